@@ -0,0 +1,710 @@
+// Replays an allocation trace recorded by AllocTraceRecorder ("Record Allocation Trace" in the stats
+// UI) under different LinearAllocator page sizes and DynamicDescriptorHeap heap sizes or tier
+// policies, and reports peak pages, wasted bytes, fragmentation and heap switches of each. Memory
+// comes back when the recorded fence completions say so, exactly like during the recording.
+// -headless replays the trace as the frame loop instead: every context finishing submits to a
+// GpuQueue over a NullQueueBackend, allocators are recycled with those fences, and the CPU time of
+// every recorded frame is reported.
+// Checks and benchmarks of the other parts of UtilityLibrary live in UtilityTests.
+//
+// Standalone, builds on Linux with
+//   g++ -std=c++14 -O2 -I../UtilityLibrary AllocTraceReplay.cpp ../UtilityLibrary/AllocationTrace.cpp
+//       ../UtilityLibrary/LinearPagePool.cpp ../UtilityLibrary/DescriptorHeapTierPolicy.cpp
+//       ../UtilityLibrary/GpuQueue.cpp ../UtilityLibrary/GpuQueueBackend.cpp -o AllocTraceReplay -pthread
+//
+// Usage: AllocTraceReplay trace.atrc [-classes 64K,256K,1M,2M] [-fixed 64K] [-heap 1024]
+//                                    [-tiers 1K,16K,64K] [-headless]
+// Every option adds one configuration and may be repeated, -tiers adds the tier policy with and
+// without growing within a command list. Without any, the current page classes, the fixed 64K GPU /
+// 2MB CPU pages they replaced, fixed heaps of 1024 and 16384 and the 1K/16K/64K tiers are compared.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AllocationTrace.h"
+#include "LinearPagePool.h"
+#include "DescriptorHeapTierPolicy.h"
+#include "GpuQueue.h"
+
+namespace
+{
+	// LinearAllocatorType of the recording, kCpuRingBuffer is replayed as CPU pages
+	enum { kGpuExclusive = 0, kCpuWritable = 1, kNumPageTypes = 2 };
+	const char* kTypeNames[kNumPageTypes] = { "GPU", "CPU" };
+
+	struct LinearConfig
+	{
+		std::string				Name;
+		std::vector<size_t>		ClassSizes[kNumPageTypes];
+		bool					Adaptive;		// LinearAllocator's class stepping, off for one fixed size
+	};
+
+	struct LinearResult
+	{
+		uint64_t	NumAllocs;
+		uint64_t	RequestedBytes;
+		uint64_t	PeakPages;
+		uint64_t	PeakBytes;
+		uint64_t	RetiredBytes;
+		uint64_t	WastedBytes;		// Alignment padding and page tails
+		uint64_t	NumLargePages;
+	};
+
+	struct DescriptorConfig
+	{
+		std::string					Name;
+		DescriptorHeapTierConfig	Tiers;			// MinTier == MaxTier for one fixed size
+	};
+
+	struct DescriptorResult
+	{
+		uint64_t	NumAllocs;
+		uint64_t	PeakHeaps;
+		uint64_t	PeakDescriptors;	// Of all heaps alive at once
+		uint64_t	NumHeapSwitches;	// Heaps filled during a command list
+		uint64_t	RetiredDescriptors;
+		uint64_t	WastedDescriptors;
+		uint64_t	NumOversized;		// Requests bigger than the largest heap
+	};
+
+	// Completed fences per queue, as seen by the recording CPU
+	class ReplayFences : public IFenceOracle
+	{
+	public:
+		ReplayFences() { memset( m_Completed, 0, sizeof( m_Completed ) ); }
+		virtual bool IsFenceComplete( uint64_t FenceValue ) override { return FenceValue <= m_Completed[FenceValue >> 56 & 0xf]; }
+		void Complete( uint64_t FenceValue )
+		{
+			uint64_t& Completed = m_Completed[FenceValue >> 56 & 0xf];
+			Completed = (std::max)( Completed, FenceValue );
+		}
+
+	private:
+		uint64_t	m_Completed[16];
+	};
+
+	class CountingStore : public ILinearPageBackingStore
+	{
+	public:
+		CountingStore() :m_NumPages( 0 ), m_Bytes( 0 ), m_PeakPages( 0 ), m_PeakBytes( 0 ) {}
+		virtual LinearPage* CreatePage( size_t SizeInByte ) override
+		{
+			m_NumPages++;
+			m_Bytes += SizeInByte;
+			m_PeakPages = (std::max)( m_PeakPages, m_NumPages );
+			m_PeakBytes = (std::max)( m_PeakBytes, m_Bytes );
+			return new LinearPage();
+		}
+		virtual void DestroyPage( LinearPage* pPage ) override
+		{
+			m_NumPages--;
+			m_Bytes -= pPage->m_SizeInByte;
+			delete pPage;
+		}
+
+		uint64_t	m_NumPages;
+		uint64_t	m_Bytes;
+		uint64_t	m_PeakPages;
+		uint64_t	m_PeakBytes;
+	};
+
+	// LinearAllocator's page path on counted memory
+	class ReplayAllocator
+	{
+	public:
+		ReplayAllocator( LinearPagePool& Pool, bool Adaptive, LinearResult& Result )
+			:m_Pool( Pool ), m_Adaptive( Adaptive ), m_Result( Result ), m_CurPage( nullptr ), m_CurOffset( 0 ),
+			m_NextClass( 0 ), m_IntervalBytes( 0 ) {}
+
+		void Allocate( uint64_t SizeInByte, uint64_t Alignment )
+		{
+			const size_t AlignedSize = (size_t)((SizeInByte + Alignment - 1) & ~(Alignment - 1));
+			m_Result.NumAllocs++;
+			m_Result.RequestedBytes += SizeInByte;
+			if (AlignedSize > m_Pool.GetMaxClassSize())
+			{
+				LinearPage* pPage = m_Pool.RequestLargePage( AlignedSize );
+				pPage->m_UsedBytes = SizeInByte;
+				m_RetiredPages.push_back( pPage );
+				m_Result.NumLargePages++;
+				return;
+			}
+			if (m_CurPage != nullptr)
+			{
+				size_t AlignedOffset = (size_t)((m_CurOffset + Alignment - 1) & ~(Alignment - 1));
+				if (AlignedOffset + AlignedSize > m_CurPage->m_SizeInByte)
+				{
+					if (m_Adaptive)
+						m_NextClass = (std::min)( m_CurPage->m_SizeClass + 1, m_Pool.GetNumClasses() - 1 );
+					RetireCurPage();
+				}
+				else
+					m_CurOffset = AlignedOffset;
+			}
+			if (m_CurPage == nullptr)
+			{
+				m_CurPage = m_Pool.RequestPage( (std::max)( m_NextClass, m_Pool.GetSizeClass( AlignedSize ) ) );
+				m_CurOffset = 0;
+				m_CurUsed = 0;
+			}
+			m_CurOffset += AlignedSize;
+			// Only what was asked for counts as used, padding is waste
+			m_CurUsed += SizeInByte;
+			m_IntervalBytes += AlignedSize;
+		}
+
+		void Cleanup( uint64_t FenceValue )
+		{
+			if (m_CurPage != nullptr)
+				RetireCurPage();
+			if (m_RetiredPages.empty())
+				return;
+			if (m_Adaptive)
+				m_NextClass = (std::min)( m_Pool.GetSizeClass( m_IntervalBytes ), m_Pool.GetNumClasses() - 1 );
+			m_IntervalBytes = 0;
+			for (auto pPage : m_RetiredPages)
+			{
+				m_Result.RetiredBytes += pPage->m_SizeInByte;
+				m_Result.WastedBytes += pPage->m_SizeInByte - pPage->m_UsedBytes;
+			}
+			m_Pool.DiscardPages( FenceValue, m_RetiredPages );
+			m_RetiredPages.clear();
+		}
+
+	private:
+		void RetireCurPage()
+		{
+			m_CurPage->m_UsedBytes = m_CurUsed;
+			m_RetiredPages.push_back( m_CurPage );
+			m_CurPage = nullptr;
+		}
+
+		LinearPagePool&				m_Pool;
+		bool						m_Adaptive;
+		LinearResult&				m_Result;
+		LinearPage*					m_CurPage;
+		size_t						m_CurOffset;
+		size_t						m_CurUsed;
+		uint32_t					m_NextClass;
+		size_t						m_IntervalBytes;
+		std::vector<LinearPage*>	m_RetiredPages;
+	};
+
+	// Heaps waiting for reuse and heaps created, shared by all contexts
+	struct ReplayHeapPool
+	{
+		std::vector<uint64_t>	RetiredHeaps[kNumDescriptorHeapTiers];		// Fence of every heap
+		uint64_t				NumLiveHeaps;
+		uint64_t				NumLiveDescriptors;
+	};
+
+	// DynamicDescriptorHeap: bump allocation in heaps of the tier its policy picks, recycled once
+	// their fence completed
+	class ReplayDescriptorHeap
+	{
+	public:
+		ReplayDescriptorHeap( DescriptorResult& Result, IFenceOracle& Fences, ReplayHeapPool& Pool, const DescriptorHeapTierConfig& Tiers )
+			:m_Result( Result ), m_Fences( Fences ), m_Pool( Pool ), m_Policy( Tiers ), m_HasHeap( false ), m_Tier( 0 ), m_Offset( 0 ) {}
+
+		void Allocate( uint64_t Count )
+		{
+			const DescriptorHeapTierConfig& Tiers = m_Policy.GetConfig();
+			m_Result.NumAllocs++;
+			if (Count > Tiers.TierSizes[Tiers.MaxTier])
+			{
+				m_Result.NumOversized++;
+				return;
+			}
+			if (m_HasHeap && m_Offset + Count > Tiers.TierSizes[m_Tier])
+			{
+				RetireCurrentHeap();
+				m_Policy.OnHeapSwitch();
+				m_Result.NumHeapSwitches++;
+			}
+			if (!m_HasHeap)
+			{
+				// DynamicDescriptorHeap never stages more than its smallest heap, a trace may
+				uint32_t Tier = m_Policy.GetHeapTier();
+				while (Count > Tiers.TierSizes[Tier])
+					Tier++;
+				RequestHeap( Tier );
+			}
+			m_Offset += (uint32_t)Count;
+			m_Policy.OnAllocate( (uint32_t)Count );
+		}
+
+		void Cleanup( uint64_t FenceValue )
+		{
+			RetireCurrentHeap();
+			for (uint32_t Tier = 0; Tier < kNumDescriptorHeapTiers; ++Tier)
+			{
+				m_Pool.RetiredHeaps[Tier].insert( m_Pool.RetiredHeaps[Tier].end(), m_NumUsedHeaps[Tier], FenceValue );
+				m_NumUsedHeaps[Tier] = 0;
+			}
+			m_Policy.EndFrame();
+		}
+
+	private:
+		void RetireCurrentHeap()
+		{
+			if (!m_HasHeap)
+				return;
+			uint32_t HeapSize = m_Policy.GetConfig().TierSizes[m_Tier];
+			m_Result.RetiredDescriptors += HeapSize;
+			m_Result.WastedDescriptors += HeapSize - m_Offset;
+			m_NumUsedHeaps[m_Tier]++;
+			m_HasHeap = false;
+		}
+
+		void RequestHeap( uint32_t Tier )
+		{
+			m_HasHeap = true;
+			m_Tier = Tier;
+			m_Offset = 0;
+			// Any heap of the tier whose fence completed will do
+			std::vector<uint64_t>& RetiredHeaps = m_Pool.RetiredHeaps[Tier];
+			for (auto iter = RetiredHeaps.begin(); iter != RetiredHeaps.end(); ++iter)
+			{
+				if (m_Fences.IsFenceComplete( *iter ))
+				{
+					RetiredHeaps.erase( iter );
+					return;
+				}
+			}
+			m_Pool.NumLiveHeaps++;
+			m_Pool.NumLiveDescriptors += m_Policy.GetConfig().TierSizes[Tier];
+			m_Result.PeakHeaps = (std::max)( m_Result.PeakHeaps, m_Pool.NumLiveHeaps );
+			m_Result.PeakDescriptors = (std::max)( m_Result.PeakDescriptors, m_Pool.NumLiveDescriptors );
+		}
+
+		DescriptorResult&			m_Result;
+		IFenceOracle&				m_Fences;
+		ReplayHeapPool&				m_Pool;
+		DescriptorHeapTierPolicy	m_Policy;
+		uint32_t					m_NumUsedHeaps[kNumDescriptorHeapTiers] = {};	// Retired since the last cleanup
+		bool						m_HasHeap;
+		uint32_t					m_Tier;
+		uint32_t					m_Offset;
+	};
+
+	void ReplayLinear( AllocTraceReader& Reader, const LinearConfig& Config, LinearResult Results[kNumPageTypes] )
+	{
+		ReplayFences Fences;
+		CountingStore Stores[kNumPageTypes];
+		std::unique_ptr<LinearPagePool> Pools[kNumPageTypes];
+		for (uint32_t Type = 0; Type < kNumPageTypes; ++Type)
+		{
+			memset( &Results[Type], 0, sizeof( LinearResult ) );
+			Pools[Type].reset( new LinearPagePool( Config.ClassSizes[Type].data(), (uint32_t)Config.ClassSizes[Type].size() ) );
+			Pools[Type]->SetBackend( &Stores[Type], &Fences );
+			Pools[Type]->SetUseMagazines( false );
+		}
+
+		// Allocators can change between kCpuWritable and kCpuRingBuffer, both replay as CPU pages
+		std::vector<std::unique_ptr<ReplayAllocator>> Allocators[kNumPageTypes];
+		AllocTraceRecord Record;
+		Reader.Rewind();
+		while (Reader.Next( Record ))
+		{
+			switch (Record.Event)
+			{
+			case kTraceLinearAlloc:
+			{
+				uint32_t Type = Record.Type == kGpuExclusive ? kGpuExclusive : kCpuWritable;
+				if (Record.Id >= Allocators[Type].size())
+					Allocators[Type].resize( Record.Id + 1 );
+				if (!Allocators[Type][Record.Id])
+					Allocators[Type][Record.Id].reset( new ReplayAllocator( *Pools[Type], Config.Adaptive, Results[Type] ) );
+				Allocators[Type][Record.Id]->Allocate( Record.Size, Record.Alignment );
+				break;
+			}
+			case kTraceLinearCleanup:
+				for (uint32_t Type = 0; Type < kNumPageTypes; ++Type)
+					if (Record.Id < Allocators[Type].size() && Allocators[Type][Record.Id])
+						Allocators[Type][Record.Id]->Cleanup( Record.FenceValue );
+				break;
+			case kTraceFenceComplete:
+				Fences.Complete( Record.FenceValue );
+				break;
+			default:
+				break;
+			}
+		}
+		for (uint32_t Type = 0; Type < kNumPageTypes; ++Type)
+		{
+			Results[Type].PeakPages = Stores[Type].m_PeakPages;
+			Results[Type].PeakBytes = Stores[Type].m_PeakBytes;
+			// Hand back what is still recorded into at the end of the trace, so the pool frees it
+			for (auto& pAllocator : Allocators[Type])
+				if (pAllocator) pAllocator->Cleanup( 0 );
+		}
+	}
+
+	DescriptorResult ReplayDescriptors( AllocTraceReader& Reader, const DescriptorConfig& Config )
+	{
+		DescriptorResult Result;
+		memset( &Result, 0, sizeof( Result ) );
+		ReplayFences Fences;
+		ReplayHeapPool Pool;
+		Pool.NumLiveHeaps = 0;
+		Pool.NumLiveDescriptors = 0;
+		std::vector<std::unique_ptr<ReplayDescriptorHeap>> Heaps;
+		AllocTraceRecord Record;
+		Reader.Rewind();
+		while (Reader.Next( Record ))
+		{
+			if (Record.Event == kTraceDescriptorAlloc || Record.Event == kTraceDescriptorCleanup)
+			{
+				if (Record.Id >= Heaps.size())
+					Heaps.resize( Record.Id + 1 );
+				if (!Heaps[Record.Id])
+					Heaps[Record.Id].reset( new ReplayDescriptorHeap( Result, Fences, Pool, Config.Tiers ) );
+				if (Record.Event == kTraceDescriptorAlloc)
+					Heaps[Record.Id]->Allocate( Record.Size );
+				else
+					Heaps[Record.Id]->Cleanup( Record.FenceValue );
+			}
+			else if (Record.Event == kTraceFenceComplete)
+				Fences.Complete( Record.FenceValue );
+		}
+		return Result;
+	}
+
+	// One GpuQueue per queue type over NullQueueBackends. A recorded cleanup fence is a context
+	// finishing, the first cleanup seeing it submits to the queue of its type and the allocators are
+	// retired with the new fence instead.
+	class HeadlessQueues : public IFenceOracle
+	{
+	public:
+		enum { kNumQueueTypes = 4 };		// D3D12_COMMAND_LIST_TYPE DIRECT to COPY
+
+		HeadlessQueues()
+		{
+			for (uint32_t Type = 0; Type < kNumQueueTypes; ++Type)
+			{
+				m_Queues[Type].reset( new GpuQueue( Type ) );
+				m_Backends[Type].reset( new NullQueueBackend( m_Queues[Type]->GetInitialFence() ) );
+				m_Backends[Type]->SetRecording( false );
+				m_Queues[Type]->Create( m_Backends[Type].get() );
+			}
+		}
+
+		uint64_t Submit( uint64_t RecordedFence )
+		{
+			auto Result = m_Fences.insert( std::make_pair( RecordedFence, 0ull ) );
+			if (Result.second)
+			{
+				static int s_CommandList;
+				void* pList = &s_CommandList;
+				Result.first->second = m_Queues[RecordedFence >> 56 & 3]->Execute( 1, &pList );
+			}
+			return Result.first->second;
+		}
+
+		virtual bool IsFenceComplete( uint64_t FenceValue ) override { return m_Queues[FenceValue >> 56 & 3]->IsFenceComplete( FenceValue ); }
+		uint64_t GetNumSubmissions( uint32_t Type ) const { return m_Backends[Type]->GetNumSubmissions(); }
+
+	private:
+		std::unique_ptr<GpuQueue>						m_Queues[kNumQueueTypes];
+		std::unique_ptr<NullQueueBackend>				m_Backends[kNumQueueTypes];
+		std::unordered_map<uint64_t, uint64_t>			m_Fences;		// Recorded to replayed
+	};
+
+	struct HeadlessResult
+	{
+		uint64_t				NumEvents;
+		uint64_t				NumSubmissions[HeadlessQueues::kNumQueueTypes];
+		std::vector<double>		FrameMicros;	// CPU time of every frame, one for a trace without frames
+	};
+
+	// The frame loop with the current page classes and heap tiers, decoding is kept out of the timing
+	HeadlessResult ReplayHeadless( AllocTraceReader& Reader )
+	{
+		HeadlessResult Result;
+		memset( Result.NumSubmissions, 0, sizeof( Result.NumSubmissions ) );
+		std::vector<AllocTraceRecord> Records;
+		AllocTraceRecord Record;
+		Reader.Rewind();
+		while (Reader.Next( Record ))
+			Records.push_back( Record );
+		Result.NumEvents = Records.size();
+
+		HeadlessQueues Queues;
+		const size_t ClassSizes[] = { 0x10000, 0x40000, 0x100000, 0x200000 };
+		CountingStore Stores[kNumPageTypes];
+		std::unique_ptr<LinearPagePool> Pools[kNumPageTypes];
+		LinearResult LinearResults[kNumPageTypes];
+		memset( LinearResults, 0, sizeof( LinearResults ) );
+		for (uint32_t Type = 0; Type < kNumPageTypes; ++Type)
+		{
+			Pools[Type].reset( new LinearPagePool( ClassSizes, 4 ) );
+			Pools[Type]->SetBackend( &Stores[Type], &Queues );
+		}
+		std::vector<std::unique_ptr<ReplayAllocator>> Allocators[kNumPageTypes];
+		DescriptorResult HeapResult;
+		memset( &HeapResult, 0, sizeof( HeapResult ) );
+		ReplayHeapPool HeapPool;
+		HeapPool.NumLiveHeaps = 0;
+		HeapPool.NumLiveDescriptors = 0;
+		std::vector<std::unique_ptr<ReplayDescriptorHeap>> Heaps;
+
+		auto FrameStart = std::chrono::high_resolution_clock::now();
+		for (auto& R : Records)
+		{
+			switch (R.Event)
+			{
+			case kTraceLinearAlloc:
+			{
+				uint32_t Type = R.Type == kGpuExclusive ? kGpuExclusive : kCpuWritable;
+				if (R.Id >= Allocators[Type].size())
+					Allocators[Type].resize( R.Id + 1 );
+				if (!Allocators[Type][R.Id])
+					Allocators[Type][R.Id].reset( new ReplayAllocator( *Pools[Type], true, LinearResults[Type] ) );
+				Allocators[Type][R.Id]->Allocate( R.Size, R.Alignment );
+				break;
+			}
+			case kTraceLinearCleanup:
+			{
+				uint64_t FenceValue = Queues.Submit( R.FenceValue );
+				for (uint32_t Type = 0; Type < kNumPageTypes; ++Type)
+					if (R.Id < Allocators[Type].size() && Allocators[Type][R.Id])
+						Allocators[Type][R.Id]->Cleanup( FenceValue );
+				break;
+			}
+			case kTraceDescriptorAlloc:
+			case kTraceDescriptorCleanup:
+				if (R.Id >= Heaps.size())
+					Heaps.resize( R.Id + 1 );
+				if (!Heaps[R.Id])
+					Heaps[R.Id].reset( new ReplayDescriptorHeap( HeapResult, Queues, HeapPool, DescriptorHeapTierConfig() ) );
+				if (R.Event == kTraceDescriptorAlloc)
+					Heaps[R.Id]->Allocate( R.Size );
+				else
+					Heaps[R.Id]->Cleanup( Queues.Submit( R.FenceValue ) );
+				break;
+			case kTraceFrame:
+			{
+				auto Now = std::chrono::high_resolution_clock::now();
+				Result.FrameMicros.push_back( std::chrono::duration<double, std::micro>( Now - FrameStart ).count() );
+				FrameStart = Now;
+				break;
+			}
+			default:
+				break;
+			}
+		}
+		if (Result.FrameMicros.empty())
+			Result.FrameMicros.push_back( std::chrono::duration<double, std::micro>( std::chrono::high_resolution_clock::now() - FrameStart ).count() );
+
+		for (uint32_t Type = 0; Type < HeadlessQueues::kNumQueueTypes; ++Type)
+			Result.NumSubmissions[Type] = Queues.GetNumSubmissions( Type );
+		for (uint32_t Type = 0; Type < kNumPageTypes; ++Type)
+		{
+			for (auto& pAllocator : Allocators[Type])
+				if (pAllocator) pAllocator->Cleanup( 0 );
+		}
+		return Result;
+	}
+
+	void PrintHeadless( const HeadlessResult& R )
+	{
+		std::vector<double> Sorted = R.FrameMicros;
+		std::sort( Sorted.begin(), Sorted.end() );
+		double Total = 0;
+		for (auto Micros : Sorted)
+			Total += Micros;
+		printf( "\n%-24s %10s %10s %10s %10s %10s %10s %10s\n", "Headless frame loop", "Frames", "Events", "Submits",
+			"Mean us", "P50 us", "P99 us", "Max us" );
+		printf( "%-24s %10zu %10llu %10llu %10.2f %10.2f %10.2f %10.2f\n", "null queues", Sorted.size(),
+			(unsigned long long)R.NumEvents, (unsigned long long)(R.NumSubmissions[0] + R.NumSubmissions[2] + R.NumSubmissions[3]),
+			Total / Sorted.size(), Sorted[Sorted.size() / 2], Sorted[(size_t)(Sorted.size() * 0.99)], Sorted.back() );
+	}
+
+	bool ParseSize( const char* pText, size_t& Size )
+	{
+		char* pEnd;
+		Size = strtoull( pText, &pEnd, 10 );
+		if (*pEnd == 'K' || *pEnd == 'k') { Size <<= 10; pEnd++; }
+		else if (*pEnd == 'M' || *pEnd == 'm') { Size <<= 20; pEnd++; }
+		return Size != 0 && (*pEnd == '\0' || *pEnd == ',');
+	}
+
+	bool ParseSizeList( const char* pText, std::vector<size_t>& Sizes )
+	{
+		Sizes.clear();
+		for (const char* p = pText; p != nullptr; p = strchr( p, ',' ) ? strchr( p, ',' ) + 1 : nullptr)
+		{
+			size_t Size;
+			if (!ParseSize( p, Size ) || (!Sizes.empty() && Size <= Sizes.back()) || Sizes.size() == LinearPagePool::kMaxSizeClasses)
+				return false;
+			Sizes.push_back( Size );
+		}
+		return !Sizes.empty();
+	}
+
+	DescriptorConfig FixedHeapConfig( uint32_t HeapSize )
+	{
+		DescriptorConfig Config;
+		char Name[32];
+		snprintf( Name, sizeof( Name ), "heap %u", HeapSize );
+		Config.Name = Name;
+		for (uint32_t Tier = 0; Tier < kNumDescriptorHeapTiers; ++Tier)
+			Config.Tiers.TierSizes[Tier] = HeapSize;
+		Config.Tiers.MinTier = Config.Tiers.MaxTier = 0;
+		return Config;
+	}
+
+	// The tier policy as DynamicDescriptorHeap runs it, and without growing within a command list
+	void AddTierConfigs( const char* pSizes, const uint32_t TierSizes[kNumDescriptorHeapTiers], std::vector<DescriptorConfig>& Configs )
+	{
+		for (int GrowWithinFrame = 1; GrowWithinFrame >= 0; --GrowWithinFrame)
+		{
+			DescriptorConfig Config;
+			Config.Name = std::string( GrowWithinFrame ? "tiers " : "tiers/frame " ) + pSizes;
+			for (uint32_t Tier = 0; Tier < kNumDescriptorHeapTiers; ++Tier)
+				Config.Tiers.TierSizes[Tier] = TierSizes[Tier];
+			Config.Tiers.GrowWithinFrame = GrowWithinFrame != 0;
+			Configs.push_back( Config );
+		}
+	}
+
+	void PrintLinear( const LinearConfig& Config, const LinearResult Results[kNumPageTypes] )
+	{
+		for (uint32_t Type = 0; Type < kNumPageTypes; ++Type)
+		{
+			const LinearResult& R = Results[Type];
+			if (R.NumAllocs == 0)
+				continue;
+			printf( "%-24s %-4s %10llu %10.2f %8llu %10.2f %10.2f %10.2f %7.1f%% %8llu\n", Config.Name.c_str(), kTypeNames[Type],
+				(unsigned long long)R.NumAllocs, R.RequestedBytes / 1048576.0, (unsigned long long)R.PeakPages,
+				R.PeakBytes / 1048576.0, R.RetiredBytes / 1048576.0, R.WastedBytes / 1048576.0,
+				R.RetiredBytes ? R.WastedBytes * 100.0 / R.RetiredBytes : 0.0, (unsigned long long)R.NumLargePages );
+		}
+	}
+}
+
+int main( int argc, char* argv[] )
+{
+	if (argc < 2)
+	{
+		fprintf( stderr, "Usage: %s trace.atrc [-classes 64K,256K,1M,2M] [-fixed 64K] [-heap 1024] [-tiers 1K,16K,64K] [-headless]\n", argv[0] );
+		return 1;
+	}
+	std::vector<LinearConfig> LinearConfigs;
+	std::vector<DescriptorConfig> DescriptorConfigs;
+	bool Headless = false;
+	for (int i = 2; i < argc; ++i)
+	{
+		LinearConfig Config;
+		if (strcmp( argv[i], "-headless" ) == 0)
+		{
+			Headless = true;
+			continue;
+		}
+		bool IsOption = strcmp( argv[i], "-classes" ) == 0 || strcmp( argv[i], "-fixed" ) == 0 || strcmp( argv[i], "-heap" ) == 0 ||
+			strcmp( argv[i], "-tiers" ) == 0;
+		if (!IsOption || i + 1 >= argc)
+		{
+			fprintf( stderr, IsOption ? "Missing value of %s\n" : "Unknown option %s\n", argv[i] );
+			return 1;
+		}
+		if (strcmp( argv[i], "-classes" ) == 0 || strcmp( argv[i], "-fixed" ) == 0)
+		{
+			Config.Adaptive = strcmp( argv[i], "-classes" ) == 0;
+			Config.Name = std::string( Config.Adaptive ? "classes " : "fixed " ) + argv[i + 1];
+			if (!ParseSizeList( argv[++i], Config.ClassSizes[0] ) || (!Config.Adaptive && Config.ClassSizes[0].size() != 1))
+			{
+				fprintf( stderr, "Bad page sizes %s\n", argv[i] );
+				return 1;
+			}
+			Config.ClassSizes[1] = Config.ClassSizes[0];
+			LinearConfigs.push_back( Config );
+		}
+		else if (strcmp( argv[i], "-heap" ) == 0)
+		{
+			size_t HeapSize;
+			if (!ParseSize( argv[++i], HeapSize ))
+			{
+				fprintf( stderr, "Bad heap size %s\n", argv[i] );
+				return 1;
+			}
+			DescriptorConfigs.push_back( FixedHeapConfig( (uint32_t)HeapSize ) );
+		}
+		else if (strcmp( argv[i], "-tiers" ) == 0)
+		{
+			std::vector<size_t> Sizes;
+			if (!ParseSizeList( argv[++i], Sizes ) || Sizes.size() != kNumDescriptorHeapTiers)
+			{
+				fprintf( stderr, "Bad heap tiers %s, %d sizes expected\n", argv[i], kNumDescriptorHeapTiers );
+				return 1;
+			}
+			uint32_t TierSizes[kNumDescriptorHeapTiers];
+			for (uint32_t Tier = 0; Tier < kNumDescriptorHeapTiers; ++Tier)
+				TierSizes[Tier] = (uint32_t)Sizes[Tier];
+			AddTierConfigs( argv[i], TierSizes, DescriptorConfigs );
+		}
+	}
+	if (LinearConfigs.empty())
+	{
+		LinearConfig Classes;
+		Classes.Name = "classes 64K..2M";
+		Classes.Adaptive = true;
+		Classes.ClassSizes[0] = { 0x10000, 0x40000, 0x100000, 0x200000 };
+		Classes.ClassSizes[1] = Classes.ClassSizes[0];
+		LinearConfig Fixed;
+		Fixed.Name = "fixed 64K GPU/2M CPU";
+		Fixed.Adaptive = false;
+		Fixed.ClassSizes[0] = { 0x10000 };
+		Fixed.ClassSizes[1] = { 0x200000 };
+		LinearConfigs.push_back( Classes );
+		LinearConfigs.push_back( Fixed );
+	}
+	if (DescriptorConfigs.empty())
+	{
+		DescriptorHeapTierConfig Default;
+		DescriptorConfigs.push_back( FixedHeapConfig( 1024 ) );
+		DescriptorConfigs.push_back( FixedHeapConfig( 16384 ) );
+		AddTierConfigs( "1K,16K,64K", Default.TierSizes, DescriptorConfigs );
+	}
+
+	AllocTraceReader Reader;
+	if (!Reader.Open( argv[1] ))
+	{
+		fprintf( stderr, "Can't read trace %s\n", argv[1] );
+		return 1;
+	}
+	if (Headless)
+	{
+		PrintHeadless( ReplayHeadless( Reader ) );
+		return 0;
+	}
+
+	printf( "%-24s %-4s %10s %10s %8s %10s %10s %10s %8s %8s\n", "LinearAllocator", "Type", "Allocs", "Asked MB",
+		"PeakPgs", "Peak MB", "Retired MB", "Wasted MB", "Frag", "Large" );
+	for (auto& Config : LinearConfigs)
+	{
+		LinearResult Results[kNumPageTypes];
+		ReplayLinear( Reader, Config, Results );
+		PrintLinear( Config, Results );
+	}
+
+	printf( "\n%-24s %10s %10s %10s %10s %12s %12s %8s %10s\n", "DynamicDescriptorHeap", "Allocs", "PeakHeaps", "PeakDescs",
+		"Switches", "Retired", "Wasted", "Frag", "Oversized" );
+	for (auto& Config : DescriptorConfigs)
+	{
+		DescriptorResult R = ReplayDescriptors( Reader, Config );
+		printf( "%-24s %10llu %10llu %10llu %10llu %12llu %12llu %7.1f%% %10llu\n", Config.Name.c_str(), (unsigned long long)R.NumAllocs,
+			(unsigned long long)R.PeakHeaps, (unsigned long long)R.PeakDescriptors, (unsigned long long)R.NumHeapSwitches,
+			(unsigned long long)R.RetiredDescriptors, (unsigned long long)R.WastedDescriptors,
+			R.RetiredDescriptors ? R.WastedDescriptors * 100.0 / R.RetiredDescriptors : 0.0, (unsigned long long)R.NumOversized );
+	}
+	return 0;
+}
@@ -0,0 +1,185 @@
+#include "PortableAssert.h"
+#include "BoidsAsyncCompute.h"
+#include "SimulatedGpuTimeline.h"
+#include "GpuQueue.h"
+
+#include <algorithm>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// BoidsBufferRing
+//--------------------------------------------------------------------------------------
+void BoidsBufferRing::Reset( uint32_t LatestIdx, uint64_t DirectFence )
+{
+	ASSERT( LatestIdx < kNumBuffers );
+	m_LatestIdx = LatestIdx;
+	m_LatestFence = 0;
+	m_RenderWaitPending = false;
+	for (uint32_t i = 0; i < kNumBuffers; ++i)
+		m_LastReadFence[i] = DirectFence;
+}
+
+void BoidsBufferRing::RenderSubmitted( uint32_t RenderIdx, uint64_t DirectFence )
+{
+	m_LastReadFence[RenderIdx] = (std::max)( m_LastReadFence[RenderIdx], DirectFence );
+	if (RenderIdx == m_LatestIdx)
+		m_RenderWaitPending = false;
+}
+
+uint64_t BoidsBufferRing::PlanSimulation( uint32_t NumSteps, BoidsSimulationPass* pPasses ) const
+{
+	ASSERT( NumSteps <= kMaxSteps );
+	if (NumSteps == 0)
+		return 0;
+	// The two buffers this frame doesn't render, the one read longer ago is written first
+	uint32_t Spare[2];
+	for (uint32_t i = 0, n = 0; i < kNumBuffers; ++i)
+		if (i != m_LatestIdx) Spare[n++] = i;
+	if (m_LastReadFence[Spare[1]] < m_LastReadFence[Spare[0]])
+		std::swap( Spare[0], Spare[1] );
+
+	uint32_t ReadIdx = m_LatestIdx;
+	for (uint32_t Step = 0; Step < NumSteps; ++Step)
+	{
+		pPasses[Step].ReadIdx = ReadIdx;
+		pPasses[Step].WriteIdx = Spare[Step & 1];
+		ReadIdx = pPasses[Step].WriteIdx;
+	}
+	// Direct fences only grow, the later of the written buffers' last reads covers both
+	return NumSteps == 1 ? m_LastReadFence[Spare[0]] : (std::max)( m_LastReadFence[Spare[0]], m_LastReadFence[Spare[1]] );
+}
+
+void BoidsBufferRing::SimulationSubmitted( uint32_t NumSteps, const BoidsSimulationPass* pPasses, uint64_t ComputeFence )
+{
+	if (NumSteps == 0)
+		return;
+	m_LatestIdx = pPasses[NumSteps - 1].WriteIdx;
+	m_LatestFence = ComputeFence;
+	m_RenderWaitPending = true;
+}
+
+//--------------------------------------------------------------------------------------
+// CheckBoidsAsyncSchedule
+//--------------------------------------------------------------------------------------
+namespace
+{
+	enum { kDirect = 0, kCompute = 2 };
+	const uint32_t kFramesInFlight = 2;
+
+	struct BufferAccess
+	{
+		double		Start;
+		double		End;
+		uint32_t	Queue;
+		bool		IsWrite;
+	};
+
+	class AccessChecker
+	{
+	public:
+		AccessChecker() :m_NumHazards( 0 ) {}
+		void Add( uint32_t Buffer, double Start, double End, uint32_t Queue, bool IsWrite )
+		{
+			// A write may not overlap anything of the other queue, a read no write of it
+			for (const BufferAccess& Access : m_Accesses[Buffer])
+				if (Access.Queue != Queue && (IsWrite || Access.IsWrite) && Start < Access.End && Access.Start < End)
+					m_NumHazards++;
+			BufferAccess Access = { Start, End, Queue, IsWrite };
+			m_Accesses[Buffer].push_back( Access );
+		}
+		// Accesses which ended before Time can't overlap anything submitted from now on
+		void Prune( double Time )
+		{
+			for (auto& Accesses : m_Accesses)
+				Accesses.erase( std::remove_if( Accesses.begin(), Accesses.end(),
+					[Time]( const BufferAccess& Access ) { return Access.End <= Time; } ), Accesses.end() );
+		}
+		uint64_t GetNumHazards() const { return m_NumHazards; }
+
+	private:
+		std::vector<BufferAccess>	m_Accesses[BoidsBufferRing::kNumBuffers];
+		uint64_t					m_NumHazards;
+	};
+}
+
+BoidsAsyncCheckResult CheckBoidsAsyncSchedule( uint32_t NumFrames, double SimUsPerStep, double RenderUs, double CpuFrameUs, uint32_t Seed )
+{
+	SimulatedGpuTimeline Timeline;
+	SimulatedQueueConfig DirectConfig = { 50.0, RenderUs };
+	SimulatedQueueConfig ComputeConfig = { 50.0, SimUsPerStep };
+	Timeline.Configure( kDirect, DirectConfig );
+	Timeline.Configure( kCompute, ComputeConfig );
+	GpuQueue DirectQueue( kDirect ), ComputeQueue( kCompute );
+	DirectQueue.Create( Timeline.GetBackend( kDirect ) );
+	ComputeQueue.Create( Timeline.GetBackend( kCompute ) );
+
+	BoidsBufferRing Ring;
+	AccessChecker Checker;
+	std::vector<uint64_t> FrameFences;
+	uint32_t Random = Seed * 0x9e3779b9u + 1;
+	uint32_t NewestWritten = Ring.GetRenderIdx();
+	uint64_t NumStaleRenders = 0;
+	double DirectBusyUs = 0, OverlapUs = 0;
+	double ComputeStart = 0, ComputeEnd = 0;
+	void* const pList = nullptr;
+	void* Lists[BoidsBufferRing::kMaxSteps] = {};
+
+	for (uint32_t Frame = 0; Frame < NumFrames; ++Frame)
+	{
+		if (Frame >= kFramesInFlight)
+		{
+			double StallMs;
+			DirectQueue.WaitForFence( FrameFences[Frame - kFramesInFlight], StallMs );
+		}
+		Checker.Prune( Timeline.GetNow() );
+
+		const uint32_t RenderIdx = Ring.GetRenderIdx();
+		const uint64_t RenderWait = Ring.GetRenderWaitFence();
+		if (RenderIdx != NewestWritten)
+			NumStaleRenders++;
+
+		Random = Random * 1664525u + 1013904223u;
+		const uint32_t NumSteps = (Random >> 16) % 4;
+		BoidsSimulationPass Passes[BoidsBufferRing::kMaxSteps];
+		uint64_t SimWait = Ring.PlanSimulation( NumSteps, Passes );
+		if (NumSteps != 0)
+		{
+			if (SimWait != 0)
+				ComputeQueue.GpuWait( SimWait );
+			uint64_t SimFence = ComputeQueue.Execute( NumSteps, Lists );
+			Ring.SimulationSubmitted( NumSteps, Passes, SimFence );
+			ComputeStart = Timeline.GetStartTime( SimFence );
+			ComputeEnd = Timeline.GetCompletionTime( SimFence );
+			for (uint32_t Step = 0; Step < NumSteps; ++Step)
+			{
+				double Start = ComputeStart + Step * SimUsPerStep;
+				Checker.Add( Passes[Step].ReadIdx, Start, Start + SimUsPerStep, kCompute, false );
+				Checker.Add( Passes[Step].WriteIdx, Start, Start + SimUsPerStep, kCompute, true );
+			}
+			NewestWritten = Passes[NumSteps - 1].WriteIdx;
+		}
+
+		if (RenderWait != 0)
+			DirectQueue.GpuWait( RenderWait );
+		uint64_t RenderFence = DirectQueue.Execute( 1, &pList );
+		Ring.RenderSubmitted( RenderIdx, RenderFence );
+		double RenderStart = Timeline.GetStartTime( RenderFence );
+		double RenderEnd = Timeline.GetCompletionTime( RenderFence );
+		Checker.Add( RenderIdx, RenderStart, RenderEnd, kDirect, false );
+		DirectBusyUs += RenderEnd - RenderStart;
+		OverlapUs += (std::max)( 0.0, (std::min)( RenderEnd, ComputeEnd ) - (std::max)( RenderStart, ComputeStart ) );
+		FrameFences.push_back( RenderFence );
+
+		Timeline.AdvanceCpu( CpuFrameUs );
+	}
+
+	BoidsAsyncCheckResult Result;
+	Result.NumFrames = NumFrames;
+	Result.NumHazards = Checker.GetNumHazards();
+	Result.NumStaleRenders = NumStaleRenders;
+	Result.OverlapPercent = DirectBusyUs > 0 ? OverlapUs * 100.0 / DirectBusyUs : 0.0;
+	Result.FrameMs = NumFrames ? Timeline.GetNow() / 1000.0 / NumFrames : 0.0;
+	DirectQueue.Destroy();
+	ComputeQueue.Destroy();
+	return Result;
+}
@@ -0,0 +1,56 @@
+#pragma once
+// Three buffer rotation of the async compute mode, the render reads what the compute queue wrote a frame before.
+
+#include <stdint.h>
+
+struct BoidsSimulationPass
+{
+	uint32_t	ReadIdx;
+	uint32_t	WriteIdx;
+};
+
+//--------------------------------------------------------------------------------------
+// BoidsBufferRing
+//--------------------------------------------------------------------------------------
+class BoidsBufferRing
+{
+public:
+	enum { kNumBuffers = 3, kMaxSteps = 16 };
+
+	BoidsBufferRing() { Reset( 0, 0 ); }
+
+	// LatestIdx holds the current state, none of the buffers may be touched before DirectFence
+	void Reset( uint32_t LatestIdx, uint64_t DirectFence );
+
+	// What this frame renders, ask before planning the simulation
+	uint32_t GetRenderIdx() const { return m_LatestIdx; }
+	// Compute fence the direct queue has to wait for before rendering it, 0 if waited already
+	uint64_t GetRenderWaitFence() const { return m_RenderWaitPending ? m_LatestFence : 0; }
+	void RenderSubmitted( uint32_t RenderIdx, uint64_t DirectFence );
+
+	// Fills NumSteps passes starting from the latest result, returns the direct fence the compute
+	// queue has to wait for before running them, 0 if none
+	uint64_t PlanSimulation( uint32_t NumSteps, BoidsSimulationPass* pPasses ) const;
+	void SimulationSubmitted( uint32_t NumSteps, const BoidsSimulationPass* pPasses, uint64_t ComputeFence );
+
+	// Compute fence of the newest result, 0 if there was no simulation since Reset()
+	uint64_t GetLatestFence() const { return m_LatestFence; }
+
+private:
+	uint32_t	m_LatestIdx;
+	uint64_t	m_LatestFence;
+	bool		m_RenderWaitPending;
+	uint64_t	m_LastReadFence[kNumBuffers];		// Direct fence of the last render which read it
+};
+
+struct BoidsAsyncCheckResult
+{
+	uint32_t	NumFrames;
+	uint64_t	NumHazards;			// Buffer written while the other queue could access it
+	uint64_t	NumStaleRenders;	// Render not reading the newest submitted result
+	double		OverlapPercent;		// Of the direct queue's busy time the compute queue ran alongside
+	double		FrameMs;
+};
+
+// Random substep counts of 0 to 3 per frame, 2 frames in flight
+BoidsAsyncCheckResult CheckBoidsAsyncSchedule( uint32_t NumFrames, double SimUsPerStep, double RenderUs, double CpuFrameUs, uint32_t Seed );
@@ -0,0 +1,439 @@
+#include "BoidsEngine.h"
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	// Shader static constant
+	const float softeningSquared = 0.0012500000f*0.0012500000f;
+
+	struct vec3
+	{
+		float x, y, z;
+		vec3() :x( 0.f ), y( 0.f ), z( 0.f ) {}
+		vec3( float s ) :x( s ), y( s ), z( s ) {}
+		vec3( float _x, float _y, float _z ) :x( _x ), y( _y ), z( _z ) {}
+		vec3( const float3& f ) :x( f.x ), y( f.y ), z( f.z ) {}
+		float3 ToFloat3() const { return float3( x, y, z ); }
+
+		vec3 operator+( const vec3& o ) const { return vec3( x + o.x, y + o.y, z + o.z ); }
+		vec3 operator-( const vec3& o ) const { return vec3( x - o.x, y - o.y, z - o.z ); }
+		vec3 operator*( const vec3& o ) const { return vec3( x * o.x, y * o.y, z * o.z ); }
+		vec3 operator*( float s ) const { return vec3( x * s, y * s, z * s ); }
+		vec3 operator/( float s ) const { return vec3( x / s, y / s, z / s ); }
+		vec3 operator-() const { return vec3( -x, -y, -z ); }
+		vec3& operator+=( const vec3& o ) { x += o.x; y += o.y; z += o.z; return *this; }
+		vec3& operator-=( const vec3& o ) { x -= o.x; y -= o.y; z -= o.z; return *this; }
+	};
+
+	inline float dot( const vec3& a, const vec3& b ) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline float length( const vec3& a ) { return sqrtf( dot( a, a ) ); }
+	inline vec3 normalize( const vec3& a ) { return a / length( a ); }
+	inline vec3 vmax( const vec3& a, const vec3& b ) { return vec3( (std::max)( a.x, b.x ), (std::max)( a.y, b.y ), (std::max)( a.z, b.z ) ); }
+
+	//--------------------------------------------------------------------------------------
+	// Line by line port of the utility functions in BoidsSimulation_shader.hlsl
+	//--------------------------------------------------------------------------------------
+	// Calculate cohesion force
+	inline vec3 Cohesion( const SimulationCB& cb, const vec3& localPos, const vec3& avgPos )
+	{
+		vec3 delta = avgPos - localPos;
+		float deltaSqr = dot( delta, delta ) + softeningSquared;
+		float invDelta = 1.0f / sqrtf( deltaSqr );
+		return delta * (cb.fCohesionFactor * invDelta);
+	}
+
+	// Calculate alignment force
+	inline vec3 Alignment( const SimulationCB& cb, const vec3& localVel, const vec3& avgVel )
+	{
+		vec3 delta = avgVel - localVel;
+		float deltaSqr = dot( delta, delta ) + softeningSquared;
+		float invDelta = 1.0f / sqrtf( deltaSqr );
+		return delta * (cb.fAlignmentFactor * invDelta);
+	}
+
+	// Calculate seeking force
+	inline vec3 Seeking( const SimulationCB& cb, const vec3& vLocalPos, const vec3& vLocalVel, const vec3& vSeekPos )
+	{
+		vec3 vDelta = normalize( vSeekPos - vLocalPos );
+		vec3 vDesired = vDelta * cb.fMaxSpeed;
+		return (vDesired - vLocalVel) * cb.fSeekingFactor;
+	}
+
+	// Calculate flee force
+	inline vec3 Flee( const SimulationCB& cb, const vec3& localPos, const vec3& localVel, const vec3& fleePos )
+	{
+		vec3 delta = localPos - fleePos;
+		float deltaSqr = dot( delta, delta ) + softeningSquared;
+		float invDelta = 1.0f / sqrtf( deltaSqr );
+		vec3 desiredVel = delta * cb.fMaxSpeed;
+		return (desiredVel - localVel) * (cb.fFleeFactor * invDelta * invDelta);
+	}
+
+	// Calculate border force from planes
+	inline void PlaneVelCorrection( const SimulationCB& cb, vec3& probePos )
+	{
+		vec3 diff = vmax( vec3( 0.f ), probePos - vec3( cb.f3xyzExpand ) );
+		probePos -= diff;
+	}
+
+	// Calculate border force from edges
+	inline void EdgeVelCorrection( float probeToEdgeA, float probeToEdgeB, float cornerRadius, float& probePosA, float& probePosB )
+	{
+		if (probeToEdgeA < 0.f && probeToEdgeB < 0.f)
+		{
+			float dist = sqrtf( probeToEdgeA * probeToEdgeA + probeToEdgeB * probeToEdgeB );
+			if (dist > cornerRadius)
+			{
+				float scale = (dist - cornerRadius) / dist;
+				probePosA += probeToEdgeA * scale;
+				probePosB += probeToEdgeB * scale;
+			}
+		}
+	}
+
+	// Calculate border force from corners
+	inline void CornerVelCorrection( const vec3& probeToCorner, float cornerRadius, vec3& probePos )
+	{
+		if (probeToCorner.x < 0.f && probeToCorner.y < 0.f && probeToCorner.z < 0.f)
+		{
+			float dist = length( probeToCorner );
+			if (dist > cornerRadius)
+			{
+				vec3 moveDir = normalize( probeToCorner );
+				probePos += moveDir * (dist - cornerRadius);
+			}
+		}
+	}
+
+	inline void BorderVelCorrection( const SimulationCB& cb, const vec3& pos, vec3& vel )
+	{
+		float speed = length( vel );
+		float probeDist = speed * 25 * cb.fDeltaT;
+		vec3 probePos = pos + vel * (25 * cb.fDeltaT);
+		float cornerRadius = probeDist * 1.5f;
+		vec3 convert( pos.x > 0.f ? 1.f : -1.f, pos.y > 0.f ? 1.f : -1.f, pos.z > 0.f ? 1.f : -1.f );
+		vec3 mirrorProbePos = probePos * convert;
+		vec3 cornerSphereCenterPos = vec3( cb.f3xyzExpand ) - vec3( cornerRadius );
+		vec3 probeToCorner = cornerSphereCenterPos - mirrorProbePos;
+		// For corners
+		CornerVelCorrection( probeToCorner, cornerRadius, mirrorProbePos );
+		// For edges
+		EdgeVelCorrection( probeToCorner.x, probeToCorner.y, cornerRadius, mirrorProbePos.x, mirrorProbePos.y );
+		EdgeVelCorrection( probeToCorner.x, probeToCorner.z, cornerRadius, mirrorProbePos.x, mirrorProbePos.z );
+		EdgeVelCorrection( probeToCorner.y, probeToCorner.z, cornerRadius, mirrorProbePos.y, mirrorProbePos.z );
+		// For planes
+		PlaneVelCorrection( cb, mirrorProbePos );
+		// Get true new probe pos
+		probePos = mirrorProbePos * convert;
+		// Get new vel
+		vel = normalize( probePos - pos ) * speed;
+	}
+
+	inline int32_t CellCoord( float v, float InvCellSize )
+	{
+		return (int32_t)floorf( v * InvCellSize );
+	}
+
+	// Fish per task, big enough to hide scheduling cost, small enough to balance dense clusters
+	const uint32_t kFishPerTask = 1024;
+}
+
+//--------------------------------------------------------------------------------------
+// BoidsEngine
+//--------------------------------------------------------------------------------------
+BoidsEngine::BoidsEngine()
+	:m_NumFish( 0 ), m_OnStageIdx( 0 ), m_pScheduler( nullptr ), m_LastInteractions( 0 ),
+	m_InvCellSize( 1.f ), m_TableMask( 0 ), m_OccupiedCells( 0 )
+{
+	SetISA( DetectBestBoidsISA() );
+	SetTaskScheduler( nullptr );
+}
+
+BoidsEngine::~BoidsEngine()
+{
+}
+
+void BoidsEngine::Init( const SimulationCB& CB, const FishData* pFishData )
+{
+	m_CB = CB;
+	m_NumFish = CB.uNumInstance;
+	m_OnStageIdx = 0;
+	m_FishData[0].assign( pFishData, pFishData + m_NumFish );
+	m_FishData[1].resize( m_NumFish );
+}
+
+void BoidsEngine::SetSimulationCB( const SimulationCB& CB )
+{
+	// Number of fish is fixed at Init, only simulation parameters could be changed on the fly
+	uint32_t NumFish = m_NumFish;
+	m_CB = CB;
+	m_CB.uNumInstance = NumFish;
+}
+
+void BoidsEngine::Step( uint32_t NumSteps )
+{
+	for (uint32_t s = 0; s < NumSteps; ++s)
+	{
+		const std::vector<FishData>& Src = m_FishData[m_OnStageIdx];
+		std::vector<FishData>& Dst = m_FishData[1 - m_OnStageIdx];
+		BuildGrid( Src );
+
+		// Walk fish in bucket order, so each task works on a compact group of cells
+		for (auto& Stats : m_ThreadStats) Stats.Interactions = 0;
+		ForEachRange( (uint32_t)m_SortedIdx.size(), [&]( uint32_t Begin, uint32_t End, uint32_t ThreadIdx )
+		{
+			uint64_t Interactions = 0;
+			for (uint32_t Slot = Begin; Slot < End; ++Slot)
+			{
+				uint32_t i = m_SortedIdx[Slot];
+				if (i < m_NumFish) Interactions += UpdateFish( Src[i], m_SortedResult[Slot] );
+			}
+			m_ThreadStats[ThreadIdx].Interactions += Interactions;
+		} );
+		// Back to fish order, instance id matters for rendering
+		ForEachRange( m_NumFish, [&]( uint32_t Begin, uint32_t End, uint32_t )
+		{
+			for (uint32_t i = Begin; i < End; ++i)
+				Dst[i] = m_SortedResult[m_SortedRank[i]];
+		} );
+
+		m_LastInteractions = 0;
+		for (auto& Stats : m_ThreadStats) m_LastInteractions += Stats.Interactions;
+		m_OnStageIdx = 1 - m_OnStageIdx;
+	}
+}
+
+void BoidsEngine::SetTaskScheduler( TaskScheduler* pScheduler )
+{
+	m_pScheduler = pScheduler;
+	m_ThreadStats.resize( pScheduler ? (std::max)( 1u, pScheduler->GetNumThreads() ) : 1 );
+}
+
+void BoidsEngine::ForEachRange( uint32_t Count, const TaskScheduler::RangeFn& Func )
+{
+	if (m_pScheduler)
+		m_pScheduler->ParallelFor( Count, kFishPerTask, Func );
+	else
+		Func( 0, Count, 0 );
+}
+
+void BoidsEngine::SetISA( BoidsISA ISA )
+{
+	m_ISA = IsBoidsISASupported( ISA ) ? ISA : kBoidsScalar;
+	m_pfnGatherNeighbors = GetGatherNeighborsFn( m_ISA );
+}
+
+void BoidsEngine::GenerateFishData( const SimulationCB& CB, uint32_t Seed, float ClusterScale, FishData* pFishData )
+{
+	// Own LCG instead of rand(), whose sequence differs between C runtimes
+	auto Rand = [&Seed]() { Seed = Seed * 1664525u + 1013904223u; return (Seed >> 8) / (float)(1 << 24) * 2.f - 1.f; };
+	for (uint32_t i = 0; i < CB.uNumInstance; ++i)
+	{
+		pFishData[i].pos.x = Rand() * CB.f3xyzExpand.x * ClusterScale + CB.f3CenterPos.x;
+		pFishData[i].pos.y = Rand() * CB.f3xyzExpand.y * ClusterScale + CB.f3CenterPos.y;
+		pFishData[i].pos.z = Rand() * CB.f3xyzExpand.z * ClusterScale + CB.f3CenterPos.z;
+		pFishData[i].vel.x = Rand();
+		pFishData[i].vel.y = Rand();
+		pFishData[i].vel.z = Rand();
+	}
+}
+
+float BoidsEngine::MaxDifference( const FishData* A, const FishData* B, uint32_t Count )
+{
+	float MaxDiff = 0.f;
+	for (uint32_t i = 0; i < Count; ++i)
+	{
+		MaxDiff = (std::max)( MaxDiff, fabsf( A[i].pos.x - B[i].pos.x ) );
+		MaxDiff = (std::max)( MaxDiff, fabsf( A[i].pos.y - B[i].pos.y ) );
+		MaxDiff = (std::max)( MaxDiff, fabsf( A[i].pos.z - B[i].pos.z ) );
+		MaxDiff = (std::max)( MaxDiff, fabsf( A[i].vel.x - B[i].vel.x ) );
+		MaxDiff = (std::max)( MaxDiff, fabsf( A[i].vel.y - B[i].vel.y ) );
+		MaxDiff = (std::max)( MaxDiff, fabsf( A[i].vel.z - B[i].vel.z ) );
+	}
+	return MaxDiff;
+}
+
+void BoidsEngine::RunScalingBenchmark( const SimulationCB& CB, const std::vector<uint32_t>& FishCounts, uint32_t NumSteps,
+	const std::function<void( const BoidsBenchmarkResult& )>& OnResult )
+{
+	uint32_t MaxThreads = (std::max)( 1u, std::thread::hardware_concurrency() );
+	std::vector<uint32_t> ThreadCounts;
+	for (uint32_t n = 1; n < MaxThreads; n *= 2) ThreadCounts.push_back( n );
+	ThreadCounts.push_back( MaxThreads );
+
+	for (uint32_t NumFish : FishCounts)
+	{
+		SimulationCB BenchCB = CB;
+		float Scale = cbrtf( (float)NumFish / (std::max)( 1u, CB.uNumInstance ) );
+		BenchCB.uNumInstance = NumFish;
+		BenchCB.f3xyzExpand = (vec3( CB.f3xyzExpand ) * Scale).ToFloat3();
+
+		// Fixed seed so every thread count starts from identical state
+		std::vector<FishData> Fish( NumFish );
+		GenerateFishData( BenchCB, 12345, 1.f, Fish.data() );
+
+		for (uint32_t NumThreads : ThreadCounts)
+		{
+			TaskScheduler Scheduler;
+			Scheduler.Initialize( NumThreads );
+			BoidsEngine Engine;
+			Engine.SetTaskScheduler( &Scheduler );
+			Engine.Init( BenchCB, Fish.data() );
+			Engine.Step();	// Warm up, allocates grid buffers
+
+			auto Start = std::chrono::high_resolution_clock::now();
+			Engine.Step( NumSteps );
+			std::chrono::duration<double> Elapsed = std::chrono::high_resolution_clock::now() - Start;
+
+			BoidsBenchmarkResult Result;
+			Result.NumFish = NumFish;
+			Result.NumThreads = NumThreads;
+			Result.StepsPerSec = NumSteps / (std::max)( Elapsed.count(), 1e-9 );
+			OnResult( Result );
+		}
+	}
+}
+
+uint32_t BoidsEngine::HashCell( int32_t x, int32_t y, int32_t z ) const
+{
+	return (((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u) ^ ((uint32_t)z * 83492791u)) & m_TableMask;
+}
+
+void BoidsEngine::BuildGrid( const std::vector<FishData>& Src )
+{
+	uint32_t NumPhantom = 0;
+	if (m_EmulateTilePadding)
+		NumPhantom = (m_NumFish / BLOCK_SIZE + 1) * BLOCK_SIZE - m_NumFish;
+	uint32_t NumEntries = m_NumFish + NumPhantom;
+
+	// Bucket table at least twice the entry count to keep collision rate low
+	uint32_t TableSize = 1;
+	while (TableSize < NumEntries * 2) TableSize <<= 1;
+	m_TableMask = TableSize - 1;
+	m_InvCellSize = 1.f / (std::max)( m_CB.fVisionDist, 1e-3f );
+
+	m_BucketStart.assign( TableSize + 1, 0 );
+	m_FishBucket.resize( NumEntries );
+	m_SortedFish.Resize( NumEntries );
+	m_SortedIdx.resize( NumEntries );
+	m_SortedRank.resize( m_NumFish );
+	m_SortedResult.resize( NumEntries );
+
+	vec3 Center( m_CB.f3CenterPos );
+	vec3 PhantomPos = -Center;
+	ForEachRange( NumEntries, [&]( uint32_t Begin, uint32_t End, uint32_t )
+	{
+		for (uint32_t i = Begin; i < End; ++i)
+		{
+			vec3 Pos = i < m_NumFish ? vec3( Src[i].pos ) - Center : PhantomPos;
+			m_FishBucket[i] = HashCell( CellCoord( Pos.x, m_InvCellSize ), CellCoord( Pos.y, m_InvCellSize ), CellCoord( Pos.z, m_InvCellSize ) );
+		}
+	} );
+	for (uint32_t i = 0; i < NumEntries; ++i)
+		m_BucketStart[m_FishBucket[i] + 1]++;
+
+	m_OccupiedCells = 0;
+	for (uint32_t b = 0; b < TableSize; ++b)
+	{
+		if (m_BucketStart[b + 1] != 0) m_OccupiedCells++;
+		m_BucketStart[b + 1] += m_BucketStart[b];
+	}
+
+	// Scatter into bucket order, reuse m_FishBucket as the write cursor source
+	std::vector<uint32_t> Cursor( m_BucketStart.begin(), m_BucketStart.end() - 1 );
+	for (uint32_t i = 0; i < NumEntries; ++i)
+	{
+		// AoS to SoA conversion happens as part of the scatter, no extra pass over the fish
+		uint32_t Dst = Cursor[m_FishBucket[i]]++;
+		m_SortedIdx[Dst] = i;
+		if (i < m_NumFish)
+		{
+			m_SortedRank[i] = Dst;
+			m_SortedFish.Set( Dst, (vec3( Src[i].pos ) - Center).ToFloat3(), Src[i].vel );
+		}
+		else
+			m_SortedFish.Set( Dst, PhantomPos.ToFloat3(), float3( 0.f, 0.f, 0.f ) );
+	}
+}
+
+uint32_t BoidsEngine::UpdateFish( const FishData& Old, FishData& New ) const
+{
+	const SimulationCB& cb = m_CB;
+	vec3 Center( cb.f3CenterPos );
+	vec3 localPos = vec3( Old.pos ) - Center;			// Transform to local space
+	vec3 localVel( Old.vel );
+	float scalarVel = length( localVel );
+	vec3 velDir = localVel / scalarVel;
+
+	// Gather unique buckets of the 27 surrounding cells, different cells may hash into the same bucket
+	int32_t cx = CellCoord( localPos.x, m_InvCellSize );
+	int32_t cy = CellCoord( localPos.y, m_InvCellSize );
+	int32_t cz = CellCoord( localPos.z, m_InvCellSize );
+	uint32_t Buckets[27];
+	uint32_t NumBuckets = 0;
+	for (int32_t dz = -1; dz <= 1; ++dz)
+		for (int32_t dy = -1; dy <= 1; ++dy)
+			for (int32_t dx = -1; dx <= 1; ++dx)
+			{
+				uint32_t Bucket = HashCell( cx + dx, cy + dy, cz + dz );
+				bool Found = false;
+				for (uint32_t b = 0; b < NumBuckets && !Found; ++b)
+					Found = Buckets[b] == Bucket;
+				if (!Found) Buckets[NumBuckets++] = Bucket;
+			}
+
+	NeighborQuery Query;
+	Query.Pos[0] = localPos.x; Query.Pos[1] = localPos.y; Query.Pos[2] = localPos.z;
+	Query.VelDir[0] = velDir.x; Query.VelDir[1] = velDir.y; Query.VelDir[2] = velDir.z;
+	Query.VisionDist = cb.fVisionDist;
+	Query.VisionAngleCos = cb.fVisionAngleCos;
+	Query.SeperationFactor = cb.fSeperationFactor;
+	Query.AvoidanceFactor = cb.fAvoidanceFactor;
+
+	// Separation and avoidance forces plus neighbor pos/vel sums come from the SIMD kernel
+	NeighborAccum Accum;
+	m_pfnGatherNeighbors( Query, m_SortedFish, m_BucketStart.data(), Buckets, NumBuckets, Accum );
+	vec3	accForce( Accum.Force[0], Accum.Force[1], Accum.Force[2] );	// Keep track of all forces for this fish
+	vec3	accPos( Accum.Pos[0], Accum.Pos[1], Accum.Pos[2] );			// Accumulate neighbor fish pos for neighbor ave pos calculation
+	vec3	accVel( Accum.Vel[0], Accum.Vel[1], Accum.Vel[2] );			// Accumulate neighbor fish vel for neighbor ave vel calculation
+	uint32_t accCount = Accum.Count;										// Number of near by fish (neighbor) for ave data calculation
+
+	// Calculate average pos and vel of neighbor fish
+	if (accCount != 0)
+	{
+		vec3 avgPos = accPos / (float)accCount;
+		vec3 avgVel = accVel / (float)accCount;
+		vec3 localFleeSourcePos = vec3( cb.f3FleeSourcePos ) - Center;
+		accForce += Cohesion( cb, localPos, avgPos + normalize( localVel ) * 0.2f );
+		accForce += Alignment( cb, localVel, avgVel );
+		accForce += Flee( cb, localPos, localVel, localFleeSourcePos );
+		accForce += (avgPos - localPos) * 0.5f;
+	}
+
+	vec3 seekPos = vec3( cb.f3SeekSourcePos ) - Center;
+	vec3 seek = Seeking( cb, localPos, localVel, seekPos );
+	accForce += ((accCount == 0) ? seek * 100.f : seek);
+	float accForceSqr = dot( accForce, accForce ) + softeningSquared;
+	float invForceLen = 1.0f / sqrtf( accForceSqr );
+	vec3 forceDir = accForce * invForceLen;
+	if (accForceSqr > cb.fMaxForce * cb.fMaxForce)
+		accForce = forceDir * cb.fMaxForce;
+
+	localVel += accForce * cb.fDeltaT;
+	float velAfterSqr = dot( localVel, localVel );
+	float invVelLen = 1.0f / sqrtf( velAfterSqr );
+	if (velAfterSqr > cb.fMaxSpeed * cb.fMaxSpeed)
+		localVel = localVel * invVelLen * cb.fMaxSpeed;
+	else if (velAfterSqr < cb.fMinSpeed * cb.fMinSpeed)
+		localVel = localVel * invVelLen * cb.fMinSpeed;
+
+	BorderVelCorrection( cb, localPos, localVel );
+	localPos += localVel * cb.fDeltaT;
+
+	New.pos = (localPos + Center).ToFloat3();	// Convert the result pos back to world space
+	New.vel = localVel.ToFloat3();
+	return accCount;
+}
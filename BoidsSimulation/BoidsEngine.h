@@ -0,0 +1,98 @@
+#pragma once
+// Headless CPU version of csmain in BoidsSimulation_shader.hlsl. It consumes the same SimulationCB
+// and FishData layout, but instead of the O(N^2) all-pairs tile loop it buckets fish into a uniform
+// hash grid with cell size of fVisionDist, so each fish only visits the 27 surrounding cells.
+// No device is needed, so it also serves as golden reference when changing the compute kernel.
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+#include "BoidsKernel.h"
+#include "TaskScheduler.h"
+
+struct BoidsBenchmarkResult
+{
+	uint32_t	NumFish;
+	uint32_t	NumThreads;
+	double		StepsPerSec;
+};
+
+class BoidsEngine
+{
+public:
+	BoidsEngine();
+	~BoidsEngine();
+
+	// Copy initial state, number of fish is taken from CB.uNumInstance
+	void Init( const SimulationCB& CB, const FishData* pFishData );
+	void SetSimulationCB( const SimulationCB& CB );
+	void Step( uint32_t NumSteps = 1 );
+
+	// Fish are updated in parallel chunks when a scheduler is set, nullptr runs everything inline
+	void SetTaskScheduler( TaskScheduler* pScheduler );
+
+	const FishData* GetFishData() const { return m_FishData[m_OnStageIdx].data(); }
+	uint32_t GetNumFish() const { return m_NumFish; }
+	uint32_t GetOccupiedCellCount() const { return m_OccupiedCells; }
+	// Average number of visible neighbors per fish in the last step
+	float GetAvgNeighborCount() const { return m_NumFish ? (float)m_LastInteractions / m_NumFish : 0.f; }
+
+	// Defaults to DetectBestBoidsISA(), unsupported ISA falls back to scalar
+	void SetISA( BoidsISA ISA );
+	BoidsISA GetISA() const { return m_ISA; }
+
+	// Deterministic initial state for CB.uNumInstance fish, scattered around f3CenterPos within
+	// f3xyzExpand * ClusterScale, vel components in [-1, 1]
+	static void GenerateFishData( const SimulationCB& CB, uint32_t Seed, float ClusterScale, FishData* pFishData );
+
+	// Max per component abs difference of pos/vel between two snapshots, for validating against GPU readback
+	static float MaxDifference( const FishData* A, const FishData* B, uint32_t Count );
+
+	// Steps/sec for every fish count at 1, 2, 4 ... hardware thread count. Simulation box grows with
+	// fish count to keep the density of CB. Each result is reported as soon as it is measured.
+	static void RunScalingBenchmark( const SimulationCB& CB, const std::vector<uint32_t>& FishCounts, uint32_t NumSteps,
+		const std::function<void( const BoidsBenchmarkResult& )>& OnResult );
+
+	// csmain loads whole tiles of BLOCK_SIZE, the tail of last tile reads out of bound of oldVP which
+	// returns zero. Those phantom fish sit at world origin with zero vel and take part in the neighbor
+	// search, keep this on to match GPU result.
+	bool	m_EmulateTilePadding = true;
+
+private:
+	void BuildGrid( const std::vector<FishData>& Src );
+	uint32_t UpdateFish( const FishData& Old, FishData& New ) const;
+	void ForEachRange( uint32_t Count, const TaskScheduler::RangeFn& Func );
+	uint32_t HashCell( int32_t x, int32_t y, int32_t z ) const;
+
+	SimulationCB			m_CB;
+	uint32_t				m_NumFish;
+	uint8_t					m_OnStageIdx;
+	std::vector<FishData>	m_FishData[2];
+
+	BoidsISA				m_ISA;
+	GatherNeighborsFn		m_pfnGatherNeighbors;
+
+	// Per thread counters, a cache line each so threads never write to the same one
+	struct alignas( 64 ) ThreadStats
+	{
+		uint64_t	Interactions;
+	};
+	TaskScheduler*				m_pScheduler;
+	std::vector<ThreadStats>	m_ThreadStats;
+	uint64_t					m_LastInteractions;
+
+	// Uniform grid hashed into a power of 2 bucket table, fish are counting-sorted by bucket
+	// so a bucket is a contiguous range in m_SortedFish (local space pos, SoA for SIMD kernels)
+	float					m_InvCellSize;
+	uint32_t				m_TableMask;
+	uint32_t				m_OccupiedCells;
+	std::vector<uint32_t>	m_BucketStart;
+	std::vector<uint32_t>	m_FishBucket;
+	FishStreams				m_SortedFish;
+	// Sorted slot -> fish index and back. Results are written in sorted order, so each task
+	// fills a contiguous range, then copied back into fish order
+	std::vector<uint32_t>	m_SortedIdx;
+	std::vector<uint32_t>	m_SortedRank;
+	std::vector<FishData>	m_SortedResult;
+};
@@ -0,0 +1,485 @@
+#include "BoidsKernel.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BOIDS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define BOIDS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+	// Shader static constant
+	const float softeningSquared = 0.0012500000f*0.0012500000f;
+	const float softening = 0.0012500000f;
+
+	void* AlignedAlloc( size_t Size, size_t Alignment )
+	{
+#ifdef _WIN32
+		return _aligned_malloc( Size, Alignment );
+#else
+		void* p = nullptr;
+		return posix_memalign( &p, Alignment, Size ) == 0 ? p : nullptr;
+#endif
+	}
+
+	void AlignedFree( void* p )
+	{
+#ifdef _WIN32
+		_aligned_free( p );
+#else
+		free( p );
+#endif
+	}
+
+#if BOIDS_X86
+	void CpuId( int Info[4], int Leaf, int SubLeaf )
+	{
+#if defined(_MSC_VER)
+		__cpuidex( Info, Leaf, SubLeaf );
+#else
+		__cpuid_count( Leaf, SubLeaf, Info[0], Info[1], Info[2], Info[3] );
+#endif
+	}
+
+	uint64_t ReadXCR0()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv( 0 );
+#else
+		uint32_t Eax, Edx;
+		__asm__ __volatile__( "xgetbv" : "=a"(Eax), "=d"(Edx) : "c"(0) );
+		return ((uint64_t)Edx << 32) | Eax;
+#endif
+	}
+#endif
+}
+
+BoidsISA DetectBestBoidsISA()
+{
+	for (int ISA = kNumBoidsISA - 1; ISA > kBoidsScalar; --ISA)
+		if (IsBoidsISASupported( (BoidsISA)ISA )) return (BoidsISA)ISA;
+	return kBoidsScalar;
+}
+
+bool IsBoidsISASupported( BoidsISA ISA )
+{
+	switch (ISA)
+	{
+	case kBoidsScalar:
+		return true;
+#if BOIDS_X86
+	case kBoidsSSE:
+	{
+		int Info[4];
+		CpuId( Info, 1, 0 );
+		return (Info[3] & (1 << 26)) != 0;	// SSE2
+	}
+	case kBoidsAVX2:
+	{
+		int Info[4];
+		CpuId( Info, 0, 0 );
+		if (Info[0] < 7) return false;
+		CpuId( Info, 1, 0 );
+		// OS has to save ymm registers on context switch
+		bool OSXSave = (Info[2] & (1 << 27)) != 0;
+		bool AVX = (Info[2] & (1 << 28)) != 0;
+		if (!OSXSave || !AVX || (ReadXCR0() & 0x6) != 0x6) return false;
+		CpuId( Info, 7, 0 );
+		return (Info[1] & (1 << 5)) != 0;
+	}
+#endif
+#if BOIDS_NEON
+	case kBoidsNEON:
+		return true;	// Mandatory on ARM64
+#endif
+	default:
+		return false;
+	}
+}
+
+const char* GetBoidsISAName( BoidsISA ISA )
+{
+	static const char* Names[kNumBoidsISA] = { "Scalar", "SSE", "AVX2", "NEON" };
+	return ISA < kNumBoidsISA ? Names[ISA] : "Unknown";
+}
+
+//--------------------------------------------------------------------------------------
+// FishStreams
+//--------------------------------------------------------------------------------------
+FishStreams::FishStreams()
+	:m_pData( nullptr ), m_Count( 0 ), m_Stride( 0 )
+{
+}
+
+FishStreams::~FishStreams()
+{
+	AlignedFree( m_pData );
+}
+
+void FishStreams::Resize( uint32_t Count )
+{
+	// One extra lane group so a load starting at the last fish doesn't run into next stream
+	uint32_t Stride = ((Count + kLaneGroup - 1) / kLaneGroup + 1) * kLaneGroup;
+	if (Stride != m_Stride)
+	{
+		AlignedFree( m_pData );
+		m_pData = (float*)AlignedAlloc( sizeof( float ) * Stride * kNumStreams, 32 );
+		m_Stride = Stride;
+	}
+	// Padding lanes are masked out by kernels, keep them zero so they never hold NaN garbage
+	memset( m_pData, 0, sizeof( float ) * Stride * kNumStreams );
+	m_Count = Count;
+}
+
+void FishStreams::Set( uint32_t Idx, const float3& Pos, const float3& Vel )
+{
+	float* p = m_pData + Idx;
+	p[kPosX * m_Stride] = Pos.x; p[kPosY * m_Stride] = Pos.y; p[kPosZ * m_Stride] = Pos.z;
+	p[kVelX * m_Stride] = Vel.x; p[kVelY * m_Stride] = Vel.y; p[kVelZ * m_Stride] = Vel.z;
+}
+
+void FishStreams::Load( const FishData* pSrc, uint32_t Count )
+{
+	Resize( Count );
+	float* px = (*this)[kPosX]; float* py = (*this)[kPosY]; float* pz = (*this)[kPosZ];
+	float* vx = (*this)[kVelX]; float* vy = (*this)[kVelY]; float* vz = (*this)[kVelZ];
+	for (uint32_t i = 0; i < Count; ++i)
+	{
+		px[i] = pSrc[i].pos.x; py[i] = pSrc[i].pos.y; pz[i] = pSrc[i].pos.z;
+		vx[i] = pSrc[i].vel.x; vy[i] = pSrc[i].vel.y; vz[i] = pSrc[i].vel.z;
+	}
+}
+
+void FishStreams::Store( FishData* pDst ) const
+{
+	const float* px = (*this)[kPosX]; const float* py = (*this)[kPosY]; const float* pz = (*this)[kPosZ];
+	const float* vx = (*this)[kVelX]; const float* vy = (*this)[kVelY]; const float* vz = (*this)[kVelZ];
+	for (uint32_t i = 0; i < m_Count; ++i)
+	{
+		pDst[i].pos.x = px[i]; pDst[i].pos.y = py[i]; pDst[i].pos.z = pz[i];
+		pDst[i].vel.x = vx[i]; pDst[i].vel.y = vy[i]; pDst[i].vel.z = vz[i];
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Scalar kernel, same arithmetic as the neighbor loop of csmain
+//--------------------------------------------------------------------------------------
+namespace
+{
+	void GatherNeighbors_Scalar( const NeighborQuery& Q, const FishStreams& Fish,
+		const uint32_t* pBucketStart, const uint32_t* pBuckets, uint32_t NumBuckets, NeighborAccum& Accum )
+	{
+		const float* px = Fish[FishStreams::kPosX]; const float* py = Fish[FishStreams::kPosY]; const float* pz = Fish[FishStreams::kPosZ];
+		const float* vx = Fish[FishStreams::kVelX]; const float* vy = Fish[FishStreams::kVelY]; const float* vz = Fish[FishStreams::kVelZ];
+		memset( &Accum, 0, sizeof( NeighborAccum ) );
+		for (uint32_t b = 0; b < NumBuckets; ++b)
+		{
+			uint32_t End = pBucketStart[pBuckets[b] + 1];
+			for (uint32_t i = pBucketStart[pBuckets[b]]; i < End; ++i)
+			{
+				// Calculate distance
+				float dx = px[i] - Q.Pos[0], dy = py[i] - Q.Pos[1], dz = pz[i] - Q.Pos[2];
+				float distSqr = dx * dx + dy * dy + dz * dz + softeningSquared;
+				float dist = sqrtf( distSqr );
+				float invDist = 1.0f / dist;
+				// Calculate angle between vel and dist dir
+				float ndx = dx * invDist, ndy = dy * invDist, ndz = dz * invDist;
+				float cosAngle = Q.VelDir[0] * ndx + Q.VelDir[1] * ndy + Q.VelDir[2] * ndz;
+				if (dist > Q.VisionDist || cosAngle < Q.VisionAngleCos) continue;
+
+				Accum.Pos[0] += px[i]; Accum.Pos[1] += py[i]; Accum.Pos[2] += pz[i];
+				Accum.Vel[0] += vx[i]; Accum.Vel[1] += vy[i]; Accum.Vel[2] += vz[i];
+				Accum.Count += 1;
+
+				// Seperation
+				float nvSqr = vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i] + softeningSquared;
+				float invNvLen = 1.0f / sqrtf( nvSqr );
+				float dirFactor = fabsf( (ndx * vx[i] + ndy * vy[i] + ndz * vz[i]) * invNvLen ) + softening;
+				float sep = -Q.SeperationFactor * invDist * invDist * (1 + 3 * dirFactor);
+
+				// Avoidance
+				float t = dx * Q.VelDir[0] + dy * Q.VelDir[1] + dz * Q.VelDir[2];
+				float fx = Q.Pos[0] + Q.VelDir[0] * t - px[i];
+				float fy = Q.Pos[1] + Q.VelDir[1] * t - py[i];
+				float fz = Q.Pos[2] + Q.VelDir[2] * t - pz[i];
+				float forceLenSqr = fx * fx + fy * fy + fz * fz + softeningSquared;
+				float avoid = Q.AvoidanceFactor / (forceLenSqr * distSqr);
+
+				Accum.Force[0] += ndx * sep + fx * avoid;
+				Accum.Force[1] += ndy * sep + fy * avoid;
+				Accum.Force[2] += ndz * sep + fz * avoid;
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// SSE kernel, 4 neighbors per iteration
+//--------------------------------------------------------------------------------------
+#if BOIDS_X86
+namespace
+{
+	void GatherNeighbors_SSE( const NeighborQuery& Q, const FishStreams& Fish,
+		const uint32_t* pBucketStart, const uint32_t* pBuckets, uint32_t NumBuckets, NeighborAccum& Accum )
+	{
+		const float* px = Fish[FishStreams::kPosX]; const float* py = Fish[FishStreams::kPosY]; const float* pz = Fish[FishStreams::kPosZ];
+		const float* vx = Fish[FishStreams::kVelX]; const float* vy = Fish[FishStreams::kVelY]; const float* vz = Fish[FishStreams::kVelZ];
+
+		const __m128 qx = _mm_set1_ps( Q.Pos[0] ), qy = _mm_set1_ps( Q.Pos[1] ), qz = _mm_set1_ps( Q.Pos[2] );
+		const __m128 dirX = _mm_set1_ps( Q.VelDir[0] ), dirY = _mm_set1_ps( Q.VelDir[1] ), dirZ = _mm_set1_ps( Q.VelDir[2] );
+		const __m128 visionDist = _mm_set1_ps( Q.VisionDist ), visionAngleCos = _mm_set1_ps( Q.VisionAngleCos );
+		const __m128 negSepFactor = _mm_set1_ps( -Q.SeperationFactor ), avoidFactor = _mm_set1_ps( Q.AvoidanceFactor );
+		const __m128 eps2 = _mm_set1_ps( softeningSquared ), eps = _mm_set1_ps( softening );
+		const __m128 one = _mm_set1_ps( 1.f ), three = _mm_set1_ps( 3.f );
+		const __m128 absMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+		const __m128i laneIdx = _mm_setr_epi32( 0, 1, 2, 3 );
+
+		__m128 aPx = _mm_setzero_ps(), aPy = _mm_setzero_ps(), aPz = _mm_setzero_ps();
+		__m128 aVx = _mm_setzero_ps(), aVy = _mm_setzero_ps(), aVz = _mm_setzero_ps();
+		__m128 aFx = _mm_setzero_ps(), aFy = _mm_setzero_ps(), aFz = _mm_setzero_ps();
+		__m128 aCnt = _mm_setzero_ps();
+
+		for (uint32_t b = 0; b < NumBuckets; ++b)
+		{
+			uint32_t End = pBucketStart[pBuckets[b] + 1];
+			for (uint32_t i = pBucketStart[pBuckets[b]]; i < End; i += 4)
+			{
+				__m128 valid = _mm_castsi128_ps( _mm_cmpgt_epi32( _mm_set1_epi32( (int)(End - i) ), laneIdx ) );
+				__m128 nx = _mm_loadu_ps( px + i ), ny = _mm_loadu_ps( py + i ), nz = _mm_loadu_ps( pz + i );
+				__m128 nvx = _mm_loadu_ps( vx + i ), nvy = _mm_loadu_ps( vy + i ), nvz = _mm_loadu_ps( vz + i );
+
+				__m128 dx = _mm_sub_ps( nx, qx ), dy = _mm_sub_ps( ny, qy ), dz = _mm_sub_ps( nz, qz );
+				__m128 distSqr = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_add_ps( _mm_mul_ps( dz, dz ), eps2 ) );
+				__m128 dist = _mm_sqrt_ps( distSqr );
+				__m128 invDist = _mm_div_ps( one, dist );
+				__m128 ndx = _mm_mul_ps( dx, invDist ), ndy = _mm_mul_ps( dy, invDist ), ndz = _mm_mul_ps( dz, invDist );
+				__m128 cosAngle = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dirX, ndx ), _mm_mul_ps( dirY, ndy ) ), _mm_mul_ps( dirZ, ndz ) );
+				__m128 mask = _mm_and_ps( valid, _mm_and_ps( _mm_cmple_ps( dist, visionDist ), _mm_cmpge_ps( cosAngle, visionAngleCos ) ) );
+				if (_mm_movemask_ps( mask ) == 0) continue;
+
+				// Seperation
+				__m128 nvSqr = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nvx, nvx ), _mm_mul_ps( nvy, nvy ) ), _mm_add_ps( _mm_mul_ps( nvz, nvz ), eps2 ) );
+				__m128 invNvLen = _mm_div_ps( one, _mm_sqrt_ps( nvSqr ) );
+				__m128 dirDot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ndx, nvx ), _mm_mul_ps( ndy, nvy ) ), _mm_mul_ps( ndz, nvz ) );
+				__m128 dirFactor = _mm_add_ps( _mm_and_ps( _mm_mul_ps( dirDot, invNvLen ), absMask ), eps );
+				__m128 sep = _mm_mul_ps( _mm_mul_ps( negSepFactor, _mm_mul_ps( invDist, invDist ) ), _mm_add_ps( one, _mm_mul_ps( three, dirFactor ) ) );
+
+				// Avoidance
+				__m128 t = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dirX ), _mm_mul_ps( dy, dirY ) ), _mm_mul_ps( dz, dirZ ) );
+				__m128 fx = _mm_sub_ps( _mm_add_ps( qx, _mm_mul_ps( dirX, t ) ), nx );
+				__m128 fy = _mm_sub_ps( _mm_add_ps( qy, _mm_mul_ps( dirY, t ) ), ny );
+				__m128 fz = _mm_sub_ps( _mm_add_ps( qz, _mm_mul_ps( dirZ, t ) ), nz );
+				__m128 forceLenSqr = _mm_add_ps( _mm_add_ps( _mm_mul_ps( fx, fx ), _mm_mul_ps( fy, fy ) ), _mm_add_ps( _mm_mul_ps( fz, fz ), eps2 ) );
+				__m128 avoid = _mm_div_ps( avoidFactor, _mm_mul_ps( forceLenSqr, distSqr ) );
+
+				aPx = _mm_add_ps( aPx, _mm_and_ps( mask, nx ) ); aPy = _mm_add_ps( aPy, _mm_and_ps( mask, ny ) ); aPz = _mm_add_ps( aPz, _mm_and_ps( mask, nz ) );
+				aVx = _mm_add_ps( aVx, _mm_and_ps( mask, nvx ) ); aVy = _mm_add_ps( aVy, _mm_and_ps( mask, nvy ) ); aVz = _mm_add_ps( aVz, _mm_and_ps( mask, nvz ) );
+				aFx = _mm_add_ps( aFx, _mm_and_ps( mask, _mm_add_ps( _mm_mul_ps( ndx, sep ), _mm_mul_ps( fx, avoid ) ) ) );
+				aFy = _mm_add_ps( aFy, _mm_and_ps( mask, _mm_add_ps( _mm_mul_ps( ndy, sep ), _mm_mul_ps( fy, avoid ) ) ) );
+				aFz = _mm_add_ps( aFz, _mm_and_ps( mask, _mm_add_ps( _mm_mul_ps( ndz, sep ), _mm_mul_ps( fz, avoid ) ) ) );
+				aCnt = _mm_add_ps( aCnt, _mm_and_ps( mask, one ) );
+			}
+		}
+
+		__m128 Sums[10] = { aPx, aPy, aPz, aVx, aVy, aVz, aFx, aFy, aFz, aCnt };
+		float Lanes[4];
+		float* pOut[10] = { &Accum.Pos[0], &Accum.Pos[1], &Accum.Pos[2], &Accum.Vel[0], &Accum.Vel[1], &Accum.Vel[2], &Accum.Force[0], &Accum.Force[1], &Accum.Force[2], nullptr };
+		for (int s = 0; s < 10; ++s)
+		{
+			_mm_storeu_ps( Lanes, Sums[s] );
+			float Sum = (Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3]);
+			if (pOut[s]) *pOut[s] = Sum;
+			else Accum.Count = (uint32_t)(Sum + 0.5f);
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// AVX2 kernel, 8 neighbors per iteration
+//--------------------------------------------------------------------------------------
+// MSVC emits VEX code for AVX intrinsics without /arch, gcc and clang need the target attribute
+#if defined(__GNUC__)
+#define BOIDS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define BOIDS_TARGET_AVX2
+#endif
+namespace
+{
+	BOIDS_TARGET_AVX2
+	void GatherNeighbors_AVX2( const NeighborQuery& Q, const FishStreams& Fish,
+		const uint32_t* pBucketStart, const uint32_t* pBuckets, uint32_t NumBuckets, NeighborAccum& Accum )
+	{
+		const float* px = Fish[FishStreams::kPosX]; const float* py = Fish[FishStreams::kPosY]; const float* pz = Fish[FishStreams::kPosZ];
+		const float* vx = Fish[FishStreams::kVelX]; const float* vy = Fish[FishStreams::kVelY]; const float* vz = Fish[FishStreams::kVelZ];
+
+		const __m256 qx = _mm256_set1_ps( Q.Pos[0] ), qy = _mm256_set1_ps( Q.Pos[1] ), qz = _mm256_set1_ps( Q.Pos[2] );
+		const __m256 dirX = _mm256_set1_ps( Q.VelDir[0] ), dirY = _mm256_set1_ps( Q.VelDir[1] ), dirZ = _mm256_set1_ps( Q.VelDir[2] );
+		const __m256 visionDist = _mm256_set1_ps( Q.VisionDist ), visionAngleCos = _mm256_set1_ps( Q.VisionAngleCos );
+		const __m256 negSepFactor = _mm256_set1_ps( -Q.SeperationFactor ), avoidFactor = _mm256_set1_ps( Q.AvoidanceFactor );
+		const __m256 eps2 = _mm256_set1_ps( softeningSquared ), eps = _mm256_set1_ps( softening );
+		const __m256 one = _mm256_set1_ps( 1.f ), three = _mm256_set1_ps( 3.f );
+		const __m256 absMask = _mm256_castsi256_ps( _mm256_set1_epi32( 0x7fffffff ) );
+		const __m256i laneIdx = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+
+		__m256 aPx = _mm256_setzero_ps(), aPy = _mm256_setzero_ps(), aPz = _mm256_setzero_ps();
+		__m256 aVx = _mm256_setzero_ps(), aVy = _mm256_setzero_ps(), aVz = _mm256_setzero_ps();
+		__m256 aFx = _mm256_setzero_ps(), aFy = _mm256_setzero_ps(), aFz = _mm256_setzero_ps();
+		__m256 aCnt = _mm256_setzero_ps();
+
+		for (uint32_t b = 0; b < NumBuckets; ++b)
+		{
+			uint32_t End = pBucketStart[pBuckets[b] + 1];
+			for (uint32_t i = pBucketStart[pBuckets[b]]; i < End; i += 8)
+			{
+				__m256 valid = _mm256_castsi256_ps( _mm256_cmpgt_epi32( _mm256_set1_epi32( (int)(End - i) ), laneIdx ) );
+				__m256 nx = _mm256_loadu_ps( px + i ), ny = _mm256_loadu_ps( py + i ), nz = _mm256_loadu_ps( pz + i );
+				__m256 nvx = _mm256_loadu_ps( vx + i ), nvy = _mm256_loadu_ps( vy + i ), nvz = _mm256_loadu_ps( vz + i );
+
+				__m256 dx = _mm256_sub_ps( nx, qx ), dy = _mm256_sub_ps( ny, qy ), dz = _mm256_sub_ps( nz, qz );
+				__m256 distSqr = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( dx, dx ), _mm256_mul_ps( dy, dy ) ), _mm256_add_ps( _mm256_mul_ps( dz, dz ), eps2 ) );
+				__m256 dist = _mm256_sqrt_ps( distSqr );
+				__m256 invDist = _mm256_div_ps( one, dist );
+				__m256 ndx = _mm256_mul_ps( dx, invDist ), ndy = _mm256_mul_ps( dy, invDist ), ndz = _mm256_mul_ps( dz, invDist );
+				__m256 cosAngle = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( dirX, ndx ), _mm256_mul_ps( dirY, ndy ) ), _mm256_mul_ps( dirZ, ndz ) );
+				__m256 mask = _mm256_and_ps( valid, _mm256_and_ps( _mm256_cmp_ps( dist, visionDist, _CMP_LE_OQ ), _mm256_cmp_ps( cosAngle, visionAngleCos, _CMP_GE_OQ ) ) );
+				if (_mm256_movemask_ps( mask ) == 0) continue;
+
+				// Seperation
+				__m256 nvSqr = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( nvx, nvx ), _mm256_mul_ps( nvy, nvy ) ), _mm256_add_ps( _mm256_mul_ps( nvz, nvz ), eps2 ) );
+				__m256 invNvLen = _mm256_div_ps( one, _mm256_sqrt_ps( nvSqr ) );
+				__m256 dirDot = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( ndx, nvx ), _mm256_mul_ps( ndy, nvy ) ), _mm256_mul_ps( ndz, nvz ) );
+				__m256 dirFactor = _mm256_add_ps( _mm256_and_ps( _mm256_mul_ps( dirDot, invNvLen ), absMask ), eps );
+				__m256 sep = _mm256_mul_ps( _mm256_mul_ps( negSepFactor, _mm256_mul_ps( invDist, invDist ) ), _mm256_add_ps( one, _mm256_mul_ps( three, dirFactor ) ) );
+
+				// Avoidance
+				__m256 t = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( dx, dirX ), _mm256_mul_ps( dy, dirY ) ), _mm256_mul_ps( dz, dirZ ) );
+				__m256 fx = _mm256_sub_ps( _mm256_add_ps( qx, _mm256_mul_ps( dirX, t ) ), nx );
+				__m256 fy = _mm256_sub_ps( _mm256_add_ps( qy, _mm256_mul_ps( dirY, t ) ), ny );
+				__m256 fz = _mm256_sub_ps( _mm256_add_ps( qz, _mm256_mul_ps( dirZ, t ) ), nz );
+				__m256 forceLenSqr = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( fx, fx ), _mm256_mul_ps( fy, fy ) ), _mm256_add_ps( _mm256_mul_ps( fz, fz ), eps2 ) );
+				__m256 avoid = _mm256_div_ps( avoidFactor, _mm256_mul_ps( forceLenSqr, distSqr ) );
+
+				aPx = _mm256_add_ps( aPx, _mm256_and_ps( mask, nx ) ); aPy = _mm256_add_ps( aPy, _mm256_and_ps( mask, ny ) ); aPz = _mm256_add_ps( aPz, _mm256_and_ps( mask, nz ) );
+				aVx = _mm256_add_ps( aVx, _mm256_and_ps( mask, nvx ) ); aVy = _mm256_add_ps( aVy, _mm256_and_ps( mask, nvy ) ); aVz = _mm256_add_ps( aVz, _mm256_and_ps( mask, nvz ) );
+				aFx = _mm256_add_ps( aFx, _mm256_and_ps( mask, _mm256_add_ps( _mm256_mul_ps( ndx, sep ), _mm256_mul_ps( fx, avoid ) ) ) );
+				aFy = _mm256_add_ps( aFy, _mm256_and_ps( mask, _mm256_add_ps( _mm256_mul_ps( ndy, sep ), _mm256_mul_ps( fy, avoid ) ) ) );
+				aFz = _mm256_add_ps( aFz, _mm256_and_ps( mask, _mm256_add_ps( _mm256_mul_ps( ndz, sep ), _mm256_mul_ps( fz, avoid ) ) ) );
+				aCnt = _mm256_add_ps( aCnt, _mm256_and_ps( mask, one ) );
+			}
+		}
+
+		__m256 Sums[10] = { aPx, aPy, aPz, aVx, aVy, aVz, aFx, aFy, aFz, aCnt };
+		float Lanes[8];
+		float* pOut[10] = { &Accum.Pos[0], &Accum.Pos[1], &Accum.Pos[2], &Accum.Vel[0], &Accum.Vel[1], &Accum.Vel[2], &Accum.Force[0], &Accum.Force[1], &Accum.Force[2], nullptr };
+		for (int s = 0; s < 10; ++s)
+		{
+			_mm256_storeu_ps( Lanes, Sums[s] );
+			float Sum = ((Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3])) + ((Lanes[4] + Lanes[5]) + (Lanes[6] + Lanes[7]));
+			if (pOut[s]) *pOut[s] = Sum;
+			else Accum.Count = (uint32_t)(Sum + 0.5f);
+		}
+	}
+}
+#endif // BOIDS_X86
+
+//--------------------------------------------------------------------------------------
+// NEON kernel, 4 neighbors per iteration
+//--------------------------------------------------------------------------------------
+#if BOIDS_NEON
+namespace
+{
+	void GatherNeighbors_NEON( const NeighborQuery& Q, const FishStreams& Fish,
+		const uint32_t* pBucketStart, const uint32_t* pBuckets, uint32_t NumBuckets, NeighborAccum& Accum )
+	{
+		const float* px = Fish[FishStreams::kPosX]; const float* py = Fish[FishStreams::kPosY]; const float* pz = Fish[FishStreams::kPosZ];
+		const float* vx = Fish[FishStreams::kVelX]; const float* vy = Fish[FishStreams::kVelY]; const float* vz = Fish[FishStreams::kVelZ];
+
+		const float32x4_t qx = vdupq_n_f32( Q.Pos[0] ), qy = vdupq_n_f32( Q.Pos[1] ), qz = vdupq_n_f32( Q.Pos[2] );
+		const float32x4_t dirX = vdupq_n_f32( Q.VelDir[0] ), dirY = vdupq_n_f32( Q.VelDir[1] ), dirZ = vdupq_n_f32( Q.VelDir[2] );
+		const float32x4_t visionDist = vdupq_n_f32( Q.VisionDist ), visionAngleCos = vdupq_n_f32( Q.VisionAngleCos );
+		const float32x4_t negSepFactor = vdupq_n_f32( -Q.SeperationFactor ), avoidFactor = vdupq_n_f32( Q.AvoidanceFactor );
+		const float32x4_t eps2 = vdupq_n_f32( softeningSquared ), eps = vdupq_n_f32( softening );
+		const float32x4_t one = vdupq_n_f32( 1.f ), three = vdupq_n_f32( 3.f );
+		const uint32_t LaneIdx[4] = { 0, 1, 2, 3 };
+		const uint32x4_t laneIdx = vld1q_u32( LaneIdx );
+
+		float32x4_t aPx = vdupq_n_f32( 0.f ), aPy = aPx, aPz = aPx, aVx = aPx, aVy = aPx, aVz = aPx, aFx = aPx, aFy = aPx, aFz = aPx, aCnt = aPx;
+
+		for (uint32_t b = 0; b < NumBuckets; ++b)
+		{
+			uint32_t End = pBucketStart[pBuckets[b] + 1];
+			for (uint32_t i = pBucketStart[pBuckets[b]]; i < End; i += 4)
+			{
+				uint32x4_t valid = vcgtq_u32( vdupq_n_u32( End - i ), laneIdx );
+				float32x4_t nx = vld1q_f32( px + i ), ny = vld1q_f32( py + i ), nz = vld1q_f32( pz + i );
+				float32x4_t nvx = vld1q_f32( vx + i ), nvy = vld1q_f32( vy + i ), nvz = vld1q_f32( vz + i );
+
+				float32x4_t dx = vsubq_f32( nx, qx ), dy = vsubq_f32( ny, qy ), dz = vsubq_f32( nz, qz );
+				float32x4_t distSqr = vaddq_f32( vaddq_f32( vmulq_f32( dx, dx ), vmulq_f32( dy, dy ) ), vaddq_f32( vmulq_f32( dz, dz ), eps2 ) );
+				float32x4_t dist = vsqrtq_f32( distSqr );
+				float32x4_t invDist = vdivq_f32( one, dist );
+				float32x4_t ndx = vmulq_f32( dx, invDist ), ndy = vmulq_f32( dy, invDist ), ndz = vmulq_f32( dz, invDist );
+				float32x4_t cosAngle = vaddq_f32( vaddq_f32( vmulq_f32( dirX, ndx ), vmulq_f32( dirY, ndy ) ), vmulq_f32( dirZ, ndz ) );
+				uint32x4_t mask = vandq_u32( valid, vandq_u32( vcleq_f32( dist, visionDist ), vcgeq_f32( cosAngle, visionAngleCos ) ) );
+				if (vmaxvq_u32( mask ) == 0) continue;
+
+				// Seperation
+				float32x4_t nvSqr = vaddq_f32( vaddq_f32( vmulq_f32( nvx, nvx ), vmulq_f32( nvy, nvy ) ), vaddq_f32( vmulq_f32( nvz, nvz ), eps2 ) );
+				float32x4_t invNvLen = vdivq_f32( one, vsqrtq_f32( nvSqr ) );
+				float32x4_t dirDot = vaddq_f32( vaddq_f32( vmulq_f32( ndx, nvx ), vmulq_f32( ndy, nvy ) ), vmulq_f32( ndz, nvz ) );
+				float32x4_t dirFactor = vaddq_f32( vabsq_f32( vmulq_f32( dirDot, invNvLen ) ), eps );
+				float32x4_t sep = vmulq_f32( vmulq_f32( negSepFactor, vmulq_f32( invDist, invDist ) ), vaddq_f32( one, vmulq_f32( three, dirFactor ) ) );
+
+				// Avoidance
+				float32x4_t t = vaddq_f32( vaddq_f32( vmulq_f32( dx, dirX ), vmulq_f32( dy, dirY ) ), vmulq_f32( dz, dirZ ) );
+				float32x4_t fx = vsubq_f32( vaddq_f32( qx, vmulq_f32( dirX, t ) ), nx );
+				float32x4_t fy = vsubq_f32( vaddq_f32( qy, vmulq_f32( dirY, t ) ), ny );
+				float32x4_t fz = vsubq_f32( vaddq_f32( qz, vmulq_f32( dirZ, t ) ), nz );
+				float32x4_t forceLenSqr = vaddq_f32( vaddq_f32( vmulq_f32( fx, fx ), vmulq_f32( fy, fy ) ), vaddq_f32( vmulq_f32( fz, fz ), eps2 ) );
+				float32x4_t avoid = vdivq_f32( avoidFactor, vmulq_f32( forceLenSqr, distSqr ) );
+
+#define BOIDS_MASKED(v) vreinterpretq_f32_u32( vandq_u32( mask, vreinterpretq_u32_f32( v ) ) )
+				aPx = vaddq_f32( aPx, BOIDS_MASKED( nx ) ); aPy = vaddq_f32( aPy, BOIDS_MASKED( ny ) ); aPz = vaddq_f32( aPz, BOIDS_MASKED( nz ) );
+				aVx = vaddq_f32( aVx, BOIDS_MASKED( nvx ) ); aVy = vaddq_f32( aVy, BOIDS_MASKED( nvy ) ); aVz = vaddq_f32( aVz, BOIDS_MASKED( nvz ) );
+				aFx = vaddq_f32( aFx, BOIDS_MASKED( vaddq_f32( vmulq_f32( ndx, sep ), vmulq_f32( fx, avoid ) ) ) );
+				aFy = vaddq_f32( aFy, BOIDS_MASKED( vaddq_f32( vmulq_f32( ndy, sep ), vmulq_f32( fy, avoid ) ) ) );
+				aFz = vaddq_f32( aFz, BOIDS_MASKED( vaddq_f32( vmulq_f32( ndz, sep ), vmulq_f32( fz, avoid ) ) ) );
+				aCnt = vaddq_f32( aCnt, BOIDS_MASKED( one ) );
+#undef BOIDS_MASKED
+			}
+		}
+
+		Accum.Pos[0] = vaddvq_f32( aPx ); Accum.Pos[1] = vaddvq_f32( aPy ); Accum.Pos[2] = vaddvq_f32( aPz );
+		Accum.Vel[0] = vaddvq_f32( aVx ); Accum.Vel[1] = vaddvq_f32( aVy ); Accum.Vel[2] = vaddvq_f32( aVz );
+		Accum.Force[0] = vaddvq_f32( aFx ); Accum.Force[1] = vaddvq_f32( aFy ); Accum.Force[2] = vaddvq_f32( aFz );
+		Accum.Count = (uint32_t)(vaddvq_f32( aCnt ) + 0.5f);
+	}
+}
+#endif // BOIDS_NEON
+
+GatherNeighborsFn GetGatherNeighborsFn( BoidsISA ISA )
+{
+	if (!IsBoidsISASupported( ISA )) ISA = kBoidsScalar;
+	switch (ISA)
+	{
+#if BOIDS_X86
+	case kBoidsSSE:		return GatherNeighbors_SSE;
+	case kBoidsAVX2:	return GatherNeighbors_AVX2;
+#endif
+#if BOIDS_NEON
+	case kBoidsNEON:	return GatherNeighbors_NEON;
+#endif
+	default:			return GatherNeighbors_Scalar;
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+// SIMD neighbor kernels for BoidsEngine. Fish are stored as structure of arrays (one stream per
+// component) so a group of neighbors could be loaded into one register per component. Kernel is
+// picked at runtime from the widest ISA the host supports: AVX2 (8 lanes), SSE (4 lanes) on x86,
+// NEON (4 lanes) on ARM64, and plain scalar code as fallback and reference.
+
+#ifdef _WIN32
+#include "LibraryHeader.h"
+using namespace DirectX;
+#endif
+
+#include <stdint.h>
+
+#include "BoidsSimulation_SharedHeader.inl"
+
+enum BoidsISA
+{
+	kBoidsScalar = 0,
+	kBoidsSSE,
+	kBoidsAVX2,
+	kBoidsNEON,
+	kNumBoidsISA,
+};
+
+BoidsISA DetectBestBoidsISA();
+bool IsBoidsISASupported( BoidsISA ISA );
+const char* GetBoidsISAName( BoidsISA ISA );
+
+//--------------------------------------------------------------------------------------
+// FishStreams
+//--------------------------------------------------------------------------------------
+class FishStreams
+{
+public:
+	enum Stream { kPosX = 0, kPosY, kPosZ, kVelX, kVelY, kVelZ, kNumStreams };
+	// Stride is rounded up to kLaneGroup fish, so every stream starts 32 bytes aligned and a full
+	// lane group load starting at any valid index stays inside the allocation
+	static const uint32_t kLaneGroup = 8;
+
+	FishStreams();
+	~FishStreams();
+
+	void Resize( uint32_t Count );
+	uint32_t GetCount() const { return m_Count; }
+
+	float* operator[]( uint32_t Idx ) { return m_pData + Idx * m_Stride; }
+	const float* operator[]( uint32_t Idx ) const { return m_pData + Idx * m_Stride; }
+
+	void Set( uint32_t Idx, const float3& Pos, const float3& Vel );
+	// Streaming conversion from/to the FishData layout used by the upload buffer
+	void Load( const FishData* pSrc, uint32_t Count );
+	void Store( FishData* pDst ) const;
+
+private:
+	FishStreams( const FishStreams& ) = delete;
+	FishStreams& operator=( const FishStreams& ) = delete;
+
+	float*		m_pData;
+	uint32_t	m_Count;
+	uint32_t	m_Stride;
+};
+
+//--------------------------------------------------------------------------------------
+// Neighbor gathering
+//--------------------------------------------------------------------------------------
+// Everything a kernel needs to know about the fish being updated, all in local space
+struct NeighborQuery
+{
+	float	Pos[3];
+	float	VelDir[3];
+	float	VisionDist;
+	float	VisionAngleCos;
+	float	SeperationFactor;
+	float	AvoidanceFactor;
+};
+
+// Sum of visible neighbor pos/vel and their separation + avoidance forces
+struct NeighborAccum
+{
+	float		Pos[3];
+	float		Vel[3];
+	float		Force[3];
+	uint32_t	Count;
+};
+
+// Visit fish in [pBucketStart[b], pBucketStart[b + 1]) for each b in pBuckets
+typedef void (*GatherNeighborsFn)( const NeighborQuery& Query, const FishStreams& Fish,
+	const uint32_t* pBucketStart, const uint32_t* pBuckets, uint32_t NumBuckets, NeighborAccum& Accum );
+
+GatherNeighborsFn GetGatherNeighborsFn( BoidsISA ISA );
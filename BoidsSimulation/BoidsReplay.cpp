@@ -0,0 +1,197 @@
+#include "BoidsReplay.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+namespace
+{
+	const char kMagic[4] = { 'B', 'R', 'P', 'L' };
+	const uint32_t kVersion = 1;
+
+	struct FileHeader
+	{
+		char		Magic[4];
+		uint32_t	Version;
+		uint32_t	CBSize;
+		uint32_t	Seed;
+		uint32_t	ISA;
+		uint32_t	EmulateTilePadding;
+		uint32_t	NumSteps;
+		uint32_t	NumChanges;
+		uint64_t	Checksum;
+	};
+}
+
+const float BoidsReplay::kInitialClusterScale = 0.2f;
+const uint32_t BoidsReplay::kCBSize = offsetof( SimulationCB, fFishSize ) + sizeof( float );
+
+BoidsReplay::BoidsReplay()
+	:m_Seed( 0 ), m_ISA( kBoidsScalar ), m_EmulateTilePadding( true ), m_NumSteps( 0 ), m_Checksum( 0 )
+{
+}
+
+void BoidsReplay::Begin( const SimulationCB& CB, uint32_t Seed, BoidsISA ISA, bool EmulateTilePadding )
+{
+	m_Seed = Seed;
+	m_ISA = ISA;
+	m_EmulateTilePadding = EmulateTilePadding;
+	m_NumSteps = 0;
+	m_Checksum = 0;
+	m_Changes.clear();
+	// Initial CB is the change at step 0, so record it even if nothing runs
+	CBChange Initial;
+	Initial.Step = 0;
+	Initial.CB.assign( (const uint8_t*)&CB, (const uint8_t*)&CB + kCBSize );
+	m_Changes.push_back( std::move( Initial ) );
+}
+
+void BoidsReplay::RecordStep( const SimulationCB& CB )
+{
+	if (memcmp( m_Changes.back().CB.data(), &CB, kCBSize ) != 0)
+	{
+		CBChange Change;
+		Change.Step = m_NumSteps;
+		Change.CB.assign( (const uint8_t*)&CB, (const uint8_t*)&CB + kCBSize );
+		m_Changes.push_back( std::move( Change ) );
+	}
+	m_NumSteps++;
+}
+
+bool BoidsReplay::Save( const std::string& FileName ) const
+{
+	FILE* pFile = fopen( FileName.c_str(), "wb" );
+	if (!pFile) return false;
+
+	FileHeader Header;
+	memcpy( Header.Magic, kMagic, sizeof( kMagic ) );
+	Header.Version = kVersion;
+	Header.CBSize = kCBSize;
+	Header.Seed = m_Seed;
+	Header.ISA = m_ISA;
+	Header.EmulateTilePadding = m_EmulateTilePadding ? 1 : 0;
+	Header.NumSteps = m_NumSteps;
+	Header.NumChanges = (uint32_t)m_Changes.size();
+	Header.Checksum = m_Checksum;
+
+	bool Succeeded = fwrite( &Header, sizeof( Header ), 1, pFile ) == 1;
+	for (size_t i = 0; i < m_Changes.size() && Succeeded; ++i)
+	{
+		Succeeded = fwrite( &m_Changes[i].Step, sizeof( uint32_t ), 1, pFile ) == 1;
+		Succeeded = Succeeded && fwrite( m_Changes[i].CB.data(), kCBSize, 1, pFile ) == 1;
+	}
+	fclose( pFile );
+	return Succeeded;
+}
+
+bool BoidsReplay::Load( const std::string& FileName )
+{
+	FILE* pFile = fopen( FileName.c_str(), "rb" );
+	if (!pFile) return false;
+
+	FileHeader Header;
+	bool Succeeded = fread( &Header, sizeof( Header ), 1, pFile ) == 1 &&
+		memcmp( Header.Magic, kMagic, sizeof( kMagic ) ) == 0 &&
+		Header.Version == kVersion && Header.CBSize == kCBSize &&
+		Header.ISA < kNumBoidsISA && Header.NumChanges != 0;
+
+	std::vector<CBChange> Changes( Succeeded ? Header.NumChanges : 0 );
+	for (size_t i = 0; i < Changes.size() && Succeeded; ++i)
+	{
+		Changes[i].CB.resize( kCBSize );
+		Succeeded = fread( &Changes[i].Step, sizeof( uint32_t ), 1, pFile ) == 1;
+		Succeeded = Succeeded && fread( Changes[i].CB.data(), kCBSize, 1, pFile ) == 1;
+	}
+	fclose( pFile );
+	if (!Succeeded) return false;
+
+	m_Seed = Header.Seed;
+	m_ISA = (BoidsISA)Header.ISA;
+	m_EmulateTilePadding = Header.EmulateTilePadding != 0;
+	m_NumSteps = Header.NumSteps;
+	m_Checksum = Header.Checksum;
+	m_Changes = std::move( Changes );
+	return true;
+}
+
+void BoidsReplay::ApplyChange( const CBChange& Change, SimulationCB& CB ) const
+{
+	memcpy( &CB, Change.CB.data(), kCBSize );
+}
+
+bool BoidsReplay::Play( BoidsEngine& Engine, uint64_t& Checksum ) const
+{
+	// Lanes sum in a different order per ISA, result is only bit-exact with the recorded one
+	if (!IsBoidsISASupported( m_ISA ))
+		return false;
+
+	// Every meaningful byte comes from the initial change
+	SimulationCB CB;
+	ApplyChange( m_Changes[0], CB );
+
+	std::vector<FishData> Fish( CB.uNumInstance );
+	BoidsEngine::GenerateFishData( CB, m_Seed, kInitialClusterScale, Fish.data() );
+	Engine.SetISA( m_ISA );
+	Engine.m_EmulateTilePadding = m_EmulateTilePadding;
+	Engine.Init( CB, Fish.data() );
+
+	uint32_t Step = 0;
+	for (size_t c = 1; c <= m_Changes.size(); ++c)
+	{
+		// Run until next change in one go
+		uint32_t NextChange = c < m_Changes.size() ? m_Changes[c].Step : m_NumSteps;
+		if (NextChange > Step)
+		{
+			Engine.Step( NextChange - Step );
+			Step = NextChange;
+		}
+		if (c < m_Changes.size())
+		{
+			ApplyChange( m_Changes[c], CB );
+			Engine.SetSimulationCB( CB );
+		}
+	}
+	Checksum = BoidsReplay::Checksum( Engine.GetFishData(), Engine.GetNumFish() );
+	return true;
+}
+
+uint64_t BoidsReplay::Checksum( const FishData* pFishData, uint32_t Count )
+{
+	uint64_t Hash = 14695981039346656037ull;
+	const uint8_t* pBytes = (const uint8_t*)pFishData;
+	for (size_t i = 0; i < Count * sizeof( FishData ); ++i)
+	{
+		Hash ^= pBytes[i];
+		Hash *= 1099511628211ull;
+	}
+	return Hash;
+}
+
+std::vector<BoidsReplay::BatchResult> BoidsReplay::RunBatch( const std::vector<std::string>& FileNames, TaskScheduler* pScheduler )
+{
+	std::vector<BatchResult> Results;
+	for (auto& FileName : FileNames)
+	{
+		BatchResult Result = {};
+		Result.FileName = FileName;
+		BoidsReplay Replay;
+		Result.Loaded = Replay.Load( FileName );
+		if (Result.Loaded)
+		{
+			BoidsEngine Engine;
+			Engine.SetTaskScheduler( pScheduler );
+			Result.ISA = Replay.GetISA();
+			auto Start = std::chrono::high_resolution_clock::now();
+			Result.ISAAvailable = Replay.Play( Engine, Result.Checksum );
+			std::chrono::duration<double> Elapsed = std::chrono::high_resolution_clock::now() - Start;
+			Result.NumSteps = Replay.GetNumSteps();
+			Result.Seconds = Elapsed.count();
+			Result.ExpectedChecksum = Replay.GetChecksum();
+			Result.Verified = Result.ISAAvailable && Result.ExpectedChecksum != 0;
+			Result.Matched = Result.Verified && Result.ExpectedChecksum == Result.Checksum;
+		}
+		Results.push_back( Result );
+	}
+	return Results;
+}
@@ -0,0 +1,80 @@
+#pragma once
+// Record of a fixed timestep Boids run: seed of the initial fish data, the SimulationCB of every
+// step where it changed, and the number of steps. Playing it back with BoidsEngine reproduces the
+// run bit-exactly (same binary and ISA), so a checksum of the final state could be stored and
+// verified headless, in batches, without window or device.
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "BoidsEngine.h"
+
+//--------------------------------------------------------------------------------------
+// BoidsReplay
+//--------------------------------------------------------------------------------------
+class BoidsReplay
+{
+public:
+	// Initial fish are spread over this portion of f3xyzExpand, same as the interactive app
+	static const float kInitialClusterScale;
+
+	BoidsReplay();
+
+	void Begin( const SimulationCB& CB, uint32_t Seed, BoidsISA ISA, bool EmulateTilePadding );
+	// Call once before every fixed step with the CB that step runs with
+	void RecordStep( const SimulationCB& CB );
+	// 0 saves the run without one, its playback can't be verified then
+	void SetChecksum( uint64_t Checksum ) { m_Checksum = Checksum; }
+
+	bool Save( const std::string& FileName ) const;
+	bool Load( const std::string& FileName );
+
+	uint32_t GetSeed() const { return m_Seed; }
+	uint32_t GetNumSteps() const { return m_NumSteps; }
+	uint32_t GetNumChanges() const { return (uint32_t)m_Changes.size(); }
+	uint64_t GetChecksum() const { return m_Checksum; }
+	BoidsISA GetISA() const { return m_ISA; }
+
+	// Run all steps on Engine from the seeded initial state, Checksum gets the final state's. False
+	// without running when this CPU lacks the recorded ISA, no other one could give the same checksum
+	bool Play( BoidsEngine& Engine, uint64_t& Checksum ) const;
+
+	// FNV-1a over the raw fish data
+	static uint64_t Checksum( const FishData* pFishData, uint32_t Count );
+
+	struct BatchResult
+	{
+		std::string	FileName;
+		bool		Loaded;
+		BoidsISA	ISA;				// Recorded with
+		bool		ISAAvailable;		// False if this CPU lacks it, not played
+		uint32_t	NumSteps;
+		double		Seconds;
+		uint64_t	Checksum;
+		uint64_t	ExpectedChecksum;
+		bool		Verified;			// False if the replay has no checksum, Matched is false too
+		bool		Matched;
+	};
+	// Play every file in turn, pScheduler could be nullptr for single thread playback
+	static std::vector<BatchResult> RunBatch( const std::vector<std::string>& FileNames, TaskScheduler* pScheduler );
+
+private:
+	// Only the meaningful bytes of SimulationCB are kept, so alignment padding never affects
+	// comparison and files are the same on every platform
+	static const uint32_t kCBSize;
+	struct CBChange
+	{
+		uint32_t				Step;
+		std::vector<uint8_t>	CB;
+	};
+
+	void ApplyChange( const CBChange& Change, SimulationCB& CB ) const;
+
+	uint32_t				m_Seed;
+	BoidsISA				m_ISA;
+	bool					m_EmulateTilePadding;
+	uint32_t				m_NumSteps;
+	uint64_t				m_Checksum;
+	std::vector<CBChange>	m_Changes;
+};
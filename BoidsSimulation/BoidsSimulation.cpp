@@ -23,18 +23,8 @@ FishData* BoidsSimulation::CreateInitialFishData()
 	FishData* pFishData = new FishData[m_SimulationCB.uNumInstance];
 	if (!pFishData) return nullptr;
 
-	float clusterScale = 0.2f;			// Cluster radius in meters
-	float velFactor = 1.f;
-
-	for (uint32_t i = 0; i < m_SimulationCB.uNumInstance; ++i)
-	{
-		pFishData[i].pos.x = (rand() / (float)RAND_MAX * 2 - 1) * m_SimulationCB.f3xyzExpand.x * clusterScale + m_SimulationCB.f3CenterPos.x;
-		pFishData[i].pos.y = (rand() / (float)RAND_MAX * 2 - 1) * m_SimulationCB.f3xyzExpand.y * clusterScale + m_SimulationCB.f3CenterPos.y;
-		pFishData[i].pos.z = (rand() / (float)RAND_MAX * 2 - 1) * m_SimulationCB.f3xyzExpand.z * clusterScale + m_SimulationCB.f3CenterPos.z;
-		pFishData[i].vel.x = (rand() / (float)RAND_MAX * 2 - 1) * velFactor;				  
-		pFishData[i].vel.y = (rand() / (float)RAND_MAX * 2 - 1) * velFactor;
-		pFishData[i].vel.z = (rand() / (float)RAND_MAX * 2 - 1) * velFactor;
-	};
+	// Same generator replays use, so a recorded seed is all it takes to rebuild the initial state
+	BoidsEngine::GenerateFishData( m_SimulationCB, m_Seed, BoidsReplay::kInitialClusterScale, pFishData );
 	return pFishData;
 }
 
@@ -89,6 +79,8 @@ void BoidsSimulation::OnConfiguration()
 
 void BoidsSimulation::OnInit()
 {
+	m_TaskScheduler.Initialize();
+	m_CPUEngine.SetTaskScheduler( &m_TaskScheduler );
 }
 
 HRESULT BoidsSimulation::OnCreateResource()
@@ -169,6 +161,7 @@ HRESULT BoidsSimulation::LoadAssets()
 	FishData* pFishData = CreateInitialFishData();
 	m_BoidsPosVelBuffer[0].Create( L"BoidsPosVolBuffer[0]", m_SimulationCB.uNumInstance, sizeof( FishData ), (void*)pFishData );
 	m_BoidsPosVelBuffer[1].Create( L"BoidsPosVolBuffer[1]", m_SimulationCB.uNumInstance, sizeof( FishData ), (void*)pFishData );
+	m_BoidsPosVelBuffer[2].Create( L"BoidsPosVolBuffer[2]", m_SimulationCB.uNumInstance, sizeof( FishData ), (void*)pFishData );
 	delete pFishData;
 
 	// Define and create vertex buffer for fish
@@ -205,6 +198,57 @@ void BoidsSimulation::OnUpdate()
 	if (ImGui::Begin( "BoidsSimulation", &showPanel ))
 	{
 		ImGui::Checkbox( "Separate Context", &m_SeperateContext);
+		ImGui::SameLine();
+		ImGui::Checkbox( "Async Compute", &m_AsyncCompute );
+		if (m_AsyncCompute && !m_AsyncActive)
+		{
+			ImGui::SameLine();
+			ImGui::Text( "(off with CPU Simulation or Deterministic)" );
+		}
+		if (ImGui::CollapsingHeader( "Async Compute Schedule Check" ))
+		{
+			// Simulated queues, GPU bound with rendering longer than a CPU frame, then CPU bound
+			if (ImGui::Button( "Run Check" ))
+			{
+				m_AsyncCheck[0] = CheckBoidsAsyncSchedule( 5000, 1000.0, 12000.0, 2000.0, m_Seed );
+				m_AsyncCheck[1] = CheckBoidsAsyncSchedule( 5000, 3000.0, 4000.0, 8000.0, m_Seed );
+			}
+			for (auto& Check : m_AsyncCheck)
+				ImGui::Text( "%u frames: %llu hazards %llu stale renders %.1f%% overlap %.2fms/frame", Check.NumFrames,
+					Check.NumHazards, Check.NumStaleRenders, Check.OverlapPercent, Check.FrameMs );
+		}
+		if (ImGui::Checkbox( "CPU Simulation", &m_CPUSimulation ))
+		{
+			if (m_CPUSimulation) m_CPUEngineReady = false;
+			// Recording has to restart so CPU state matches the replay from step 0
+			if (m_Deterministic) m_NeedReseed = true;
+		}
+		if (m_CPUSimulation)
+		{
+			ImGui::SameLine();
+			ImGui::Text( "%s %.2fms %d cells", GetBoidsISAName( m_CPUEngine.GetISA() ), m_CPUStepTime, m_CPUEngine.GetOccupiedCellCount() );
+			if (ImGui::Checkbox( "Multi-thread", &m_CPUMultiThread ))
+				m_CPUEngine.SetTaskScheduler( m_CPUMultiThread ? &m_TaskScheduler : nullptr );
+			ImGui::SameLine();
+			ImGui::Text( "%d threads %.1f neighbors", m_CPUMultiThread ? m_TaskScheduler.GetNumThreads() : 1, m_CPUEngine.GetAvgNeighborCount() );
+		}
+		if (ImGui::CollapsingHeader( "CPU Scaling Benchmark" ))
+		{
+			if (m_BenchmarkRunning) ImGui::Text( "Running..." );
+			else if (ImGui::Button( "Run Benchmark" )) StartScalingBenchmark();
+			std::lock_guard<std::mutex> Lock( m_BenchmarkMutex );
+			for (auto& Result : m_BenchmarkResults)
+				ImGui::Text( "%8d fish %3d threads %10.2f steps/s", Result.NumFish, Result.NumThreads, Result.StepsPerSec );
+		}
+		if (ImGui::Checkbox( "Deterministic", &m_Deterministic ) && m_Deterministic) m_NeedReseed = true;
+		if (m_Deterministic)
+		{
+			ImGui::SameLine();
+			ImGui::Text( "seed %u, %u steps, %u CB changes", m_Seed, m_Replay.GetNumSteps(), m_Replay.GetNumChanges() );
+			if (ImGui::Button( "Restart" )) m_NeedReseed = true;
+			ImGui::SameLine();
+			if (ImGui::Button( "Save Replay" )) SaveReplay();
+		}
 		ImGui::Checkbox( "PerFrame Simulation", &m_ForcePerFrameSimulation ); ImGui::SameLine();
 		static char pauseSim[] = "Pause Simulation";
 		static char continueSim[] = "Continue Simulation";
@@ -236,7 +280,20 @@ void BoidsSimulation::OnRender( CommandContext& EngineContext )
 	uint16_t SimulationCnt = (uint16_t)(m_SimulationTimer/m_SimulationDelta);
 	m_SimulationTimer -= SimulationCnt * m_SimulationDelta;
 
-	if (m_ForcePerFrameSimulation) 
+	if (m_Deterministic)
+	{
+		// Substep count comes from StepTimer, fDeltaT never follows frame time
+		m_StepTimer.SetFixedTimeStep( true );
+		m_StepTimer.SetTargetElapsedSeconds( m_SimulationDelta );
+		SimulationCnt = 0;
+		m_StepTimer.Tick( [&SimulationCnt]() { ++SimulationCnt; } );
+		if (m_SimulationCB.fDeltaT != m_SimulationDelta)
+		{
+			m_SimulationCB.fDeltaT = m_SimulationDelta;
+			m_NeedUpdate = true;
+		}
+	}
+	else if (m_ForcePerFrameSimulation) 
 	{
 		SimulationCnt = 1;
 		m_SimulationCB.fDeltaT = deltaTime<=0? m_SimulationDelta : deltaTime;
@@ -250,6 +307,28 @@ void BoidsSimulation::OnRender( CommandContext& EngineContext )
 
 	wchar_t timerName[32];
 	if (m_PauseSimulation) SimulationCnt = 0;
+	// The CPU path and reseeding write the buffers on the direct queue, so neither runs async
+	bool UseAsync = m_AsyncCompute && !m_CPUSimulation && !m_Deterministic;
+	if (UseAsync != m_AsyncActive) SetAsyncCompute( UseAsync );
+	if (m_Deterministic)
+	{
+		if (m_NeedReseed) ReseedFish( EngineContext );
+		for (int i = 0; i < SimulationCnt; ++i)
+			m_Replay.RecordStep( m_SimulationCB );
+	}
+	if (m_CPUSimulation)
+	{
+		SimulateOnCPU( EngineContext, SimulationCnt );
+		SimulationCnt = 0;
+	}
+	if (m_AsyncActive)
+	{
+		SimulateAsync( SimulationCnt );
+		SimulationCnt = 0;
+	}
+	// Separate contexts of the substeps go to the queue as one submission on one fence
+	bool BatchSubsteps = m_SeperateContext && SimulationCnt > 0;
+	if (BatchSubsteps) m_SimulationBatch.Begin( SimulationCnt );
 	for (int i = 0; i < SimulationCnt; ++i)
 	{
 		swprintf( timerName, L"Simulation %d", i );
@@ -273,8 +352,9 @@ void BoidsSimulation::OnRender( CommandContext& EngineContext )
 			cptContext.BeginResourceTransition( m_BoidsPosVelBuffer[1-m_OnStageBufIdx], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
 			cptContext.BeginResourceTransition( m_BoidsPosVelBuffer[m_OnStageBufIdx], D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
 		}
-		if (m_SeperateContext) cptContext.Finish();
+		if (m_SeperateContext) cptContext.FinishInto( m_SimulationBatch, i );
 	}
+	if (BatchSubsteps) m_SimulationBatch.Submit();
 
 	// Record all the commands we need to render the scene into the command list.
 	XMMATRIX view = m_camera.View();
@@ -285,7 +365,9 @@ void BoidsSimulation::OnRender( CommandContext& EngineContext )
 	// We should do m_renderCB.mWorldViewProj = XMMatrixTranspose(XMMatricMultiply(proj,view))
 	m_RenderCB.mWorldViewProj = XMMatrixMultiply( view, proj );
 
-	GraphicsContext& gfxContext = m_SeperateContext? GraphicsContext::Begin(L"Rendering") : EngineContext.GetGraphicsContext();
+	// Async compute needs the exact fence of the render, so it always gets its own context
+	bool SeperateRender = m_SeperateContext || m_AsyncActive;
+	GraphicsContext& gfxContext = SeperateRender? GraphicsContext::Begin(L"Rendering") : EngineContext.GetGraphicsContext();
 	{
 		GPU_PROFILE( gfxContext, L"Render" );
 		gfxContext.TransitionResource( m_BoidsPosVelBuffer[m_OnStageBufIdx], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
@@ -308,10 +390,176 @@ void BoidsSimulation::OnRender( CommandContext& EngineContext )
 		gfxContext.SetScisor( Graphics::g_DisplayPlaneScissorRect );
 		gfxContext.SetVertexBuffer( 0, m_VertexBuffer.VertexBufferView() );
 		gfxContext.DrawInstanced( _countof( FishMesh ), m_SimulationCB.uNumInstance );
-		gfxContext.BeginResourceTransition( m_BoidsPosVelBuffer[m_OnStageBufIdx], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
-		gfxContext.BeginResourceTransition( m_BoidsPosVelBuffer[1 - m_OnStageBufIdx], D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+		// Async compute does all transitions of the buffers on the compute queue
+		if (!m_AsyncActive)
+		{
+			gfxContext.BeginResourceTransition( m_BoidsPosVelBuffer[m_OnStageBufIdx], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
+			gfxContext.BeginResourceTransition( m_BoidsPosVelBuffer[1 - m_OnStageBufIdx], D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+		}
+	}
+	if (m_AsyncActive)
+	{
+		if (m_RenderWaitFence != 0)
+			Graphics::g_cmdListMngr.GpuWait( D3D12_COMMAND_LIST_TYPE_DIRECT, m_RenderWaitFence );
+		m_BufferRing.RenderSubmitted( m_OnStageBufIdx, gfxContext.Finish() );
+	}
+	else if (m_SeperateContext) gfxContext.Finish();
+}
+
+// Entering, every buffer goes to the state the compute queue leaves them in. Leaving, the newest
+// result moves to one of the two buffers the direct queue path ping-pongs.
+void BoidsSimulation::SetAsyncCompute( bool Enable )
+{
+	m_AsyncActive = Enable;
+	GraphicsContext& Context = GraphicsContext::Begin( L"Async Compute Switch" );
+	if (Enable)
+	{
+		for (auto& Buffer : m_BoidsPosVelBuffer)
+			Context.TransitionResource( Buffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
+		Context.FlushResourceBarriers();
+		m_BufferRing.Reset( m_OnStageBufIdx, Context.Finish() );
+		return;
+	}
+
+	if (m_BufferRing.GetLatestFence() != 0)
+		Graphics::g_cmdListMngr.GpuWait( D3D12_COMMAND_LIST_TYPE_DIRECT, m_BufferRing.GetLatestFence() );
+	uint32_t LatestIdx = m_BufferRing.GetRenderIdx();
+	if (LatestIdx == 2)
+	{
+		Context.TransitionResource( m_BoidsPosVelBuffer[2], D3D12_RESOURCE_STATE_COPY_SOURCE );
+		Context.CopyBufferRegion( m_BoidsPosVelBuffer[0], 0, m_BoidsPosVelBuffer[2], 0, m_SimulationCB.uNumInstance * sizeof( FishData ) );
+		LatestIdx = 0;
+	}
+	m_OnStageBufIdx = (uint8_t)LatestIdx;
+	Context.Finish();
+}
+
+// All substeps go to the compute queue in one list, the render of this frame shows the result of
+// the previous one and waits for it on the GPU
+void BoidsSimulation::SimulateAsync( uint16_t SimulationCnt )
+{
+	m_OnStageBufIdx = (uint8_t)m_BufferRing.GetRenderIdx();
+	m_RenderWaitFence = m_BufferRing.GetRenderWaitFence();
+	uint32_t NumSteps = min( (uint32_t)SimulationCnt, (uint32_t)BoidsBufferRing::kMaxSteps );
+	if (NumSteps == 0)
+		return;
+
+	BoidsSimulationPass Passes[BoidsBufferRing::kMaxSteps];
+	uint64_t WaitFence = m_BufferRing.PlanSimulation( NumSteps, Passes );
+	// Timestamps of the compute queue aren't comparable with the direct queue's, so no GPU_PROFILE
+	ComputeContext& cptContext = ComputeContext::Begin( L"Simulating", true );
+	cptContext.SetRootSignature( m_RootSignature );
+	cptContext.SetPipelineState( m_ComputePSO );
+	if (m_NeedUpdate)
+	{
+		m_NeedUpdate = false;
+		memcpy( m_pConstantBuffer->DataPtr, &m_SimulationCB, sizeof( SimulationCB ) );
+	}
+	cptContext.SetConstantBuffer( 1, m_pConstantBuffer->GpuAddress );
+	for (uint32_t i = 0; i < NumSteps; ++i)
+	{
+		cptContext.TransitionResource( m_BoidsPosVelBuffer[Passes[i].ReadIdx], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
+		cptContext.TransitionResource( m_BoidsPosVelBuffer[Passes[i].WriteIdx], D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+		cptContext.SetBufferSRV( 2, m_BoidsPosVelBuffer[Passes[i].ReadIdx] );
+		cptContext.SetBufferUAV( 3, m_BoidsPosVelBuffer[Passes[i].WriteIdx] );
+		cptContext.Dispatch1D( m_SimulationCB.uNumInstance, BLOCK_SIZE );
+	}
+	// Rendering reads the result without touching its state
+	cptContext.TransitionResource( m_BoidsPosVelBuffer[Passes[NumSteps - 1].WriteIdx], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, true );
+	if (WaitFence != 0)
+		Graphics::g_cmdListMngr.GpuWait( D3D12_COMMAND_LIST_TYPE_COMPUTE, WaitFence );
+	m_BufferRing.SimulationSubmitted( NumSteps, Passes, cptContext.Finish() );
+}
+
+// Run the same simulation with BoidsEngine and upload the result to current on stage buffer
+void BoidsSimulation::SimulateOnCPU( CommandContext& EngineContext, uint16_t SimulationCnt )
+{
+	bool NeedUpload = !m_CPUEngineReady;
+	if (!m_CPUEngineReady)
+	{
+		// Restart from fresh initial state, GPU buffers are not read back
+		FishData* pFishData = CreateInitialFishData();
+		m_CPUEngine.Init( m_SimulationCB, pFishData );
+		delete[] pFishData;
+		m_CPUEngineReady = true;
+	}
+	if (SimulationCnt != 0)
+	{
+		int64_t startTick, endTick;
+		QueryPerformanceCounter( (LARGE_INTEGER*)&startTick );
+		m_CPUEngine.SetSimulationCB( m_SimulationCB );
+		m_CPUEngine.Step( SimulationCnt );
+		QueryPerformanceCounter( (LARGE_INTEGER*)&endTick );
+		m_CPUStepTime = (double)(endTick - startTick) / Core::g_tickesPerSecond * 1000.0 / SimulationCnt;
+		NeedUpload = true;
+	}
+	if (!NeedUpload) return;
+
+	size_t BufferSize = m_CPUEngine.GetNumFish() * sizeof( FishData );
+	DynAlloc Upload = EngineContext.m_CpuLinearAllocator.Allocate( BufferSize );
+	memcpy( Upload.DataPtr, m_CPUEngine.GetFishData(), BufferSize );
+	EngineContext.CopyBufferRegion( m_BoidsPosVelBuffer[m_OnStageBufIdx], 0, Upload.Buffer, Upload.Offset, BufferSize );
+}
+
+// Fish count goes from 10k to 2M, every count runs at 1, 2, 4 ... N threads
+void BoidsSimulation::StartScalingBenchmark()
+{
+	if (m_BenchmarkThread.joinable()) m_BenchmarkThread.join();
+	m_BenchmarkResults.clear();
+	m_BenchmarkRunning = true;
+	// The render thread keeps changing m_SimulationCB from the GUI, the benchmark runs on a copy
+	m_BenchmarkThread = std::thread( [this, SimulationCB = m_SimulationCB]()
+	{
+		SetThreadName( "Boids Benchmark" );
+		std::vector<uint32_t> FishCounts = { 10000, 100000, 500000, 2000000 };
+		BoidsEngine::RunScalingBenchmark( SimulationCB, FishCounts, 4, [this]( const BoidsBenchmarkResult& Result )
+		{
+			PRINTINFO( "Boids benchmark: %d fish %d threads %.2f steps/s", Result.NumFish, Result.NumThreads, Result.StepsPerSec );
+			std::lock_guard<std::mutex> Lock( m_BenchmarkMutex );
+			m_BenchmarkResults.push_back( Result );
+		} );
+		m_BenchmarkRunning = false;
+	} );
+}
+
+// Restart both GPU buffers and CPU engine from a new seed and begin a new recording
+void BoidsSimulation::ReseedFish( CommandContext& EngineContext )
+{
+	m_NeedReseed = false;
+	m_Seed = (uint32_t)GetTickCount();
+
+	FishData* pFishData = CreateInitialFishData();
+	size_t BufferSize = m_SimulationCB.uNumInstance * sizeof( FishData );
+	DynAlloc Upload = EngineContext.m_CpuLinearAllocator.Allocate( BufferSize );
+	memcpy( Upload.DataPtr, pFishData, BufferSize );
+	delete[] pFishData;
+	// Finish the split barrier last frame began on this buffer before copying into it
+	EngineContext.TransitionResource( m_BoidsPosVelBuffer[1 - m_OnStageBufIdx], D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+	for (int i = 0; i < 2; ++i)
+		EngineContext.CopyBufferRegion( m_BoidsPosVelBuffer[i], 0, Upload.Buffer, Upload.Offset, BufferSize );
+
+	m_CPUEngineReady = false;
+	m_Replay.Begin( m_SimulationCB, m_Seed, m_CPUEngine.GetISA(), m_CPUEngine.m_EmulateTilePadding );
+	m_StepTimer.ResetElapsedTime();
+}
+
+void BoidsSimulation::SaveReplay()
+{
+	// Final state is only known for the CPU path, GPU runs are saved without checksum and their
+	// playback is reported as not verified
+	if (m_CPUSimulation)
+		m_Replay.SetChecksum( BoidsReplay::Checksum( m_CPUEngine.GetFishData(), m_CPUEngine.GetNumFish() ) );
+	else
+		m_Replay.SetChecksum( 0 );
+
+	char FileName[64];
+	sprintf_s( FileName, "BoidsReplay_%u_%u.brpl", m_Seed, m_Replay.GetNumSteps() );
+	if (!m_Replay.Save( FileName ))
+	{
+		PRINTERROR( "Failed to save replay to %s", FileName );
+		return;
 	}
-	if (m_SeperateContext) gfxContext.Finish();
+	PRINTINFO( "Replay saved to %s, %u steps, checksum %llx", FileName, m_Replay.GetNumSteps(), m_Replay.GetChecksum() );
 }
 
 HRESULT BoidsSimulation::OnSizeChanged()
@@ -323,6 +571,8 @@ HRESULT BoidsSimulation::OnSizeChanged()
 
 void BoidsSimulation::OnDestroy()
 {
+	if (m_BenchmarkThread.joinable()) m_BenchmarkThread.join();
+	m_TaskScheduler.Shutdown();
 }
 
 bool BoidsSimulation::OnEvent( MSG* msg )
@@ -10,12 +10,16 @@
 #include "PipelineState.h"
 #include "CommandContext.h"
 #include "Camera.h"
+#include "TaskScheduler.h"
 
 
 using namespace DirectX;
 using namespace Microsoft::WRL;
 
 #include "BoidsSimulation_SharedHeader.inl"
+#include "BoidsEngine.h"
+#include "BoidsReplay.h"
+#include "BoidsAsyncCompute.h"
 
 
 class BoidsSimulation : public Core::IDX12Framework
@@ -39,6 +43,12 @@ private:
 	void ResetCameraView();
 
 	FishData* CreateInitialFishData();
+	void SimulateOnCPU( CommandContext& EngineContext, uint16_t SimulationCnt );
+	void SetAsyncCompute( bool Enable );
+	void SimulateAsync( uint16_t SimulationCnt );
+	void StartScalingBenchmark();
+	void ReseedFish( CommandContext& EngineContext );
+	void SaveReplay();
 
 	uint32_t			m_width;
 	uint32_t			m_height;
@@ -52,7 +62,8 @@ private:
 
 	// Buffers
 	Texture				m_ColorMapTex;
-	StructuredBuffer	m_BoidsPosVelBuffer[2];
+	// Only async compute uses the third one
+	StructuredBuffer	m_BoidsPosVelBuffer[BoidsBufferRing::kNumBuffers];
 	DynAlloc*			m_pConstantBuffer;
 
 	StructuredBuffer	m_VertexBuffer;
@@ -69,9 +80,38 @@ private:
 	bool				m_ForcePerFrameSimulation = true;
 	bool				m_PauseSimulation = false;
 	bool				m_SeperateContext = false;
+	// Substep contexts of Separate Context mode, recorded in slot order on the render thread
+	CommandContextBatch	m_SimulationBatch;
+	// Substeps on the compute queue while the direct queue renders the previous result
+	bool				m_AsyncCompute = false;
+	bool				m_AsyncActive = false;
+	BoidsBufferRing		m_BufferRing;
+	uint64_t			m_RenderWaitFence = 0;
+	BoidsAsyncCheckResult	m_AsyncCheck[2] = {};
 	float				m_SimulationDelta = 0.015f;
 	float				m_SimulationTimer = 0.0f;
 	float				m_SimulationMaxDelta = 0.08f;
 
+	// Headless CPU reference path, result is uploaded into m_BoidsPosVelBuffer[m_OnStageBufIdx]
+	BoidsEngine			m_CPUEngine;
+	TaskScheduler		m_TaskScheduler;
+	bool				m_CPUSimulation = false;
+	bool				m_CPUEngineReady = false;
+	bool				m_CPUMultiThread = true;
+	double				m_CPUStepTime = 0.0;
+
+	// Fixed timestep mode, every step is recorded into m_Replay for headless playback
+	StepTimer			m_StepTimer;
+	BoidsReplay			m_Replay;
+	uint32_t			m_Seed = 1;
+	bool				m_Deterministic = false;
+	bool				m_NeedReseed = false;
+
+	// Steps/sec over fish and thread counts, measured on a background thread
+	std::thread							m_BenchmarkThread;
+	std::mutex							m_BenchmarkMutex;
+	std::vector<BoidsBenchmarkResult>	m_BenchmarkResults;
+	std::atomic<bool>					m_BenchmarkRunning{ false };
+
 	LinearAllocator		m_Allocator;
 };
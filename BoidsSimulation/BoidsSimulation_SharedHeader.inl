@@ -1,17 +1,20 @@
 
+#ifndef BOIDSSIMULATION_SHAREDHEADER
+#define BOIDSSIMULATION_SHAREDHEADER
 #define BLOCK_SIZE 256
 
 // Do not modify below this line
-#if __cplusplus
+#if __cplusplus && defined(_WIN32)
 #define CBUFFER_ALIGN __declspec(align(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT))
 #else
+// hlsl, or headless build of BoidsEngine on non-Windows host where no upload to constant buffer happens
 #define CBUFFER_ALIGN
 #endif
 
 #if __hlsl
 #define REGISTER(x) :register(x)
 #define STRUCT(x) x
-#else 
+#elif defined(_WIN32)
 typedef XMMATRIX	matrix;
 typedef XMINT4		int4;
 typedef XMINT3		int3;
@@ -21,12 +24,23 @@ typedef XMFLOAT2	float2;
 typedef UINT		uint;
 #define REGISTER(x)
 #define STRUCT(x) struct
+#else
+// Layout compatible stand-ins for DirectXMath types so the CPU engine can consume this header without a device
+struct matrix { float m[4][4]; };
+struct int4 { int x, y, z, w; };
+struct int3 { int x, y, z; };
+struct float4 { float x, y, z, w; };
+struct float3 { float x, y, z; float3() {} float3( float _x, float _y, float _z ) :x( _x ), y( _y ), z( _z ) {} };
+struct float2 { float x, y; };
+typedef unsigned int uint;
+#define REGISTER(x)
+#define STRUCT(x) struct
 #endif
 
 CBUFFER_ALIGN STRUCT( cbuffer ) RenderCB REGISTER( b0 )
 {
 	matrix	mWorldViewProj;
-#if __cplusplus
+#if __cplusplus && defined(_WIN32)
 	void* operator new(size_t i){return _aligned_malloc( i,16 );};
 	void operator delete(void* p) { _aligned_free( p ); };
 #endif
@@ -59,7 +73,7 @@ CBUFFER_ALIGN STRUCT( cbuffer ) SimulationCB REGISTER( b1 )
 	uint	uNumInstance;
 	float	fFishSize;
 
-#if __cplusplus
+#if __cplusplus && defined(_WIN32)
 	void* operator new(size_t i){return _aligned_malloc( i,16 );};
 	void operator delete(void* p) { _aligned_free( p ); };
 #endif
@@ -71,4 +85,5 @@ struct FishData
 	float3 vel;
 };
 
-#undef CBUFFER_ALIGN
\ No newline at end of file
+#undef CBUFFER_ALIGN
+#endif // BOIDSSIMULATION_SHAREDHEADER
\ No newline at end of file
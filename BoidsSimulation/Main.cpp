@@ -1,9 +1,76 @@
 #include "stdafx.h"
 #include "BoidsSimulation.h"
 
+namespace
+{
+	// -replay file [file ...] [-threads N]: play recorded runs without window or device and verify
+	// their checksums, skipping runs recorded with an ISA this CPU lacks. Runs saved without checksum
+	// are played and reported as not verified, never as matched. Returns -1 if there is nothing to
+	// replay, otherwise the process exit code.
+	int RunHeadlessReplay()
+	{
+		int argc;
+		LPWSTR *argv = CommandLineToArgvW( GetCommandLineW(), &argc );
+		std::vector<std::string> FileNames;
+		bool ReplayMode = false;
+		uint32_t NumThreads = 0;
+		for (int i = 1; i < argc; ++i)
+		{
+			if (_wcsicmp( argv[i], L"-replay" ) == 0) { ReplayMode = true; continue; }
+			if (_wcsicmp( argv[i], L"-threads" ) == 0 && i + 1 < argc) { NumThreads = _wtoi( argv[++i] ); continue; }
+			if (!ReplayMode || argv[i][0] == L'-') continue;
+			char FileName[MAX_PATH];
+			WideCharToMultiByte( CP_ACP, 0, argv[i], -1, FileName, MAX_PATH, nullptr, nullptr );
+			FileNames.push_back( FileName );
+		}
+		LocalFree( argv );
+		if (!ReplayMode) return -1;
+
+		MsgPrinting::Init();
+		TaskScheduler Scheduler;
+		Scheduler.Initialize( NumThreads );
+		bool AllMatched = true;
+		for (auto& Result : BoidsReplay::RunBatch( FileNames, &Scheduler ))
+		{
+			if (!Result.Loaded)
+			{
+				PRINTERROR( "Failed to load replay %s", Result.FileName.c_str() );
+				AllMatched = false;
+				continue;
+			}
+			// Can't be verified here, which isn't a mismatch
+			if (!Result.ISAAvailable)
+			{
+				PRINTWARN( "%s: skipped, recorded with %s which this CPU lacks", Result.FileName.c_str(),
+					GetBoidsISAName( Result.ISA ) );
+				continue;
+			}
+			// Recorded without checksum (GPU runs), played but nothing to compare with
+			if (!Result.Verified)
+			{
+				PRINTWARN( "%s: %u steps played, not verified, recorded without checksum", Result.FileName.c_str(),
+					Result.NumSteps );
+				continue;
+			}
+			if (Result.Matched)
+				PRINTINFO( "%s: %u steps %.2f steps/s checksum %llx", Result.FileName.c_str(), Result.NumSteps,
+					Result.NumSteps / max( Result.Seconds, 1e-9 ), Result.Checksum )
+			else
+				PRINTERROR( "%s: checksum %llx does not match recorded %llx", Result.FileName.c_str(), Result.Checksum, Result.ExpectedChecksum );
+			AllMatched = AllMatched && Result.Matched;
+		}
+		Scheduler.Shutdown();
+		MsgPrinting::Destory();
+		return AllMatched ? 0 : 1;
+	}
+}
+
 _Use_decl_annotations_
 int WINAPI WinMain( HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow )
 {
+	int ExitCode = RunHeadlessReplay();
+	if (ExitCode >= 0) return ExitCode;
+
 	BoidsSimulation application( 1280, 720);
 	return Core::Run( application, hInstance, nCmdShow );
 }
@@ -131,7 +131,7 @@ HRESULT RotatingCube::LoadSizeDependentResource()
 // Update frame-based values.
 void RotatingCube::OnUpdate()
 {
-	m_timer.Tick( NULL );
+	m_timer.Tick( nullptr );
 	m_camera.ProcessInertia();
 }
 
@@ -0,0 +1,252 @@
+#ifdef _WIN32
+#include "LibraryHeader.h"
+#endif
+#include "AllocationTrace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+	const char kMagic[4] = { 'A', 'T', 'R', 'C' };
+	const size_t kHeaderSize = sizeof( kMagic ) + sizeof( uint32_t );
+	const size_t kFlushSize = 0x10000;
+	const uint64_t kFenceMask = (1ull << 56) - 1;
+
+	// Everything below is guarded by s_Mutex
+	std::mutex s_Mutex;
+	FILE* s_pFile = nullptr;
+	std::vector<uint8_t> s_Buffer;
+	std::unordered_map<const void*, uint32_t> s_LinearIds;
+	std::unordered_map<const void*, uint32_t> s_DescriptorIds;
+	uint64_t s_NumEvents = 0;
+
+	uint32_t GetId( std::unordered_map<const void*, uint32_t>& Ids, const void* pObject )
+	{
+		auto Result = Ids.insert( std::make_pair( pObject, (uint32_t)Ids.size() ) );
+		return Result.first->second;
+	}
+
+	void WriteVarint( uint64_t Value )
+	{
+		while (Value >= 0x80)
+		{
+			s_Buffer.push_back( (uint8_t)(Value | 0x80) );
+			Value >>= 7;
+		}
+		s_Buffer.push_back( (uint8_t)Value );
+	}
+
+	void WriteEvent( AllocTraceEvent Event, uint32_t HighNibble )
+	{
+		s_Buffer.push_back( (uint8_t)(Event | (HighNibble & 0xf) << 4) );
+		s_NumEvents++;
+	}
+
+	void WriteFence( uint64_t FenceValue ) { WriteVarint( FenceValue & kFenceMask ); }
+
+	void FlushBuffer( bool Force )
+	{
+		if (s_pFile == nullptr || s_Buffer.empty() || (!Force && s_Buffer.size() < kFlushSize))
+			return;
+		fwrite( s_Buffer.data(), 1, s_Buffer.size(), s_pFile );
+		s_Buffer.clear();
+	}
+
+	uint32_t Log2( uint64_t Value )
+	{
+		uint32_t Result = 0;
+		while (Value > 1)
+		{
+			Value >>= 1;
+			Result++;
+		}
+		return Result;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// AllocTraceRecorder
+//--------------------------------------------------------------------------------------
+std::atomic<bool> AllocTraceRecorder::sm_Recording( false );
+
+bool AllocTraceRecorder::Begin( const char* FileName )
+{
+	std::lock_guard<std::mutex> Lock( s_Mutex );
+	if (s_pFile != nullptr)
+		return false;
+	s_pFile = fopen( FileName, "wb" );
+	if (s_pFile == nullptr)
+		return false;
+	uint32_t Version = kVersion;
+	fwrite( kMagic, sizeof( kMagic ), 1, s_pFile );
+	fwrite( &Version, sizeof( Version ), 1, s_pFile );
+	s_Buffer.reserve( kFlushSize + 64 );
+	s_LinearIds.clear();
+	s_DescriptorIds.clear();
+	s_NumEvents = 0;
+	sm_Recording.store( true, std::memory_order_relaxed );
+	return true;
+}
+
+void AllocTraceRecorder::End()
+{
+	std::lock_guard<std::mutex> Lock( s_Mutex );
+	sm_Recording.store( false, std::memory_order_relaxed );
+	if (s_pFile == nullptr)
+		return;
+	FlushBuffer( true );
+	fclose( s_pFile );
+	s_pFile = nullptr;
+}
+
+uint64_t AllocTraceRecorder::GetNumEvents()
+{
+	std::lock_guard<std::mutex> Lock( s_Mutex );
+	return s_NumEvents;
+}
+
+void AllocTraceRecorder::LinearAllocate( const void* pAllocator, uint32_t Type, size_t SizeInByte, size_t Alignment )
+{
+	std::lock_guard<std::mutex> Lock( s_Mutex );
+	if (s_pFile == nullptr) return;
+	WriteEvent( kTraceLinearAlloc, Type );
+	WriteVarint( GetId( s_LinearIds, pAllocator ) );
+	WriteVarint( SizeInByte );
+	WriteVarint( Log2( Alignment ) );
+	FlushBuffer( false );
+}
+
+void AllocTraceRecorder::LinearCleanup( const void* pAllocator, uint64_t FenceValue )
+{
+	std::lock_guard<std::mutex> Lock( s_Mutex );
+	if (s_pFile == nullptr) return;
+	WriteEvent( kTraceLinearCleanup, (uint32_t)(FenceValue >> 56) );
+	WriteVarint( GetId( s_LinearIds, pAllocator ) );
+	WriteFence( FenceValue );
+	FlushBuffer( false );
+}
+
+void AllocTraceRecorder::DescriptorAllocate( const void* pHeap, uint32_t Count )
+{
+	std::lock_guard<std::mutex> Lock( s_Mutex );
+	if (s_pFile == nullptr) return;
+	WriteEvent( kTraceDescriptorAlloc, 0 );
+	WriteVarint( GetId( s_DescriptorIds, pHeap ) );
+	WriteVarint( Count );
+	FlushBuffer( false );
+}
+
+void AllocTraceRecorder::DescriptorCleanup( const void* pHeap, uint64_t FenceValue )
+{
+	std::lock_guard<std::mutex> Lock( s_Mutex );
+	if (s_pFile == nullptr) return;
+	WriteEvent( kTraceDescriptorCleanup, (uint32_t)(FenceValue >> 56) );
+	WriteVarint( GetId( s_DescriptorIds, pHeap ) );
+	WriteFence( FenceValue );
+	FlushBuffer( false );
+}
+
+void AllocTraceRecorder::FenceComplete( uint64_t FenceValue )
+{
+	std::lock_guard<std::mutex> Lock( s_Mutex );
+	if (s_pFile == nullptr) return;
+	WriteEvent( kTraceFenceComplete, (uint32_t)(FenceValue >> 56) );
+	WriteFence( FenceValue );
+	FlushBuffer( false );
+}
+
+void AllocTraceRecorder::Frame()
+{
+	std::lock_guard<std::mutex> Lock( s_Mutex );
+	if (s_pFile == nullptr) return;
+	WriteEvent( kTraceFrame, 0 );
+	FlushBuffer( false );
+}
+
+//--------------------------------------------------------------------------------------
+// AllocTraceReader
+//--------------------------------------------------------------------------------------
+bool AllocTraceReader::Open( const char* FileName )
+{
+	m_Data.clear();
+	m_Pos = 0;
+	FILE* pFile = fopen( FileName, "rb" );
+	if (!pFile) return false;
+	uint8_t Chunk[0x10000];
+	size_t NumRead;
+	while ((NumRead = fread( Chunk, 1, sizeof( Chunk ), pFile )) > 0)
+		m_Data.insert( m_Data.end(), Chunk, Chunk + NumRead );
+	fclose( pFile );
+
+	uint32_t Version;
+	if (m_Data.size() < kHeaderSize || memcmp( m_Data.data(), kMagic, sizeof( kMagic ) ) != 0)
+		return false;
+	memcpy( &Version, m_Data.data() + sizeof( kMagic ), sizeof( Version ) );
+	// Version 1 only lacks frame markers
+	if (Version < 1 || Version > AllocTraceRecorder::kVersion)
+		return false;
+	m_Pos = kHeaderSize;
+	return true;
+}
+
+void AllocTraceReader::Rewind()
+{
+	m_Pos = m_Data.size() < kHeaderSize ? m_Data.size() : kHeaderSize;
+}
+
+bool AllocTraceReader::ReadVarint( uint64_t& Value )
+{
+	Value = 0;
+	for (uint32_t Shift = 0; m_Pos < m_Data.size() && Shift < 64; Shift += 7)
+	{
+		uint8_t Byte = m_Data[m_Pos++];
+		Value |= (uint64_t)(Byte & 0x7f) << Shift;
+		if ((Byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool AllocTraceReader::Next( AllocTraceRecord& Record )
+{
+	if (m_Pos >= m_Data.size())
+		return false;
+	uint8_t Header = m_Data[m_Pos++];
+	uint32_t HighNibble = Header >> 4;
+	uint64_t Id = 0, Value = 0;
+	memset( &Record, 0, sizeof( Record ) );
+	Record.Event = (AllocTraceEvent)(Header & 0xf);
+	switch (Record.Event)
+	{
+	case kTraceLinearAlloc:
+		Record.Type = HighNibble;
+		if (!ReadVarint( Id ) || !ReadVarint( Record.Size ) || !ReadVarint( Value ) || Value >= 64)
+			return false;
+		Record.Alignment = 1ull << Value;
+		break;
+	case kTraceDescriptorAlloc:
+		if (!ReadVarint( Id ) || !ReadVarint( Record.Size ))
+			return false;
+		break;
+	case kTraceLinearCleanup:
+	case kTraceDescriptorCleanup:
+		if (!ReadVarint( Id ) || !ReadVarint( Value ))
+			return false;
+		Record.FenceValue = (uint64_t)HighNibble << 56 | Value;
+		break;
+	case kTraceFenceComplete:
+		if (!ReadVarint( Value ))
+			return false;
+		Record.FenceValue = (uint64_t)HighNibble << 56 | Value;
+		break;
+	case kTraceFrame:
+		break;
+	default:
+		return false;
+	}
+	Record.Id = (uint32_t)Id;
+	return true;
+}
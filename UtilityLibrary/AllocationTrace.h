@@ -0,0 +1,86 @@
+#pragma once
+// Opt-in binary trace of LinearAllocator and DynamicDescriptorHeap activity, for tuning page and heap
+// sizes offline with the AllocTraceReplay tool. Records every allocation, every cleanup with its
+// fence, and every fence the CPU saw complete, so a replay knows when memory came back.
+// Allocators and heaps are identified by small ids handed out in order of first appearance.
+//
+// Format: "ATRC", uint32 version, then one record per event. A record is one byte with the event in
+// the low nibble and the allocator type or queue type in the high nibble, followed by LEB128 varints:
+//   kTraceLinearAlloc        id, size, log2 alignment
+//   kTraceLinearCleanup      id, fence
+//   kTraceDescriptorAlloc    id, count
+//   kTraceDescriptorCleanup  id, fence
+//   kTraceFenceComplete      fence
+//   kTraceFrame              nothing, written by Graphics::Present() (version 2 on)
+// Fences are stored without the queue type in the top 8 bits, it goes in the high nibble.
+// Only std headers, the reader is used on Linux by the replay tool.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+enum AllocTraceEvent
+{
+	kTraceLinearAlloc = 1,
+	kTraceLinearCleanup = 2,
+	kTraceDescriptorAlloc = 3,
+	kTraceDescriptorCleanup = 4,
+	kTraceFenceComplete = 5,
+	kTraceFrame = 6,
+};
+
+struct AllocTraceRecord
+{
+	AllocTraceEvent	Event;
+	uint32_t		Id;
+	uint32_t		Type;			// LinearAllocatorType of kTraceLinearAlloc
+	uint64_t		Size;			// Bytes, or descriptors of kTraceDescriptorAlloc
+	uint64_t		Alignment;
+	uint64_t		FenceValue;		// With the queue type in the top 8 bits as usual
+};
+
+//--------------------------------------------------------------------------------------
+// AllocTraceRecorder
+//--------------------------------------------------------------------------------------
+class AllocTraceRecorder
+{
+public:
+	enum { kVersion = 2 };
+
+	static bool Begin( const char* FileName );
+	static void End();
+	static bool IsRecording() { return sm_Recording.load( std::memory_order_relaxed ); }
+	static uint64_t GetNumEvents();
+
+	// Call sites check IsRecording() first, the recorder takes a lock
+	static void LinearAllocate( const void* pAllocator, uint32_t Type, size_t SizeInByte, size_t Alignment );
+	static void LinearCleanup( const void* pAllocator, uint64_t FenceValue );
+	static void DescriptorAllocate( const void* pHeap, uint32_t Count );
+	static void DescriptorCleanup( const void* pHeap, uint64_t FenceValue );
+	static void FenceComplete( uint64_t FenceValue );
+	static void Frame();
+
+private:
+	static std::atomic<bool> sm_Recording;
+};
+
+//--------------------------------------------------------------------------------------
+// AllocTraceReader
+//--------------------------------------------------------------------------------------
+class AllocTraceReader
+{
+public:
+	AllocTraceReader() :m_Pos( 0 ) {}
+
+	bool Open( const char* FileName );
+	// False at the end of the trace or on a truncated record
+	bool Next( AllocTraceRecord& Record );
+	void Rewind();
+
+private:
+	bool ReadVarint( uint64_t& Value );
+
+	std::vector<uint8_t>	m_Data;
+	size_t					m_Pos;
+};
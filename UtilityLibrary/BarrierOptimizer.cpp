@@ -0,0 +1,325 @@
+#include "PortableAssert.h"
+#include "BarrierOptimizer.h"
+
+#include <algorithm>
+
+namespace
+{
+	const BarrierState kNoState = 0xffffffff;
+	const uint32_t kNeverUsed = 0xffffffff;
+
+	//--------------------------------------------------------------------------------------
+	// BarrierPass
+	//--------------------------------------------------------------------------------------
+	class BarrierPass
+	{
+	public:
+		BarrierPass( const BarrierStream& Stream, const BarrierPassOptions& Options, std::vector<BarrierBatch>& Batches );
+		void Run( BarrierPassStats& Stats );
+
+	private:
+		uint32_t NumSubresources( uint32_t Resource ) const { return m_Stream.Resources[Resource].NumSubresources; }
+		void Request( uint32_t Resource );
+		// Applies one request right away, as CommandContext did
+		void TransitionNow( uint32_t WorkIndex, uint32_t Resource, uint32_t Subresource, BarrierState State );
+		// Net change of everything requested since the last work
+		void Resolve( uint32_t WorkIndex );
+		void Emit( uint32_t WorkIndex, uint32_t Resource, uint32_t Subresource, BarrierState Before, BarrierState After );
+		void EmitUAV( uint32_t WorkIndex, uint32_t Resource );
+		void MarkUsed( uint32_t WorkIndex );
+
+		const BarrierStream&			m_Stream;
+		const BarrierPassOptions		m_Options;
+		std::vector<BarrierBatch>&		m_Batches;
+		uint64_t						m_NumSplit;
+		uint32_t						m_SplitFloor;		// First work of the current command list
+
+		// Per subresource, resource R's start at m_First[R]
+		std::vector<uint32_t>			m_First;
+		std::vector<BarrierState>		m_States;
+		std::vector<BarrierState>		m_Targets;			// Requested since the last work
+		std::vector<uint32_t>			m_LastUse;
+
+		// Per resource
+		std::vector<uint8_t>			m_Requested;
+		std::vector<uint8_t>			m_PendingUAV;
+		std::vector<uint8_t>			m_Touched;			// Some request left the current state
+		std::vector<uint8_t>			m_UsedSinceBarrier;
+		std::vector<uint32_t>			m_RequestOrder;
+	};
+
+	BarrierPass::BarrierPass( const BarrierStream& Stream, const BarrierPassOptions& Options, std::vector<BarrierBatch>& Batches )
+		:m_Stream( Stream ), m_Options( Options ), m_Batches( Batches ), m_NumSplit( 0 ), m_SplitFloor( 0 )
+	{
+		const uint32_t NumResources = (uint32_t)Stream.Resources.size();
+		m_First.resize( NumResources + 1 );
+		m_First[0] = 0;
+		for (uint32_t i = 0; i < NumResources; ++i)
+			m_First[i + 1] = m_First[i] + Stream.Resources[i].NumSubresources;
+		m_States.resize( m_First[NumResources] );
+		for (uint32_t i = 0; i < NumResources; ++i)
+			std::fill( m_States.begin() + m_First[i], m_States.begin() + m_First[i + 1], Stream.Resources[i].InitialState );
+		m_Targets.assign( m_States.size(), kNoState );
+		m_LastUse.assign( m_States.size(), kNeverUsed );
+		m_Requested.assign( NumResources, 0 );
+		m_PendingUAV.assign( NumResources, 0 );
+		m_Touched.assign( NumResources, 0 );
+		m_UsedSinceBarrier.assign( NumResources, 0 );
+
+		uint32_t NumWorks = 0;
+		for (auto& Op : Stream.Ops)
+			NumWorks += Op.Type == kBarrierOpWork || Op.Type == kBarrierOpFlush;
+		m_Batches.clear();
+		m_Batches.resize( NumWorks + 1 );
+		for (uint32_t i = 0; i <= NumWorks; ++i)
+			m_Batches[i].WorkIndex = i;
+	}
+
+	void BarrierPass::Run( BarrierPassStats& Stats )
+	{
+		Stats = BarrierPassStats();
+		uint32_t WorkIndex = 0;
+		for (auto& Op : m_Stream.Ops)
+		{
+			switch (Op.Type)
+			{
+			case kBarrierOpTransition:
+			{
+				ASSERT( Op.Subresource == kAllSubresources || Op.Subresource < NumSubresources( Op.Resource ) );
+				Stats.NumRequests++;
+				Request( Op.Resource );
+				if (!m_Options.Collapse)
+				{
+					TransitionNow( WorkIndex, Op.Resource, Op.Subresource, Op.State );
+					break;
+				}
+				const uint32_t Begin = Op.Subresource == kAllSubresources ? m_First[Op.Resource] : m_First[Op.Resource] + Op.Subresource;
+				const uint32_t End = Op.Subresource == kAllSubresources ? m_First[Op.Resource + 1] : Begin + 1;
+				for (uint32_t i = Begin; i < End; ++i)
+				{
+					m_Targets[i] = Op.State;
+					m_Touched[Op.Resource] |= Op.State != m_States[i];
+				}
+				break;
+			}
+			case kBarrierOpUAV:
+				Stats.NumRequests++;
+				Request( Op.Resource );
+				if (m_Options.Collapse)
+					m_PendingUAV[Op.Resource] = 1;
+				else
+					EmitUAV( WorkIndex, Op.Resource );
+				break;
+			case kBarrierOpWork:
+			case kBarrierOpFlush:
+				if (m_Options.Collapse)
+					Resolve( WorkIndex );
+				MarkUsed( WorkIndex );
+				WorkIndex++;
+				if (Op.Type == kBarrierOpFlush)
+					m_SplitFloor = WorkIndex;
+				break;
+			}
+		}
+		// Whatever was requested after the last work still goes out, at the end of the list
+		if (m_Options.Collapse)
+			Resolve( WorkIndex );
+		MarkUsed( WorkIndex );
+		Stats.NumWorks = WorkIndex;
+
+		size_t NumBatches = 0;
+		for (auto& Batch : m_Batches)
+		{
+			if (Batch.Barriers.empty())
+				continue;
+			const uint32_t Size = (uint32_t)Batch.Barriers.size();
+			Stats.NumBarriers += Size;
+			Stats.NumCalls += m_Options.MaxBatchSize ? (Size + m_Options.MaxBatchSize - 1) / m_Options.MaxBatchSize : 1;
+			Stats.MaxBatchSize = (std::max)( Stats.MaxBatchSize, Size );
+			for (auto& Barrier : Batch.Barriers)
+			{
+				Stats.NumUAVBarriers += Barrier.IsUAV;
+				Stats.NumSubresourceBarriers += !Barrier.IsUAV && Barrier.Subresource != kAllSubresources;
+			}
+			if (&Batch != &m_Batches[NumBatches])
+				m_Batches[NumBatches] = std::move( Batch );
+			NumBatches++;
+		}
+		m_Batches.resize( NumBatches );
+		Stats.NumSplit = m_NumSplit;
+	}
+
+	void BarrierPass::Request( uint32_t Resource )
+	{
+		if (!m_Requested[Resource])
+		{
+			m_Requested[Resource] = 1;
+			m_RequestOrder.push_back( Resource );
+		}
+	}
+
+	void BarrierPass::TransitionNow( uint32_t WorkIndex, uint32_t Resource, uint32_t Subresource, BarrierState State )
+	{
+		const uint32_t First = m_First[Resource];
+		const uint32_t Count = NumSubresources( Resource );
+		if (Subresource != kAllSubresources)
+		{
+			m_Targets[First + Subresource] = State;
+			if (m_States[First + Subresource] != State)
+				Emit( WorkIndex, Resource, Count == 1 ? kAllSubresources : Subresource, m_States[First + Subresource], State );
+			return;
+		}
+		bool Uniform = true;
+		for (uint32_t i = 1; i < Count; ++i)
+			Uniform &= m_States[First + i] == m_States[First];
+		if (Uniform)
+		{
+			if (m_States[First] != State)
+				Emit( WorkIndex, Resource, kAllSubresources, m_States[First], State );
+		}
+		else
+		{
+			for (uint32_t i = 0; i < Count; ++i)
+				if (m_States[First + i] != State)
+					Emit( WorkIndex, Resource, i, m_States[First + i], State );
+		}
+		std::fill( m_Targets.begin() + First, m_Targets.begin() + First + Count, State );
+	}
+
+	void BarrierPass::Resolve( uint32_t WorkIndex )
+	{
+		for (uint32_t Resource : m_RequestOrder)
+		{
+			const uint32_t First = m_First[Resource];
+			const uint32_t Count = NumSubresources( Resource );
+			uint32_t NumChanged = 0;
+			bool Uniform = true;
+			bool InUAV = false;
+			for (uint32_t i = First; i < First + Count; ++i)
+			{
+				if (m_Targets[i] == kNoState)
+					continue;
+				InUAV |= m_Targets[i] == kBarrierStateUAV;
+				if (m_Targets[i] == m_States[i])
+					continue;
+				NumChanged++;
+				Uniform &= m_States[i] == m_States[First] && m_Targets[i] == m_Targets[First];
+			}
+
+			if (NumChanged == Count && Uniform)
+				Emit( WorkIndex, Resource, kAllSubresources, m_States[First], m_Targets[First] );
+			else if (NumChanged != 0)
+			{
+				for (uint32_t i = 0; i < Count; ++i)
+					if (m_Targets[First + i] != kNoState && m_Targets[First + i] != m_States[First + i])
+						Emit( WorkIndex, Resource, i, m_States[First + i], m_Targets[First + i] );
+			}
+			// A transition orders the writes already. UAV->B->UAV collapsed to nothing would have
+			// ordered them too, so that one keeps a UAV barrier
+			else if (m_UsedSinceBarrier[Resource] && (m_PendingUAV[Resource] || (m_Touched[Resource] && InUAV)))
+				EmitUAV( WorkIndex, Resource );
+			m_PendingUAV[Resource] = 0;
+			m_Touched[Resource] = 0;
+		}
+	}
+
+	void BarrierPass::Emit( uint32_t WorkIndex, uint32_t Resource, uint32_t Subresource, BarrierState Before, BarrierState After )
+	{
+		const uint32_t Begin = Subresource == kAllSubresources ? m_First[Resource] : m_First[Resource] + Subresource;
+		const uint32_t End = Subresource == kAllSubresources ? m_First[Resource + 1] : Begin + 1;
+		uint32_t Earliest = m_SplitFloor;
+		for (uint32_t i = Begin; i < End; ++i)
+		{
+			if (m_LastUse[i] != kNeverUsed)
+				Earliest = (std::max)( Earliest, m_LastUse[i] + 1 );
+			m_States[i] = After;
+		}
+		m_UsedSinceBarrier[Resource] = 0;
+
+		ResolvedBarrier Barrier = { false, kBarrierFlagNone, Resource, Subresource, Before, After };
+		// The subresource idles from its last use on, the GPU can start on the transition there
+		if (m_Options.SplitBarriers && WorkIndex >= Earliest + (std::max)( m_Options.MinSplitDistance, 1u ))
+		{
+			Barrier.Flags = kBarrierFlagBeginOnly;
+			m_Batches[Earliest].Barriers.push_back( Barrier );
+			Barrier.Flags = kBarrierFlagEndOnly;
+			m_NumSplit++;
+		}
+		m_Batches[WorkIndex].Barriers.push_back( Barrier );
+	}
+
+	void BarrierPass::EmitUAV( uint32_t WorkIndex, uint32_t Resource )
+	{
+		ResolvedBarrier Barrier = { true, kBarrierFlagNone, Resource, kAllSubresources, 0, 0 };
+		m_Batches[WorkIndex].Barriers.push_back( Barrier );
+		m_UsedSinceBarrier[Resource] = 0;
+		// It covers every subresource, none may be split across it
+		std::fill( m_LastUse.begin() + m_First[Resource], m_LastUse.begin() + m_First[Resource + 1], WorkIndex );
+	}
+
+	void BarrierPass::MarkUsed( uint32_t WorkIndex )
+	{
+		for (uint32_t Resource : m_RequestOrder)
+		{
+			const uint32_t First = m_First[Resource];
+			const uint32_t End = m_First[Resource + 1];
+			// A UAV barrier alone is a use of the whole resource
+			const bool Whole = m_PendingUAV[Resource] != 0;
+			for (uint32_t i = First; i < End; ++i)
+			{
+				if (Whole || m_Targets[i] != kNoState)
+					m_LastUse[i] = WorkIndex;
+				m_Targets[i] = kNoState;
+			}
+			m_UsedSinceBarrier[Resource] = 1;
+			m_Requested[Resource] = 0;
+			m_PendingUAV[Resource] = 0;
+		}
+		m_RequestOrder.clear();
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// BarrierStream
+//--------------------------------------------------------------------------------------
+uint32_t BarrierStream::AddResource( uint32_t NumSubresources, BarrierState InitialState )
+{
+	ASSERT( NumSubresources > 0 );
+	BarrierResourceDesc Desc = { NumSubresources, InitialState };
+	Resources.push_back( Desc );
+	return (uint32_t)Resources.size() - 1;
+}
+
+void BarrierStream::Transition( uint32_t Resource, BarrierState State, uint32_t Subresource )
+{
+	BarrierOp Op = { kBarrierOpTransition, Resource, Subresource, State };
+	Ops.push_back( Op );
+}
+
+void BarrierStream::UAV( uint32_t Resource )
+{
+	BarrierOp Op = { kBarrierOpUAV, Resource, kAllSubresources, kBarrierStateUAV };
+	Ops.push_back( Op );
+}
+
+void BarrierStream::Work()
+{
+	BarrierOp Op = { kBarrierOpWork, 0, 0, 0 };
+	Ops.push_back( Op );
+}
+
+void BarrierStream::Flush()
+{
+	BarrierOp Op = { kBarrierOpFlush, 0, 0, 0 };
+	Ops.push_back( Op );
+}
+
+//--------------------------------------------------------------------------------------
+// OptimizeBarriers
+//--------------------------------------------------------------------------------------
+void OptimizeBarriers( const BarrierStream& Stream, const BarrierPassOptions& Options, std::vector<BarrierBatch>& Batches,
+	BarrierPassStats& Stats )
+{
+	BarrierPass Pass( Stream, Options, Batches );
+	Pass.Run( Stats );
+}
@@ -0,0 +1,103 @@
+#pragma once
+// Barrier pass resolving a recorded command list's transition and UAV requests into one batch per work
+
+#include <stdint.h>
+#include <vector>
+
+// Same values as D3D12_RESOURCE_STATES, the pass only compares them
+typedef uint32_t BarrierState;
+
+const uint32_t kAllSubresources = 0xffffffff;		// D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES
+const BarrierState kBarrierStateUAV = 0x8;			// D3D12_RESOURCE_STATE_UNORDERED_ACCESS
+
+enum BarrierOpType : uint8_t
+{
+	kBarrierOpTransition,					// Resource needed in State by the next work
+	kBarrierOpUAV,							// Writes to Resource must be done before the next work
+	kBarrierOpWork,
+	kBarrierOpFlush,						// A work which also ends the command list
+};
+
+struct BarrierOp
+{
+	BarrierOpType	Type;
+	uint32_t		Resource;				// Index into BarrierStream::Resources
+	uint32_t		Subresource;			// kAllSubresources or one of them
+	BarrierState	State;
+};
+
+// State is tracked per subresource, subresources which don't share a state transition one by one
+struct BarrierResourceDesc
+{
+	uint32_t		NumSubresources;
+	BarrierState	InitialState;			// Of every subresource
+};
+
+struct BarrierStream
+{
+	std::vector<BarrierResourceDesc>	Resources;
+	std::vector<BarrierOp>				Ops;
+
+	uint32_t AddResource( uint32_t NumSubresources, BarrierState InitialState );
+	void Transition( uint32_t Resource, BarrierState State, uint32_t Subresource = kAllSubresources );
+	void UAV( uint32_t Resource );
+	void Work();
+	void Flush();
+};
+
+// Same values as D3D12_RESOURCE_BARRIER_FLAGS
+enum BarrierFlags : uint8_t
+{
+	kBarrierFlagNone = 0,
+	kBarrierFlagBeginOnly = 1,
+	kBarrierFlagEndOnly = 2,
+};
+
+struct ResolvedBarrier
+{
+	bool			IsUAV;
+	BarrierFlags	Flags;
+	uint32_t		Resource;
+	uint32_t		Subresource;
+	BarrierState	StateBefore;
+	BarrierState	StateAfter;
+};
+
+struct BarrierBatch
+{
+	uint32_t						WorkIndex;		// Issued right before this work, the number of works for the end
+	std::vector<ResolvedBarrier>	Barriers;
+};
+
+struct BarrierPassOptions
+{
+	bool		Collapse;					// Net change per work, else every request on its own like CommandContext
+	// BEGIN_ONLY right after the subresource's last use, END_ONLY where it is needed, never across a flush
+	bool		SplitBarriers;
+	uint32_t	MinSplitDistance;			// Unused works between last use and need to split
+	uint32_t	MaxBatchSize;				// Only counts the calls a fixed buffer would take, 0 is unbounded
+
+	static BarrierPassOptions Legacy() { return { false, false, 0, 16 }; }
+	static BarrierPassOptions Optimized( bool Split = true ) { return { true, Split, 2, 0 }; }
+};
+
+struct BarrierPassStats
+{
+	uint64_t	NumRequests;				// Transition and UAV ops
+	uint64_t	NumWorks;
+	uint64_t	NumBarriers;				// Both halves of a split one count
+	uint64_t	NumUAVBarriers;
+	uint64_t	NumSubresourceBarriers;		// Transitions of a single subresource
+	uint64_t	NumSplit;
+	uint64_t	NumCalls;					// ResourceBarrier() calls
+	uint32_t	MaxBatchSize;
+};
+
+// Only the net change of a subresource since the last work is kept, so A->B->C is one barrier and
+// A->B->A none, and a UAV barrier is dropped when a transition of the same resource already orders its
+// writes or nothing used the resource since its last barrier. Every use has to be requested, even in
+// the current state, the way CommandContext calls TransitionResource() before every bind, that is how
+// the pass knows when a resource was last used. Batches come out in work order, empty ones are left out
+void OptimizeBarriers( const BarrierStream& Stream, const BarrierPassOptions& Options, std::vector<BarrierBatch>& Batches,
+	BarrierPassStats& Stats );
+
@@ -0,0 +1,101 @@
+#include "LibraryHeader.h"
+#include "Graphics.h"
+#include "CmdListMngr.h"
+#include "Utility.h"
+#include "BindlessDescriptorHeap.h"
+
+CRITICAL_SECTION BindlessDescriptorHeap::sm_CS;
+GpuDescriptorHeap BindlessDescriptorHeap::sm_Heap = {};
+ID3D12DescriptorHeap* BindlessDescriptorHeap::sm_pHeap = nullptr;
+uint32_t BindlessDescriptorHeap::sm_DescriptorSize = 0;
+BindlessDescriptorHeap::QueueFenceOracle BindlessDescriptorHeap::sm_FenceOracle;
+BindlessIndexAllocator BindlessDescriptorHeap::sm_Allocator;
+
+bool BindlessDescriptorHeap::QueueFenceOracle::IsFenceComplete( uint64_t FenceValue )
+{
+	return Graphics::g_cmdListMngr.IsFenceComplete( FenceValue );
+}
+
+void BindlessDescriptorHeap::Initialize()
+{
+	InitializeCriticalSection( &sm_CS );
+
+	IGpuDeviceBackend& Backend = Graphics::g_cmdListMngr.GetDeviceBackend();
+	sm_Heap = Backend.CreateDescriptorHeap( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, kNumDescriptors, true );
+	sm_pHeap = (ID3D12DescriptorHeap*)sm_Heap.pNative;
+	sm_pHeap->SetName( L"Bindless Descriptor Heap" );
+	sm_DescriptorSize = Backend.GetDescriptorSize( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV );
+	sm_Allocator.Create( kNumDescriptors, &sm_FenceOracle );
+}
+
+void BindlessDescriptorHeap::Shutdown()
+{
+	if (sm_pHeap == nullptr)
+		return;
+	sm_Allocator.Destroy();
+	Graphics::g_cmdListMngr.GetDeviceBackend().DestroyDescriptorHeap( sm_Heap );
+	sm_Heap = GpuDescriptorHeap();
+	sm_pHeap = nullptr;
+	DeleteCriticalSection( &sm_CS );
+}
+
+void BindlessDescriptorHeap::Register( uint32_t& Handle, D3D12_CPU_DESCRIPTOR_HANDLE Src )
+{
+	if (sm_pHeap == nullptr)
+	{
+		Handle = kInvalidHandle;
+		return;
+	}
+	Release( Handle );
+	{
+		CriticalSectionScope LockGuard( &sm_CS );
+		Handle = sm_Allocator.Allocate();
+	}
+	if (Handle == kInvalidHandle)
+	{
+		PRINTWARN( "Bindless descriptor heap is full" );
+		return;
+	}
+	D3D12_CPU_DESCRIPTOR_HANDLE Dest = sm_pHeap->GetCPUDescriptorHandleForHeapStart();
+	Dest.ptr += (SIZE_T)GetIndex( Handle ) * sm_DescriptorSize;
+	Graphics::g_device->CopyDescriptorsSimple( 1, Dest, Src, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV );
+}
+
+void BindlessDescriptorHeap::Release( uint32_t& Handle )
+{
+	if (sm_pHeap != nullptr && Handle != kInvalidHandle)
+	{
+		// The last fence each queue signaled, complete already on a queue with nothing in flight. The
+		// next one would never complete on a queue which gets no more work, and hold back every later
+		// free behind it
+		uint64_t FenceValues[BindlessIndexAllocator::kMaxFences] = {
+			Graphics::g_cmdListMngr.GetGraphicsQueue().GetNextFenceValue() - 1,
+			Graphics::g_cmdListMngr.GetComputeQueue().GetNextFenceValue() - 1,
+			Graphics::g_cmdListMngr.GetCopyQueue().GetNextFenceValue() - 1 };
+		CriticalSectionScope LockGuard( &sm_CS );
+		sm_Allocator.Free( Handle, FenceValues, BindlessIndexAllocator::kMaxFences );
+	}
+	Handle = kInvalidHandle;
+}
+
+bool BindlessDescriptorHeap::IsValid( uint32_t Handle )
+{
+	if (sm_pHeap == nullptr)
+		return false;
+	CriticalSectionScope LockGuard( &sm_CS );
+	return sm_Allocator.IsValid( Handle );
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE BindlessDescriptorHeap::GetTableStart()
+{
+	ASSERT( sm_pHeap != nullptr );
+	return sm_pHeap->GetGPUDescriptorHandleForHeapStart();
+}
+
+BindlessIndexStats BindlessDescriptorHeap::GetStats()
+{
+	if (sm_pHeap == nullptr)
+		return BindlessIndexStats();
+	CriticalSectionScope LockGuard( &sm_CS );
+	return sm_Allocator.GetStats();
+}
@@ -0,0 +1,56 @@
+#pragma once
+// One big persistent shader-visible CBV/SRV/UAV heap. Textures and StructuredBuffers register their
+// SRV/UAV once at creation and keep the slot until destroyed, shaders index the heap with the
+// slot number passed in root constants, so nothing is copied per draw.
+// Root signatures take the whole heap with RootParameter::InitAsBindlessTable(), on the HLSL side
+// (shader model 5.1):
+//   Texture2D<float4> g_BindlessTextures[] : register( t0, space1 );
+//   RWStructuredBuffer<Particle> g_BindlessParticles[] : register( u0, space1 );
+//   cbuffer BindlessIndices : register( b0 ) { uint g_ParticleUAV; };
+//   ... g_BindlessParticles[NonUniformResourceIndex( g_ParticleUAV )][i]
+// Only one CBV/SRV/UAV heap can be bound at a time. A draw binding the bindless table must not
+// use SetDynamicDescriptors(), which switches to the DynamicDescriptorHeap's heap.
+// Slot bookkeeping lives in BindlessIndexAllocator, this class only copies descriptors.
+
+#include "BindlessIndexAllocator.h"
+#include "GpuQueueBackend.h"
+
+//--------------------------------------------------------------------------------------
+// BindlessDescriptorHeap
+//--------------------------------------------------------------------------------------
+class BindlessDescriptorHeap
+{
+public:
+	static const uint32_t kNumDescriptors = 1 << 16;
+	static const uint32_t kInvalidHandle = BindlessIndexAllocator::kInvalidHandle;
+
+	static void Initialize();
+	static void Shutdown();
+	static bool IsEnabled() { return sm_pHeap != nullptr; }
+
+	// Copies the staging descriptor into a new slot. A valid Handle is released first, its slot may
+	// still be read by the GPU. Leaves Handle invalid when the heap is disabled or full.
+	static void Register( uint32_t& Handle, D3D12_CPU_DESCRIPTOR_HANDLE Src );
+	// The slot is reused after every queue finished the work submitted so far, Handle is reset
+	static void Release( uint32_t& Handle );
+	static uint32_t GetIndex( uint32_t Handle ) { return BindlessIndexAllocator::GetIndex( Handle ); }
+	static bool IsValid( uint32_t Handle );
+
+	static ID3D12DescriptorHeap* GetHeapPointer() { return sm_pHeap; }
+	static D3D12_GPU_DESCRIPTOR_HANDLE GetTableStart();
+	static BindlessIndexStats GetStats();
+
+private:
+	class QueueFenceOracle : public IFenceOracle
+	{
+	public:
+		virtual bool IsFenceComplete( uint64_t FenceValue ) override;
+	};
+
+	static CRITICAL_SECTION sm_CS;
+	static GpuDescriptorHeap sm_Heap;
+	static ID3D12DescriptorHeap* sm_pHeap;		// sm_Heap.pNative
+	static uint32_t sm_DescriptorSize;
+	static QueueFenceOracle sm_FenceOracle;
+	static BindlessIndexAllocator sm_Allocator;
+};
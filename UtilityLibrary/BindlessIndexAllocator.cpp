@@ -0,0 +1,105 @@
+#include "PortableAssert.h"
+#include "BindlessIndexAllocator.h"
+
+//--------------------------------------------------------------------------------------
+// BindlessIndexAllocator
+//--------------------------------------------------------------------------------------
+BindlessIndexAllocator::BindlessIndexAllocator()
+	:m_pFenceOracle( nullptr ), m_Capacity( 0 ), m_NumCreated( 0 ), m_Stats()
+{
+}
+
+void BindlessIndexAllocator::Create( uint32_t Capacity, IFenceOracle* pFenceOracle )
+{
+	ASSERT( Capacity > 0 && Capacity <= kMaxCapacity );
+	ASSERT( pFenceOracle != nullptr );
+	Destroy();
+	m_pFenceOracle = pFenceOracle;
+	m_Capacity = Capacity;
+	m_Generations.assign( Capacity, 0 );
+	m_Stats.Capacity = Capacity;
+}
+
+void BindlessIndexAllocator::Destroy()
+{
+	m_Capacity = 0;
+	m_NumCreated = 0;
+	m_Generations.clear();
+	m_FreeIndices.clear();
+	m_PendingFrees.clear();
+	m_Stats = BindlessIndexStats();
+}
+
+uint32_t BindlessIndexAllocator::Allocate()
+{
+	ASSERT( IsCreated() );
+	Reclaim();
+	uint32_t Index;
+	if (!m_FreeIndices.empty())
+	{
+		Index = m_FreeIndices.front();
+		m_FreeIndices.pop_front();
+	}
+	else if (m_NumCreated < m_Capacity)
+		Index = m_NumCreated++;
+	else
+	{
+		m_Stats.NumFailed++;
+		return kInvalidHandle;
+	}
+	m_Stats.NumAllocated++;
+	if (m_Stats.NumAllocated > m_Stats.PeakAllocated)
+		m_Stats.PeakAllocated = m_Stats.NumAllocated;
+	return m_Generations[Index] << kIndexBits | Index;
+}
+
+void BindlessIndexAllocator::Free( uint32_t Handle, const uint64_t* FenceValues, uint32_t NumFences )
+{
+	ASSERT( IsValid( Handle ) );
+	ASSERT( NumFences <= kMaxFences );
+	if (!IsValid( Handle ))
+		return;
+	uint32_t Index = GetIndex( Handle );
+	m_Generations[Index] = (m_Generations[Index] + 1) & kGenerationMask;
+
+	PendingFree Pending = {};
+	Pending.Index = Index;
+	for (uint32_t i = 0; i < NumFences; ++i)
+		Pending.FenceValues[i] = FenceValues[i];
+	m_PendingFrees.push_back( Pending );
+	m_Stats.NumPendingFree++;
+}
+
+bool BindlessIndexAllocator::IsValid( uint32_t Handle ) const
+{
+	uint32_t Index = GetIndex( Handle );
+	return Handle != kInvalidHandle && Index < m_NumCreated && m_Generations[Index] == GetGeneration( Handle );
+}
+
+bool BindlessIndexAllocator::IsComplete( const PendingFree& Pending )
+{
+	for (uint32_t i = 0; i < kMaxFences; ++i)
+	{
+		if (Pending.FenceValues[i] != 0 && !m_pFenceOracle->IsFenceComplete( Pending.FenceValues[i] ))
+			return false;
+	}
+	return true;
+}
+
+void BindlessIndexAllocator::Reclaim()
+{
+	// Fences of different queues aren't ordered, stopping at the first one still in flight may hold
+	// back a few slots for a frame but keeps this O(1) per slot
+	while (!m_PendingFrees.empty() && IsComplete( m_PendingFrees.front() ))
+	{
+		m_FreeIndices.push_back( m_PendingFrees.front().Index );
+		m_PendingFrees.pop_front();
+		m_Stats.NumPendingFree--;
+		m_Stats.NumAllocated--;
+	}
+}
+
+BindlessIndexStats BindlessIndexAllocator::GetStats() const
+{
+	return m_Stats;
+}
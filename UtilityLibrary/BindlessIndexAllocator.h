@@ -0,0 +1,75 @@
+#pragma once
+// Stable slots of the bindless descriptor heap. A handle is the slot index, which is what shaders
+// get through root constants, plus a generation in the top bits, bumped every time the slot is
+// freed so a stale handle can be told apart from the slot's new owner.
+// A freed slot may still be read by command lists in flight, so it only goes back to the free list
+// once every fence passed to Free() completed. Slots are reused oldest first.
+// No locking of its own. BindlessDescriptorHeap calls it from any thread under sm_CS, which also
+// covers the fence oracle asked from Allocate().
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "LinearPagePool.h"
+
+struct BindlessIndexStats
+{
+	uint32_t	Capacity;
+	uint32_t	NumAllocated;		// Including slots waiting for their fences
+	uint32_t	NumPendingFree;
+	uint32_t	PeakAllocated;
+	uint64_t	NumFailed;			// Allocations finding no slot at all
+};
+
+//--------------------------------------------------------------------------------------
+// BindlessIndexAllocator
+//--------------------------------------------------------------------------------------
+class BindlessIndexAllocator
+{
+public:
+	enum
+	{
+		kIndexBits = 20,
+		kIndexMask = (1 << kIndexBits) - 1,
+		kGenerationMask = (1 << (32 - kIndexBits)) - 1,
+		kMaxCapacity = kIndexMask,				// kInvalidHandle has index kIndexMask
+		kMaxFences = 3,							// One per queue type
+	};
+	static const uint32_t kInvalidHandle = 0xffffffff;
+
+	static uint32_t GetIndex( uint32_t Handle ) { return Handle & kIndexMask; }
+	static uint32_t GetGeneration( uint32_t Handle ) { return Handle >> kIndexBits; }
+
+	BindlessIndexAllocator();
+	void Create( uint32_t Capacity, IFenceOracle* pFenceOracle );
+	void Destroy();
+	bool IsCreated() const { return m_Capacity != 0; }
+
+	// Returns kInvalidHandle when all slots are taken or still waiting for their fences
+	uint32_t Allocate();
+	// The slot is reused once all non zero FenceValues completed
+	void Free( uint32_t Handle, const uint64_t* FenceValues, uint32_t NumFences );
+	bool IsValid( uint32_t Handle ) const;
+	// Returns slots whose fences completed to the free list, Allocate() does it as well
+	void Reclaim();
+
+	BindlessIndexStats GetStats() const;
+
+private:
+	struct PendingFree
+	{
+		uint32_t	Index;
+		uint64_t	FenceValues[kMaxFences];
+	};
+
+	bool IsComplete( const PendingFree& Pending );
+
+	IFenceOracle*				m_pFenceOracle;
+	uint32_t					m_Capacity;
+	uint32_t					m_NumCreated;			// Slots below this have been handed out before
+	std::vector<uint32_t>		m_Generations;
+	std::deque<uint32_t>		m_FreeIndices;
+	std::deque<PendingFree>		m_PendingFrees;			// In order of Free()
+	BindlessIndexStats			m_Stats;
+};
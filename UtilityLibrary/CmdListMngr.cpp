@@ -1,8 +1,8 @@
 #include "LibraryHeader.h"
 #include "Utility.h"
-#include "DX12Framework.h"
 #include "Graphics.h"
 #include "CmdListMngr.h"
+#include "LinearAllocator.h"
 
 //--------------------------------------------------------------------------------------
 // CommandAllocatorPool
@@ -27,6 +27,7 @@ void CommandAllocatorPool::Create( ID3D12Device* pDevice )
 
 void CommandAllocatorPool::Shutdown()
 {
+	m_ReadyAllocators.Clear();
 	for (size_t i = 0; i < m_AllocatorPool.size(); ++i)
 		m_AllocatorPool[i]->Release();
 	m_AllocatorPool.clear();
@@ -34,39 +35,295 @@ void CommandAllocatorPool::Shutdown()
 
 ID3D12CommandAllocator* CommandAllocatorPool::RequestAllocator( uint64_t CompletedFenceValue )
 {
+	HRESULT hr;
+	ID3D12CommandAllocator* pAllocator = m_ReadyAllocators.Acquire(
+		[CompletedFenceValue]( uint64_t FenceValue ) { return FenceValue <= CompletedFenceValue; } );
+	Graphics::g_stats.allocatorReady[m_cCommandListType] = (uint16_t)(m_ReadyAllocators.GetNumRetired() + m_ReadyAllocators.GetNumReady());
+	if (pAllocator != nullptr)
+	{
+		V( pAllocator->Reset() );
+		return pAllocator;
+	}
+
 	CriticalSectionScope LockGuard( &m_AllocatorCS );
+	V( m_pDevice->CreateCommandAllocator( m_cCommandListType, IID_PPV_ARGS( &pAllocator ) ) );
+	wchar_t AllocatorName[32];
+	swprintf( AllocatorName, 32, L"CommandAllocator %zu", m_AllocatorPool.size() );
+	pAllocator->SetName( AllocatorName );
+	m_AllocatorPool.push_back( pAllocator );
+	Graphics::g_stats.allocatorCreated[m_cCommandListType] = (uint16_t)m_AllocatorPool.size();
+
+	return pAllocator;
+}
+
+void CommandAllocatorPool::DiscardAllocator( uint64_t FenceValue, ID3D12CommandAllocator* Allocator )
+{
+	m_ReadyAllocators.Retire( FenceValue, Allocator );
+}
+
+uint32_t CommandAllocatorPool::ReclaimCompleted( uint64_t CompletedFenceValue )
+{
+	auto IsFenceComplete = [CompletedFenceValue]( uint64_t FenceValue ) { return FenceValue <= CompletedFenceValue; };
+	uint32_t Count = 0, Moved;
+	do
+	{
+		Moved = m_ReadyAllocators.Reclaim( IsFenceComplete );
+		Count += Moved;
+	} while (Moved == FenceRecycler<ID3D12CommandAllocator>::kReclaimBatch);
+	return Count;
+}
+
+//--------------------------------------------------------------------------------------
+// D3D12QueueBackend
+//--------------------------------------------------------------------------------------
+ID3D12Fence* D3D12QueueBackend::sm_pFences[4] = {};
+
+D3D12QueueBackend::D3D12QueueBackend() :
+	m_CommandQueue( nullptr ),
+	m_pFence( nullptr )
+{
+}
+
+D3D12QueueBackend::~D3D12QueueBackend()
+{
+	Shutdown();
+}
+
+void D3D12QueueBackend::Create( ID3D12Device* pDevice, D3D12_COMMAND_LIST_TYPE Type, uint64_t InitialFence )
+{
+	ASSERT( m_CommandQueue == nullptr );
+	HRESULT hr;
+
+	D3D12_COMMAND_QUEUE_DESC QueueDesc = {};
+	QueueDesc.Type = Type;
+	QueueDesc.NodeMask = 1;
+	V( pDevice->CreateCommandQueue( &QueueDesc, IID_PPV_ARGS( &m_CommandQueue ) ) );
+	m_CommandQueue->SetName( L"m_CommandQueue" );
+
+	V( pDevice->CreateFence( 0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS( &m_pFence ) ) );
+	m_pFence->SetName( L"m_pFence" );
+	m_pFence->Signal( InitialFence );
+	sm_pFences[Type] = m_pFence;
+}
+
+void D3D12QueueBackend::Shutdown()
+{
+	if (m_CommandQueue == nullptr)
+		return;
+	for (auto& pFence : sm_pFences)
+		if (pFence == m_pFence) pFence = nullptr;
+	m_pFence->Release();
+	m_CommandQueue->Release();
+	m_CommandQueue = nullptr;
+}
+
+void D3D12QueueBackend::ExecuteAndSignal( uint32_t NumLists, void* const* ppLists, uint64_t FenceValue )
+{
+	m_CommandQueue->ExecuteCommandLists( NumLists, (ID3D12CommandList* const*)ppLists );
+	m_CommandQueue->Signal( m_pFence, FenceValue );
+}
+
+void D3D12QueueBackend::Signal( uint64_t FenceValue )
+{
+	m_CommandQueue->Signal( m_pFence, FenceValue );
+}
+
+void D3D12QueueBackend::GpuWait( uint64_t FenceValue )
+{
+	ID3D12Fence* pFence = sm_pFences[FenceValue >> 56 & 3];
+	ASSERT( pFence != nullptr );
+	m_CommandQueue->Wait( pFence, FenceValue );
+}
+
+uint64_t D3D12QueueBackend::GetCompletedFence()
+{
+	return m_pFence->GetCompletedValue();
+}
+
+void D3D12QueueBackend::WaitForFence( uint64_t FenceValue )
+{
+	// Without an event the call itself blocks until the fence is reached, so concurrent waiters
+	// don't queue up behind a shared event
+	HRESULT hr;
+	V( m_pFence->SetEventOnCompletion( FenceValue, nullptr ) );
+}
+
+//--------------------------------------------------------------------------------------
+// D3D12CommandList
+//--------------------------------------------------------------------------------------
+void D3D12CommandList::Reset( void* pAllocator )
+{
+	HRESULT hr;
+	V( m_pList->Reset( (ID3D12CommandAllocator*)pAllocator, nullptr ) );
+}
 
+void D3D12CommandList::Close()
+{
 	HRESULT hr;
-	ID3D12CommandAllocator* pAllocator = nullptr;
+	V( m_pList->Close() );
+}
 
-	if (!m_ReadyAllocators.empty())
+void D3D12CommandList::SetDescriptorHeaps( uint32_t NumHeaps, void* const* ppHeaps )
+{
+	m_pList->SetDescriptorHeaps( NumHeaps, (ID3D12DescriptorHeap* const*)ppHeaps );
+}
+
+void D3D12CommandList::SetRootSignature( bool Compute, void* pRootSignature )
+{
+	if (Compute)
+		m_pList->SetComputeRootSignature( (ID3D12RootSignature*)pRootSignature );
+	else
+		m_pList->SetGraphicsRootSignature( (ID3D12RootSignature*)pRootSignature );
+}
+
+void D3D12CommandList::SetPipelineState( void* pPipelineState )
+{
+	m_pList->SetPipelineState( (ID3D12PipelineState*)pPipelineState );
+}
+
+void D3D12CommandList::SetRootConstants( bool Compute, uint32_t RootIndex, uint32_t NumConstants, const void* pConstants, uint32_t FirstConstant )
+{
+	if (Compute)
+		m_pList->SetComputeRoot32BitConstants( RootIndex, NumConstants, pConstants, FirstConstant );
+	else
+		m_pList->SetGraphicsRoot32BitConstants( RootIndex, NumConstants, pConstants, FirstConstant );
+}
+
+void D3D12CommandList::SetRootDescriptorTable( bool Compute, uint32_t RootIndex, uint64_t GpuHandle )
+{
+	D3D12_GPU_DESCRIPTOR_HANDLE Handle;
+	Handle.ptr = GpuHandle;
+	if (Compute)
+		m_pList->SetComputeRootDescriptorTable( RootIndex, Handle );
+	else
+		m_pList->SetGraphicsRootDescriptorTable( RootIndex, Handle );
+}
+
+void D3D12CommandList::SetRootView( bool Compute, uint32_t RootIndex, RootView View, uint64_t GpuAddress )
+{
+	switch (View)
+	{
+	case kConstantBufferView:
+		if (Compute)
+			m_pList->SetComputeRootConstantBufferView( RootIndex, GpuAddress );
+		else
+			m_pList->SetGraphicsRootConstantBufferView( RootIndex, GpuAddress );
+		break;
+	case kShaderResourceView:
+		if (Compute)
+			m_pList->SetComputeRootShaderResourceView( RootIndex, GpuAddress );
+		else
+			m_pList->SetGraphicsRootShaderResourceView( RootIndex, GpuAddress );
+		break;
+	case kUnorderedAccessView:
+		if (Compute)
+			m_pList->SetComputeRootUnorderedAccessView( RootIndex, GpuAddress );
+		else
+			m_pList->SetGraphicsRootUnorderedAccessView( RootIndex, GpuAddress );
+		break;
+	}
+}
+
+void D3D12CommandList::CopyBuffer( void* pDest, uint64_t DestOffset, void* pSrc, uint64_t SrcOffset, uint64_t NumBytes )
+{
+	m_pList->CopyBufferRegion( (ID3D12Resource*)pDest, DestOffset, (ID3D12Resource*)pSrc, SrcOffset, NumBytes );
+}
+
+void D3D12CommandList::Draw( uint32_t VertexCount, uint32_t InstanceCount, uint32_t StartVertex, uint32_t StartInstance )
+{
+	m_pList->DrawInstanced( VertexCount, InstanceCount, StartVertex, StartInstance );
+}
+
+void D3D12CommandList::DrawIndexed( uint32_t IndexCount, uint32_t InstanceCount, uint32_t StartIndex, int32_t BaseVertex, uint32_t StartInstance )
+{
+	m_pList->DrawIndexedInstanced( IndexCount, InstanceCount, StartIndex, BaseVertex, StartInstance );
+}
+
+void D3D12CommandList::Dispatch( uint32_t GroupCountX, uint32_t GroupCountY, uint32_t GroupCountZ )
+{
+	m_pList->Dispatch( GroupCountX, GroupCountY, GroupCountZ );
+}
+
+void D3D12CommandList::ExecuteIndirect( void* pSignature, uint32_t MaxCount, void* pArgBuffer, uint64_t ArgOffset,
+	void* pCountBuffer, uint64_t CountOffset )
+{
+	m_pList->ExecuteIndirect( (ID3D12CommandSignature*)pSignature, MaxCount, (ID3D12Resource*)pArgBuffer, ArgOffset,
+		(ID3D12Resource*)pCountBuffer, CountOffset );
+}
+
+//--------------------------------------------------------------------------------------
+// D3D12DeviceBackend
+//--------------------------------------------------------------------------------------
+LinearPage* D3D12DeviceBackend::CreateLinearPage( size_t SizeInByte, bool CpuWritable )
+{
+	HRESULT hr;
+	ID3D12Resource* pBuffer;
+	D3D12_RESOURCE_STATES DefaultUsage;
+	if (!CpuWritable)
 	{
-		std::pair<uint64_t, ID3D12CommandAllocator*>& AllocatorPair = m_ReadyAllocators.front();
-		if (AllocatorPair.first <= CompletedFenceValue)
-		{
-			pAllocator = AllocatorPair.second;
-			V( pAllocator->Reset() );
-			m_ReadyAllocators.pop();
-		}
-		Graphics::g_stats.allocatorReady[m_cCommandListType] = (uint16_t)m_ReadyAllocators.size();
+		DefaultUsage = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		V( m_pDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES( D3D12_HEAP_TYPE_DEFAULT ), D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer( SizeInByte, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS ),
+			DefaultUsage, nullptr, IID_PPV_ARGS( &pBuffer ) ) );
 	}
-	if (pAllocator == nullptr)
+	else
 	{
-		V( m_pDevice->CreateCommandAllocator( m_cCommandListType, IID_PPV_ARGS( &pAllocator ) ) );
-		wchar_t AllocatorName[32];
-		swprintf( AllocatorName, 32, L"CommandAllocator %zu", m_AllocatorPool.size() );
-		pAllocator->SetName( AllocatorName );
-		m_AllocatorPool.push_back( pAllocator );
-		Graphics::g_stats.allocatorCreated[m_cCommandListType] = (uint16_t)m_AllocatorPool.size();
+		DefaultUsage = D3D12_RESOURCE_STATE_GENERIC_READ;
+		V( m_pDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES( D3D12_HEAP_TYPE_UPLOAD ), D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer( SizeInByte ),
+			DefaultUsage, nullptr, IID_PPV_ARGS( &pBuffer ) ) );
 	}
+	pBuffer->SetName( L"LinearAllocator Page" );
 
-	return pAllocator;
+	return new LinearAllocationPage( pBuffer, DefaultUsage );
 }
 
-void CommandAllocatorPool::DiscardAllocator( uint64_t FenceValue, ID3D12CommandAllocator* Allocator )
+void D3D12DeviceBackend::DestroyLinearPage( LinearPage* pPage )
 {
-	CriticalSectionScope LockGuard( &m_AllocatorCS );
-	m_ReadyAllocators.push( std::make_pair( FenceValue, Allocator ) );
+	delete pPage;
+}
+
+GpuDescriptorHeap D3D12DeviceBackend::CreateDescriptorHeap( uint32_t Type, uint32_t NumDescriptors, bool ShaderVisible )
+{
+	D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
+	HeapDesc.Type = (D3D12_DESCRIPTOR_HEAP_TYPE)Type;
+	HeapDesc.NumDescriptors = NumDescriptors;
+	HeapDesc.Flags = ShaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	HeapDesc.NodeMask = 1;
+	ID3D12DescriptorHeap* pHeap;
+	HRESULT hr;
+	V( m_pDevice->CreateDescriptorHeap( &HeapDesc, IID_PPV_ARGS( &pHeap ) ) );
+
+	GpuDescriptorHeap Heap = { pHeap, pHeap->GetCPUDescriptorHandleForHeapStart().ptr, 0 };
+	if (ShaderVisible)
+		Heap.GpuBase = pHeap->GetGPUDescriptorHandleForHeapStart().ptr;
+	return Heap;
+}
+
+void D3D12DeviceBackend::DestroyDescriptorHeap( const GpuDescriptorHeap& Heap )
+{
+	((ID3D12DescriptorHeap*)Heap.pNative)->Release();
+}
+
+uint32_t D3D12DeviceBackend::GetDescriptorSize( uint32_t Type )
+{
+	return m_pDevice->GetDescriptorHandleIncrementSize( (D3D12_DESCRIPTOR_HEAP_TYPE)Type );
+}
+
+IGpuCommandList* D3D12DeviceBackend::CreateCommandList( uint32_t Type, void* pAllocator )
+{
+	ID3D12GraphicsCommandList* pList;
+	HRESULT hr;
+	V( m_pDevice->CreateCommandList( 1, (D3D12_COMMAND_LIST_TYPE)Type, (ID3D12CommandAllocator*)pAllocator, nullptr, IID_PPV_ARGS( &pList ) ) );
+	pList->SetName( L"CommandList" );
+	return new D3D12CommandList( pList );
+}
+
+void D3D12DeviceBackend::DestroyCommandList( IGpuCommandList* pList )
+{
+	delete pList;
 }
 
 //--------------------------------------------------------------------------------------
@@ -74,21 +331,14 @@ void CommandAllocatorPool::DiscardAllocator( uint64_t FenceValue, ID3D12CommandA
 //--------------------------------------------------------------------------------------
 CommandQueue::CommandQueue( D3D12_COMMAND_LIST_TYPE Type ) :
 	m_Type( Type ),
-	m_CommandQueue( nullptr ),
-	m_pFence( nullptr ),
-	m_NextFenceValue( (uint64_t)Type << 56 | 1 ),
-	m_LastCompletedFenceValue( (uint64_t)Type << 56 ),
-	m_AllocatorPool( Type )
+	m_AllocatorPool( Type ),
+	m_Queue( Type )
 {
-	InitializeCriticalSection( &m_FenceCS );
-	InitializeCriticalSection( &m_EventCS );
 }
 
 CommandQueue::~CommandQueue()
 {
 	Shutdown();
-	DeleteCriticalSection( &m_FenceCS );
-	DeleteCriticalSection( &m_EventCS );
 }
 
 void CommandQueue::Create( ID3D12Device* pDevice )
@@ -97,20 +347,8 @@ void CommandQueue::Create( ID3D12Device* pDevice )
 	ASSERT( !IsReady() );
 	ASSERT( m_AllocatorPool.Size() == 0 );
 
-	HRESULT hr;
-
-	D3D12_COMMAND_QUEUE_DESC QueueDesc = {};
-	QueueDesc.Type = m_Type;
-	QueueDesc.NodeMask = 1;
-	V( pDevice->CreateCommandQueue( &QueueDesc, IID_PPV_ARGS( &m_CommandQueue ) ) );
-	m_CommandQueue->SetName( L"m_CommandQueue" );
-
-	V( pDevice->CreateFence( 0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS( &m_pFence ) ) );
-	m_pFence->SetName( L"m_pFence" );
-	m_pFence->Signal( (uint64_t)m_Type << 56 );
-
-	m_FenceEventHandle = CreateEvent( nullptr, false, false, nullptr );
-	ASSERT( m_FenceEventHandle != INVALID_HANDLE_VALUE );
+	m_Backend.Create( pDevice, m_Type, m_Queue.GetInitialFence() );
+	m_Queue.Create( &m_Backend );
 
 	m_AllocatorPool.Create( pDevice );
 	ASSERT( IsReady() );
@@ -118,76 +356,63 @@ void CommandQueue::Create( ID3D12Device* pDevice )
 
 void CommandQueue::Shutdown()
 {
-	if (m_CommandQueue == nullptr)
+	if (!IsReady())
 		return;
 	m_AllocatorPool.Shutdown();
-	CloseHandle( m_FenceEventHandle );
-
-	m_pFence->Release();
-	m_CommandQueue->Release();
-	m_CommandQueue = nullptr;
+	m_Queue.Destroy();
+	m_Backend.Shutdown();
 }
 
 uint64_t CommandQueue::IncrementFence()
 {
-	CriticalSectionScope LockGuard( &m_FenceCS );
-	m_CommandQueue->Signal( m_pFence, m_NextFenceValue );
-	return m_NextFenceValue++;
+	return m_Queue.Signal();
 }
 
 bool CommandQueue::IsFenceCompelete( uint64_t FenceValue )
 {
-	if (FenceValue > m_LastCompletedFenceValue)
-		m_LastCompletedFenceValue = max( m_LastCompletedFenceValue, m_pFence->GetCompletedValue() );
-
-	return FenceValue <= m_LastCompletedFenceValue;
+	return m_Queue.IsFenceComplete( FenceValue );
 }
 
 void CommandQueue::WaitForFence( uint64_t FenceValue )
 {
-	if (IsFenceCompelete( FenceValue ))
-		return;
+	double StallMs;
+	if (m_Queue.WaitForFence( FenceValue, StallMs ))
 	{
-		CriticalSectionScope LockGuard( &m_EventCS );
-		m_pFence->SetEventOnCompletion( FenceValue, m_FenceEventHandle );
-		int64_t startTick, endTick;
-		LARGE_INTEGER currentTick;
-		QueryPerformanceCounter( &currentTick );
-		startTick = static_cast<int64_t>(currentTick.QuadPart);
-		WaitForSingleObject( m_FenceEventHandle, INFINITE );
-		QueryPerformanceCounter( &currentTick );
-		endTick = static_cast<int64_t>(currentTick.QuadPart);
-
 		Graphics::g_stats.cpuStallCountPerFrame++;
-		Graphics::g_stats.cpuStallTimePerFrame += (double)(endTick - startTick) / Core::g_tickesPerSecond * 1000.f;
-		m_LastCompletedFenceValue = FenceValue;
+		Graphics::g_stats.cpuStallTimePerFrame += StallMs;
 	}
 }
 
 void CommandQueue::WaitforIdle()
 {
-	WaitForFence( m_NextFenceValue - 1 );
+	WaitForFence( m_Queue.GetNextFenceValue() - 1 );
+}
+
+void CommandQueue::GpuWait( uint64_t FenceValue )
+{
+	m_Queue.GpuWait( FenceValue );
 }
 
 ID3D12CommandQueue* CommandQueue::GetCommandQueue()
 {
-	return m_CommandQueue;
+	return m_Backend.GetCommandQueue();
 }
 
-uint64_t CommandQueue::ExecuteCommandList( ID3D12CommandList* List )
+uint64_t CommandQueue::ExecuteCommandList( IGpuCommandList* List )
 {
-	CriticalSectionScope LockGuard( &m_FenceCS );
-	HRESULT hr;
-	V( ((ID3D12GraphicsCommandList*)List)->Close() );
+	List->Close();
+	void* pNativeList = List->GetNativeList();
+	return m_Queue.Execute( 1, &pNativeList );
+}
 
-	m_CommandQueue->ExecuteCommandLists( 1, &List );
-	m_CommandQueue->Signal( m_pFence, m_NextFenceValue );
-	return m_NextFenceValue++;
+uint64_t CommandQueue::ExecuteCommandLists( CommandListBatch& Batch )
+{
+	return Batch.Submit( m_Queue );
 }
 
 ID3D12CommandAllocator* CommandQueue::RequestAllocator()
 {
-	uint64_t CompletedFence = m_pFence->GetCompletedValue();
+	uint64_t CompletedFence = m_Queue.GetCompletedFence();
 	return m_AllocatorPool.RequestAllocator( CompletedFence );
 }
 
@@ -215,6 +440,7 @@ void CmdListMngr::Create( ID3D12Device* pDevice )
 {
 	ASSERT( pDevice != nullptr );
 	m_pDevice = pDevice;
+	m_DeviceBackend.Create( pDevice );
 #ifndef RELEASE
 	pDevice->SetStablePowerState( TRUE );
 #endif
@@ -257,7 +483,7 @@ ID3D12CommandQueue* CmdListMngr::GetCommandQueue()
 	return m_GraphicsQueue.GetCommandQueue();
 }
 
-void CmdListMngr::CreateNewCommandList( D3D12_COMMAND_LIST_TYPE Type, ID3D12GraphicsCommandList** List, ID3D12CommandAllocator** Allocator )
+void CmdListMngr::CreateNewCommandList( D3D12_COMMAND_LIST_TYPE Type, IGpuCommandList** List, ID3D12CommandAllocator** Allocator )
 {
 	ASSERT( Type != D3D12_COMMAND_LIST_TYPE_BUNDLE ); // Bundles are not yet supported
 	switch (Type)
@@ -267,9 +493,7 @@ void CmdListMngr::CreateNewCommandList( D3D12_COMMAND_LIST_TYPE Type, ID3D12Grap
 	case D3D12_COMMAND_LIST_TYPE_COMPUTE: *Allocator = m_ComputeQueue.RequestAllocator(); break;
 	case D3D12_COMMAND_LIST_TYPE_COPY: *Allocator = m_CopyQueue.RequestAllocator(); break;
 	}
-	HRESULT hr;
-	V( m_pDevice->CreateCommandList( 1, Type, *Allocator, nullptr, IID_PPV_ARGS( List ) ) );
-	(*List)->SetName( L"CommandList" );
+	*List = m_DeviceBackend.CreateCommandList( Type, *Allocator );
 }
 
 bool CmdListMngr::IsFenceComplete( uint64_t FenceValue )
@@ -282,6 +506,11 @@ void CmdListMngr::WaitForFence( uint64_t FenceValue )
 	GetQueue( (D3D12_COMMAND_LIST_TYPE)(FenceValue >> 56) ).WaitForFence( FenceValue );
 }
 
+void CmdListMngr::GpuWait( D3D12_COMMAND_LIST_TYPE Type, uint64_t FenceValue )
+{
+	GetQueue( Type ).GpuWait( FenceValue );
+}
+
 void CmdListMngr::IdleGPU()
 {
 	m_GraphicsQueue.WaitforIdle();
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <vector>
-#include <queue>
+#include "FenceRecycler.h"
+#include "GpuQueue.h"
+#include "CommandListBatch.h"
 
 //--------------------------------------------------------------------------------------
 // CommandAllocatorPool
@@ -18,6 +20,8 @@ public:
 
 	ID3D12CommandAllocator* RequestAllocator( uint64_t CompletedFenceValue );
 	void DiscardAllocator( uint64_t FenceValue, ID3D12CommandAllocator* Allocator );
+	// Allocators whose fence completed become ready, returns how many
+	uint32_t ReclaimCompleted( uint64_t CompletedFenceValue );
 
 	inline size_t Size() { return m_AllocatorPool.size(); }
 
@@ -26,10 +30,90 @@ private:
 
 	ID3D12Device* m_pDevice;
 	std::vector<ID3D12CommandAllocator*> m_AllocatorPool;
-	std::queue<std::pair<uint64_t, ID3D12CommandAllocator*>> m_ReadyAllocators;
+	FenceRecycler<ID3D12CommandAllocator> m_ReadyAllocators;
+	// Only guards creating new allocators, recycling is lock-free
 	CRITICAL_SECTION m_AllocatorCS;
 };
 
+//--------------------------------------------------------------------------------------
+// D3D12QueueBackend
+//--------------------------------------------------------------------------------------
+class D3D12QueueBackend : public IGpuQueueBackend
+{
+public:
+	D3D12QueueBackend();
+	~D3D12QueueBackend();
+
+	void Create( ID3D12Device* pDevice, D3D12_COMMAND_LIST_TYPE Type, uint64_t InitialFence );
+	void Shutdown();
+	ID3D12CommandQueue* GetCommandQueue() { return m_CommandQueue; }
+
+	virtual void ExecuteAndSignal( uint32_t NumLists, void* const* ppLists, uint64_t FenceValue ) override;
+	virtual void Signal( uint64_t FenceValue ) override;
+	virtual void GpuWait( uint64_t FenceValue ) override;
+	virtual uint64_t GetCompletedFence() override;
+	virtual void WaitForFence( uint64_t FenceValue ) override;
+
+private:
+	ID3D12CommandQueue* m_CommandQueue;
+	ID3D12Fence* m_pFence;
+	// Fence of every queue type, for GpuWait() on another queue
+	static ID3D12Fence* sm_pFences[4];
+};
+
+//--------------------------------------------------------------------------------------
+// D3D12CommandList
+//--------------------------------------------------------------------------------------
+class D3D12CommandList : public IGpuCommandList
+{
+public:
+	explicit D3D12CommandList( ID3D12GraphicsCommandList* pList ) :m_pList( pList ) {}
+	~D3D12CommandList() { m_pList->Release(); }
+
+	virtual void Reset( void* pAllocator ) override;
+	virtual void Close() override;
+	virtual void* GetNativeList() override { return m_pList; }
+	virtual void* GetD3D12List() override { return m_pList; }
+
+	virtual void SetDescriptorHeaps( uint32_t NumHeaps, void* const* ppHeaps ) override;
+	virtual void SetRootSignature( bool Compute, void* pRootSignature ) override;
+	virtual void SetPipelineState( void* pPipelineState ) override;
+	virtual void SetRootConstants( bool Compute, uint32_t RootIndex, uint32_t NumConstants, const void* pConstants, uint32_t FirstConstant ) override;
+	virtual void SetRootDescriptorTable( bool Compute, uint32_t RootIndex, uint64_t GpuHandle ) override;
+	virtual void SetRootView( bool Compute, uint32_t RootIndex, RootView View, uint64_t GpuAddress ) override;
+	virtual void CopyBuffer( void* pDest, uint64_t DestOffset, void* pSrc, uint64_t SrcOffset, uint64_t NumBytes ) override;
+	virtual void Draw( uint32_t VertexCount, uint32_t InstanceCount, uint32_t StartVertex, uint32_t StartInstance ) override;
+	virtual void DrawIndexed( uint32_t IndexCount, uint32_t InstanceCount, uint32_t StartIndex, int32_t BaseVertex, uint32_t StartInstance ) override;
+	virtual void Dispatch( uint32_t GroupCountX, uint32_t GroupCountY, uint32_t GroupCountZ ) override;
+	virtual void ExecuteIndirect( void* pSignature, uint32_t MaxCount, void* pArgBuffer, uint64_t ArgOffset,
+		void* pCountBuffer, uint64_t CountOffset ) override;
+
+private:
+	ID3D12GraphicsCommandList* m_pList;
+};
+
+//--------------------------------------------------------------------------------------
+// D3D12DeviceBackend
+//--------------------------------------------------------------------------------------
+class D3D12DeviceBackend : public IGpuDeviceBackend
+{
+public:
+	D3D12DeviceBackend() :m_pDevice( nullptr ) {}
+
+	void Create( ID3D12Device* pDevice ) { m_pDevice = pDevice; }
+
+	virtual LinearPage* CreateLinearPage( size_t SizeInByte, bool CpuWritable ) override;
+	virtual void DestroyLinearPage( LinearPage* pPage ) override;
+	virtual GpuDescriptorHeap CreateDescriptorHeap( uint32_t Type, uint32_t NumDescriptors, bool ShaderVisible ) override;
+	virtual void DestroyDescriptorHeap( const GpuDescriptorHeap& Heap ) override;
+	virtual uint32_t GetDescriptorSize( uint32_t Type ) override;
+	virtual IGpuCommandList* CreateCommandList( uint32_t Type, void* pAllocator ) override;
+	virtual void DestroyCommandList( IGpuCommandList* pList ) override;
+
+private:
+	ID3D12Device* m_pDevice;
+};
+
 //--------------------------------------------------------------------------------------
 // CommandQueue
 //--------------------------------------------------------------------------------------
@@ -37,6 +121,7 @@ class CommandQueue
 {
 	friend class CmdListMngr;
 	friend class CommandContext;
+	friend class CommandContextBatch;
 
 public:
 	CommandQueue() = delete;
@@ -48,32 +133,37 @@ public:
 
 	inline bool IsReady()
 	{
-		return m_CommandQueue != nullptr;
+		return m_Queue.IsReady();
 	}
 
 	uint64_t IncrementFence();
+	// The fence the next command list will signal, work recorded now completes no earlier
+	uint64_t GetNextFenceValue() const { return m_Queue.GetNextFenceValue(); }
 	bool IsFenceCompelete( uint64_t FenceValue );
 	void WaitForFence( uint64_t FenceValue );
 	void WaitforIdle();
+	// Later submissions to this queue wait on the GPU for FenceValue of another queue, the CPU goes on
+	void GpuWait( uint64_t FenceValue );
 
 	ID3D12CommandQueue* GetCommandQueue();
+	GpuQueue& GetGpuQueue() { return m_Queue; }
+	// Allocators whose fence is at most CompletedFenceValue become ready ahead of RequestAllocator()
+	uint32_t ReclaimAllocators( uint64_t CompletedFenceValue ) { return m_AllocatorPool.ReclaimCompleted( CompletedFenceValue ); }
 
 private:
-	uint64_t ExecuteCommandList( ID3D12CommandList* List );
+	// Closes List and submits it
+	uint64_t ExecuteCommandList( IGpuCommandList* List );
+	// Lists are closed already, one submission and fence for all of them
+	uint64_t ExecuteCommandLists( CommandListBatch& Batch );
 	ID3D12CommandAllocator* RequestAllocator();
 	void DiscardAllocator( uint64_t FenceValueForReset, ID3D12CommandAllocator* Allocator );
 
-	ID3D12CommandQueue* m_CommandQueue;
 	const D3D12_COMMAND_LIST_TYPE m_Type;
 	CommandAllocatorPool m_AllocatorPool;
 
-	CRITICAL_SECTION m_FenceCS;
-	CRITICAL_SECTION m_EventCS;
-
-	ID3D12Fence* m_pFence;
-	uint64_t m_NextFenceValue;
-	uint64_t m_LastCompletedFenceValue;
-	HANDLE m_FenceEventHandle;
+	// Fence bookkeeping is device independent, see GpuQueue
+	D3D12QueueBackend m_Backend;
+	GpuQueue m_Queue;
 };
 
 //--------------------------------------------------------------------------------------
@@ -93,16 +183,22 @@ public:
 	CommandQueue& GetCopyQueue();
 	CommandQueue& GetQueue( D3D12_COMMAND_LIST_TYPE Type = D3D12_COMMAND_LIST_TYPE_DIRECT );
 	ID3D12CommandQueue* GetCommandQueue();
+	// Device objects the framework creates and destroys outside of the queues
+	IGpuDeviceBackend& GetDeviceBackend() { return m_DeviceBackend; }
 
+	// List is the backend's, destroy it through GetDeviceBackend()
 	void CreateNewCommandList( D3D12_COMMAND_LIST_TYPE Type,
-		ID3D12GraphicsCommandList** List,
+		IGpuCommandList** List,
 		ID3D12CommandAllocator** Allocator );
 	bool IsFenceComplete( uint64_t FenceValue );
 	void WaitForFence( uint64_t FenceValue );
+	// The Type queue waits on the GPU for FenceValue, which may come from any other queue
+	void GpuWait( D3D12_COMMAND_LIST_TYPE Type, uint64_t FenceValue );
 	void IdleGPU();
 
 private:
 	ID3D12Device* m_pDevice;
+	D3D12DeviceBackend m_DeviceBackend;
 
 	CommandQueue m_GraphicsQueue;
 	CommandQueue m_ComputeQueue;
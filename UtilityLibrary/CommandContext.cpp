@@ -16,22 +16,16 @@ ContextManager::~ContextManager()
 
 CommandContext* ContextManager::AllocateContext( D3D12_COMMAND_LIST_TYPE Type )
 {
-	CriticalSectionScope LockGuard( &sm_ContextAllocationCS );
-
-	auto& AvailableContexts = sm_AvailableContexts[Type];
-	CommandContext* ret = nullptr;
-	if (AvailableContexts.empty())
+	CommandContext* ret = sm_AvailableContexts[Type].Acquire();
+	if (ret != nullptr)
+		ret->Reset();
+	else
 	{
+		CriticalSectionScope LockGuard( &sm_ContextAllocationCS );
 		ret = new CommandContext( Type );
 		sm_ContextPool[Type].emplace_back( ret );
 		ret->Initialize();
 	}
-	else
-	{
-		ret = AvailableContexts.front();
-		AvailableContexts.pop();
-		ret->Reset();
-	}
 	ASSERT( ret != nullptr );
 	ASSERT( ret->m_Type == Type );
 	return ret;
@@ -40,14 +34,36 @@ CommandContext* ContextManager::AllocateContext( D3D12_COMMAND_LIST_TYPE Type )
 void ContextManager::FreeContext( CommandContext* UsedContext )
 {
 	ASSERT( UsedContext != nullptr );
-	CriticalSectionScope LockGuard( &sm_ContextAllocationCS );
-	sm_AvailableContexts[UsedContext->m_Type].push( UsedContext );
+	sm_AvailableContexts[UsedContext->m_Type].Release( UsedContext );
 }
 
 void ContextManager::DestroyAllContexts()
 {
 	for (uint32_t i = 0; i < 4; ++i)
+	{
+		sm_AvailableContexts[i].Clear();
 		sm_ContextPool[i].clear();
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// CommandContextBatch
+//--------------------------------------------------------------------------------------
+uint64_t CommandContextBatch::Submit( bool WaitForCompletion )
+{
+	ASSERT( m_Lists.IsComplete() );
+	uint64_t FenceValue = Graphics::g_cmdListMngr.GetQueue( m_Type ).ExecuteCommandLists( m_Lists );
+	for (uint32_t Slot = 0; Slot < m_Lists.GetNumSlots(); ++Slot)
+	{
+		CommandContext* pContext = (CommandContext*)m_Lists.GetOwner( Slot );
+		if (pContext != nullptr)
+			pContext->Retire( FenceValue );
+	}
+
+	if (WaitForCompletion && FenceValue != 0)
+		Graphics::g_cmdListMngr.WaitForFence( FenceValue );
+
+	return FenceValue;
 }
 
 //--------------------------------------------------------------------------------------
@@ -56,10 +72,11 @@ void ContextManager::DestroyAllContexts()
 CommandContext::CommandContext( D3D12_COMMAND_LIST_TYPE Type ) :
 	m_Type( Type ),
 	m_DynamicDescriptorHeap( *this ),
-	m_CpuLinearAllocator( kCpuWritable ),
+	m_CpuLinearAllocator( LinearAllocator::GetUploadType() ),
 	m_GpuLinearAllocator( kGpuExclusive )
 {
 	m_OwningManager = nullptr;
+	m_pCommandList = nullptr;
 	m_CommandList = nullptr;
 	m_CurCmdAllocator = nullptr;
 	ZeroMemory( m_CurrentDescriptorHeaps, sizeof( m_CurrentDescriptorHeaps ) );
@@ -68,27 +85,30 @@ CommandContext::CommandContext( D3D12_COMMAND_LIST_TYPE Type ) :
 	m_CurGraphicsPipelineState = nullptr;
 	m_CurComputeRootSignature = nullptr;
 	m_CurComputePipelineState = nullptr;
-	m_NumBarriersToFlush = 0;
+	m_ResourceBarriers.reserve( 16 );
+	m_NumBarriersIssued = 0;
+	m_NumBarriersElided = 0;
 }
 
 void CommandContext::Reset()
 {
-	ASSERT( m_CommandList != nullptr && m_CurCmdAllocator == nullptr );
+	ASSERT( m_pCommandList != nullptr && m_CurCmdAllocator == nullptr );
 	m_CurCmdAllocator = Graphics::g_cmdListMngr.GetQueue( m_Type ).RequestAllocator();
-	m_CommandList->Reset( m_CurCmdAllocator, nullptr );
+	m_pCommandList->Reset( m_CurCmdAllocator );
+	m_CpuLinearAllocator.SetType( LinearAllocator::GetUploadType() );
 
 	m_CurGraphicsRootSignature = nullptr;
 	m_CurComputeRootSignature = nullptr;
 	m_CurGraphicsPipelineState = nullptr;
 	m_CurComputePipelineState = nullptr;
-	m_NumBarriersToFlush = 0;
+	m_ResourceBarriers.clear();
 
 	BindDescriptorHeaps();
 }
 
 CommandContext::~CommandContext()
 {
-	if (m_CommandList != nullptr) m_CommandList->Release();
+	if (m_pCommandList != nullptr) Graphics::g_cmdListMngr.GetDeviceBackend().DestroyCommandList( m_pCommandList );
 }
 
 void CommandContext::DestroyAllContexts()
@@ -110,22 +130,22 @@ uint64_t CommandContext::Flush( bool WaitForCompletion )
 
 	ASSERT( m_CurCmdAllocator != nullptr );
 
-	uint64_t FenceValue = Graphics::g_cmdListMngr.GetQueue( m_Type ).ExecuteCommandList( m_CommandList );
+	uint64_t FenceValue = Graphics::g_cmdListMngr.GetQueue( m_Type ).ExecuteCommandList( m_pCommandList );
 
 	if (WaitForCompletion)
 		Graphics::g_cmdListMngr.WaitForFence( FenceValue );
 
-	m_CommandList->Reset( m_CurCmdAllocator, nullptr );
+	m_pCommandList->Reset( m_CurCmdAllocator );
 
 	if (m_CurGraphicsRootSignature)
 	{
-		m_CommandList->SetGraphicsRootSignature( m_CurGraphicsRootSignature );
-		m_CommandList->SetPipelineState( m_CurGraphicsPipelineState );
+		m_pCommandList->SetRootSignature( false, m_CurGraphicsRootSignature );
+		m_pCommandList->SetPipelineState( m_CurGraphicsPipelineState );
 	}
 	if (m_CurComputeRootSignature)
 	{
-		m_CommandList->SetComputeRootSignature( m_CurComputeRootSignature );
-		m_CommandList->SetPipelineState( m_CurComputePipelineState );
+		m_pCommandList->SetRootSignature( true, m_CurComputeRootSignature );
+		m_pCommandList->SetPipelineState( m_CurComputePipelineState );
 	}
 
 	BindDescriptorHeaps();
@@ -141,25 +161,50 @@ uint64_t CommandContext::Finish( bool WaitForCompletion )
 
 	ASSERT( m_CurCmdAllocator != nullptr );
 
-	CommandQueue& Queue = Graphics::g_cmdListMngr.GetQueue( m_Type );
-	uint64_t FenceValue = Queue.ExecuteCommandList( m_CommandList );
-	Queue.DiscardAllocator( FenceValue, m_CurCmdAllocator );
+	uint64_t FenceValue = Graphics::g_cmdListMngr.GetQueue( m_Type ).ExecuteCommandList( m_pCommandList );
+	Retire( FenceValue );
+
+	if (WaitForCompletion)
+		Graphics::g_cmdListMngr.WaitForFence( FenceValue );
+
+	return FenceValue;
+}
+
+void CommandContext::FinishInto( CommandContextBatch& Batch, uint32_t Slot )
+{
+	ASSERT( m_Type == Batch.m_Type );
+	ASSERT( m_Type == D3D12_COMMAND_LIST_TYPE_DIRECT || m_Type == D3D12_COMMAND_LIST_TYPE_COMPUTE );
+
+	FlushResourceBarriers();
+
+	ASSERT( m_CurCmdAllocator != nullptr );
+
+	// Closing is the part worth doing on the recording thread
+	m_pCommandList->Close();
+	Batch.m_Lists.Set( Slot, (ID3D12CommandList*)m_CommandList, this );
+}
+
+void CommandContext::Retire( uint64_t FenceValue )
+{
+	Graphics::g_cmdListMngr.GetQueue( m_Type ).DiscardAllocator( FenceValue, m_CurCmdAllocator );
 	m_CurCmdAllocator = nullptr;
 	m_CpuLinearAllocator.CleanupUsedPages( FenceValue );
 	m_GpuLinearAllocator.CleanupUsedPages( FenceValue );
 	m_DynamicDescriptorHeap.CleanupUsedHeaps( FenceValue );
-
-	if (WaitForCompletion)
-		Graphics::g_cmdListMngr.WaitForFence( FenceValue );
+	Graphics::g_stats.barriersIssued += m_NumBarriersIssued;
+	Graphics::g_stats.barriersElided += m_NumBarriersElided;
+	m_NumBarriersIssued = 0;
+	m_NumBarriersElided = 0;
 
 	Graphics::g_ContextMngr.FreeContext( this );
-
-	return FenceValue;
 }
 
 void CommandContext::Initialize()
 {
-	Graphics::g_cmdListMngr.CreateNewCommandList( m_Type, &m_CommandList, &m_CurCmdAllocator );
+	Graphics::g_cmdListMngr.CreateNewCommandList( m_Type, &m_pCommandList, &m_CurCmdAllocator );
+	m_CommandList = (ID3D12GraphicsCommandList*)m_pCommandList->GetD3D12List();
+	// Barriers, clears, render targets and the like are still recorded on it directly
+	ASSERT( m_CommandList != nullptr );
 }
 
 GraphicsContext& CommandContext::GetGraphicsContext()
@@ -303,32 +348,32 @@ void CommandContext::TransitionResource( GpuResource& Resource, D3D12_RESOURCE_S
 	}
 	if (OldState != NewState)
 	{
-		ASSERT( m_NumBarriersToFlush < 16 );
-		D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
-		BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-		BarrierDesc.Transition.pResource = Resource.GetResource();
-		BarrierDesc.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-		BarrierDesc.Transition.StateBefore = OldState;
-		BarrierDesc.Transition.StateAfter = NewState;
-
-		// Check to see if we already started the transition
-		if (NewState == Resource.m_TransitioningState)
+		if (Resource.m_TransitioningState != (D3D12_RESOURCE_STATES)-1 || !FoldPendingTransition( Resource, NewState ))
 		{
-			BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_END_ONLY;
-			Resource.m_TransitioningState = (D3D12_RESOURCE_STATES)-1;
+			m_ResourceBarriers.emplace_back();
+			D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarriers.back();
+			BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+			BarrierDesc.Transition.pResource = Resource.GetResource();
+			BarrierDesc.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+			BarrierDesc.Transition.StateBefore = OldState;
+			BarrierDesc.Transition.StateAfter = NewState;
+
+			// Check to see if we already started the transition
+			if (NewState == Resource.m_TransitioningState)
+			{
+				BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_END_ONLY;
+				Resource.m_TransitioningState = (D3D12_RESOURCE_STATES)-1;
+			}
+			else
+				BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+			Resource.m_UsageState = NewState;
 		}
-		else
-			BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-		Resource.m_UsageState = NewState;
 	}
 	else if (NewState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
 		InsertUAVBarrier( Resource, FlushImmediate );
 
-	if (m_NumBarriersToFlush != 0 && (FlushImmediate || m_NumBarriersToFlush == 16))
-	{
-		m_CommandList->ResourceBarrier( m_NumBarriersToFlush, m_ResourceBarrierBuffer );
-		m_NumBarriersToFlush = 0;
-	}
+	if (FlushImmediate)
+		FlushResourceBarriers();
 }
 
 void CommandContext::BeginResourceTransition( GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate /* = false */ )
@@ -341,8 +386,8 @@ void CommandContext::BeginResourceTransition( GpuResource& Resource, D3D12_RESOU
 
 	if (OldState != NewState)
 	{
-		ASSERT( m_NumBarriersToFlush < 16 );
-		D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+		m_ResourceBarriers.emplace_back();
+		D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarriers.back();
 
 		BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
 		BarrierDesc.Transition.pResource = Resource.GetResource();
@@ -355,40 +400,104 @@ void CommandContext::BeginResourceTransition( GpuResource& Resource, D3D12_RESOU
 		Resource.m_TransitioningState = NewState;
 	}
 
-	if (m_NumBarriersToFlush != 0 && (FlushImmediate || m_NumBarriersToFlush == 16))
+	if (FlushImmediate)
+		FlushResourceBarriers();
+}
+
+void CommandContext::InsertUAVBarrier( GpuResource& Resource, bool FlushImmediate /* = false */ )
+{
+	// A UAV barrier or a finished transition of the resource still pending orders its writes already
+	bool Covered = false;
+	for (auto& Pending : m_ResourceBarriers)
+	{
+		if (Pending.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV)
+			Covered |= Pending.UAV.pResource == Resource.GetResource();
+		else if (Pending.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && Pending.Flags != D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+			Covered |= Pending.Transition.pResource == Resource.GetResource();
+	}
+	if (Covered)
+		m_NumBarriersElided++;
+	else
 	{
-		m_CommandList->ResourceBarrier( m_NumBarriersToFlush, m_ResourceBarrierBuffer );
-		m_NumBarriersToFlush = 0;
+		m_ResourceBarriers.emplace_back();
+		D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarriers.back();
+
+		BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+		BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+		BarrierDesc.UAV.pResource = Resource.GetResource();
 	}
+
+	if (FlushImmediate)
+		FlushResourceBarriers();
 }
 
-void CommandContext::InsertUAVBarrier( GpuResource& Resource, bool FlushImmediate /* = false */ )
+void CommandContext::InsertAliasBarrier( GpuResource* Before, GpuResource& After, bool FlushImmediate /* = false */ )
 {
-	ASSERT( m_NumBarriersToFlush < 16 );
-	D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+	m_ResourceBarriers.emplace_back();
+	D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarriers.back();
 
-	BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+	BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
 	BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-	BarrierDesc.UAV.pResource = Resource.GetResource();
+	BarrierDesc.Aliasing.pResourceBefore = Before ? Before->GetResource() : nullptr;
+	BarrierDesc.Aliasing.pResourceAfter = After.GetResource();
 
 	if (FlushImmediate)
-	{
-		m_CommandList->ResourceBarrier( m_NumBarriersToFlush, m_ResourceBarrierBuffer );
-		m_NumBarriersToFlush = 0;
-	}
+		FlushResourceBarriers();
+}
+
+void CommandContext::DiscardResource( GpuResource& Resource )
+{
+	FlushResourceBarriers();
+	m_CommandList->DiscardResource( Resource.GetResource(), nullptr );
 }
 
 void CommandContext::FlushResourceBarriers()
 {
-	if (m_NumBarriersToFlush == 0) return;
-	m_CommandList->ResourceBarrier( m_NumBarriersToFlush, m_ResourceBarrierBuffer );
-	m_NumBarriersToFlush = 0;
+	if (m_ResourceBarriers.empty()) return;
+	m_CommandList->ResourceBarrier( (UINT)m_ResourceBarriers.size(), m_ResourceBarriers.data() );
+	m_NumBarriersIssued += (uint32_t)m_ResourceBarriers.size();
+	m_ResourceBarriers.clear();
+}
+
+bool CommandContext::FoldPendingTransition( GpuResource& Resource, D3D12_RESOURCE_STATES NewState )
+{
+	for (size_t i = m_ResourceBarriers.size(); i-- > 0;)
+	{
+		D3D12_RESOURCE_BARRIER& Pending = m_ResourceBarriers[i];
+		// A transition never moves to the other side of the resource's aliasing barrier
+		if (Pending.Type == D3D12_RESOURCE_BARRIER_TYPE_ALIASING &&
+			(Pending.Aliasing.pResourceBefore == Resource.GetResource() || Pending.Aliasing.pResourceAfter == Resource.GetResource()))
+			return false;
+		if (Pending.Type != D3D12_RESOURCE_BARRIER_TYPE_TRANSITION || Pending.Transition.pResource != Resource.GetResource())
+			continue;
+		// Nothing used the resource since, only the net change matters: A->B->C is A->C and A->B->A nothing
+		if (Pending.Flags != D3D12_RESOURCE_BARRIER_FLAG_NONE || Pending.Transition.Subresource != D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES)
+			return false;
+		ASSERT( Pending.Transition.StateAfter == Resource.m_UsageState );
+		Resource.m_UsageState = NewState;
+		if (Pending.Transition.StateBefore != NewState)
+		{
+			Pending.Transition.StateAfter = NewState;
+			m_NumBarriersElided++;
+			return true;
+		}
+		m_ResourceBarriers.erase( m_ResourceBarriers.begin() + i );
+		m_NumBarriersElided += 2;
+		// Leaving UAV and coming back ordered the writes before, keep that
+		if (NewState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+		{
+			InsertUAVBarrier( Resource );
+			m_NumBarriersElided--;
+		}
+		return true;
+	}
+	return false;
 }
 
 void CommandContext::BindDescriptorHeaps()
 {
 	UINT NonNullHeaps = 0;
-	ID3D12DescriptorHeap* HeapsToBind[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+	void* HeapsToBind[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
 	for (UINT i = 0; i < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++i)
 	{
 		ID3D12DescriptorHeap* HeapItr = m_CurrentDescriptorHeaps[i];
@@ -397,7 +506,7 @@ void CommandContext::BindDescriptorHeaps()
 	}
 	if (NonNullHeaps > 0)
 	{
-		m_CommandList->SetDescriptorHeaps( NonNullHeaps, HeapsToBind );
+		m_pCommandList->SetDescriptorHeaps( NonNullHeaps, HeapsToBind );
 	}
 }
 
@@ -7,7 +7,9 @@
 #include "RootSignature.h"
 #include "CommandSignature.h"
 #include "DynamicDescriptorHeap.h"
+#include "BindlessDescriptorHeap.h"
 #include "CmdListMngr.h"
+#include "CommandListBatch.h"
 #include "Graphics.h"
 #include <vector>
 #include <queue>
@@ -53,19 +55,52 @@ public:
 
 private:
 	std::vector<std::unique_ptr<CommandContext> > sm_ContextPool[4];
-	std::queue<CommandContext*> sm_AvailableContexts[4];
+	FenceRecycler<CommandContext> sm_AvailableContexts[4];
+	// Only guards creating new contexts, recycling is lock-free
 	CRITICAL_SECTION sm_ContextAllocationCS;
 };
 
+//--------------------------------------------------------------------------------------
+// CommandContextBatch
+//--------------------------------------------------------------------------------------
+// Contexts recorded on several threads and submitted as one ExecuteCommandLists with one fence, in
+// slot order. Begin() with the number of contexts, each thread calls FinishInto() with its own slot,
+// Submit() once all did. All contexts must be of the batch's queue type.
+// Contexts recorded in parallel must not touch the same resources. Barriers come from each
+// GpuResource's m_UsageState and m_TransitioningState, which aren't per context: threads recording
+// the same resource race on them, and even without a race StateBefore follows the order contexts
+// recorded in rather than the slot order the GPU runs them in. Resources shared between slots have
+// to be transitioned before Begin() or after Submit(), on a context of their own, unless one thread
+// records every slot in slot order. BoidsSimulation's Separate Context mode does that with its
+// substeps, which share the ping-pong buffers.
+class CommandContextBatch
+{
+	friend CommandContext;
+public:
+	explicit CommandContextBatch( D3D12_COMMAND_LIST_TYPE Type = D3D12_COMMAND_LIST_TYPE_DIRECT ) :m_Type( Type ) {}
+
+	void Begin( uint32_t NumContexts ) { m_Lists.Begin( NumContexts ); }
+	bool IsComplete() const { return m_Lists.IsComplete(); }
+	// Finishes every context of the batch, returns the one fence they all signal
+	uint64_t Submit( bool WaitForCompletion = false );
+
+private:
+	const D3D12_COMMAND_LIST_TYPE m_Type;
+	CommandListBatch m_Lists;
+};
+
 //--------------------------------------------------------------------------------------
 // CommandContext
 //--------------------------------------------------------------------------------------
 class CommandContext
 {
 	friend ContextManager;
+	friend CommandContextBatch;
 private:
 	CommandContext( D3D12_COMMAND_LIST_TYPE Type );
 	void Reset();
+	// Hands everything the submitted list used back for reuse after FenceValue, frees the context
+	void Retire( uint64_t FenceValue );
 
 public:
 	CommandContext() = delete;
@@ -76,6 +111,9 @@ public:
 
 	uint64_t Flush( bool WaitForCompletion = false );
 	uint64_t Finish( bool WaitForCompletion = false );
+	// Closes the list into Slot of Batch instead of submitting it, Batch.Submit() finishes the
+	// context. Meant for the recording thread, the context must not be used afterwards.
+	void FinishInto( CommandContextBatch& Batch, uint32_t Slot );
 
 	void Initialize();
 
@@ -95,6 +133,11 @@ public:
 	void BeginResourceTransition( GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate = false );
 
 	void InsertUAVBarrier( GpuResource& Resource, bool FlushImmediate = false );
+	// After takes over memory of a heap Before had, any resource in it with a null Before. A render
+	// target or depth stencil must then be cleared, discarded or copied to before anything else.
+	void InsertAliasBarrier( GpuResource* Before, GpuResource& After, bool FlushImmediate = false );
+	// Contents become undefined, the resource must be in a state it can be cleared in
+	void DiscardResource( GpuResource& Resource );
 	void FlushResourceBarriers();
 
 	void InsertTimeStamp( ID3D12QueryHeap* pQueryHeap, uint32_t QueryIdx );
@@ -112,10 +155,15 @@ public:
 
 protected:
 	void BindDescriptorHeaps();
+	// Folds a transition into the one still pending for the resource, false if there is none
+	bool FoldPendingTransition( GpuResource& Resource, D3D12_RESOURCE_STATES NewState );
 
 	void SetID( const std::wstring& ID ) { m_ID = ID; }
 
 	CmdListMngr* m_OwningManager;
+	IGpuCommandList* m_pCommandList;
+	// m_pCommandList's D3D12 list, for what IGpuCommandList doesn't cover yet. Never nullptr, the
+	// null device can't back a CommandContext
 	ID3D12GraphicsCommandList* m_CommandList;
 	ID3D12CommandAllocator* m_CurCmdAllocator;
 
@@ -126,8 +174,10 @@ protected:
 
 	DynamicDescriptorHeap m_DynamicDescriptorHeap;
 
-	D3D12_RESOURCE_BARRIER m_ResourceBarrierBuffer[16];
-	UINT m_NumBarriersToFlush;
+	// Pending until the next draw, dispatch or copy, no size limit
+	std::vector<D3D12_RESOURCE_BARRIER> m_ResourceBarriers;
+	uint32_t m_NumBarriersIssued;
+	uint32_t m_NumBarriersElided;
 
 	ID3D12DescriptorHeap* m_CurrentDescriptorHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
 
@@ -140,7 +190,7 @@ inline void CommandContext::CopyBufferRegion( GpuResource& Dest, size_t DestOffs
 {
 	TransitionResource( Dest, D3D12_RESOURCE_STATE_COPY_DEST );
 	FlushResourceBarriers();
-	m_CommandList->CopyBufferRegion( Dest.GetResource(), DestOffset, Src.GetResource(), SrcOffset, NumBytes );
+	m_pCommandList->CopyBuffer( Dest.GetResource(), DestOffset, Src.GetResource(), SrcOffset, NumBytes );
 }
 
 inline void CommandContext::ResetCounter( StructuredBuffer& Buf, uint32_t Value /* = 0 */ )
@@ -250,6 +300,8 @@ public:
 	void SetBufferSRV( UINT RootIndex, const GpuBuffer& SRV );
 	void SetBufferUAV( UINT RootIndex, const GpuBuffer& UAV );
 	void SetDescriptorTable( UINT RootIndex, D3D12_GPU_DESCRIPTOR_HANDLE FirstHandle );
+	// Binds the BindlessDescriptorHeap to a table made with RootParameter::InitAsBindlessTable()
+	void SetBindlessTable( UINT RootIndex );
 
 	void SetIndexBuffer( const D3D12_INDEX_BUFFER_VIEW& IBView );
 	void SetVertexBuffer( UINT Slot, const D3D12_VERTEX_BUFFER_VIEW& VBView );
@@ -267,7 +319,7 @@ inline void GraphicsContext::SetRootSignature( const RootSignature& RootSig )
 {
 	if (RootSig.GetSignature() == m_CurGraphicsRootSignature)
 		return;
-	m_CommandList->SetGraphicsRootSignature( m_CurGraphicsRootSignature = RootSig.GetSignature() );
+	m_pCommandList->SetRootSignature( false, m_CurGraphicsRootSignature = RootSig.GetSignature() );
 	m_DynamicDescriptorHeap.ParseGraphicsRootSignature( RootSig );
 }
 
@@ -280,44 +332,41 @@ inline void GraphicsContext::SetPipelineState( const GraphicsPSO& PSO )
 {
 	if (PSO.GetPipelineStateObject() == m_CurGraphicsPipelineState)
 		return;
-	m_CommandList->SetPipelineState( m_CurGraphicsPipelineState = PSO.GetPipelineStateObject() );
+	m_pCommandList->SetPipelineState( m_CurGraphicsPipelineState = PSO.GetPipelineStateObject() );
 }
 
 inline void GraphicsContext::SetConstants( UINT RootIndex, UINT NumConstants, const void* pConstants )
 {
-	m_CommandList->SetGraphicsRoot32BitConstants( RootIndex, NumConstants, pConstants, 0 );
+	m_pCommandList->SetRootConstants( false, RootIndex, NumConstants, pConstants, 0 );
 }
 
 inline void GraphicsContext::SetConstants( UINT RootIndex, DWParam X )
 {
-	m_CommandList->SetGraphicsRoot32BitConstant( RootIndex, X.Uint, 0 );
+	m_pCommandList->SetRootConstants( false, RootIndex, 1, &X, 0 );
 }
 
 
 inline void GraphicsContext::SetConstants( UINT RootIndex, DWParam X, DWParam Y )
 {
-	m_CommandList->SetGraphicsRoot32BitConstant( RootIndex, X.Uint, 0 );
-	m_CommandList->SetGraphicsRoot32BitConstant( RootIndex, Y.Uint, 1 );
+	const DWParam Values[2] = { X, Y };
+	m_pCommandList->SetRootConstants( false, RootIndex, 2, Values, 0 );
 }
 
 inline void GraphicsContext::SetConstants( UINT RootIndex, DWParam X, DWParam Y, DWParam Z )
 {
-	m_CommandList->SetGraphicsRoot32BitConstant( RootIndex, X.Uint, 0 );
-	m_CommandList->SetGraphicsRoot32BitConstant( RootIndex, Y.Uint, 1 );
-	m_CommandList->SetGraphicsRoot32BitConstant( RootIndex, Z.Uint, 2 );
+	const DWParam Values[3] = { X, Y, Z };
+	m_pCommandList->SetRootConstants( false, RootIndex, 3, Values, 0 );
 }
 
 inline void GraphicsContext::SetConstants( UINT RootIndex, DWParam X, DWParam Y, DWParam Z, DWParam W )
 {
-	m_CommandList->SetGraphicsRoot32BitConstant( RootIndex, X.Uint, 0 );
-	m_CommandList->SetGraphicsRoot32BitConstant( RootIndex, Y.Uint, 1 );
-	m_CommandList->SetGraphicsRoot32BitConstant( RootIndex, Z.Uint, 2 );
-	m_CommandList->SetGraphicsRoot32BitConstant( RootIndex, W.Uint, 3 );
+	const DWParam Values[4] = { X, Y, Z, W };
+	m_pCommandList->SetRootConstants( false, RootIndex, 4, Values, 0 );
 }
 
 inline void GraphicsContext::SetConstantBuffer( UINT RootIndex, D3D12_GPU_VIRTUAL_ADDRESS CBV )
 {
-	m_CommandList->SetGraphicsRootConstantBufferView( RootIndex, CBV );
+	m_pCommandList->SetRootView( false, RootIndex, IGpuCommandList::kConstantBufferView, CBV );
 }
 
 inline void GraphicsContext::SetDynamicDescriptors( UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[] )
@@ -366,7 +415,7 @@ inline void GraphicsContext::SetDynamicSRV( UINT RootIndex, size_t BufferSize, c
 	ASSERT( BufferData != nullptr && IsAligned( BufferData, 16 ) );
 	DynAlloc cb = m_CpuLinearAllocator.Allocate( BufferSize );
 	memcpy( cb.DataPtr, BufferData, BufferSize );
-	m_CommandList->SetGraphicsRootShaderResourceView( RootIndex, cb.GpuAddress );
+	m_pCommandList->SetRootView( false, RootIndex, IGpuCommandList::kShaderResourceView, cb.GpuAddress );
 }
 
 inline void GraphicsContext::SetDynamicConstantBufferView( UINT RootIndex, size_t BufferSize, const void* BufferData )
@@ -374,24 +423,30 @@ inline void GraphicsContext::SetDynamicConstantBufferView( UINT RootIndex, size_
 	ASSERT( BufferData != nullptr && IsAligned( BufferData, 16 ) );
 	DynAlloc cb = m_CpuLinearAllocator.Allocate( BufferSize );
 	memcpy( cb.DataPtr, BufferData, BufferSize );
-	m_CommandList->SetGraphicsRootConstantBufferView( RootIndex, cb.GpuAddress );
+	m_pCommandList->SetRootView( false, RootIndex, IGpuCommandList::kConstantBufferView, cb.GpuAddress );
 }
 
 inline void GraphicsContext::SetBufferSRV( UINT RootIndex, const GpuBuffer& SRV )
 {
 	ASSERT( (SRV.m_UsageState & (D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)) != 0 );
-	m_CommandList->SetGraphicsRootShaderResourceView( RootIndex, SRV.GetGpuVirtualAddress() );
+	m_pCommandList->SetRootView( false, RootIndex, IGpuCommandList::kShaderResourceView, SRV.GetGpuVirtualAddress() );
 }
 
 inline void GraphicsContext::SetBufferUAV( UINT RootIndex, const GpuBuffer& UAV )
 {
 	ASSERT( (UAV.m_UsageState & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) != 0 );
-	m_CommandList->SetGraphicsRootUnorderedAccessView( RootIndex, UAV.GetGpuVirtualAddress() );
+	m_pCommandList->SetRootView( false, RootIndex, IGpuCommandList::kUnorderedAccessView, UAV.GetGpuVirtualAddress() );
 }
 
 inline void GraphicsContext::SetDescriptorTable( UINT RootIndex, D3D12_GPU_DESCRIPTOR_HANDLE FirstHandle )
 {
-	m_CommandList->SetGraphicsRootDescriptorTable( RootIndex, FirstHandle );
+	m_pCommandList->SetRootDescriptorTable( false, RootIndex, FirstHandle.ptr );
+}
+
+inline void GraphicsContext::SetBindlessTable( UINT RootIndex )
+{
+	SetDescriptorHeap( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, BindlessDescriptorHeap::GetHeapPointer() );
+	m_pCommandList->SetRootDescriptorTable( false, RootIndex, BindlessDescriptorHeap::GetTableStart().ptr );
 }
 
 inline void GraphicsContext::SetIndexBuffer( const D3D12_INDEX_BUFFER_VIEW& IBView )
@@ -422,15 +477,15 @@ inline void GraphicsContext::DrawIndexed( UINT IndexCount, UINT StartIndexLocati
 inline void GraphicsContext::DrawInstanced( UINT VertexCountPerInstance, UINT InstanceCount, UINT StartVertexLocation /* = 0 */, UINT StartInstanceLocation /* = 0 */ )
 {
 	FlushResourceBarriers();
-	m_DynamicDescriptorHeap.CommitGraphicsRootDescriptorTables( m_CommandList );
-	m_CommandList->DrawInstanced( VertexCountPerInstance, InstanceCount, StartVertexLocation, StartInstanceLocation );
+	m_DynamicDescriptorHeap.CommitGraphicsRootDescriptorTables( m_pCommandList );
+	m_pCommandList->Draw( VertexCountPerInstance, InstanceCount, StartVertexLocation, StartInstanceLocation );
 }
 
 inline void GraphicsContext::DrawIndexedInstanced( UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation, INT BaseVertexLocation, UINT StartInstanceLocation )
 {
 	FlushResourceBarriers();
-	m_DynamicDescriptorHeap.CommitGraphicsRootDescriptorTables( m_CommandList );
-	m_CommandList->DrawIndexedInstanced( IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation, StartInstanceLocation );
+	m_DynamicDescriptorHeap.CommitGraphicsRootDescriptorTables( m_pCommandList );
+	m_pCommandList->DrawIndexed( IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation, StartInstanceLocation );
 }
 
 //inline void GraphicsContext::DrawIndirect(GpuBuffer& ArgumentBuffer, size_t ArgumentBufferOffset /* = 0 */)
@@ -464,6 +519,8 @@ public:
 	void SetBufferSRV( UINT RootIndex, const GpuBuffer& SRV );
 	void SetBufferUAV( UINT RootIndex, const GpuBuffer& UAV );
 	void SetDescriptorTable( UINT RootIndex, D3D12_GPU_DESCRIPTOR_HANDLE FirstHandle );
+	// Binds the BindlessDescriptorHeap to a table made with RootParameter::InitAsBindlessTable()
+	void SetBindlessTable( UINT RootIndex );
 
 	void Dispatch( size_t GroupCountX = 1, size_t GroupCountY = 1, size_t GroupCountZ = 1 );
 	void Dispatch1D( size_t ThreadCountX, size_t GroupSizeX = 64 );
@@ -476,7 +533,7 @@ inline void ComputeContext::SetRootSignature( const RootSignature& RootSig )
 {
 	if (RootSig.GetSignature() == m_CurComputeRootSignature)
 		return;
-	m_CommandList->SetComputeRootSignature( m_CurComputeRootSignature = RootSig.GetSignature() );
+	m_pCommandList->SetRootSignature( true, m_CurComputeRootSignature = RootSig.GetSignature() );
 	m_DynamicDescriptorHeap.ParseComputeRootSignature( RootSig );
 }
 
@@ -484,43 +541,40 @@ inline void ComputeContext::SetPipelineState( const ComputePSO& PSO )
 {
 	if (PSO.GetPipelineStateObject() == m_CurComputePipelineState)
 		return;
-	m_CommandList->SetPipelineState( m_CurComputePipelineState = PSO.GetPipelineStateObject() );
+	m_pCommandList->SetPipelineState( m_CurComputePipelineState = PSO.GetPipelineStateObject() );
 }
 
 inline void ComputeContext::SetConstants( UINT RootEntry, UINT NumConstants, const void* pConstants )
 {
-	m_CommandList->SetComputeRoot32BitConstants( RootEntry, NumConstants, pConstants, 0 );
+	m_pCommandList->SetRootConstants( true, RootEntry, NumConstants, pConstants, 0 );
 }
 
 inline void ComputeContext::SetConstants( UINT RootEntry, DWParam X )
 {
-	m_CommandList->SetComputeRoot32BitConstant( RootEntry, X.Uint, 0 );
+	m_pCommandList->SetRootConstants( true, RootEntry, 1, &X, 0 );
 }
 
 inline void ComputeContext::SetConstants( UINT RootEntry, DWParam X, DWParam Y )
 {
-	m_CommandList->SetComputeRoot32BitConstant( RootEntry, X.Uint, 0 );
-	m_CommandList->SetComputeRoot32BitConstant( RootEntry, Y.Uint, 1 );
+	const DWParam Values[2] = { X, Y };
+	m_pCommandList->SetRootConstants( true, RootEntry, 2, Values, 0 );
 }
 
 inline void ComputeContext::SetConstants( UINT RootEntry, DWParam X, DWParam Y, DWParam Z )
 {
-	m_CommandList->SetComputeRoot32BitConstant( RootEntry, X.Uint, 0 );
-	m_CommandList->SetComputeRoot32BitConstant( RootEntry, Y.Uint, 1 );
-	m_CommandList->SetComputeRoot32BitConstant( RootEntry, Z.Uint, 2 );
+	const DWParam Values[3] = { X, Y, Z };
+	m_pCommandList->SetRootConstants( true, RootEntry, 3, Values, 0 );
 }
 
 inline void ComputeContext::SetConstants( UINT RootEntry, DWParam X, DWParam Y, DWParam Z, DWParam W )
 {
-	m_CommandList->SetComputeRoot32BitConstant( RootEntry, X.Uint, 0 );
-	m_CommandList->SetComputeRoot32BitConstant( RootEntry, Y.Uint, 1 );
-	m_CommandList->SetComputeRoot32BitConstant( RootEntry, Z.Uint, 2 );
-	m_CommandList->SetComputeRoot32BitConstant( RootEntry, W.Uint, 3 );
+	const DWParam Values[4] = { X, Y, Z, W };
+	m_pCommandList->SetRootConstants( true, RootEntry, 4, Values, 0 );
 }
 
 inline void ComputeContext::SetConstantBuffer( UINT RootIndex, D3D12_GPU_VIRTUAL_ADDRESS CBV )
 {
-	m_CommandList->SetComputeRootConstantBufferView( RootIndex, CBV );
+	m_pCommandList->SetRootView( true, RootIndex, IGpuCommandList::kConstantBufferView, CBV );
 }
 
 inline void ComputeContext::SetDynamicDescriptors( UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[] )
@@ -533,7 +587,7 @@ inline void ComputeContext::SetDynamicSRV( UINT RootIndex, size_t BufferSize, co
 	ASSERT( BufferData != nullptr && IsAligned( BufferData, 16 ) );
 	DynAlloc cb = m_CpuLinearAllocator.Allocate( BufferSize );
 	memcpy( cb.DataPtr, BufferData, BufferSize );
-	m_CommandList->SetComputeRootShaderResourceView( RootIndex, cb.GpuAddress );
+	m_pCommandList->SetRootView( true, RootIndex, IGpuCommandList::kShaderResourceView, cb.GpuAddress );
 }
 
 inline void ComputeContext::SetDynamicConstantBufferView( UINT RootIndex, size_t BufferSize, const void* BufferData )
@@ -541,31 +595,37 @@ inline void ComputeContext::SetDynamicConstantBufferView( UINT RootIndex, size_t
 	ASSERT( BufferData != nullptr && IsAligned( BufferData, 16 ) );
 	DynAlloc cb = m_CpuLinearAllocator.Allocate( BufferSize );
 	memcpy( cb.DataPtr, BufferData, BufferSize );
-	m_CommandList->SetComputeRootConstantBufferView( RootIndex, cb.GpuAddress );
+	m_pCommandList->SetRootView( true, RootIndex, IGpuCommandList::kConstantBufferView, cb.GpuAddress );
 }
 
 inline void ComputeContext::SetBufferSRV( UINT RootIndex, const GpuBuffer& SRV )
 {
 	ASSERT( (SRV.m_UsageState & D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE) != 0 );
-	m_CommandList->SetComputeRootShaderResourceView( RootIndex, SRV.GetGpuVirtualAddress() );
+	m_pCommandList->SetRootView( true, RootIndex, IGpuCommandList::kShaderResourceView, SRV.GetGpuVirtualAddress() );
 }
 
 inline void ComputeContext::SetBufferUAV( UINT RootIndex, const GpuBuffer& UAV )
 {
 	ASSERT( (UAV.m_UsageState & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) != 0 );
-	m_CommandList->SetComputeRootUnorderedAccessView( RootIndex, UAV.GetGpuVirtualAddress() );
+	m_pCommandList->SetRootView( true, RootIndex, IGpuCommandList::kUnorderedAccessView, UAV.GetGpuVirtualAddress() );
 }
 
 inline void ComputeContext::SetDescriptorTable( UINT RootIndex, D3D12_GPU_DESCRIPTOR_HANDLE FirstHandle )
 {
-	m_CommandList->SetComputeRootDescriptorTable( RootIndex, FirstHandle );
+	m_pCommandList->SetRootDescriptorTable( true, RootIndex, FirstHandle.ptr );
+}
+
+inline void ComputeContext::SetBindlessTable( UINT RootIndex )
+{
+	SetDescriptorHeap( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, BindlessDescriptorHeap::GetHeapPointer() );
+	m_pCommandList->SetRootDescriptorTable( true, RootIndex, BindlessDescriptorHeap::GetTableStart().ptr );
 }
 
 inline void ComputeContext::Dispatch( size_t GroupCountX /* = 1 */, size_t GroupCountY /* = 1 */, size_t GroupCountZ /* = 1 */ )
 {
 	FlushResourceBarriers();
-	m_DynamicDescriptorHeap.CommitComputeRootDescriptorTables( m_CommandList );
-	m_CommandList->Dispatch( (UINT)GroupCountX, (UINT)GroupCountY, (UINT)GroupCountZ );
+	m_DynamicDescriptorHeap.CommitComputeRootDescriptorTables( m_pCommandList );
+	m_pCommandList->Dispatch( (UINT)GroupCountX, (UINT)GroupCountY, (UINT)GroupCountZ );
 }
 
 inline void ComputeContext::Dispatch1D( size_t ThreadCountX, size_t GroupSizeX /* = 64 */ )
@@ -591,6 +651,6 @@ inline void ComputeContext::Dispatch3D( size_t ThreadCountX, size_t ThreadCountY
 inline void ComputeContext::DispatchIndirect( GpuBuffer& ArgumentBuffer, size_t ArgumentBUfferOffset )
 {
 	FlushResourceBarriers();
-	m_DynamicDescriptorHeap.CommitComputeRootDescriptorTables( m_CommandList );
-	m_CommandList->ExecuteIndirect( Graphics::g_DispatchIndirectCommandSignature.GetSignature(), 1, ArgumentBuffer.GetResource(), (UINT64)ArgumentBUfferOffset, nullptr, 0 );
+	m_DynamicDescriptorHeap.CommitComputeRootDescriptorTables( m_pCommandList );
+	m_pCommandList->ExecuteIndirect( Graphics::g_DispatchIndirectCommandSignature.GetSignature(), 1, ArgumentBuffer.GetResource(), (UINT64)ArgumentBUfferOffset, nullptr, 0 );
 }
\ No newline at end of file
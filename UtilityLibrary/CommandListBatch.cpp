@@ -0,0 +1,34 @@
+#include "PortableAssert.h"
+#include "CommandListBatch.h"
+#include "GpuQueue.h"
+
+//--------------------------------------------------------------------------------------
+// CommandListBatch
+//--------------------------------------------------------------------------------------
+void CommandListBatch::Begin( uint32_t NumSlots )
+{
+	m_Lists.assign( NumSlots, nullptr );
+	m_Owners.assign( NumSlots, nullptr );
+	m_NumSet.store( 0, std::memory_order_relaxed );
+}
+
+bool CommandListBatch::Set( uint32_t Slot, void* pList, void* pOwner )
+{
+	ASSERT( Slot < m_Lists.size() && m_Lists[Slot] == nullptr && m_Owners[Slot] == nullptr );
+	m_Lists[Slot] = pList;
+	m_Owners[Slot] = pOwner;
+	// Release so whoever sees the batch complete sees every slot
+	return m_NumSet.fetch_add( 1, std::memory_order_acq_rel ) + 1 == m_Lists.size();
+}
+
+uint64_t CommandListBatch::Submit( GpuQueue& Queue )
+{
+	ASSERT( IsComplete() );
+	m_Submitted.clear();
+	for (void* pList : m_Lists)
+		if (pList != nullptr)
+			m_Submitted.push_back( pList );
+	if (m_Submitted.empty())
+		return 0;
+	return Queue.Execute( (uint32_t)m_Submitted.size(), m_Submitted.data() );
+}
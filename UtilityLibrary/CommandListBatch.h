@@ -0,0 +1,40 @@
+#pragma once
+// Command lists recorded in parallel and submitted together in slot order, on one fence.
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+class GpuQueue;
+
+//--------------------------------------------------------------------------------------
+// CommandListBatch
+//--------------------------------------------------------------------------------------
+class CommandListBatch
+{
+public:
+	CommandListBatch() :m_NumSet( 0 ) {}
+
+	// Not thread safe, the previous batch must have been submitted
+	void Begin( uint32_t NumSlots );
+	// Thread safe for distinct slots, true for the call which filled the last one. pList may be
+	// nullptr when the thread recorded nothing, pOwner is whatever has to be told the fence afterwards.
+	bool Set( uint32_t Slot, void* pList, void* pOwner = nullptr );
+	bool IsComplete() const { return m_NumSet.load( std::memory_order_acquire ) == m_Lists.size(); }
+
+	// Every slot must be set, submits the lists in slot order however the slots were filled. Returns
+	// the fence of the submission, or 0 if there were no lists.
+	uint64_t Submit( GpuQueue& Queue );
+
+	uint32_t GetNumSlots() const { return (uint32_t)m_Lists.size(); }
+	void* GetOwner( uint32_t Slot ) const { return m_Owners[Slot]; }
+
+private:
+	CommandListBatch( const CommandListBatch& ) = delete;
+	CommandListBatch& operator=( const CommandListBatch& ) = delete;
+
+	std::vector<void*>			m_Lists;
+	std::vector<void*>			m_Owners;
+	std::vector<void*>			m_Submitted;		// m_Lists without the empty slots
+	std::atomic<uint32_t>		m_NumSet;
+};
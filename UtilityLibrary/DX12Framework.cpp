@@ -6,6 +6,7 @@
 #include "DXHelper.h"
 #include "GuiRenderer.h"
 #include "FXAA.h"
+#include "FrameGraph.h"
 #include <shellapi.h>
 
 #include "Graphics.h"
@@ -69,6 +70,9 @@ namespace Core
 			if (_wcsnicmp( argv[i], L"-warp", wcslen( argv[i] ) ) == 0 ||
 				_wcsnicmp( argv[i], L"/warp", wcslen( argv[i] ) ) == 0)
 				g_config.warpDevice = true;
+			else if (_wcsnicmp( argv[i], L"-bakeshaders", wcslen( argv[i] ) ) == 0 ||
+				_wcsnicmp( argv[i], L"/bakeshaders", wcslen( argv[i] ) ) == 0)
+				g_config.bakeShaders = true;
 		}
 		LocalFree( argv );
 	}
@@ -176,11 +180,23 @@ namespace Core
 
 	void FrameworkRender( IDX12Framework& application )
 	{
-		CommandContext& EngineContext = CommandContext::Begin( L"EngineContext" );
-		application.OnRender( EngineContext );
+		FrameGraph& Graph = Graphics::g_frameGraph;
+		Graph.Reset();
+		// Nothing is kept from the frame before, applications clear both
+		const uint32_t SceneColor = Graph.CreateTransient( "Scene Color", Graphics::g_SceneColorBuffer );
+		const uint32_t SceneDepth = Graph.CreateTransient( "Scene Depth", Graphics::g_SceneDepthBuffer );
+
+		Graph.AddPass( "EngineContext", kPassSideEffect | kPassOwnContexts, [&application]( CommandContext& EngineContext )
+		{
+			application.OnRender( EngineContext );
+		} );
+		Graph.Write( SceneColor, D3D12_RESOURCE_STATE_RENDER_TARGET );
+		Graph.Write( SceneDepth, D3D12_RESOURCE_STATE_DEPTH_WRITE );
+
 		if(g_config.FXAA)
-			FXAA::Render( EngineContext.GetComputeContext() );
-		Graphics::Present( EngineContext );
+			FXAA::AddPasses( Graph, SceneColor );
+		Graphics::AddPresentPass( Graph, SceneColor );
+		Graphics::Present( Graph.Execute() );
 	}
 
 	void FrameworkDestory( IDX12Framework& application )
@@ -243,6 +259,7 @@ namespace Core
 				_resize.store( false, std::memory_order_relaxed );
 				FrameworkResize( application );
 			}
+			Graphics::BeginFrame();
 			FrameworkUpdate( application );
 			FrameworkRender( application );
 		}
@@ -290,7 +307,15 @@ namespace Core
 			windowRect.bottom - windowRect.top, NULL, NULL, hInstance, nullptr );
 
 		// SwapChain need hwnd, so have to place it after window creation
-		FrameworkCreateResource( application );
+		HRESULT createResult = FrameworkCreateResource( application );
+
+		// Every shader is compiled once everything is created, the window is never shown
+		if (g_config.bakeShaders)
+		{
+			FrameworkDestory( application );
+			DestroyWindow( g_hwnd );
+			return SUCCEEDED( createResult ) && Graphics::g_stats.shadersCompiled + Graphics::g_stats.shadersCached > 0 ? 0 : 1;
+		}
 
 		g_title += (g_config.warpDevice ? L" (WARP)" : L"");
 
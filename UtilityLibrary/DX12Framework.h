@@ -26,12 +26,14 @@ namespace Core
 	const uint32_t				NUM_RTV = 64;
 	const uint32_t				NUM_DSV = 64;
 	const uint32_t				NUM_SMP = 128;
-	const uint32_t				NUM_CSU = 128;
+	const uint32_t				NUM_CSU = 1024;
 
 	struct Settings
 	{
 		bool					enableFullScreen = false;
 		bool					warpDevice = false;
+		// -bakeshaders: creates all resources, saves <exe>.ShaderCache.bin and quits, the build runs it with /p:BakeShaderCache=true
+		bool					bakeShaders = false;
 		DXGI_SWAP_CHAIN_DESC1	swapChainDesc = {};
 
 		// Free to be changed after init
@@ -39,6 +41,10 @@ namespace Core
 		bool					vsync = false;
 		bool					FXAA = true;
 		bool					showPerf = true;
+		// Frames the CPU may run ahead of the GPU, 1 to 4
+		uint32_t				framesInFlight = 2;
+		// Starts each frame as late as keeps the GPU busy, two frames in flight at most
+		bool					lowLatency = false;
 	};
 
 	class IDX12Framework
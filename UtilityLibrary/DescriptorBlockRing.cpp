@@ -0,0 +1,119 @@
+#include "PortableAssert.h"
+#include "DescriptorBlockRing.h"
+
+//--------------------------------------------------------------------------------------
+// DescriptorBlockRing
+//--------------------------------------------------------------------------------------
+DescriptorBlockRing::DescriptorBlockRing()
+	:m_pFenceOracle( nullptr ), m_Capacity( 0 ), m_Head( 0 ), m_Tail( 0 ), m_PeakUsed( 0 ), m_NumBlocks( 0 ),
+	m_NumFailed( 0 ), m_NumSkipped( 0 )
+{
+}
+
+void DescriptorBlockRing::Create( uint32_t Capacity, IFenceOracle* pFenceOracle )
+{
+	ASSERT( Capacity > 0 );
+	m_pFenceOracle = pFenceOracle;
+	m_Capacity = Capacity;
+	m_Head = 0;
+	m_Tail = 0;
+	m_RetiredBlocks.clear();
+	m_PeakUsed = 0;
+	m_NumBlocks = 0;
+	m_NumFailed = 0;
+	m_NumSkipped = 0;
+}
+
+void DescriptorBlockRing::Destroy()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_RetiredBlocks.clear();
+	m_Head = 0;
+	m_Tail = 0;
+	m_Capacity = 0;
+}
+
+bool DescriptorBlockRing::Reserve( uint32_t Count, DescriptorBlock& Block )
+{
+	ASSERT( Count > 0 );
+	if (Count > m_Capacity)
+	{
+		m_NumFailed++;
+		return false;
+	}
+
+	bool Reclaimed = false;
+	uint64_t Head = m_Head.load( std::memory_order_relaxed );
+	for (;;)
+	{
+		// Blocks are contiguous, skip what is left in front of the heap end
+		const uint32_t Pos = (uint32_t)(Head % m_Capacity);
+		const uint32_t Skip = Pos + Count > m_Capacity ? m_Capacity - Pos : 0;
+		const uint64_t NewHead = Head + Skip + Count;
+		// A stale tail only makes the ring look fuller than it is
+		const uint64_t Used = NewHead - m_Tail.load( std::memory_order_acquire );
+		if (Used > m_Capacity)
+		{
+			if (Reclaimed)
+			{
+				m_NumFailed++;
+				return false;
+			}
+			Reclaim();
+			Reclaimed = true;
+			Head = m_Head.load( std::memory_order_relaxed );
+			continue;
+		}
+		if (!m_Head.compare_exchange_weak( Head, NewHead, std::memory_order_relaxed ))
+			continue;
+
+		Block.Begin = Head;
+		Block.End = NewHead;
+		Block.Offset = (Pos + Skip) % m_Capacity;
+		Block.Count = Count;
+		m_NumBlocks++;
+		if (Skip)
+			m_NumSkipped += Skip;
+		uint32_t Peak = m_PeakUsed.load( std::memory_order_relaxed );
+		while (Peak < Used && !m_PeakUsed.compare_exchange_weak( Peak, (uint32_t)Used, std::memory_order_relaxed ));
+		return true;
+	}
+}
+
+void DescriptorBlockRing::Retire( const DescriptorBlock* pBlocks, size_t NumBlocks, uint64_t FenceValue )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	for (size_t i = 0; i < NumBlocks; ++i)
+	{
+		RetiredBlock Retired = { pBlocks[i].End, FenceValue };
+		m_RetiredBlocks.emplace( pBlocks[i].Begin, Retired );
+	}
+}
+
+DescriptorBlockRingStats DescriptorBlockRing::GetStats()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	DescriptorBlockRingStats Stats;
+	Stats.Capacity = m_Capacity;
+	Stats.NumUsed = (uint32_t)(m_Head.load() - m_Tail.load());
+	Stats.PeakUsed = m_PeakUsed;
+	Stats.NumPendingBlocks = (uint32_t)m_RetiredBlocks.size();
+	Stats.NumBlocks = m_NumBlocks;
+	Stats.NumFailed = m_NumFailed;
+	Stats.NumSkipped = m_NumSkipped;
+	return Stats;
+}
+
+void DescriptorBlockRing::Reclaim()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	// Blocks are reserved back to back, a gap at the tail is a block not retired yet
+	uint64_t Tail = m_Tail.load( std::memory_order_relaxed );
+	auto iter = m_RetiredBlocks.begin();
+	while (iter != m_RetiredBlocks.end() && iter->first == Tail && m_pFenceOracle->IsFenceComplete( iter->second.FenceValue ))
+	{
+		Tail = iter->second.End;
+		iter = m_RetiredBlocks.erase( iter );
+	}
+	m_Tail.store( Tail, std::memory_order_release );
+}
@@ -0,0 +1,78 @@
+#pragma once
+// Fence based ring of descriptors in one big shader-visible heap shared by every context. A context
+// reserves a block at the head with one CAS, no lock, and keeps allocating from it; when the block is
+// full it reserves the next one and tables bound from the old block stay valid, since all blocks
+// live in the same heap. At the end of the command list the context retires its blocks with the
+// command list's fence, the tail only moves past retired blocks whose fence completed, so one block
+// still being recorded holds back everything reserved after it.
+// A block which doesn't fit in front of the heap end skips to the start, the skipped descriptors
+// are retired along with it. Reserve() fails when the ring is full, the caller falls back to a heap
+// of its own.
+// Reserve() is lock-free, Retire() and reclaiming take a mutex. The descriptor-block-ring area of
+// UtilityTests stresses it from many threads.
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#include "LinearPagePool.h"
+
+struct DescriptorBlock
+{
+	uint64_t	Begin;				// Ever increasing ring position, including skipped descriptors
+	uint64_t	End;
+	uint32_t	Offset;				// Into the heap
+	uint32_t	Count;
+};
+
+struct DescriptorBlockRingStats
+{
+	uint32_t	Capacity;
+	uint32_t	NumUsed;			// Between tail and head, including skipped ones
+	uint32_t	PeakUsed;
+	uint32_t	NumPendingBlocks;	// Retired, waiting for their fence or an older block
+	uint64_t	NumBlocks;			// Total blocks reserved
+	uint64_t	NumFailed;			// Reservations left to the caller's fallback
+	uint64_t	NumSkipped;			// Total descriptors skipped at the heap end
+};
+
+//--------------------------------------------------------------------------------------
+// DescriptorBlockRing
+//--------------------------------------------------------------------------------------
+class DescriptorBlockRing
+{
+public:
+	DescriptorBlockRing();
+	void Create( uint32_t Capacity, IFenceOracle* pFenceOracle );
+	void Destroy();
+	bool IsCreated() const { return m_Capacity != 0; }
+	uint32_t GetCapacity() const { return m_Capacity; }
+
+	// Thread safe
+	bool Reserve( uint32_t Count, DescriptorBlock& Block );
+	void Retire( const DescriptorBlock* pBlocks, size_t NumBlocks, uint64_t FenceValue );
+	// Move the tail past retired blocks whose fence completed, Reserve() does it when the ring is
+	// full, calling it ahead keeps that off the recording threads
+	void Reclaim();
+	DescriptorBlockRingStats GetStats();
+
+private:
+	struct RetiredBlock
+	{
+		uint64_t	End;
+		uint64_t	FenceValue;
+	};
+
+	IFenceOracle*					m_pFenceOracle;
+	uint32_t						m_Capacity;
+	std::atomic<uint64_t>			m_Head;
+	std::atomic<uint64_t>			m_Tail;				// Only moved by Reclaim(), under m_Mutex
+	std::mutex						m_Mutex;
+	std::map<uint64_t, RetiredBlock>	m_RetiredBlocks;	// By Begin
+
+	std::atomic<uint32_t>			m_PeakUsed;
+	std::atomic<uint64_t>			m_NumBlocks;
+	std::atomic<uint64_t>			m_NumFailed;
+	std::atomic<uint64_t>			m_NumSkipped;
+};
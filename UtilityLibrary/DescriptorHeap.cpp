@@ -46,32 +46,79 @@ CD3DX12_GPU_DESCRIPTOR_HANDLE DescriptorHandle::GetGPUHandle()
 	return mGPUHandle;
 }
 
-DescriptorHeap::DescriptorHeap( ID3D12Device* device, UINT maxDescriptors, D3D12_DESCRIPTOR_HEAP_TYPE type, bool shaderVisible )
-	: mDevice( device ), mMaxSize( maxDescriptors )
+DescriptorHeap::DescriptorHeap( IGpuDeviceBackend* backend, UINT maxDescriptors, D3D12_DESCRIPTOR_HEAP_TYPE type, bool shaderVisible )
+	: mBackend( backend ), mType( type ), mMaxSize( maxDescriptors )
 {
-	HRESULT hr;
+	mShaderVisible = shaderVisible;
+	mHandleIncrementSize = mBackend->GetDescriptorSize( type );
+	InitializeCriticalSection( &mCS );
+	mChain.Create( mMaxSize, mHandleIncrementSize, [this]( uint32_t ) { return CreatePage(); } );
+}
 
-	D3D12_DESCRIPTOR_HEAP_DESC desc = {};
-	desc.Type = type;
-	desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-	desc.NumDescriptors = mMaxSize;
+DescriptorHeap::~DescriptorHeap()
+{
+	for (auto& page : mPages)
+		mBackend->DestroyDescriptorHeap( page );
+	mPages.clear();
+	DeleteCriticalSection( &mCS );
+}
 
-	V( mDevice->CreateDescriptorHeap( &desc, IID_PPV_ARGS( &mHeap ) ) );
+uint64_t DescriptorHeap::CreatePage()
+{
+	// Descriptors are copied out of here, so the heap itself is never shader visible
+	GpuDescriptorHeap page = mBackend->CreateDescriptorHeap( mType, mMaxSize, false );
+	mPages.push_back( page );
+	if (mPages.size() > 1)
+		PRINTWARN( "Descriptor heap type %d full, chained heap %d", mType, (int)mPages.size() );
+	return page.CpuBase;
+}
 
-	mShaderVisible = shaderVisible;
+DescriptorHandle DescriptorHeap::Allocate( UINT count )
+{
+	ASSERT( count > 0 && count <= mMaxSize );
+	CriticalSectionScope lock( &mCS );
+	uint32_t heap = 0;
+	const uint64_t cpuHandle = mChain.Allocate( count, &heap );
 
-	mCPUBegin = mHeap->GetCPUDescriptorHandleForHeapStart();
-	mHandleIncrementSize = mDevice->GetDescriptorHandleIncrementSize( desc.Type );
+	DescriptorHandle ret;
+	ret.mCPUHandle.ptr = (SIZE_T)cpuHandle;
+	if (mShaderVisible)
+		ret.mGPUHandle.ptr = mPages[heap].GpuBase + (cpuHandle - mChain.GetHeapBase( heap ));
+	return ret;
+}
 
-	if (shaderVisible) {
-		mGPUBegin = mHeap->GetGPUDescriptorHandleForHeapStart();
+void DescriptorHeap::Free( D3D12_CPU_DESCRIPTOR_HANDLE handle, UINT count )
+{
+	CriticalSectionScope lock( &mCS );
+	mChain.Free( handle.ptr, count );
+}
+
+void DescriptorHeap::Clear()
+{
+	CriticalSectionScope lock( &mCS );
+	mChain.Reset();
+}
+
+DescriptorHeapStats DescriptorHeap::GetStats() const
+{
+	CriticalSectionScope lock( &mCS );
+	DescriptorHeapStats stats = {};
+	stats.NumHeaps = mChain.GetNumHeaps();
+	for (uint32_t i = 0; i < stats.NumHeaps; ++i)
+	{
+		DescriptorRangeStats pageStats = mChain.GetHeapStats( i );
+		stats.Capacity += pageStats.Capacity;
+		stats.NumUsed += pageStats.NumUsed;
+		stats.NumFreeRanges += pageStats.NumFreeRanges;
+		if (pageStats.LargestFreeRange > stats.LargestFreeRange)
+			stats.LargestFreeRange = pageStats.LargestFreeRange;
 	}
+	return stats;
 }
 
-DescriptorHandle DescriptorHeap::Append()
+void FreeDescriptor( DescriptorHeap* pHeap, D3D12_CPU_DESCRIPTOR_HANDLE& handle )
 {
-	ASSERT( mCurrentSize < mMaxSize );
-	DescriptorHandle ret( CPU( mCurrentSize ), GPU( mCurrentSize ) );
-	mCurrentSize++;
-	return ret;
-}
\ No newline at end of file
+	if (pHeap != nullptr && handle.ptr != ~0ull)
+		pHeap->Free( handle );
+	handle.ptr = ~0ull;
+}
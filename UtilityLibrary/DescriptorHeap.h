@@ -1,6 +1,9 @@
 #pragma once
 #include <vector>
 
+#include "DescriptorRangeAllocator.h"
+#include "GpuQueueBackend.h"
+
 class DescriptorHandle
 {
 	friend class DescriptorHeap;
@@ -18,36 +21,54 @@ private:
 	bool hasGpuHandle;
 };
 
+struct DescriptorHeapStats
+{
+	uint32_t	NumHeaps;
+	uint32_t	Capacity;
+	uint32_t	NumUsed;
+	uint32_t	NumFreeRanges;
+	uint32_t	LargestFreeRange;			// Over all chained heaps
+};
+
+// Persistent descriptors, handed out and freed in contiguous ranges. Starts with one heap of
+// maxDescriptors and chains another heap of the same size whenever a range doesn't fit, so
+// maxDescriptors is also the largest range there is.
 class DescriptorHeap
 {
 public:
 
-	// device must live for the lifetime of this object (no explicit refcount increment)
-	DescriptorHeap( ID3D12Device* device, UINT maxDescriptors, D3D12_DESCRIPTOR_HEAP_TYPE type, bool shaderVisible = false );
+	// Heaps are created through backend, which must outlive this object
+	DescriptorHeap( IGpuDeviceBackend* backend, UINT maxDescriptors, D3D12_DESCRIPTOR_HEAP_TYPE type, bool shaderVisible = false );
+	~DescriptorHeap();
 
 	// NOTE: Caller can fill in data at new handle and/or derived classes provide
 	// specialized methods to do it in one step.
-	DescriptorHandle Append();
+	DescriptorHandle Allocate( UINT count = 1 );
+	// Takes the first handle of a range, with the count it was allocated with
+	void Free( D3D12_CPU_DESCRIPTOR_HANDLE handle, UINT count = 1 );
 
 	// Invalidates contents of any previous handles
-	void Clear() { mCurrentSize = 0; }
-	void Resize( UINT newSize ) { mCurrentSize = newSize; }
-	UINT Size() const { return mCurrentSize; }
+	void Clear();
+	UINT Size() const { return mChain.GetNumUsed(); }
+	DescriptorHeapStats GetStats() const;
 
-	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mHeap;
 	UINT mHandleIncrementSize = 0;
 
 protected:
-	// Direct access to handles
-	CD3DX12_CPU_DESCRIPTOR_HANDLE CPU( UINT index = 0 ) const { return CD3DX12_CPU_DESCRIPTOR_HANDLE( mCPUBegin, index, mHandleIncrementSize ); }
-	CD3DX12_GPU_DESCRIPTOR_HANDLE GPU( UINT index = 0 ) const { return CD3DX12_GPU_DESCRIPTOR_HANDLE( mGPUBegin, index, mHandleIncrementSize ); }
-	CD3DX12_GPU_DESCRIPTOR_HANDLE GPUEnd() const { return GPU( mCurrentSize ); }
+	// Returns the CPU handle of the heap start
+	uint64_t CreatePage();
 	UINT HandleIncrementSize() const { return mHandleIncrementSize; }
 
-	ID3D12Device* mDevice = nullptr;
-	CD3DX12_CPU_DESCRIPTOR_HANDLE mCPUBegin;
-	CD3DX12_GPU_DESCRIPTOR_HANDLE mGPUBegin;
-	UINT mCurrentSize = 0;
+	IGpuDeviceBackend* mBackend = nullptr;
+	D3D12_DESCRIPTOR_HEAP_TYPE mType;
+	// One per heap of mChain, in the same order
+	std::vector<GpuDescriptorHeap> mPages;
+	DescriptorRangeChain mChain;
 	UINT mMaxSize = 0;
 	bool mShaderVisible;
-};
\ No newline at end of file
+	mutable CRITICAL_SECTION mCS;
+};
+
+// Frees a handle of one of the Graphics descriptor heaps and resets it to ~0ull. Does nothing for
+// handles never allocated, or once the heaps are gone at shutdown.
+void FreeDescriptor( DescriptorHeap* pHeap, D3D12_CPU_DESCRIPTOR_HANDLE& handle );
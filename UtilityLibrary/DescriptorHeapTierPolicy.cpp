@@ -0,0 +1,55 @@
+#include "PortableAssert.h"
+#include "DescriptorHeapTierPolicy.h"
+
+//--------------------------------------------------------------------------------------
+// DescriptorHeapTierPolicy
+//--------------------------------------------------------------------------------------
+DescriptorHeapTierPolicy::DescriptorHeapTierPolicy( const DescriptorHeapTierConfig& Config )
+	:m_Config( Config ), m_Tier( Config.MinTier ), m_CurTier( Config.MinTier ), m_FrameSwitches( 0 ),
+	m_FrameDescriptors( 0 ), m_QuietFrames( 0 ), m_QuietPeak( 0 )
+{
+	ASSERT( Config.MinTier <= Config.MaxTier && Config.MaxTier < kNumDescriptorHeapTiers );
+}
+
+uint32_t DescriptorHeapTierPolicy::GetTierFor( uint32_t NumDescriptors ) const
+{
+	uint32_t Tier = m_Config.MinTier;
+	while (Tier < m_Config.MaxTier && m_Config.TierSizes[Tier] < NumDescriptors)
+		Tier++;
+	return Tier;
+}
+
+void DescriptorHeapTierPolicy::OnHeapSwitch()
+{
+	m_FrameSwitches++;
+	if (m_Config.GrowWithinFrame && m_CurTier < m_Config.MaxTier)
+		m_CurTier++;
+}
+
+void DescriptorHeapTierPolicy::EndFrame()
+{
+	if (m_FrameSwitches)
+	{
+		uint32_t Tier = GetTierFor( m_FrameDescriptors );
+		if (Tier <= m_Tier)
+			Tier = m_Tier < m_Config.MaxTier ? m_Tier + 1 : m_Tier;
+		m_Tier = Tier;
+		m_QuietFrames = 0;
+		m_QuietPeak = 0;
+	}
+	else if (m_Tier > m_Config.MinTier)
+	{
+		m_QuietFrames++;
+		m_QuietPeak = m_FrameDescriptors > m_QuietPeak ? m_FrameDescriptors : m_QuietPeak;
+		if (m_QuietFrames >= m_Config.ShrinkFrames)
+		{
+			if (m_QuietPeak <= m_Config.TierSizes[m_Tier - 1] / 2)
+				m_Tier--;
+			m_QuietFrames = 0;
+			m_QuietPeak = 0;
+		}
+	}
+	m_CurTier = m_Tier;
+	m_FrameSwitches = 0;
+	m_FrameDescriptors = 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+// Picks the size of the next shader-visible heap a DynamicDescriptorHeap takes.
+
+#include <stdint.h>
+
+enum { kNumDescriptorHeapTiers = 3 };
+
+struct DescriptorHeapTierConfig
+{
+	uint32_t	TierSizes[kNumDescriptorHeapTiers];		// Descriptors, increasing
+	uint32_t	MinTier;
+	uint32_t	MaxTier;								// Same as MinTier for a fixed size
+	uint32_t	ShrinkFrames;		// Quiet command lists before stepping down a tier
+	bool		GrowWithinFrame;	// The heap taken after an overflow is already one tier up
+
+	DescriptorHeapTierConfig()
+		:TierSizes{ 1024, 16384, 65536 }, MinTier( 0 ), MaxTier( kNumDescriptorHeapTiers - 1 ),
+		ShrinkFrames( 120 ), GrowWithinFrame( true ) {}
+};
+
+//--------------------------------------------------------------------------------------
+// DescriptorHeapTierPolicy
+//--------------------------------------------------------------------------------------
+class DescriptorHeapTierPolicy
+{
+public:
+	explicit DescriptorHeapTierPolicy( const DescriptorHeapTierConfig& Config = DescriptorHeapTierConfig() );
+
+	const DescriptorHeapTierConfig& GetConfig() const { return m_Config; }
+	// Tier of the next heap to take
+	uint32_t GetHeapTier() const { return m_CurTier; }
+	uint32_t GetHeapSize() const { return m_Config.TierSizes[m_CurTier]; }
+
+	void OnAllocate( uint32_t Count ) { m_FrameDescriptors += Count; }
+	// The current heap was full, which means SetDescriptorHeaps() and copying every bound table again
+	void OnHeapSwitch();
+	// Heap switches of the current command list
+	uint32_t GetNumHeapSwitches() const { return m_FrameSwitches; }
+	// The command list was closed, its heaps retired. After an overflow the next one starts a tier
+	// up, or more to fit everything the command list allocated. After ShrinkFrames command lists in
+	// a row which all stayed below half of the next smaller tier it steps down one.
+	void EndFrame();
+
+private:
+	uint32_t GetTierFor( uint32_t NumDescriptors ) const;
+
+	DescriptorHeapTierConfig	m_Config;
+	uint32_t					m_Tier;				// Tier the next command list starts with
+	uint32_t					m_CurTier;
+	uint32_t					m_FrameSwitches;
+	uint32_t					m_FrameDescriptors;
+	uint32_t					m_QuietFrames;		// Command lists in a row without overflow
+	uint32_t					m_QuietPeak;		// Most descriptors used by one of them
+};
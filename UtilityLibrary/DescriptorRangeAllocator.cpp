@@ -0,0 +1,218 @@
+#include "PortableAssert.h"
+#include "DescriptorRangeAllocator.h"
+
+#include <iterator>
+
+//--------------------------------------------------------------------------------------
+// DescriptorRangeAllocator
+//--------------------------------------------------------------------------------------
+DescriptorRangeAllocator::DescriptorRangeAllocator()
+	:m_Capacity( 0 ), m_NumUsed( 0 ), m_NonEmptyClasses( 0 )
+{
+}
+
+void DescriptorRangeAllocator::Create( uint32_t Capacity )
+{
+	ASSERT( Capacity > 0 && Capacity < kInvalidOffset );
+	m_Capacity = Capacity;
+	Reset();
+}
+
+void DescriptorRangeAllocator::Reset()
+{
+	m_FreeRanges.clear();
+	for (uint32_t i = 0; i < kNumSizeClasses; ++i)
+		m_FreeLists[i].clear();
+	m_NonEmptyClasses = 0;
+	m_NumUsed = 0;
+	if (m_Capacity)
+		InsertFreeRange( 0, m_Capacity );
+}
+
+uint32_t DescriptorRangeAllocator::GetSizeClass( uint32_t Count )
+{
+	uint32_t SizeClass = 0;
+	while (Count > 1)
+	{
+		Count >>= 1;
+		SizeClass++;
+	}
+	return SizeClass;
+}
+
+void DescriptorRangeAllocator::InsertFreeRange( uint32_t Offset, uint32_t Count )
+{
+	uint32_t SizeClass = GetSizeClass( Count );
+	m_FreeRanges.insert( std::make_pair( Offset, Count ) );
+	m_FreeLists[SizeClass].insert( Offset );
+	m_NonEmptyClasses |= 1u << SizeClass;
+}
+
+void DescriptorRangeAllocator::EraseFreeRange( RangeMap::iterator It )
+{
+	uint32_t SizeClass = GetSizeClass( It->second );
+	m_FreeLists[SizeClass].erase( It->first );
+	if (m_FreeLists[SizeClass].empty())
+		m_NonEmptyClasses &= ~(1u << SizeClass);
+	m_FreeRanges.erase( It );
+}
+
+uint32_t DescriptorRangeAllocator::Allocate( uint32_t Count )
+{
+	ASSERT( Count > 0 );
+	if (Count > m_Capacity - m_NumUsed)
+		return kInvalidOffset;
+
+	uint32_t SizeClass = GetSizeClass( Count );
+	RangeMap::iterator Found = m_FreeRanges.end();
+	// Ranges of the request's own class may still be too short, unless it's a power of two
+	for (uint32_t Offset : m_FreeLists[SizeClass])
+	{
+		RangeMap::iterator It = m_FreeRanges.find( Offset );
+		if (It->second >= Count)
+		{
+			Found = It;
+			break;
+		}
+	}
+	if (Found == m_FreeRanges.end())
+	{
+		uint32_t LargerClasses = SizeClass + 1 < kNumSizeClasses ? m_NonEmptyClasses & ~((2u << SizeClass) - 1) : 0;
+		if (LargerClasses == 0)
+			return kInvalidOffset;
+		uint32_t LargerClass = GetSizeClass( LargerClasses & (0u - LargerClasses) );
+		Found = m_FreeRanges.find( *m_FreeLists[LargerClass].begin() );
+	}
+
+	uint32_t Offset = Found->first;
+	uint32_t Remaining = Found->second - Count;
+	EraseFreeRange( Found );
+	if (Remaining)
+		InsertFreeRange( Offset + Count, Remaining );
+	m_NumUsed += Count;
+	return Offset;
+}
+
+void DescriptorRangeAllocator::Free( uint32_t Offset, uint32_t Count )
+{
+	ASSERT( Count > 0 && Offset + Count <= m_Capacity && Count <= m_NumUsed );
+	uint32_t Begin = Offset;
+	uint32_t End = Offset + Count;
+
+	RangeMap::iterator Next = m_FreeRanges.lower_bound( Offset );
+	ASSERT( Next == m_FreeRanges.end() || Next->first >= End );
+	if (Next != m_FreeRanges.end() && Next->first == End)
+	{
+		End += Next->second;
+		RangeMap::iterator Erase = Next++;
+		EraseFreeRange( Erase );
+	}
+	if (Next != m_FreeRanges.begin())
+	{
+		RangeMap::iterator Prev = std::prev( Next );
+		ASSERT( Prev->first + Prev->second <= Begin );
+		if (Prev->first + Prev->second == Begin)
+		{
+			Begin = Prev->first;
+			EraseFreeRange( Prev );
+		}
+	}
+	InsertFreeRange( Begin, End - Begin );
+	m_NumUsed -= Count;
+}
+
+DescriptorRangeStats DescriptorRangeAllocator::GetStats() const
+{
+	DescriptorRangeStats Stats = {};
+	Stats.Capacity = m_Capacity;
+	Stats.NumUsed = m_NumUsed;
+	Stats.NumFreeRanges = (uint32_t)m_FreeRanges.size();
+	if (m_NonEmptyClasses)
+	{
+		uint32_t LargestClass = GetSizeClass( m_NonEmptyClasses );
+		for (uint32_t Offset : m_FreeLists[LargestClass])
+		{
+			uint32_t Count = m_FreeRanges.find( Offset )->second;
+			if (Count > Stats.LargestFreeRange)
+				Stats.LargestFreeRange = Count;
+		}
+	}
+	return Stats;
+}
+
+//--------------------------------------------------------------------------------------
+// DescriptorRangeChain
+//--------------------------------------------------------------------------------------
+DescriptorRangeChain::DescriptorRangeChain()
+	:m_HeapCapacity( 0 ), m_Increment( 0 ), m_NumUsed( 0 )
+{
+}
+
+void DescriptorRangeChain::Create( uint32_t HeapCapacity, uint32_t Increment, const HeapCreator& CreateHeap )
+{
+	ASSERT( HeapCapacity > 0 && Increment > 0 && m_Heaps.empty() );
+	m_HeapCapacity = HeapCapacity;
+	m_Increment = Increment;
+	m_CreateHeap = CreateHeap;
+	AddHeap();
+}
+
+void DescriptorRangeChain::Reset()
+{
+	for (Heap& H : m_Heaps)
+		H.Allocator.Reset();
+	m_NumUsed = 0;
+}
+
+uint32_t DescriptorRangeChain::AddHeap()
+{
+	const uint32_t Index = (uint32_t)m_Heaps.size();
+	m_Heaps.push_back( Heap() );
+	m_Heaps.back().Base = m_CreateHeap( Index );
+	m_Heaps.back().Allocator.Create( m_HeapCapacity );
+	return Index;
+}
+
+uint64_t DescriptorRangeChain::Allocate( uint32_t Count, uint32_t* pHeap )
+{
+	ASSERT( Count > 0 && Count <= m_HeapCapacity );
+	uint32_t Index = 0;
+	uint32_t Offset = DescriptorRangeAllocator::kInvalidOffset;
+	for (; Index < m_Heaps.size(); ++Index)
+	{
+		Offset = m_Heaps[Index].Allocator.Allocate( Count );
+		if (Offset != DescriptorRangeAllocator::kInvalidOffset)
+			break;
+	}
+	if (Offset == DescriptorRangeAllocator::kInvalidOffset)
+	{
+		Index = AddHeap();
+		Offset = m_Heaps[Index].Allocator.Allocate( Count );
+	}
+	m_NumUsed += Count;
+	if (pHeap)
+		*pHeap = Index;
+	return m_Heaps[Index].Base + (uint64_t)Offset * m_Increment;
+}
+
+void DescriptorRangeChain::Free( uint64_t Handle, uint32_t Count )
+{
+	const int Index = FindHeap( Handle );
+	ASSERT( Index >= 0 );
+	if (Index < 0)
+		return;
+	const uint64_t Delta = Handle - m_Heaps[Index].Base;
+	ASSERT( Delta % m_Increment == 0 );
+	m_Heaps[Index].Allocator.Free( (uint32_t)(Delta / m_Increment), Count );
+	m_NumUsed -= Count;
+}
+
+int DescriptorRangeChain::FindHeap( uint64_t Handle ) const
+{
+	for (size_t i = 0; i < m_Heaps.size(); ++i)
+	{
+		if (Handle >= m_Heaps[i].Base && Handle < m_Heaps[i].Base + (uint64_t)m_HeapCapacity * m_Increment)
+			return (int)i;
+	}
+	return -1;
+}
@@ -0,0 +1,107 @@
+#pragma once
+// Free-list allocator of contiguous descriptor ranges within one heap of Capacity descriptors.
+// It only deals in offsets; DescriptorRangeChain turns them into handles and chains another heap when
+// a request doesn't fit anywhere.
+// Free ranges are kept twice: by offset, so a freed range merges with its neighbours right away,
+// and in segregated lists by size class, floor(log2(count)). A request first looks at the lowest
+// offsets of its own class, any range of a higher class is big enough, so the search is bounded
+// by the number of free ranges of a single class. Allocations are cut from the front of a range.
+// No locking of its own. DescriptorHeap serializes every call on its chain under mCS, the callback
+// creating another heap included, so callers on any thread go through DescriptorHeap.
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+
+struct DescriptorRangeStats
+{
+	uint32_t	Capacity;
+	uint32_t	NumUsed;
+	uint32_t	NumFreeRanges;
+	uint32_t	LargestFreeRange;
+};
+
+//--------------------------------------------------------------------------------------
+// DescriptorRangeAllocator
+//--------------------------------------------------------------------------------------
+class DescriptorRangeAllocator
+{
+public:
+	enum { kInvalidOffset = 0xffffffff, kNumSizeClasses = 32 };
+
+	DescriptorRangeAllocator();
+	void Create( uint32_t Capacity );
+	// Frees everything
+	void Reset();
+
+	// Returns kInvalidOffset when no free range of Count descriptors is left
+	uint32_t Allocate( uint32_t Count );
+	void Free( uint32_t Offset, uint32_t Count );
+
+	uint32_t GetCapacity() const { return m_Capacity; }
+	uint32_t GetNumUsed() const { return m_NumUsed; }
+	bool IsEmpty() const { return m_NumUsed == 0; }
+	DescriptorRangeStats GetStats() const;
+
+private:
+	typedef std::map<uint32_t, uint32_t> RangeMap;		// Offset to count
+
+	static uint32_t GetSizeClass( uint32_t Count );
+	void InsertFreeRange( uint32_t Offset, uint32_t Count );
+	void EraseFreeRange( RangeMap::iterator It );
+
+	uint32_t				m_Capacity;
+	uint32_t				m_NumUsed;
+	uint32_t				m_NonEmptyClasses;				// Bit per size class with free ranges
+	RangeMap				m_FreeRanges;
+	std::set<uint32_t>		m_FreeLists[kNumSizeClasses];	// Offsets of the free ranges of a class
+};
+
+//--------------------------------------------------------------------------------------
+// DescriptorRangeChain
+// Heaps of HeapCapacity descriptors, another one chained whenever a range doesn't fit in any of them.
+// Handles are Increment apart from the base of their heap. CreateHeap gives the base of each new
+// heap: DescriptorHeap creates an ID3D12DescriptorHeap for it, tests make one up. A range never
+// straddles two heaps. Not thread safe.
+//--------------------------------------------------------------------------------------
+class DescriptorRangeChain
+{
+public:
+	typedef std::function<uint64_t( uint32_t Heap )> HeapCreator;
+
+	DescriptorRangeChain();
+	// Chains the first heap
+	void Create( uint32_t HeapCapacity, uint32_t Increment, const HeapCreator& CreateHeap );
+	// Frees everything, the heaps stay
+	void Reset();
+
+	// Handle of the first of Count descriptors, taken from the first heap with room. pHeap is set to
+	// the index of that heap.
+	uint64_t Allocate( uint32_t Count, uint32_t* pHeap = nullptr );
+	// Takes the first handle of a range, with the count it was allocated with
+	void Free( uint64_t Handle, uint32_t Count );
+
+	// Index of the heap Handle is in, -1 if none
+	int FindHeap( uint64_t Handle ) const;
+	uint32_t GetNumHeaps() const { return (uint32_t)m_Heaps.size(); }
+	uint64_t GetHeapBase( uint32_t Heap ) const { return m_Heaps[Heap].Base; }
+	uint32_t GetNumUsed() const { return m_NumUsed; }
+	DescriptorRangeStats GetHeapStats( uint32_t Heap ) const { return m_Heaps[Heap].Allocator.GetStats(); }
+
+private:
+	struct Heap
+	{
+		uint64_t					Base;
+		DescriptorRangeAllocator	Allocator;
+	};
+
+	uint32_t AddHeap();
+
+	uint32_t			m_HeapCapacity;
+	uint32_t			m_Increment;
+	uint32_t			m_NumUsed;
+	HeapCreator			m_CreateHeap;
+	std::vector<Heap>	m_Heaps;
+};
@@ -0,0 +1,74 @@
+#include "PortableAssert.h"
+#include "DescriptorTableLRU.h"
+
+#include <string.h>
+
+//--------------------------------------------------------------------------------------
+// DescriptorTableLRU
+//--------------------------------------------------------------------------------------
+DescriptorTableLRU::DescriptorTableLRU()
+{
+	Clear();
+}
+
+void DescriptorTableLRU::Clear()
+{
+	for (uint32_t i = 0; i < kNumEntries; ++i)
+	{
+		m_Entries[i].LastUse = 0;
+		m_Entries[i].Handles.clear();
+	}
+	m_UseCounter = 0;
+	m_NumHits = 0;
+	m_NumMisses = 0;
+}
+
+uint64_t DescriptorTableLRU::HashTable( const uint64_t* Handles, uint32_t Count )
+{
+	uint64_t Hash = 0xcbf29ce484222325ull ^ Count;
+	for (uint32_t i = 0; i < Count; ++i)
+	{
+		Hash = (Hash ^ Handles[i]) * 0x9e3779b97f4a7c15ull;
+		Hash ^= Hash >> 29;
+	}
+	return Hash;
+}
+
+bool DescriptorTableLRU::Find( uint64_t Hash, uint64_t HeapGeneration, const uint64_t* Handles, uint32_t Count, uint64_t& GpuHandle )
+{
+	for (uint32_t i = 0; i < kNumEntries; ++i)
+	{
+		Entry& Cached = m_Entries[i];
+		if (Cached.LastUse == 0 || Cached.Hash != Hash || Cached.HeapGeneration != HeapGeneration ||
+			Cached.Handles.size() != Count || memcmp( Cached.Handles.data(), Handles, Count * sizeof( uint64_t ) ) != 0)
+			continue;
+		Cached.LastUse = ++m_UseCounter;
+		GpuHandle = Cached.GpuHandle;
+		m_NumHits++;
+		return true;
+	}
+	m_NumMisses++;
+	return false;
+}
+
+void DescriptorTableLRU::Insert( uint64_t Hash, uint64_t HeapGeneration, const uint64_t* Handles, uint32_t Count, uint64_t GpuHandle )
+{
+	ASSERT( Count > 0 );
+	Entry* pVictim = &m_Entries[0];
+	for (uint32_t i = 0; i < kNumEntries; ++i)
+	{
+		Entry& Cached = m_Entries[i];
+		if (Cached.LastUse == 0 || Cached.HeapGeneration != HeapGeneration)
+		{
+			pVictim = &Cached;
+			break;
+		}
+		if (Cached.LastUse < pVictim->LastUse)
+			pVictim = &Cached;
+	}
+	pVictim->Hash = Hash;
+	pVictim->HeapGeneration = HeapGeneration;
+	pVictim->GpuHandle = GpuHandle;
+	pVictim->LastUse = ++m_UseCounter;
+	pVictim->Handles.assign( Handles, Handles + Count );
+}
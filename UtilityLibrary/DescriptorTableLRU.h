@@ -0,0 +1,50 @@
+#pragma once
+// Small LRU of descriptor tables a DynamicDescriptorHeap already copied into its current
+// shader-visible heap. A stale table staged with the same CPU handles as a cached one is bound at
+// the cached GPU handle instead of being copied again, which is what GuiRenderer's per draw
+// SetDynamicDescriptors() mostly does.
+// Entries are keyed by a hash of the table's handles and by the heap generation, which the owner
+// bumps whenever it moves to another heap, so a retired heap is never pointed at. The handles are
+// compared as well, a hash collision only costs a copy.
+// Handles are plain uint64_t with 0 for slots the table leaves unassigned.
+// Each DynamicDescriptorHeap owns one, so it is only touched by the thread recording that heap's
+// CommandContext and takes no lock.
+
+#include <stdint.h>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// DescriptorTableLRU
+//--------------------------------------------------------------------------------------
+class DescriptorTableLRU
+{
+public:
+	enum { kNumEntries = 32 };
+
+	DescriptorTableLRU();
+	void Clear();
+
+	static uint64_t HashTable( const uint64_t* Handles, uint32_t Count );
+	bool Find( uint64_t Hash, uint64_t HeapGeneration, const uint64_t* Handles, uint32_t Count, uint64_t& GpuHandle );
+	// Replaces the least recently used entry, or one of an older heap
+	void Insert( uint64_t Hash, uint64_t HeapGeneration, const uint64_t* Handles, uint32_t Count, uint64_t GpuHandle );
+
+	uint64_t GetNumHits() const { return m_NumHits; }
+	uint64_t GetNumMisses() const { return m_NumMisses; }
+	void ResetCounters() { m_NumHits = m_NumMisses = 0; }
+
+private:
+	struct Entry
+	{
+		uint64_t				Hash;
+		uint64_t				HeapGeneration;
+		uint64_t				GpuHandle;
+		uint64_t				LastUse;			// 0 for an empty entry
+		std::vector<uint64_t>	Handles;
+	};
+
+	Entry		m_Entries[kNumEntries];
+	uint64_t	m_UseCounter;
+	uint64_t	m_NumHits;
+	uint64_t	m_NumMisses;
+};
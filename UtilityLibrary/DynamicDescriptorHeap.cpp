@@ -5,6 +5,7 @@
 #include "RootSignature.h"
 #include "Utility.h"
 #include "DynamicDescriptorHeap.h"
+#include "AllocationTrace.h"
 #include <intrin.h>
 
 #pragma intrinsic(_BitScanReverse)
@@ -12,16 +13,30 @@
 #pragma intrinsic(_BitScanForward64)
 
 CRITICAL_SECTION DynamicDescriptorHeap::sm_CS;
-std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> DynamicDescriptorHeap::sm_DescriptorHeapPool;
-std::queue<std::pair<uint64_t, ID3D12DescriptorHeap*>> DynamicDescriptorHeap::sm_RetiredDescriptorHeaps;
-std::queue<ID3D12DescriptorHeap*> DynamicDescriptorHeap::sm_AvailableDescriptorHeaps;
+std::vector<GpuDescriptorHeap> DynamicDescriptorHeap::sm_DescriptorHeapPool;
+FenceRecycler<ID3D12DescriptorHeap> DynamicDescriptorHeap::sm_DescriptorHeapRecycler[kNumDescriptorHeapTiers];
 uint32_t DynamicDescriptorHeap::sm_DescriptorSize = 0;
+const uint32_t DynamicDescriptorHeap::kDescriptorHeapTierSizes[kNumDescriptorHeapTiers] = { 1024, 16384, 65536 };
+const uint32_t DynamicDescriptorHeap::kSharedBlockTierSizes[kNumDescriptorHeapTiers] = { 256, 1024, 4096 };
+ID3D12DescriptorHeap* DynamicDescriptorHeap::sm_pSharedHeap = nullptr;
+DynamicDescriptorHeap::QueueFenceOracle DynamicDescriptorHeap::sm_FenceOracle;
+DescriptorBlockRing DynamicDescriptorHeap::sm_SharedRing;
+std::atomic<bool> DynamicDescriptorHeap::sm_UseSharedHeap( true );
+
+bool DynamicDescriptorHeap::QueueFenceOracle::IsFenceComplete( uint64_t FenceValue )
+{
+	return Graphics::g_cmdListMngr.IsFenceComplete( FenceValue );
+}
 
 DynamicDescriptorHeap::DynamicDescriptorHeap( CommandContext& OwningContext )
-	:m_OwningContext( OwningContext )
+	:m_OwningContext( OwningContext ), m_TierPolicy( GetTierConfig( kDescriptorHeapTierSizes ) ),
+	m_BlockPolicy( GetTierConfig( kSharedBlockTierSizes ) )
 {
 	m_CurrentHeapPtr = nullptr;
+	m_CurrentHeapTier = 0;
 	m_CurrentOffset = 0;
+	m_CurrentHeapEnd = 0;
+	m_HeapGeneration = 0;
 }
 
 DynamicDescriptorHeap::~DynamicDescriptorHeap()
@@ -41,20 +56,56 @@ void DynamicDescriptorHeap::Shutdown()
 
 void DynamicDescriptorHeap::DestroyAll()
 {
+	for (uint32_t Tier = 0; Tier < kNumDescriptorHeapTiers; ++Tier)
+		sm_DescriptorHeapRecycler[Tier].Clear();
+	for (auto& Heap : sm_DescriptorHeapPool)
+		Graphics::g_cmdListMngr.GetDeviceBackend().DestroyDescriptorHeap( Heap );
 	sm_DescriptorHeapPool.clear();
+	if (sm_pSharedHeap != nullptr)
+	{
+		sm_SharedRing.Destroy();
+		sm_pSharedHeap = nullptr;
+	}
+}
+
+void DynamicDescriptorHeap::CreateSharedHeap()
+{
+	ASSERT( sm_pSharedHeap == nullptr );
+	GpuDescriptorHeap Heap = Graphics::g_cmdListMngr.GetDeviceBackend().CreateDescriptorHeap(
+		D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, kNumSharedDescriptors, true );
+	sm_DescriptorHeapPool.push_back( Heap );
+	sm_pSharedHeap = (ID3D12DescriptorHeap*)Heap.pNative;
+	sm_pSharedHeap->SetName( L"Shared Dynamic Descriptor Heap" );
+	sm_SharedRing.Create( kNumSharedDescriptors, &sm_FenceOracle );
+}
+
+DescriptorHeapTierConfig DynamicDescriptorHeap::GetTierConfig( const uint32_t TierSizes[kNumDescriptorHeapTiers] )
+{
+	DescriptorHeapTierConfig Config;
+	for (uint32_t Tier = 0; Tier < kNumDescriptorHeapTiers; ++Tier)
+		Config.TierSizes[Tier] = TierSizes[Tier];
+	return Config;
 }
 
 uint32_t DynamicDescriptorHeap::GetDescriptorSize()
 {
 	if (sm_DescriptorSize == 0)
-		sm_DescriptorSize = Graphics::g_device->GetDescriptorHandleIncrementSize( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV );
+		sm_DescriptorSize = Graphics::g_cmdListMngr.GetDeviceBackend().GetDescriptorSize( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV );
 	return sm_DescriptorSize;
 }
 
 void DynamicDescriptorHeap::CleanupUsedHeaps( uint64_t FenceValue )
 {
+	if (AllocTraceRecorder::IsRecording())
+		AllocTraceRecorder::DescriptorCleanup( this, FenceValue );
 	RetireCurrentHeap();
 	RetireUsedHeaps( FenceValue );
+	Graphics::g_stats.descriptorHeapSwitches += m_TierPolicy.GetNumHeapSwitches();
+	m_TierPolicy.EndFrame();
+	m_BlockPolicy.EndFrame();
+	Graphics::g_stats.descriptorTableHits += (uint32_t)m_TableLRU.GetNumHits();
+	Graphics::g_stats.descriptorTableMisses += (uint32_t)m_TableLRU.GetNumMisses();
+	m_TableLRU.ResetCounters();
 	m_GraphicsHandleCache.ClearCache();
 	m_ComputeHandleCache.ClearCache();
 }
@@ -72,13 +123,9 @@ void DynamicDescriptorHeap::SetComputeDescriptorHandles( UINT RootIndex, UINT Of
 D3D12_GPU_DESCRIPTOR_HANDLE DynamicDescriptorHeap::UploadDirect( D3D12_CPU_DESCRIPTOR_HANDLE Handles )
 {
 	if (!HasSpace( 1 ))
-	{
-		RetireCurrentHeap();
-		UnbindAllValid();
-	}
+		SwitchHeap( 1 );
 	m_OwningContext.SetDescriptorHeap( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, GetHeapPointer() );
-	DescriptorHandle DestHandle = m_FirstDescriptor + m_CurrentOffset*GetDescriptorSize();
-	m_CurrentOffset += 1;
+	DescriptorHandle DestHandle = Allocate( 1 );
 	Graphics::g_device->CopyDescriptorsSimple( 1, DestHandle.GetCPUHandle(), Handles, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV );
 	return DestHandle.GetGPUHandle();
 }
@@ -124,8 +171,37 @@ uint32_t DynamicDescriptorHeap::DescriptorHandleCache::ComputeStagedSize()
 	return NeededSpace;
 }
 
-void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables( DescriptorHandle DestHandleStart, ID3D12GraphicsCommandList* CmdList,
-	void(STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE) )
+uint32_t DynamicDescriptorHeap::DescriptorHandleCache::GetTableContents( uint32_t RootIndex, uint64_t Handles[] )
+{
+	DescriptorTableCache& RootDescTable = m_RootDescriptorTable[RootIndex];
+	unsigned long MaxSetHandle = 0;
+	_BitScanReverse( &MaxSetHandle, RootDescTable.AssignedHandlesBitMap );
+	for (uint32_t i = 0; i <= MaxSetHandle; ++i)
+		Handles[i] = (RootDescTable.AssignedHandlesBitMap & (1 << i)) ? RootDescTable.TableStart[i].ptr : 0;
+	return MaxSetHandle + 1;
+}
+
+void DynamicDescriptorHeap::DescriptorHandleCache::BindCachedTables( IGpuCommandList* CmdList, bool Compute,
+	DescriptorTableLRU& TableLRU, uint64_t HeapGeneration )
+{
+	uint64_t Handles[32];
+	uint32_t RootIndex;
+	uint32_t StaleParams = m_StaleRootParamsBitMap;
+	while (_BitScanForward( (unsigned long*)&RootIndex, StaleParams ))
+	{
+		StaleParams ^= (1 << RootIndex);
+		uint32_t Count = GetTableContents( RootIndex, Handles );
+		D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+		if (TableLRU.Find( DescriptorTableLRU::HashTable( Handles, Count ), HeapGeneration, Handles, Count, GpuHandle.ptr ))
+		{
+			CmdList->SetRootDescriptorTable( Compute, RootIndex, GpuHandle.ptr );
+			m_StaleRootParamsBitMap ^= (1 << RootIndex);
+		}
+	}
+}
+
+void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables( DescriptorHandle DestHandleStart, IGpuCommandList* CmdList, bool Compute,
+	DescriptorTableLRU& TableLRU, uint64_t HeapGeneration )
 {
 	uint32_t StaleParamCount = 0;
 	uint32_t TableSize[DescriptorHandleCache::kMaxNumDescriptorTables];
@@ -159,7 +235,11 @@ void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables( Descr
 	for (uint32_t i = 0; i < StaleParamCount; ++i)
 	{
 		RootIndex = RootIndices[i];
-		(CmdList->*SetFunc)(RootIndex, DestHandleStart.GetGPUHandle());
+		CmdList->SetRootDescriptorTable( Compute, RootIndex, DestHandleStart.GetGPUHandle().ptr );
+		uint64_t TableHandles[32];
+		uint32_t TableCount = GetTableContents( RootIndex, TableHandles );
+		TableLRU.Insert( DescriptorTableLRU::HashTable( TableHandles, TableCount ), HeapGeneration, TableHandles, TableCount,
+			DestHandleStart.GetGPUHandle().ptr );
 		DescriptorTableCache& RootDescTable = m_RootDescriptorTable[RootIndex];
 		D3D12_CPU_DESCRIPTOR_HANDLE* SrcHandles = RootDescTable.TableStart;
 		uint64_t SetHandles = (uint64_t)RootDescTable.AssignedHandlesBitMap;
@@ -263,87 +343,145 @@ void DynamicDescriptorHeap::DescriptorHandleCache::ParseRootSignature( const Roo
 	ASSERT( m_MaxCachedDescriptors <= kMaxNumDescriptors );
 }
 
-ID3D12DescriptorHeap* DynamicDescriptorHeap::RequestDescriptorHeap()
+ID3D12DescriptorHeap* DynamicDescriptorHeap::RequestDescriptorHeap( uint32_t Tier )
 {
+	ASSERT( Tier < kNumDescriptorHeapTiers );
+	ID3D12DescriptorHeap* pHeap = sm_DescriptorHeapRecycler[Tier].Acquire(
+		[]( uint64_t FenceValue ) { return Graphics::g_cmdListMngr.IsFenceComplete( FenceValue ); } );
+	if (pHeap != nullptr)
+		return pHeap;
+
+	GpuDescriptorHeap Heap = Graphics::g_cmdListMngr.GetDeviceBackend().CreateDescriptorHeap(
+		D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, kDescriptorHeapTierSizes[Tier], true );
 	CriticalSectionScope LockGard( &sm_CS );
-	while (!sm_RetiredDescriptorHeaps.empty() && Graphics::g_cmdListMngr.IsFenceComplete( sm_RetiredDescriptorHeaps.front().first ))
-	{
-		sm_AvailableDescriptorHeaps.push( sm_RetiredDescriptorHeaps.front().second );
-		sm_RetiredDescriptorHeaps.pop();
-	}
-	if (!sm_AvailableDescriptorHeaps.empty())
-	{
-		ID3D12DescriptorHeap* HeapPtr = sm_AvailableDescriptorHeaps.front();
-		sm_AvailableDescriptorHeaps.pop();
-		return HeapPtr;
-	}
-	else
+	sm_DescriptorHeapPool.push_back( Heap );
+	Graphics::g_stats.descriptorHeapsCreated[Tier]++;
+	return (ID3D12DescriptorHeap*)Heap.pNative;
+}
+
+uint32_t DynamicDescriptorHeap::ReclaimRetired()
+{
+	auto IsFenceComplete = []( uint64_t FenceValue ) { return Graphics::g_cmdListMngr.IsFenceComplete( FenceValue ); };
+	uint32_t Count = 0;
+	for (uint32_t Tier = 0; Tier < kNumDescriptorHeapTiers; ++Tier)
 	{
-		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
-		HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-		HeapDesc.NumDescriptors = kNumDescriptorsPerHeap;
-		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-		HeapDesc.NodeMask = 1;
-		Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> HeapPtr;
-		HRESULT hr;
-		V( Graphics::g_device->CreateDescriptorHeap( &HeapDesc, IID_PPV_ARGS( &HeapPtr ) ) );
-		sm_DescriptorHeapPool.emplace_back( HeapPtr );
-		return HeapPtr.Get();
+		uint32_t Moved;
+		do
+		{
+			Moved = sm_DescriptorHeapRecycler[Tier].Reclaim( IsFenceComplete );
+			Count += Moved;
+		} while (Moved == FenceRecycler<ID3D12DescriptorHeap>::kReclaimBatch);
 	}
+	if (sm_SharedRing.IsCreated())
+		sm_SharedRing.Reclaim();
+	return Count;
 }
 
-void DynamicDescriptorHeap::DiscardDescriptorHeaps( uint64_t FenceValueForReset, const std::vector<ID3D12DescriptorHeap*>& UsedHeaps )
+void DynamicDescriptorHeap::DiscardDescriptorHeaps( uint64_t FenceValueForReset, uint32_t Tier, const std::vector<ID3D12DescriptorHeap*>& UsedHeaps )
 {
-	CriticalSectionScope LockGard( &sm_CS );
-	for (auto iter = UsedHeaps.begin(); iter != UsedHeaps.end(); ++iter)
-		sm_RetiredDescriptorHeaps.push( std::make_pair( FenceValueForReset, *iter ) );
+	sm_DescriptorHeapRecycler[Tier].Retire( FenceValueForReset, UsedHeaps.data(), UsedHeaps.size() );
 }
 
 bool DynamicDescriptorHeap::HasSpace( uint32_t Count )
 {
-	return (m_CurrentHeapPtr != nullptr && m_CurrentOffset + Count <= kNumDescriptorsPerHeap);
+	return (m_CurrentHeapPtr != nullptr && m_CurrentOffset + Count <= m_CurrentHeapEnd);
+}
+
+void DynamicDescriptorHeap::SwitchHeap( uint32_t Count )
+{
+	// Once in the shared heap a context stays there until its next cleanup, unless the ring is full
+	bool InSharedHeap = m_CurrentHeapPtr != nullptr && m_CurrentHeapPtr == sm_pSharedHeap;
+	bool TryShared = InSharedHeap || (m_CurrentHeapPtr == nullptr && sm_pSharedHeap != nullptr && sm_UseSharedHeap);
+	if (TryShared && ReserveSharedBlock( Count ))
+		return;
+
+	if (m_CurrentHeapPtr != nullptr)
+		m_TierPolicy.OnHeapSwitch();
+	RetireCurrentHeap();
+	UnbindAllValid();
+}
+
+bool DynamicDescriptorHeap::ReserveSharedBlock( uint32_t Count )
+{
+	if (m_CurrentHeapPtr != nullptr)
+		m_BlockPolicy.OnHeapSwitch();
+	DescriptorBlock Block;
+	if (!sm_SharedRing.Reserve( max( Count, m_BlockPolicy.GetHeapSize() ), Block ))
+		return false;
+
+	if (m_CurrentHeapPtr == nullptr)
+	{
+		m_CurrentHeapPtr = sm_pSharedHeap;
+		m_HeapGeneration++;
+		m_FirstDescriptor = DescriptorHandle( sm_pSharedHeap->GetCPUDescriptorHandleForHeapStart(), sm_pSharedHeap->GetGPUDescriptorHandleForHeapStart() );
+	}
+	m_SharedBlocks.push_back( Block );
+	m_CurrentOffset = Block.Offset;
+	m_CurrentHeapEnd = Block.Offset + Block.Count;
+	return true;
 }
 
 void DynamicDescriptorHeap::RetireCurrentHeap()
 {
-	if (m_CurrentOffset == 0)
+	if (m_CurrentHeapPtr == nullptr)
 	{
-		ASSERT( m_CurrentHeapPtr == nullptr );
+		ASSERT( m_CurrentOffset == 0 );
 		return;
 	}
 
-	ASSERT( m_CurrentHeapPtr != nullptr );
-	m_RetiredHeaps.push_back( m_CurrentHeapPtr );
+	// Blocks of the shared heap are retired all at once in RetireUsedHeaps()
+	if (m_CurrentHeapPtr != sm_pSharedHeap)
+		m_RetiredHeaps[m_CurrentHeapTier].push_back( m_CurrentHeapPtr );
 	m_CurrentHeapPtr = nullptr;
 	m_CurrentOffset = 0;
+	m_CurrentHeapEnd = 0;
 }
 
 void DynamicDescriptorHeap::RetireUsedHeaps( uint64_t FenceValue )
 {
-	DiscardDescriptorHeaps( FenceValue, m_RetiredHeaps );
-	m_RetiredHeaps.clear();
+	if (!m_SharedBlocks.empty())
+	{
+		sm_SharedRing.Retire( m_SharedBlocks.data(), m_SharedBlocks.size(), FenceValue );
+		m_SharedBlocks.clear();
+	}
+	for (uint32_t Tier = 0; Tier < kNumDescriptorHeapTiers; ++Tier)
+	{
+		if (m_RetiredHeaps[Tier].empty())
+			continue;
+		DiscardDescriptorHeaps( FenceValue, Tier, m_RetiredHeaps[Tier] );
+		m_RetiredHeaps[Tier].clear();
+	}
 }
 
 DescriptorHandle DynamicDescriptorHeap::Allocate( UINT Count )
 {
+	if (AllocTraceRecorder::IsRecording())
+		AllocTraceRecorder::DescriptorAllocate( this, Count );
 	DescriptorHandle ret = m_FirstDescriptor + m_CurrentOffset * GetDescriptorSize();
 	m_CurrentOffset += Count;
+	m_TierPolicy.OnAllocate( Count );
+	m_BlockPolicy.OnAllocate( Count );
 	return ret;
 }
 
-void DynamicDescriptorHeap::CopyAndBindStagedTables( DescriptorHandleCache& HandleCache, ID3D12GraphicsCommandList* CmdList,
-	void(STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE) )
+void DynamicDescriptorHeap::CopyAndBindStagedTables( DescriptorHandleCache& HandleCache, IGpuCommandList* CmdList, bool Compute )
 {
-	uint32_t NeededSize = HandleCache.ComputeStagedSize();
-	if (!HasSpace( NeededSize ))
+	// Tables staged with the same handles as one already in the current heap are bound where they are
+	if (m_CurrentHeapPtr != nullptr)
 	{
-		RetireCurrentHeap();
-		UnbindAllValid();
+		m_OwningContext.SetDescriptorHeap( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_CurrentHeapPtr );
+		HandleCache.BindCachedTables( CmdList, Compute, m_TableLRU, m_HeapGeneration );
+		if (HandleCache.m_StaleRootParamsBitMap == 0)
+			return;
 	}
 
+	uint32_t NeededSize = HandleCache.ComputeStagedSize();
+	if (!HasSpace( NeededSize ))
+		SwitchHeap( NeededSize );
+
 	// This can trigger the creation of a new heap
 	m_OwningContext.SetDescriptorHeap( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, GetHeapPointer() );
-	HandleCache.CopyAndBindStaleTables( Allocate( NeededSize ), CmdList, SetFunc );
+	HandleCache.CopyAndBindStaleTables( Allocate( NeededSize ), CmdList, Compute, m_TableLRU, m_HeapGeneration );
 }
 
 void DynamicDescriptorHeap::UnbindAllValid()
@@ -1,7 +1,10 @@
 #pragma once
 #include <vector>
-#include <queue>
 #include "DescriptorHeap.h"
+#include "FenceRecycler.h"
+#include "DescriptorTableLRU.h"
+#include "DescriptorHeapTierPolicy.h"
+#include "DescriptorBlockRing.h"
 
 
 class DynamicDescriptorHeap
@@ -15,14 +18,24 @@ public:
 	static void DestroyAll();
 	static uint32_t GetDescriptorSize();
 
+	// One big shader-visible heap all contexts reserve blocks of, a context only takes a heap of its
+	// own when the shared one is full or disabled. Needs the device.
+	static void CreateSharedHeap();
+	static void SetUseSharedHeap( bool Enable ) { sm_UseSharedHeap = Enable; }
+	static bool GetUseSharedHeap() { return sm_UseSharedHeap; }
+	static DescriptorBlockRingStats GetSharedHeapStats() { return sm_SharedRing.GetStats(); }
+	// Heaps and shared blocks whose fence completed become ready before anyone requests them,
+	// returns how many heaps were moved
+	static uint32_t ReclaimRetired();
+
 	void CleanupUsedHeaps( uint64_t fenceValue );
 	void SetGraphicsDescriptorHandles( UINT RootIndex, UINT Offset, UINT NumHandles, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[] );
 	void SetComputeDescriptorHandles( UINT RootIndex, UINT Offset, UINT NumHandles, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[] );
 	D3D12_GPU_DESCRIPTOR_HANDLE UploadDirect( D3D12_CPU_DESCRIPTOR_HANDLE Handles );
 	void ParseGraphicsRootSignature( const RootSignature& RootSig );
 	void ParseComputeRootSignature( const RootSignature& RootSig );
-	void CommitGraphicsRootDescriptorTables( ID3D12GraphicsCommandList* CmdList );
-	void CommitComputeRootDescriptorTables( ID3D12GraphicsCommandList* CmdList );
+	void CommitGraphicsRootDescriptorTables( IGpuCommandList* CmdList );
+	void CommitComputeRootDescriptorTables( IGpuCommandList* CmdList );
 
 private:
 	struct DescriptorTableCache
@@ -38,8 +51,11 @@ private:
 		DescriptorHandleCache();
 		void ClearCache();
 		uint32_t ComputeStagedSize();
-		void CopyAndBindStaleTables( DescriptorHandle DestHandleStart, ID3D12GraphicsCommandList* CmdList,
-			void(STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE) );
+		void CopyAndBindStaleTables( DescriptorHandle DestHandleStart, IGpuCommandList* CmdList, bool Compute,
+			DescriptorTableLRU& TableLRU, uint64_t HeapGeneration );
+		void BindCachedTables( IGpuCommandList* CmdList, bool Compute,
+			DescriptorTableLRU& TableLRU, uint64_t HeapGeneration );
+		uint32_t GetTableContents( uint32_t RootIndex, uint64_t Handles[] );
 		void UnbindAllValid();
 		void StageDescriptorHandles( UINT RootIndex, UINT Offset, UINT NumHandles, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[] );
 		void ParseRootSignature( const RootSignature& RootSig );
@@ -55,44 +71,71 @@ private:
 		D3D12_CPU_DESCRIPTOR_HANDLE m_HandleCache[kMaxNumDescriptors];
 	};
 
-	static ID3D12DescriptorHeap* RequestDescriptorHeap();
-	static void DiscardDescriptorHeaps( uint64_t FenceValueForReset, const std::vector<ID3D12DescriptorHeap*>& UsedHeaps );
+	static ID3D12DescriptorHeap* RequestDescriptorHeap( uint32_t Tier );
+	static void DiscardDescriptorHeaps( uint64_t FenceValueForReset, uint32_t Tier, const std::vector<ID3D12DescriptorHeap*>& UsedHeaps );
 
 	bool HasSpace( uint32_t Count );
+	// The current heap or block can't take Count more. Another block of the shared heap leaves bound
+	// tables alone, taking another heap means staging every bound table again.
+	void SwitchHeap( uint32_t Count );
+	bool ReserveSharedBlock( uint32_t Count );
 	void RetireCurrentHeap();
 	void RetireUsedHeaps( uint64_t FenceValue );
 	ID3D12DescriptorHeap* GetHeapPointer();
 	DescriptorHandle Allocate( UINT Count );
-	void CopyAndBindStagedTables( DescriptorHandleCache& HandleCache, ID3D12GraphicsCommandList* CmdList,
-		void(STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE) );
+	void CopyAndBindStagedTables( DescriptorHandleCache& HandleCache, IGpuCommandList* CmdList, bool Compute );
 	void UnbindAllValid();
 
-	static const uint32_t kNumDescriptorsPerHeap = 1024;
+	// Shader-visible heap sizes, m_TierPolicy picks one per heap taken
+	static const uint32_t kDescriptorHeapTierSizes[kNumDescriptorHeapTiers];
+	static DescriptorHeapTierConfig GetTierConfig( const uint32_t TierSizes[kNumDescriptorHeapTiers] );
+	// Block sizes reserved from the shared heap, grown like the heap tiers
+	static const uint32_t kSharedBlockTierSizes[kNumDescriptorHeapTiers];
+	static const uint32_t kNumSharedDescriptors = 1 << 18;
+	// Only guards creating new heaps, recycling is lock-free
 	static CRITICAL_SECTION sm_CS;
-	static std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> sm_DescriptorHeapPool;
-	static std::queue<std::pair<uint64_t, ID3D12DescriptorHeap*>> sm_RetiredDescriptorHeaps;
-	static std::queue<ID3D12DescriptorHeap*> sm_AvailableDescriptorHeaps;
+	// Every heap created, the shared one included
+	static std::vector<GpuDescriptorHeap> sm_DescriptorHeapPool;
+	static FenceRecycler<ID3D12DescriptorHeap> sm_DescriptorHeapRecycler[kNumDescriptorHeapTiers];
 	static uint32_t sm_DescriptorSize;
 
+	class QueueFenceOracle : public IFenceOracle
+	{
+	public:
+		virtual bool IsFenceComplete( uint64_t FenceValue ) override;
+	};
+
+	static ID3D12DescriptorHeap* sm_pSharedHeap;
+	static QueueFenceOracle sm_FenceOracle;
+	static DescriptorBlockRing sm_SharedRing;
+	static std::atomic<bool> sm_UseSharedHeap;
+
 	DescriptorHandleCache m_GraphicsHandleCache;
 	DescriptorHandleCache m_ComputeHandleCache;
 	CommandContext& m_OwningContext;
 	ID3D12DescriptorHeap* m_CurrentHeapPtr;
+	uint32_t m_CurrentHeapTier;
 	uint32_t m_CurrentOffset;
+	uint32_t m_CurrentHeapEnd;					// End of the current block, or size of the current heap
+	DescriptorHeapTierPolicy m_TierPolicy;
+	DescriptorHeapTierPolicy m_BlockPolicy;
+	std::vector<DescriptorBlock> m_SharedBlocks;	// Reserved since the last cleanup
+	uint64_t m_HeapGeneration;					// Bumped for every heap taken, keys m_TableLRU
 	DescriptorHandle m_FirstDescriptor;
-	std::vector<ID3D12DescriptorHeap*> m_RetiredHeaps;
+	DescriptorTableLRU m_TableLRU;
+	std::vector<ID3D12DescriptorHeap*> m_RetiredHeaps[kNumDescriptorHeapTiers];
 };
 
-inline void DynamicDescriptorHeap::CommitGraphicsRootDescriptorTables( ID3D12GraphicsCommandList* CmdList )
+inline void DynamicDescriptorHeap::CommitGraphicsRootDescriptorTables( IGpuCommandList* CmdList )
 {
 	if (m_GraphicsHandleCache.m_StaleRootParamsBitMap != 0)
-		CopyAndBindStagedTables( m_GraphicsHandleCache, CmdList, &ID3D12GraphicsCommandList::SetGraphicsRootDescriptorTable );
+		CopyAndBindStagedTables( m_GraphicsHandleCache, CmdList, false );
 }
 
-inline void DynamicDescriptorHeap::CommitComputeRootDescriptorTables( ID3D12GraphicsCommandList* CmdList )
+inline void DynamicDescriptorHeap::CommitComputeRootDescriptorTables( IGpuCommandList* CmdList )
 {
 	if (m_ComputeHandleCache.m_StaleRootParamsBitMap != 0)
-		CopyAndBindStagedTables( m_ComputeHandleCache, CmdList, &ID3D12GraphicsCommandList::SetComputeRootDescriptorTable );
+		CopyAndBindStagedTables( m_ComputeHandleCache, CmdList, true );
 }
 
 inline ID3D12DescriptorHeap* DynamicDescriptorHeap::GetHeapPointer()
@@ -100,7 +143,10 @@ inline ID3D12DescriptorHeap* DynamicDescriptorHeap::GetHeapPointer()
 	if (m_CurrentHeapPtr == nullptr)
 	{
 		ASSERT( m_CurrentOffset == 0 );
-		m_CurrentHeapPtr = RequestDescriptorHeap();
+		m_CurrentHeapTier = m_TierPolicy.GetHeapTier();
+		m_CurrentHeapPtr = RequestDescriptorHeap( m_CurrentHeapTier );
+		m_CurrentHeapEnd = kDescriptorHeapTierSizes[m_CurrentHeapTier];
+		m_HeapGeneration++;
 		m_FirstDescriptor = DescriptorHandle( m_CurrentHeapPtr->GetCPUDescriptorHandleForHeapStart(), m_CurrentHeapPtr->GetGPUDescriptorHandleForHeapStart() );
 	}
 	return m_CurrentHeapPtr;
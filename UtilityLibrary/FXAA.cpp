@@ -7,6 +7,7 @@
 #include "PipelineState.h"
 #include "GPU_Profiler.h"
 #include "GpuResource.h"
+#include "FrameGraph.h"
 #include "imgui.h"
 #include "FXAA.h"
 
@@ -35,6 +36,12 @@ namespace FXAA
 	float ContrastThreeshold = 0.2f;
 	float SubpixelRemoval = 0.75f;
 	bool DebugDraw = false;
+
+	void SetRootSignature( ComputeContext& Context )
+	{
+		Context.SetRootSignature( RootSig );
+		Context.SetConstants( 0, 1.f / Graphics::g_SceneColorBuffer.GetWidth(), 1.f / Graphics::g_SceneColorBuffer.GetHeight(), ContrastThreeshold, SubpixelRemoval );
+	}
 }
 
 void FXAA::CreateResource()
@@ -124,84 +131,111 @@ void FXAA::Shutdown()
 	g_FXAAColorQueueV.Destroy();
 }
 
-void FXAA::Render( ComputeContext& Context )
+void FXAA::AddPasses( FrameGraph& Graph, uint32_t SceneColor )
 {
-	GPU_PROFILE( Context, L"FXAA" );
-	Context.SetRootSignature( RootSig );
-	Context.SetConstants( 0, 1.f / Graphics::g_SceneColorBuffer.GetWidth(), 1.f / Graphics::g_SceneColorBuffer.GetHeight(), ContrastThreeshold, SubpixelRemoval );
+	// All written before they are read every frame. The work queues and luma by FXAA Luma, the padding of
+	// the work queues and both dispatch arguments, group counts Y and Z included, by FXAA Resolve Work.
+	const uint32_t WorkQueueH = Graph.CreateTransient( "FXAA Work Queue H", g_FXAAWorkQueueH );
+	const uint32_t WorkQueueV = Graph.CreateTransient( "FXAA Work Queue V", g_FXAAWorkQueueV );
+	const uint32_t ColorQueueH = Graph.CreateTransient( "FXAA Color Queue H", g_FXAAColorQueueH );
+	const uint32_t ColorQueueV = Graph.CreateTransient( "FXAA Color Queue V", g_FXAAColorQueueV );
+	const uint32_t Luma = Graph.CreateTransient( "FXAA Luma", g_LumaBuffer );
+	const uint32_t Indirect = Graph.CreateTransient( "FXAA Indirect Parameters", IndirectParameters );
 
 	// Pass1
-	Context.ResetCounter( g_FXAAWorkQueueH );
-	Context.ResetCounter( g_FXAAWorkQueueV );
-
-	Context.TransitionResource( Graphics::g_SceneColorBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
-	Context.TransitionResource( g_FXAAWorkQueueH, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
-	Context.TransitionResource( g_FXAAWorkQueueV, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
-	Context.TransitionResource( g_FXAAColorQueueH, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
-	Context.TransitionResource( g_FXAAColorQueueV, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
-	Context.TransitionResource( g_LumaBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
-
-	D3D12_CPU_DESCRIPTOR_HANDLE Pass1UAVs[] =
+	Graph.AddPass( "FXAA Luma", 0, []( CommandContext& EngineContext )
 	{
-		g_FXAAWorkQueueH.GetUAV(),
-		g_FXAAColorQueueH.GetUAV(),
-		g_FXAAWorkQueueV.GetUAV(),
-		g_FXAAColorQueueV.GetUAV(),
-		g_LumaBuffer.GetUAV()
-	};
+		ComputeContext& Context = EngineContext.GetComputeContext();
+		GPU_PROFILE( Context, L"FXAA Luma" );
+		SetRootSignature( Context );
+		Context.ResetCounter( g_FXAAWorkQueueH );
+		Context.ResetCounter( g_FXAAWorkQueueV );
+
+		D3D12_CPU_DESCRIPTOR_HANDLE Pass1UAVs[] =
+		{
+			g_FXAAWorkQueueH.GetUAV(),
+			g_FXAAColorQueueH.GetUAV(),
+			g_FXAAWorkQueueV.GetUAV(),
+			g_FXAAColorQueueV.GetUAV(),
+			g_LumaBuffer.GetUAV()
+		};
+
+		Context.SetPipelineState( Pass1LdrCS );
+		Context.SetDynamicDescriptors( 1, 0, _countof( Pass1UAVs ), Pass1UAVs );
+		Context.SetDynamicDescriptors( 2, 0, 1, &Graphics::g_SceneColorBuffer.GetSRV() );
 
-	Context.SetPipelineState( Pass1LdrCS );
-	Context.SetDynamicDescriptors( 1, 0, _countof( Pass1UAVs ), Pass1UAVs );
-	Context.SetDynamicDescriptors( 2, 0, 1, &Graphics::g_SceneColorBuffer.GetSRV() );
+		Context.Dispatch2D( Graphics::g_SceneColorBuffer.GetWidth(), Graphics::g_SceneColorBuffer.GetHeight() );
+	} );
+	Graph.Read( SceneColor, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
+	Graph.Write( WorkQueueH, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+	Graph.Write( WorkQueueV, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+	Graph.Write( ColorQueueH, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+	Graph.Write( ColorQueueV, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+	Graph.Write( Luma, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
 
-	Context.Dispatch2D( Graphics::g_SceneColorBuffer.GetWidth(), Graphics::g_SceneColorBuffer.GetHeight() );
 	// Pass2
-	Context.SetPipelineState( ResolveWorkCS );
-	Context.TransitionResource( IndirectParameters, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
-	Context.SetDynamicDescriptors( 1, 0, 1, &IndirectParameters.GetUAV() );
-	Context.SetDynamicDescriptors( 1, 1, 1, &g_FXAAWorkQueueH.GetUAV() );
-	Context.SetDynamicDescriptors( 1, 2, 1, &g_FXAAWorkQueueV.GetUAV() );
-	Context.SetDynamicDescriptors( 2, 0, 1, &g_FXAAWorkQueueH.GetCounterSRV( Context ) );
-	Context.SetDynamicDescriptors( 2, 1, 1, &g_FXAAWorkQueueV.GetCounterSRV( Context ) );
-
-	Context.Dispatch( 1, 1, 1 );
-
-	Context.TransitionResource( Graphics::g_SceneColorBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
-	Context.TransitionResource( IndirectParameters, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT );
-	Context.TransitionResource( g_FXAAWorkQueueH, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
-	Context.TransitionResource( g_FXAAColorQueueH, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
-	Context.TransitionResource( g_FXAAWorkQueueV, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
-	Context.TransitionResource( g_FXAAColorQueueV, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
-
-	Context.SetDynamicDescriptors( 1, 0, 1, &Graphics::g_SceneColorBuffer.GetUAV() );
-
-	D3D12_CPU_DESCRIPTOR_HANDLE Pass2SRVs[] =
+	Graph.AddPass( "FXAA Resolve Work", 0, []( CommandContext& EngineContext )
 	{
-		g_LumaBuffer.GetSRV(),
-		Graphics::g_SceneColorBuffer.GetSRV(),
-		g_FXAAWorkQueueH.GetSRV(),
-		g_FXAAColorQueueH.GetSRV(),
-	};
-	Context.SetDynamicDescriptors( 2, 0, _countof( Pass2SRVs ), Pass2SRVs );
+		ComputeContext& Context = EngineContext.GetComputeContext();
+		GPU_PROFILE( Context, L"FXAA Resolve Work" );
+		SetRootSignature( Context );
+		Context.SetPipelineState( ResolveWorkCS );
+		Context.SetDynamicDescriptors( 1, 0, 1, &IndirectParameters.GetUAV() );
+		Context.SetDynamicDescriptors( 1, 1, 1, &g_FXAAWorkQueueH.GetUAV() );
+		Context.SetDynamicDescriptors( 1, 2, 1, &g_FXAAWorkQueueV.GetUAV() );
+		Context.SetDynamicDescriptors( 2, 0, 1, &g_FXAAWorkQueueH.GetCounterSRV( Context ) );
+		Context.SetDynamicDescriptors( 2, 1, 1, &g_FXAAWorkQueueV.GetCounterSRV( Context ) );
+
+		Context.Dispatch( 1, 1, 1 );
+	} );
+	Graph.Read( WorkQueueH, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+	Graph.Read( WorkQueueV, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+	Graph.Write( Indirect, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
 
-	if (DebugDraw)
-	{
-		Context.SetPipelineState( Color2LumaCS );
-		Context.Dispatch2D( Graphics::g_SceneColorBuffer.GetWidth(), Graphics::g_SceneColorBuffer.GetHeight() );
-	}
 	// The final phase involves processing pixels on the work queues and writing them
 	// back into the color buffer. Because the two source pixels required for linearly
 	// blending are held in the work queue, this does not require also sampling from
 	// the target color buffer (i.e. no read/modify/write, just write.)
-
-	Context.SetPipelineState( DebugDraw ? Pass2HDebugCS : Pass2HCS );
-	Context.DispatchIndirect( IndirectParameters, 0 );
-
-	Context.SetDynamicDescriptors( 2, 2, 1, &g_FXAAWorkQueueV.GetSRV() );
-	Context.SetDynamicDescriptors( 2, 3, 1, &g_FXAAColorQueueV.GetSRV() );
-
-	Context.SetPipelineState( DebugDraw ? Pass2VDebugCS : Pass2VCS );
-	Context.DispatchIndirect( IndirectParameters, 12 );
+	Graph.AddPass( "FXAA Apply", 0, []( CommandContext& EngineContext )
+	{
+		ComputeContext& Context = EngineContext.GetComputeContext();
+		GPU_PROFILE( Context, L"FXAA Apply" );
+		SetRootSignature( Context );
+		Context.SetDynamicDescriptors( 1, 0, 1, &Graphics::g_SceneColorBuffer.GetUAV() );
+
+		D3D12_CPU_DESCRIPTOR_HANDLE Pass2SRVs[] =
+		{
+			g_LumaBuffer.GetSRV(),
+			Graphics::g_SceneColorBuffer.GetSRV(),
+			g_FXAAWorkQueueH.GetSRV(),
+			g_FXAAColorQueueH.GetSRV(),
+		};
+		Context.SetDynamicDescriptors( 2, 0, _countof( Pass2SRVs ), Pass2SRVs );
+
+		if (DebugDraw)
+		{
+			Context.SetPipelineState( Color2LumaCS );
+			Context.Dispatch2D( Graphics::g_SceneColorBuffer.GetWidth(), Graphics::g_SceneColorBuffer.GetHeight() );
+		}
+
+		Context.SetPipelineState( DebugDraw ? Pass2HDebugCS : Pass2HCS );
+		Context.DispatchIndirect( IndirectParameters, 0 );
+
+		Context.SetDynamicDescriptors( 2, 2, 1, &g_FXAAWorkQueueV.GetSRV() );
+		Context.SetDynamicDescriptors( 2, 3, 1, &g_FXAAColorQueueV.GetSRV() );
+
+		Context.SetPipelineState( DebugDraw ? Pass2VDebugCS : Pass2VCS );
+		Context.DispatchIndirect( IndirectParameters, 12 );
+	} );
+	// Only the pixels on the work queues are written, the rest of the color buffer is kept
+	Graph.Read( SceneColor, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+	Graph.Write( SceneColor, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+	Graph.Read( Indirect, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT );
+	Graph.Read( WorkQueueH, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
+	Graph.Read( WorkQueueV, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
+	Graph.Read( ColorQueueH, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
+	Graph.Read( ColorQueueV, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
+	Graph.Read( Luma, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
 }
 
 void FXAA::UpdateGUI()
@@ -1,14 +1,15 @@
 #pragma once
 
 #include "FXAA_SharedHeader.inl"
-class ComputeContext;
 class ColorBuffer;
+class FrameGraph;
 namespace FXAA
 {
 	void CreateResource();
 	void Resize();
 	void Shutdown();
-	void Render( ComputeContext& Context );
+	// On SceneColor, a resource of Graph
+	void AddPasses( FrameGraph& Graph, uint32_t SceneColor );
 	void UpdateGUI();
 
 	extern float ContrastThreeshold;
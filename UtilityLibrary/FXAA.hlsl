@@ -148,8 +148,9 @@ void csmain( uint3 Gid : SV_GroupID, uint GI : SV_GroupIndex, uint3 GTid : SV_Gr
 
 	if (GI == 0)
 	{
-		IndirectParams.Store( 0, PaddedCountH >> 6 );
-		IndirectParams.Store( 12, PaddedCountV >> 6 );
+		// All six dwords, the buffer may be placed over other transients and start out as garbage
+		IndirectParams.Store3( 0, uint3( PaddedCountH >> 6, 1, 1 ) );
+		IndirectParams.Store3( 12, uint3( PaddedCountV >> 6, 1, 1 ) );
 	}
 }
 #endif // ResolveWork
@@ -0,0 +1,205 @@
+#include "PortableAssert.h"
+#include "FenceNotifier.h"
+#include "GpuQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+//--------------------------------------------------------------------------------------
+// FenceNotifier
+//--------------------------------------------------------------------------------------
+FenceNotifier::FenceNotifier()
+	:m_StopRequested( false ), m_Kicked( false ), m_NumPending( 0 ), m_PollIntervalUs( kMinPollUs ), m_NumPolls( 0 ),
+	m_NumCallbacks( 0 ), m_NumInline( 0 ), m_NumListenerCalls( 0 )
+{
+	for (uint32_t i = 0; i < kMaxQueues; ++i)
+	{
+		m_pQueues[i] = nullptr;
+		m_LastCompleted[i] = 0;
+	}
+}
+
+FenceNotifier::~FenceNotifier()
+{
+	Stop();
+}
+
+void FenceNotifier::AddListener( Listener Fn )
+{
+	ASSERT( !IsRunning() );
+	m_Listeners.push_back( std::move( Fn ) );
+}
+
+void FenceNotifier::Start( GpuQueue* const* ppQueues, uint32_t NumQueues )
+{
+	ASSERT( !IsRunning() );
+	for (uint32_t i = 0; i < NumQueues; ++i)
+	{
+		uint32_t Type = ppQueues[i]->GetType();
+		ASSERT( Type < kMaxQueues && m_pQueues[Type] == nullptr );
+		m_pQueues[Type] = ppQueues[i];
+		m_LastCompleted[Type] = ppQueues[i]->GetCompletedFence();
+	}
+	m_StopRequested = false;
+	m_Kicked = false;
+	m_PollIntervalUs = kMinPollUs;
+	m_Thread = std::thread( &FenceNotifier::ThreadMain, this );
+}
+
+void FenceNotifier::Stop()
+{
+	if (!IsRunning())
+		return;
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		m_StopRequested = true;
+	}
+	m_WakeUp.notify_one();
+	m_Thread.join();
+
+	std::vector<Callback> Due;
+	PollAndRun( Due );
+	std::multimap<uint64_t, Callback> Dropped[kMaxQueues];
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		for (uint32_t i = 0; i < kMaxQueues; ++i)
+		{
+			Dropped[i].swap( m_Pending[i] );
+			m_pQueues[i] = nullptr;
+		}
+		m_NumPending = 0;
+	}
+}
+
+void FenceNotifier::OnFenceComplete( uint64_t FenceValue, Callback Fn )
+{
+	const uint32_t Type = (uint32_t)(FenceValue >> 56) & (kMaxQueues - 1);
+	GpuQueue* pQueue = m_pQueues[Type];
+	ASSERT( pQueue != nullptr );
+	if (pQueue->IsFenceComplete( FenceValue ))
+	{
+		{
+			std::lock_guard<std::mutex> Lock( m_Mutex );
+			m_NumInline++;
+		}
+		Fn();
+		return;
+	}
+	bool WakeUp;
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		m_Pending[Type].emplace( FenceValue, std::move( Fn ) );
+		m_NumPending++;
+		// Only wake a thread which is sleeping longer than the fast rate
+		WakeUp = m_PollIntervalUs > kMinPollUs;
+		m_PollIntervalUs = kMinPollUs;
+		m_Kicked |= WakeUp;
+	}
+	if (WakeUp)
+		m_WakeUp.notify_one();
+}
+
+std::future<void> FenceNotifier::WhenComplete( uint64_t FenceValue )
+{
+	// std::function has to be copyable, a promise isn't
+	auto pPromise = std::make_shared<std::promise<void>>();
+	std::future<void> Future = pPromise->get_future();
+	OnFenceComplete( FenceValue, [pPromise]() { pPromise->set_value(); } );
+	return Future;
+}
+
+void FenceNotifier::Kick()
+{
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		m_PollIntervalUs = kMinPollUs;
+		m_Kicked = true;
+	}
+	m_WakeUp.notify_one();
+}
+
+FenceNotifierStats FenceNotifier::GetStats()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	FenceNotifierStats Stats;
+	Stats.NumPolls = m_NumPolls;
+	Stats.NumCallbacks = m_NumCallbacks;
+	Stats.NumInline = m_NumInline;
+	Stats.NumListenerCalls = m_NumListenerCalls;
+	Stats.NumPending = m_NumPending;
+	Stats.PollIntervalUs = m_PollIntervalUs;
+	return Stats;
+}
+
+void FenceNotifier::ResetStats()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_NumPolls = 0;
+	m_NumCallbacks = 0;
+	m_NumInline = 0;
+	m_NumListenerCalls = 0;
+}
+
+void FenceNotifier::ThreadMain()
+{
+	std::vector<Callback> Due;
+	std::unique_lock<std::mutex> Lock( m_Mutex );
+	while (!m_StopRequested)
+	{
+		m_Kicked = false;
+		Lock.unlock();
+		bool MovedOn = PollAndRun( Due );
+		Lock.lock();
+		// A registration meanwhile may have lowered the interval already
+		if (MovedOn)
+			m_PollIntervalUs = kMinPollUs;
+		else if (!m_Kicked)
+			m_PollIntervalUs = (std::min)( m_PollIntervalUs * 2, (uint32_t)(m_NumPending ? kMaxPendingPollUs : kMaxPollUs) );
+		m_WakeUp.wait_for( Lock, std::chrono::microseconds( m_PollIntervalUs ),
+			[this]() { return m_StopRequested || m_Kicked; } );
+	}
+}
+
+bool FenceNotifier::PollAndRun( std::vector<Callback>& Due )
+{
+	// The queues are only set while the thread isn't running, no need for the lock to read them
+	uint64_t Completed[kMaxQueues];
+	for (uint32_t i = 0; i < kMaxQueues; ++i)
+		Completed[i] = m_pQueues[i] != nullptr ? m_pQueues[i]->GetCompletedFence() : 0;
+
+	uint32_t MovedMask = 0;
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		m_NumPolls++;
+		for (uint32_t i = 0; i < kMaxQueues; ++i)
+		{
+			if (m_pQueues[i] == nullptr)
+				continue;
+			if (Completed[i] > m_LastCompleted[i])
+			{
+				m_LastCompleted[i] = Completed[i];
+				MovedMask |= 1u << i;
+				m_NumListenerCalls += m_Listeners.size();
+			}
+			// Even if it didn't move on, a registration racing the last poll may have missed it
+			auto& Pending = m_Pending[i];
+			auto End = Pending.upper_bound( Completed[i] );
+			for (auto iter = Pending.begin(); iter != End; ++iter)
+				Due.push_back( std::move( iter->second ) );
+			Pending.erase( Pending.begin(), End );
+		}
+		m_NumPending -= (uint32_t)Due.size();
+		m_NumCallbacks += Due.size();
+	}
+
+	// Listeners first, a callback may well want what they recycled
+	for (uint32_t i = 0; i < kMaxQueues; ++i)
+		if (MovedMask & (1u << i))
+			for (auto& Fn : m_Listeners)
+				Fn( i, Completed[i] );
+	for (auto& Fn : Due)
+		Fn();
+	Due.clear();
+	return MovedMask != 0;
+}
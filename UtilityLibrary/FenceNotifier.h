@@ -0,0 +1,92 @@
+#pragma once
+// One thread polling the fences of a few GpuQueues and running continuations once they completed.
+
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class GpuQueue;
+
+struct FenceNotifierStats
+{
+	uint64_t	NumPolls;
+	uint64_t	NumCallbacks;		// Run on the notifier thread
+	uint64_t	NumInline;			// Fence had completed at registration, run on the caller
+	uint64_t	NumListenerCalls;
+	uint32_t	NumPending;
+	uint32_t	PollIntervalUs;		// The current one
+};
+
+//--------------------------------------------------------------------------------------
+// FenceNotifier
+//--------------------------------------------------------------------------------------
+class FenceNotifier
+{
+public:
+	enum
+	{
+		kMaxQueues = 4,				// Indexed by the fence's type
+		// Sleep between polls, back to the minimum once anything completed, on a registration or a
+		// Kick(), doubling while nothing does
+		kMinPollUs = 50,
+		kMaxPendingPollUs = 200,
+		kMaxPollUs = 1000,
+	};
+
+	typedef std::function<void()> Callback;
+	typedef std::function<void( uint32_t Type, uint64_t CompletedFence )> Listener;
+
+	FenceNotifier();
+	~FenceNotifier();
+
+	// Not thread safe, only while the thread isn't running. Listeners are told on the thread every
+	// time a queue's completed fence moved on, before the callbacks run.
+	void AddListener( Listener Fn );
+	// The queues must stay alive until Stop()
+	void Start( GpuQueue* const* ppQueues, uint32_t NumQueues );
+	// Runs the callbacks whose fence completed meanwhile, the others are dropped, their futures
+	// see broken_promise. Idle the GPU first to have none dropped.
+	void Stop();
+	bool IsRunning() const { return m_Thread.joinable(); }
+
+	// Thread safe. FenceValue must be from one of the queues given to Start(). Runs on the thread,
+	// or right away on the caller if the fence had completed already.
+	void OnFenceComplete( uint64_t FenceValue, Callback Fn );
+	std::future<void> WhenComplete( uint64_t FenceValue );
+	// Poll right away and at the fast rate again, e.g. after a submission expected to be short
+	void Kick();
+
+	FenceNotifierStats GetStats();
+	void ResetStats();
+
+private:
+	FenceNotifier( const FenceNotifier& ) = delete;
+	FenceNotifier& operator=( const FenceNotifier& ) = delete;
+
+	void ThreadMain();
+	// Reads the completed fence of every queue and runs what became due, true if any moved on
+	bool PollAndRun( std::vector<Callback>& Due );
+
+	std::thread									m_Thread;
+	std::mutex									m_Mutex;
+	std::condition_variable						m_WakeUp;
+	bool										m_StopRequested;
+	bool										m_Kicked;
+	uint32_t									m_NumPending;
+
+	GpuQueue*									m_pQueues[kMaxQueues];
+	uint64_t									m_LastCompleted[kMaxQueues];		// Told to the listeners
+	std::multimap<uint64_t, Callback>			m_Pending[kMaxQueues];				// By fence
+	std::vector<Listener>						m_Listeners;
+
+	uint32_t									m_PollIntervalUs;
+	uint64_t									m_NumPolls;
+	uint64_t									m_NumCallbacks;
+	uint64_t									m_NumInline;
+	uint64_t									m_NumListenerCalls;
+};
@@ -0,0 +1,263 @@
+#pragma once
+// Lock-free recycling of pooled objects (pages, command allocators, descriptor heaps, contexts)
+// which could only be reused once the GPU passed the fence they were retired with.
+// Retired and ready objects live in two bounded MPMC rings (Vyukov's sequence per cell), so
+// recording threads never serialize on a lock for the common retire/acquire path. If a ring ever
+// runs full the object goes to a mutex guarded overflow list which is drained on the next reclaim.
+// The fence-recycler area of UtilityTests checks it from many threads.
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// FenceRing
+//--------------------------------------------------------------------------------------
+// Bounded MPMC ring of (fence, item) entries. Entry fields are relaxed atomics ordered by the cell
+// sequence, which lets a consumer peek at the front entry and pop it only if it's complete.
+template <typename T>
+class FenceRing
+{
+public:
+	// Capacity is rounded up to a power of two
+	explicit FenceRing( uint32_t Capacity )
+	{
+		uint32_t Size = 2;
+		while (Size < Capacity) Size <<= 1;
+		m_Mask = Size - 1;
+		m_Cells.reset( new Cell[Size] );
+		for (uint32_t i = 0; i < Size; ++i)
+			m_Cells[i].Sequence.store( i, std::memory_order_relaxed );
+		m_Head.store( 0, std::memory_order_relaxed );
+		m_Tail.store( 0, std::memory_order_relaxed );
+	}
+
+	bool Push( uint64_t FenceValue, T* pItem )
+	{
+		size_t Pos = m_Tail.load( std::memory_order_relaxed );
+		Cell* pCell;
+		for (;;)
+		{
+			pCell = &m_Cells[Pos & m_Mask];
+			size_t Sequence = pCell->Sequence.load( std::memory_order_acquire );
+			intptr_t Diff = (intptr_t)Sequence - (intptr_t)Pos;
+			if (Diff == 0)
+			{
+				if (m_Tail.compare_exchange_weak( Pos, Pos + 1, std::memory_order_relaxed )) break;
+			}
+			else if (Diff < 0)
+				return false;
+			else
+				Pos = m_Tail.load( std::memory_order_relaxed );
+		}
+		pCell->FenceValue.store( FenceValue, std::memory_order_relaxed );
+		pCell->pItem.store( pItem, std::memory_order_relaxed );
+		pCell->Sequence.store( Pos + 1, std::memory_order_release );
+		return true;
+	}
+
+	bool Pop( uint64_t& FenceValue, T*& pItem )
+	{
+		return PopIf( FenceValue, pItem, []( uint64_t ) { return true; } );
+	}
+
+	// Pop the front entry only if Pred( FenceValue ) accepts it, so entries stay in FIFO order
+	template <typename PredFn>
+	bool PopIf( uint64_t& FenceValue, T*& pItem, PredFn&& Pred )
+	{
+		size_t Pos = m_Head.load( std::memory_order_relaxed );
+		Cell* pCell;
+		for (;;)
+		{
+			pCell = &m_Cells[Pos & m_Mask];
+			size_t Sequence = pCell->Sequence.load( std::memory_order_acquire );
+			intptr_t Diff = (intptr_t)Sequence - (intptr_t)(Pos + 1);
+			if (Diff == 0)
+			{
+				// A stale peek is harmless, the CAS fails if anybody popped this entry meanwhile
+				FenceValue = pCell->FenceValue.load( std::memory_order_relaxed );
+				pItem = pCell->pItem.load( std::memory_order_relaxed );
+				if (!Pred( FenceValue )) return false;
+				if (m_Head.compare_exchange_weak( Pos, Pos + 1, std::memory_order_relaxed )) break;
+			}
+			else if (Diff < 0)
+				return false;
+			else
+				Pos = m_Head.load( std::memory_order_relaxed );
+		}
+		pCell->Sequence.store( Pos + m_Mask + 1, std::memory_order_release );
+		return true;
+	}
+
+	// Only a snapshot, other threads may push or pop meanwhile
+	uint32_t ApproxSize() const
+	{
+		size_t Tail = m_Tail.load( std::memory_order_relaxed );
+		size_t Head = m_Head.load( std::memory_order_relaxed );
+		return Tail > Head ? (uint32_t)(Tail - Head) : 0;
+	}
+
+private:
+	FenceRing( const FenceRing& ) = delete;
+	FenceRing& operator=( const FenceRing& ) = delete;
+
+	struct Cell
+	{
+		std::atomic<size_t>		Sequence;
+		std::atomic<uint64_t>	FenceValue;
+		std::atomic<T*>			pItem;
+	};
+
+	// Head and tail on their own cache lines, producers and consumers don't invalidate each other
+	char					m_Padding0[64];
+	std::atomic<size_t>		m_Head;
+	char					m_Padding1[64];
+	std::atomic<size_t>		m_Tail;
+	char					m_Padding2[64];
+	size_t					m_Mask;
+	std::unique_ptr<Cell[]>	m_Cells;
+};
+
+//--------------------------------------------------------------------------------------
+// FenceRecycler
+//--------------------------------------------------------------------------------------
+template <typename T>
+class FenceRecycler
+{
+public:
+	enum { kDefaultCapacity = 1024, kReclaimBatch = 16 };
+
+	explicit FenceRecycler( uint32_t Capacity = kDefaultCapacity )
+		:m_Retired( Capacity ), m_Ready( Capacity ), m_HasOverflow( false ) {}
+
+	// Item could be reused once IsFenceComplete( FenceValue ) holds, FenceValue 0 means right away
+	void Retire( uint64_t FenceValue, T* pItem )
+	{
+		if (!m_Retired.Push( FenceValue, pItem ))
+			PushOverflow( FenceValue, pItem );
+	}
+
+	void Retire( uint64_t FenceValue, T* const* ppItems, size_t Count )
+	{
+		for (size_t i = 0; i < Count; ++i)
+			Retire( FenceValue, ppItems[i] );
+	}
+
+	// Item which is reusable right away (e.g. a context whose list was already submitted)
+	void Release( T* pItem )
+	{
+		if (!m_Ready.Push( 0, pItem ))
+			PushOverflow( 0, pItem );
+	}
+
+	// Move up to MaxCount retired items whose fence completed to the ready ring, returns how many
+	// were moved. Stops at the first incomplete one, later ones were mostly retired later, and once
+	// the ready ring is full.
+	template <typename FenceCompleteFn>
+	uint32_t Reclaim( FenceCompleteFn&& IsFenceComplete, uint32_t MaxCount = kReclaimBatch )
+	{
+		uint32_t Count = 0;
+		T* pItem;
+		while (Count < MaxCount && PopCompleted( IsFenceComplete, pItem ))
+		{
+			++Count;
+			// Ready ring full, going on would only cycle items through the overflow list
+			if (!m_Ready.Push( 0, pItem ))
+			{
+				PushOverflow( 0, pItem );
+				break;
+			}
+		}
+		return Count;
+	}
+
+	// Ready item, or the oldest retired one if its fence completed, nullptr if all are in flight
+	template <typename FenceCompleteFn>
+	T* Acquire( FenceCompleteFn&& IsFenceComplete )
+	{
+		uint64_t FenceValue;
+		T* pItem = nullptr;
+		if (m_Ready.Pop( FenceValue, pItem )) return pItem;
+		return PopCompleted( IsFenceComplete, pItem ) ? pItem : nullptr;
+	}
+
+	// Ready item of Release only, no fence involved
+	T* Acquire()
+	{
+		return Acquire( []( uint64_t ) { return false; } );
+	}
+
+	uint32_t GetNumRetired() const { return m_Retired.ApproxSize(); }
+	uint32_t GetNumReady() const { return m_Ready.ApproxSize(); }
+
+	// Remove every item and hand it to Visit (e.g. to destroy it), owner has to make sure nobody
+	// uses the recycler meanwhile
+	template <typename VisitFn>
+	void Drain( VisitFn&& Visit )
+	{
+		uint64_t FenceValue;
+		T* pItem;
+		while (m_Retired.Pop( FenceValue, pItem )) Visit( pItem );
+		while (m_Ready.Pop( FenceValue, pItem )) Visit( pItem );
+		std::lock_guard<std::mutex> Lock( m_OverflowMutex );
+		for (auto& Overflow : m_Overflow)
+			Visit( Overflow.second );
+		m_Overflow.clear();
+		m_HasOverflow.store( false, std::memory_order_release );
+	}
+
+	void Clear()
+	{
+		Drain( []( T* ) {} );
+	}
+
+private:
+	FenceRecycler( const FenceRecycler& ) = delete;
+	FenceRecycler& operator=( const FenceRecycler& ) = delete;
+
+	template <typename FenceCompleteFn>
+	bool PopCompleted( FenceCompleteFn&& IsFenceComplete, T*& pItem )
+	{
+		if (m_HasOverflow.load( std::memory_order_acquire ))
+			DrainOverflow();
+		uint64_t FenceValue;
+		return m_Retired.PopIf( FenceValue, pItem,
+			[&IsFenceComplete]( uint64_t Candidate ) { return Candidate == 0 || IsFenceComplete( Candidate ); } );
+	}
+
+	void PushOverflow( uint64_t FenceValue, T* pItem )
+	{
+		std::lock_guard<std::mutex> Lock( m_OverflowMutex );
+		m_Overflow.push_back( std::make_pair( FenceValue, pItem ) );
+		m_HasOverflow.store( true, std::memory_order_release );
+	}
+
+	// Overflow items are put back as retired, the next reclaim sorts out which are ready
+	void DrainOverflow()
+	{
+		std::vector<std::pair<uint64_t, T*>> Overflow;
+		{
+			std::lock_guard<std::mutex> Lock( m_OverflowMutex );
+			Overflow.swap( m_Overflow );
+			m_HasOverflow.store( false, std::memory_order_release );
+		}
+		for (size_t i = 0; i < Overflow.size(); ++i)
+		{
+			if (m_Retired.Push( Overflow[i].first, Overflow[i].second )) continue;
+			std::lock_guard<std::mutex> Lock( m_OverflowMutex );
+			m_Overflow.insert( m_Overflow.end(), Overflow.begin() + i, Overflow.end() );
+			m_HasOverflow.store( true, std::memory_order_release );
+			break;
+		}
+	}
+
+	FenceRing<T>							m_Retired;
+	FenceRing<T>							m_Ready;
+
+	std::mutex								m_OverflowMutex;
+	std::vector<std::pair<uint64_t, T*>>	m_Overflow;
+	std::atomic<bool>						m_HasOverflow;
+};
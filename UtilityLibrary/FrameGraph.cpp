@@ -0,0 +1,304 @@
+#include "LibraryHeader.h"
+#include "CommandContext.h"
+#include "CmdListMngr.h"
+#include "GpuResource.h"
+#include "Graphics.h"
+#include "Utility.h"
+#include "FrameGraph.h"
+
+#include <algorithm>
+
+namespace
+{
+	// Heap of a resource on resource heap tier 1, the same kinds TransientPackerBenchmark uses
+	uint32_t GetTier1Heap( const D3D12_RESOURCE_DESC& Desc )
+	{
+		if (Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+			return 0;
+		if (Desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+			return 1;
+		return 2;
+	}
+
+	const D3D12_HEAP_FLAGS kTier1HeapFlags[] =
+	{
+		D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS,
+		D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES,
+		D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES,
+	};
+
+	D3D12_RESOURCE_STATES GetFirstState( const RenderGraph& Graph, uint32_t Pass, uint32_t Resource )
+	{
+		const RenderGraphPass& Desc = Graph.GetPass( Pass );
+		for (uint32_t i = Desc.FirstAccess; i < Desc.FirstAccess + Desc.NumAccesses; ++i)
+			if (Graph.GetAccesses()[i].Resource == Resource)
+				return (D3D12_RESOURCE_STATES)Graph.GetAccesses()[i].State;
+		ASSERT( false );
+		return D3D12_RESOURCE_STATE_COMMON;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// FrameGraph
+//--------------------------------------------------------------------------------------
+FrameGraph::FrameGraph()
+	:m_Options( RenderGraphOptions::Default() ), m_HeapTier( (D3D12_RESOURCE_HEAP_TIER)0 )
+{
+}
+
+void FrameGraph::Reset()
+{
+	m_Graph.Reset();
+	m_Resources.clear();
+	m_Kinds.clear();
+	m_Passes.clear();
+}
+
+void FrameGraph::Destroy()
+{
+	m_Placed.clear();
+	m_Heaps.clear();
+	m_HeapSizes.clear();
+}
+
+uint32_t FrameGraph::Import( const std::string& Name, GpuResource& Resource, D3D12_RESOURCE_STATES FinalState )
+{
+	m_Resources.push_back( &Resource );
+	m_Kinds.push_back( kImported );
+	return m_Graph.Import( Name, Resource.GetUsageState(), FinalState );
+}
+
+uint32_t FrameGraph::CreateTransient( const std::string& Name, ColorBuffer& Buffer )
+{
+	return AddTransient( Name, Buffer, kTransientColor );
+}
+
+uint32_t FrameGraph::CreateTransient( const std::string& Name, DepthBuffer& Buffer )
+{
+	return AddTransient( Name, Buffer, kTransientDepth );
+}
+
+uint32_t FrameGraph::CreateTransient( const std::string& Name, GpuBuffer& Buffer )
+{
+	return AddTransient( Name, Buffer, kTransientBuffer );
+}
+
+uint32_t FrameGraph::AddTransient( const std::string& Name, GpuResource& Resource, ResourceKind Kind )
+{
+	if (m_HeapTier == 0)
+	{
+		D3D12_FEATURE_DATA_D3D12_OPTIONS Options = {};
+		Graphics::g_device->CheckFeatureSupport( D3D12_FEATURE_D3D12_OPTIONS, &Options, sizeof( Options ) );
+		m_HeapTier = Options.ResourceHeapTier;
+	}
+
+	// The device is only asked when the owner created the resource again
+	const D3D12_RESOURCE_DESC Desc = Resource->GetDesc();
+	const uint32_t Heap = m_HeapTier == D3D12_RESOURCE_HEAP_TIER_1 ? GetTier1Heap( Desc ) : 0;
+	D3D12_RESOURCE_ALLOCATION_INFO Info = {};
+	for (auto& Placed : m_Placed)
+	{
+		if (Placed.Resource == &Resource && Placed.Placed == Resource.GetResource())
+		{
+			Info.SizeInBytes = Placed.SizeBytes;
+			Info.Alignment = Placed.Alignment;
+		}
+	}
+	if (Info.SizeInBytes == 0)
+		Info = Graphics::g_device->GetResourceAllocationInfo( 0, 1, &Desc );
+	m_Resources.push_back( &Resource );
+	m_Kinds.push_back( Kind );
+	return m_Graph.CreateTransient( Name, Info.SizeInBytes, Info.Alignment, Heap );
+}
+
+uint32_t FrameGraph::AddPass( const std::string& Name, uint32_t Flags, const PassFunc& Execute )
+{
+	m_Passes.push_back( Execute );
+	return m_Graph.AddPass( Name, Flags );
+}
+
+void FrameGraph::PlaceTransients()
+{
+	const bool NewHeaps = m_HeapSizes != m_Compiled.HeapSizes;
+	m_JustPlaced.assign( m_Resources.size(), 0 );
+	uint32_t NumPlaced = 0;
+	for (auto& Transient : m_Compiled.Transients)
+	{
+		GpuResource* Resource = m_Resources[Transient.Resource];
+		bool Placed = false;
+		for (auto& Other : m_Placed)
+			Placed |= Other.Resource == Resource && Other.Placed == Resource->GetResource() && Other.Heap == Transient.Heap && Other.Offset == Transient.Offset;
+		m_JustPlaced[Transient.Resource] = NewHeaps || !Placed;
+		NumPlaced += m_JustPlaced[Transient.Resource];
+	}
+	if (NumPlaced == 0)
+		return;
+
+	// Frames in flight may still use the resources and heaps let go of here
+	Graphics::g_cmdListMngr.IdleGPU();
+	if (NewHeaps)
+	{
+		m_Heaps.clear();
+		m_Heaps.resize( m_Compiled.HeapSizes.size() );
+		for (uint32_t i = 0; i < m_Compiled.HeapSizes.size(); ++i)
+		{
+			if (m_Compiled.HeapSizes[i] == 0)
+				continue;
+			uint64_t Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+			for (auto& Transient : m_Compiled.Transients)
+				if (Transient.Heap == i)
+					Alignment = (std::max)( Alignment, m_Graph.GetResource( Transient.Resource ).Alignment );
+
+			D3D12_HEAP_DESC HeapDesc = {};
+			HeapDesc.SizeInBytes = m_Compiled.HeapSizes[i];
+			HeapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+			HeapDesc.Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+			HeapDesc.Properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+			HeapDesc.Properties.CreationNodeMask = 1;
+			HeapDesc.Properties.VisibleNodeMask = 1;
+			HeapDesc.Alignment = Alignment;
+			HeapDesc.Flags = m_HeapTier == D3D12_RESOURCE_HEAP_TIER_1 ? kTier1HeapFlags[i] : D3D12_HEAP_FLAG_ALLOW_ALL_BUFFERS_AND_TEXTURES;
+			HRESULT hr;
+			V( Graphics::g_device->CreateHeap( &HeapDesc, IID_PPV_ARGS( &m_Heaps[i] ) ) );
+#ifndef RELEASE
+			m_Heaps[i]->SetName( L"Render Graph Transients" );
+#endif
+		}
+		m_HeapSizes = m_Compiled.HeapSizes;
+	}
+
+	m_Placed.clear();
+	for (auto& Transient : m_Compiled.Transients)
+	{
+		const RenderGraphResource& Desc = m_Graph.GetResource( Transient.Resource );
+		GpuResource* Resource = m_Resources[Transient.Resource];
+		if (m_JustPlaced[Transient.Resource])
+		{
+			const std::wstring Name( Desc.Name.begin(), Desc.Name.end() );
+			ID3D12Heap* Heap = m_Heaps[Transient.Heap].Get();
+			switch (m_Kinds[Transient.Resource])
+			{
+			case kTransientColor:
+			{
+				ColorBuffer& Buffer = *static_cast<ColorBuffer*>( Resource );
+				Buffer.CreatePlaced( Name, Heap, Transient.Offset, Buffer.GetWidth(), Buffer.GetHeight(),
+					Buffer->GetDesc().MipLevels, Buffer.GetFormat() );
+				break;
+			}
+			case kTransientDepth:
+			{
+				DepthBuffer& Buffer = *static_cast<DepthBuffer*>( Resource );
+				Buffer.CreatePlaced( Name, Heap, Transient.Offset, Buffer.GetWidth(), Buffer.GetHeight(), Buffer.GetFormat() );
+				break;
+			}
+			case kTransientBuffer:
+			{
+				GpuBuffer& Buffer = *static_cast<GpuBuffer*>( Resource );
+				ASSERT( Transient.Offset <= 0xffffffff );
+				Buffer.CreatePlaced( Name, Heap, (uint32_t)Transient.Offset, Buffer.GetElementCount(), Buffer.GetElementSize() );
+				break;
+			}
+			default:
+				ASSERT( false );
+			}
+		}
+		PlacedTransient Placed = { Resource, Resource->GetResource(), Transient.Heap, Transient.Offset, Desc.SizeBytes, Desc.Alignment };
+		m_Placed.push_back( Placed );
+	}
+	PRINTINFO( "Render graph: %u of %u transients placed, %.1f MB in %u heaps, %.1f MB without aliasing", NumPlaced,
+		(uint32_t)m_Compiled.Transients.size(), m_Compiled.HeapSize / 1048576.0, (uint32_t)m_Compiled.HeapSizes.size(),
+		m_Compiled.TransientBytes / 1048576.0 );
+}
+
+uint64_t FrameGraph::Execute()
+{
+	ASSERT( !m_Options.CopyQueue );
+	if (!m_Graph.Compile( m_Options, m_Compiled ))
+	{
+		// Still record everything as declared, CommandContext transitions whatever the passes bind.
+		// Transients stay where they were, without aliasing barriers.
+		PRINTERROR( "Render graph: %s", m_Compiled.Error.c_str() );
+		CommandContext& Context = CommandContext::Begin( L"Render Graph" );
+		for (auto& Pass : m_Passes)
+			if (Pass)
+				Pass( Context );
+		return Context.Finish();
+	}
+	PlaceTransients();
+
+	const uint32_t NumPasses = m_Graph.GetNumPasses();
+	m_SegmentFences.assign( m_Compiled.Segments.size(), 0 );
+	uint64_t GraphicsFence = 0;
+	for (size_t s = 0; s < m_Compiled.Segments.size(); ++s)
+	{
+		const RenderGraphSegment& Segment = m_Compiled.Segments[s];
+		const bool Async = Segment.Queue == kRenderGraphCompute;
+		for (uint32_t Wait : Segment.Waits)
+			Graphics::g_cmdListMngr.GpuWait( Async ? D3D12_COMMAND_LIST_TYPE_COMPUTE : D3D12_COMMAND_LIST_TYPE_DIRECT, m_SegmentFences[Wait] );
+
+		// Named after the segment's first pass
+		const uint32_t FirstPass = m_Compiled.Passes[Segment.FirstPass].Pass;
+		const std::string& Name = FirstPass < NumPasses ? m_Graph.GetPass( FirstPass ).Name : std::string( "Final States" );
+		const std::wstring ID( Name.begin(), Name.end() );
+		CommandContext& Context = Async ? ComputeContext::Begin( ID, true ) : CommandContext::Begin( ID );
+
+		for (uint32_t i = Segment.FirstPass; i < Segment.FirstPass + Segment.NumPasses; ++i)
+		{
+			const CompiledRenderPass& Pass = m_Compiled.Passes[i];
+			bool Recorded = !Pass.Barriers.empty();
+
+			// Transients starting here take their memory over and get the state their first pass needs
+			for (auto& Aliasing : Pass.Aliasing)
+			{
+				GpuResource* Before = Aliasing.Before == kTransientPreviousFrame ? nullptr : m_Resources[Aliasing.Before];
+				Context.InsertAliasBarrier( Before, *m_Resources[Aliasing.After] );
+				Recorded = true;
+			}
+			for (auto& Transient : m_Compiled.Transients)
+			{
+				if (Transient.FirstPass != i)
+					continue;
+				const uint32_t r = Transient.Resource;
+				GpuResource& Resource = *m_Resources[r];
+				bool Aliased = m_JustPlaced[r] != 0;
+				for (auto& Aliasing : Pass.Aliasing)
+					Aliased |= Aliasing.After == r;
+				// Textures in memory something else had are initialized first, render targets and depth
+				// in the state they are written in as such
+				if (Aliased && m_Kinds[r] != kTransientBuffer)
+				{
+					if (m_Kinds[r] == kTransientDepth)
+						Context.TransitionResource( Resource, D3D12_RESOURCE_STATE_DEPTH_WRITE );
+					else
+						Context.TransitionResource( Resource, Async ? D3D12_RESOURCE_STATE_UNORDERED_ACCESS : D3D12_RESOURCE_STATE_RENDER_TARGET );
+					Context.DiscardResource( Resource );
+				}
+				Context.TransitionResource( Resource, GetFirstState( m_Graph, Pass.Pass, r ) );
+				Recorded = true;
+			}
+
+			for (auto& Barrier : Pass.Barriers)
+			{
+				GpuResource& Resource = *m_Resources[Barrier.Resource];
+				if (Barrier.IsUAV)
+					Context.InsertUAVBarrier( Resource );
+				else if (Barrier.Flags == kBarrierFlagBeginOnly)
+					Context.BeginResourceTransition( Resource, (D3D12_RESOURCE_STATES)Barrier.StateAfter );
+				else
+					Context.TransitionResource( Resource, (D3D12_RESOURCE_STATES)Barrier.StateAfter );
+			}
+			if (Pass.Pass == NumPasses)
+				continue;
+			// Its own contexts go to the queue first, the barriers must be ahead of them
+			if ((m_Graph.GetPass( Pass.Pass ).Flags & kPassOwnContexts) && Recorded)
+				Context.Flush();
+			if (m_Passes[Pass.Pass])
+				m_Passes[Pass.Pass]( Context );
+		}
+
+		m_SegmentFences[s] = Context.Finish();
+		if (!Async)
+			GraphicsFence = m_SegmentFences[s];
+	}
+	return GraphicsFence;
+}
@@ -0,0 +1,87 @@
+#pragma once
+// RenderGraph over GpuResources, every pass recorded by a callback on a context of its queue.
+
+#include "RenderGraph.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class CommandContext;
+class GpuResource;
+class ColorBuffer;
+class DepthBuffer;
+class GpuBuffer;
+
+//--------------------------------------------------------------------------------------
+// FrameGraph
+//--------------------------------------------------------------------------------------
+class FrameGraph
+{
+public:
+	typedef std::function<void( CommandContext& )> PassFunc;
+
+	FrameGraph();
+
+	void Reset();
+	// Releases the heaps, transients placed in them must not be used after
+	void Destroy();
+
+	// Imported resources start in the state CommandContext last left them in. A transient is created
+	// by its owner as usual, the graph places it again in its heaps, keeping its views, whenever the
+	// packing or the resource changed, after the GPU is idle. It holds nothing between frames.
+	uint32_t Import( const std::string& Name, GpuResource& Resource, D3D12_RESOURCE_STATES FinalState = (D3D12_RESOURCE_STATES)kRenderGraphKeepState );
+	uint32_t CreateTransient( const std::string& Name, ColorBuffer& Buffer );
+	uint32_t CreateTransient( const std::string& Name, DepthBuffer& Buffer );
+	uint32_t CreateTransient( const std::string& Name, GpuBuffer& Buffer );
+	uint32_t AddPass( const std::string& Name, uint32_t Flags, const PassFunc& Execute );
+	void Read( uint32_t Resource, D3D12_RESOURCE_STATES State ) { m_Graph.Read( Resource, State ); }
+	void Write( uint32_t Resource, D3D12_RESOURCE_STATES State ) { m_Graph.Write( Resource, State ); }
+
+	// Compiles and records every pass left, each segment after a GPU wait on the segments it waits
+	// for, a pass after its barriers; callbacks leave barriers of what they declared to the graph.
+	// The copy queue is off. Returns the fence of the last graphics segment, which the whole graph
+	// is done by.
+	uint64_t Execute();
+
+	RenderGraphOptions& GetOptions() { return m_Options; }
+	const RenderGraph& GetGraph() const { return m_Graph; }
+	// Of the last Execute()
+	const CompiledRenderGraph& GetCompiled() const { return m_Compiled; }
+
+private:
+	enum ResourceKind : uint8_t
+	{
+		kImported,
+		kTransientColor,
+		kTransientDepth,
+		kTransientBuffer,
+	};
+
+	struct PlacedTransient
+	{
+		GpuResource*		Resource;
+		ID3D12Resource*		Placed;				// Anything else means the owner created it again
+		uint32_t			Heap;
+		uint64_t			Offset;
+		uint64_t			SizeBytes;
+		uint64_t			Alignment;
+	};
+
+	uint32_t AddTransient( const std::string& Name, GpuResource& Resource, ResourceKind Kind );
+	// Heaps for the last compile, places the transients which aren't where it put them
+	void PlaceTransients();
+
+	RenderGraph m_Graph;
+	RenderGraphOptions m_Options;
+	CompiledRenderGraph m_Compiled;
+	std::vector<GpuResource*> m_Resources;
+	std::vector<ResourceKind> m_Kinds;
+	std::vector<uint8_t> m_JustPlaced;					// Per resource, uninitialized memory
+	std::vector<PlacedTransient> m_Placed;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Heap> > m_Heaps;
+	std::vector<uint64_t> m_HeapSizes;
+	D3D12_RESOURCE_HEAP_TIER m_HeapTier;				// Queried with the first transient
+	std::vector<PassFunc> m_Passes;
+	std::vector<uint64_t> m_SegmentFences;
+};
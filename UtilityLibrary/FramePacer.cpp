@@ -0,0 +1,230 @@
+#include "PortableAssert.h"
+#include "FramePacer.h"
+#include "GpuQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	// Low-latency lead adjustment. It grows by part of the time a frame queued behind the previous
+	// one and shrinks by a step when the GPU ran dry, which costs throughput
+	const double kLeadGrowFraction = 0.5;
+	const double kLeadShrinkMs = 0.25;
+	const double kLeadShrinkFraction = 0.1;
+
+	class SteadyFrameClock : public IFrameClock
+	{
+	public:
+		SteadyFrameClock() :m_Start( std::chrono::steady_clock::now() ) {}
+
+		virtual double GetNowMs() override
+		{
+			return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - m_Start ).count();
+		}
+
+		// The OS sleeps in timer ticks, so the last millisecond is spent yielding
+		virtual void SleepUntilMs( double TimeMs ) override
+		{
+			double RemainingMs = TimeMs - GetNowMs();
+			if (RemainingMs > 1.0)
+				std::this_thread::sleep_for( std::chrono::duration<double, std::milli>( RemainingMs - 1.0 ) );
+			while (GetNowMs() < TimeMs)
+				std::this_thread::yield();
+		}
+
+	private:
+		const std::chrono::steady_clock::time_point		m_Start;
+	};
+
+	SteadyFrameClock s_SteadyClock;
+}
+
+//--------------------------------------------------------------------------------------
+// FramePacer
+//--------------------------------------------------------------------------------------
+FramePacer::FramePacer()
+	:m_pQueue( nullptr ), m_pClock( nullptr ), m_FramesInFlight( 2 ), m_LowLatency( false ), m_FrameIndex( 0 ),
+	m_InFrame( false ), m_LeadMs( 0 )
+{
+	for (uint32_t i = 0; i < kMaxFramesInFlight; ++i)
+	{
+		m_Frames[i].FenceValue = 0;
+		m_Frames[i].BeginMs = 0;
+		m_Frames[i].SubmitMs = 0;
+		m_Frames[i].Pending = false;
+	}
+	ResetStats();
+}
+
+void FramePacer::Create( GpuQueue* pQueue, IFrameClock* pClock )
+{
+	ASSERT( pQueue != nullptr && m_pQueue == nullptr );
+	m_pQueue = pQueue;
+	m_pClock = pClock != nullptr ? pClock : &s_SteadyClock;
+	m_FrameIndex = 0;
+	m_InFrame = false;
+	m_LeadMs = 0;
+	for (uint32_t i = 0; i < kMaxFramesInFlight; ++i)
+	{
+		m_Frames[i].FenceValue = 0;
+		m_Frames[i].Pending = false;
+	}
+	ResetStats();
+}
+
+void FramePacer::Destroy()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_pQueue = nullptr;
+}
+
+void FramePacer::SetFramesInFlight( uint32_t Count )
+{
+	m_FramesInFlight = (std::max)( 1u, (std::min)( Count, (uint32_t)kMaxFramesInFlight ) );
+}
+
+void FramePacer::SetLowLatency( bool Enable )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	if (Enable != m_LowLatency)
+		m_LeadMs = 0;
+	m_LowLatency = Enable;
+}
+
+uint32_t FramePacer::BeginFrame()
+{
+	ASSERT( m_pQueue != nullptr && !m_InFrame );
+	const uint64_t FrameIndex = m_FrameIndex;
+	// Only this thread writes fences, reading them needs no lock
+	const uint32_t Depth = m_LowLatency ? (std::min)( m_FramesInFlight, 2u ) : m_FramesInFlight;
+	double WaitMs = -1.0;
+	double QueuedMs = 0;
+	double SleepMs = 0;
+	if (FrameIndex >= Depth)
+	{
+		uint64_t FenceValue = m_Frames[(FrameIndex - Depth) % kMaxFramesInFlight].FenceValue;
+		if (!m_pQueue->IsFenceComplete( FenceValue ))
+		{
+			double StartMs = m_pClock->GetNowMs();
+			double StallMs;
+			m_pQueue->WaitForFence( FenceValue, StallMs );
+			double EndMs = m_pClock->GetNowMs();
+			WaitMs = EndMs - StartMs;
+			// With two in flight the frame after the one waited for was submitted behind it, it
+			// could only start now
+			if (Depth == 2)
+				QueuedMs = EndMs - m_Frames[(FrameIndex - 1) % kMaxFramesInFlight].SubmitMs;
+		}
+	}
+	if (m_LowLatency && Depth > 1 && FrameIndex > 0)
+	{
+		if (QueuedMs > 0)
+		{
+			std::lock_guard<std::mutex> Lock( m_Mutex );
+			m_LeadMs += QueuedMs * kLeadGrowFraction;
+		}
+		// No point holding back once the GPU ran dry
+		const Frame& Previous = m_Frames[(FrameIndex - 1) % kMaxFramesInFlight];
+		double TargetMs = Previous.SubmitMs + m_LeadMs;
+		double NowMs = m_pClock->GetNowMs();
+		if (TargetMs > NowMs && !m_pQueue->IsFenceComplete( Previous.FenceValue ))
+		{
+			m_pClock->SleepUntilMs( TargetMs );
+			SleepMs = TargetMs - NowMs;
+		}
+	}
+
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	double NowMs = m_pClock->GetNowMs();
+	UpdateLocked( NowMs );
+	if (WaitMs >= 0)
+	{
+		m_NumWaits++;
+		m_WaitMs += WaitMs;
+	}
+	m_SleepMs += SleepMs;
+	const uint32_t Slot = (uint32_t)(FrameIndex % kMaxFramesInFlight);
+	Frame& Current = m_Frames[Slot];
+	ASSERT( !Current.Pending );
+	Current.FenceValue = 0;
+	Current.BeginMs = NowMs;
+	m_FrameIndex = FrameIndex + 1;
+	m_InFrame = true;
+	m_NumFrames++;
+	return Slot;
+}
+
+void FramePacer::EndFrame( uint64_t FenceValue )
+{
+	ASSERT( m_InFrame && FenceValue != 0 );
+	const uint64_t FrameIndex = m_FrameIndex - 1;
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	if (m_LowLatency && FrameIndex > 0)
+	{
+		// The previous frame done before this one is submitted means the GPU idled, start later
+		// frames sooner. The lead grows in BeginFrame(), once it is known how long this one queued
+		const Frame& Previous = m_Frames[(FrameIndex - 1) % kMaxFramesInFlight];
+		if (m_pQueue->IsFenceComplete( Previous.FenceValue ))
+			m_LeadMs = (std::max)( 0.0, m_LeadMs - (std::max)( kLeadShrinkMs, m_LeadMs * kLeadShrinkFraction ) );
+	}
+
+	Frame& Current = m_Frames[FrameIndex % kMaxFramesInFlight];
+	Current.FenceValue = FenceValue;
+	Current.SubmitMs = m_pClock->GetNowMs();
+	Current.Pending = true;
+	m_InFrame = false;
+}
+
+void FramePacer::Update()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	if (m_pQueue != nullptr)
+		UpdateLocked( m_pClock->GetNowMs() );
+}
+
+FramePacerStats FramePacer::GetStats()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	FramePacerStats Stats;
+	Stats.FramesInFlight = m_FramesInFlight;
+	Stats.LowLatency = m_LowLatency;
+	Stats.NumFrames = m_NumFrames;
+	Stats.NumWaits = m_NumWaits;
+	Stats.WaitMsPerFrame = m_NumFrames ? m_WaitMs / m_NumFrames : 0;
+	Stats.SleepMsPerFrame = m_NumFrames ? m_SleepMs / m_NumFrames : 0;
+	Stats.SubmitToCompleteMs = m_NumCompleted ? m_SubmitToCompleteMs / m_NumCompleted : 0;
+	Stats.BeginToCompleteMs = m_NumCompleted ? m_BeginToCompleteMs / m_NumCompleted : 0;
+	Stats.MaxBeginToCompleteMs = m_MaxBeginToCompleteMs;
+	Stats.LeadMs = m_LeadMs;
+	return Stats;
+}
+
+void FramePacer::ResetStats()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_NumFrames = 0;
+	m_NumWaits = 0;
+	m_WaitMs = 0;
+	m_SleepMs = 0;
+	m_NumCompleted = 0;
+	m_SubmitToCompleteMs = 0;
+	m_BeginToCompleteMs = 0;
+	m_MaxBeginToCompleteMs = 0;
+}
+
+void FramePacer::UpdateLocked( double NowMs )
+{
+	for (uint32_t i = 0; i < kMaxFramesInFlight; ++i)
+	{
+		Frame& Entry = m_Frames[i];
+		if (!Entry.Pending || !m_pQueue->IsFenceComplete( Entry.FenceValue ))
+			continue;
+		Entry.Pending = false;
+		m_NumCompleted++;
+		m_SubmitToCompleteMs += NowMs - Entry.SubmitMs;
+		m_BeginToCompleteMs += NowMs - Entry.BeginMs;
+		m_MaxBeginToCompleteMs = (std::max)( m_MaxBeginToCompleteMs, NowMs - Entry.BeginMs );
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+// Limits how many frames the CPU runs ahead of the GPU, each frame ending on a fence of one queue.
+
+#include <stdint.h>
+#include <mutex>
+
+class GpuQueue;
+
+class IFrameClock
+{
+public:
+	virtual ~IFrameClock() {}
+	virtual double GetNowMs() = 0;
+	virtual void SleepUntilMs( double TimeMs ) = 0;
+};
+
+struct FramePacerStats
+{
+	uint32_t	FramesInFlight;
+	bool		LowLatency;
+	uint64_t	NumFrames;					// Since the last ResetStats()
+	uint64_t	NumWaits;					// BeginFrame() blocked on a fence
+	double		WaitMsPerFrame;
+	double		SleepMsPerFrame;			// Low-latency mode holding the frame start back
+	double		SubmitToCompleteMs;			// Mean over the frames seen complete
+	double		BeginToCompleteMs;
+	double		MaxBeginToCompleteMs;
+	double		LeadMs;
+};
+
+//--------------------------------------------------------------------------------------
+// FramePacer
+//--------------------------------------------------------------------------------------
+class FramePacer
+{
+public:
+	enum { kMaxFramesInFlight = 4 };
+
+	FramePacer();
+
+	// pClock nullptr uses the steady clock and sleeps the calling thread
+	void Create( GpuQueue* pQueue, IFrameClock* pClock = nullptr );
+	void Destroy();
+
+	// Both take effect with the next BeginFrame(), Count is clamped to [1, kMaxFramesInFlight].
+	// Low-latency mode keeps two frames in flight and sleeps the frame start until LeadMs after the
+	// previous submission, LeadMs adapting so the previous frame finishes as the next is submitted.
+	void SetFramesInFlight( uint32_t Count );
+	void SetLowLatency( bool Enable );
+	uint32_t GetFramesInFlight() const { return m_FramesInFlight; }
+	bool GetLowLatency() const { return m_LowLatency; }
+
+	// Waits for frame N - FramesInFlight only, returns the ring slot of the new frame, in
+	// [0, kMaxFramesInFlight), which no frame still on the GPU uses
+	uint32_t BeginFrame();
+	// FenceValue of the frame's last submission
+	void EndFrame( uint64_t FenceValue );
+	// Stamps the frames which completed since, thread safe. Latency is as exact as this is frequent.
+	void Update();
+	uint64_t GetFrameIndex() const { return m_FrameIndex; }
+
+	FramePacerStats GetStats();
+	void ResetStats();
+
+private:
+	FramePacer( const FramePacer& ) = delete;
+	FramePacer& operator=( const FramePacer& ) = delete;
+
+	struct Frame
+	{
+		uint64_t	FenceValue;				// 0 while recording
+		double		BeginMs;
+		double		SubmitMs;
+		bool		Pending;				// Submitted, not yet seen complete
+	};
+
+	void UpdateLocked( double NowMs );
+
+	GpuQueue*			m_pQueue;
+	IFrameClock*		m_pClock;
+	uint32_t			m_FramesInFlight;
+	bool				m_LowLatency;
+	uint64_t			m_FrameIndex;		// Frames begun
+	bool				m_InFrame;
+	double				m_LeadMs;
+
+	std::mutex			m_Mutex;			// Update() comes from other threads
+	Frame				m_Frames[kMaxFramesInFlight];
+
+	uint64_t			m_NumFrames;
+	uint64_t			m_NumWaits;
+	double				m_WaitMs;
+	double				m_SleepMs;
+	uint64_t			m_NumCompleted;
+	double				m_SubmitToCompleteMs;
+	double				m_BeginToCompleteMs;
+	double				m_MaxBeginToCompleteMs;
+};
@@ -6,6 +6,7 @@
 #include "CmdListMngr.h"
 #include "TextRenderer.h"
 #include "Graphics.h"
+#include "FramePacer.h"
 
 #include <unordered_map>
 #include <string>
@@ -26,11 +27,15 @@ namespace {
 	XMFLOAT4*						m_timerColorArray;
 	uint64_t*						m_timeStampBufferCopy;
 
-	ID3D12Resource*					m_readbackBuffer;
+	// One readback buffer per frame in flight, read once the frame that resolved into it completed
+	ID3D12Resource*					m_readbackBuffers[FramePacer::kMaxFramesInFlight];
+	uint64_t						m_readbackFences[FramePacer::kMaxFramesInFlight];
+	uint64_t						m_readbackFrames[FramePacer::kMaxFramesInFlight];
 	ID3D12QueryHeap*				m_queryHeap;
 	uint64_t*						m_timeStampBuffer;
 
-	uint64_t						m_fence = 0;
+	uint64_t						m_frameCount = 0;
+	uint64_t						m_lastReadFrame = 0;
 
 	RootSignature					m_RootSignature;
 	GraphicsPSO						m_GraphPSO;
@@ -73,8 +78,8 @@ void GPU_Profiler::Initialize()
 	// Initialize the array to store all timer name
 	m_timerNameArray = new wstring[MAX_TIMER_COUNT];
 
-	// Initialize the array to copy from timer buffer
-	m_timeStampBufferCopy = new uint64_t[MAX_TIMER_COUNT];
+	// Initialize the array to copy from timer buffer, start and stop of each timer
+	m_timeStampBufferCopy = new uint64_t[MAX_TIMER_COUNT * 2]();
 
 	m_timerColorArray = new XMFLOAT4[MAX_TIMER_COUNT];
 
@@ -113,9 +118,14 @@ HRESULT GPU_Profiler::CreateResource()
 	BufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
 	BufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
 
-	VRET( Graphics::g_device->CreateCommittedResource( &HeapProps, D3D12_HEAP_FLAG_NONE, &BufferDesc,
-		D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS( &m_readbackBuffer ) ) );
-	m_readbackBuffer->SetName( L"GPU_Profiler Readback Buffer" );
+	for (uint32_t i = 0; i < FramePacer::kMaxFramesInFlight; ++i)
+	{
+		VRET( Graphics::g_device->CreateCommittedResource( &HeapProps, D3D12_HEAP_FLAG_NONE, &BufferDesc,
+			D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS( &m_readbackBuffers[i] ) ) );
+		m_readbackBuffers[i]->SetName( L"GPU_Profiler Readback Buffer" );
+		m_readbackFences[i] = 0;
+		m_readbackFrames[i] = 0;
+	}
 
 	D3D12_QUERY_HEAP_DESC QueryHeapDesc;
 	QueryHeapDesc.Count = MAX_TIMER_COUNT * 2;
@@ -154,7 +164,8 @@ HRESULT GPU_Profiler::CreateResource()
 
 void GPU_Profiler::ShutDown()
 {
-	if (m_readbackBuffer != nullptr) m_readbackBuffer->Release();
+	for (uint32_t i = 0; i < FramePacer::kMaxFramesInFlight; ++i)
+		if (m_readbackBuffers[i] != nullptr) m_readbackBuffers[i]->Release();
 	if (m_queryHeap != nullptr) m_queryHeap->Release();
 	m_ActiveTimer.clear();
 	delete[] m_RectData;
@@ -166,33 +177,58 @@ void GPU_Profiler::ShutDown()
 
 void GPU_Profiler::ProcessAndReadback( CommandContext& EngineContext )
 {
-	Graphics::g_cmdListMngr.WaitForFence( m_fence );
+	// Newest frame whose timestamps were resolved already, nothing waits for the GPU here
+	int32_t readSlot = -1;
+	uint64_t readFrame = m_lastReadFrame;
+	for (uint32_t i = 0; i < FramePacer::kMaxFramesInFlight; ++i)
+	{
+		if (m_readbackFences[i] != 0 && m_readbackFrames[i] > readFrame &&
+			Graphics::g_cmdListMngr.IsFenceComplete( m_readbackFences[i] ))
+		{
+			readSlot = (int32_t)i;
+			readFrame = m_readbackFrames[i];
+		}
+	}
 
-	HRESULT hr;
-	D3D12_RANGE range;
-	range.Begin = 0;
-	range.End = MAX_TIMER_COUNT * 2 * sizeof( uint64_t );
-	V( m_readbackBuffer->Map( 0, &range, reinterpret_cast<void**>(&m_timeStampBuffer) ) );
-	memcpy( m_timeStampBufferCopy, m_timeStampBuffer, m_timerCount * 2 * sizeof( uint64_t ) );
-	D3D12_RANGE EmptyRange = {};
-	m_readbackBuffer->Unmap( 0, &EmptyRange );
-
-	// based on previous frame end timestamp, creat an active timer idx vector
-	m_ActiveTimer.clear();
-	uint64_t preEndTime = m_ResolveStampIdx == MAX_TIMER_COUNT ? 0 : m_timeStampBufferCopy[m_ResolveStampIdx * 2 + 1];
-	for (uint8_t idx = 0; idx < m_timerCount; ++idx)
+	if (readSlot >= 0)
 	{
-		if (m_timeStampBufferCopy[idx * 2] > preEndTime && idx != m_ResolveStampIdx)
-			m_ActiveTimer.push_back( idx );
+		HRESULT hr;
+		D3D12_RANGE range;
+		range.Begin = 0;
+		range.End = MAX_TIMER_COUNT * 2 * sizeof( uint64_t );
+		V( m_readbackBuffers[readSlot]->Map( 0, &range, reinterpret_cast<void**>(&m_timeStampBuffer) ) );
+		memcpy( m_timeStampBufferCopy, m_timeStampBuffer, m_timerCount * 2 * sizeof( uint64_t ) );
+		D3D12_RANGE EmptyRange = {};
+		m_readbackBuffers[readSlot]->Unmap( 0, &EmptyRange );
+		m_lastReadFrame = readFrame;
+
+		// based on previous frame end timestamp, creat an active timer idx vector
+		m_ActiveTimer.clear();
+		uint64_t preEndTime = m_ResolveStampIdx == MAX_TIMER_COUNT ? 0 : m_timeStampBufferCopy[m_ResolveStampIdx * 2 + 1];
+		for (uint8_t idx = 0; idx < m_timerCount; ++idx)
+		{
+			if (m_timeStampBufferCopy[idx * 2] > preEndTime && idx != m_ResolveStampIdx)
+				m_ActiveTimer.push_back( idx );
+		}
+		// sort timer based on timer's start time
+		sort( m_ActiveTimer.begin(), m_ActiveTimer.end(), compStartTime );
 	}
-	// sort timer based on timer's start time
-	sort( m_ActiveTimer.begin(), m_ActiveTimer.end(), compStartTime );
 
+	// The frame pacer keeps at most kMaxFramesInFlight frames on the GPU, so this slot's last
+	// resolve completed
+	uint32_t writeSlot = (uint32_t)(m_frameCount % FramePacer::kMaxFramesInFlight);
 	{
 		GPU_PROFILE( EngineContext, L"ResolveQuery" );
-		EngineContext.ResolveTimeStamps( m_readbackBuffer, m_queryHeap, 2 * m_timerCount );
+		EngineContext.ResolveTimeStamps( m_readbackBuffers[writeSlot], m_queryHeap, 2 * m_timerCount );
 	}
-	m_fence = EngineContext.Flush();
+	m_readbackFences[writeSlot] = 0;
+	m_readbackFrames[writeSlot] = ++m_frameCount;
+}
+
+void GPU_Profiler::FrameSubmitted( uint64_t FenceValue )
+{
+	ASSERT( m_frameCount > 0 );
+	m_readbackFences[(m_frameCount - 1) % FramePacer::kMaxFramesInFlight] = FenceValue;
 }
 
 uint16_t GPU_Profiler::FillVertexData()
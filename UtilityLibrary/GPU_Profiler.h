@@ -11,7 +11,10 @@ namespace GPU_Profiler
 	void Initialize();
 	HRESULT CreateResource();
 	void ShutDown();
+	// Reads the newest completed frame's timestamps and resolves this frame's, never waits
 	void ProcessAndReadback( CommandContext& EngineContext );
+	// Fence of the frame ProcessAndReadback() last resolved in
+	void FrameSubmitted( uint64_t FenceValue );
 	uint16_t FillVertexData();
 	void DrawStats( GraphicsContext& gfxContext );
 	double ReadTimer( uint8_t idx, double* start = nullptr, double* stop = nullptr );
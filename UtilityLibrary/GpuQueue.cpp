@@ -0,0 +1,92 @@
+#include "PortableAssert.h"
+#include "GpuQueue.h"
+#include "AllocationTrace.h"
+
+#include <chrono>
+
+//--------------------------------------------------------------------------------------
+// GpuQueue
+//--------------------------------------------------------------------------------------
+GpuQueue::GpuQueue( uint32_t Type )
+	:m_Type( Type ), m_pBackend( nullptr ), m_NextFenceValue( (uint64_t)Type << 56 | 1 ),
+	m_LastCompletedFenceValue( (uint64_t)Type << 56 )
+{
+}
+
+void GpuQueue::Create( IGpuQueueBackend* pBackend )
+{
+	ASSERT( pBackend != nullptr && m_pBackend == nullptr );
+	m_pBackend = pBackend;
+	m_NextFenceValue = GetInitialFence() | 1;
+	m_LastCompletedFenceValue = GetInitialFence();
+}
+
+void GpuQueue::Destroy()
+{
+	m_pBackend = nullptr;
+}
+
+uint64_t GpuQueue::Signal()
+{
+	std::lock_guard<std::mutex> Lock( m_SubmitMutex );
+	uint64_t FenceValue = m_NextFenceValue.load( std::memory_order_relaxed );
+	m_pBackend->Signal( FenceValue );
+	m_NextFenceValue.store( FenceValue + 1, std::memory_order_relaxed );
+	return FenceValue;
+}
+
+uint64_t GpuQueue::Execute( uint32_t NumLists, void* const* ppLists )
+{
+	std::lock_guard<std::mutex> Lock( m_SubmitMutex );
+	uint64_t FenceValue = m_NextFenceValue.load( std::memory_order_relaxed );
+	m_pBackend->ExecuteAndSignal( NumLists, ppLists, FenceValue );
+	m_NextFenceValue.store( FenceValue + 1, std::memory_order_relaxed );
+	return FenceValue;
+}
+
+void GpuQueue::GpuWait( uint64_t FenceValue )
+{
+	ASSERT( (uint32_t)(FenceValue >> 56) != m_Type );
+	std::lock_guard<std::mutex> Lock( m_SubmitMutex );
+	m_pBackend->GpuWait( FenceValue );
+}
+
+uint64_t GpuQueue::GetCompletedFence()
+{
+	UpdateCompletedFence( m_pBackend->GetCompletedFence() );
+	return m_LastCompletedFenceValue.load( std::memory_order_acquire );
+}
+
+bool GpuQueue::IsFenceComplete( uint64_t FenceValue )
+{
+	if (FenceValue > m_LastCompletedFenceValue.load( std::memory_order_acquire ))
+		UpdateCompletedFence( m_pBackend->GetCompletedFence() );
+	return FenceValue <= m_LastCompletedFenceValue.load( std::memory_order_acquire );
+}
+
+bool GpuQueue::WaitForFence( uint64_t FenceValue, double& StallMs )
+{
+	StallMs = 0;
+	if (IsFenceComplete( FenceValue ))
+		return false;
+	auto Start = std::chrono::high_resolution_clock::now();
+	m_pBackend->WaitForFence( FenceValue );
+	std::chrono::duration<double, std::milli> Elapsed = std::chrono::high_resolution_clock::now() - Start;
+	StallMs = Elapsed.count();
+	UpdateCompletedFence( FenceValue );
+	return true;
+}
+
+void GpuQueue::UpdateCompletedFence( uint64_t FenceValue )
+{
+	uint64_t LastCompleted = m_LastCompletedFenceValue.load( std::memory_order_relaxed );
+	while (FenceValue > LastCompleted)
+	{
+		if (m_LastCompletedFenceValue.compare_exchange_weak( LastCompleted, FenceValue, std::memory_order_acq_rel ))
+		{
+			if (AllocTraceRecorder::IsRecording())
+				AllocTraceRecorder::FenceComplete( FenceValue );
+			return;
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+// Fence bookkeeping of one queue over an IGpuQueueBackend: hands out fence values in submission
+// order and caches the last completed one, so polling IsFenceComplete() rarely reaches the device.
+// CommandQueue wraps one with the D3D12 backend, headless tools with a NullQueueBackend.
+// Only std headers are used.
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+#include "GpuQueueBackend.h"
+#include "LinearPagePool.h"
+
+//--------------------------------------------------------------------------------------
+// GpuQueue
+//--------------------------------------------------------------------------------------
+class GpuQueue : public IFenceOracle
+{
+public:
+	explicit GpuQueue( uint32_t Type );
+
+	// The backend must start out with GetInitialFence() completed
+	void Create( IGpuQueueBackend* pBackend );
+	void Destroy();
+	bool IsReady() const { return m_pBackend != nullptr; }
+	uint32_t GetType() const { return m_Type; }
+	uint64_t GetInitialFence() const { return (uint64_t)m_Type << 56; }
+	IGpuQueueBackend* GetBackend() const { return m_pBackend; }
+
+	// Both return the fence signaled after the work
+	uint64_t Signal();
+	uint64_t Execute( uint32_t NumLists, void* const* ppLists );
+	// Submissions after this wait on the GPU for FenceValue of another queue
+	void GpuWait( uint64_t FenceValue );
+
+	// The fence the next submission will signal, work recorded now completes no earlier
+	uint64_t GetNextFenceValue() const { return m_NextFenceValue.load( std::memory_order_relaxed ); }
+	uint64_t GetCompletedFence();
+	virtual bool IsFenceComplete( uint64_t FenceValue ) override;
+	// False if FenceValue had completed already, otherwise StallMs is how long it blocked
+	bool WaitForFence( uint64_t FenceValue, double& StallMs );
+
+private:
+	void UpdateCompletedFence( uint64_t FenceValue );
+
+	const uint32_t				m_Type;
+	IGpuQueueBackend*			m_pBackend;
+	std::mutex					m_SubmitMutex;		// Keeps fence values in submission order
+	std::atomic<uint64_t>		m_NextFenceValue;
+	std::atomic<uint64_t>		m_LastCompletedFenceValue;
+};
@@ -0,0 +1,330 @@
+#include "PortableAssert.h"
+#include "GpuQueueBackend.h"
+
+#include <string.h>
+
+//--------------------------------------------------------------------------------------
+// NullQueueBackend
+//--------------------------------------------------------------------------------------
+NullQueueBackend::NullQueueBackend( uint64_t InitialFence )
+	:m_CompletedFence( InitialFence ), m_NumSubmissions( 0 ), m_Recording( true )
+{
+}
+
+void NullQueueBackend::ExecuteAndSignal( uint32_t NumLists, void* const* ppLists, uint64_t FenceValue )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	ASSERT( FenceValue > m_CompletedFence.load( std::memory_order_relaxed ) );
+	if (m_Recording)
+	{
+		Submission Entry = { FenceValue, 0, (uint32_t)m_Lists.size(), NumLists };
+		m_Submissions.push_back( Entry );
+		m_Lists.insert( m_Lists.end(), ppLists, ppLists + NumLists );
+	}
+	m_NumSubmissions.fetch_add( 1, std::memory_order_relaxed );
+	// Nothing to execute, the work is done as soon as it's submitted
+	m_CompletedFence.store( FenceValue, std::memory_order_release );
+}
+
+void NullQueueBackend::Signal( uint64_t FenceValue )
+{
+	ExecuteAndSignal( 0, nullptr, FenceValue );
+}
+
+void NullQueueBackend::GpuWait( uint64_t FenceValue )
+{
+	// Every signaled fence completed already, only recorded
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	if (m_Recording)
+	{
+		Submission Entry = { 0, FenceValue, (uint32_t)m_Lists.size(), 0 };
+		m_Submissions.push_back( Entry );
+	}
+}
+
+void NullQueueBackend::WaitForFence( uint64_t FenceValue )
+{
+	// Only fences already signaled can be waited on, and those completed right away
+	ASSERT( FenceValue <= m_CompletedFence.load( std::memory_order_acquire ) );
+	(void)FenceValue;
+}
+
+void NullQueueBackend::SetRecording( bool Enable )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_Recording = Enable;
+}
+
+void NullQueueBackend::ClearRecording()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_Submissions.clear();
+	m_Lists.clear();
+}
+
+std::vector<NullQueueBackend::Submission> NullQueueBackend::GetSubmissions()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	return m_Submissions;
+}
+
+std::vector<void*> NullQueueBackend::GetSubmittedLists()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	return m_Lists;
+}
+
+//--------------------------------------------------------------------------------------
+// NullCommandList
+//--------------------------------------------------------------------------------------
+NullCommandList::NullCommandList( uint32_t Type, void* pAllocator )
+	:m_Type( Type ), m_pAllocator( pAllocator ), m_Closed( false ), m_NumResets( 0 )
+{
+}
+
+void NullCommandList::Reset( void* pAllocator )
+{
+	ASSERT( m_Closed );
+	m_pAllocator = pAllocator;
+	m_Closed = false;
+	m_NumResets++;
+	m_Commands.clear();
+	m_Constants.clear();
+}
+
+void NullCommandList::Close()
+{
+	ASSERT( !m_Closed );
+	m_Closed = true;
+}
+
+NullCommandList::Command& NullCommandList::Record( uint32_t Op )
+{
+	ASSERT( !m_Closed );
+	m_Commands.push_back( Command() );
+	Command& Entry = m_Commands.back();
+	memset( &Entry, 0, sizeof( Entry ) );
+	Entry.Op = Op;
+	return Entry;
+}
+
+void NullCommandList::SetDescriptorHeaps( uint32_t NumHeaps, void* const* ppHeaps )
+{
+	ASSERT( NumHeaps <= 5 );
+	Command& Entry = Record( kSetDescriptorHeaps );
+	Entry.Args[0] = NumHeaps;
+	for (uint32_t i = 0; i < NumHeaps; ++i)
+		Entry.Values[i] = (uint64_t)(uintptr_t)ppHeaps[i];
+}
+
+void NullCommandList::SetRootSignature( bool Compute, void* pRootSignature )
+{
+	Command& Entry = Record( kSetRootSignature );
+	Entry.Args[0] = Compute;
+	Entry.Values[0] = (uint64_t)(uintptr_t)pRootSignature;
+}
+
+void NullCommandList::SetPipelineState( void* pPipelineState )
+{
+	Record( kSetPipelineState ).Values[0] = (uint64_t)(uintptr_t)pPipelineState;
+}
+
+void NullCommandList::SetRootConstants( bool Compute, uint32_t RootIndex, uint32_t NumConstants, const void* pConstants, uint32_t FirstConstant )
+{
+	Command& Entry = Record( kSetRootConstants );
+	Entry.Args[0] = Compute;
+	Entry.Args[1] = RootIndex;
+	Entry.Args[2] = NumConstants;
+	Entry.Args[3] = FirstConstant;
+	Entry.Args[4] = (uint32_t)m_Constants.size();
+	const uint32_t* pValues = (const uint32_t*)pConstants;
+	m_Constants.insert( m_Constants.end(), pValues, pValues + NumConstants );
+}
+
+void NullCommandList::SetRootDescriptorTable( bool Compute, uint32_t RootIndex, uint64_t GpuHandle )
+{
+	Command& Entry = Record( kSetRootDescriptorTable );
+	Entry.Args[0] = Compute;
+	Entry.Args[1] = RootIndex;
+	Entry.Values[0] = GpuHandle;
+}
+
+void NullCommandList::SetRootView( bool Compute, uint32_t RootIndex, RootView View, uint64_t GpuAddress )
+{
+	Command& Entry = Record( kSetRootView );
+	Entry.Args[0] = Compute;
+	Entry.Args[1] = RootIndex;
+	Entry.Args[2] = View;
+	Entry.Values[0] = GpuAddress;
+}
+
+void NullCommandList::CopyBuffer( void* pDest, uint64_t DestOffset, void* pSrc, uint64_t SrcOffset, uint64_t NumBytes )
+{
+	Command& Entry = Record( kCopyBuffer );
+	Entry.Values[0] = (uint64_t)(uintptr_t)pDest;
+	Entry.Values[1] = DestOffset;
+	Entry.Values[2] = (uint64_t)(uintptr_t)pSrc;
+	Entry.Values[3] = SrcOffset;
+	Entry.Values[4] = NumBytes;
+}
+
+void NullCommandList::Draw( uint32_t VertexCount, uint32_t InstanceCount, uint32_t StartVertex, uint32_t StartInstance )
+{
+	Command& Entry = Record( kDraw );
+	Entry.Args[0] = VertexCount;
+	Entry.Args[1] = InstanceCount;
+	Entry.Args[2] = StartVertex;
+	Entry.Args[3] = StartInstance;
+}
+
+void NullCommandList::DrawIndexed( uint32_t IndexCount, uint32_t InstanceCount, uint32_t StartIndex, int32_t BaseVertex, uint32_t StartInstance )
+{
+	Command& Entry = Record( kDrawIndexed );
+	Entry.Args[0] = IndexCount;
+	Entry.Args[1] = InstanceCount;
+	Entry.Args[2] = StartIndex;
+	Entry.Args[3] = (uint32_t)BaseVertex;
+	Entry.Args[4] = StartInstance;
+}
+
+void NullCommandList::Dispatch( uint32_t GroupCountX, uint32_t GroupCountY, uint32_t GroupCountZ )
+{
+	Command& Entry = Record( kDispatch );
+	Entry.Args[0] = GroupCountX;
+	Entry.Args[1] = GroupCountY;
+	Entry.Args[2] = GroupCountZ;
+}
+
+void NullCommandList::ExecuteIndirect( void* pSignature, uint32_t MaxCount, void* pArgBuffer, uint64_t ArgOffset,
+	void* pCountBuffer, uint64_t CountOffset )
+{
+	Command& Entry = Record( kExecuteIndirect );
+	Entry.Args[0] = MaxCount;
+	Entry.Values[0] = (uint64_t)(uintptr_t)pSignature;
+	Entry.Values[1] = (uint64_t)(uintptr_t)pArgBuffer;
+	Entry.Values[2] = ArgOffset;
+	Entry.Values[3] = (uint64_t)(uintptr_t)pCountBuffer;
+	Entry.Values[4] = CountOffset;
+}
+
+//--------------------------------------------------------------------------------------
+// NullDeviceBackend
+//--------------------------------------------------------------------------------------
+namespace
+{
+	class NullLinearPage : public LinearPage
+	{
+	public:
+		NullLinearPage( size_t SizeInByte, bool CpuWritable, uint64_t GpuAddress )
+			:m_Memory( CpuWritable ? SizeInByte : 0 )
+		{
+			m_SizeInByte = SizeInByte;
+			m_CpuVirtualAddr = CpuWritable ? m_Memory.data() : nullptr;
+			m_GpuVirtualAddr = GpuAddress;
+		}
+
+	private:
+		std::vector<uint8_t>	m_Memory;
+	};
+
+	struct NullDescriptorHeap
+	{
+		uint32_t	Type;
+		uint32_t	NumDescriptors;
+	};
+
+	// Far apart so addresses of pages, CPU and GPU descriptors can't be mistaken for each other
+	const uint64_t kGpuAddressBase = 1ull << 40;
+	const uint64_t kCpuDescriptorBase = 2ull << 40;
+	const uint64_t kGpuDescriptorBase = 3ull << 40;
+}
+
+NullDeviceBackend::NullDeviceBackend()
+	:m_NextGpuAddress( kGpuAddressBase ), m_NextCpuDescriptor( kCpuDescriptorBase ), m_NextGpuDescriptor( kGpuDescriptorBase ),
+	m_Stats()
+{
+}
+
+LinearPage* NullDeviceBackend::CreateLinearPage( size_t SizeInByte, bool CpuWritable )
+{
+	uint64_t GpuAddress;
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		GpuAddress = m_NextGpuAddress;
+		m_NextGpuAddress += (SizeInByte + LinearPagePool::kLargePageAlign - 1) & ~(uint64_t)(LinearPagePool::kLargePageAlign - 1);
+		m_Stats.NumPages++;
+		m_Stats.PageBytes += SizeInByte;
+		m_Stats.NumPagesCreated++;
+	}
+	return new NullLinearPage( SizeInByte, CpuWritable, GpuAddress );
+}
+
+void NullDeviceBackend::DestroyLinearPage( LinearPage* pPage )
+{
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		ASSERT( m_Stats.NumPages > 0 );
+		m_Stats.NumPages--;
+		m_Stats.PageBytes -= pPage->m_SizeInByte;
+	}
+	delete pPage;
+}
+
+GpuDescriptorHeap NullDeviceBackend::CreateDescriptorHeap( uint32_t Type, uint32_t NumDescriptors, bool ShaderVisible )
+{
+	NullDescriptorHeap* pHeap = new NullDescriptorHeap;
+	pHeap->Type = Type;
+	pHeap->NumDescriptors = NumDescriptors;
+	GpuDescriptorHeap Heap = { pHeap, 0, 0 };
+	const uint64_t Size = (uint64_t)NumDescriptors * kDescriptorSize;
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	Heap.CpuBase = m_NextCpuDescriptor;
+	m_NextCpuDescriptor += Size;
+	if (ShaderVisible)
+	{
+		Heap.GpuBase = m_NextGpuDescriptor;
+		m_NextGpuDescriptor += Size;
+	}
+	m_Stats.NumHeaps++;
+	m_Stats.NumDescriptors += NumDescriptors;
+	m_Stats.NumHeapsCreated++;
+	return Heap;
+}
+
+void NullDeviceBackend::DestroyDescriptorHeap( const GpuDescriptorHeap& Heap )
+{
+	NullDescriptorHeap* pHeap = (NullDescriptorHeap*)Heap.pNative;
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		ASSERT( m_Stats.NumHeaps > 0 );
+		m_Stats.NumHeaps--;
+		m_Stats.NumDescriptors -= pHeap->NumDescriptors;
+	}
+	delete pHeap;
+}
+
+IGpuCommandList* NullDeviceBackend::CreateCommandList( uint32_t Type, void* pAllocator )
+{
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		m_Stats.NumLists++;
+		m_Stats.NumListsCreated++;
+	}
+	return new NullCommandList( Type, pAllocator );
+}
+
+void NullDeviceBackend::DestroyCommandList( IGpuCommandList* pList )
+{
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		ASSERT( m_Stats.NumLists > 0 );
+		m_Stats.NumLists--;
+	}
+	delete pList;
+}
+
+NullDeviceStats NullDeviceBackend::GetStats()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	return m_Stats;
+}
@@ -0,0 +1,256 @@
+#pragma once
+// What CommandQueue, the allocators and CommandContext need from the device, so they can run
+// headless. IGpuQueueBackend submits command lists, signals its fence, reads the completed value
+// and blocks until a value completed. IGpuDeviceBackend creates LinearAllocator pages, descriptor
+// heaps and command lists, IGpuCommandList records into one. The D3D12 implementations live next to
+// CommandQueue. The null ones accept every call: NullQueueBackend completes each fence as soon as it
+// is signaled and records what was submitted, NullDeviceBackend hands out pages of plain memory and
+// made up addresses, NullCommandList records every command into a buffer. Device objects, command
+// lists and allocators are opaque pointers here, D3D12 passes ID3D12CommandList* and the like.
+// Fence values carry the queue type in the top 8 bits, (uint64_t)Type << 56 | n, a backend starts
+// out with Type << 56 completed.
+// Not behind the interfaces yet, and still D3D12 only: command allocators, barriers, vertex and
+// index buffers, render targets, viewports, clears, queries, PIX events, texture copies, and
+// creating resources, PSOs and root signatures. CommandContext records those on the list's D3D12
+// one, so it only runs over the D3D12 backend, the null device drives the queues and allocators.
+// Neither sample's frame loop runs headless for that reason.
+// Only std headers are used.
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "LinearPagePool.h"
+
+class IGpuQueueBackend
+{
+public:
+	virtual ~IGpuQueueBackend() {}
+	// Runs the lists in order, then signals FenceValue
+	virtual void ExecuteAndSignal( uint32_t NumLists, void* const* ppLists, uint64_t FenceValue ) = 0;
+	virtual void Signal( uint64_t FenceValue ) = 0;
+	// Work submitted after this doesn't start before FenceValue, of any queue, completed. The CPU
+	// doesn't wait, FenceValue must have been submitted already.
+	virtual void GpuWait( uint64_t FenceValue ) = 0;
+	virtual uint64_t GetCompletedFence() = 0;
+	// Blocks the calling thread until FenceValue completed
+	virtual void WaitForFence( uint64_t FenceValue ) = 0;
+};
+
+//--------------------------------------------------------------------------------------
+// NullQueueBackend
+//--------------------------------------------------------------------------------------
+class NullQueueBackend : public IGpuQueueBackend
+{
+public:
+	struct Submission
+	{
+		uint64_t	FenceValue;			// 0 for a GpuWait()
+		uint64_t	WaitFenceValue;		// Of a GpuWait(), 0 otherwise
+		uint32_t	FirstList;			// Into GetSubmittedLists(), NumLists 0 for a plain Signal()
+		uint32_t	NumLists;
+	};
+
+	explicit NullQueueBackend( uint64_t InitialFence );
+
+	virtual void ExecuteAndSignal( uint32_t NumLists, void* const* ppLists, uint64_t FenceValue ) override;
+	virtual void Signal( uint64_t FenceValue ) override;
+	virtual void GpuWait( uint64_t FenceValue ) override;
+	virtual uint64_t GetCompletedFence() override { return m_CompletedFence.load( std::memory_order_acquire ); }
+	virtual void WaitForFence( uint64_t FenceValue ) override;
+
+	// Recording is on by default, benchmarks turn it off to keep memory flat
+	void SetRecording( bool Enable );
+	void ClearRecording();
+	std::vector<Submission> GetSubmissions();
+	std::vector<void*> GetSubmittedLists();
+	uint64_t GetNumSubmissions() const { return m_NumSubmissions.load( std::memory_order_relaxed ); }
+
+private:
+	std::mutex					m_Mutex;
+	std::atomic<uint64_t>		m_CompletedFence;
+	std::atomic<uint64_t>		m_NumSubmissions;
+	bool						m_Recording;
+	std::vector<Submission>		m_Submissions;
+	std::vector<void*>			m_Lists;
+};
+
+//--------------------------------------------------------------------------------------
+// IGpuCommandList
+//--------------------------------------------------------------------------------------
+// Recording of one command list. Heaps, root signatures, pipeline states and resources are the
+// device's own pointers, descriptor tables and root views are GPU handles and addresses. Graphics
+// and compute bindings are kept apart like on D3D12, Compute picks which.
+class IGpuCommandList
+{
+public:
+	enum RootView
+	{
+		kConstantBufferView,
+		kShaderResourceView,
+		kUnorderedAccessView,
+	};
+
+	virtual ~IGpuCommandList() {}
+	// Records into pAllocator from scratch, the lists recorded into it before must have completed
+	virtual void Reset( void* pAllocator ) = 0;
+	virtual void Close() = 0;
+	// What IGpuQueueBackend::ExecuteAndSignal() takes
+	virtual void* GetNativeList() = 0;
+	// The ID3D12GraphicsCommandList* for what isn't behind the interface yet, nullptr if there is none
+	virtual void* GetD3D12List() = 0;
+
+	virtual void SetDescriptorHeaps( uint32_t NumHeaps, void* const* ppHeaps ) = 0;
+	virtual void SetRootSignature( bool Compute, void* pRootSignature ) = 0;
+	virtual void SetPipelineState( void* pPipelineState ) = 0;
+	virtual void SetRootConstants( bool Compute, uint32_t RootIndex, uint32_t NumConstants, const void* pConstants, uint32_t FirstConstant ) = 0;
+	virtual void SetRootDescriptorTable( bool Compute, uint32_t RootIndex, uint64_t GpuHandle ) = 0;
+	virtual void SetRootView( bool Compute, uint32_t RootIndex, RootView View, uint64_t GpuAddress ) = 0;
+	virtual void CopyBuffer( void* pDest, uint64_t DestOffset, void* pSrc, uint64_t SrcOffset, uint64_t NumBytes ) = 0;
+	virtual void Draw( uint32_t VertexCount, uint32_t InstanceCount, uint32_t StartVertex, uint32_t StartInstance ) = 0;
+	virtual void DrawIndexed( uint32_t IndexCount, uint32_t InstanceCount, uint32_t StartIndex, int32_t BaseVertex, uint32_t StartInstance ) = 0;
+	virtual void Dispatch( uint32_t GroupCountX, uint32_t GroupCountY, uint32_t GroupCountZ ) = 0;
+	// pCountBuffer may be nullptr, MaxCount commands are run then
+	virtual void ExecuteIndirect( void* pSignature, uint32_t MaxCount, void* pArgBuffer, uint64_t ArgOffset,
+		void* pCountBuffer, uint64_t CountOffset ) = 0;
+};
+
+//--------------------------------------------------------------------------------------
+// IGpuDeviceBackend
+//--------------------------------------------------------------------------------------
+struct GpuDescriptorHeap
+{
+	void*		pNative;		// ID3D12DescriptorHeap* on D3D12
+	uint64_t	CpuBase;
+	uint64_t	GpuBase;		// 0 unless shader visible
+};
+
+class IGpuDeviceBackend
+{
+public:
+	virtual ~IGpuDeviceBackend() {}
+	// A mapped buffer in an upload heap if CpuWritable, otherwise in a default heap with UAV access
+	// and no CPU address
+	virtual LinearPage* CreateLinearPage( size_t SizeInByte, bool CpuWritable ) = 0;
+	virtual void DestroyLinearPage( LinearPage* pPage ) = 0;
+	// Type is a D3D12_DESCRIPTOR_HEAP_TYPE
+	virtual GpuDescriptorHeap CreateDescriptorHeap( uint32_t Type, uint32_t NumDescriptors, bool ShaderVisible ) = 0;
+	virtual void DestroyDescriptorHeap( const GpuDescriptorHeap& Heap ) = 0;
+	virtual uint32_t GetDescriptorSize( uint32_t Type ) = 0;
+	// Type is a D3D12_COMMAND_LIST_TYPE, the list starts out recording into pAllocator
+	virtual IGpuCommandList* CreateCommandList( uint32_t Type, void* pAllocator ) = 0;
+	virtual void DestroyCommandList( IGpuCommandList* pList ) = 0;
+};
+
+//--------------------------------------------------------------------------------------
+// NullCommandList
+//--------------------------------------------------------------------------------------
+class NullCommandList : public IGpuCommandList
+{
+public:
+	enum Op
+	{
+		kSetDescriptorHeaps,		// Args[0] heaps in Values
+		kSetRootSignature,			// Args[0] Compute, Values[0]
+		kSetPipelineState,			// Values[0]
+		kSetRootConstants,			// Args Compute, RootIndex, NumConstants, FirstConstant, index into GetConstants()
+		kSetRootDescriptorTable,	// Args Compute, RootIndex, Values[0] GPU handle
+		kSetRootView,				// Args Compute, RootIndex, RootView, Values[0] GPU address
+		kCopyBuffer,				// Values Dest, DestOffset, Src, SrcOffset, NumBytes
+		kDraw,						// Args VertexCount, InstanceCount, StartVertex, StartInstance
+		kDrawIndexed,				// Args IndexCount, InstanceCount, StartIndex, BaseVertex, StartInstance
+		kDispatch,					// Args GroupCountX, Y, Z
+		kExecuteIndirect,			// Args[0] MaxCount, Values Signature, ArgBuffer, ArgOffset, CountBuffer, CountOffset
+	};
+
+	struct Command
+	{
+		uint32_t	Op;
+		uint32_t	Args[5];
+		uint64_t	Values[5];
+	};
+
+	NullCommandList( uint32_t Type, void* pAllocator );
+
+	virtual void Reset( void* pAllocator ) override;
+	virtual void Close() override;
+	virtual void* GetNativeList() override { return this; }
+	virtual void* GetD3D12List() override { return nullptr; }
+
+	virtual void SetDescriptorHeaps( uint32_t NumHeaps, void* const* ppHeaps ) override;
+	virtual void SetRootSignature( bool Compute, void* pRootSignature ) override;
+	virtual void SetPipelineState( void* pPipelineState ) override;
+	virtual void SetRootConstants( bool Compute, uint32_t RootIndex, uint32_t NumConstants, const void* pConstants, uint32_t FirstConstant ) override;
+	virtual void SetRootDescriptorTable( bool Compute, uint32_t RootIndex, uint64_t GpuHandle ) override;
+	virtual void SetRootView( bool Compute, uint32_t RootIndex, RootView View, uint64_t GpuAddress ) override;
+	virtual void CopyBuffer( void* pDest, uint64_t DestOffset, void* pSrc, uint64_t SrcOffset, uint64_t NumBytes ) override;
+	virtual void Draw( uint32_t VertexCount, uint32_t InstanceCount, uint32_t StartVertex, uint32_t StartInstance ) override;
+	virtual void DrawIndexed( uint32_t IndexCount, uint32_t InstanceCount, uint32_t StartIndex, int32_t BaseVertex, uint32_t StartInstance ) override;
+	virtual void Dispatch( uint32_t GroupCountX, uint32_t GroupCountY, uint32_t GroupCountZ ) override;
+	virtual void ExecuteIndirect( void* pSignature, uint32_t MaxCount, void* pArgBuffer, uint64_t ArgOffset,
+		void* pCountBuffer, uint64_t CountOffset ) override;
+
+	uint32_t GetType() const { return m_Type; }
+	void* GetAllocator() const { return m_pAllocator; }
+	bool IsClosed() const { return m_Closed; }
+	// What was recorded since the last Reset()
+	const std::vector<Command>& GetCommands() const { return m_Commands; }
+	const std::vector<uint32_t>& GetConstants() const { return m_Constants; }
+	uint64_t GetNumResets() const { return m_NumResets; }
+
+private:
+	Command& Record( uint32_t Op );
+
+	const uint32_t				m_Type;
+	void*						m_pAllocator;
+	bool						m_Closed;
+	uint64_t					m_NumResets;
+	std::vector<Command>		m_Commands;
+	std::vector<uint32_t>		m_Constants;
+};
+
+//--------------------------------------------------------------------------------------
+// NullDeviceBackend
+//--------------------------------------------------------------------------------------
+struct NullDeviceStats
+{
+	uint32_t	NumPages;			// Alive
+	uint64_t	PageBytes;
+	uint32_t	NumHeaps;
+	uint64_t	NumDescriptors;
+	uint32_t	NumLists;
+	uint64_t	NumPagesCreated;	// Since the backend was made
+	uint64_t	NumHeapsCreated;
+	uint64_t	NumListsCreated;
+};
+
+// Thread-safe. CPU writable pages are plain memory so writing to them costs what it would, GPU
+// addresses and descriptor handles are made up and never overlap.
+class NullDeviceBackend : public IGpuDeviceBackend
+{
+public:
+	enum
+	{
+		kDescriptorSize = 32,
+	};
+
+	NullDeviceBackend();
+
+	virtual LinearPage* CreateLinearPage( size_t SizeInByte, bool CpuWritable ) override;
+	virtual void DestroyLinearPage( LinearPage* pPage ) override;
+	virtual GpuDescriptorHeap CreateDescriptorHeap( uint32_t Type, uint32_t NumDescriptors, bool ShaderVisible ) override;
+	virtual void DestroyDescriptorHeap( const GpuDescriptorHeap& Heap ) override;
+	virtual uint32_t GetDescriptorSize( uint32_t ) override { return kDescriptorSize; }
+	virtual IGpuCommandList* CreateCommandList( uint32_t Type, void* pAllocator ) override;
+	virtual void DestroyCommandList( IGpuCommandList* pList ) override;
+
+	NullDeviceStats GetStats();
+
+private:
+	std::mutex			m_Mutex;
+	uint64_t			m_NextGpuAddress;
+	uint64_t			m_NextCpuDescriptor;
+	uint64_t			m_NextGpuDescriptor;
+	NullDeviceStats		m_Stats;
+};
@@ -4,6 +4,7 @@
 #include "CommandContext.h"
 #include "Utility.h"
 #include "DDSTextureLoader.h"
+#include "BindlessDescriptorHeap.h"
 #include "GpuResource.h"
 
 //--------------------------------------------------------------------------------------
@@ -72,6 +73,23 @@ void PixelBuffer::CreateTextureResource( ID3D12Device* Device, const std::wstrin
 	m_GpuVirtualAddress = D3D12_GPU_VIRTUAL_ADDRESS_NULL;
 }
 
+void PixelBuffer::CreatePlacedTextureResource( ID3D12Device* Device, const std::wstring& Name,
+	const D3D12_RESOURCE_DESC& ResourceDesc, D3D12_CLEAR_VALUE ClearValue, ID3D12Heap* BackingHeap, uint64_t HeapOffset )
+{
+	HRESULT hr;
+	V( Device->CreatePlacedResource( BackingHeap, HeapOffset, &ResourceDesc, D3D12_RESOURCE_STATE_COMMON,
+		&ClearValue, IID_PPV_ARGS( &m_pResource ) ) );
+
+	m_UsageState = D3D12_RESOURCE_STATE_COMMON;
+	m_TransitioningState = (D3D12_RESOURCE_STATES)-1;
+	m_GpuVirtualAddress = D3D12_GPU_VIRTUAL_ADDRESS_NULL;
+#ifdef RELEASE
+	( Name );
+#else
+	m_pResource->SetName( Name.c_str() );
+#endif
+}
+
 DXGI_FORMAT PixelBuffer::GetBaseFormat( DXGI_FORMAT defaultFormat )
 {
 	switch (defaultFormat)
@@ -270,10 +288,19 @@ void ColorBuffer::CreateFromSwapChain( const std::wstring& Name, ID3D12Resource*
 {
 	AssociateWithResource( Graphics::g_device.Get(), Name, BaseResource, D3D12_RESOURCE_STATE_PRESENT );
 	if (m_RTVHandle.ptr == ~0ull)
-		m_RTVHandle = Graphics::g_pRTVDescriptorHeap->Append().GetCPUHandle();
+		m_RTVHandle = Graphics::g_pRTVDescriptorHeap->Allocate().GetCPUHandle();
 	Graphics::g_device->CreateRenderTargetView( m_pResource.Get(), nullptr, m_RTVHandle );
 }
 
+void ColorBuffer::Destroy()
+{
+	FreeDescriptor( Graphics::g_pRTVDescriptorHeap, m_RTVHandle );
+	FreeDescriptor( Graphics::g_pCSUDescriptorHeap, m_SRVHandle );
+	for (uint32_t i = 0; i < _countof( m_UAVHandle ); ++i)
+		FreeDescriptor( Graphics::g_pCSUDescriptorHeap, m_UAVHandle[i] );
+	GpuResource::Destroy();
+}
+
 void ColorBuffer::Create( const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t NumMips,
 	DXGI_FORMAT Format, D3D12_GPU_VIRTUAL_ADDRESS VidMemPtr /* = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN */ )
 {
@@ -292,6 +319,24 @@ void ColorBuffer::Create( const std::wstring& Name, uint32_t Width, uint32_t Hei
 	CreateDerivedViews( Graphics::g_device.Get(), Format, 1, NumMips );
 }
 
+void ColorBuffer::CreatePlaced( const std::wstring& Name, ID3D12Heap* BackingHeap, uint64_t HeapOffset, uint32_t Width, uint32_t Height,
+	uint32_t NumMips, DXGI_FORMAT Format )
+{
+	NumMips = (NumMips == 0 ? ComputeNumMips( Width, Height ) : NumMips);
+	D3D12_RESOURCE_DESC ResourceDesc = DescribeTex2D( Width, Height, 1, NumMips, Format,
+		D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS );
+
+	D3D12_CLEAR_VALUE ClearValue = {};
+	ClearValue.Format = Format;
+	ClearValue.Color[0] = DirectX::XMVectorGetX( m_ClearColor );
+	ClearValue.Color[1] = DirectX::XMVectorGetY( m_ClearColor );
+	ClearValue.Color[2] = DirectX::XMVectorGetZ( m_ClearColor );
+	ClearValue.Color[3] = DirectX::XMVectorGetW( m_ClearColor );
+
+	CreatePlacedTextureResource( Graphics::g_device.Get(), Name, ResourceDesc, ClearValue, BackingHeap, HeapOffset );
+	CreateDerivedViews( Graphics::g_device.Get(), Format, 1, NumMips );
+}
+
 void ColorBuffer::CreateDerivedViews( ID3D12Device* Device, DXGI_FORMAT Format, uint32_t ArraySize, uint32_t NumMips /* = 1 */ )
 {
 	ASSERT( ArraySize == 1 || NumMips == 1 );
@@ -334,8 +379,8 @@ void ColorBuffer::CreateDerivedViews( ID3D12Device* Device, DXGI_FORMAT Format,
 
 	if (m_SRVHandle.ptr == ~0ull)
 	{
-		m_RTVHandle = Graphics::g_pRTVDescriptorHeap->Append().GetCPUHandle();
-		m_SRVHandle = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+		m_RTVHandle = Graphics::g_pRTVDescriptorHeap->Allocate().GetCPUHandle();
+		m_SRVHandle = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 	}
 
 	ID3D12Resource* Resource = m_pResource.Get();
@@ -344,7 +389,7 @@ void ColorBuffer::CreateDerivedViews( ID3D12Device* Device, DXGI_FORMAT Format,
 	for (uint32_t i = 0; i < NumMips; ++i)
 	{
 		if (m_UAVHandle[i].ptr == ~0ull)
-			m_UAVHandle[i] = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+			m_UAVHandle[i] = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 		Device->CreateUnorderedAccessView( Resource, nullptr, &UAVDesc, m_UAVHandle[i] );
 		UAVDesc.Texture2D.MipSlice++;
 	}
@@ -364,6 +409,21 @@ DepthBuffer::DepthBuffer( FLOAT ClearDepth /* = .0f */, UINT8 ClearStencil /* =
 	m_StencilSRVHandle.ptr = ~0ull;
 }
 
+void DepthBuffer::Destroy()
+{
+	// Without stencil the stencil read-only views alias the depth ones
+	if (m_DSVHandle[2].ptr == m_DSVHandle[0].ptr)
+	{
+		m_DSVHandle[2].ptr = ~0ull;
+		m_DSVHandle[3].ptr = ~0ull;
+	}
+	for (uint32_t i = 0; i < _countof( m_DSVHandle ); ++i)
+		FreeDescriptor( Graphics::g_pDSVDescriptorHeap, m_DSVHandle[i] );
+	FreeDescriptor( Graphics::g_pCSUDescriptorHeap, m_DepthSRVHandle );
+	FreeDescriptor( Graphics::g_pCSUDescriptorHeap, m_StencilSRVHandle );
+	GpuResource::Destroy();
+}
+
 void DepthBuffer::Create( const std::wstring& Name, uint32_t Width, uint32_t Height, DXGI_FORMAT Format,
 	D3D12_GPU_VIRTUAL_ADDRESS VidMemPtr /* = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN */ )
 {
@@ -376,6 +436,18 @@ void DepthBuffer::Create( const std::wstring& Name, uint32_t Width, uint32_t Hei
 	CreateDerivedViews( Graphics::g_device.Get(), Format );
 }
 
+void DepthBuffer::CreatePlaced( const std::wstring& Name, ID3D12Heap* BackingHeap, uint64_t HeapOffset, uint32_t Width, uint32_t Height,
+	DXGI_FORMAT Format )
+{
+	D3D12_RESOURCE_DESC ResourceDesc = DescribeTex2D( Width, Height, 1, 1, Format, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL );
+	D3D12_CLEAR_VALUE ClearValue = {};
+	ClearValue.Format = Format;
+	ClearValue.DepthStencil.Depth = m_ClearDepth;
+	ClearValue.DepthStencil.Stencil = m_ClearStencil;
+	CreatePlacedTextureResource( Graphics::g_device.Get(), Name, ResourceDesc, ClearValue, BackingHeap, HeapOffset );
+	CreateDerivedViews( Graphics::g_device.Get(), Format );
+}
+
 void DepthBuffer::CreateDerivedViews( ID3D12Device* Device, DXGI_FORMAT Format )
 {
 	ID3D12Resource* Resource = m_pResource.Get();
@@ -385,8 +457,8 @@ void DepthBuffer::CreateDerivedViews( ID3D12Device* Device, DXGI_FORMAT Format )
 	DSVDesc.Texture2D.MipSlice = 0;
 	if (m_DSVHandle[0].ptr == ~0ull)
 	{
-		m_DSVHandle[0] = Graphics::g_pDSVDescriptorHeap->Append().GetCPUHandle();
-		m_DSVHandle[1] = Graphics::g_pDSVDescriptorHeap->Append().GetCPUHandle();
+		m_DSVHandle[0] = Graphics::g_pDSVDescriptorHeap->Allocate().GetCPUHandle();
+		m_DSVHandle[1] = Graphics::g_pDSVDescriptorHeap->Allocate().GetCPUHandle();
 	}
 	DSVDesc.Flags = D3D12_DSV_FLAG_NONE;
 	Device->CreateDepthStencilView( Resource, &DSVDesc, m_DSVHandle[0] );
@@ -398,8 +470,8 @@ void DepthBuffer::CreateDerivedViews( ID3D12Device* Device, DXGI_FORMAT Format )
 	{
 		if (m_DSVHandle[2].ptr == ~0ull)
 		{
-			m_DSVHandle[2] = Graphics::g_pDSVDescriptorHeap->Append().GetCPUHandle();
-			m_DSVHandle[3] = Graphics::g_pDSVDescriptorHeap->Append().GetCPUHandle();
+			m_DSVHandle[2] = Graphics::g_pDSVDescriptorHeap->Allocate().GetCPUHandle();
+			m_DSVHandle[3] = Graphics::g_pDSVDescriptorHeap->Allocate().GetCPUHandle();
 		}
 		DSVDesc.Flags = D3D12_DSV_FLAG_READ_ONLY_STENCIL;
 		Device->CreateDepthStencilView( Resource, &DSVDesc, m_DSVHandle[2] );
@@ -413,7 +485,7 @@ void DepthBuffer::CreateDerivedViews( ID3D12Device* Device, DXGI_FORMAT Format )
 	}
 
 	if (m_DepthSRVHandle.ptr == ~0ull)
-		m_DepthSRVHandle = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+		m_DepthSRVHandle = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 	D3D12_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
 	SRVDesc.Format = GetDepthFormat( Format );
 	SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
@@ -425,7 +497,7 @@ void DepthBuffer::CreateDerivedViews( ID3D12Device* Device, DXGI_FORMAT Format )
 	{
 		if (m_StencilSRVHandle.ptr == ~0ull)
 		{
-			m_StencilSRVHandle = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+			m_StencilSRVHandle = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 		}
 		SRVDesc.Format = stencilReadFormat;
 		Device->CreateShaderResourceView( Resource, &SRVDesc, m_StencilSRVHandle );
@@ -438,6 +510,10 @@ void DepthBuffer::CreateDerivedViews( ID3D12Device* Device, DXGI_FORMAT Format )
 //--------------------------------------------------------------------------------------
 void GpuBuffer::Destroy()
 {
+	FreeDescriptor( Graphics::g_pCSUDescriptorHeap, m_SRV );
+	FreeDescriptor( Graphics::g_pCSUDescriptorHeap, m_UAV );
+	BindlessDescriptorHeap::Release( m_BindlessSRV );
+	BindlessDescriptorHeap::Release( m_BindlessUAV );
 	GpuResource::Destroy();
 }
 
@@ -507,7 +583,7 @@ D3D12_CPU_DESCRIPTOR_HANDLE GpuBuffer::CreateConstantBufferView( uint32_t Offset
 	CBVDesc.BufferLocation = m_GpuVirtualAddress + (size_t)Offset;
 	CBVDesc.SizeInBytes = Size;
 
-	D3D12_CPU_DESCRIPTOR_HANDLE hCBV = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+	D3D12_CPU_DESCRIPTOR_HANDLE hCBV = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 	Graphics::g_device->CreateConstantBufferView( &CBVDesc, hCBV );
 	return hCBV;
 }
@@ -518,6 +594,18 @@ GpuBuffer::GpuBuffer()
 	m_ResourceFlags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
 	m_UAV.ptr = ~0ull;
 	m_SRV.ptr = ~0ull;
+	m_BindlessSRV = BindlessDescriptorHeap::kInvalidHandle;
+	m_BindlessUAV = BindlessDescriptorHeap::kInvalidHandle;
+}
+
+uint32_t GpuBuffer::GetBindlessSRV() const
+{
+	return BindlessDescriptorHeap::GetIndex( m_BindlessSRV );
+}
+
+uint32_t GpuBuffer::GetBindlessUAV() const
+{
+	return BindlessDescriptorHeap::GetIndex( m_BindlessUAV );
 }
 
 D3D12_RESOURCE_DESC GpuBuffer::DescribeBuffer()
@@ -551,7 +639,7 @@ void ByteAddressBuffer::CreateDerivedViews()
 	SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
 
 	if (m_SRV.ptr == ~0ull)
-		m_SRV = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+		m_SRV = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 	Graphics::g_device->CreateShaderResourceView( m_pResource.Get(), &SRVDesc, m_SRV );
 
 	D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
@@ -561,7 +649,7 @@ void ByteAddressBuffer::CreateDerivedViews()
 	UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
 
 	if (m_UAV.ptr == ~0ull)
-		m_UAV = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+		m_UAV = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 	Graphics::g_device->CreateUnorderedAccessView( m_pResource.Get(), nullptr, &UAVDesc, m_UAV );
 }
 
@@ -585,7 +673,7 @@ void StructuredBuffer::CreateDerivedViews()
 	SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
 
 	if (m_SRV.ptr == ~0ull)
-		m_SRV = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+		m_SRV = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 	Graphics::g_device->CreateShaderResourceView( m_pResource.Get(), &SRVDesc, m_SRV );
 
 	D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
@@ -599,8 +687,11 @@ void StructuredBuffer::CreateDerivedViews()
 	m_CounterBuffer.Create( L"StructuredBuffer::Counter", 1, 4 );
 
 	if (m_UAV.ptr == ~0ull)
-		m_UAV = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+		m_UAV = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 	Graphics::g_device->CreateUnorderedAccessView( m_pResource.Get(), m_CounterBuffer.GetResource(), &UAVDesc, m_UAV );
+
+	BindlessDescriptorHeap::Register( m_BindlessSRV, m_SRV );
+	BindlessDescriptorHeap::Register( m_BindlessUAV, m_UAV );
 }
 
 ByteAddressBuffer& StructuredBuffer::GetCounterBuffer()
@@ -633,7 +724,7 @@ void TypedBuffer::CreateDerivedViews()
 	SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
 
 	if (m_SRV.ptr == ~0ull)
-		m_SRV = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+		m_SRV = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 	Graphics::g_device->CreateShaderResourceView( m_pResource.Get(), &SRVDesc, m_SRV );
 
 	D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
@@ -643,7 +734,7 @@ void TypedBuffer::CreateDerivedViews()
 	UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
 
 	if (m_UAV.ptr == ~0ull)
-		m_UAV = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+		m_UAV = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 	Graphics::g_device->CreateUnorderedAccessView( m_pResource.Get(), nullptr, &UAVDesc, m_UAV );
 }
 
@@ -651,12 +742,13 @@ void TypedBuffer::CreateDerivedViews()
 // Texture
 //--------------------------------------------------------------------------------------
 Texture::Texture()
+	:m_OwnsDescriptor( true ), m_BindlessSRV( BindlessDescriptorHeap::kInvalidHandle )
 {
 	m_hCpuDescriptorHandle.ptr = ~0ull;
 }
 
 Texture::Texture( D3D12_CPU_DESCRIPTOR_HANDLE Handle )
-	:m_hCpuDescriptorHandle( Handle )
+	:m_hCpuDescriptorHandle( Handle ), m_OwnsDescriptor( false ), m_BindlessSRV( BindlessDescriptorHeap::kInvalidHandle )
 {
 }
 
@@ -696,20 +788,26 @@ void Texture::Create( size_t Width, size_t Height, DXGI_FORMAT Format, const voi
 	CommandContext::InitializeTexture( *this, 1, &texResource );
 
 	if (m_hCpuDescriptorHandle.ptr == ~0ull)
-		m_hCpuDescriptorHandle = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+		m_hCpuDescriptorHandle = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 	Graphics::g_device->CreateShaderResourceView( m_pResource.Get(), nullptr, m_hCpuDescriptorHandle );
+	BindlessDescriptorHeap::Register( m_BindlessSRV, m_hCpuDescriptorHandle );
 }
 
 bool Texture::CreateFromFIle( const wchar_t* FileName, bool sRGB )
 {
 	if (m_hCpuDescriptorHandle.ptr == ~0ull)
-		m_hCpuDescriptorHandle = Graphics::g_pCSUDescriptorHeap->Append().GetCPUHandle();
+		m_hCpuDescriptorHandle = Graphics::g_pCSUDescriptorHeap->Allocate().GetCPUHandle();
 	HRESULT hr = CreateDDSTextureFromFile( Graphics::g_device.Get(), FileName, 0, sRGB, &m_pResource, m_hCpuDescriptorHandle );
+	if (SUCCEEDED( hr ))
+		BindlessDescriptorHeap::Register( m_BindlessSRV, m_hCpuDescriptorHandle );
 	return SUCCEEDED( hr );
 }
 
 void Texture::Destroy()
 {
+	if (m_OwnsDescriptor)
+		FreeDescriptor( Graphics::g_pCSUDescriptorHeap, m_hCpuDescriptorHandle );
+	BindlessDescriptorHeap::Release( m_BindlessSRV );
 	GpuResource::Destroy();
 }
 
@@ -718,6 +816,11 @@ const D3D12_CPU_DESCRIPTOR_HANDLE& Texture::GetSRV() const
 	return m_hCpuDescriptorHandle;
 }
 
+uint32_t Texture::GetBindlessSRV() const
+{
+	return BindlessDescriptorHeap::GetIndex( m_BindlessSRV );
+}
+
 bool Texture::operator!()
 {
 	return m_hCpuDescriptorHandle.ptr == 0;
@@ -43,6 +43,8 @@ public:
 	const ID3D12Resource* GetResource() const { return m_pResource.Get(); }
 
 	D3D12_GPU_VIRTUAL_ADDRESS GetGpuVirtualAddress() const { return m_GpuVirtualAddress; }
+	// As recorded so far, not as the GPU has it yet
+	D3D12_RESOURCE_STATES GetUsageState() const { return m_UsageState; }
 
 protected:
 
@@ -73,6 +75,8 @@ protected:
 	void CreateTextureResource( ID3D12Device* Device, const std::wstring& Name,
 		const D3D12_RESOURCE_DESC& ResourceDesc, D3D12_CLEAR_VALUE ClearValue,
 		D3D12_GPU_VIRTUAL_ADDRESS VidMemPtr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN );
+	void CreatePlacedTextureResource( ID3D12Device* Device, const std::wstring& Name,
+		const D3D12_RESOURCE_DESC& ResourceDesc, D3D12_CLEAR_VALUE ClearValue, ID3D12Heap* BackingHeap, uint64_t HeapOffset );
 
 	static DXGI_FORMAT GetBaseFormat( DXGI_FORMAT Format );
 	static DXGI_FORMAT GetUAVFormat( DXGI_FORMAT Format );
@@ -96,6 +100,12 @@ public:
 	void CreateFromSwapChain( const std::wstring& Name, ID3D12Resource* BaseResource );
 	void Create( const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t NumMips,
 		DXGI_FORMAT Format, D3D12_GPU_VIRTUAL_ADDRESS VidMemPtr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN );
+	// Starts in COMMON, uninitialized, clear or discard it before use. Views already created are
+	// kept and point to the new resource.
+	void CreatePlaced( const std::wstring& Name, ID3D12Heap* BackingHeap, uint64_t HeapOffset, uint32_t Width, uint32_t Height,
+		uint32_t NumMips, DXGI_FORMAT Format );
+	// Also frees the descriptors, Create() allocates new ones
+	void Destroy();
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetSRV() const { return m_SRVHandle; }
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetRTV() const { return m_RTVHandle; }
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetUAV() const { return m_UAVHandle[0]; }
@@ -126,6 +136,11 @@ public:
 	DepthBuffer( FLOAT ClearDepth = .0f, UINT8 ClearStencil = 0 );
 	void Create( const std::wstring& Name, uint32_t Width, uint32_t Height, DXGI_FORMAT format,
 		D3D12_GPU_VIRTUAL_ADDRESS VidMemPtr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN );
+	// Same as ColorBuffer::CreatePlaced()
+	void CreatePlaced( const std::wstring& Name, ID3D12Heap* BackingHeap, uint64_t HeapOffset, uint32_t Width, uint32_t Height,
+		DXGI_FORMAT Format );
+	// Also frees the descriptors, Create() allocates new ones
+	void Destroy();
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetDSV() const { return m_DSVHandle[0]; }
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetDSV_DepthReadOnly() const { return m_DSVHandle[1]; }
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetDSV_StencilReadOnly() const { return m_DSVHandle[2]; }
@@ -157,7 +172,13 @@ public:
 		uint32_t ElementSize, const void* InitData = nullptr );
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetUAV() const { return m_UAV; }
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetSRV() const { return m_SRV; }
+	uint32_t GetElementCount() const { return m_ElementCount; }
+	uint32_t GetElementSize() const { return m_ElementSize; }
+	// Slots in the BindlessDescriptorHeap for shaders, StructuredBuffer only
+	uint32_t GetBindlessSRV() const;
+	uint32_t GetBindlessUAV() const;
 	D3D12_GPU_VIRTUAL_ADDRESS RootConstantBufferView() const { return m_GpuVirtualAddress; }
+	// The caller owns the new descriptor, give it back with g_pCSUDescriptorHeap->Free()
 	D3D12_CPU_DESCRIPTOR_HANDLE CreateConstantBufferView( uint32_t Offset, uint32_t Size ) const;
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView( size_t Offset, uint32_t Size, uint32_t Stride ) const;
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView( size_t BaseVertexIndex = 0 ) const;
@@ -171,6 +192,8 @@ protected:
 
 	D3D12_CPU_DESCRIPTOR_HANDLE m_UAV;
 	D3D12_CPU_DESCRIPTOR_HANDLE m_SRV;
+	uint32_t m_BindlessUAV;
+	uint32_t m_BindlessSRV;
 
 	size_t m_BufferSize;
 	uint32_t m_ElementCount;
@@ -274,7 +297,11 @@ public:
 	bool CreateFromFIle( const wchar_t* FileName, bool sRGB );
 	void Destroy();
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetSRV() const;
+	// Slot in the BindlessDescriptorHeap for shaders
+	uint32_t GetBindlessSRV() const;
 	bool operator!();
 protected:
 	D3D12_CPU_DESCRIPTOR_HANDLE m_hCpuDescriptorHandle;
+	bool m_OwnsDescriptor;			// False for a handle passed in, Destroy() leaves it alone
+	uint32_t m_BindlessSRV;
 };
\ No newline at end of file
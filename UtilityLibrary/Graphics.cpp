@@ -3,6 +3,7 @@
 #include "CommandContext.h"
 #include "CmdListMngr.h"
 #include "DescriptorHeap.h"
+#include "BindlessDescriptorHeap.h"
 #include "LinearAllocator.h"
 #include "RootSignature.h"
 #include "PipelineState.h"
@@ -16,6 +17,14 @@
 #include "imgui.h"
 #include "TextRenderer.h"
 #include "DX12Framework.h"
+#include "FenceNotifier.h"
+#include "FramePacer.h"
+#include "FrameGraph.h"
+#include "PipelineCache.h"
+#include "ShaderCacheKey.h"
+#include "AllocationTrace.h"
+
+#include <chrono>
 
 using namespace Microsoft::WRL;
 using namespace std;
@@ -55,6 +64,56 @@ namespace
 		}
 		if (!found) adapter.Detach()->QueryInterface( ppAdapter );
 	}
+
+	// In the working directory, like allocation traces
+	const char* kPipelineCachePath = "PipelineCache.bin";
+
+	// Pipeline blobs are only good for the adapter and driver which made them
+	uint64_t GetPipelineCacheDeviceKey( IDXGIAdapter1* pAdapter )
+	{
+		DXGI_ADAPTER_DESC1 desc;
+		pAdapter->GetDesc1( &desc );
+		LARGE_INTEGER driverVersion = {};
+		pAdapter->CheckInterfaceSupport( __uuidof( IDXGIDevice ), &driverVersion );
+		uint64_t key = PipelineCacheHash( &desc.VendorId, sizeof( desc.VendorId ) );
+		key = PipelineCacheHash( &desc.DeviceId, sizeof( desc.DeviceId ), key );
+		key = PipelineCacheHash( &desc.SubSysId, sizeof( desc.SubSysId ), key );
+		key = PipelineCacheHash( &desc.Revision, sizeof( desc.Revision ), key );
+		return PipelineCacheHash( &driverVersion.QuadPart, sizeof( driverVersion.QuadPart ), key );
+	}
+
+	// Bytecode is only good for the compiler which made it
+	uint64_t GetShaderCacheCompilerKey()
+	{
+		const uint32_t version = D3D_COMPILER_VERSION;
+		return PipelineCacheHash( &version, sizeof( version ), PipelineCacheHash( "D3DCompiler", 11 ) );
+	}
+
+	string ToUtf8( const wstring& wide )
+	{
+		const int size = WideCharToMultiByte( CP_UTF8, 0, wide.c_str(), (int)wide.size(), nullptr, 0, nullptr, nullptr );
+		string utf8( size > 0 ? size : 0, '\0' );
+		if (size > 0)
+			WideCharToMultiByte( CP_UTF8, 0, wide.c_str(), (int)wide.size(), &utf8[0], size, nullptr, nullptr );
+		return utf8;
+	}
+
+	// Next to the executable and the .hlsl files, one per application as they share the directory
+	string GetShaderCachePath()
+	{
+		wchar_t path[MAX_PATH];
+		const DWORD size = GetModuleFileNameW( nullptr, path, MAX_PATH );
+		const wstring exePath( path, size < MAX_PATH ? size : 0 );
+		return ToUtf8( exePath.substr( 0, exePath.find_last_of( L'.' ) ) + L".ShaderCache.bin" );
+	}
+
+	uint64_t MicrosecondsSince( chrono::high_resolution_clock::time_point start )
+	{
+		return (uint64_t)chrono::duration_cast<chrono::microseconds>( chrono::high_resolution_clock::now() - start ).count();
+	}
+
+	// Sources and includes read and hashed once a launch, FXAA.hlsl alone is keyed 7 times
+	ShaderFileCache s_shaderFiles( ReadShaderFile );
 }
 
 namespace Graphics
@@ -68,6 +127,11 @@ namespace Graphics
 	ComPtr<IDXGISwapChain3>		g_swapChain;
 	CmdListMngr					g_cmdListMngr;
 	ContextManager				g_ContextMngr;
+	FenceNotifier				g_fenceNotifier;
+	FramePacer					g_framePacer;
+	FrameGraph					g_frameGraph;
+	PipelineCache				g_pipelineCache;
+	PipelineCache				g_shaderCache;
 	DescriptorHeap*				g_pRTVDescriptorHeap;
 	DescriptorHeap*				g_pDSVDescriptorHeap;
 	DescriptorHeap*				g_pSMPDescriptorHeap;
@@ -141,6 +205,9 @@ namespace Graphics
 	void Shutdown()
 	{
 		g_cmdListMngr.IdleGPU();
+		g_fenceNotifier.Stop();
+		g_framePacer.Destroy();
+		AllocTraceRecorder::End();
 
 		GuiRenderer::Shutdown();
 		FXAA::Shutdown();
@@ -151,19 +218,41 @@ namespace Graphics
 		g_cmdListMngr.Shutdown();
 		PSO::DestroyAll();
 		RootSignature::DestroyAll();
+		// A bake runs on WARP, its pipeline states would replace those of the GPU
+		if (!Core::g_config.bakeShaders && !g_pipelineCache.Save( kPipelineCachePath ))
+			PRINTWARN( "Unable to save the pipeline cache to %s", kPipelineCachePath );
+		// A bake keeps only what this build compiles, a run keeps what it didn't ask for and rewrites the
+		// file only when it has something new
+		PipelineCacheStats shaderStats = g_shaderCache.GetStats();
+		const string shaderCachePath = GetShaderCachePath();
+		if (Core::g_config.bakeShaders || shaderStats.NumAdded + shaderStats.NumCorrupt > 0)
+		{
+			if (g_shaderCache.Save( shaderCachePath, !Core::g_config.bakeShaders ))
+				PRINTINFO( "Shader cache: %u compiled, %u cached", g_stats.shadersCompiled.load(), g_stats.shadersCached.load() );
+			else
+				PRINTWARN( "Unable to save the shader cache to %s", shaderCachePath.c_str() );
+		}
+		g_shaderCache.Close();
 		DynamicDescriptorHeap::Shutdown();
 
 		LinearAllocator::DestroyAll();
 
 		g_SceneColorBuffer.Destroy();
 		g_SceneDepthBuffer.Destroy();
+		g_frameGraph.Destroy();
 		for (uint8_t i = 0; i < Core::g_config.swapChainDesc.BufferCount; ++i)
 			g_pDisplayPlanes[i].Destroy();
 
+		// Buffers destroyed after this won't free their descriptors
+		BindlessDescriptorHeap::Shutdown();
 		delete g_pRTVDescriptorHeap;
 		delete g_pDSVDescriptorHeap;
 		delete g_pSMPDescriptorHeap;
 		delete g_pCSUDescriptorHeap;
+		g_pRTVDescriptorHeap = nullptr;
+		g_pDSVDescriptorHeap = nullptr;
+		g_pSMPDescriptorHeap = nullptr;
+		g_pCSUDescriptorHeap = nullptr;
 
 		delete[] g_pDisplayPlanes;
 
@@ -197,6 +286,13 @@ namespace Graphics
 		}
 #endif
 
+		// Before anything compiles a shader
+		PipelineCacheLoadResult shaderCacheResult = g_shaderCache.Load( GetShaderCachePath(), GetShaderCacheCompilerKey() );
+		if (shaderCacheResult == kCacheLoaded)
+			PRINTINFO( "Shader cache: %u entries loaded", g_shaderCache.GetNumEntries() );
+		else if (shaderCacheResult != kCacheMissing)
+			PRINTWARN( "Shader cache %s, starting over", GetPipelineCacheLoadResultName( shaderCacheResult ) );
+
 		// Create directx device
 		VRET( CreateDXGIFactory1( IID_PPV_ARGS( &g_factory ) ) );
 		if (Core::g_config.warpDevice)
@@ -211,6 +307,13 @@ namespace Graphics
 			VRET( D3D12CreateDevice( g_adaptor.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS( &g_device ) ) );
 		}
 
+		// Before anything creates a root signature or pipeline state
+		PipelineCacheLoadResult cacheResult = g_pipelineCache.Load( kPipelineCachePath, GetPipelineCacheDeviceKey( g_adaptor.Get() ) );
+		if (cacheResult == kCacheLoaded)
+			PRINTINFO( "Pipeline cache: %u entries loaded", g_pipelineCache.GetNumEntries() );
+		else if (cacheResult != kCacheMissing)
+			PRINTWARN( "Pipeline cache %s, starting over", GetPipelineCacheLoadResultName( cacheResult ) );
+
 		// Check Direct3D 12 feature hardware support (more usage refer Direct3D 12 sdk Capability Querying)
 		D3D12_FEATURE_DATA_D3D12_OPTIONS options;
 		g_device->CheckFeatureSupport( D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof( options ) );
@@ -265,10 +368,27 @@ namespace Graphics
 #endif
 		g_cmdListMngr.Create( g_device.Get() );
 
-		g_pRTVDescriptorHeap = new DescriptorHeap( g_device.Get(), Core::NUM_RTV, D3D12_DESCRIPTOR_HEAP_TYPE_RTV );
-		g_pDSVDescriptorHeap = new DescriptorHeap( g_device.Get(), Core::NUM_DSV, D3D12_DESCRIPTOR_HEAP_TYPE_DSV );
-		g_pSMPDescriptorHeap = new DescriptorHeap( g_device.Get(), Core::NUM_SMP, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER );
-		g_pCSUDescriptorHeap = new DescriptorHeap( g_device.Get(), Core::NUM_CSU, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true );
+		g_pRTVDescriptorHeap = new DescriptorHeap( &g_cmdListMngr.GetDeviceBackend(), Core::NUM_RTV, D3D12_DESCRIPTOR_HEAP_TYPE_RTV );
+		g_pDSVDescriptorHeap = new DescriptorHeap( &g_cmdListMngr.GetDeviceBackend(), Core::NUM_DSV, D3D12_DESCRIPTOR_HEAP_TYPE_DSV );
+		g_pSMPDescriptorHeap = new DescriptorHeap( &g_cmdListMngr.GetDeviceBackend(), Core::NUM_SMP, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER );
+		g_pCSUDescriptorHeap = new DescriptorHeap( &g_cmdListMngr.GetDeviceBackend(), Core::NUM_CSU, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true );
+		BindlessDescriptorHeap::Initialize();
+		DynamicDescriptorHeap::CreateSharedHeap();
+
+		// Recycle on the notifier thread as soon as a fence completes, the recording threads only
+		// fall back to reclaiming themselves when it hasn't come round yet
+		g_fenceNotifier.AddListener( []( uint32_t type, uint64_t completedFence )
+		{
+			uint32_t count = g_cmdListMngr.GetQueue( (D3D12_COMMAND_LIST_TYPE)type ).ReclaimAllocators( completedFence );
+			count += LinearAllocator::ReclaimCompletedPages();
+			count += DynamicDescriptorHeap::ReclaimRetired();
+			if (count)
+				g_stats.reclaimedAhead += count;
+		} );
+		GpuQueue* queues[3] = { &g_cmdListMngr.GetGraphicsQueue().GetGpuQueue(),
+			&g_cmdListMngr.GetComputeQueue().GetGpuQueue(), &g_cmdListMngr.GetCopyQueue().GetGpuQueue() };
+		g_fenceNotifier.Start( queues, 3 );
+		g_framePacer.Create( queues[0] );
 
 		ASSERT( Core::g_config.swapChainDesc.BufferCount <= DXGI_MAX_SWAP_CHAIN_BUFFERS );
 		// Create the swap chain
@@ -446,6 +566,26 @@ namespace Graphics
 		// the release configuration of this program.
 		Flags1 |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		ShaderCompileDesc desc = { ToUtf8( pFileName ), {}, pEntrypoint, pTarget, Flags1, Flags2 };
+		for (const D3D_SHADER_MACRO* pMacro = pDefines; pMacro != nullptr && pMacro->Name != nullptr; ++pMacro)
+			desc.Macros.push_back( { pMacro->Name, pMacro->Definition != nullptr ? pMacro->Definition : "" } );
+		// Includes of a handler of the caller's own can't be followed
+		uint64_t key = 0;
+		const bool cacheable = (pInclude == nullptr || pInclude == D3D_COMPILE_STANDARD_FILE_INCLUDE) &&
+			GetShaderCacheKey( desc, s_shaderFiles, key );
+		// Copied under the cache's lock, another thread may Add() the same key meanwhile
+		auto createBlob = [ppCode]( size_t size ) -> void*
+		{
+			return SUCCEEDED( D3DCreateBlob( size, ppCode ) ) ? (*ppCode)->GetBufferPointer() : nullptr;
+		};
+		if (cacheable && g_shaderCache.FindCopy( key, createBlob ))
+		{
+			g_stats.shadersCached++;
+			g_stats.shaderCachedUs += MicrosecondsSince( start );
+			return S_OK;
+		}
+
 		ID3DBlob* pErrorBlob = nullptr;
 		hr = D3DCompileFromFile( pFileName, pDefines, pInclude, pEntrypoint, pTarget, Flags1, Flags2, ppCode, &pErrorBlob );
 		if (pErrorBlob)
@@ -453,6 +593,10 @@ namespace Graphics
 			PRINTERROR( reinterpret_cast<const char*>(pErrorBlob->GetBufferPointer()) );
 			pErrorBlob->Release();
 		}
+		if (SUCCEEDED( hr ) && cacheable)
+			g_shaderCache.Add( key, (*ppCode)->GetBufferPointer(), (*ppCode)->GetBufferSize() );
+		g_stats.shadersCompiled++;
+		g_stats.shaderCompileUs += MicrosecondsSince( start );
 
 		return hr;
 	}
@@ -498,32 +642,51 @@ namespace Graphics
 		FXAA::Resize();
 	}
 
-	void Present( CommandContext& EngineContext )
+	void BeginFrame()
 	{
-		HRESULT hr;
-		GraphicsContext& Context = EngineContext.GetGraphicsContext();
+		g_framePacer.SetFramesInFlight( Core::g_config.framesInFlight );
+		g_framePacer.SetLowLatency( Core::g_config.lowLatency );
+		g_framePacer.BeginFrame();
+	}
+
+	void AddPresentPass( FrameGraph& Graph, uint32_t SceneColor )
+	{
+		const uint32_t BackBuffer = Graph.Import( "Back Buffer", g_pDisplayPlanes[g_CurrentDPIdx], D3D12_RESOURCE_STATE_PRESENT );
+		Graph.AddPass( "Present", kPassSideEffect, []( CommandContext& EngineContext )
 		{
-			GPU_PROFILE( Context, L"Copy To BackBuffer" );
-			Context.TransitionResource( g_SceneColorBuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE );
-			Context.SetRootSignature( s_PresentRS );
-			Context.SetPipelineState( s_BufferCopyPSO );
-			Context.SetPrimitiveTopology( D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
-			Context.SetDynamicDescriptors( 0, 0, 1, &g_SceneColorBuffer.GetSRV() );
-			Context.SetRenderTargets( 1, &g_pDisplayPlanes[g_CurrentDPIdx] );
-			Context.SetViewport( g_DisplayPlaneViewPort );
-			Context.SetScisor( g_DisplayPlaneScissorRect );
-			Context.Draw( 3 );
-		}
+			GraphicsContext& Context = EngineContext.GetGraphicsContext();
+			{
+				GPU_PROFILE( Context, L"Copy To BackBuffer" );
+				Context.SetRootSignature( s_PresentRS );
+				Context.SetPipelineState( s_BufferCopyPSO );
+				Context.SetPrimitiveTopology( D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+				Context.SetDynamicDescriptors( 0, 0, 1, &g_SceneColorBuffer.GetSRV() );
+				Context.SetRenderTargets( 1, &g_pDisplayPlanes[g_CurrentDPIdx] );
+				Context.SetViewport( g_DisplayPlaneViewPort );
+				Context.SetScisor( g_DisplayPlaneScissorRect );
+				Context.Draw( 3 );
+			}
 
-		GuiRenderer::Render( Context );
+			GuiRenderer::Render( Context );
 
 #ifndef RELEASE
-		GPU_Profiler::ProcessAndReadback( EngineContext );
-		GPU_Profiler::DrawStats( Context );
+			GPU_Profiler::ProcessAndReadback( EngineContext );
+			GPU_Profiler::DrawStats( Context );
 #endif
+		} );
+		Graph.Read( SceneColor, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE );
+		Graph.Write( BackBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET );
+	}
 
-		Context.TransitionResource( g_pDisplayPlanes[g_CurrentDPIdx], D3D12_RESOURCE_STATE_PRESENT );
-		Context.Finish();
+	void Present( uint64_t frameFence )
+	{
+		HRESULT hr;
+#ifndef RELEASE
+		GPU_Profiler::FrameSubmitted( frameFence );
+#endif
+		g_framePacer.EndFrame( frameFence );
+		// Latency is stamped when the frame is seen complete, the notifier sees it soonest
+		g_fenceNotifier.OnFenceComplete( frameFence, []() { g_framePacer.Update(); } );
 
 		DXGI_PRESENT_PARAMETERS param;
 		param.DirtyRectsCount = 0;
@@ -533,6 +696,8 @@ namespace Graphics
 
 		// Present the frame.
 		V( g_swapChain->Present1( Core::g_config.vsync ? 1 : 0, 0, &param ) );
+		if (AllocTraceRecorder::IsRecording())
+			AllocTraceRecorder::Frame();
 		g_CurrentDPIdx = (g_CurrentDPIdx + 1) % Core::g_config.swapChainDesc.BufferCount;
 	}
 
@@ -566,16 +731,140 @@ namespace Graphics
 			}
 			ImGui::Columns( 1 );
 			ImGui::Separator();
+			int framesInFlight = (int)Core::g_config.framesInFlight;
+			if (ImGui::SliderInt( "Frames In Flight", &framesInFlight, 1, FramePacer::kMaxFramesInFlight ))
+				Core::g_config.framesInFlight = (uint32_t)framesInFlight;
+			ImGui::Checkbox( "Low Latency", &Core::g_config.lowLatency );
+			FramePacerStats pacerStats = g_framePacer.GetStats();
+			g_framePacer.ResetStats();
+			ImGui::Text( "Frame Latency: %4.2fms  Submit To GPU Done: %4.2fms  Wait: %4.2fms  Sleep: %4.2fms  Lead: %4.2fms",
+				pacerStats.BeginToCompleteMs, pacerStats.SubmitToCompleteMs, pacerStats.WaitMsPerFrame, pacerStats.SleepMsPerFrame,
+				pacerStats.LeadMs );
 			ImGui::Text( "RenderThread Stall Count: %d/frame  Time:%4.2fms", Graphics::g_stats.cpuStallCountPerFrame, Graphics::g_stats.cpuStallTimePerFrame );
 			Graphics::g_stats.cpuStallCountPerFrame = 0;
 			Graphics::g_stats.cpuStallTimePerFrame = 0;
+			uint32_t tableHits = Graphics::g_stats.descriptorTableHits.exchange( 0 );
+			uint32_t tableLookups = tableHits + Graphics::g_stats.descriptorTableMisses.exchange( 0 );
+			ImGui::Text( "Descriptor Table Reuse: %u/%u  Hit Rate: %4.1f%%", tableHits, tableLookups,
+				tableLookups ? tableHits * 100.0 / tableLookups : 0.0 );
+			ImGui::Text( "Descriptor Heap Switches: %u/frame  Heaps 1K: %d  16K: %d  64K: %d",
+				Graphics::g_stats.descriptorHeapSwitches.exchange( 0 ), Graphics::g_stats.descriptorHeapsCreated[0],
+				Graphics::g_stats.descriptorHeapsCreated[1], Graphics::g_stats.descriptorHeapsCreated[2] );
+			ImGui::Text( "Resource Barriers: %u/frame  Folded Away: %u", Graphics::g_stats.barriersIssued.exchange( 0 ),
+				Graphics::g_stats.barriersElided.exchange( 0 ) );
+			const CompiledRenderGraph& frameGraph = g_frameGraph.GetCompiled();
+			ImGui::Text( "Render Graph Passes: %u  Culled: %u  Segments: %u  Barriers: %llu  Split: %llu",
+				g_frameGraph.GetGraph().GetNumPasses(), frameGraph.NumCulled, (uint32_t)frameGraph.Segments.size(),
+				frameGraph.BarrierStats.NumBarriers, frameGraph.BarrierStats.NumSplit );
+			ImGui::Text( "Render Graph Transients: %u  Heaps: %u  %.1f MB  Unaliased: %.1f MB", (uint32_t)frameGraph.Transients.size(),
+				(uint32_t)frameGraph.HeapSizes.size(), frameGraph.HeapSize / 1048576.0, frameGraph.TransientBytes / 1048576.0 );
+			PipelineCacheStats cacheStats = g_pipelineCache.GetStats();
+			ImGui::Text( "Pipeline Cache Loaded: %u  Hits: %u  Misses: %u  Refused: %u  Corrupt: %u", cacheStats.NumLoaded,
+				cacheStats.NumHits, cacheStats.NumMisses, cacheStats.NumInvalidated, cacheStats.NumCorrupt );
+			ImGui::Text( "Shader Cache Hits: %u  %.1fms  Compiled: %u  %.1fms", Graphics::g_stats.shadersCached.load(),
+				Graphics::g_stats.shaderCachedUs / 1000.0, Graphics::g_stats.shadersCompiled.load(), Graphics::g_stats.shaderCompileUs / 1000.0 );
+			bool useSharedHeap = DynamicDescriptorHeap::GetUseSharedHeap();
+			if (ImGui::Checkbox( "Shared Descriptor Heap", &useSharedHeap ))
+				DynamicDescriptorHeap::SetUseSharedHeap( useSharedHeap );
+			DescriptorBlockRingStats sharedStats = DynamicDescriptorHeap::GetSharedHeapStats();
+			ImGui::Text( "Shared Heap Used: %u  Peak: %u / %u  Blocks: %llu  Pending: %u  Full: %llu", sharedStats.NumUsed,
+				sharedStats.PeakUsed, sharedStats.Capacity, sharedStats.NumBlocks, sharedStats.NumPendingBlocks, sharedStats.NumFailed );
+			FenceNotifierStats notifierStats = g_fenceNotifier.GetStats();
+			g_fenceNotifier.ResetStats();
+			ImGui::Text( "Fence Notifier Polls: %llu/frame  Callbacks: %llu  Pending: %u  Interval: %uus  Reclaimed Ahead: %u",
+				notifierStats.NumPolls, notifierStats.NumCallbacks + notifierStats.NumInline, notifierStats.NumPending,
+				notifierStats.PollIntervalUs, Graphics::g_stats.reclaimedAhead.exchange( 0 ) );
+
+			ImGui::Columns( 5, "linearAllocatorInfo" );
+			ImGui::Separator();
+			ImGui::Text( "LinearAllocator Page" ); ImGui::NextColumn();
+			ImGui::Text( "Pages" ); ImGui::NextColumn();
+			ImGui::Text( "Ready" ); ImGui::NextColumn();
+			ImGui::Text( "Retired" ); ImGui::NextColumn();
+			ImGui::Text( "Waste" ); ImGui::NextColumn();
+			ImGui::Separator();
+			const char* typeName[2] = {"GPU", "CPU"};
+			// kCpuRingBuffer falls back to the CPU pages
+			for (int type = 0; type <= kCpuWritable; ++type)
+			{
+				for (uint32_t sizeClass = 0; sizeClass <= kNumLinearPageClasses; ++sizeClass)
+				{
+					uint32_t statsClass = sizeClass < kNumLinearPageClasses ? sizeClass : LinearPagePool::kLargePageClass;
+					LinearPageClassStats stats = LinearAllocator::GetPageStats( (LinearAllocatorType)type, statsClass );
+					uint64_t retiredBytes = stats.UsedBytes + stats.WastedBytes;
+					if (sizeClass < kNumLinearPageClasses)
+						ImGui::Text( "%s %uK", typeName[type], (uint32_t)(kLinearPageClassSizes[sizeClass] >> 10) );
+					else
+						ImGui::Text( "%s Large", typeName[type] );
+					ImGui::NextColumn();
+					ImGui::Text( "%d", stats.NumPages ); ImGui::NextColumn();
+					ImGui::Text( "%d", stats.NumAvailable ); ImGui::NextColumn();
+					ImGui::Text( "%llu", stats.NumRetired ); ImGui::NextColumn();
+					ImGui::Text( "%4.1f%%", retiredBytes ? stats.WastedBytes * 100.0 / retiredBytes : 0.0 ); ImGui::NextColumn();
+				}
+			}
+			ImGui::Columns( 1 );
+			ImGui::Separator();
+
+			ImGui::Columns( 5, "descriptorHeapInfo" );
+			ImGui::Separator();
+			ImGui::Text( "Descriptor Heap" ); ImGui::NextColumn();
+			ImGui::Text( "Heaps" ); ImGui::NextColumn();
+			ImGui::Text( "Used" ); ImGui::NextColumn();
+			ImGui::Text( "Free Ranges" ); ImGui::NextColumn();
+			ImGui::Text( "Largest" ); ImGui::NextColumn();
+			ImGui::Separator();
+			const char* heapName[4] = {"RTV", "DSV", "Sampler", "CBV/SRV/UAV"};
+			DescriptorHeap* heaps[4] = {g_pRTVDescriptorHeap, g_pDSVDescriptorHeap, g_pSMPDescriptorHeap, g_pCSUDescriptorHeap};
+			for (int i = 0; i < 4; ++i)
+			{
+				DescriptorHeapStats stats = heaps[i]->GetStats();
+				ImGui::Text( heapName[i] ); ImGui::NextColumn();
+				ImGui::Text( "%u", stats.NumHeaps ); ImGui::NextColumn();
+				ImGui::Text( "%u/%u", stats.NumUsed, stats.Capacity ); ImGui::NextColumn();
+				ImGui::Text( "%u", stats.NumFreeRanges ); ImGui::NextColumn();
+				ImGui::Text( "%u", stats.LargestFreeRange ); ImGui::NextColumn();
+			}
+			ImGui::Columns( 1 );
+			BindlessIndexStats bindlessStats = BindlessDescriptorHeap::GetStats();
+			ImGui::Text( "Bindless Slots: %u/%u  Peak: %u  Pending Free: %u  Failed: %llu", bindlessStats.NumAllocated,
+				bindlessStats.Capacity, bindlessStats.PeakAllocated, bindlessStats.NumPendingFree, bindlessStats.NumFailed );
+			ImGui::Separator();
+
+			bool useUploadRing = LinearAllocator::GetUploadType() == kCpuRingBuffer;
+			if (ImGui::Checkbox( "Ring Upload Allocator", &useUploadRing ))
+				LinearAllocator::SetUploadType( useUploadRing ? kCpuRingBuffer : kCpuWritable );
+			UploadRingStats ringStats = LinearAllocator::GetUploadRingStats();
+			ImGui::Text( "Ring Used: %4.2fMB  Peak: %4.2fMB / %4.2fMB", ringStats.UsedBytes / 1048576.0,
+				ringStats.PeakUsedBytes / 1048576.0, ringStats.Capacity / 1048576.0 );
+			ImGui::Text( "Ring Stalls: %llu  Stalled: %4.2fMB  Fallbacks: %llu", ringStats.StallCount,
+				ringStats.BytesStalled / 1048576.0, ringStats.NumFailed );
+
+			// Replay offline with the AllocTraceReplay tool
+			bool recordTrace = AllocTraceRecorder::IsRecording();
+			if (ImGui::Checkbox( "Record Allocation Trace", &recordTrace ))
+			{
+				if (recordTrace)
+					AllocTraceRecorder::Begin( "AllocTrace.atrc" );
+				else
+					AllocTraceRecorder::End();
+			}
+			if (recordTrace)
+			{
+				ImGui::SameLine();
+				ImGui::Text( "%llu events", AllocTraceRecorder::GetNumEvents() );
+			}
 		}
 		if (ImGui::CollapsingHeader( "Render Targets" ))
 		{
 			ImTextureID tex_id = (void*)&Graphics::g_SceneColorBuffer.GetSRV();
 			ImGui::Image( tex_id, ImVec2( 640, 480 ) ); 
-			ImTextureID tex_id1 = (void*)&FXAA::g_LumaBuffer.GetSRV();
-			ImGui::Image( tex_id1, ImVec2( 640, 480 ) );
+			// A transient, only backed by memory while FXAA runs
+			if (Core::g_config.FXAA)
+			{
+				ImTextureID tex_id1 = (void*)&FXAA::g_LumaBuffer.GetSRV();
+				ImGui::Image( tex_id1, ImVec2( 640, 480 ) );
+			}
 		}
 	}
 }
\ No newline at end of file
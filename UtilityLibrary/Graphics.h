@@ -10,6 +10,10 @@ class ColorBuffer;
 class DepthBuffer;
 class SamplerDesc;
 class SamplerDescriptor;
+class FenceNotifier;
+class FramePacer;
+class FrameGraph;
+class PipelineCache;
 
 namespace Graphics
 {
@@ -20,6 +24,22 @@ namespace Graphics
 		uint16_t						allocatorReady[4] = {};
 		uint16_t						cpuStallCountPerFrame = 0;
 		double							cpuStallTimePerFrame = 0;
+		// DynamicDescriptorHeap tables bound again without a copy, added up as contexts finish
+		std::atomic<uint32_t>			descriptorTableHits{ 0 };
+		std::atomic<uint32_t>			descriptorTableMisses{ 0 };
+		// DynamicDescriptorHeap overflows, each one rebinds the heap and copies all tables again
+		std::atomic<uint32_t>			descriptorHeapSwitches{ 0 };
+		uint16_t						descriptorHeapsCreated[3] = {};
+		// Allocators, pages and descriptor heaps g_fenceNotifier made ready before anyone asked
+		std::atomic<uint32_t>			reclaimedAhead{ 0 };
+		// Resource barriers handed to command lists, and the ones CommandContext folded away
+		std::atomic<uint32_t>			barriersIssued{ 0 };
+		std::atomic<uint32_t>			barriersElided{ 0 };
+		// CompileShaderFromFile() calls the compiler ran and g_shaderCache answered, and the time each took
+		std::atomic<uint32_t>			shadersCompiled{ 0 };
+		std::atomic<uint32_t>			shadersCached{ 0 };
+		std::atomic<uint64_t>			shaderCompileUs{ 0 };
+		std::atomic<uint64_t>			shaderCachedUs{ 0 };
 	};
 
 	extern Stats									g_stats;
@@ -30,6 +50,19 @@ namespace Graphics
 	extern Microsoft::WRL::ComPtr<ID3D12Device>		g_device;
 	extern Microsoft::WRL::ComPtr<IDXGISwapChain3>	g_swapChain;
 	extern CmdListMngr								g_cmdListMngr;
+	// Watches the fences of all queues, recycles what they retire as soon as it completes
+	extern FenceNotifier							g_fenceNotifier;
+	// Frames of the direct queue in flight, see Core::Settings::framesInFlight
+	extern FramePacer								g_framePacer;
+	// Passes of the frame being recorded, rebuilt every frame
+	extern FrameGraph								g_frameGraph;
+	// Root signatures and pipeline states of the runs before, loaded once the device exists and saved
+	// by Shutdown()
+	extern PipelineCache							g_pipelineCache;
+	// Bytecode CompileShaderFromFile() compiled before, <exe>.ShaderCache.bin next to the executable. Loaded
+	// before anything compiles, saved by Shutdown(), baked by a -bakeshaders run after the build when
+	// BakeShaderCache=true.
+	extern PipelineCache							g_shaderCache;
 	extern ContextManager							g_ContextMngr;
 	extern DescriptorHeap*							g_pRTVDescriptorHeap;
 	extern DescriptorHeap*							g_pDSVDescriptorHeap;
@@ -72,9 +105,16 @@ namespace Graphics
 	void Init();
 	void Shutdown();
 	void Resize();
-	void Present( CommandContext& EngineContext );
+	// Blocks until a frame may start, before sampling input for it
+	void BeginFrame();
+	// Copies SceneColor, a resource of Graph, to the back buffer with the GUI on top
+	void AddPresentPass( FrameGraph& Graph, uint32_t SceneColor );
+	// Once the frame, which frameFence is the end of, is submitted
+	void Present( uint64_t frameFence );
 	void UpdateGUI();
 	HRESULT CreateResource();
+	// Looks the compile up in g_shaderCache first, see ShaderCacheKey.h, and adds what it compiles. A
+	// pInclude but D3D_COMPILE_STANDARD_FILE_INCLUDE always compiles.
 	HRESULT CompileShaderFromFile( LPCWSTR pFileName, const D3D_SHADER_MACRO* pDefines, ID3DInclude* pInclude,
 		LPCSTR pEntrypoint, LPCSTR pTarget, UINT Flags1, UINT Flags2, ID3DBlob** ppCode );
 }
\ No newline at end of file
@@ -2,13 +2,18 @@
 #include "Graphics.h"
 #include "CmdListMngr.h"
 #include "Utility.h"
+#include "AllocationTrace.h"
 
 using namespace std;
 using namespace Microsoft::WRL;
 
 #include "LinearAllocator.h"
 
-LinearAllocatorPageMngr LinearAllocator::sm_PageMngr[2] = {LinearAllocatorPageMngr( kGpuExclusive ),LinearAllocatorPageMngr( kCpuWritable )};
+const size_t kLinearPageClassSizes[kNumLinearPageClasses] = { 0x10000, 0x40000, 0x100000, 0x200000 };
+
+LinearAllocatorPageMngr LinearAllocator::sm_PageMngr[2] = { { kGpuExclusive }, { kCpuWritable } };
+RingUploadAllocator LinearAllocator::sm_UploadRing;
+LinearAllocatorType LinearAllocator::sm_UploadType = kCpuWritable;
 //--------------------------------------------------------------------------------------
 // LinearAllocationPage
 //--------------------------------------------------------------------------------------
@@ -28,98 +33,161 @@ LinearAllocationPage::~LinearAllocationPage() { m_pResource->Unmap( 0, nullptr )
 // LinearAllocatorPageMngr
 //--------------------------------------------------------------------------------------
 LinearAllocatorPageMngr::LinearAllocatorPageMngr( LinearAllocatorType Type )
+	:m_AllocationType( Type ), m_Pool( kLinearPageClassSizes, kNumLinearPageClasses )
 {
-	InitializeCriticalSection( &m_CS );
-	m_AllocationType = Type;
+	m_Pool.SetBackend( this, this );
 }
 
-LinearAllocatorPageMngr::~LinearAllocatorPageMngr() { DeleteCriticalSection( &m_CS ); }
+LinearAllocatorPageMngr::~LinearAllocatorPageMngr() { m_Pool.Destroy(); }
 
-LinearAllocationPage* LinearAllocatorPageMngr::RequestPage()
+LinearPage* LinearAllocatorPageMngr::CreatePage( size_t SizeInByte )
 {
-	CriticalSectionScope LockGard( &m_CS );
-	while (!m_RetiredPages.empty() && Graphics::g_cmdListMngr.IsFenceComplete( m_RetiredPages.front().first ))
-	{
-		m_AvailablePages.push( m_RetiredPages.front().second );
-		m_RetiredPages.pop();
-	}
-	LinearAllocationPage* PagePtr = nullptr;
-	if (!m_AvailablePages.empty())
-	{
-		PagePtr = m_AvailablePages.front();
-		m_AvailablePages.pop();
-	}
-	else
-	{
-		PagePtr = CreateNewPage();
-		m_PagePool.emplace_back( PagePtr );
-	}
-	return PagePtr;
+	return Graphics::g_cmdListMngr.GetDeviceBackend().CreateLinearPage( SizeInByte, m_AllocationType != kGpuExclusive );
+}
+
+void LinearAllocatorPageMngr::DestroyPage( LinearPage* pPage )
+{
+	Graphics::g_cmdListMngr.GetDeviceBackend().DestroyLinearPage( pPage );
 }
 
-void LinearAllocatorPageMngr::DiscardPages( uint64_t FenceValue, const vector<LinearAllocationPage*>& UsedPages )
+bool LinearAllocatorPageMngr::IsFenceComplete( uint64_t FenceValue )
 {
-	CriticalSectionScope LockGard( &m_CS );
-	for (auto iter = UsedPages.begin(); iter != UsedPages.end(); ++iter)
-		m_RetiredPages.push( make_pair( FenceValue, *iter ) );
+	return Graphics::g_cmdListMngr.IsFenceComplete( FenceValue );
 }
 
-LinearAllocationPage* LinearAllocatorPageMngr::CreateNewPage()
+void LinearAllocatorPageMngr::Destory() { m_Pool.Destroy(); }
+
+//--------------------------------------------------------------------------------------
+// RingUploadAllocator
+//--------------------------------------------------------------------------------------
+RingUploadAllocator::RingUploadAllocator()
+	:m_CpuVirtualAddr( nullptr )
+{
+	InitializeCriticalSection( &m_CS );
+}
+
+RingUploadAllocator::~RingUploadAllocator()
+{
+	Destroy();
+	DeleteCriticalSection( &m_CS );
+}
+
+void RingUploadAllocator::Create()
 {
 	HRESULT hr;
 	ID3D12Resource* pBuffer;
-	D3D12_RESOURCE_STATES DefaultUsage;
-	if (m_AllocationType == kGpuExclusive)
-	{
-		DefaultUsage = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
-		V( Graphics::g_device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES( D3D12_HEAP_TYPE_DEFAULT ), D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer( kGpuAllocatorPageSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS ),
-			DefaultUsage, nullptr, IID_PPV_ARGS( &pBuffer ) ) );
-	}
-	else
+	V( Graphics::g_device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES( D3D12_HEAP_TYPE_UPLOAD ), D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer( kCapacity ),
+		D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS( &pBuffer ) ) );
+	pBuffer->SetName( L"RingUploadAllocator" );
+	m_pResource.Attach( pBuffer );
+	m_UsageState = D3D12_RESOURCE_STATE_GENERIC_READ;
+	m_GpuVirtualAddress = m_pResource->GetGPUVirtualAddress();
+	// Stays mapped for its whole life, like the pages
+	m_pResource->Map( 0, nullptr, &m_CpuVirtualAddr );
+	m_Ring.Create( kCapacity, this );
+}
+
+bool RingUploadAllocator::AllocateBlock( size_t SizeInByte, UploadRingBlock& Block )
+{
+	CriticalSectionScope LockGuard( &m_CS );
+	if (!m_Ring.IsCreated())
+		Create();
+	// Waits without the lock, so uploaders with room left go on meanwhile; the ring tries again
+	// from scratch afterwards
+	return m_Ring.Allocate( SizeInByte, Block, [this]( uint64_t FenceValue )
 	{
-		DefaultUsage = D3D12_RESOURCE_STATE_GENERIC_READ;
-		V( Graphics::g_device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES( D3D12_HEAP_TYPE_UPLOAD ), D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer( kCpuAllocatorPageSize ),
-			DefaultUsage, nullptr, IID_PPV_ARGS( &pBuffer ) ) );
-	}
-	pBuffer->SetName( L"LinearAllocator Page" );
+		LeaveCriticalSection( &m_CS );
+		Graphics::g_cmdListMngr.WaitForFence( FenceValue );
+		EnterCriticalSection( &m_CS );
+	} );
+}
 
-	return new LinearAllocationPage( pBuffer, DefaultUsage );
+void RingUploadAllocator::RetireBlocks( uint64_t FenceValue, const std::vector<uint64_t>& BlockIds )
+{
+	CriticalSectionScope LockGuard( &m_CS );
+	for (auto BlockId : BlockIds)
+		m_Ring.Retire( BlockId, FenceValue );
 }
 
-void LinearAllocatorPageMngr::Destory() { m_PagePool.clear(); }
+bool RingUploadAllocator::IsFenceComplete( uint64_t FenceValue )
+{
+	return Graphics::g_cmdListMngr.IsFenceComplete( FenceValue );
+}
+
+UploadRingStats RingUploadAllocator::GetStats()
+{
+	CriticalSectionScope LockGuard( &m_CS );
+	return m_Ring.GetStats();
+}
+
+void RingUploadAllocator::Destroy()
+{
+	CriticalSectionScope LockGuard( &m_CS );
+	if (!m_Ring.IsCreated())
+		return;
+	m_Ring.Destroy();
+	m_pResource->Unmap( 0, nullptr );
+	m_CpuVirtualAddr = nullptr;
+	GpuResource::Destroy();
+}
 
 
 //--------------------------------------------------------------------------------------
 // LinearAllocator
 //--------------------------------------------------------------------------------------
 LinearAllocator::LinearAllocator( LinearAllocatorType Type )
-	:m_AllocationType( Type ), m_PageSize( 0 ), m_CurOffset( ~0ull ), m_CurPage( nullptr )
+	:m_AllocationType( Type ), m_CurOffset( 0 ), m_CurPage( nullptr ), m_NextClass( 0 ), m_IntervalBytes( 0 )
 {
 	ASSERT( Type > kInvalidAllocator && Type < kNumAllocatorTypes );
-	m_PageSize = (Type == kGpuExclusive ? kGpuAllocatorPageSize : kCpuAllocatorPageSize);
+	m_CurBlock.Size = 0;
+}
+
+void LinearAllocator::SetType( LinearAllocatorType Type )
+{
+	ASSERT( Type > kInvalidAllocator && Type < kNumAllocatorTypes );
+	ASSERT( m_CurPage == nullptr && m_RetiredPages.empty() && m_CurBlock.Size == 0 && m_RetiredBlocks.empty() );
+	m_AllocationType = Type;
+}
+
+void LinearAllocator::SetUploadType( LinearAllocatorType Type )
+{
+	ASSERT( Type == kCpuWritable || Type == kCpuRingBuffer );
+	sm_UploadType = Type;
 }
 
 DynAlloc LinearAllocator::Allocate( size_t SizeInByte, size_t Alignment )
 {
-	ASSERT( SizeInByte <= m_PageSize );
 	const size_t AlignmentMask = Alignment - 1;
 	// Assert that it's a power of two.
 	ASSERT( (AlignmentMask & Alignment) == 0 );
 	const size_t AlignedSize = AlignUpWithMask( SizeInByte, AlignmentMask );
-	m_CurOffset = AlignUp( m_CurOffset, Alignment );
-	if (m_CurOffset + AlignedSize > m_PageSize)
+
+	if (AllocTraceRecorder::IsRecording())
+		AllocTraceRecorder::LinearAllocate( this, m_AllocationType, SizeInByte, Alignment );
+
+	if (m_AllocationType == kCpuRingBuffer)
+		return AllocateFromRing( AlignedSize, Alignment );
+
+	LinearPagePool& Pool = GetPageMngr( m_AllocationType ).m_Pool;
+	if (AlignedSize > Pool.GetMaxClassSize())
+		return AllocateLargePage( AlignedSize );
+
+	if (m_CurPage != nullptr)
 	{
-		ASSERT( m_CurPage != nullptr );
-		m_RetiredPages.push_back( m_CurPage );
-		m_CurPage = nullptr;
+		m_CurOffset = AlignUp( m_CurOffset, Alignment );
+		if (m_CurOffset + AlignedSize > m_CurPage->m_SizeInByte)
+		{
+			// Ran out within one interval, next page is one class bigger
+			m_NextClass = min( m_CurPage->m_SizeClass + 1, Pool.GetNumClasses() - 1 );
+			RetireCurPage();
+		}
 	}
 	if (m_CurPage == nullptr)
 	{
-		m_CurPage = sm_PageMngr[m_AllocationType].RequestPage();
+		uint32_t SizeClass = max( m_NextClass, Pool.GetSizeClass( AlignedSize ) );
+		m_CurPage = static_cast<LinearAllocationPage*>(Pool.RequestPage( SizeClass ));
 		m_CurOffset = 0;
 	}
 
@@ -128,25 +196,109 @@ DynAlloc LinearAllocator::Allocate( size_t SizeInByte, size_t Alignment )
 	ret.DataPtr = (uint8_t*)m_CurPage->m_CpuVirtualAddr + m_CurOffset;
 
 	m_CurOffset += AlignedSize;
+	m_IntervalBytes += AlignedSize;
 
 	return ret;
 }
 
-void LinearAllocator::CleanupUsedPages( uint64_t FenceID )
+DynAlloc LinearAllocator::AllocateFromRing( size_t AlignedSize, size_t Alignment )
 {
-	if (m_CurPage == nullptr)
-		return;
+	// Blocks start kBlockAlign aligned, so aligning within the block is enough
+	ASSERT( Alignment <= UploadRing::kBlockAlign );
+	if (m_CurBlock.Size != 0)
+	{
+		m_CurOffset = AlignUp( m_CurOffset, Alignment );
+		if (m_CurOffset + AlignedSize > m_CurBlock.Size)
+			RetireCurBlock();
+	}
+	if (m_CurBlock.Size == 0)
+	{
+		// Requests of a good part of the ring would mostly cause stalls, they get pages like
+		// everything which doesn't fit while other contexts still hold the tail
+		if (AlignedSize > kRingMaxBlockSize ||
+			!sm_UploadRing.AllocateBlock( max( AlignedSize, (size_t)kRingBlockSize ), m_CurBlock ))
+			return AllocateLargePage( AlignedSize );
+		m_CurOffset = 0;
+	}
+
+	DynAlloc ret( sm_UploadRing, m_CurBlock.Offset + m_CurOffset, AlignedSize );
+	ret.GpuAddress = sm_UploadRing.GetGpuVirtualAddress() + ret.Offset;
+	ret.DataPtr = (uint8_t*)sm_UploadRing.m_CpuVirtualAddr + ret.Offset;
+
+	m_CurOffset += AlignedSize;
+
+	return ret;
+}
+
+DynAlloc LinearAllocator::AllocateLargePage( size_t SizeInByte )
+{
+	LinearAllocationPage* pPage = static_cast<LinearAllocationPage*>(
+		GetPageMngr( m_AllocationType ).m_Pool.RequestLargePage( SizeInByte ));
+	// Nobody else sub-allocates from it, so it's retired right away and released with the others
+	pPage->m_UsedBytes = SizeInByte;
+	m_RetiredPages.push_back( pPage );
+
+	DynAlloc ret( *pPage, 0, SizeInByte );
+	ret.GpuAddress = pPage->m_GpuVirtualAddr;
+	ret.DataPtr = pPage->m_CpuVirtualAddr;
+	return ret;
+}
 
+void LinearAllocator::RetireCurPage()
+{
+	m_CurPage->m_UsedBytes = min( m_CurOffset, m_CurPage->m_SizeInByte );
 	m_RetiredPages.push_back( m_CurPage );
 	m_CurPage = nullptr;
 	m_CurOffset = 0;
+}
+
+void LinearAllocator::RetireCurBlock()
+{
+	m_RetiredBlocks.push_back( m_CurBlock.Id );
+	m_CurBlock.Size = 0;
+	m_CurOffset = 0;
+}
+
+void LinearAllocator::CleanupUsedPages( uint64_t FenceID )
+{
+	if (AllocTraceRecorder::IsRecording())
+		AllocTraceRecorder::LinearCleanup( this, FenceID );
 
-	sm_PageMngr[m_AllocationType].DiscardPages( FenceID, m_RetiredPages );
+	if (m_CurBlock.Size != 0)
+		RetireCurBlock();
+	if (!m_RetiredBlocks.empty())
+	{
+		sm_UploadRing.RetireBlocks( FenceID, m_RetiredBlocks );
+		m_RetiredBlocks.clear();
+	}
+
+	if (m_CurPage != nullptr)
+		RetireCurPage();
+	if (m_RetiredPages.empty())
+		return;
+
+	// Start the next interval with the class which would have held all of this one
+	LinearPagePool& Pool = GetPageMngr( m_AllocationType ).m_Pool;
+	m_NextClass = min( Pool.GetSizeClass( m_IntervalBytes ), Pool.GetNumClasses() - 1 );
+	m_IntervalBytes = 0;
+
+	Pool.DiscardPages( FenceID, m_RetiredPages );
 	m_RetiredPages.clear();
 }
 
+LinearPageClassStats LinearAllocator::GetPageStats( LinearAllocatorType Type, uint32_t SizeClass )
+{
+	return GetPageMngr( Type ).m_Pool.GetStats( SizeClass );
+}
+
+uint32_t LinearAllocator::ReclaimCompletedPages()
+{
+	return sm_PageMngr[0].m_Pool.ReclaimCompleted() + sm_PageMngr[1].m_Pool.ReclaimCompleted();
+}
+
 void LinearAllocator::DestroyAll()
 {
 	sm_PageMngr[0].Destory();
 	sm_PageMngr[1].Destory();
-}
\ No newline at end of file
+	sm_UploadRing.Destroy();
+}
@@ -1,8 +1,9 @@
 #pragma once
 
 #include "GpuResource.h"
+#include "LinearPagePool.h"
+#include "UploadRing.h"
 #include <vector>
-#include <queue>
 
 // Constant blocks must be multiples of 16 constants @ 16 bytes each
 #define DEFAULT_ALIGN 256
@@ -25,7 +26,7 @@ struct DynAlloc
 	D3D12_GPU_VIRTUAL_ADDRESS	GpuAddress;
 };
 
-class LinearAllocationPage : public GpuResource
+class LinearAllocationPage : public GpuResource, public LinearPage
 {
 public:
 	LinearAllocationPage( ID3D12Resource* pGfxResource, D3D12_RESOURCE_STATES Usage );
@@ -33,9 +34,6 @@ public:
 
 	LinearAllocationPage& operator=( LinearAllocationPage const& ) = delete;
 	LinearAllocationPage( LinearAllocationPage const& ) = delete;
-
-	void*									m_CpuVirtualAddr;
-	D3D12_GPU_VIRTUAL_ADDRESS				m_GpuVirtualAddr;
 };
 
 enum LinearAllocatorType
@@ -43,16 +41,20 @@ enum LinearAllocatorType
 	kInvalidAllocator = -1,
 	kGpuExclusive = 0,		// DEFAULT   GPU-writable (via UAV)
 	kCpuWritable = 1,		// UPLOAD CPU-writable (but write combined)
+	kCpuRingBuffer = 2,		// UPLOAD like kCpuWritable, blocks of the shared RingUploadAllocator
 	kNumAllocatorTypes
 };
 
+// Page size classes shared by both allocator types, anything bigger gets a right-sized large page
 enum
 {
-	kGpuAllocatorPageSize = 0x10000,	// 64K
-	kCpuAllocatorPageSize = 0x200000	// 2MB
+	kNumLinearPageClasses = 4,
 };
+extern const size_t kLinearPageClassSizes[kNumLinearPageClasses];	// 64K, 256K, 1MB, 2MB
 
-class LinearAllocatorPageMngr
+// Device side of the page pool: creates pages through g_cmdListMngr's device backend and checks
+// fences on its queues
+class LinearAllocatorPageMngr : public ILinearPageBackingStore, public IFenceOracle
 {
 	friend class LinearAllocator;
 
@@ -60,42 +62,105 @@ public:
 	LinearAllocatorPageMngr( LinearAllocatorType );
 	~LinearAllocatorPageMngr();
 
-	LinearAllocationPage* RequestPage();
-	void DiscardPages( uint64_t FenceID, const std::vector<LinearAllocationPage*>& Pages );
+	virtual LinearPage* CreatePage( size_t SizeInByte ) override;
+	virtual void DestroyPage( LinearPage* pPage ) override;
+	virtual bool IsFenceComplete( uint64_t FenceValue ) override;
 	void Destory();
 
-	//LinearAllocatorPageMngr( LinearAllocatorPageMngr const& ) = delete;
+	LinearAllocatorPageMngr( LinearAllocatorPageMngr const& ) = delete;
 	LinearAllocatorPageMngr& operator= ( LinearAllocatorPageMngr const& ) = delete;
 
 private:
-	LinearAllocationPage* CreateNewPage();
-
 	LinearAllocatorType										m_AllocationType;
-	std::vector<std::unique_ptr<LinearAllocationPage>>		m_PagePool;
-	std::queue<std::pair<uint64_t, LinearAllocationPage*>>	m_RetiredPages;
-	std::queue<LinearAllocationPage*>						m_AvailablePages;
+	LinearPagePool											m_Pool;
+};
+
+// One persistently mapped upload buffer shared by every kCpuRingBuffer allocator. Blocks are handed
+// out under a lock, a full ring waits for the GPU on the oldest retired block
+class RingUploadAllocator : public GpuResource, public IFenceOracle
+{
+	friend class LinearAllocator;
+
+public:
+	enum
+	{
+		kCapacity = 0x1000000,		// 16MB
+	};
+
+	RingUploadAllocator();
+	~RingUploadAllocator();
+
+	// False if the ring can't hold it without waiting on a block still being recorded
+	bool AllocateBlock( size_t SizeInByte, UploadRingBlock& Block );
+	void RetireBlocks( uint64_t FenceValue, const std::vector<uint64_t>& BlockIds );
+	virtual bool IsFenceComplete( uint64_t FenceValue ) override;
+	UploadRingStats GetStats();
+	void Destroy();
+
+	RingUploadAllocator( RingUploadAllocator const& ) = delete;
+	RingUploadAllocator& operator= ( RingUploadAllocator const& ) = delete;
+
+private:
+	void Create();
+
 	CRITICAL_SECTION										m_CS;
+	UploadRing												m_Ring;
+	void*													m_CpuVirtualAddr;
 };
 
+// Pages are sized per fence interval: the first one gets the class that held everything of the last
+// interval, whenever a page runs full the next class up is used. Requests bigger than the biggest
+// class get a dedicated large page retired on the same fence.
+// kCpuRingBuffer allocators sub-allocate 64K blocks of the upload ring the same way and fall back to
+// large pages when the ring is full.
 class LinearAllocator
 {
 public:
+	enum
+	{
+		kRingBlockSize = 0x10000,
+		kRingMaxBlockSize = RingUploadAllocator::kCapacity / 8,
+	};
+
 	LinearAllocator( LinearAllocatorType Type );
 	LinearAllocator( LinearAllocator const& ) = delete;
 	LinearAllocator& operator= ( LinearAllocator const& ) = delete;
 
 	DynAlloc Allocate( size_t SizeInByte, size_t Alignment = DEFAULT_ALIGN );
 	void CleanupUsedPages( uint64_t FenceID );
-
+	// Only between fence intervals, nothing may be allocated since the last CleanupUsedPages
+	void SetType( LinearAllocatorType Type );
+
+	// kCpuWritable or kCpuRingBuffer, picked up by command contexts when they are allocated
+	static void SetUploadType( LinearAllocatorType Type );
+	static LinearAllocatorType GetUploadType() { return sm_UploadType; }
+
+	// SizeClass in [0, kNumLinearPageClasses) or LinearPagePool::kLargePageClass
+	static LinearPageClassStats GetPageStats( LinearAllocatorType Type, uint32_t SizeClass );
+	static UploadRingStats GetUploadRingStats() { return sm_UploadRing.GetStats(); }
+	// Pages of both page managers whose fence completed become ready, see LinearPagePool
+	static uint32_t ReclaimCompletedPages();
 	static void DestroyAll();
 
 private:
+	// kCpuRingBuffer shares the pages of kCpuWritable for its fallback
+	static LinearAllocatorPageMngr& GetPageMngr( LinearAllocatorType Type ) { return sm_PageMngr[Type == kGpuExclusive ? kGpuExclusive : kCpuWritable]; }
+	DynAlloc AllocateFromRing( size_t AlignedSize, size_t Alignment );
+	DynAlloc AllocateLargePage( size_t SizeInByte );
+	void RetireCurPage();
+	void RetireCurBlock();
+
 	static LinearAllocatorPageMngr		sm_PageMngr[2];
+	static RingUploadAllocator			sm_UploadRing;
+	static LinearAllocatorType			sm_UploadType;
 
 	LinearAllocatorType					m_AllocationType;
-	size_t								m_PageSize;
 	size_t								m_CurOffset;
 	LinearAllocationPage*				m_CurPage;
-	std::vector<LinearAllocationPage*>	m_RetiredPages;
+	uint32_t							m_NextClass;
+	// Bytes sub-allocated from class pages since the last CleanupUsedPages
+	size_t								m_IntervalBytes;
+	std::vector<LinearPage*>			m_RetiredPages;
+	UploadRingBlock						m_CurBlock;			// Size 0 if none
+	std::vector<uint64_t>				m_RetiredBlocks;
 };
-
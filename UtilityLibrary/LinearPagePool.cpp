@@ -0,0 +1,322 @@
+#include "PortableAssert.h"
+#include "LinearPagePool.h"
+
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------
+// LinearPagePool
+//--------------------------------------------------------------------------------------
+LinearPagePool::LinearPagePool( const size_t* ClassSizes, uint32_t NumClasses )
+	:m_NumClasses( NumClasses ), m_UseMagazines( true ), m_pBackingStore( nullptr ), m_pFenceOracle( nullptr )
+{
+	ASSERT( NumClasses > 0 && NumClasses <= kMaxSizeClasses );
+	for (uint32_t i = 0; i < NumClasses; ++i)
+	{
+		ASSERT( i == 0 || ClassSizes[i] > ClassSizes[i - 1] );
+		m_ClassSizes[i] = ClassSizes[i];
+	}
+}
+
+LinearPagePool::~LinearPagePool()
+{
+	Destroy();
+}
+
+void LinearPagePool::SetBackend( ILinearPageBackingStore* pBackingStore, IFenceOracle* pFenceOracle )
+{
+	m_pBackingStore = pBackingStore;
+	m_pFenceOracle = pFenceOracle;
+}
+
+uint32_t LinearPagePool::GetSizeClass( size_t SizeInByte ) const
+{
+	for (uint32_t i = 0; i < m_NumClasses; ++i)
+		if (SizeInByte <= m_ClassSizes[i]) return i;
+	return kLargePageClass;
+}
+
+LinearPage* LinearPagePool::RequestPage( uint32_t SizeClass )
+{
+	ASSERT( SizeClass < m_NumClasses );
+	LinearPage* pPage = nullptr;
+	ThreadMagazines* pMagazines = GetThreadMagazines();
+	if (pMagazines != nullptr)
+	{
+		Magazine& Mag = pMagazines->Classes[SizeClass];
+		if (Mag.NumReady == 0) ReclaimMagazine( Mag );
+		if (Mag.NumReady == 0) RefillMagazine( Mag, SizeClass );
+		if (Mag.NumReady != 0) pPage = Mag.Ready[--Mag.NumReady];
+	}
+	else
+	{
+		IFenceOracle* pFenceOracle = m_pFenceOracle;
+		pPage = m_Classes[SizeClass].Pages.Acquire(
+			[pFenceOracle]( uint64_t FenceValue ) { return pFenceOracle->IsFenceComplete( FenceValue ); } );
+	}
+	if (pPage == nullptr)
+		return CreatePage( SizeClass, m_ClassSizes[SizeClass] );
+	pPage->m_UsedBytes = 0;
+	return pPage;
+}
+
+LinearPage* LinearPagePool::RequestLargePage( size_t SizeInByte )
+{
+	SizeInByte = (SizeInByte + kLargePageAlign - 1) & ~(size_t)(kLargePageAlign - 1);
+	{
+		std::lock_guard<std::mutex> Lock( m_LargeMutex );
+		ReclaimLargePages();
+		// Reuse a cached page only if it doesn't waste more than it holds
+		for (auto iter = m_CachedLargePages.begin(); iter != m_CachedLargePages.end(); ++iter)
+		{
+			LinearPage* pPage = *iter;
+			if (pPage->m_SizeInByte >= SizeInByte && pPage->m_SizeInByte <= SizeInByte * 2)
+			{
+				m_CachedLargePages.erase( iter );
+				pPage->m_UsedBytes = 0;
+				return pPage;
+			}
+		}
+	}
+	return CreatePage( kLargePageClass, SizeInByte );
+}
+
+void LinearPagePool::DiscardPages( uint64_t FenceValue, const std::vector<LinearPage*>& Pages )
+{
+	ThreadMagazines* pMagazines = GetThreadMagazines();
+	for (auto pPage : Pages)
+	{
+		ASSERT( pPage->m_UsedBytes <= pPage->m_SizeInByte );
+		uint32_t SizeClass = pPage->m_SizeClass;
+		if (SizeClass != kLargePageClass && pMagazines != nullptr)
+		{
+			// Stays with this thread, most likely it's the next one to need it
+			Magazine& Mag = pMagazines->Classes[SizeClass];
+			Mag.NumRetired++;
+			Mag.UsedBytes += pPage->m_UsedBytes;
+			Mag.WastedBytes += pPage->m_SizeInByte - pPage->m_UsedBytes;
+			Mag.Retired.push_back( std::make_pair( FenceValue, pPage ) );
+			if (Mag.Retired.size() > kMaxLocalRetired)
+				FlushRetired( Mag, kMaxLocalRetired / 2 );
+			if (Mag.NumRetired >= kMaxLocalRetired)
+				PublishStats( Mag, SizeClass );
+			continue;
+		}
+		ClassPool& Class = m_Classes[SizeClass];
+		Class.NumRetired.fetch_add( 1, std::memory_order_relaxed );
+		Class.UsedBytes.fetch_add( pPage->m_UsedBytes, std::memory_order_relaxed );
+		Class.WastedBytes.fetch_add( pPage->m_SizeInByte - pPage->m_UsedBytes, std::memory_order_relaxed );
+		if (SizeClass == kLargePageClass)
+		{
+			std::lock_guard<std::mutex> Lock( m_LargeMutex );
+			m_RetiredLargePages.push_back( std::make_pair( FenceValue, pPage ) );
+		}
+		else
+			Class.Pages.Retire( FenceValue, pPage );
+	}
+}
+
+uint32_t LinearPagePool::ReclaimCompleted()
+{
+	IFenceOracle* pFenceOracle = m_pFenceOracle;
+	if (pFenceOracle == nullptr)
+		return 0;
+	auto IsFenceComplete = [pFenceOracle]( uint64_t FenceValue ) { return pFenceOracle->IsFenceComplete( FenceValue ); };
+	uint32_t Count = 0;
+	for (uint32_t i = 0; i < m_NumClasses; ++i)
+	{
+		uint32_t Moved;
+		do
+		{
+			Moved = m_Classes[i].Pages.Reclaim( IsFenceComplete );
+			Count += Moved;
+		} while (Moved == FenceRecycler<LinearPage>::kReclaimBatch);
+	}
+	std::lock_guard<std::mutex> Lock( m_LargeMutex );
+	size_t NumRetired = m_RetiredLargePages.size();
+	ReclaimLargePages();
+	return Count + (uint32_t)(NumRetired - m_RetiredLargePages.size());
+}
+
+void LinearPagePool::Destroy()
+{
+	// Only called after the GPU went idle, so retired pages are as good as available
+	{
+		std::lock_guard<std::mutex> Lock( GetMagazineMutex() );
+		for (auto pMagazines : m_Magazines)
+		{
+			FlushMagazines( *pMagazines, true );
+			pMagazines->pOwner = nullptr;
+		}
+		m_Magazines.clear();
+	}
+	for (uint32_t i = 0; i < m_NumClasses; ++i)
+		m_Classes[i].Pages.Drain( [this]( LinearPage* pPage ) { DestroyPage( pPage ); } );
+	std::lock_guard<std::mutex> Lock( m_LargeMutex );
+	for (auto& Retired : m_RetiredLargePages)
+		DestroyPage( Retired.second );
+	m_RetiredLargePages.clear();
+	for (auto pPage : m_CachedLargePages)
+		DestroyPage( pPage );
+	m_CachedLargePages.clear();
+}
+
+LinearPageClassStats LinearPagePool::GetStats( uint32_t SizeClass )
+{
+	ASSERT( SizeClass < m_NumClasses || SizeClass == kLargePageClass );
+	ClassPool& Class = m_Classes[SizeClass];
+	LinearPageClassStats Stats;
+	Stats.NumPages = Class.NumPages.load( std::memory_order_relaxed );
+	Stats.NumRetired = Class.NumRetired.load( std::memory_order_relaxed );
+	Stats.UsedBytes = Class.UsedBytes.load( std::memory_order_relaxed );
+	Stats.WastedBytes = Class.WastedBytes.load( std::memory_order_relaxed );
+	if (SizeClass == kLargePageClass)
+	{
+		std::lock_guard<std::mutex> Lock( m_LargeMutex );
+		Stats.NumAvailable = (uint32_t)m_CachedLargePages.size();
+	}
+	else
+		Stats.NumAvailable = Class.Pages.GetNumReady();
+	return Stats;
+}
+
+LinearPagePool::ThreadCache::~ThreadCache()
+{
+	std::lock_guard<std::mutex> Lock( GetMagazineMutex() );
+	for (uint32_t i = 0; i < NumPools; ++i)
+	{
+		LinearPagePool* pOwner = Magazines[i]->pOwner;
+		if (pOwner != nullptr)
+		{
+			pOwner->FlushMagazines( *Magazines[i], false );
+			auto& Registered = pOwner->m_Magazines;
+			Registered.erase( std::find( Registered.begin(), Registered.end(), Magazines[i] ) );
+		}
+		delete Magazines[i];
+	}
+}
+
+std::mutex& LinearPagePool::GetMagazineMutex()
+{
+	static std::mutex s_Mutex;
+	return s_Mutex;
+}
+
+LinearPagePool::ThreadMagazines* LinearPagePool::GetThreadMagazines()
+{
+	if (!m_UseMagazines.load( std::memory_order_relaxed )) return nullptr;
+	thread_local ThreadCache t_Cache;
+	ThreadMagazines* pMagazines = nullptr;
+	for (uint32_t i = 0; i < t_Cache.NumPools && pMagazines == nullptr; ++i)
+		if (t_Cache.Pools[i] == this) pMagazines = t_Cache.Magazines[i];
+	if (pMagazines == nullptr)
+	{
+		if (t_Cache.NumPools == ThreadCache::kMaxPools) return nullptr;
+		pMagazines = new ThreadMagazines();
+		t_Cache.Pools[t_Cache.NumPools] = this;
+		t_Cache.Magazines[t_Cache.NumPools++] = pMagazines;
+	}
+	// First use, or the pool was destroyed and is in use again
+	if (pMagazines->pOwner == nullptr)
+	{
+		std::lock_guard<std::mutex> Lock( GetMagazineMutex() );
+		pMagazines->pOwner = this;
+		m_Magazines.push_back( pMagazines );
+	}
+	return pMagazines;
+}
+
+void LinearPagePool::ReclaimMagazine( Magazine& Mag )
+{
+	while (Mag.NumReady < kMagazineSize && !Mag.Retired.empty() && m_pFenceOracle->IsFenceComplete( Mag.Retired.front().first ))
+	{
+		Mag.Ready[Mag.NumReady++] = Mag.Retired.front().second;
+		Mag.Retired.pop_front();
+	}
+}
+
+void LinearPagePool::RefillMagazine( Magazine& Mag, uint32_t SizeClass )
+{
+	IFenceOracle* pFenceOracle = m_pFenceOracle;
+	auto IsFenceComplete = [pFenceOracle]( uint64_t FenceValue ) { return pFenceOracle->IsFenceComplete( FenceValue ); };
+	// Half a magazine, so a thread doesn't drain pages other threads are about to need
+	while (Mag.NumReady < kMagazineSize / 2)
+	{
+		LinearPage* pPage = m_Classes[SizeClass].Pages.Acquire( IsFenceComplete );
+		if (pPage == nullptr) break;
+		Mag.Ready[Mag.NumReady++] = pPage;
+	}
+}
+
+void LinearPagePool::FlushRetired( Magazine& Mag, size_t Count )
+{
+	for (size_t i = 0; i < Count && !Mag.Retired.empty(); ++i)
+	{
+		LinearPage* pPage = Mag.Retired.front().second;
+		m_Classes[pPage->m_SizeClass].Pages.Retire( Mag.Retired.front().first, pPage );
+		Mag.Retired.pop_front();
+	}
+}
+
+void LinearPagePool::PublishStats( Magazine& Mag, uint32_t SizeClass )
+{
+	ClassPool& Class = m_Classes[SizeClass];
+	Class.NumRetired.fetch_add( Mag.NumRetired, std::memory_order_relaxed );
+	Class.UsedBytes.fetch_add( Mag.UsedBytes, std::memory_order_relaxed );
+	Class.WastedBytes.fetch_add( Mag.WastedBytes, std::memory_order_relaxed );
+	Mag.NumRetired = Mag.UsedBytes = Mag.WastedBytes = 0;
+}
+
+void LinearPagePool::FlushMagazines( ThreadMagazines& Magazines, bool DestroyPages )
+{
+	for (uint32_t SizeClass = 0; SizeClass < m_NumClasses; ++SizeClass)
+	{
+		Magazine& Mag = Magazines.Classes[SizeClass];
+		PublishStats( Mag, SizeClass );
+		for (uint32_t i = 0; i < Mag.NumReady; ++i)
+		{
+			if (DestroyPages) DestroyPage( Mag.Ready[i] );
+			else m_Classes[SizeClass].Pages.Release( Mag.Ready[i] );
+		}
+		Mag.NumReady = 0;
+		if (DestroyPages)
+		{
+			for (auto& Retired : Mag.Retired)
+				DestroyPage( Retired.second );
+			Mag.Retired.clear();
+		}
+		else
+			FlushRetired( Mag, Mag.Retired.size() );
+	}
+}
+
+void LinearPagePool::ReclaimLargePages()
+{
+	while (!m_RetiredLargePages.empty() && m_pFenceOracle->IsFenceComplete( m_RetiredLargePages.front().first ))
+	{
+		m_CachedLargePages.push_back( m_RetiredLargePages.front().second );
+		m_RetiredLargePages.pop_front();
+	}
+	// Large pages are rarely the same size twice, keep only the most recent ones
+	while (m_CachedLargePages.size() > kMaxCachedLargePages)
+	{
+		DestroyPage( m_CachedLargePages.front() );
+		m_CachedLargePages.pop_front();
+	}
+}
+
+LinearPage* LinearPagePool::CreatePage( uint32_t SizeClass, size_t SizeInByte )
+{
+	ASSERT( m_pBackingStore != nullptr );
+	LinearPage* pPage = m_pBackingStore->CreatePage( SizeInByte );
+	pPage->m_SizeInByte = SizeInByte;
+	pPage->m_SizeClass = SizeClass;
+	pPage->m_UsedBytes = 0;
+	m_Classes[SizeClass].NumPages.fetch_add( 1, std::memory_order_relaxed );
+	return pPage;
+}
+
+void LinearPagePool::DestroyPage( LinearPage* pPage )
+{
+	m_Classes[pPage->m_SizeClass].NumPages.fetch_sub( 1, std::memory_order_relaxed );
+	m_pBackingStore->DestroyPage( pPage );
+}
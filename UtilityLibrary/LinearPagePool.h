@@ -0,0 +1,184 @@
+#pragma once
+// Fence based recycling of LinearAllocator pages, split into size classes. Pages of a class are
+// created on demand, retired with the fence of the command list which used them and handed out
+// again once that fence completed, through a lock-free FenceRecycler per class. Requests larger
+// than the biggest class get a right-sized large page retired the same way, a few of them are
+// cached and the rest released.
+// Every recording thread keeps a small magazine per class: ready pages plus the pages it retired
+// itself. A thread mostly reuses its own pages once their fence passed and only refills from or
+// returns to the shared recyclers in batches, so parallel recording barely touches shared state.
+// The pool only talks to the device through ILinearPageBackingStore and IFenceOracle, the
+// linear-page-pool area of UtilityTests drives it with a fake backing store.
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "FenceRecycler.h"
+
+//--------------------------------------------------------------------------------------
+// LinearPage
+//--------------------------------------------------------------------------------------
+class LinearPage
+{
+public:
+	LinearPage() :m_SizeInByte( 0 ), m_SizeClass( 0 ), m_UsedBytes( 0 ), m_CpuVirtualAddr( nullptr ), m_GpuVirtualAddr( 0 ) {}
+	virtual ~LinearPage() {}
+
+	size_t			m_SizeInByte;
+	uint32_t		m_SizeClass;		// LinearPagePool::kLargePageClass for a right-sized page
+	size_t			m_UsedBytes;		// Set by the allocator before retiring, everything beyond is waste
+	void*			m_CpuVirtualAddr;
+	uint64_t		m_GpuVirtualAddr;
+};
+
+class ILinearPageBackingStore
+{
+public:
+	virtual ~ILinearPageBackingStore() {}
+	virtual LinearPage* CreatePage( size_t SizeInByte ) = 0;
+	virtual void DestroyPage( LinearPage* pPage ) = 0;
+};
+
+class IFenceOracle
+{
+public:
+	virtual ~IFenceOracle() {}
+	virtual bool IsFenceComplete( uint64_t FenceValue ) = 0;
+};
+
+struct LinearPageClassStats
+{
+	uint32_t	NumPages;			// Pages alive in this class, including cached large pages
+	uint32_t	NumAvailable;		// Pages ready for reuse
+	uint64_t	NumRetired;			// Total pages retired so far
+	uint64_t	UsedBytes;			// Total bytes handed out from retired pages
+	uint64_t	WastedBytes;		// Total bytes left unused in retired pages
+};
+
+//--------------------------------------------------------------------------------------
+// LinearPagePool
+//--------------------------------------------------------------------------------------
+class LinearPagePool
+{
+public:
+	enum
+	{
+		kMaxSizeClasses = 8,
+		kLargePageClass = kMaxSizeClasses,
+		kLargePageAlign = 0x10000,		// 64K, placement alignment of a buffer resource
+		kMaxCachedLargePages = 4,
+		kMagazineSize = 4,				// Ready pages a thread holds per class
+		kMaxLocalRetired = 16,			// In flight pages a thread tracks per class before handing half back
+	};
+
+	// ClassSizes must be ascending, the last one is the biggest page sub-allocated linearly
+	LinearPagePool( const size_t* ClassSizes, uint32_t NumClasses );
+	~LinearPagePool();
+
+	void SetBackend( ILinearPageBackingStore* pBackingStore, IFenceOracle* pFenceOracle );
+	// Thread magazines are on by default, off sends every request to the shared recyclers
+	void SetUseMagazines( bool UseMagazines ) { m_UseMagazines.store( UseMagazines, std::memory_order_relaxed ); }
+
+	uint32_t GetNumClasses() const { return m_NumClasses; }
+	size_t GetClassSize( uint32_t SizeClass ) const { return m_ClassSizes[SizeClass]; }
+	size_t GetMaxClassSize() const { return m_ClassSizes[m_NumClasses - 1]; }
+	// Smallest class holding SizeInByte, kLargePageClass if none does
+	uint32_t GetSizeClass( size_t SizeInByte ) const;
+
+	LinearPage* RequestPage( uint32_t SizeClass );
+	// Page of at least SizeInByte which is not sub-allocated by anyone else
+	LinearPage* RequestLargePage( size_t SizeInByte );
+	void DiscardPages( uint64_t FenceValue, const std::vector<LinearPage*>& Pages );
+	// Move the shared pages whose fence completed to the ready side, so the next request doesn't
+	// have to. Magazines are left to their threads. Returns how many pages were moved
+	uint32_t ReclaimCompleted();
+	// Also releases the pages held in magazines, no thread may use the pool meanwhile
+	void Destroy();
+
+	// SizeClass in [0, GetNumClasses()) or kLargePageClass. Byte counters of a thread are
+	// published every few retired pages, NumAvailable doesn't include magazines
+	LinearPageClassStats GetStats( uint32_t SizeClass );
+
+private:
+	LinearPagePool( const LinearPagePool& ) = delete;
+	LinearPagePool& operator=( const LinearPagePool& ) = delete;
+
+	struct Magazine
+	{
+		Magazine() :NumReady( 0 ), NumRetired( 0 ), UsedBytes( 0 ), WastedBytes( 0 ) {}
+
+		LinearPage*										Ready[kMagazineSize];
+		uint32_t										NumReady;
+		std::deque<std::pair<uint64_t, LinearPage*>>	Retired;
+		// Not yet published to the shared stats
+		uint64_t										NumRetired;
+		uint64_t										UsedBytes;
+		uint64_t										WastedBytes;
+	};
+
+	struct ThreadMagazines
+	{
+		ThreadMagazines() :pOwner( nullptr ) {}
+
+		LinearPagePool*		pOwner;		// nullptr once the pool destroyed its pages
+		Magazine			Classes[kMaxSizeClasses];
+	};
+
+	// Thread local list of magazines, one per pool the thread used. Returns the pages to their
+	// pools when the thread exits.
+	struct ThreadCache
+	{
+		enum { kMaxPools = 4 };
+		ThreadCache() :NumPools( 0 ) {}
+		~ThreadCache();
+
+		const LinearPagePool*	Pools[kMaxPools];
+		ThreadMagazines*		Magazines[kMaxPools];
+		uint32_t				NumPools;
+	};
+
+	ThreadMagazines* GetThreadMagazines();
+	void ReclaimMagazine( Magazine& Mag );
+	void RefillMagazine( Magazine& Mag, uint32_t SizeClass );
+	void FlushRetired( Magazine& Mag, size_t Count );
+	void PublishStats( Magazine& Mag, uint32_t SizeClass );
+	// Hand every page of Magazines to the shared recyclers, or destroy them
+	void FlushMagazines( ThreadMagazines& Magazines, bool DestroyPages );
+	// Guards m_Magazines of all pools and ThreadMagazines::pOwner
+	static std::mutex& GetMagazineMutex();
+
+	void ReclaimLargePages();
+	LinearPage* CreatePage( uint32_t SizeClass, size_t SizeInByte );
+	void DestroyPage( LinearPage* pPage );
+
+	struct ClassPool
+	{
+		ClassPool() :NumPages( 0 ), NumRetired( 0 ), UsedBytes( 0 ), WastedBytes( 0 ) {}
+
+		FenceRecycler<LinearPage>	Pages;
+		std::atomic<uint32_t>		NumPages;
+		std::atomic<uint64_t>		NumRetired;
+		std::atomic<uint64_t>		UsedBytes;
+		std::atomic<uint64_t>		WastedBytes;
+	};
+
+	uint32_t											m_NumClasses;
+	size_t												m_ClassSizes[kMaxSizeClasses];
+	// Last one only counts large pages, they are matched by size so live in the lists below
+	ClassPool											m_Classes[kMaxSizeClasses + 1];
+
+	// Large pages are rare, a lock doesn't hurt there
+	std::mutex											m_LargeMutex;
+	std::deque<std::pair<uint64_t, LinearPage*>>		m_RetiredLargePages;
+	std::deque<LinearPage*>								m_CachedLargePages;
+
+	std::atomic<bool>									m_UseMagazines;
+	std::vector<ThreadMagazines*>						m_Magazines;
+
+	ILinearPageBackingStore*							m_pBackingStore;
+	IFenceOracle*										m_pFenceOracle;
+};
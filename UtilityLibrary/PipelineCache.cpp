@@ -0,0 +1,401 @@
+#include "PortableAssert.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "PipelineCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+	const uint64_t kBlobAlignment = 16;
+
+	// Slicing-by-8, Values[k][b] is the CRC of byte b followed by k zero bytes
+	struct CrcTable
+	{
+		uint32_t	Values[8][256];
+
+		CrcTable()
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t Crc = i;
+				for (uint32_t Bit = 0; Bit < 8; ++Bit)
+					Crc = (Crc >> 1) ^ (Crc & 1 ? 0xedb88320u : 0);
+				Values[0][i] = Crc;
+			}
+			for (uint32_t i = 0; i < 256; ++i)
+				for (uint32_t k = 1; k < 8; ++k)
+					Values[k][i] = (Values[k - 1][i] >> 8) ^ Values[0][Values[k - 1][i] & 0xff];
+		}
+	};
+
+	uint64_t AlignUp( uint64_t Value, uint64_t Alignment )
+	{
+		return (Value + Alignment - 1) & ~(Alignment - 1);
+	}
+
+	struct PendingBlob
+	{
+		uint64_t		Key;
+		const void*		Data;
+		size_t			Size;
+
+		bool operator<( const PendingBlob& Other ) const { return Key < Other.Key; }
+	};
+
+#ifdef _WIN32
+	std::wstring Widen( const std::string& Path )
+	{
+		const int Size = MultiByteToWideChar( CP_UTF8, 0, Path.c_str(), -1, nullptr, 0 );
+		std::wstring Wide( Size > 0 ? Size : 1, L'\0' );
+		MultiByteToWideChar( CP_UTF8, 0, Path.c_str(), -1, &Wide[0], Size );
+		return Wide;
+	}
+#endif
+
+	bool WriteCacheFile( const std::string& Path, const std::vector<uint8_t>& Bytes )
+	{
+#ifdef _WIN32
+		FILE* pFile = _wfopen( Widen( Path ).c_str(), L"wb" );
+#else
+		FILE* pFile = fopen( Path.c_str(), "wb" );
+#endif
+		if (pFile == nullptr)
+			return false;
+		const bool Written = fwrite( Bytes.data(), 1, Bytes.size(), pFile ) == Bytes.size();
+		return fclose( pFile ) == 0 && Written;
+	}
+
+	bool MoveCacheFileOver( const std::string& From, const std::string& To )
+	{
+#ifdef _WIN32
+		return MoveFileExW( Widen( From ).c_str(), Widen( To ).c_str(), MOVEFILE_REPLACE_EXISTING ) != 0;
+#else
+		return rename( From.c_str(), To.c_str() ) == 0;
+#endif
+	}
+}
+
+uint64_t PipelineCacheHash( const void* Data, size_t Size, uint64_t Hash /* = kPipelineCacheHashSeed */ )
+{
+	const uint8_t* Bytes = (const uint8_t*)Data;
+	for (size_t i = 0; i < Size; ++i)
+	{
+		Hash ^= Bytes[i];
+		Hash *= 1099511628211ull;
+	}
+	return Hash;
+}
+
+uint32_t PipelineCacheCrc( const void* Data, size_t Size )
+{
+	static const CrcTable Table;
+	const uint8_t* Bytes = (const uint8_t*)Data;
+	uint32_t Crc = 0xffffffff;
+	// Little-endian, like every target the file is written on
+	for (; Size >= 8; Size -= 8, Bytes += 8)
+	{
+		uint32_t Low;
+		uint32_t High;
+		memcpy( &Low, Bytes, 4 );
+		memcpy( &High, Bytes + 4, 4 );
+		Low ^= Crc;
+		Crc = Table.Values[7][Low & 0xff] ^ Table.Values[6][(Low >> 8) & 0xff] ^ Table.Values[5][(Low >> 16) & 0xff] ^
+			Table.Values[4][Low >> 24] ^ Table.Values[3][High & 0xff] ^ Table.Values[2][(High >> 8) & 0xff] ^
+			Table.Values[1][(High >> 16) & 0xff] ^ Table.Values[0][High >> 24];
+	}
+	for (; Size > 0; --Size, ++Bytes)
+		Crc = Table.Values[0][(Crc ^ *Bytes) & 0xff] ^ (Crc >> 8);
+	return ~Crc;
+}
+
+const char* GetPipelineCacheLoadResultName( PipelineCacheLoadResult Result )
+{
+	switch (Result)
+	{
+	case kCacheLoaded: return "loaded";
+	case kCacheMissing: return "missing";
+	case kCacheNotACache: return "not a cache";
+	case kCacheOldVersion: return "old version";
+	case kCacheOtherDevice: return "other device";
+	case kCacheTruncated: return "truncated";
+	case kCacheCorrupt: return "corrupt";
+	}
+	return "unknown";
+}
+
+//--------------------------------------------------------------------------------------
+// PipelineCache
+//--------------------------------------------------------------------------------------
+PipelineCache::PipelineCache()
+	:m_DeviceKey( 0 ), m_pMapped( nullptr ), m_MappedSize( 0 ), m_pEntries( nullptr ), m_NumEntries( 0 )
+{
+#ifdef _WIN32
+	m_File = INVALID_HANDLE_VALUE;
+	m_Mapping = nullptr;
+#endif
+	memset( &m_Stats, 0, sizeof( m_Stats ) );
+}
+
+PipelineCache::~PipelineCache()
+{
+	Close();
+}
+
+PipelineCacheLoadResult PipelineCache::Load( const std::string& Path, uint64_t DeviceKey )
+{
+	Close();
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_DeviceKey = DeviceKey;
+
+#ifdef _WIN32
+	m_File = CreateFileW( Widen( Path ).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if (m_File == INVALID_HANDLE_VALUE)
+		return kCacheMissing;
+	LARGE_INTEGER FileSize;
+	if (!GetFileSizeEx( m_File, &FileSize ) || (uint64_t)FileSize.QuadPart < sizeof( PipelineCacheHeader ))
+		return kCacheNotACache;
+	m_Mapping = CreateFileMappingW( m_File, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if (m_Mapping == nullptr)
+		return kCacheNotACache;
+	m_pMapped = (const uint8_t*)MapViewOfFile( m_Mapping, FILE_MAP_READ, 0, 0, 0 );
+	if (m_pMapped == nullptr)
+		return kCacheNotACache;
+	m_MappedSize = (uint64_t)FileSize.QuadPart;
+#else
+	const int File = open( Path.c_str(), O_RDONLY );
+	if (File < 0)
+		return kCacheMissing;
+	struct stat FileStat;
+	if (fstat( File, &FileStat ) != 0 || (uint64_t)FileStat.st_size < sizeof( PipelineCacheHeader ))
+	{
+		close( File );
+		return kCacheNotACache;
+	}
+	void* pMapped = mmap( nullptr, (size_t)FileStat.st_size, PROT_READ, MAP_PRIVATE, File, 0 );
+	// The mapping keeps the file open
+	close( File );
+	if (pMapped == MAP_FAILED)
+		return kCacheNotACache;
+	m_pMapped = (const uint8_t*)pMapped;
+	m_MappedSize = (uint64_t)FileStat.st_size;
+#endif
+
+	// Nothing is trusted before it checks out, a file that doesn't stays mapped until Close() but has
+	// no entries
+	PipelineCacheHeader Header;
+	memcpy( &Header, m_pMapped, sizeof( Header ) );
+	if (Header.Magic != kPipelineCacheMagic)
+		return kCacheNotACache;
+	if (Header.Version != kPipelineCacheVersion)
+		return kCacheOldVersion;
+	if (Header.DeviceKey != DeviceKey)
+		return kCacheOtherDevice;
+	const uint64_t TableEnd = sizeof( Header ) + (uint64_t)Header.NumEntries * sizeof( PipelineCacheEntry );
+	if (Header.FileSize != m_MappedSize || TableEnd > m_MappedSize)
+		return kCacheTruncated;
+	const PipelineCacheEntry* pEntries = (const PipelineCacheEntry*)(m_pMapped + sizeof( Header ));
+	if (PipelineCacheCrc( pEntries, (size_t)(TableEnd - sizeof( Header )) ) != Header.TableCrc)
+		return kCacheCorrupt;
+	for (uint32_t i = 0; i < Header.NumEntries; ++i)
+	{
+		const PipelineCacheEntry& Entry = pEntries[i];
+		if (Entry.Offset < TableEnd || Entry.Offset > m_MappedSize || Entry.Size > m_MappedSize - Entry.Offset)
+			return kCacheTruncated;
+		if (i > 0 && pEntries[i - 1].Key >= Entry.Key)
+			return kCacheCorrupt;
+	}
+
+	m_pEntries = pEntries;
+	m_NumEntries = Header.NumEntries;
+	m_States.assign( m_NumEntries, kEntryUnchecked );
+	m_Stats.NumLoaded = m_NumEntries;
+	return kCacheLoaded;
+}
+
+const PipelineCacheEntry* PipelineCache::FindMapped( uint64_t Key ) const
+{
+	const PipelineCacheEntry* pEnd = m_pEntries + m_NumEntries;
+	const PipelineCacheEntry* pEntry = std::lower_bound( m_pEntries, pEnd, Key,
+		[]( const PipelineCacheEntry& Entry, uint64_t Value ) { return Entry.Key < Value; } );
+	return pEntry != pEnd && pEntry->Key == Key ? pEntry : nullptr;
+}
+
+bool PipelineCache::CheckMapped( size_t Index )
+{
+	if (m_States[Index] == kEntryUnchecked)
+	{
+		const PipelineCacheEntry& Entry = m_pEntries[Index];
+		const bool Good = PipelineCacheCrc( m_pMapped + Entry.Offset, Entry.Size ) == Entry.Crc;
+		m_States[Index] = Good ? kEntryGood : kEntryBad;
+		m_Stats.NumCorrupt += !Good;
+	}
+	return m_States[Index] == kEntryGood;
+}
+
+bool PipelineCache::FindLocked( uint64_t Key, const void*& Data, size_t& Size )
+{
+	auto Iter = m_Added.find( Key );
+	if (Iter != m_Added.end())
+	{
+		Data = Iter->second.data();
+		Size = Iter->second.size();
+		return true;
+	}
+	const PipelineCacheEntry* pEntry = FindMapped( Key );
+	if (pEntry != nullptr && CheckMapped( pEntry - m_pEntries ))
+	{
+		Data = m_pMapped + pEntry->Offset;
+		Size = pEntry->Size;
+		return true;
+	}
+	return false;
+}
+
+bool PipelineCache::Find( uint64_t Key, const void*& Data, size_t& Size )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	const bool Found = FindLocked( Key, Data, Size );
+	++(Found ? m_Stats.NumHits : m_Stats.NumMisses);
+	return Found;
+}
+
+bool PipelineCache::FindCopy( uint64_t Key, const std::function<void*( size_t Size )>& Allocate )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	const void* Data;
+	size_t Size;
+	void* pCopy = nullptr;
+	const bool Found = FindLocked( Key, Data, Size ) && (pCopy = Allocate( Size )) != nullptr;
+	if (Found)
+		memcpy( pCopy, Data, Size );
+	++(Found ? m_Stats.NumHits : m_Stats.NumMisses);
+	return Found;
+}
+
+void PipelineCache::Add( uint64_t Key, const void* Data, size_t Size )
+{
+	ASSERT( Size <= 0xffffffff );
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	const uint8_t* Bytes = (const uint8_t*)Data;
+	m_Added[Key].assign( Bytes, Bytes + Size );
+	++m_Stats.NumAdded;
+}
+
+void PipelineCache::Invalidate( uint64_t Key )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_Added.erase( Key );
+	const PipelineCacheEntry* pEntry = FindMapped( Key );
+	if (pEntry != nullptr)
+		m_States[pEntry - m_pEntries] = kEntryBad;
+	++m_Stats.NumInvalidated;
+}
+
+bool PipelineCache::Save( const std::string& Path, bool KeepUnused /* = true */ )
+{
+	std::vector<uint8_t> Bytes;
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		std::vector<PendingBlob> Blobs;
+		Blobs.reserve( m_NumEntries + m_Added.size() );
+		for (uint32_t i = 0; i < m_NumEntries; ++i)
+		{
+			const PipelineCacheEntry& Entry = m_pEntries[i];
+			if (m_Added.count( Entry.Key ) == 0 && (KeepUnused || m_States[i] != kEntryUnchecked) && CheckMapped( i ))
+			{
+				PendingBlob Blob = { Entry.Key, m_pMapped + Entry.Offset, Entry.Size };
+				Blobs.push_back( Blob );
+			}
+		}
+		for (auto& Added : m_Added)
+		{
+			PendingBlob Blob = { Added.first, Added.second.data(), Added.second.size() };
+			Blobs.push_back( Blob );
+		}
+		std::sort( Blobs.begin(), Blobs.end() );
+
+		PipelineCacheHeader Header;
+		Header.Magic = kPipelineCacheMagic;
+		Header.Version = kPipelineCacheVersion;
+		Header.DeviceKey = m_DeviceKey;
+		Header.NumEntries = (uint32_t)Blobs.size();
+		std::vector<PipelineCacheEntry> Entries( Blobs.size() );
+		uint64_t Offset = sizeof( Header ) + Entries.size() * sizeof( PipelineCacheEntry );
+		for (size_t i = 0; i < Blobs.size(); ++i)
+		{
+			Offset = AlignUp( Offset, kBlobAlignment );
+			PipelineCacheEntry Entry = { Blobs[i].Key, Offset, (uint32_t)Blobs[i].Size, PipelineCacheCrc( Blobs[i].Data, Blobs[i].Size ) };
+			Entries[i] = Entry;
+			Offset += Blobs[i].Size;
+		}
+		Header.FileSize = Offset;
+		Header.TableCrc = PipelineCacheCrc( Entries.data(), Entries.size() * sizeof( PipelineCacheEntry ) );
+
+		Bytes.assign( (size_t)Header.FileSize, 0 );
+		memcpy( Bytes.data(), &Header, sizeof( Header ) );
+		if (!Entries.empty())
+			memcpy( Bytes.data() + sizeof( Header ), Entries.data(), Entries.size() * sizeof( PipelineCacheEntry ) );
+		for (size_t i = 0; i < Blobs.size(); ++i)
+			memcpy( Bytes.data() + Entries[i].Offset, Blobs[i].Data, Blobs[i].Size );
+	}
+
+	// Windows won't replace a file still mapped
+	Close();
+	const std::string TempPath = Path + ".tmp";
+	if (!WriteCacheFile( TempPath, Bytes ) || !MoveCacheFileOver( TempPath, Path ))
+	{
+#ifdef _WIN32
+		_wremove( Widen( TempPath ).c_str() );
+#else
+		remove( TempPath.c_str() );
+#endif
+		return false;
+	}
+	return true;
+}
+
+void PipelineCache::Close()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+#ifdef _WIN32
+	if (m_pMapped != nullptr)
+		UnmapViewOfFile( m_pMapped );
+	if (m_Mapping != nullptr)
+		CloseHandle( m_Mapping );
+	if (m_File != INVALID_HANDLE_VALUE)
+		CloseHandle( m_File );
+	m_File = INVALID_HANDLE_VALUE;
+	m_Mapping = nullptr;
+#else
+	if (m_pMapped != nullptr)
+		munmap( (void*)m_pMapped, (size_t)m_MappedSize );
+#endif
+	m_pMapped = nullptr;
+	m_MappedSize = 0;
+	m_pEntries = nullptr;
+	m_NumEntries = 0;
+	m_States.clear();
+	m_Added.clear();
+}
+
+uint32_t PipelineCache::GetNumEntries() const
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	uint32_t NumEntries = m_NumEntries;
+	for (auto& Added : m_Added)
+		NumEntries += FindMapped( Added.first ) == nullptr;
+	return NumEntries;
+}
+
+PipelineCacheStats PipelineCache::GetStats() const
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	return m_Stats;
+}
@@ -0,0 +1,126 @@
+#pragma once
+// Blobs by 64-bit content key kept in a file from one run to the next, see PipelineCacheHeader for the format
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const uint32_t kPipelineCacheMagic = 0x43505350;				// "PSPC"
+const uint32_t kPipelineCacheVersion = 1;
+const uint64_t kPipelineCacheHashSeed = 14695981039346656037ull;
+
+// File: this header, NumEntries PipelineCacheEntry sorted by key, then the blobs. A file of another
+// version or device is ignored as a whole.
+struct PipelineCacheHeader
+{
+	uint32_t	Magic;
+	uint32_t	Version;
+	uint64_t	DeviceKey;
+	uint64_t	FileSize;
+	uint32_t	NumEntries;
+	uint32_t	TableCrc;				// Of the entry table
+};
+
+struct PipelineCacheEntry
+{
+	uint64_t	Key;
+	uint64_t	Offset;					// From the start of the file
+	uint32_t	Size;
+	uint32_t	Crc;
+};
+
+enum PipelineCacheLoadResult : uint8_t
+{
+	kCacheLoaded,
+	kCacheMissing,					// No file, the first run
+	kCacheNotACache,				// Too small or not the magic
+	kCacheOldVersion,
+	kCacheOtherDevice,				// Another adapter or driver
+	kCacheTruncated,				// Shorter than the header says, or entries out of it
+	kCacheCorrupt,					// Entry table failing its CRC or not sorted
+};
+
+struct PipelineCacheStats
+{
+	uint32_t	NumLoaded;				// Entries of the file loaded
+	uint32_t	NumHits;
+	uint32_t	NumMisses;
+	uint32_t	NumCorrupt;				// Blobs failing their CRC
+	uint32_t	NumInvalidated;			// Blobs the device refused
+	uint32_t	NumAdded;
+};
+
+// 64-bit FNV-1a over whatever the blob was made from, so keys don't depend on where anything ended
+// up in memory. Chain calls through Hash for keys made of several parts
+uint64_t PipelineCacheHash( const void* Data, size_t Size, uint64_t Hash = kPipelineCacheHashSeed );
+// CRC-32 as zlib computes it
+uint32_t PipelineCacheCrc( const void* Data, size_t Size );
+const char* GetPipelineCacheLoadResultName( PipelineCacheLoadResult Result );
+
+//--------------------------------------------------------------------------------------
+// PipelineCache
+//--------------------------------------------------------------------------------------
+// For pipeline states and root signatures, and the shader bytecode of ShaderCacheKey.h. Find(),
+// FindCopy(), Add() and Invalidate() may be called from any thread. Paths are UTF-8.
+class PipelineCache
+{
+public:
+	PipelineCache();
+	~PipelineCache();
+
+	// Maps the file read-only, with mmap() or MapViewOfFile(). DeviceKey names the adapter and driver, blobs of another one are of no use to the device. The
+	// key is remembered for Save() whatever comes back. Starts over, blobs added before are dropped.
+	PipelineCacheLoadResult Load( const std::string& Path, uint64_t DeviceKey );
+	// A blob's CRC is checked the first time it is handed out, one failing it is a miss and left out
+	// of the next Save(). Data stays valid until Save() or Close(), or Add() of the same key; callers which may race
+	// with an Add() of the key on another thread use FindCopy()
+	bool Find( uint64_t Key, const void*& Data, size_t& Size );
+	// Copies the blob into what Allocate returns for its size, still holding the lock. A miss as well
+	// when Allocate returns nullptr.
+	bool FindCopy( uint64_t Key, const std::function<void*( size_t Size )>& Allocate );
+	// Replaces what the key had
+	void Add( uint64_t Key, const void* Data, size_t Size );
+	// The device refused the blob, it is a miss from now on and not saved again
+	void Invalidate( uint64_t Key );
+	// Closes the file loaded first, false if it couldn't be written. Writes a new file next to the old
+	// one and renames it over, a run killed halfway through never leaves a broken cache behind. Without KeepUnused only the blobs
+	// found or added since Load() are written, what the run didn't ask for is dropped.
+	bool Save( const std::string& Path, bool KeepUnused = true );
+	void Close();
+
+	uint32_t GetNumEntries() const;
+	PipelineCacheStats GetStats() const;
+
+private:
+	enum EntryState : uint8_t
+	{
+		kEntryUnchecked,
+		kEntryGood,
+		kEntryBad,
+	};
+
+	const PipelineCacheEntry* FindMapped( uint64_t Key ) const;
+	// Find() with m_Mutex held, stats left alone
+	bool FindLocked( uint64_t Key, const void*& Data, size_t& Size );
+	bool CheckMapped( size_t Index );
+
+	mutable std::mutex	m_Mutex;
+	uint64_t			m_DeviceKey;
+
+	const uint8_t*				m_pMapped;
+	uint64_t					m_MappedSize;
+	const PipelineCacheEntry*	m_pEntries;
+	uint32_t					m_NumEntries;
+	std::vector<EntryState>		m_States;			// Per entry of the file
+#ifdef _WIN32
+	void*				m_File;
+	void*				m_Mapping;
+#endif
+
+	std::unordered_map<uint64_t, std::vector<uint8_t>>	m_Added;
+	PipelineCacheStats	m_Stats;
+};
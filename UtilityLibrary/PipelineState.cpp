@@ -7,6 +7,7 @@
 #include "PipelineState.h"
 #include "Graphics.h"
 #include "Utility.h"
+#include "PipelineCache.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace std;
@@ -17,6 +18,72 @@ static unordered_map<size_t, ComPtr<ID3D12PipelineState>> s_ComputePSOHashMap;
 static CRITICAL_SECTION s_GraphicsPSOCS;
 static CRITICAL_SECTION s_ComputePSOCS;
 
+// Created without a cached blob, their blobs go to the pipeline cache in DestroyAll(); guarded by
+// the critical section of their map
+static vector<pair<uint64_t, ID3D12PipelineState*>> s_NewGraphicsPSOs;
+static vector<pair<uint64_t, ID3D12PipelineState*>> s_NewComputePSOs;
+
+namespace
+{
+	uint64_t HashBytecode( const D3D12_SHADER_BYTECODE& Bytecode, uint64_t Hash )
+	{
+		Hash = PipelineCacheHash( &Bytecode.BytecodeLength, sizeof( Bytecode.BytecodeLength ), Hash );
+		return PipelineCacheHash( Bytecode.pShaderBytecode, Bytecode.BytecodeLength, Hash );
+	}
+
+	// The desc with its pointers cleared, then what they point to, so the key is the same every run
+	uint64_t GetCacheKey( const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, const RootSignature& Signature )
+	{
+		// GraphicsPSO has no way to set stream output
+		ASSERT( Desc.StreamOutput.NumEntries == 0 && Desc.StreamOutput.NumStrides == 0 );
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC State;
+		memcpy( &State, &Desc, sizeof( State ) );
+		State.pRootSignature = nullptr;
+		State.VS = State.PS = State.DS = State.HS = State.GS = {};
+		State.StreamOutput = {};
+		State.InputLayout.pInputElementDescs = nullptr;
+		State.CachedPSO = {};
+
+		const uint64_t RootSignatureKey = Signature.GetCacheKey();
+		uint64_t Key = PipelineCacheHash( "GraphicsPSO", 11 );
+		Key = PipelineCacheHash( &State, sizeof( State ), Key );
+		Key = PipelineCacheHash( &RootSignatureKey, sizeof( RootSignatureKey ), Key );
+		Key = HashBytecode( Desc.VS, Key );
+		Key = HashBytecode( Desc.PS, Key );
+		Key = HashBytecode( Desc.DS, Key );
+		Key = HashBytecode( Desc.HS, Key );
+		Key = HashBytecode( Desc.GS, Key );
+		for (UINT i = 0; i < Desc.InputLayout.NumElements; ++i)
+		{
+			D3D12_INPUT_ELEMENT_DESC Element = Desc.InputLayout.pInputElementDescs[i];
+			Key = PipelineCacheHash( Element.SemanticName, strlen( Element.SemanticName ), Key );
+			Element.SemanticName = nullptr;
+			Key = PipelineCacheHash( &Element, sizeof( Element ), Key );
+		}
+		return Key;
+	}
+
+	uint64_t GetCacheKey( const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, const RootSignature& Signature )
+	{
+		const uint64_t RootSignatureKey = Signature.GetCacheKey();
+		uint64_t Key = PipelineCacheHash( "ComputePSO", 10 );
+		Key = PipelineCacheHash( &Desc.NodeMask, sizeof( Desc.NodeMask ), Key );
+		Key = PipelineCacheHash( &Desc.Flags, sizeof( Desc.Flags ), Key );
+		Key = PipelineCacheHash( &RootSignatureKey, sizeof( RootSignatureKey ), Key );
+		return HashBytecode( Desc.CS, Key );
+	}
+
+	void AddToCache( const vector<pair<uint64_t, ID3D12PipelineState*>>& NewPSOs )
+	{
+		for (auto& NewPSO : NewPSOs)
+		{
+			ComPtr<ID3DBlob> Blob;
+			if (SUCCEEDED( NewPSO.second->GetCachedBlob( &Blob ) ))
+				Graphics::g_pipelineCache.Add( NewPSO.first, Blob->GetBufferPointer(), Blob->GetBufferSize() );
+		}
+	}
+}
+
 //--------------------------------------------------------------------------------------
 // PSO
 //--------------------------------------------------------------------------------------
@@ -28,6 +95,10 @@ void PSO::Initialize()
 
 void PSO::DestroyAll()
 {
+	AddToCache( s_NewGraphicsPSOs );
+	AddToCache( s_NewComputePSOs );
+	s_NewGraphicsPSOs.clear();
+	s_NewComputePSOs.clear();
 	s_GraphicsPSOHashMap.clear();
 	s_ComputePSOHashMap.clear();
 }
@@ -144,8 +215,30 @@ void GraphicsPSO::Finalize()
 	if (firstCompile)
 	{
 		HRESULT hr;
-		V( Graphics::g_device->CreateGraphicsPipelineState( &m_PSODesc, IID_PPV_ARGS( &m_PSO ) ) );
+		const uint64_t CacheKey = GetCacheKey( m_PSODesc, *m_RootSignature );
+		m_PSO = nullptr;
+		const void* CachedBlob;
+		size_t CachedSize;
+		if (Graphics::g_pipelineCache.Find( CacheKey, CachedBlob, CachedSize ))
+		{
+			m_PSODesc.CachedPSO.pCachedBlob = CachedBlob;
+			m_PSODesc.CachedPSO.CachedBlobSizeInBytes = CachedSize;
+			// Another driver or a blob gone bad, either way it is compiled again
+			if (FAILED( Graphics::g_device->CreateGraphicsPipelineState( &m_PSODesc, IID_PPV_ARGS( &m_PSO ) ) ))
+			{
+				PRINTWARN( "Cached graphics PSO refused, compiling it again" );
+				Graphics::g_pipelineCache.Invalidate( CacheKey );
+				m_PSO = nullptr;
+			}
+			m_PSODesc.CachedPSO = {};
+		}
+		const bool Cached = m_PSO != nullptr;
+		if (!Cached)
+			V( Graphics::g_device->CreateGraphicsPipelineState( &m_PSODesc, IID_PPV_ARGS( &m_PSO ) ) );
+		CriticalSectionScope LockGuard( &s_GraphicsPSOCS );
 		s_GraphicsPSOHashMap[HashCode].Attach( m_PSO );
+		if (!Cached)
+			s_NewGraphicsPSOs.push_back( make_pair( CacheKey, m_PSO ) );
 	}
 	else
 	{
@@ -187,8 +280,29 @@ void ComputePSO::Finalize()
 	if (firstCompile)
 	{
 		HRESULT hr;
-		V( Graphics::g_device->CreateComputePipelineState( &m_PSODesc, IID_PPV_ARGS( &m_PSO ) ) );
+		const uint64_t CacheKey = GetCacheKey( m_PSODesc, *m_RootSignature );
+		m_PSO = nullptr;
+		const void* CachedBlob;
+		size_t CachedSize;
+		if (Graphics::g_pipelineCache.Find( CacheKey, CachedBlob, CachedSize ))
+		{
+			m_PSODesc.CachedPSO.pCachedBlob = CachedBlob;
+			m_PSODesc.CachedPSO.CachedBlobSizeInBytes = CachedSize;
+			if (FAILED( Graphics::g_device->CreateComputePipelineState( &m_PSODesc, IID_PPV_ARGS( &m_PSO ) ) ))
+			{
+				PRINTWARN( "Cached compute PSO refused, compiling it again" );
+				Graphics::g_pipelineCache.Invalidate( CacheKey );
+				m_PSO = nullptr;
+			}
+			m_PSODesc.CachedPSO = {};
+		}
+		const bool Cached = m_PSO != nullptr;
+		if (!Cached)
+			V( Graphics::g_device->CreateComputePipelineState( &m_PSODesc, IID_PPV_ARGS( &m_PSO ) ) );
+		CriticalSectionScope LockGuard( &s_ComputePSOCS );
 		s_ComputePSOHashMap[HashCode].Attach( m_PSO );
+		if (!Cached)
+			s_NewComputePSOs.push_back( make_pair( CacheKey, m_PSO ) );
 	}
 	else
 	{
@@ -0,0 +1,10 @@
+#pragma once
+// ASSERT for the files which build on Linux too: Utility.h's on Windows, assert() everywhere else.
+
+#ifdef _WIN32
+#include "LibraryHeader.h"
+#include "Utility.h"
+#else
+#include <assert.h>
+#define ASSERT assert
+#endif
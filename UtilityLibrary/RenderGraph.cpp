@@ -0,0 +1,524 @@
+#include "PortableAssert.h"
+#include "RenderGraph.h"
+
+#include <algorithm>
+
+namespace
+{
+	const uint32_t kNone = 0xffffffff;
+
+	// Same as VALID_COMPUTE_QUEUE_RESOURCE_STATES, COMMON is 0 and valid everywhere
+	const BarrierState kComputeQueueStates = 0x8 | 0x40 | 0x400 | 0x800;
+	const BarrierState kCopyQueueStates = 0x400 | 0x800;
+
+	bool IsValidOn( RenderGraphQueue Queue, BarrierState State )
+	{
+		if (Queue == kRenderGraphCompute)
+			return (State & kComputeQueueStates) == State;
+		if (Queue == kRenderGraphCopy)
+			return (State & kCopyQueueStates) == State;
+		return true;
+	}
+
+	struct AccessRange
+	{
+		const RenderGraphAccess*	First;
+		uint32_t					Count;
+
+		const RenderGraphAccess* begin() const { return First; }
+		const RenderGraphAccess* end() const { return First + Count; }
+	};
+
+	// Pass GetNumPasses() is the final state pass
+	AccessRange GetPassAccesses( const RenderGraph& Graph, const CompiledRenderGraph& Compiled, uint32_t Pass )
+	{
+		if (Pass == Graph.GetNumPasses())
+			return { Compiled.FinalAccesses.data(), (uint32_t)Compiled.FinalAccesses.size() };
+		const RenderGraphPass& Desc = Graph.GetPass( Pass );
+		return { Graph.GetAccesses().data() + Desc.FirstAccess, Desc.NumAccesses };
+	}
+
+	// One work per compiled pass, a flush ending every segment. Transients start in the state their
+	// first pass needs, a UAV written by the access before gets a UAV barrier request.
+	void BuildBarrierStream( const RenderGraph& Graph, const CompiledRenderGraph& Compiled, BarrierStream& Stream )
+	{
+		const uint32_t NumResources = Graph.GetNumResources();
+		std::vector<BarrierState> InitialStates( NumResources, 0 );
+		std::vector<uint8_t> Seen( NumResources, 0 );
+		for (uint32_t i = 0; i < NumResources; ++i)
+		{
+			Seen[i] = Graph.GetResource( i ).Imported;
+			InitialStates[i] = Graph.GetResource( i ).InitialState;
+		}
+		for (auto& Pass : Compiled.Passes)
+		{
+			for (auto& Access : GetPassAccesses( Graph, Compiled, Pass.Pass ))
+			{
+				if (!Seen[Access.Resource])
+					InitialStates[Access.Resource] = Access.State;
+				Seen[Access.Resource] = 1;
+			}
+		}
+
+		Stream.Resources.clear();
+		Stream.Ops.clear();
+		for (uint32_t i = 0; i < NumResources; ++i)
+			Stream.AddResource( 1, InitialStates[i] );
+		std::vector<uint8_t> Written( NumResources, 0 );
+		for (auto& Segment : Compiled.Segments)
+		{
+			for (uint32_t i = Segment.FirstPass; i < Segment.FirstPass + Segment.NumPasses; ++i)
+			{
+				for (auto& Access : GetPassAccesses( Graph, Compiled, Compiled.Passes[i].Pass ))
+				{
+					Stream.Transition( Access.Resource, Access.State );
+					if (Access.State == kBarrierStateUAV && Written[Access.Resource])
+						Stream.UAV( Access.Resource );
+					Written[Access.Resource] = Access.Write;
+				}
+				if (i + 1 == Segment.FirstPass + Segment.NumPasses)
+					Stream.Flush();
+				else
+					Stream.Work();
+			}
+		}
+	}
+
+	struct SegmentBuild
+	{
+		RenderGraphQueue		Queue;
+		bool					Open;
+		uint32_t				Seq;						// 1 for the queue's first segment
+		uint32_t				Clock[kRenderGraphNumQueues];	// Seq of the last segment per queue known done at the start
+		std::vector<uint32_t>	Passes;
+		std::vector<uint32_t>	Waits;
+	};
+
+	// Dependencies of the passes through one resource: a pass follows the last writer and the pass
+	// whose barriers put the resource in its state, a writer or a pass needing another state also
+	// follows everyone reading since
+	struct ResourceTrack
+	{
+		uint32_t				LastWriter;
+		uint32_t				StateSetter;
+		BarrierState			State;
+		std::vector<uint32_t>	Readers;
+	};
+}
+
+//--------------------------------------------------------------------------------------
+// RenderGraph
+//--------------------------------------------------------------------------------------
+void RenderGraph::Reset()
+{
+	m_Resources.clear();
+	m_Passes.clear();
+	m_Accesses.clear();
+}
+
+uint32_t RenderGraph::Import( const std::string& Name, BarrierState InitialState, BarrierState FinalState )
+{
+	RenderGraphResource Resource = { Name, true, InitialState, FinalState, 0, 0, 0 };
+	m_Resources.push_back( Resource );
+	return (uint32_t)m_Resources.size() - 1;
+}
+
+uint32_t RenderGraph::CreateTransient( const std::string& Name, uint64_t SizeBytes, uint64_t Alignment, uint32_t Heap )
+{
+	ASSERT( Alignment != 0 && (Alignment & (Alignment - 1)) == 0 );
+	RenderGraphResource Resource = { Name, false, 0, kRenderGraphKeepState, SizeBytes, Alignment, Heap };
+	m_Resources.push_back( Resource );
+	return (uint32_t)m_Resources.size() - 1;
+}
+
+uint32_t RenderGraph::AddPass( const std::string& Name, uint32_t Flags )
+{
+	RenderGraphPass Pass = { Name, Flags, (uint32_t)m_Accesses.size(), 0 };
+	m_Passes.push_back( Pass );
+	return (uint32_t)m_Passes.size() - 1;
+}
+
+void RenderGraph::Read( uint32_t Resource, BarrierState State )
+{
+	Access( Resource, State, false );
+}
+
+void RenderGraph::Write( uint32_t Resource, BarrierState State )
+{
+	Access( Resource, State, true );
+}
+
+void RenderGraph::Access( uint32_t Resource, BarrierState State, bool Write )
+{
+	ASSERT( !m_Passes.empty() && Resource < m_Resources.size() );
+	RenderGraphPass& Pass = m_Passes.back();
+	for (uint32_t i = Pass.FirstAccess; i < Pass.FirstAccess + Pass.NumAccesses; ++i)
+	{
+		RenderGraphAccess& Other = m_Accesses[i];
+		if (Other.Resource == Resource && Other.State == State)
+		{
+			Other.Read |= !Write;
+			Other.Write |= Write;
+			return;
+		}
+	}
+	// Another state of the same resource is kept, Compile() reports it
+	RenderGraphAccess NewAccess = { Resource, State, !Write, Write };
+	m_Accesses.push_back( NewAccess );
+	Pass.NumAccesses++;
+}
+
+bool RenderGraph::Compile( const RenderGraphOptions& Options, CompiledRenderGraph& Out ) const
+{
+	const uint32_t NumPasses = GetNumPasses();
+	const uint32_t NumResources = GetNumResources();
+	const uint32_t FinalPass = NumPasses;
+
+	Out.Passes.clear();
+	Out.Segments.clear();
+	Out.Transients.clear();
+	Out.Culled.assign( NumPasses, 0 );
+	Out.FinalAccesses.clear();
+	Out.NumCulled = 0;
+	Out.NumWaits = 0;
+	Out.HeapSizes.clear();
+	Out.HeapSize = 0;
+	Out.TransientBytes = 0;
+	Out.BarrierStats = BarrierPassStats();
+	Out.Error.clear();
+
+	std::vector<uint32_t> Mark( NumResources, kNone );
+	for (uint32_t p = 0; p < NumPasses; ++p)
+	{
+		for (auto& Access : GetPassAccesses( *this, Out, p ))
+		{
+			if (Mark[Access.Resource] == p)
+			{
+				Out.Error = "Pass " + m_Passes[p].Name + " needs " + m_Resources[Access.Resource].Name + " in two states";
+				return false;
+			}
+			Mark[Access.Resource] = p;
+		}
+	}
+
+	// Walking back, a pass is needed when it has side effects or writes what a pass after it needs
+	std::vector<uint8_t> Needed( NumResources, 0 );
+	for (uint32_t r = 0; r < NumResources; ++r)
+		Needed[r] = m_Resources[r].Imported;
+	for (uint32_t p = NumPasses; p-- > 0;)
+	{
+		const AccessRange Accesses = GetPassAccesses( *this, Out, p );
+		bool Alive = !Options.Cull || (m_Passes[p].Flags & kPassSideEffect) != 0;
+		for (auto& Access : Accesses)
+			Alive |= Access.Write && Needed[Access.Resource];
+		if (!Alive)
+		{
+			Out.Culled[p] = 1;
+			Out.NumCulled++;
+			continue;
+		}
+		for (auto& Access : Accesses)
+			if (Access.Write && !Access.Read && !m_Resources[Access.Resource].Imported)
+				Needed[Access.Resource] = 0;
+		for (auto& Access : Accesses)
+			if (Access.Read)
+				Needed[Access.Resource] = 1;
+	}
+
+	// Transients must be written first, and the final state pass reads every import in its final
+	// state, or the one its last pass left it in
+	std::vector<BarrierState> States( NumResources, kRenderGraphKeepState );
+	std::vector<uint32_t> FirstUse( NumResources, kNone );
+	std::vector<uint32_t> LastUse( NumResources, kNone );
+	for (uint32_t r = 0; r < NumResources; ++r)
+		if (m_Resources[r].Imported)
+			States[r] = m_Resources[r].InitialState;
+	for (uint32_t p = 0; p < NumPasses; ++p)
+	{
+		if (Out.Culled[p])
+			continue;
+		for (auto& Access : GetPassAccesses( *this, Out, p ))
+		{
+			const uint32_t r = Access.Resource;
+			if (!m_Resources[r].Imported && FirstUse[r] == kNone && (Access.Read || !Access.Write))
+			{
+				Out.Error = "Pass " + m_Passes[p].Name + " reads " + m_Resources[r].Name + " before anything wrote it";
+				return false;
+			}
+			if (FirstUse[r] == kNone)
+				FirstUse[r] = p;
+			LastUse[r] = p;
+			States[r] = Access.State;
+		}
+	}
+	for (uint32_t r = 0; r < NumResources; ++r)
+	{
+		if (!m_Resources[r].Imported)
+			continue;
+		const BarrierState FinalState = m_Resources[r].FinalState == kRenderGraphKeepState ? States[r] : m_Resources[r].FinalState;
+		RenderGraphAccess Access = { r, FinalState, true, false };
+		Out.FinalAccesses.push_back( Access );
+	}
+
+	// Queues, a pass leaves the graphics queue only when every state it and the user before it
+	// leave its resources in is valid on the other one
+	std::vector<RenderGraphQueue> Queues( NumPasses + 1, kRenderGraphGraphics );
+	std::fill( States.begin(), States.end(), kRenderGraphKeepState );
+	for (uint32_t r = 0; r < NumResources; ++r)
+		if (m_Resources[r].Imported)
+			States[r] = m_Resources[r].InitialState;
+	for (uint32_t p = 0; p < NumPasses; ++p)
+	{
+		if (Out.Culled[p])
+			continue;
+		const AccessRange Accesses = GetPassAccesses( *this, Out, p );
+		RenderGraphQueue Queue = kRenderGraphGraphics;
+		if (Options.AsyncCompute && (m_Passes[p].Flags & kPassAsyncCompute))
+			Queue = kRenderGraphCompute;
+		else if (Options.CopyQueue && (m_Passes[p].Flags & kPassCopy))
+			Queue = kRenderGraphCopy;
+		for (auto& Access : Accesses)
+		{
+			const BarrierState Before = States[Access.Resource];
+			if (!IsValidOn( Queue, Access.State ) || (Before != kRenderGraphKeepState && !IsValidOn( Queue, Before )))
+				Queue = kRenderGraphGraphics;
+		}
+		Queues[p] = Queue;
+		for (auto& Access : Accesses)
+			States[Access.Resource] = Access.State;
+	}
+
+	// Passes using each transient and their queues
+	std::vector<std::vector<uint32_t> > Users( NumResources );
+	std::vector<uint8_t> UserQueues( NumResources, 0 );
+	for (uint32_t p = 0; p < NumPasses; ++p)
+	{
+		if (Out.Culled[p])
+			continue;
+		for (auto& Access : GetPassAccesses( *this, Out, p ))
+		{
+			if (m_Resources[Access.Resource].Imported)
+				continue;
+			Users[Access.Resource].push_back( p );
+			UserQueues[Access.Resource] |= 1 << Queues[p];
+		}
+	}
+
+	// Transients live from their first to their last pass in declared order, which is the order of
+	// each queue, and are packed largest first with PackTransients(). Memory is only shared by
+	// transients used on one queue, so the first pass of the new one follows every user of the old
+	// ones without a wait; one used on both queues keeps memory of its own.
+	std::vector<uint32_t> TransientOrder;
+	for (uint32_t p = 0; p < NumPasses; ++p)
+	{
+		if (Out.Culled[p])
+			continue;
+		for (auto& Access : GetPassAccesses( *this, Out, p ))
+		{
+			const uint32_t r = Access.Resource;
+			if (!m_Resources[r].Imported && FirstUse[r] == p)
+				TransientOrder.push_back( r );
+		}
+	}
+	std::vector<TransientInterval> Intervals;
+	Intervals.reserve( TransientOrder.size() );
+	for (uint32_t r : TransientOrder)
+	{
+		const uint8_t Used = UserQueues[r];
+		const bool OneQueue = (Used & (Used - 1)) == 0;
+		TransientInterval Interval = { m_Resources[r].SizeBytes, m_Resources[r].Alignment, FirstUse[r], LastUse[r],
+			m_Resources[r].Heap, Options.Alias && OneQueue ? (uint32_t)Queues[FirstUse[r]] : kTransientNoAlias };
+		Intervals.push_back( Interval );
+		Out.TransientBytes += m_Resources[r].SizeBytes;
+	}
+	TransientPacking Packing;
+	PackTransients( Intervals, kPackBySize, Packing );
+	std::vector<TransientAliasing> Aliasing;
+	FindTransientAliasing( Intervals, Packing, Aliasing );
+	Out.HeapSizes = Packing.HeapSizes;
+	Out.HeapSize = Packing.TotalSize;
+
+	// Transients whose memory each one takes over, by resource
+	std::vector<std::vector<uint32_t> > AliasBefore( NumResources );
+	for (auto& Entry : Aliasing)
+		AliasBefore[TransientOrder[Entry.After]].push_back( Entry.Before == kTransientPreviousFrame ? kTransientPreviousFrame : TransientOrder[Entry.Before] );
+
+	// Segments, in the order they are closed. A segment closes when a pass of another queue has to
+	// wait for it, or a pass of its queue has to wait for another one first.
+	std::vector<SegmentBuild> Segments;
+	std::vector<uint32_t> CloseOrder;
+	std::vector<uint32_t> PassSegment( NumPasses + 1, kNone );
+	uint32_t OpenSegment[kRenderGraphNumQueues] = { kNone, kNone, kNone };
+	uint32_t LastSegment[kRenderGraphNumQueues] = { kNone, kNone, kNone };
+	uint32_t LastPass[kRenderGraphNumQueues] = { kNone, kNone, kNone };
+	uint32_t NumSegments[kRenderGraphNumQueues] = {};
+	std::vector<ResourceTrack> Tracks( NumResources );
+	for (uint32_t r = 0; r < NumResources; ++r)
+	{
+		Tracks[r].LastWriter = kNone;
+		Tracks[r].StateSetter = kNone;
+		Tracks[r].State = m_Resources[r].Imported ? m_Resources[r].InitialState : kRenderGraphKeepState;
+	}
+
+	auto CloseSegment = [&]( uint32_t Segment )
+	{
+		Segments[Segment].Open = false;
+		CloseOrder.push_back( Segment );
+		OpenSegment[Segments[Segment].Queue] = kNone;
+	};
+	auto OpenNewSegment = [&]( RenderGraphQueue Queue )
+	{
+		SegmentBuild Segment;
+		Segment.Queue = Queue;
+		Segment.Open = true;
+		Segment.Seq = ++NumSegments[Queue];
+		// Work of the queue's segments before is done before this one starts, and what they waited for
+		for (uint32_t q = 0; q < kRenderGraphNumQueues; ++q)
+			Segment.Clock[q] = LastSegment[Queue] == kNone ? 0 : Segments[LastSegment[Queue]].Clock[q];
+		Segments.push_back( std::move( Segment ) );
+		OpenSegment[Queue] = LastSegment[Queue] = (uint32_t)Segments.size() - 1;
+	};
+
+	std::vector<uint32_t> Deps;
+	std::vector<uint32_t> NewWaits;
+	std::vector<uint32_t> DepMark( NumPasses + 1, kNone );
+	for (uint32_t p = 0; p <= NumPasses; ++p)
+	{
+		if (p < NumPasses && Out.Culled[p])
+			continue;
+		const RenderGraphQueue Queue = Queues[p];
+		Deps.clear();
+		auto AddDep = [&]( uint32_t Dep )
+		{
+			if (Dep != kNone && DepMark[Dep] != p)
+			{
+				DepMark[Dep] = p;
+				Deps.push_back( Dep );
+			}
+		};
+
+		for (auto& Access : GetPassAccesses( *this, Out, p ))
+		{
+			ResourceTrack& Track = Tracks[Access.Resource];
+			AddDep( Track.LastWriter );
+			AddDep( Track.StateSetter );
+			if (Access.Write || Access.State != Track.State)
+			{
+				for (uint32_t Reader : Track.Readers)
+					AddDep( Reader );
+				Track.Readers.clear();
+				Track.StateSetter = p;
+			}
+			if (Access.Write)
+				Track.LastWriter = p;
+			else
+				Track.Readers.push_back( p );
+			Track.State = Access.State;
+			if (FirstUse[Access.Resource] == p)
+				for (uint32_t Before : AliasBefore[Access.Resource])
+					if (Before != kTransientPreviousFrame)
+						AddDep( LastUse[Before] );
+		}
+		// The graph is done when its graphics queue is
+		if (p == FinalPass)
+			for (uint32_t q = 0; q < kRenderGraphNumQueues; ++q)
+				AddDep( LastPass[q] );
+
+		// Segments of other queues this pass depends on which no wait covers yet
+		const uint32_t Current = OpenSegment[Queue] != kNone ? OpenSegment[Queue] : LastSegment[Queue];
+		NewWaits.clear();
+		for (uint32_t Dep : Deps)
+		{
+			if (Queues[Dep] == Queue)
+				continue;
+			const uint32_t DepSegment = PassSegment[Dep];
+			const uint32_t Known = Current == kNone ? 0 : Segments[Current].Clock[Queues[Dep]];
+			if (Known < Segments[DepSegment].Seq && std::find( NewWaits.begin(), NewWaits.end(), DepSegment ) == NewWaits.end())
+				NewWaits.push_back( DepSegment );
+		}
+		if (!NewWaits.empty())
+		{
+			std::sort( NewWaits.begin(), NewWaits.end() );
+			if (OpenSegment[Queue] != kNone && !Segments[OpenSegment[Queue]].Passes.empty())
+				CloseSegment( OpenSegment[Queue] );
+			for (uint32_t Wait : NewWaits)
+				if (Segments[Wait].Open)
+					CloseSegment( Wait );
+		}
+		if (OpenSegment[Queue] == kNone)
+			OpenNewSegment( Queue );
+		SegmentBuild& Segment = Segments[OpenSegment[Queue]];
+		for (uint32_t Wait : NewWaits)
+		{
+			// Left out when another wait covers it
+			bool Covered = false;
+			for (uint32_t Other : NewWaits)
+				Covered |= Other != Wait && Segments[Other].Clock[Segments[Wait].Queue] >= Segments[Wait].Seq;
+			if (Covered)
+				continue;
+			Segment.Waits.push_back( Wait );
+			for (uint32_t q = 0; q < kRenderGraphNumQueues; ++q)
+				Segment.Clock[q] = (std::max)( Segment.Clock[q], Segments[Wait].Clock[q] );
+			Segment.Clock[Segments[Wait].Queue] = (std::max)( Segment.Clock[Segments[Wait].Queue], Segments[Wait].Seq );
+		}
+		Segment.Passes.push_back( p );
+		PassSegment[p] = OpenSegment[Queue];
+		LastPass[Queue] = p;
+	}
+	for (uint32_t s = 0; s < Segments.size(); ++s)
+		if (Segments[s].Open)
+			CloseSegment( s );
+
+	// Passes in segment order
+	std::vector<uint32_t> SegmentIndex( Segments.size() );
+	for (uint32_t i = 0; i < CloseOrder.size(); ++i)
+		SegmentIndex[CloseOrder[i]] = i;
+	std::vector<uint32_t> CompiledIndex( NumPasses + 1, kNone );
+	for (uint32_t i = 0; i < CloseOrder.size(); ++i)
+	{
+		SegmentBuild& Build = Segments[CloseOrder[i]];
+		RenderGraphSegment Segment;
+		Segment.Queue = Build.Queue;
+		Segment.FirstPass = (uint32_t)Out.Passes.size();
+		Segment.NumPasses = (uint32_t)Build.Passes.size();
+		for (uint32_t Wait : Build.Waits)
+			Segment.Waits.push_back( SegmentIndex[Wait] );
+		Out.NumWaits += (uint32_t)Segment.Waits.size();
+		for (uint32_t p : Build.Passes)
+		{
+			CompiledRenderPass Pass;
+			Pass.Pass = p;
+			Pass.Queue = Build.Queue;
+			Pass.Segment = i;
+			CompiledIndex[p] = (uint32_t)Out.Passes.size();
+			Out.Passes.push_back( std::move( Pass ) );
+		}
+		Out.Segments.push_back( std::move( Segment ) );
+	}
+
+	for (uint32_t i = 0; i < TransientOrder.size(); ++i)
+	{
+		const uint32_t r = TransientOrder[i];
+		RenderGraphTransient Transient = { r, CompiledIndex[FirstUse[r]], 0, m_Resources[r].Heap, Packing.Offsets[i], m_Resources[r].SizeBytes };
+		for (uint32_t User : Users[r])
+			Transient.LastPass = (std::max)( Transient.LastPass, CompiledIndex[User] );
+		Out.Transients.push_back( Transient );
+		for (uint32_t Before : AliasBefore[r])
+		{
+			RenderGraphAliasing Entry = { Before, r };
+			Out.Passes[Transient.FirstPass].Aliasing.push_back( Entry );
+		}
+	}
+
+	BarrierStream Stream;
+	BuildBarrierStream( *this, Out, Stream );
+	std::vector<BarrierBatch> Batches;
+	OptimizeBarriers( Stream, BarrierPassOptions::Optimized( Options.SplitBarriers ), Batches, Out.BarrierStats );
+	for (auto& Batch : Batches)
+	{
+		// Nothing is requested after the final state pass
+		ASSERT( Batch.WorkIndex < Out.Passes.size() );
+		Out.Passes[Batch.WorkIndex].Barriers = std::move( Batch.Barriers );
+	}
+	return true;
+}
@@ -0,0 +1,156 @@
+#pragma once
+// Declarative frame description compiled into segments per queue, barriers and transient placements.
+
+#include "BarrierOptimizer.h"
+#include "TransientPacker.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum RenderGraphQueue : uint8_t
+{
+	kRenderGraphGraphics,
+	kRenderGraphCompute,
+	kRenderGraphCopy,
+	kRenderGraphNumQueues,
+};
+
+enum RenderGraphPassFlags : uint32_t
+{
+	kPassSideEffect = 0x1,					// Never culled
+	kPassAsyncCompute = 0x2,				// May run on the compute queue
+	kPassCopy = 0x4,						// May run on the copy queue
+	kPassOwnContexts = 0x8,					// Submits contexts of its own, the executor submits its barriers first
+};
+
+// Not a state, imported resources with it are left in whatever state their last pass needed
+const BarrierState kRenderGraphKeepState = 0xffffffff;
+
+struct RenderGraphResource
+{
+	std::string		Name;
+	bool			Imported;
+	BarrierState	InitialState;			// Imported only, transients start where their first pass needs them
+	BarrierState	FinalState;
+	uint64_t		SizeBytes;				// Transient only
+	uint64_t		Alignment;
+	uint32_t		Heap;
+};
+
+struct RenderGraphAccess
+{
+	uint32_t		Resource;
+	BarrierState	State;
+	bool			Read;
+	bool			Write;
+};
+
+struct RenderGraphPass
+{
+	std::string		Name;
+	uint32_t		Flags;
+	uint32_t		FirstAccess;			// Into RenderGraph::GetAccesses()
+	uint32_t		NumAccesses;
+};
+
+struct RenderGraphOptions
+{
+	bool			Cull;
+	bool			AsyncCompute;
+	bool			CopyQueue;
+	bool			SplitBarriers;
+	bool			Alias;
+
+	static RenderGraphOptions Default() { return { true, true, false, true, true }; }
+};
+
+struct RenderGraphAliasing
+{
+	uint32_t		Before;					// Transient whose memory is taken over, kTransientPreviousFrame for the frame before
+	uint32_t		After;
+};
+
+struct CompiledRenderPass
+{
+	uint32_t							Pass;			// Declared index, the final state pass is GetNumPasses()
+	RenderGraphQueue					Queue;
+	uint32_t							Segment;
+	std::vector<RenderGraphAliasing>	Aliasing;		// Go before the barriers
+	std::vector<ResolvedBarrier>		Barriers;		// Resource is the graph's resource index
+};
+
+struct RenderGraphSegment
+{
+	RenderGraphQueue		Queue;
+	uint32_t				FirstPass;					// Into CompiledRenderGraph::Passes
+	uint32_t				NumPasses;
+	std::vector<uint32_t>	Waits;						// Segments of other queues to wait for first
+};
+
+struct RenderGraphTransient
+{
+	uint32_t		Resource;
+	uint32_t		FirstPass;							// Into CompiledRenderGraph::Passes
+	uint32_t		LastPass;
+	uint32_t		Heap;
+	uint64_t		Offset;								// In its heap
+	uint64_t		SizeBytes;
+};
+
+struct CompiledRenderGraph
+{
+	std::vector<CompiledRenderPass>		Passes;
+	std::vector<RenderGraphSegment>		Segments;
+	std::vector<RenderGraphTransient>	Transients;		// Of the passes left, by first use
+	std::vector<uint8_t>				Culled;			// Per declared pass
+	std::vector<RenderGraphAccess>		FinalAccesses;	// Of the final state pass, one read per imported resource
+	uint32_t							NumCulled;
+	uint32_t							NumWaits;
+	std::vector<uint64_t>				HeapSizes;		// Per heap index
+	uint64_t							HeapSize;		// Of all heaps
+	uint64_t							TransientBytes;	// Without aliasing
+	BarrierPassStats					BarrierStats;
+	std::string							Error;
+};
+
+//--------------------------------------------------------------------------------------
+// RenderGraph
+//--------------------------------------------------------------------------------------
+class RenderGraph
+{
+public:
+	void Reset();
+
+	uint32_t Import( const std::string& Name, BarrierState InitialState, BarrierState FinalState = kRenderGraphKeepState );
+	// Transients of different heaps never share memory, resource heap tier 1 needs one per kind
+	uint32_t CreateTransient( const std::string& Name, uint64_t SizeBytes, uint64_t Alignment = 65536, uint32_t Heap = 0 );
+
+	// Accesses go to the pass added last. Write alone means the pass overwrites what was there, so
+	// the passes which wrote it before are no longer needed for it; a pass keeping some of it reads
+	// it too, in the same state. A UAV written by consecutive passes gets a UAV barrier in between.
+	uint32_t AddPass( const std::string& Name, uint32_t Flags = 0 );
+	void Read( uint32_t Resource, BarrierState State );
+	void Write( uint32_t Resource, BarrierState State );
+
+	// Culls passes nothing depends on, moves kPassAsyncCompute and kPassCopy passes off the graphics
+	// queue where their states are valid, cuts runs of passes on one queue into segments waiting only
+	// on what they depend on, places barriers with OptimizeBarriers() and packs transients with
+	// PackTransients(). Deterministic. False with Out.Error set for a transient read before anything
+	// wrote it, or a resource a pass needs in two states.
+	bool Compile( const RenderGraphOptions& Options, CompiledRenderGraph& Out ) const;
+
+	uint32_t GetNumPasses() const { return (uint32_t)m_Passes.size(); }
+	uint32_t GetNumResources() const { return (uint32_t)m_Resources.size(); }
+	const RenderGraphPass& GetPass( uint32_t Index ) const { return m_Passes[Index]; }
+	const RenderGraphResource& GetResource( uint32_t Index ) const { return m_Resources[Index]; }
+	const std::vector<RenderGraphAccess>& GetAccesses() const { return m_Accesses; }
+
+private:
+	void Access( uint32_t Resource, BarrierState State, bool Write );
+
+	std::vector<RenderGraphResource>	m_Resources;
+	std::vector<RenderGraphPass>		m_Passes;
+	std::vector<RenderGraphAccess>		m_Accesses;
+};
+
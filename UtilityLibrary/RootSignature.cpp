@@ -2,6 +2,7 @@
 #include "Utility.h"
 #include "Graphics.h"
 #include "RootSignature.h"
+#include "PipelineCache.h"
 
 #include <unordered_map>
 #include <thread>
@@ -15,7 +16,7 @@ static CRITICAL_SECTION s_RootSignatureCS;
 // RootSignature
 //--------------------------------------------------------------------------------------
 RootSignature::RootSignature( UINT NumRootParams /* = 0 */, UINT NumStaticSamplers /* = 0 */ )
-	:m_Finalized( FALSE ), m_NumParameters( NumRootParams )
+	:m_Finalized( FALSE ), m_NumParameters( NumRootParams ), m_CacheKey( 0 )
 {
 	Reset( NumRootParams, NumStaticSamplers );
 }
@@ -112,10 +113,24 @@ void RootSignature::Finalize( D3D12_ROOT_SIGNATURE_FLAGS Flags /* = D3D12_ROOT_S
 	m_MaxDescriptorCacheHandleCount = 0;
 
 	size_t HashCode = HashStateArray( RootDesc.pStaticSamplers, m_NumSamplers );
+	m_CacheKey = PipelineCacheHash( "RootSignature", 13 );
+	m_CacheKey = PipelineCacheHash( &Flags, sizeof( Flags ), m_CacheKey );
+	m_CacheKey = PipelineCacheHash( RootDesc.pStaticSamplers, m_NumSamplers * sizeof( D3D12_STATIC_SAMPLER_DESC ), m_CacheKey );
 
 	for (UINT Param = 0; Param < m_NumParameters; ++Param)
 	{
 		const D3D12_ROOT_PARAMETER& RootParam = RootDesc.pParameters[Param];
+		m_CacheKey = PipelineCacheHash( &RootParam.ParameterType, sizeof( RootParam.ParameterType ), m_CacheKey );
+		m_CacheKey = PipelineCacheHash( &RootParam.ShaderVisibility, sizeof( RootParam.ShaderVisibility ), m_CacheKey );
+		// Only the union member of the type, the rest of it may be anything
+		if (RootParam.ParameterType == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
+			m_CacheKey = PipelineCacheHash( RootParam.DescriptorTable.pDescriptorRanges,
+				RootParam.DescriptorTable.NumDescriptorRanges * sizeof( D3D12_DESCRIPTOR_RANGE ), m_CacheKey );
+		else if (RootParam.ParameterType == D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS)
+			m_CacheKey = PipelineCacheHash( &RootParam.Constants, sizeof( RootParam.Constants ), m_CacheKey );
+		else
+			m_CacheKey = PipelineCacheHash( &RootParam.Descriptor, sizeof( RootParam.Descriptor ), m_CacheKey );
+
 		m_DescriptorTableSize[Param] = 0;
 		if (RootParam.ParameterType == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
 		{
@@ -125,6 +140,9 @@ void RootSignature::Finalize( D3D12_ROOT_SIGNATURE_FLAGS Flags /* = D3D12_ROOT_S
 
 			if (RootParam.DescriptorTable.pDescriptorRanges->RangeType == D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER)
 				continue;
+			// Bindless tables point into the BindlessDescriptorHeap, nothing to stage
+			if (RootParam.DescriptorTable.pDescriptorRanges->NumDescriptors == UINT_MAX)
+				continue;
 
 			m_DescriptorTableBitMap |= (1 << Param);
 			for (UINT TableRange = 0; TableRange < RootParam.DescriptorTable.NumDescriptorRanges; ++TableRange)
@@ -152,12 +170,29 @@ void RootSignature::Finalize( D3D12_ROOT_SIGNATURE_FLAGS Flags /* = D3D12_ROOT_S
 
 	if (firstCompile)
 	{
-		ComPtr<ID3DBlob> pOutBlob, pErrorBlob;
 		HRESULT hr;
-		V( D3D12SerializeRootSignature( &RootDesc, D3D_ROOT_SIGNATURE_VERSION_1,
-			pOutBlob.GetAddressOf(), pErrorBlob.GetAddressOf() ) );
-		V( Graphics::g_device->CreateRootSignature( 1, pOutBlob->GetBufferPointer(),
-			pOutBlob->GetBufferSize(), IID_PPV_ARGS( &m_Signature ) ) );
+		// A serialized root signature from the pipeline cache saves serializing it again
+		m_Signature = nullptr;
+		const void* CachedBlob;
+		size_t CachedSize;
+		if (Graphics::g_pipelineCache.Find( m_CacheKey, CachedBlob, CachedSize ) &&
+			FAILED( Graphics::g_device->CreateRootSignature( 1, CachedBlob, CachedSize, IID_PPV_ARGS( &m_Signature ) ) ))
+		{
+			PRINTWARN( "Cached root signature refused, serializing it again" );
+			Graphics::g_pipelineCache.Invalidate( m_CacheKey );
+			m_Signature = nullptr;
+		}
+		if (m_Signature == nullptr)
+		{
+			ComPtr<ID3DBlob> pOutBlob, pErrorBlob;
+			V( D3D12SerializeRootSignature( &RootDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+				pOutBlob.GetAddressOf(), pErrorBlob.GetAddressOf() ) );
+			V( Graphics::g_device->CreateRootSignature( 1, pOutBlob->GetBufferPointer(),
+				pOutBlob->GetBufferSize(), IID_PPV_ARGS( &m_Signature ) ) );
+			Graphics::g_pipelineCache.Add( m_CacheKey, pOutBlob->GetBufferPointer(), pOutBlob->GetBufferSize() );
+		}
+		CriticalSectionScope LockGaurd( &s_RootSignatureCS );
+		s_RootSignatureHashMap[HashCode].Attach( m_Signature );
 	}
 	else
 	{
@@ -57,6 +57,18 @@ public:
 		SetTableRange( 0, Type, Register, Count );
 	}
 
+	// Unbounded SRV and UAV ranges both starting at the first slot of the BindlessDescriptorHeap, the
+	// DynamicDescriptorHeap leaves this table alone
+	void InitAsBindlessTable( UINT Space, D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL )
+	{
+		InitAsDescriptorTable( 2, Visibility );
+		SetTableRange( 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, UINT_MAX, Space );
+		SetTableRange( 1, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, UINT_MAX, Space );
+		D3D12_DESCRIPTOR_RANGE* ranges = const_cast<D3D12_DESCRIPTOR_RANGE*>(m_RootParam.DescriptorTable.pDescriptorRanges);
+		ranges[0].OffsetInDescriptorsFromTableStart = 0;
+		ranges[1].OffsetInDescriptorsFromTableStart = 0;
+	}
+
 	void InitAsDescriptorTable( UINT RangeCount, D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL )
 	{
 		m_RootParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
@@ -101,6 +113,8 @@ public:
 		D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL );
 	void Finalize( D3D12_ROOT_SIGNATURE_FLAGS Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE );
 	ID3D12RootSignature* GetSignature() const { return m_Signature; }
+	// Hash of the content, the same from run to run; pipeline cache keys start from it
+	uint64_t GetCacheKey() const { return m_CacheKey; }
 
 protected:
 	BOOL m_Finalized;
@@ -113,4 +127,5 @@ protected:
 	std::unique_ptr<RootParameter[]> m_ParamArray;
 	std::unique_ptr<D3D12_STATIC_SAMPLER_DESC[]> m_SamplerArray;
 	ID3D12RootSignature* m_Signature;
+	uint64_t m_CacheKey;
 };
\ No newline at end of file
@@ -66,7 +66,7 @@ void SamplerDescriptor::Create( const D3D12_SAMPLER_DESC& Desc )
 		*this = SamplerDescriptor( iter->second );
 		return;
 	}
-	m_hCpuDescriptorHandle = Graphics::g_pSMPDescriptorHeap->Append().GetCPUHandle();
+	m_hCpuDescriptorHandle = Graphics::g_pSMPDescriptorHeap->Allocate().GetCPUHandle();
 	Graphics::g_device->CreateSampler( &Desc, m_hCpuDescriptorHandle );
 }
 
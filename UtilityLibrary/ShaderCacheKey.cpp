@@ -0,0 +1,261 @@
+#include "PortableAssert.h"
+#include "ShaderCacheKey.h"
+#include "PipelineCache.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+	// Markers between the parts of a key, so moving bytes from one part to the next changes it
+	const uint8_t kIncludeFound = 1;
+	const uint8_t kIncludeMissing = 2;
+	const uint8_t kIncludeAgain = 3;
+
+	uint64_t HashString( const std::string& String, uint64_t Hash )
+	{
+		const uint64_t Size = String.size();
+		Hash = PipelineCacheHash( &Size, sizeof( Size ), Hash );
+		return PipelineCacheHash( String.data(), String.size(), Hash );
+	}
+
+	uint64_t HashMarker( uint8_t Marker, uint64_t Hash )
+	{
+		return PipelineCacheHash( &Marker, sizeof( Marker ), Hash );
+	}
+
+	std::string GetDirectory( const std::string& Path )
+	{
+		const size_t Slash = Path.find_last_of( "/\\" );
+		return Slash == std::string::npos ? std::string() : Path.substr( 0, Slash + 1 );
+	}
+
+	bool IsAbsolute( const std::string& Path )
+	{
+		return (!Path.empty() && (Path[0] == '/' || Path[0] == '\\')) || Path.find( ':' ) != std::string::npos;
+	}
+
+	// Comments blanked out, newlines and string literals kept
+	std::string StripComments( const std::string& Source )
+	{
+		std::string Stripped( Source );
+		const size_t Size = Source.size();
+		for (size_t i = 0; i < Size;)
+		{
+			if (Source[i] == '"')
+			{
+				for (++i; i < Size && Source[i] != '"' && Source[i] != '\n'; ++i) {}
+				i += i < Size && Source[i] == '"';
+			}
+			else if (Source[i] == '/' && i + 1 < Size && Source[i + 1] == '/')
+			{
+				for (; i < Size && Source[i] != '\n'; ++i)
+					Stripped[i] = ' ';
+			}
+			else if (Source[i] == '/' && i + 1 < Size && Source[i + 1] == '*')
+			{
+				Stripped[i] = Stripped[i + 1] = ' ';
+				for (i += 2; i < Size && !(Source[i] == '*' && i + 1 < Size && Source[i + 1] == '/'); ++i)
+				{
+					if (Source[i] != '\n')
+						Stripped[i] = ' ';
+				}
+				if (i < Size)
+				{
+					Stripped[i] = Stripped[i + 1] = ' ';
+					i += 2;
+				}
+			}
+			else
+				++i;
+		}
+		return Stripped;
+	}
+
+	bool IsBlank( char C )
+	{
+		return C == ' ' || C == '\t' || C == '\r';
+	}
+}
+
+bool ReadShaderFile( const std::string& Path, std::string& Content )
+{
+#ifdef _WIN32
+	const int WideSize = MultiByteToWideChar( CP_UTF8, 0, Path.c_str(), -1, nullptr, 0 );
+	std::wstring WidePath( WideSize > 0 ? WideSize : 1, L'\0' );
+	MultiByteToWideChar( CP_UTF8, 0, Path.c_str(), -1, &WidePath[0], WideSize );
+	FILE* pFile = _wfopen( WidePath.c_str(), L"rb" );
+#else
+	FILE* pFile = fopen( Path.c_str(), "rb" );
+#endif
+	if (pFile == nullptr)
+		return false;
+	fseek( pFile, 0, SEEK_END );
+	const long Size = ftell( pFile );
+	fseek( pFile, 0, SEEK_SET );
+	Content.assign( Size > 0 ? (size_t)Size : 0, '\0' );
+	const bool Read = Content.empty() || fread( &Content[0], 1, Content.size(), pFile ) == Content.size();
+	fclose( pFile );
+	return Size >= 0 && Read;
+}
+
+void FindShaderIncludes( const std::string& Source, std::vector<std::string>& Includes )
+{
+	Includes.clear();
+	const std::string Stripped = StripComments( Source );
+	const size_t Size = Stripped.size();
+	for (size_t Line = 0; Line < Size;)
+	{
+		size_t LineEnd = Stripped.find( '\n', Line );
+		LineEnd = LineEnd == std::string::npos ? Size : LineEnd;
+		size_t i = Line;
+		for (; i < LineEnd && IsBlank( Stripped[i] ); ++i) {}
+		if (i < LineEnd && Stripped[i] == '#')
+		{
+			for (++i; i < LineEnd && IsBlank( Stripped[i] ); ++i) {}
+			if (Stripped.compare( i, 7, "include" ) == 0)
+			{
+				for (i += 7; i < LineEnd && IsBlank( Stripped[i] ); ++i) {}
+				if (i < LineEnd && (Stripped[i] == '"' || Stripped[i] == '<'))
+				{
+					const char Close = Stripped[i] == '"' ? '"' : '>';
+					const size_t NameEnd = Stripped.find( Close, i + 1 );
+					if (NameEnd != std::string::npos && NameEnd < LineEnd && NameEnd > i + 1)
+						Includes.push_back( Stripped.substr( i + 1, NameEnd - i - 1 ) );
+				}
+			}
+		}
+		Line = LineEnd + 1;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// ShaderFileCache
+//--------------------------------------------------------------------------------------
+ShaderFileCache::ShaderFileCache( const ShaderFileReader& Read )
+	:m_Read( Read ), m_NumReads( 0 )
+{
+}
+
+bool ShaderFileCache::Get( const std::string& Path, uint64_t& Hash, std::vector<std::string>& Includes )
+{
+	{
+		std::lock_guard<std::mutex> Lock( m_Mutex );
+		auto It = m_Files.find( Path );
+		if (It != m_Files.end())
+		{
+			Hash = It->second.Hash;
+			Includes = It->second.Includes;
+			return It->second.Found;
+		}
+	}
+
+	// Two threads may both read a file new to the cache, the first one in keeps it
+	File NewFile = {};
+	std::string Content;
+	NewFile.Found = m_Read( Path, Content );
+	if (NewFile.Found)
+	{
+		NewFile.Hash = HashString( Content, kPipelineCacheHashSeed );
+		FindShaderIncludes( Content, NewFile.Includes );
+	}
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	++m_NumReads;
+	const File& Cached = m_Files.insert( std::make_pair( Path, NewFile ) ).first->second;
+	Hash = Cached.Hash;
+	Includes = Cached.Includes;
+	return Cached.Found;
+}
+
+void ShaderFileCache::Clear()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_Files.clear();
+}
+
+uint32_t ShaderFileCache::GetNumReads() const
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	return m_NumReads;
+}
+
+//--------------------------------------------------------------------------------------
+// GetShaderCacheKey
+//--------------------------------------------------------------------------------------
+bool GetShaderCacheKey( const ShaderCompileDesc& Desc, ShaderFileCache& Cache, uint64_t& Key,
+	std::vector<std::string>* pFiles /* = nullptr */ )
+{
+	std::vector<std::string> Files( 1, Desc.SourcePath );
+	std::vector<std::vector<std::string>> FileIncludes( 1 );
+	uint64_t FileHash;
+	if (!Cache.Get( Desc.SourcePath, FileHash, FileIncludes[0] ))
+		return false;
+
+	uint64_t Hash = PipelineCacheHash( "ShaderCacheKey", 14 );
+	Hash = PipelineCacheHash( &FileHash, sizeof( FileHash ), Hash );
+
+	// Every file once, in the order they are first included
+	const std::string SourceDirectory = GetDirectory( Desc.SourcePath );
+	std::vector<std::string> Includes;
+	std::string Candidates[2];
+	for (size_t File = 0; File < Files.size(); ++File)
+	{
+		// Files grows below
+		const std::vector<std::string> Names( std::move( FileIncludes[File] ) );
+		for (auto& Name : Names)
+		{
+			Hash = HashString( Name, Hash );
+			uint32_t NumCandidates = 1;
+			if (IsAbsolute( Name ))
+				Candidates[0] = Name;
+			else
+			{
+				Candidates[0] = GetDirectory( Files[File] ) + Name;
+				Candidates[1] = SourceDirectory + Name;
+				NumCandidates = Candidates[1] != Candidates[0] ? 2 : 1;
+			}
+
+			uint8_t Marker = kIncludeMissing;
+			for (uint32_t c = 0; c < NumCandidates && Marker == kIncludeMissing; ++c)
+			{
+				if (std::find( Files.begin(), Files.end(), Candidates[c] ) != Files.end())
+					Marker = kIncludeAgain;
+				else if (Cache.Get( Candidates[c], FileHash, Includes ))
+				{
+					Marker = kIncludeFound;
+					Files.push_back( Candidates[c] );
+					FileIncludes.push_back( Includes );
+				}
+			}
+			Hash = HashMarker( Marker, Hash );
+			if (Marker == kIncludeFound)
+				Hash = PipelineCacheHash( &FileHash, sizeof( FileHash ), Hash );
+		}
+	}
+
+	// Macros as a set, a name defined twice keeps its order
+	std::vector<ShaderMacro> Macros( Desc.Macros );
+	std::stable_sort( Macros.begin(), Macros.end(), []( const ShaderMacro& A, const ShaderMacro& B ) { return A.Name < B.Name; } );
+	const uint64_t NumMacros = Macros.size();
+	Hash = PipelineCacheHash( &NumMacros, sizeof( NumMacros ), Hash );
+	for (auto& Macro : Macros)
+	{
+		Hash = HashString( Macro.Name, Hash );
+		Hash = HashString( Macro.Definition, Hash );
+	}
+	Hash = HashString( Desc.EntryPoint, Hash );
+	Hash = HashString( Desc.Target, Hash );
+	Hash = PipelineCacheHash( &Desc.Flags1, sizeof( Desc.Flags1 ), Hash );
+	Key = PipelineCacheHash( &Desc.Flags2, sizeof( Desc.Flags2 ), Hash );
+	if (pFiles != nullptr)
+		pFiles->swap( Files );
+	return true;
+}
+
+bool GetShaderCacheKey( const ShaderCompileDesc& Desc, const ShaderFileReader& Read, uint64_t& Key,
+	std::vector<std::string>* pFiles /* = nullptr */ )
+{
+	ShaderFileCache Cache( Read );
+	return GetShaderCacheKey( Desc, Cache, Key, pFiles );
+}
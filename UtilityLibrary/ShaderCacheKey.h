@@ -0,0 +1,78 @@
+#pragma once
+// Content keys of shader compiles, to look compiled bytecode up in an archive instead of compiling again
+
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ShaderMacro
+{
+	std::string		Name;
+	std::string		Definition;
+};
+
+struct ShaderCompileDesc
+{
+	std::string					SourcePath;
+	std::vector<ShaderMacro>	Macros;				// In any order, but for a name defined twice
+	std::string					EntryPoint;
+	std::string					Target;				// "cs_5_1"
+	uint32_t					Flags1;
+	uint32_t					Flags2;
+};
+
+// False if the file can't be read
+typedef std::function<bool( const std::string& Path, std::string& Content )> ShaderFileReader;
+
+// Reads the whole file, _wfopen() on Windows
+bool ReadShaderFile( const std::string& Path, std::string& Content );
+
+// Names of the #include lines of Source in order, those in comments left out. No preprocessing, one
+// under an #if the macros turn off still counts, which can only change a key more often than needed.
+void FindShaderIncludes( const std::string& Source, std::vector<std::string>& Includes );
+
+//--------------------------------------------------------------------------------------
+// ShaderFileCache
+// Content hash and includes of every file asked for, each read once, so the permutations of a launch
+// share the work. A file which can't be read
+// is remembered as missing. Edits made while it lives aren't seen until Clear(), so it is meant to
+// last a launch. Thread safe, files are read without holding the lock.
+//--------------------------------------------------------------------------------------
+class ShaderFileCache
+{
+public:
+	explicit ShaderFileCache( const ShaderFileReader& Read );
+
+	// False if the file can't be read
+	bool Get( const std::string& Path, uint64_t& Hash, std::vector<std::string>& Includes );
+	void Clear();
+	uint32_t GetNumReads() const;
+
+private:
+	struct File
+	{
+		bool						Found;
+		uint64_t					Hash;
+		std::vector<std::string>	Includes;
+	};
+
+	const ShaderFileReader						m_Read;
+	mutable std::mutex							m_Mutex;
+	std::unordered_map<std::string, File>		m_Files;
+	uint32_t									m_NumReads;
+};
+
+// The key covers the source, every file it includes by content hash, the macros, the entry point, the
+// target and the flags. Paths are left out but for the names #include lines use, so the same shader
+// somewhere else has the same key; a missing include counts, so creating it changes the key. Includes
+// are looked for next to the file including them, then next to the source, like
+// D3D_COMPILE_STANDARD_FILE_INCLUDE. Paths are UTF-8.
+// False if the source can't be read. Files gets the paths of the source and every include found.
+bool GetShaderCacheKey( const ShaderCompileDesc& Desc, ShaderFileCache& Cache, uint64_t& Key,
+	std::vector<std::string>* pFiles = nullptr );
+// Every file read again
+bool GetShaderCacheKey( const ShaderCompileDesc& Desc, const ShaderFileReader& Read, uint64_t& Key,
+	std::vector<std::string>* pFiles = nullptr );
@@ -0,0 +1,149 @@
+#include "PortableAssert.h"
+#include "SimulatedGpuTimeline.h"
+
+#include <algorithm>
+
+namespace
+{
+	const uint64_t kFenceCountMask = (1ull << 56) - 1;
+}
+
+//--------------------------------------------------------------------------------------
+// SimulatedGpuTimeline
+//--------------------------------------------------------------------------------------
+SimulatedGpuTimeline::SimulatedGpuTimeline()
+	:m_Now( 0 ), m_NumStalls( 0 ), m_StallUs( 0 )
+{
+	for (uint32_t i = 0; i < kNumQueues; ++i)
+	{
+		QueueState& Queue = m_Queues[i];
+		Queue.Config.SubmitLatencyUs = 0;
+		Queue.Config.ExecuteUsPerList = 0;
+		Queue.BusyUntil = 0;
+		Queue.WaitUntil = 0;
+		Queue.CompletedCount = 0;
+		m_Backends[i].m_pTimeline = this;
+		m_Backends[i].m_Type = i;
+	}
+}
+
+void SimulatedGpuTimeline::Configure( uint32_t Type, const SimulatedQueueConfig& Config )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_Queues[Type].Config = Config;
+}
+
+double SimulatedGpuTimeline::GetNow()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	return m_Now;
+}
+
+void SimulatedGpuTimeline::AdvanceCpu( double Us )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_Now += Us;
+}
+
+double SimulatedGpuTimeline::GetStartTime( uint64_t FenceValue )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	const QueueState& Queue = m_Queues[(FenceValue >> 56) & (kNumQueues - 1)];
+	uint64_t Count = FenceValue & kFenceCountMask;
+	if (Count == 0)
+		return 0;
+	ASSERT( Count <= Queue.StartTimes.size() );
+	return Queue.StartTimes[Count - 1];
+}
+
+double SimulatedGpuTimeline::GetCompletionTime( uint64_t FenceValue )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	return FinishTimeLocked( FenceValue );
+}
+
+uint64_t SimulatedGpuTimeline::GetNumStalls()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	return m_NumStalls;
+}
+
+double SimulatedGpuTimeline::GetStallUs()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	return m_StallUs;
+}
+
+void SimulatedGpuTimeline::ResetStats()
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	m_NumStalls = 0;
+	m_StallUs = 0;
+}
+
+void SimulatedGpuTimeline::Submit( uint32_t Type, uint32_t NumLists, uint64_t FenceValue )
+{
+	std::lock_guard<std::mutex> Lock( m_Mutex );
+	QueueState& Queue = m_Queues[Type];
+	ASSERT( (FenceValue >> 56) == Type && (FenceValue & kFenceCountMask) == Queue.FinishTimes.size() + 1 );
+	double Start = (std::max)( m_Now + Queue.Config.SubmitLatencyUs, (std::max)( Queue.BusyUntil, Queue.WaitUntil ) );
+	Queue.BusyUntil = Start + NumLists * Queue.Config.ExecuteUsPerList;
+	Queue.StartTimes.push_back( Start );
+	Queue.FinishTimes.push_back( Queue.BusyUntil );
+}
+
+double SimulatedGpuTimeline::FinishTimeLocked( uint64_t FenceValue )
+{
+	const QueueState& Queue = m_Queues[(FenceValue >> 56) & (kNumQueues - 1)];
+	uint64_t Count = FenceValue & kFenceCountMask;
+	// The initial fence was complete from the start
+	if (Count == 0)
+		return 0;
+	ASSERT( Count <= Queue.FinishTimes.size() );
+	return Queue.FinishTimes[Count - 1];
+}
+
+uint64_t SimulatedGpuTimeline::CompletedFenceLocked( uint32_t Type )
+{
+	QueueState& Queue = m_Queues[Type];
+	// Queues finish in submission order, so finish times only grow
+	while (Queue.CompletedCount < Queue.FinishTimes.size() && Queue.FinishTimes[Queue.CompletedCount] <= m_Now)
+		Queue.CompletedCount++;
+	return (uint64_t)Type << 56 | Queue.CompletedCount;
+}
+
+void SimulatedGpuTimeline::QueueBackend::ExecuteAndSignal( uint32_t NumLists, void* const* ppLists, uint64_t FenceValue )
+{
+	(void)ppLists;
+	m_pTimeline->Submit( m_Type, NumLists, FenceValue );
+}
+
+void SimulatedGpuTimeline::QueueBackend::Signal( uint64_t FenceValue )
+{
+	m_pTimeline->Submit( m_Type, 0, FenceValue );
+}
+
+void SimulatedGpuTimeline::QueueBackend::GpuWait( uint64_t FenceValue )
+{
+	std::lock_guard<std::mutex> Lock( m_pTimeline->m_Mutex );
+	QueueState& Queue = m_pTimeline->m_Queues[m_Type];
+	Queue.WaitUntil = (std::max)( Queue.WaitUntil, m_pTimeline->FinishTimeLocked( FenceValue ) );
+}
+
+uint64_t SimulatedGpuTimeline::QueueBackend::GetCompletedFence()
+{
+	std::lock_guard<std::mutex> Lock( m_pTimeline->m_Mutex );
+	return m_pTimeline->CompletedFenceLocked( m_Type );
+}
+
+void SimulatedGpuTimeline::QueueBackend::WaitForFence( uint64_t FenceValue )
+{
+	std::lock_guard<std::mutex> Lock( m_pTimeline->m_Mutex );
+	double Finish = m_pTimeline->FinishTimeLocked( FenceValue );
+	if (Finish <= m_pTimeline->m_Now)
+		return;
+	// Blocking is all the CPU does meanwhile, the clock jumps to the finish
+	m_pTimeline->m_NumStalls++;
+	m_pTimeline->m_StallUs += Finish - m_pTimeline->m_Now;
+	m_pTimeline->m_Now = Finish;
+}
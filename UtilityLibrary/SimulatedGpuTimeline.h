@@ -0,0 +1,80 @@
+#pragma once
+// IGpuQueueBackends of the four queue types over one virtual clock in microseconds, no GPU needed.
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#include "GpuQueueBackend.h"
+
+// A queue runs its submissions in order, fences complete once the clock passes their finish
+struct SimulatedQueueConfig
+{
+	double		SubmitLatencyUs;		// From the CPU submitting until the queue can start
+	double		ExecuteUsPerList;		// GPU time of one command list, a plain Signal() costs nothing
+};
+
+//--------------------------------------------------------------------------------------
+// SimulatedGpuTimeline
+//--------------------------------------------------------------------------------------
+class SimulatedGpuTimeline
+{
+public:
+	enum { kNumQueues = 4 };
+
+	SimulatedGpuTimeline();
+
+	// Takes effect from the next submission on the queue
+	void Configure( uint32_t Type, const SimulatedQueueConfig& Config );
+	IGpuQueueBackend* GetBackend( uint32_t Type ) { return &m_Backends[Type]; }
+
+	double GetNow();
+	// CPU work moves the clock, so does blocking in WaitForFence(), which counts as a stall
+	void AdvanceCpu( double Us );
+	// When the GPU starts and finishes the work of FenceValue, the submission must have been made
+	double GetStartTime( uint64_t FenceValue );
+	double GetCompletionTime( uint64_t FenceValue );
+
+	uint64_t GetNumStalls();
+	double GetStallUs();
+	void ResetStats();
+
+private:
+	class QueueBackend : public IGpuQueueBackend
+	{
+	public:
+		QueueBackend() :m_pTimeline( nullptr ), m_Type( 0 ) {}
+		virtual void ExecuteAndSignal( uint32_t NumLists, void* const* ppLists, uint64_t FenceValue ) override;
+		virtual void Signal( uint64_t FenceValue ) override;
+		virtual void GpuWait( uint64_t FenceValue ) override;
+		virtual uint64_t GetCompletedFence() override;
+		virtual void WaitForFence( uint64_t FenceValue ) override;
+
+		SimulatedGpuTimeline*	m_pTimeline;
+		uint32_t				m_Type;
+	};
+
+	struct QueueState
+	{
+		SimulatedQueueConfig	Config;
+		double					BusyUntil;			// Finish of the last submission
+		double					WaitUntil;			// Of GpuWait()s, holds back the next submission
+		std::vector<double>		StartTimes;			// Of fence Type << 56 | n at n - 1
+		std::vector<double>		FinishTimes;
+		uint64_t				CompletedCount;		// Fences whose finish time the clock passed
+	};
+
+	SimulatedGpuTimeline( const SimulatedGpuTimeline& ) = delete;
+	SimulatedGpuTimeline& operator=( const SimulatedGpuTimeline& ) = delete;
+
+	void Submit( uint32_t Type, uint32_t NumLists, uint64_t FenceValue );
+	double FinishTimeLocked( uint64_t FenceValue );
+	uint64_t CompletedFenceLocked( uint32_t Type );
+
+	std::mutex			m_Mutex;
+	double				m_Now;
+	uint64_t			m_NumStalls;
+	double				m_StallUs;
+	QueueState			m_Queues[kNumQueues];
+	QueueBackend		m_Backends[kNumQueues];
+};
@@ -1,6 +1,8 @@
 // Port from MSFT DX sample
 #pragma once
 
+#include <functional>
+
 // Helper class for animation and simulation timing.
 class StepTimer
 {
@@ -58,10 +60,11 @@ public:
 		m_qpcSecondCounter = 0;
 	}
 
-	typedef void( *LPUPDATEFUNC ) (void);
+	// Could be a lambda capturing its owner, so fixed step users could count or run their substeps
+	typedef std::function<void()> LPUPDATEFUNC;
 
 	// Update timer state, calling the specified Update function the appropriate number of times.
-	void Tick( LPUPDATEFUNC update )
+	void Tick( const LPUPDATEFUNC& update )
 	{
 		// Query the current time.
 		LARGE_INTEGER currentTime;
@@ -0,0 +1,196 @@
+#include "PortableAssert.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+
+namespace
+{
+	// Scheduler the current thread works for and its index in that scheduler
+	thread_local const TaskScheduler* t_pOwner = nullptr;
+	thread_local uint32_t t_ThreadIdx = 0;
+}
+
+TaskScheduler::TaskScheduler()
+	:m_NumThreads( 0 ), m_NextQueue( 0 ), m_NumQueued( 0 ), m_Shutdown( false )
+{
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	Shutdown();
+}
+
+void TaskScheduler::Initialize( uint32_t NumThreads )
+{
+	Shutdown();
+	if (NumThreads == 0) NumThreads = (std::max)( 1u, std::thread::hardware_concurrency() );
+	m_NumThreads = NumThreads;
+	m_Shutdown = false;
+	m_OwnerThread = std::this_thread::get_id();
+	m_Queues.reset( new WorkQueue[NumThreads] );
+	m_Workers.reserve( NumThreads - 1 );
+	for (uint32_t i = 1; i < NumThreads; ++i)
+		m_Workers.emplace_back( &TaskScheduler::WorkerLoop, this, i );
+}
+
+void TaskScheduler::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> Lock( m_SleepMutex );
+		m_Shutdown = true;
+	}
+	m_WakeUp.notify_all();
+	for (auto& Worker : m_Workers)
+		if (Worker.joinable()) Worker.join();
+	m_Workers.clear();
+	m_Queues.reset();
+	m_NumThreads = 0;
+}
+
+uint32_t TaskScheduler::GetCurrentThreadIdx() const
+{
+	if (t_pOwner == this) return t_ThreadIdx;
+	ASSERT( std::this_thread::get_id() == m_OwnerThread );
+	return 0;
+}
+
+void TaskScheduler::Submit( TaskGroup& Group, TaskFn&& Task )
+{
+	Group.m_Pending.fetch_add( 1, std::memory_order_relaxed );
+	if (m_NumThreads <= 1)
+	{
+		TaskScheduler::Task T = { std::move( Task ), &Group };
+		Execute( T, 0 );
+		return;
+	}
+	// Workers push to their own queue, the owning thread spreads tasks over all queues
+	uint32_t QueueIdx = GetCurrentThreadIdx();
+	if (QueueIdx == 0)
+		QueueIdx = m_NextQueue.fetch_add( 1, std::memory_order_relaxed ) % m_NumThreads;
+	{
+		std::lock_guard<std::mutex> Lock( m_Queues[QueueIdx].Mutex );
+		m_Queues[QueueIdx].Tasks.push_back( { std::move( Task ), &Group } );
+	}
+	m_NumQueued.fetch_add( 1, std::memory_order_release );
+	// Pass through the sleep mutex so a worker between its predicate check and wait can't miss this
+	{ std::lock_guard<std::mutex> Lock( m_SleepMutex ); }
+	m_WakeUp.notify_one();
+	// A waiter may be the only one free when every worker waits on a nested group
+	m_WaiterWakeUp.notify_one();
+}
+
+void TaskScheduler::Wait( TaskGroup& Group )
+{
+	uint32_t ThreadIdx = GetCurrentThreadIdx();
+	Task T;
+	while (!Group.IsDone())
+	{
+		if (PopOrSteal( ThreadIdx, T ))
+		{
+			Execute( T, ThreadIdx );
+			continue;
+		}
+		// The rest of Group runs on other threads, sleep until it's done or there is a task to help with
+		std::unique_lock<std::mutex> Lock( m_SleepMutex );
+		if (m_NumQueued.load( std::memory_order_acquire ) != 0)
+		{
+			// try_lock in stealing missed it
+			Lock.unlock();
+			std::this_thread::yield();
+			continue;
+		}
+		m_WaiterWakeUp.wait( Lock, [this, &Group]
+		{
+			return Group.IsDone() || m_NumQueued.load( std::memory_order_acquire ) != 0;
+		} );
+	}
+}
+
+void TaskScheduler::ParallelFor( uint32_t Count, uint32_t Grain, const RangeFn& Func )
+{
+	if (Count == 0) return;
+	Grain = (std::max)( 1u, Grain );
+	if (m_NumThreads <= 1 || Count <= Grain)
+	{
+		Func( 0, Count, GetCurrentThreadIdx() );
+		return;
+	}
+	TaskGroup Group;
+	for (uint32_t Begin = 0; Begin < Count; Begin += Grain)
+	{
+		uint32_t End = (std::min)( Count, Begin + Grain );
+		Submit( Group, [&Func, Begin, End]( uint32_t ThreadIdx ) { Func( Begin, End, ThreadIdx ); } );
+	}
+	Wait( Group );
+}
+
+bool TaskScheduler::PopOrSteal( uint32_t ThreadIdx, Task& Out )
+{
+	if (m_NumQueued.load( std::memory_order_acquire ) == 0) return false;
+	// Own queue from the back first, then steal from the front of the others
+	{
+		WorkQueue& Queue = m_Queues[ThreadIdx];
+		std::lock_guard<std::mutex> Lock( Queue.Mutex );
+		if (!Queue.Tasks.empty())
+		{
+			Out = std::move( Queue.Tasks.back() );
+			Queue.Tasks.pop_back();
+			m_NumQueued.fetch_sub( 1, std::memory_order_relaxed );
+			return true;
+		}
+	}
+	for (uint32_t i = 1; i < m_NumThreads; ++i)
+	{
+		WorkQueue& Victim = m_Queues[(ThreadIdx + i) % m_NumThreads];
+		std::unique_lock<std::mutex> Lock( Victim.Mutex, std::try_to_lock );
+		if (Lock.owns_lock() && !Victim.Tasks.empty())
+		{
+			Out = std::move( Victim.Tasks.front() );
+			Victim.Tasks.pop_front();
+			m_NumQueued.fetch_sub( 1, std::memory_order_relaxed );
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskScheduler::Execute( Task& T, uint32_t ThreadIdx )
+{
+	T.Fn( ThreadIdx );
+	T.Fn = nullptr;
+	if (T.Group->m_Pending.fetch_sub( 1, std::memory_order_acq_rel ) == 1)
+	{
+		// Pass through the sleep mutex so a waiter between its IsDone() check and wait can't miss this
+		{ std::lock_guard<std::mutex> Lock( m_SleepMutex ); }
+		m_WaiterWakeUp.notify_all();
+	}
+}
+
+void TaskScheduler::WorkerLoop( uint32_t ThreadIdx )
+{
+#ifdef _WIN32
+	SetThreadName( "Task Worker" );
+#endif
+	t_pOwner = this;
+	t_ThreadIdx = ThreadIdx;
+	Task T;
+	for (;;)
+	{
+		if (PopOrSteal( ThreadIdx, T ))
+		{
+			Execute( T, ThreadIdx );
+			continue;
+		}
+		std::unique_lock<std::mutex> Lock( m_SleepMutex );
+		if (m_Shutdown) break;
+		// try_lock in stealing may miss a task, so don't sleep forever while something is queued
+		if (m_NumQueued.load( std::memory_order_acquire ) != 0)
+		{
+			Lock.unlock();
+			std::this_thread::yield();
+			continue;
+		}
+		m_WakeUp.wait( Lock, [this] { return m_Shutdown || m_NumQueued.load( std::memory_order_acquire ) != 0; } );
+		if (m_Shutdown) break;
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+// Portable work-stealing task scheduler. Every worker owns a deque: it pushes and pops its own tasks
+// at the back (LIFO, cache warm), idle workers steal from the front of other deques (FIFO, biggest
+// pieces first). A thread waiting on a TaskGroup keeps running tasks, so nested ParallelFor from
+// inside a task is fine, and only sleeps while there is nothing queued it could help with.
+// Besides the workers only the thread which called Initialize() may use it, as thread 0.
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskScheduler;
+
+//--------------------------------------------------------------------------------------
+// TaskGroup
+//--------------------------------------------------------------------------------------
+class TaskGroup
+{
+	friend TaskScheduler;
+public:
+	TaskGroup() :m_Pending( 0 ) {}
+	bool IsDone() const { return m_Pending.load( std::memory_order_acquire ) == 0; }
+
+private:
+	TaskGroup( const TaskGroup& ) = delete;
+	TaskGroup& operator=( const TaskGroup& ) = delete;
+
+	std::atomic<uint32_t> m_Pending;
+};
+
+//--------------------------------------------------------------------------------------
+// TaskScheduler
+//--------------------------------------------------------------------------------------
+class TaskScheduler
+{
+public:
+	// ThreadIdx is in [0, GetNumThreads()), 0 is the thread which called Initialize()
+	typedef std::function<void( uint32_t ThreadIdx )> TaskFn;
+	typedef std::function<void( uint32_t Begin, uint32_t End, uint32_t ThreadIdx )> RangeFn;
+
+	TaskScheduler();
+	~TaskScheduler();
+
+	// NumThreads includes the calling thread, 0 means one per hardware thread
+	void Initialize( uint32_t NumThreads = 0 );
+	void Shutdown();
+	uint32_t GetNumThreads() const { return m_NumThreads; }
+
+	void Submit( TaskGroup& Group, TaskFn&& Task );
+	// Run tasks until all tasks of Group are done, sleeps while the rest run on other threads
+	void Wait( TaskGroup& Group );
+
+	// Split [0, Count) into chunks of at most Grain and run them in parallel, returns when all done
+	void ParallelFor( uint32_t Count, uint32_t Grain, const RangeFn& Func );
+
+	// Thread index of the caller, 0 if it's not a worker of this scheduler, in which case it must be
+	// the thread which called Initialize(): per thread data indexed by it would be shared otherwise
+	uint32_t GetCurrentThreadIdx() const;
+
+private:
+	TaskScheduler( const TaskScheduler& ) = delete;
+	TaskScheduler& operator=( const TaskScheduler& ) = delete;
+
+	struct Task
+	{
+		TaskFn		Fn;
+		TaskGroup*	Group;
+	};
+
+	// A cache line of its own so workers locking their own deque don't invalidate neighbors
+	struct alignas( 64 ) WorkQueue
+	{
+		std::mutex			Mutex;
+		std::deque<Task>	Tasks;
+	};
+
+	void WorkerLoop( uint32_t ThreadIdx );
+	bool PopOrSteal( uint32_t ThreadIdx, Task& Out );
+	void Execute( Task& T, uint32_t ThreadIdx );
+
+	uint32_t								m_NumThreads;
+	std::vector<std::thread>				m_Workers;
+	// One queue per thread, queue 0 is the one of the thread which called Initialize()
+	std::unique_ptr<WorkQueue[]>			m_Queues;
+	std::thread::id							m_OwnerThread;
+	std::atomic<uint32_t>					m_NextQueue;
+
+	// Idle workers sleep here while no task is queued anywhere
+	std::mutex								m_SleepMutex;
+	std::condition_variable					m_WakeUp;
+	// Threads in Wait() sleep here until their group is done or a task is queued
+	std::condition_variable					m_WaiterWakeUp;
+	std::atomic<uint32_t>					m_NumQueued;
+	bool									m_Shutdown;
+};
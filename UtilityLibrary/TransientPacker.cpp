@@ -0,0 +1,245 @@
+#include "PortableAssert.h"
+#include "TransientPacker.h"
+
+#include <algorithm>
+
+namespace
+{
+	uint64_t AlignUp( uint64_t Value, uint64_t Alignment )
+	{
+		return (Value + Alignment - 1) & ~(Alignment - 1);
+	}
+
+	uint64_t SizeOf( const TransientInterval& Interval )
+	{
+		return (std::max)( Interval.SizeBytes, (uint64_t)1 );
+	}
+
+	bool CanShare( const TransientInterval& A, const TransientInterval& B )
+	{
+		return A.AliasDomain != kTransientNoAlias && A.AliasDomain == B.AliasDomain &&
+			(A.LastUse < B.FirstUse || B.LastUse < A.FirstUse);
+	}
+
+	bool Overlaps( uint64_t OffsetA, uint64_t SizeA, uint64_t OffsetB, uint64_t SizeB )
+	{
+		return OffsetA < OffsetB + SizeB && OffsetB < OffsetA + SizeA;
+	}
+
+	struct MemoryRange
+	{
+		uint64_t	Begin;
+		uint64_t	End;
+
+		bool operator<( const MemoryRange& Other ) const { return Begin < Other.Begin; }
+	};
+
+	struct LiveEvent
+	{
+		uint32_t	Heap;
+		uint32_t	Domain;
+		uint32_t	Step;
+		int64_t		Bytes;
+
+		bool operator<( const LiveEvent& Other ) const
+		{
+			if (Heap != Other.Heap)
+				return Heap < Other.Heap;
+			if (Domain != Other.Domain)
+				return Domain < Other.Domain;
+			if (Step != Other.Step)
+				return Step < Other.Step;
+			// Ends at a step before starts at it
+			return Bytes < Other.Bytes;
+		}
+	};
+}
+
+//--------------------------------------------------------------------------------------
+// PackTransients
+//--------------------------------------------------------------------------------------
+void PackTransients( const std::vector<TransientInterval>& Intervals, TransientPackOrder Order, TransientPacking& Out )
+{
+	const uint32_t NumIntervals = (uint32_t)Intervals.size();
+	uint32_t NumHeaps = 0;
+	for (auto& Interval : Intervals)
+	{
+		ASSERT( Interval.Alignment != 0 && (Interval.Alignment & (Interval.Alignment - 1)) == 0 );
+		ASSERT( Interval.FirstUse <= Interval.LastUse );
+		NumHeaps = (std::max)( NumHeaps, Interval.Heap + 1 );
+	}
+	Out.Offsets.assign( NumIntervals, 0 );
+	Out.HeapSizes.assign( NumHeaps, 0 );
+	Out.TotalSize = 0;
+	Out.UnaliasedSize = 0;
+	Out.LowerBound = 0;
+
+	std::vector<uint64_t> Ends( NumHeaps, 0 );
+	for (auto& Interval : Intervals)
+		Ends[Interval.Heap] = AlignUp( Ends[Interval.Heap], Interval.Alignment ) + SizeOf( Interval );
+	for (uint64_t End : Ends)
+		Out.UnaliasedSize += End;
+
+	// Most bytes alive at once, intervals sharing nothing count as alive all along
+	std::vector<LiveEvent> Events;
+	Events.reserve( NumIntervals * 2 );
+	for (auto& Interval : Intervals)
+	{
+		if (Interval.AliasDomain == kTransientNoAlias)
+		{
+			Out.LowerBound += SizeOf( Interval );
+			continue;
+		}
+		LiveEvent Start = { Interval.Heap, Interval.AliasDomain, Interval.FirstUse, (int64_t)SizeOf( Interval ) };
+		LiveEvent End = { Interval.Heap, Interval.AliasDomain, Interval.LastUse + 1, -(int64_t)SizeOf( Interval ) };
+		Events.push_back( Start );
+		Events.push_back( End );
+	}
+	std::sort( Events.begin(), Events.end() );
+	for (size_t i = 0; i < Events.size();)
+	{
+		int64_t Live = 0;
+		int64_t MaxLive = 0;
+		size_t j = i;
+		for (; j < Events.size() && Events[j].Heap == Events[i].Heap && Events[j].Domain == Events[i].Domain; ++j)
+		{
+			Live += Events[j].Bytes;
+			MaxLive = (std::max)( MaxLive, Live );
+		}
+		Out.LowerBound += (uint64_t)MaxLive;
+		i = j;
+	}
+
+	// Domains never share memory, each one is packed on its own and laid out after the one before it
+	// in the heap. Those sharing nothing come last, one after the other.
+	std::vector<uint32_t> Sorted( NumIntervals );
+	for (uint32_t i = 0; i < NumIntervals; ++i)
+		Sorted[i] = i;
+	std::sort( Sorted.begin(), Sorted.end(), [&Intervals, Order]( uint32_t A, uint32_t B )
+	{
+		const TransientInterval& IntervalA = Intervals[A];
+		const TransientInterval& IntervalB = Intervals[B];
+		if (IntervalA.Heap != IntervalB.Heap)
+			return IntervalA.Heap < IntervalB.Heap;
+		if (IntervalA.AliasDomain != IntervalB.AliasDomain)
+			return IntervalA.AliasDomain < IntervalB.AliasDomain;
+		if (Order == kPackBySize && SizeOf( IntervalA ) != SizeOf( IntervalB ))
+			return SizeOf( IntervalA ) > SizeOf( IntervalB );
+		if (IntervalA.FirstUse != IntervalB.FirstUse)
+			return IntervalA.FirstUse < IntervalB.FirstUse;
+		return A < B;
+	} );
+
+	// First-fit between the memory of the intervals of the domain placed already whose lifetime it overlaps
+	std::vector<uint32_t> Placed;
+	std::vector<MemoryRange> Taken;
+	for (size_t i = 0; i < Sorted.size();)
+	{
+		const TransientInterval& First = Intervals[Sorted[i]];
+		uint64_t& HeapSize = Out.HeapSizes[First.Heap];
+		const uint64_t Base = HeapSize;
+		Placed.clear();
+		for (; i < Sorted.size() && Intervals[Sorted[i]].Heap == First.Heap && Intervals[Sorted[i]].AliasDomain == First.AliasDomain; ++i)
+		{
+			const uint32_t Index = Sorted[i];
+			const TransientInterval& Interval = Intervals[Index];
+			const uint64_t Size = SizeOf( Interval );
+			Taken.clear();
+			for (uint32_t j : Placed)
+			{
+				if (!CanShare( Interval, Intervals[j] ))
+				{
+					MemoryRange Range = { Out.Offsets[j], Out.Offsets[j] + SizeOf( Intervals[j] ) };
+					Taken.push_back( Range );
+				}
+			}
+			std::sort( Taken.begin(), Taken.end() );
+			uint64_t Offset = Interval.AliasDomain == kTransientNoAlias ? HeapSize : Base;
+			for (auto& Range : Taken)
+			{
+				if (AlignUp( Offset, Interval.Alignment ) + Size <= Range.Begin)
+					break;
+				Offset = (std::max)( Offset, Range.End );
+			}
+			Offset = AlignUp( Offset, Interval.Alignment );
+			Out.Offsets[Index] = Offset;
+			HeapSize = (std::max)( HeapSize, Offset + Size );
+			if (Interval.AliasDomain != kTransientNoAlias)
+				Placed.push_back( Index );
+		}
+	}
+	for (uint64_t HeapSize : Out.HeapSizes)
+		Out.TotalSize += HeapSize;
+}
+
+//--------------------------------------------------------------------------------------
+// FindTransientAliasing
+//--------------------------------------------------------------------------------------
+void FindTransientAliasing( const std::vector<TransientInterval>& Intervals, const TransientPacking& Packing,
+	std::vector<TransientAliasing>& Out )
+{
+	Out.clear();
+	const uint32_t NumIntervals = (uint32_t)Intervals.size();
+	std::vector<uint32_t> Before;
+	std::vector<MemoryRange> Covered;
+	for (uint32_t After = 0; After < NumIntervals; ++After)
+	{
+		const TransientInterval& B = Intervals[After];
+		if (B.AliasDomain == kTransientNoAlias)
+			continue;
+		const MemoryRange Range = { Packing.Offsets[After], Packing.Offsets[After] + SizeOf( B ) };
+		bool TakenLater = false;
+		Before.clear();
+		for (uint32_t i = 0; i < NumIntervals; ++i)
+		{
+			const TransientInterval& A = Intervals[i];
+			if (i == After || A.Heap != B.Heap || !Overlaps( Packing.Offsets[i], SizeOf( A ), Range.Begin, SizeOf( B ) ))
+				continue;
+			ASSERT( CanShare( A, B ) );
+			if (A.LastUse < B.FirstUse)
+				Before.push_back( i );
+			else
+				TakenLater = true;
+		}
+
+		// The last ones to use each part of its memory, going back from the latest
+		std::sort( Before.begin(), Before.end(), [&Intervals]( uint32_t X, uint32_t Y )
+		{
+			return Intervals[X].LastUse != Intervals[Y].LastUse ? Intervals[X].LastUse > Intervals[Y].LastUse : X < Y;
+		} );
+		Covered.clear();
+		const size_t First = Out.size();
+		for (uint32_t i : Before)
+		{
+			const MemoryRange Overlap = { (std::max)( Packing.Offsets[i], Range.Begin ), (std::min)( Packing.Offsets[i] + SizeOf( Intervals[i] ), Range.End ) };
+			// Covered stays sorted and merged
+			uint64_t Reached = Overlap.Begin;
+			for (auto& Part : Covered)
+				if (Part.Begin <= Reached && Part.End > Reached)
+					Reached = Part.End;
+			if (Reached >= Overlap.End)
+				continue;
+			TransientAliasing Aliasing = { i, After };
+			Out.push_back( Aliasing );
+			Covered.push_back( Overlap );
+			std::sort( Covered.begin(), Covered.end() );
+			size_t Merged = 0;
+			for (size_t c = 1; c < Covered.size(); ++c)
+			{
+				if (Covered[c].Begin <= Covered[Merged].End)
+					Covered[Merged].End = (std::max)( Covered[Merged].End, Covered[c].End );
+				else
+					Covered[++Merged] = Covered[c];
+			}
+			Covered.resize( Merged + 1 );
+		}
+		// The frame before left what comes later in this one in the memory not handed over in it
+		const bool AllCovered = Covered.size() == 1 && Covered[0].Begin == Range.Begin && Covered[0].End == Range.End;
+		if (TakenLater && !AllCovered)
+		{
+			TransientAliasing Aliasing = { kTransientPreviousFrame, After };
+			Out.push_back( Aliasing );
+		}
+		std::sort( Out.begin() + First, Out.end(), []( const TransientAliasing& X, const TransientAliasing& Y ) { return X.Before < Y.Before; } );
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+// Packs resources which only live for part of a frame into shared heaps, aliasing their memory
+
+#include <stdint.h>
+#include <vector>
+
+// Alias domain of a resource sharing memory with nothing
+const uint32_t kTransientNoAlias = 0xffffffff;
+// TransientAliasing::Before of a resource whose memory a later one had in the frame before
+const uint32_t kTransientPreviousFrame = 0xffffffff;
+
+struct TransientInterval
+{
+	uint64_t	SizeBytes;
+	uint64_t	Alignment;				// Power of two
+	uint32_t	FirstUse;
+	uint32_t	LastUse;				// Inclusive
+	uint32_t	Heap;					// Heaps are packed apart, resource heap tier 1 needs one per kind
+	uint32_t	AliasDomain;			// Shares memory only within its domain, the queue its users run on
+};
+
+enum TransientPackOrder : uint8_t
+{
+	kPackBySize,							// Largest first, the way it is done offline
+	kPackByFirstUse,						// In the order they start, like an allocator as the frame goes
+};
+
+struct TransientPacking
+{
+	std::vector<uint64_t>	Offsets;			// Per interval, in its heap
+	std::vector<uint64_t>	HeapSizes;			// Per heap index used
+	uint64_t				TotalSize;			// Of all heaps
+	uint64_t				UnaliasedSize;		// Every interval in memory of its own
+	uint64_t				LowerBound;			// Most bytes alive at one step, per heap and domain
+};
+
+struct TransientAliasing
+{
+	uint32_t	Before;					// Interval whose memory is taken over
+	uint32_t	After;
+};
+
+// Lifetimes are inclusive ranges of steps, passes of a frame for instance. Two resources share memory
+// when their lifetimes are apart and they are in the same alias domain, the later one taking it over
+// with an aliasing barrier. Each goes to the lowest aligned offset of its heap missing every resource
+// placed already it can't share with (first-fit), every alias domain in a range of the heap of its own.
+void PackTransients( const std::vector<TransientInterval>& Intervals, TransientPackOrder Order, TransientPacking& Out );
+
+// Aliasing barriers, with the last interval to use each part of After's memory before it as Before.
+// Frames repeat, so memory a later interval takes over is handed back at the start of the next
+// frame, with kTransientPreviousFrame when nothing in the frame used it before. Sorted by After,
+// then Before.
+void FindTransientAliasing( const std::vector<TransientInterval>& Intervals, const TransientPacking& Packing,
+	std::vector<TransientAliasing>& Out );
+
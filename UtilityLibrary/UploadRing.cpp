@@ -0,0 +1,101 @@
+#include "PortableAssert.h"
+#include "UploadRing.h"
+
+#include <algorithm>
+#include <string.h>
+
+//--------------------------------------------------------------------------------------
+// UploadRing
+//--------------------------------------------------------------------------------------
+UploadRing::UploadRing()
+	:m_pFenceOracle( nullptr ), m_Capacity( 0 ), m_Head( 0 ), m_Tail( 0 )
+{
+	memset( &m_Stats, 0, sizeof( m_Stats ) );
+}
+
+void UploadRing::Create( size_t Capacity, IFenceOracle* pFenceOracle )
+{
+	ASSERT( Capacity > 0 && Capacity % kBlockAlign == 0 );
+	m_pFenceOracle = pFenceOracle;
+	m_Capacity = Capacity;
+	m_Head = m_Tail = 0;
+	m_Entries.clear();
+	memset( &m_Stats, 0, sizeof( m_Stats ) );
+	m_Stats.Capacity = Capacity;
+}
+
+void UploadRing::Destroy()
+{
+	m_Entries.clear();
+	m_Head = m_Tail = 0;
+	m_Capacity = 0;
+}
+
+void UploadRing::Retire( uint64_t BlockId, uint64_t FenceValue )
+{
+	auto iter = std::lower_bound( m_Entries.begin(), m_Entries.end(), BlockId,
+		[]( const Entry& E, uint64_t Id ) { return E.Begin < Id; } );
+	ASSERT( iter != m_Entries.end() && iter->Begin == BlockId && !iter->Retired );
+	iter->FenceValue = FenceValue;
+	iter->Retired = true;
+}
+
+UploadRingStats UploadRing::GetStats() const
+{
+	UploadRingStats Stats = m_Stats;
+	Stats.UsedBytes = m_Head - m_Tail;
+	return Stats;
+}
+
+UploadRing::Status UploadRing::TryAllocate( size_t Size, UploadRingBlock& Block, uint64_t& WaitFence )
+{
+	Reclaim();
+	const size_t AlignedSize = (Size + kBlockAlign - 1) & ~(size_t)(kBlockAlign - 1);
+	if (AlignedSize > m_Capacity)
+		return kFull;
+
+	// Blocks are contiguous, skip what is left in front of the buffer end
+	const size_t Pos = (size_t)(m_Head % m_Capacity);
+	const size_t Skip = Pos + AlignedSize > m_Capacity ? m_Capacity - Pos : 0;
+	const uint64_t Needed = Skip + AlignedSize;
+	// Doesn't fit in front of the buffer end, and the bytes skipped make it too big for the ring
+	if (Needed > m_Capacity)
+		return kFull;
+	if (m_Head - m_Tail + Needed <= m_Capacity)
+	{
+		Entry NewEntry = { m_Head, m_Head + Needed, 0, false };
+		m_Entries.push_back( NewEntry );
+		Block.Id = m_Head;
+		Block.Offset = (Pos + Skip) % m_Capacity;
+		Block.Size = AlignedSize;
+		m_Head += Needed;
+		m_Stats.NumBlocks++;
+		m_Stats.SkippedBytes += Skip;
+		m_Stats.PeakUsedBytes = (std::max)( m_Stats.PeakUsedBytes, m_Head - m_Tail );
+		return kAllocated;
+	}
+
+	// Waiting only helps if retired blocks alone free enough, one still recording blocks the tail
+	const uint64_t NeededTail = m_Head + Needed - m_Capacity;
+	for (auto& E : m_Entries)
+	{
+		if (!E.Retired)
+			return kFull;
+		if (E.End >= NeededTail)
+		{
+			WaitFence = m_Entries.front().FenceValue;
+			return kMustWait;
+		}
+	}
+	return kFull;
+}
+
+void UploadRing::Reclaim()
+{
+	while (!m_Entries.empty() && m_Entries.front().Retired &&
+		m_pFenceOracle->IsFenceComplete( m_Entries.front().FenceValue ))
+	{
+		m_Tail = m_Entries.front().End;
+		m_Entries.pop_front();
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+// Fence based ring of one persistently mapped upload buffer, not thread safe.
+
+#include <stdint.h>
+#include <deque>
+
+#include "LinearPagePool.h"
+
+struct UploadRingBlock
+{
+	uint64_t	Id;				// Ever increasing position of the block, pass back to Retire()
+	size_t		Offset;			// Into the ring buffer
+	size_t		Size;
+};
+
+struct UploadRingStats
+{
+	uint64_t	Capacity;
+	uint64_t	UsedBytes;			// Bytes between tail and head, including skipped ones
+	uint64_t	PeakUsedBytes;
+	uint64_t	NumBlocks;			// Total blocks handed out
+	uint64_t	StallCount;			// Allocations which had to wait for the GPU
+	uint64_t	BytesStalled;		// Bytes of those allocations
+	uint64_t	NumFailed;			// Allocations left to the caller's fallback
+	uint64_t	SkippedBytes;		// Total bytes skipped at the buffer end
+};
+
+//--------------------------------------------------------------------------------------
+// UploadRing
+//--------------------------------------------------------------------------------------
+class UploadRing
+{
+public:
+	enum { kBlockAlign = 0x1000 };
+
+	UploadRing();
+	void Create( size_t Capacity, IFenceOracle* pFenceOracle );
+	void Destroy();
+	bool IsCreated() const { return m_Capacity != 0; }
+	size_t GetCapacity() const { return m_Capacity; }
+
+	// Reserves a block at the head, one which doesn't fit in front of the buffer end skips to the
+	// start. When the ring is full it waits on the oldest retired fence, counted as one stall; if
+	// waiting can't help, because a block in front is still being recorded or Size is bigger than the
+	// ring, it returns false and the caller falls back to pages.
+	// WaitForFence( uint64_t ) blocks until the fence completed, it's only called with fences
+	// passed to Retire(). It may drop the caller's lock while it blocks and let other threads use
+	// the ring, nothing is kept across the wait.
+	template <typename WaitFn>
+	bool Allocate( size_t Size, UploadRingBlock& Block, WaitFn&& WaitForFence );
+	// The tail only moves past retired blocks whose fence completed, skipped bytes go along with the
+	// block after them
+	void Retire( uint64_t BlockId, uint64_t FenceValue );
+
+	UploadRingStats GetStats() const;
+
+private:
+	struct Entry
+	{
+		uint64_t	Begin;			// Including bytes skipped in front of it
+		uint64_t	End;
+		uint64_t	FenceValue;
+		bool		Retired;
+	};
+
+	enum Status { kAllocated, kMustWait, kFull };
+	Status TryAllocate( size_t Size, UploadRingBlock& Block, uint64_t& WaitFence );
+	void Reclaim();
+
+	IFenceOracle*		m_pFenceOracle;
+	size_t				m_Capacity;
+	uint64_t			m_Head;
+	uint64_t			m_Tail;
+	std::deque<Entry>	m_Entries;			// Sorted by Begin, front is at the tail
+	UploadRingStats		m_Stats;
+};
+
+template <typename WaitFn>
+bool UploadRing::Allocate( size_t Size, UploadRingBlock& Block, WaitFn&& WaitForFence )
+{
+	bool Stalled = false;
+	uint64_t WaitFence;
+	for (;;)
+	{
+		Status Result = TryAllocate( Size, Block, WaitFence );
+		if (Result == kAllocated) return true;
+		if (Result == kFull)
+		{
+			m_Stats.NumFailed++;
+			return false;
+		}
+		if (!Stalled)
+		{
+			Stalled = true;
+			m_Stats.StallCount++;
+			m_Stats.BytesStalled += Size;
+		}
+		WaitForFence( WaitFence );
+	}
+}
@@ -0,0 +1,499 @@
+// OptimizeBarriers() on small streams with known results: A->B->C collapses to one barrier and
+// A->B->A to none, a UAV barrier nothing used the resource before is dropped, subresource barriers
+// merge back into one once the states agree, and a transition idle long enough is split unless a
+// flush ends the list in between. ValidateBarriers() must find an error once a barrier is dropped or
+// its StateBefore is wrong. Then the legacy options, collapsing only and collapsing with split
+// barriers over two kinds of stream, every result validated. The frame stream is a deferred
+// renderer's barrier requests: uploads, a shadow map drawn early and read late, particles
+// ping-ponging between two UAV buffers, G-buffer draws which request their targets again every draw
+// and now and then bounce one to COPY_SOURCE and back, and a bloom chain rendering mip to mip in one
+// texture. The random stream requests random states of random subresources between works and
+// flushes, to shake out what the frame doesn't.
+
+#include "UtilityTests.h"
+#include "BarrierOptimizer.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	// D3D12_RESOURCE_STATES the streams use
+	const BarrierState kCommon = 0x0;
+	const BarrierState kVertexAndConstant = 0x1;
+	const BarrierState kRenderTarget = 0x4;
+	const BarrierState kUnorderedAccess = 0x8;
+	const BarrierState kDepthWrite = 0x10;
+	const BarrierState kDepthRead = 0x20;
+	const BarrierState kNonPixelShaderResource = 0x40;
+	const BarrierState kPixelShaderResource = 0x80;
+	const BarrierState kCopyDest = 0x400;
+	const BarrierState kCopySource = 0x800;
+	const BarrierState kPresent = 0x0;
+
+	const BarrierState kNoState = 0xffffffff;
+
+	const uint32_t kBloomMips = 5;
+	const uint32_t kRandomResources = 12;
+	const uint32_t kNumSeeds = 8;
+
+	BarrierStream MakeSyntheticBarrierStream( uint32_t NumFrames, uint32_t Seed )
+	{
+		BarrierStream Stream;
+		const uint32_t Vertices = Stream.AddResource( 1, kCopyDest );
+		const uint32_t ShadowMap = Stream.AddResource( 1, kDepthWrite );
+		uint32_t GBuffer[3];
+		for (auto& Target : GBuffer)
+			Target = Stream.AddResource( 1, kPixelShaderResource );
+		const uint32_t Depth = Stream.AddResource( 1, kDepthWrite );
+		const uint32_t SceneColor = Stream.AddResource( 1, kPixelShaderResource );
+		const uint32_t Particles[2] = { Stream.AddResource( 1, kNonPixelShaderResource ), Stream.AddResource( 1, kNonPixelShaderResource ) };
+		const uint32_t Bloom = Stream.AddResource( kBloomMips, kPixelShaderResource );
+		const uint32_t BackBuffer = Stream.AddResource( 1, kPresent );
+
+		uint32_t Current = 0;
+		for (uint32_t Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			// Upload the frame's vertices
+			Stream.Transition( Vertices, kCopyDest );
+			Stream.Work();
+			Stream.Transition( Vertices, kVertexAndConstant );
+
+			// Shadow map, clear then draws
+			Stream.Transition( ShadowMap, kDepthWrite );
+			Stream.Work();
+			const uint32_t NumShadowDraws = 8 + NextRandom( Seed ) % 24;
+			for (uint32_t i = 0; i < NumShadowDraws; ++i)
+			{
+				Stream.Transition( Vertices, kVertexAndConstant );
+				Stream.Transition( ShadowMap, kDepthWrite );
+				Stream.Work();
+			}
+
+			// Particle simulation steps read one buffer and write the other, then update it in place
+			const uint32_t NumSteps = 2 + NextRandom( Seed ) % 3;
+			for (uint32_t i = 0; i < NumSteps; ++i)
+			{
+				const uint32_t Src = Particles[Current];
+				const uint32_t Dst = Particles[Current ^ 1];
+				Stream.Transition( Src, kNonPixelShaderResource );
+				Stream.Transition( Dst, kUnorderedAccess );
+				Stream.UAV( Dst );
+				Stream.Work();
+				Stream.Transition( Dst, kUnorderedAccess );
+				Stream.UAV( Dst );
+				Stream.UAV( Dst );
+				Stream.Work();
+				Current ^= 1;
+			}
+
+			// G-buffer, every clear flushes on its own
+			for (auto& Target : GBuffer)
+			{
+				Stream.Transition( Target, kRenderTarget );
+				Stream.Work();
+			}
+			Stream.Transition( Depth, kDepthWrite );
+			Stream.Work();
+			const uint32_t NumDraws = 16 + NextRandom( Seed ) % 48;
+			for (uint32_t i = 0; i < NumDraws; ++i)
+			{
+				// A readback which was asked for and then skipped
+				if (NextRandom( Seed ) % 8 == 0)
+					Stream.Transition( GBuffer[0], kCopySource );
+				Stream.Transition( Vertices, kVertexAndConstant );
+				for (auto& Target : GBuffer)
+					Stream.Transition( Target, kRenderTarget );
+				Stream.Transition( Depth, kDepthWrite );
+				Stream.Work();
+			}
+
+			// Lighting
+			Stream.Transition( ShadowMap, kPixelShaderResource );
+			for (auto& Target : GBuffer)
+				Stream.Transition( Target, kPixelShaderResource );
+			Stream.Transition( Depth, kDepthRead | kPixelShaderResource );
+			Stream.Transition( SceneColor, kRenderTarget );
+			Stream.Work();
+
+			// Particles drawn over it
+			Stream.Transition( Particles[Current], kVertexAndConstant | kNonPixelShaderResource );
+			Stream.Transition( SceneColor, kRenderTarget );
+			Stream.Transition( Depth, kDepthRead );
+			Stream.Work();
+
+			// Bloom down the mip chain and back up, one mip read while the next is rendered
+			Stream.Transition( SceneColor, kPixelShaderResource );
+			Stream.Transition( Bloom, kRenderTarget, 0 );
+			Stream.Work();
+			for (uint32_t Mip = 1; Mip < kBloomMips; ++Mip)
+			{
+				Stream.Transition( Bloom, kPixelShaderResource, Mip - 1 );
+				Stream.Transition( Bloom, kRenderTarget, Mip );
+				Stream.Work();
+			}
+			for (uint32_t Mip = kBloomMips - 1; Mip > 0; --Mip)
+			{
+				Stream.Transition( Bloom, kPixelShaderResource, Mip );
+				Stream.Transition( Bloom, kRenderTarget, Mip - 1 );
+				Stream.Work();
+			}
+
+			// Composite into the back buffer, then the GUI
+			Stream.Transition( Bloom, kPixelShaderResource );
+			Stream.Transition( SceneColor, kPixelShaderResource );
+			Stream.Transition( BackBuffer, kRenderTarget );
+			Stream.Work();
+			const uint32_t NumGuiDraws = NextRandom( Seed ) % 4;
+			for (uint32_t i = 0; i < NumGuiDraws; ++i)
+			{
+				Stream.Transition( BackBuffer, kRenderTarget );
+				Stream.Work();
+			}
+			Stream.Transition( BackBuffer, kPresent );
+			Stream.Flush();
+		}
+		return Stream;
+	}
+
+	BarrierStream MakeRandomBarrierStream( uint32_t NumOps, uint32_t Seed )
+	{
+		static const BarrierState kStates[] = { kCommon, kRenderTarget, kUnorderedAccess, kPixelShaderResource,
+			kNonPixelShaderResource | kPixelShaderResource, kCopyDest, kCopySource };
+		const uint32_t kNumStates = sizeof( kStates ) / sizeof( kStates[0] );
+
+		BarrierStream Stream;
+		for (uint32_t i = 0; i < kRandomResources; ++i)
+			Stream.AddResource( 1 + NextRandom( Seed ) % 6, kStates[NextRandom( Seed ) % kNumStates] );
+		for (uint32_t i = 0; i < NumOps; ++i)
+		{
+			const uint32_t Kind = NextRandom( Seed ) % 100;
+			const uint32_t Resource = NextRandom( Seed ) % kRandomResources;
+			if (Kind < 60)
+			{
+				const uint32_t NumSubresources = Stream.Resources[Resource].NumSubresources;
+				const uint32_t Subresource = NextRandom( Seed ) % 2 ? kAllSubresources : NextRandom( Seed ) % NumSubresources;
+				Stream.Transition( Resource, kStates[NextRandom( Seed ) % kNumStates], Subresource );
+			}
+			else if (Kind < 70)
+			{
+				Stream.Transition( Resource, kUnorderedAccess );
+				Stream.UAV( Resource );
+			}
+			else if (Kind < 98)
+				Stream.Work();
+			else
+				Stream.Flush();
+		}
+		return Stream;
+	}
+
+	void CheckKnownStreams( std::vector<std::string>& Failures )
+	{
+		std::vector<BarrierBatch> Batches;
+		BarrierPassStats Stats;
+		const Checker Check( Failures, "barrier-optimizer" );
+		auto Run = [&]( const BarrierStream& Stream, const BarrierPassOptions& Options, const char* What )
+		{
+			OptimizeBarriers( Stream, Options, Batches, Stats );
+			Check( ValidateBarriers( Stream, Batches ) == 0, What );
+		};
+
+		{
+			BarrierStream Stream;
+			const uint32_t Texture = Stream.AddResource( 1, kPixelShaderResource );
+			Stream.Transition( Texture, kRenderTarget );
+			Stream.Transition( Texture, kCopySource );
+			Stream.Work();
+			Run( Stream, BarrierPassOptions::Legacy(), "A->B->C valid under legacy options" );
+			Check( Stats.NumBarriers == 2, "legacy options resolve A->B->C request by request" );
+			Run( Stream, BarrierPassOptions::Optimized(), "A->B->C valid" );
+			Check( Stats.NumBarriers == 1 && Batches.size() == 1 && Batches[0].Barriers[0].StateBefore == kPixelShaderResource &&
+				Batches[0].Barriers[0].StateAfter == kCopySource, "A->B->C is one barrier A->C" );
+		}
+		{
+			BarrierStream Stream;
+			const uint32_t Texture = Stream.AddResource( 1, kPixelShaderResource );
+			Stream.Transition( Texture, kRenderTarget );
+			Stream.Transition( Texture, kPixelShaderResource );
+			Stream.Work();
+			Run( Stream, BarrierPassOptions::Optimized(), "A->B->A valid" );
+			Check( Stats.NumBarriers == 0 && Batches.empty(), "A->B->A is no barrier" );
+		}
+		{
+			// Nothing used the buffer before the first work, the second one needs its writes done
+			BarrierStream Stream;
+			const uint32_t Buffer = Stream.AddResource( 1, kUnorderedAccess );
+			Stream.Transition( Buffer, kUnorderedAccess );
+			Stream.UAV( Buffer );
+			Stream.Work();
+			Stream.Transition( Buffer, kUnorderedAccess );
+			Stream.UAV( Buffer );
+			Stream.UAV( Buffer );
+			Stream.Work();
+			Run( Stream, BarrierPassOptions::Legacy(), "UAV stream valid under legacy options" );
+			Check( Stats.NumUAVBarriers == 3, "legacy options emit every UAV barrier" );
+			Run( Stream, BarrierPassOptions::Optimized(), "UAV stream valid" );
+			Check( Stats.NumUAVBarriers == 1 && Batches.size() == 1 && Batches[0].WorkIndex == 1,
+				"one UAV barrier, before the work after a use" );
+		}
+		{
+			BarrierStream Stream;
+			const uint32_t Texture = Stream.AddResource( 4, kPixelShaderResource );
+			Stream.Transition( Texture, kRenderTarget, 1 );
+			Stream.Work();
+			Stream.Transition( Texture, kRenderTarget );
+			Stream.Work();
+			Stream.Transition( Texture, kPixelShaderResource );
+			Stream.Work();
+			Run( Stream, BarrierPassOptions::Optimized( false ), "subresource stream valid" );
+			Check( Stats.NumSubresourceBarriers == 4, "subresources in other states transition one by one" );
+			Check( Stats.NumBarriers == 5 && Batches.size() == 3 && Batches[2].Barriers.size() == 1 &&
+				Batches[2].Barriers[0].Subresource == kAllSubresources, "one barrier for all subresources once they agree" );
+		}
+		for (uint32_t WithFlush = 0; WithFlush < 2; ++WithFlush)
+		{
+			// Last used by work 0 and needed again by work 3
+			BarrierStream Stream;
+			const uint32_t Target = Stream.AddResource( 1, kRenderTarget );
+			Stream.Transition( Target, kRenderTarget );
+			Stream.Work();
+			if (WithFlush)
+				Stream.Flush();
+			else
+				Stream.Work();
+			Stream.Work();
+			Stream.Transition( Target, kPixelShaderResource );
+			Stream.Work();
+			Run( Stream, BarrierPassOptions::Optimized( false ), "idle transition valid without splitting" );
+			Check( Stats.NumSplit == 0 && Stats.NumBarriers == 1, "no split barriers unless asked for" );
+			Run( Stream, BarrierPassOptions::Optimized( true ), "idle transition valid with splitting" );
+			if (WithFlush)
+				Check( Stats.NumSplit == 0 && Stats.NumBarriers == 1, "no split barrier across a flush, too few works after it" );
+			else
+				Check( Stats.NumSplit == 1 && Batches.size() == 2 && Batches[0].WorkIndex == 1 &&
+					Batches[0].Barriers[0].Flags == kBarrierFlagBeginOnly && Batches[1].WorkIndex == 3 &&
+					Batches[1].Barriers[0].Flags == kBarrierFlagEndOnly, "split right after the last use and ended where needed" );
+		}
+
+		// The validator itself has to catch what a broken pass would do
+		const BarrierStream Stream = MakeSyntheticBarrierStream( 1, 1 );
+		OptimizeBarriers( Stream, BarrierPassOptions::Optimized(), Batches, Stats );
+		std::vector<BarrierBatch> Broken = Batches;
+		Broken[Broken.size() / 2].Barriers.pop_back();
+		Check( ValidateBarriers( Stream, Broken ) != 0, "validation finds a dropped barrier" );
+		Broken = Batches;
+		for (auto& Barrier : Broken[0].Barriers)
+			Barrier.StateBefore ^= kCopySource;
+		Check( ValidateBarriers( Stream, Broken ) != 0, "validation finds a wrong StateBefore" );
+	}
+
+	struct BenchmarkResult
+	{
+		uint64_t	NumRequests;
+		uint64_t	NumWorks;
+		uint64_t	NumBarriers;
+		uint64_t	NumUAVBarriers;
+		uint64_t	NumSplit;
+		uint64_t	NumCalls;
+		uint32_t	MaxBatchSize;
+		double		Seconds;
+	};
+
+	// Each stream kind is made once per seed, the random one with NumFrames * 200 ops, results add up
+	// over the seeds
+	BenchmarkResult RunBenchmark( uint32_t Kind, const BarrierPassOptions& Options, uint32_t NumFrames, std::vector<std::string>& Failures )
+	{
+		BenchmarkResult Result = {};
+		std::vector<BarrierBatch> Batches;
+		for (uint32_t Seed = 1; Seed <= kNumSeeds; ++Seed)
+		{
+			BarrierStream Stream = Kind == 0 ? MakeSyntheticBarrierStream( NumFrames, Seed ) : MakeRandomBarrierStream( NumFrames * 200, Seed );
+			BarrierPassStats Stats;
+			auto Start = std::chrono::high_resolution_clock::now();
+			OptimizeBarriers( Stream, Options, Batches, Stats );
+			Result.Seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - Start ).count();
+
+			Result.NumRequests += Stats.NumRequests;
+			Result.NumWorks += Stats.NumWorks;
+			Result.NumBarriers += Stats.NumBarriers;
+			Result.NumUAVBarriers += Stats.NumUAVBarriers;
+			Result.NumSplit += Stats.NumSplit;
+			Result.NumCalls += Stats.NumCalls;
+			Result.MaxBatchSize = (std::max)( Result.MaxBatchSize, Stats.MaxBatchSize );
+			const uint64_t NumErrors = ValidateBarriers( Stream, Batches );
+			if (NumErrors)
+				Failures.push_back( "barrier-optimizer: " + std::to_string( NumErrors ) + " errors on seed " + std::to_string( Seed ) );
+		}
+		return Result;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// ValidateBarriers
+//--------------------------------------------------------------------------------------
+uint64_t ValidateBarriers( const BarrierStream& Stream, const std::vector<BarrierBatch>& Batches )
+{
+	const uint32_t NumResources = (uint32_t)Stream.Resources.size();
+	std::vector<uint32_t> First( NumResources + 1, 0 );
+	for (uint32_t i = 0; i < NumResources; ++i)
+		First[i + 1] = First[i] + Stream.Resources[i].NumSubresources;
+	std::vector<BarrierState> States( First[NumResources] );
+	for (uint32_t i = 0; i < NumResources; ++i)
+		std::fill( States.begin() + First[i], States.begin() + First[i + 1], Stream.Resources[i].InitialState );
+	// Split barriers begun and not ended, with the command list they began in
+	std::vector<BarrierState> Splitting( States.size(), kNoState );
+	std::vector<uint32_t> SplitList( States.size(), 0 );
+	std::vector<uint8_t> UsedSinceBarrier( NumResources, 0 );
+	// What the next work asked for last, per subresource
+	std::vector<BarrierState> Wanted( States.size(), kNoState );
+	std::vector<uint8_t> WantsUAV( NumResources, 0 );
+	std::vector<uint32_t> Requested;
+
+	uint64_t NumErrors = 0;
+	uint32_t WorkIndex = 0;
+	uint32_t ListIndex = 0;
+	size_t NextBatch = 0;
+
+	auto ApplyBatches = [&]()
+	{
+		for (; NextBatch < Batches.size() && Batches[NextBatch].WorkIndex <= WorkIndex; ++NextBatch)
+		{
+			NumErrors += Batches[NextBatch].WorkIndex != WorkIndex;
+			for (auto& Barrier : Batches[NextBatch].Barriers)
+			{
+				const uint32_t Begin = Barrier.Subresource == kAllSubresources ? First[Barrier.Resource] : First[Barrier.Resource] + Barrier.Subresource;
+				const uint32_t End = Barrier.IsUAV || Barrier.Subresource == kAllSubresources ? First[Barrier.Resource + 1] : Begin + 1;
+				UsedSinceBarrier[Barrier.Resource] = 0;
+				for (uint32_t i = Begin; i < End; ++i)
+				{
+					if (Barrier.IsUAV)
+					{
+						NumErrors += Splitting[i] != kNoState;
+						continue;
+					}
+					NumErrors += States[i] != Barrier.StateBefore;
+					if (Barrier.Flags == kBarrierFlagEndOnly)
+						NumErrors += Splitting[i] != Barrier.StateAfter || SplitList[i] != ListIndex;
+					else
+						NumErrors += Splitting[i] != kNoState;
+					if (Barrier.Flags == kBarrierFlagBeginOnly)
+					{
+						Splitting[i] = Barrier.StateAfter;
+						SplitList[i] = ListIndex;
+					}
+					else
+					{
+						Splitting[i] = kNoState;
+						States[i] = Barrier.StateAfter;
+					}
+				}
+			}
+		}
+	};
+	auto CheckWork = [&]()
+	{
+		ApplyBatches();
+		for (uint32_t Resource : Requested)
+		{
+			for (uint32_t i = First[Resource]; i < First[Resource + 1]; ++i)
+			{
+				if (Wanted[i] != kNoState)
+					NumErrors += Splitting[i] != kNoState || States[i] != Wanted[i];
+				Wanted[i] = kNoState;
+			}
+			NumErrors += WantsUAV[Resource] && UsedSinceBarrier[Resource];
+			WantsUAV[Resource] = 0;
+			UsedSinceBarrier[Resource] = 1;
+		}
+		Requested.clear();
+	};
+
+	for (auto& Op : Stream.Ops)
+	{
+		switch (Op.Type)
+		{
+		case kBarrierOpTransition:
+		{
+			const uint32_t Begin = Op.Subresource == kAllSubresources ? First[Op.Resource] : First[Op.Resource] + Op.Subresource;
+			const uint32_t End = Op.Subresource == kAllSubresources ? First[Op.Resource + 1] : Begin + 1;
+			for (uint32_t i = Begin; i < End; ++i)
+				Wanted[i] = Op.State;
+			Requested.push_back( Op.Resource );
+			break;
+		}
+		case kBarrierOpUAV:
+			WantsUAV[Op.Resource] = 1;
+			Requested.push_back( Op.Resource );
+			break;
+		case kBarrierOpWork:
+		case kBarrierOpFlush:
+			CheckWork();
+			WorkIndex++;
+			if (Op.Type == kBarrierOpFlush)
+			{
+				// Nothing begun may end in another command list
+				for (size_t i = 0; i < Splitting.size(); ++i)
+					NumErrors += Splitting[i] != kNoState;
+				ListIndex++;
+			}
+			break;
+		}
+	}
+	CheckWork();
+	NumErrors += NextBatch != Batches.size();
+	for (BarrierState State : Splitting)
+		NumErrors += State != kNoState;
+	return NumErrors;
+}
+
+// [NumFrames]
+uint64_t RunBarrierOptimizerTests( int argc, char* argv[] )
+{
+	const uint32_t NumFrames = GetCountArg( argc, argv, 1, 200 );
+	if (NumFrames == 0)
+	{
+		fprintf( stderr, "Bad frame count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckKnownStreams( Failures );
+
+	struct Config
+	{
+		const char*			Name;
+		BarrierPassOptions	Options;
+	};
+	const Config Configs[] =
+	{
+		{ "legacy", BarrierPassOptions::Legacy() },
+		{ "collapse", BarrierPassOptions::Optimized( false ) },
+		{ "collapse+split", BarrierPassOptions::Optimized( true ) },
+	};
+	const char* const StreamNames[] = { "frame", "random" };
+
+	printf( "%-7s %-15s %10s %10s %12s %10s %10s %10s %8s %10s\n", "Stream", "Options", "Requests", "Works",
+		"Barriers/wk", "Calls/wk", "UAV", "Split", "MaxBatch", "ns/req" );
+	for (uint32_t Kind = 0; Kind < 2; ++Kind)
+	{
+		BenchmarkResult Results[3];
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			const BenchmarkResult& R = Results[i] = RunBenchmark( Kind, Configs[i].Options, NumFrames, Failures );
+			const double Works = R.NumWorks ? (double)R.NumWorks : 1.0;
+			printf( "%-7s %-15s %10llu %10llu %12.3f %10.3f %10llu %10llu %8u %10.1f\n", StreamNames[Kind], Configs[i].Name,
+				(unsigned long long)R.NumRequests, (unsigned long long)R.NumWorks, R.NumBarriers / Works, R.NumCalls / Works,
+				(unsigned long long)R.NumUAVBarriers, (unsigned long long)R.NumSplit, R.MaxBatchSize,
+				R.NumRequests ? R.Seconds * 1e9 / R.NumRequests : 0.0 );
+		}
+		const std::string Where = std::string( " on the " ) + StreamNames[Kind] + " stream";
+		if (Results[1].NumBarriers > Results[0].NumBarriers || Results[1].NumCalls >= Results[0].NumCalls)
+			Failures.push_back( "barrier-optimizer: collapsing adds barriers or calls" + Where );
+		if (Results[0].NumSplit != 0 || Results[1].NumSplit != 0)
+			Failures.push_back( "barrier-optimizer: split barriers without splitting" + Where );
+		if (Kind == 0 && Results[2].NumSplit == 0)
+			Failures.push_back( "barrier-optimizer: nothing split" + Where );
+	}
+	return ReportFailures( Failures );
+}
@@ -0,0 +1,233 @@
+// BindlessIndexAllocator against fake direct, compute and copy queues: slots handed out once and
+// failing when full, generations making stale handles invalid, and freed slots coming back only
+// once the fences of every queue they were freed with completed. A random run on top checks that no
+// slot is reused early or handed out twice, and that every slot comes back once the queues drain.
+// Slots freed the way BindlessDescriptorHeap does must come back while the compute and copy queues
+// never get any work.
+
+#include "UtilityTests.h"
+#include "BindlessIndexAllocator.h"
+
+#include <stdio.h>
+
+namespace
+{
+	// Direct, compute and copy, D3D12_COMMAND_LIST_TYPE 0, 2 and 3
+	const uint32_t kNumQueues = 3;
+
+	void CheckAllocation( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "allocation" );
+
+		const uint32_t Capacity = 64;
+		FakeFences Queues( { 0, 2, 3 } );
+		BindlessIndexAllocator Allocator;
+		Allocator.Create( Capacity, &Queues );
+		std::vector<bool> Seen( Capacity, false );
+		for (uint32_t i = 0; i < Capacity; ++i)
+		{
+			const uint32_t Handle = Allocator.Allocate();
+			const uint32_t Index = BindlessIndexAllocator::GetIndex( Handle );
+			Check( Handle != BindlessIndexAllocator::kInvalidHandle && Index < Capacity && !Seen[Index], "slot handed out twice" );
+			Check( BindlessIndexAllocator::GetGeneration( Handle ) == 0 && Allocator.IsValid( Handle ), "new slot" );
+			if (Index < Capacity)
+				Seen[Index] = true;
+		}
+		Check( Allocator.Allocate() == BindlessIndexAllocator::kInvalidHandle, "allocated past the capacity" );
+		BindlessIndexStats Stats = Allocator.GetStats();
+		Check( Stats.Capacity == Capacity && Stats.NumAllocated == Capacity && Stats.PeakAllocated == Capacity &&
+			Stats.NumFailed == 1 && Stats.NumPendingFree == 0, "stats when full" );
+		Check( !Allocator.IsValid( BindlessIndexAllocator::kInvalidHandle ), "invalid handle valid" );
+		Check( !Allocator.IsValid( Capacity ), "slot past the capacity valid" );
+
+		Allocator.Destroy();
+		Check( !Allocator.IsCreated() && !Allocator.IsValid( 0 ), "destroy" );
+	}
+
+	void CheckGenerations( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "generations" );
+
+		// No fences, so a freed slot is back right away
+		FakeFences Queues( { 0, 2, 3 } );
+		BindlessIndexAllocator Allocator;
+		Allocator.Create( 1, &Queues );
+		const uint32_t First = Allocator.Allocate();
+		Allocator.Free( First, nullptr, 0 );
+		Check( !Allocator.IsValid( First ), "freed handle still valid" );
+		const uint32_t Second = Allocator.Allocate();
+		Check( BindlessIndexAllocator::GetIndex( Second ) == BindlessIndexAllocator::GetIndex( First ) &&
+			BindlessIndexAllocator::GetGeneration( Second ) == 1, "reused slot not a generation on" );
+		Check( Allocator.IsValid( Second ) && !Allocator.IsValid( First ), "stale handle valid for the new owner" );
+
+		// The generation wraps, only then does an old handle turn valid again
+		uint32_t Handle = Second;
+		for (uint32_t i = 1; i < BindlessIndexAllocator::kGenerationMask; ++i)
+		{
+			Allocator.Free( Handle, nullptr, 0 );
+			Handle = Allocator.Allocate();
+		}
+		Check( BindlessIndexAllocator::GetGeneration( Handle ) == BindlessIndexAllocator::kGenerationMask &&
+			!Allocator.IsValid( First ), "last generation" );
+		Allocator.Free( Handle, nullptr, 0 );
+		Handle = Allocator.Allocate();
+		Check( Handle == First && Allocator.IsValid( First ), "generation wrap" );
+	}
+
+	void CheckDeferredFree( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "deferred free" );
+
+		FakeFences Queues( { 0, 2, 3 } );
+		BindlessIndexAllocator Allocator;
+		Allocator.Create( 2, &Queues );
+		const uint32_t A = Allocator.Allocate();
+		const uint32_t B = Allocator.Allocate();
+
+		// A read by the direct and compute queues, B by the copy queue only
+		const uint64_t FencesA[3] = { Queues.Signal( 0 ), Queues.Signal( 1 ), 0 };
+		Allocator.Free( A, FencesA, 3 );
+		const uint64_t FencesB[3] = { 0, 0, Queues.Signal( 2 ) };
+		Allocator.Free( B, FencesB, 3 );
+		Check( Allocator.GetStats().NumPendingFree == 2 && Allocator.GetStats().NumAllocated == 2, "pending stats" );
+		Check( Allocator.Allocate() == BindlessIndexAllocator::kInvalidHandle, "slot reused with no fence complete" );
+
+		Queues.Advance( 0, 1 );
+		Check( Allocator.Allocate() == BindlessIndexAllocator::kInvalidHandle, "slot reused before its compute fence" );
+
+		// B's fence is done, but it waits behind A: slots come back in the order they were freed
+		Queues.Advance( 2, 1 );
+		Check( Allocator.Allocate() == BindlessIndexAllocator::kInvalidHandle, "slots reclaimed out of order" );
+
+		Queues.Advance( 1, 1 );
+		Allocator.Reclaim();
+		Check( Allocator.GetStats().NumPendingFree == 0 && Allocator.GetStats().NumAllocated == 0, "stats once reclaimed" );
+		const uint32_t C = Allocator.Allocate();
+		const uint32_t D = Allocator.Allocate();
+		Check( BindlessIndexAllocator::GetIndex( C ) == BindlessIndexAllocator::GetIndex( A ) &&
+			BindlessIndexAllocator::GetIndex( D ) == BindlessIndexAllocator::GetIndex( B ), "not reused oldest first" );
+	}
+
+	// Re-registering a texture every frame the way BindlessDescriptorHeap::Register() does, which
+	// frees with the last fence of each queue. Only the direct queue ever gets work, the compute and
+	// copy ones stay idle, yet slots must keep coming back with one frame in flight.
+	void CheckIdleQueues( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "idle queues" );
+
+		const uint32_t Capacity = 4;
+		FakeFences Queues( { 0, 2, 3 } );
+		BindlessIndexAllocator Allocator;
+		Allocator.Create( Capacity, &Queues );
+		uint32_t Handle = Allocator.Allocate();
+		uint32_t NumFailed = 0;
+		uint64_t FrameFence = 0;
+		for (uint32_t Frame = 0; Frame < 16 * Capacity; ++Frame)
+		{
+			if (Handle != BindlessIndexAllocator::kInvalidHandle)
+			{
+				uint64_t Fences[kNumQueues];
+				for (uint32_t q = 0; q < kNumQueues; ++q)
+					Fences[q] = Queues.GetLastSignaled( q );
+				Allocator.Free( Handle, Fences, kNumQueues );
+			}
+			Handle = Allocator.Allocate();
+			NumFailed += Handle == BindlessIndexAllocator::kInvalidHandle;
+			if (FrameFence != 0)
+				Queues.Complete( FrameFence );
+			FrameFence = Queues.Signal( 0 );
+		}
+		Check( NumFailed == 0, "slots held back by a queue which never submits" );
+		Check( Allocator.GetStats().NumPendingFree <= 2, "frees pile up behind an idle queue" );
+	}
+
+	void CheckRandom( uint32_t NumOps, std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "random" );
+
+		struct Slot
+		{
+			bool		Live;
+			uint32_t	Handle;
+			uint32_t	NumFrees;
+			uint64_t	FreeFences[kNumQueues];		// Of the last free, 0 for a queue not given
+		};
+
+		const uint32_t Capacity = 256;
+		FakeFences Queues( { 0, 2, 3 } );
+		BindlessIndexAllocator Allocator;
+		Allocator.Create( Capacity, &Queues );
+		std::vector<Slot> Slots( Capacity, Slot() );
+		std::vector<uint32_t> Live;
+		uint32_t Seed = 5;
+		uint32_t NumFailed = 0;
+
+		for (uint32_t Op = 0; Op < NumOps && Failures.empty(); ++Op)
+		{
+			const uint32_t What = NextRandom( Seed ) % 100;
+			if (What < 50)
+			{
+				const uint32_t Handle = Allocator.Allocate();
+				if (Handle == BindlessIndexAllocator::kInvalidHandle)
+				{
+					NumFailed++;
+					continue;
+				}
+				Slot& S = Slots[BindlessIndexAllocator::GetIndex( Handle )];
+				if (!Check( !S.Live, "slot handed out twice" ))
+					break;
+				for (uint32_t q = 0; q < kNumQueues; ++q)
+					Check( S.FreeFences[q] == 0 || Queues.IsFenceComplete( S.FreeFences[q] ), "slot reused before its fences" );
+				Check( BindlessIndexAllocator::GetGeneration( Handle ) == (S.NumFrees & BindlessIndexAllocator::kGenerationMask), "generation" );
+				S.Live = true;
+				S.Handle = Handle;
+				Live.push_back( Handle );
+			}
+			else if (What < 90 && !Live.empty())
+			{
+				const size_t Index = NextRandom( Seed ) % Live.size();
+				Slot& S = Slots[BindlessIndexAllocator::GetIndex( Live[Index] )];
+				uint64_t Fences[kNumQueues];
+				const uint32_t QueueMask = NextRandom( Seed ) % 8;
+				for (uint32_t q = 0; q < kNumQueues; ++q)
+					Fences[q] = S.FreeFences[q] = QueueMask & (1 << q) ? Queues.Signal( q ) : 0;
+				Allocator.Free( S.Handle, Fences, kNumQueues );
+				Check( !Allocator.IsValid( S.Handle ), "freed handle still valid" );
+				S.Live = false;
+				S.NumFrees++;
+				Live[Index] = Live.back();
+				Live.pop_back();
+			}
+			else
+				Queues.Advance( NextRandom( Seed ) % kNumQueues, 1 + NextRandom( Seed ) % 4 );
+		}
+		Check( NumFailed > 0, "never full, the run didn't test failing allocations" );
+
+		for (uint32_t Handle : Live)
+			Check( Allocator.IsValid( Handle ), "live handle invalid" );
+		Queues.Drain();
+		uint32_t NumAllocated = (uint32_t)Live.size();
+		while (Allocator.Allocate() != BindlessIndexAllocator::kInvalidHandle)
+			NumAllocated++;
+		Check( NumAllocated == Capacity, "slots lost once every queue drained" );
+	}
+}
+
+// [NumOps]
+uint64_t RunBindlessIndexAllocatorTests( int argc, char* argv[] )
+{
+	const uint32_t NumOps = GetCountArg( argc, argv, 1, 200000 );
+	if (NumOps == 0)
+	{
+		fprintf( stderr, "Bad op count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckAllocation( Failures );
+	CheckGenerations( Failures );
+	CheckDeferredFree( Failures );
+	CheckIdleQueues( Failures );
+	CheckRandom( NumOps, Failures );
+	printf( "%u random allocations, frees and fence completions on three queues\n", NumOps );
+	return ReportFailures( Failures );
+}
@@ -0,0 +1,102 @@
+// CheckBoidsAsyncSchedule() over render bound, simulation bound and CPU bound frames with a number of
+// seeds, the same kinds of frames the boids sample checks from its UI. Fails on any buffer written
+// while the other queue could still access it, and on any render not showing the newest result.
+// BoidsBufferRing is also driven on its own: no pass may write the buffer being rendered, and the
+// fence the simulation waits for must cover the last render of every buffer it writes.
+
+#include "UtilityTests.h"
+#include "BoidsAsyncCompute.h"
+
+#include <stdio.h>
+
+namespace
+{
+	struct ScheduleConfig
+	{
+		const char*	Name;
+		double		SimUsPerStep;
+		double		RenderUs;
+		double		CpuFrameUs;
+	};
+
+	const ScheduleConfig kConfigs[] =
+	{
+		{ "render bound",		1000.0,		12000.0,	2000.0 },
+		{ "simulation bound",	3000.0,		4000.0,		8000.0 },
+		{ "cpu bound",			500.0,		1000.0,		16000.0 },
+		{ "balanced",			2000.0,		6000.0,		6000.0 },
+	};
+
+	void CheckRing( uint32_t NumFrames, std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "ring" );
+
+		BoidsBufferRing Ring;
+		uint64_t LastRead[BoidsBufferRing::kNumBuffers] = {};
+		uint64_t DirectFence = 0, ComputeFence = 0;
+		uint32_t Random = 1;
+		for (uint32_t Frame = 0; Frame < NumFrames && Failures.empty(); ++Frame)
+		{
+			const uint32_t RenderIdx = Ring.GetRenderIdx();
+			const uint32_t NumSteps = NextRandom( Random ) % (BoidsBufferRing::kMaxSteps + 1);
+			BoidsSimulationPass Passes[BoidsBufferRing::kMaxSteps];
+			const uint64_t Wait = Ring.PlanSimulation( NumSteps, Passes );
+			uint32_t ReadIdx = RenderIdx;
+			for (uint32_t Step = 0; Step < NumSteps; ++Step)
+			{
+				const uint32_t WriteIdx = Passes[Step].WriteIdx;
+				if (!Check( Passes[Step].ReadIdx == ReadIdx, "pass not reading the previous result" ) ||
+					!Check( WriteIdx != RenderIdx && WriteIdx != ReadIdx, "pass writing a buffer it or the render reads" ) ||
+					!Check( Wait >= LastRead[WriteIdx], "wait not covering the last render of a written buffer" ))
+					break;
+				ReadIdx = WriteIdx;
+			}
+			if (!Failures.empty())
+				break;
+			Check( NumSteps != 0 || Wait == 0, "wait without a simulation" );
+			if (NumSteps != 0)
+				Ring.SimulationSubmitted( NumSteps, Passes, ++ComputeFence );
+
+			Ring.RenderSubmitted( RenderIdx, ++DirectFence );
+			LastRead[RenderIdx] = DirectFence;
+			// The next render is of this simulation's result, and waits for it unless it was already rendered
+			Check( Ring.GetRenderIdx() == ReadIdx, "render not of the newest result" );
+			Check( Ring.GetRenderWaitFence() == (NumSteps != 0 ? ComputeFence : 0), "render wait" );
+		}
+	}
+}
+
+// [NumFrames] [NumSeeds]
+uint64_t RunBoidsAsyncComputeTests( int argc, char* argv[] )
+{
+	const uint32_t NumFrames = GetCountArg( argc, argv, 1, 5000 );
+	const uint32_t NumSeeds = GetCountArg( argc, argv, 2, 8 );
+	if (NumFrames == 0 || NumSeeds == 0)
+	{
+		fprintf( stderr, "Bad frame or seed count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckRing( NumFrames, Failures );
+	uint64_t NumErrors = ReportFailures( Failures );
+
+	printf( "%-18s %6s %8s %8s %12s %10s %9s\n", "Frame", "Seeds", "Hazards", "Stale", "Overlap %", "Frame ms", "Result" );
+	for (auto& Config : kConfigs)
+	{
+		uint64_t NumHazards = 0, NumStale = 0;
+		double OverlapPercent = 0, FrameMs = 0;
+		for (uint32_t Seed = 1; Seed <= NumSeeds; ++Seed)
+		{
+			const BoidsAsyncCheckResult R = CheckBoidsAsyncSchedule( NumFrames, Config.SimUsPerStep, Config.RenderUs, Config.CpuFrameUs, Seed );
+			NumHazards += R.NumHazards;
+			NumStale += R.NumStaleRenders;
+			OverlapPercent += R.OverlapPercent / NumSeeds;
+			FrameMs += R.FrameMs / NumSeeds;
+		}
+		const bool Passed = NumHazards == 0 && NumStale == 0;
+		printf( "%-18s %6u %8llu %8llu %12.1f %10.2f %9s\n", Config.Name, NumSeeds, (unsigned long long)NumHazards,
+			(unsigned long long)NumStale, OverlapPercent, FrameMs, Passed ? "ok" : "FAILED" );
+		NumErrors += NumHazards + NumStale;
+	}
+	return NumErrors;
+}
@@ -0,0 +1,370 @@
+// BoidsEngine against a brute force port of csmain: every fish looks at every other one tile by tile,
+// phantom fish of the last tile included, and the grid step must land within a small tolerance of
+// it. The SIMD kernels the host supports must match the scalar one within the same tolerance, and
+// stepping on a TaskScheduler must be bit-exact with stepping inline, for any thread count. A saved
+// replay must play back to its checksum, and one saved without checksum must never count as matched.
+
+#include "UtilityTests.h"
+#include "BoidsEngine.h"
+#include "BoidsReplay.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+	// Grid and kernels sum neighbors in another order than csmain, nothing else differs
+	const float kTolerance = 1e-3f;
+
+	SimulationCB GetDefaultCB( uint32_t NumFish )
+	{
+		// Defaults of the interactive app
+		SimulationCB CB = {};
+		CB.fAvoidanceFactor = 8.0f;
+		CB.fSeperationFactor = 0.4f;
+		CB.fCohesionFactor = 15.f;
+		CB.fAlignmentFactor = 12.f;
+		CB.fSeekingFactor = 0.2f;
+		CB.f3SeekSourcePos = float3( 0.f, 0.f, 0.f );
+		CB.fFleeFactor = 0.f;
+		CB.f3FleeSourcePos = float3( 0.f, 0.f, 0.f );
+		CB.fMaxForce = 200.0f;
+		CB.f3CenterPos = float3( 0.f, 0.f, 0.f );
+		CB.fMaxSpeed = 20.0f;
+		CB.f3xyzExpand = float3( 60.f, 30.f, 60.f );
+		CB.fMinSpeed = 2.5f;
+		CB.fVisionDist = 3.5f;
+		CB.fVisionAngleCos = -0.6f;
+		CB.fDeltaT = 0.01f;
+		CB.uNumInstance = NumFish;
+		CB.fFishSize = 0.3f;
+		return CB;
+	}
+
+	// Off center, fleeing and seeking somewhere else, so every term of csmain is in play
+	SimulationCB GetMovedCB( uint32_t NumFish )
+	{
+		SimulationCB CB = GetDefaultCB( NumFish );
+		CB.f3CenterPos = float3( 10.f, -5.f, 20.f );
+		CB.f3SeekSourcePos = float3( 30.f, 0.f, 10.f );
+		CB.fFleeFactor = 50.f;
+		CB.f3FleeSourcePos = float3( 0.f, 5.f, 20.f );
+		return CB;
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Brute force csmain, written after BoidsSimulation_shader.hlsl without looking at BoidsEngine
+	//--------------------------------------------------------------------------------------
+	const float softeningSquared = 0.0012500000f*0.0012500000f;
+	const float softening = 0.0012500000f;
+
+	struct vec3
+	{
+		float x, y, z;
+		vec3() :x( 0.f ), y( 0.f ), z( 0.f ) {}
+		vec3( float _x, float _y, float _z ) :x( _x ), y( _y ), z( _z ) {}
+		vec3( const float3& f ) :x( f.x ), y( f.y ), z( f.z ) {}
+		vec3 operator+( const vec3& o ) const { return vec3( x + o.x, y + o.y, z + o.z ); }
+		vec3 operator-( const vec3& o ) const { return vec3( x - o.x, y - o.y, z - o.z ); }
+		vec3 operator*( const vec3& o ) const { return vec3( x * o.x, y * o.y, z * o.z ); }
+		vec3 operator*( float s ) const { return vec3( x * s, y * s, z * s ); }
+		vec3 operator/( float s ) const { return vec3( x / s, y / s, z / s ); }
+	};
+
+	float dot( const vec3& a, const vec3& b ) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	float length( const vec3& a ) { return sqrtf( dot( a, a ) ); }
+	vec3 normalize( const vec3& a ) { return a / length( a ); }
+
+	vec3 Avoidance( const SimulationCB& cb, const vec3& localPos, const vec3& velDir, const vec3& avoidPos, float distSqr )
+	{
+		vec3 OP = avoidPos - localPos;
+		float t = dot( OP, velDir );
+		vec3 tPos = localPos + velDir * t;
+		vec3 force = tPos - avoidPos;
+		float forceLenSqr = dot( force, force ) + softeningSquared;
+		return force * cb.fAvoidanceFactor / (forceLenSqr * distSqr);
+	}
+
+	vec3 Seperation( const SimulationCB& cb, const vec3& neighborDir, const vec3& neighborVel, float invDist )
+	{
+		float neighborVelSqr = dot( neighborVel, neighborVel ) + softeningSquared;
+		float invNeighborVelLen = 1.0f / sqrtf( neighborVelSqr );
+		vec3 neighborVelDir = neighborVel * invNeighborVelLen;
+		float directionFactor = fabsf( dot( neighborDir, neighborVelDir ) ) + softening;
+		return neighborDir * (-cb.fSeperationFactor * invDist * invDist * (1 + 3 * directionFactor));
+	}
+
+	vec3 Cohesion( const SimulationCB& cb, const vec3& localPos, const vec3& avgPos )
+	{
+		vec3 delta = avgPos - localPos;
+		float invDelta = 1.0f / sqrtf( dot( delta, delta ) + softeningSquared );
+		return delta * (cb.fCohesionFactor * invDelta);
+	}
+
+	vec3 Alignment( const SimulationCB& cb, const vec3& localVel, const vec3& avgVel )
+	{
+		vec3 delta = avgVel - localVel;
+		float invDelta = 1.0f / sqrtf( dot( delta, delta ) + softeningSquared );
+		return delta * (cb.fAlignmentFactor * invDelta);
+	}
+
+	vec3 Seeking( const SimulationCB& cb, const vec3& localPos, const vec3& localVel, const vec3& seekPos )
+	{
+		vec3 desired = normalize( seekPos - localPos ) * cb.fMaxSpeed;
+		return (desired - localVel) * cb.fSeekingFactor;
+	}
+
+	vec3 Flee( const SimulationCB& cb, const vec3& localPos, const vec3& localVel, const vec3& fleePos )
+	{
+		vec3 delta = localPos - fleePos;
+		float invDelta = 1.0f / sqrtf( dot( delta, delta ) + softeningSquared );
+		return (delta * cb.fMaxSpeed - localVel) * (cb.fFleeFactor * invDelta * invDelta);
+	}
+
+	void EdgeVelCorrection( float probeToEdgeA, float probeToEdgeB, float cornerRadius, float& probePosA, float& probePosB )
+	{
+		if (probeToEdgeA < 0.f && probeToEdgeB < 0.f)
+		{
+			float dist = sqrtf( probeToEdgeA * probeToEdgeA + probeToEdgeB * probeToEdgeB );
+			if (dist > cornerRadius)
+			{
+				probePosA += probeToEdgeA / dist * (dist - cornerRadius);
+				probePosB += probeToEdgeB / dist * (dist - cornerRadius);
+			}
+		}
+	}
+
+	void BorderVelCorrection( const SimulationCB& cb, const vec3& pos, vec3& vel )
+	{
+		float speed = length( vel );
+		float cornerRadius = speed * 25 * cb.fDeltaT * 1.5f;
+		vec3 probePos = pos + vel * (25 * cb.fDeltaT);
+		vec3 convert( pos.x > 0.f ? 1.f : -1.f, pos.y > 0.f ? 1.f : -1.f, pos.z > 0.f ? 1.f : -1.f );
+		vec3 mirror = probePos * convert;
+		vec3 toCorner = vec3( cb.f3xyzExpand ) - vec3( cornerRadius, cornerRadius, cornerRadius ) - mirror;
+		if (toCorner.x < 0.f && toCorner.y < 0.f && toCorner.z < 0.f)
+		{
+			float dist = length( toCorner );
+			if (dist > cornerRadius)
+				mirror = mirror + normalize( toCorner ) * (dist - cornerRadius);
+		}
+		EdgeVelCorrection( toCorner.x, toCorner.y, cornerRadius, mirror.x, mirror.y );
+		EdgeVelCorrection( toCorner.x, toCorner.z, cornerRadius, mirror.x, mirror.z );
+		EdgeVelCorrection( toCorner.y, toCorner.z, cornerRadius, mirror.y, mirror.z );
+		mirror = vec3( (std::min)( mirror.x, cb.f3xyzExpand.x ), (std::min)( mirror.y, cb.f3xyzExpand.y ), (std::min)( mirror.z, cb.f3xyzExpand.z ) );
+		vel = normalize( mirror * convert - pos ) * speed;
+	}
+
+	// One thread of csmain for every fish, reads past the end of oldVP return zero like on the GPU
+	void BruteForceStep( const SimulationCB& cb, const std::vector<FishData>& Old, std::vector<FishData>& New )
+	{
+		const uint32_t N = cb.uNumInstance;
+		const vec3 center( cb.f3CenterPos );
+		const uint32_t NumLoaded = (N / BLOCK_SIZE + 1) * BLOCK_SIZE;
+		New.resize( N );
+		for (uint32_t f = 0; f < N; ++f)
+		{
+			vec3 localPos = vec3( Old[f].pos ) - center;
+			vec3 localVel( Old[f].vel );
+			vec3 accForce, accPos, accVel;
+			uint32_t accCount = 0;
+			vec3 velDir = localVel / length( localVel );
+			for (uint32_t i = 0; i < NumLoaded; ++i)
+			{
+				vec3 pos = (i < N ? vec3( Old[i].pos ) : vec3()) - center;
+				vec3 vel = i < N ? vec3( Old[i].vel ) : vec3();
+				vec3 vPos = pos - localPos;
+				float distSqr = dot( vPos, vPos ) + softeningSquared;
+				float dist = sqrtf( distSqr );
+				float invDist = 1.0f / dist;
+				vec3 neighborDir = vPos * invDist;
+				if (dist <= cb.fVisionDist && dot( velDir, neighborDir ) >= cb.fVisionAngleCos)
+				{
+					accPos = accPos + pos;
+					accVel = accVel + vel;
+					accCount += 1;
+					accForce = accForce + Seperation( cb, neighborDir, vel, invDist );
+					accForce = accForce + Avoidance( cb, localPos, velDir, pos, distSqr );
+				}
+			}
+			if (accCount != 0)
+			{
+				vec3 avgPos = accPos / (float)accCount;
+				vec3 avgVel = accVel / (float)accCount;
+				accForce = accForce + Cohesion( cb, localPos, avgPos + normalize( localVel ) * 0.2f );
+				accForce = accForce + Alignment( cb, localVel, avgVel );
+				accForce = accForce + Flee( cb, localPos, localVel, vec3( cb.f3FleeSourcePos ) - center );
+				accForce = accForce + (avgPos - localPos) * 0.5f;
+			}
+			vec3 seek = Seeking( cb, localPos, localVel, vec3( cb.f3SeekSourcePos ) - center );
+			accForce = accForce + (accCount == 0 ? seek * 100.f : seek);
+			float accForceSqr = dot( accForce, accForce ) + softeningSquared;
+			if (accForceSqr > cb.fMaxForce * cb.fMaxForce)
+				accForce = accForce * (1.0f / sqrtf( accForceSqr )) * cb.fMaxForce;
+
+			localVel = localVel + accForce * cb.fDeltaT;
+			float velAfterSqr = dot( localVel, localVel );
+			if (velAfterSqr > cb.fMaxSpeed * cb.fMaxSpeed)
+				localVel = localVel * (1.0f / sqrtf( velAfterSqr )) * cb.fMaxSpeed;
+			else if (velAfterSqr < cb.fMinSpeed * cb.fMinSpeed)
+				localVel = localVel * (1.0f / sqrtf( velAfterSqr )) * cb.fMinSpeed;
+			BorderVelCorrection( cb, localPos, localVel );
+			localPos = localPos + localVel * cb.fDeltaT;
+
+			vec3 pos = localPos + center;
+			New[f].pos = float3( pos.x, pos.y, pos.z );
+			New[f].vel = float3( localVel.x, localVel.y, localVel.z );
+		}
+	}
+
+	std::vector<FishData> GenerateFish( const SimulationCB& CB, uint32_t Seed, float ClusterScale )
+	{
+		std::vector<FishData> Fish( CB.uNumInstance );
+		BoidsEngine::GenerateFishData( CB, Seed, ClusterScale, Fish.data() );
+		return Fish;
+	}
+
+	// Fish counts on and off a tile boundary, a loose and a dense cluster
+	void CheckBruteForce( const Checker& Check )
+	{
+		const uint32_t kFishCounts[] = { 1000, BLOCK_SIZE * 8 };
+		const float kClusterScales[] = { 0.2f, 0.05f };
+		for (uint32_t NumFish : kFishCounts)
+			for (float ClusterScale : kClusterScales)
+				for (uint32_t Moved = 0; Moved < 2; ++Moved)
+				{
+					const SimulationCB CB = Moved ? GetMovedCB( NumFish ) : GetDefaultCB( NumFish );
+					std::vector<FishData> Fish = GenerateFish( CB, NumFish + Moved, ClusterScale );
+					BoidsEngine Engine;
+					Engine.SetISA( kBoidsScalar );
+					Engine.Init( CB, Fish.data() );
+					std::vector<FishData> Expected;
+					for (uint32_t Step = 0; Step < 2; ++Step)
+					{
+						// Each step starts from the grid's result, differences don't add up over steps
+						BruteForceStep( CB, std::vector<FishData>( Engine.GetFishData(), Engine.GetFishData() + NumFish ), Expected );
+						Engine.Step();
+						const float Diff = BoidsEngine::MaxDifference( Engine.GetFishData(), Expected.data(), NumFish );
+						Check( Diff <= kTolerance, "grid step " + std::to_string( Step + 1 ) + " of " + std::to_string( NumFish ) +
+							(Moved ? " moved" : "") + " fish at cluster scale " + std::to_string( ClusterScale ) +
+							" off brute force csmain by " + std::to_string( Diff ) );
+					}
+				}
+	}
+
+	void CheckISAs( const Checker& Check )
+	{
+		const SimulationCB CB = GetMovedCB( 20000 );
+		std::vector<FishData> Fish = GenerateFish( CB, 7, 0.2f );
+		BoidsEngine Scalar;
+		Scalar.SetISA( kBoidsScalar );
+		Scalar.Init( CB, Fish.data() );
+		Scalar.Step();
+		printf( "Kernels:" );
+		for (int ISA = kBoidsScalar + 1; ISA < kNumBoidsISA; ++ISA)
+		{
+			if (!IsBoidsISASupported( (BoidsISA)ISA ))
+				continue;
+			printf( " %s", GetBoidsISAName( (BoidsISA)ISA ) );
+			BoidsEngine Engine;
+			Engine.SetISA( (BoidsISA)ISA );
+			Check( Engine.GetISA() == ISA, std::string( GetBoidsISAName( (BoidsISA)ISA ) ) + " kernel picked when supported" );
+			Engine.Init( CB, Fish.data() );
+			Engine.Step();
+			const float Diff = BoidsEngine::MaxDifference( Engine.GetFishData(), Scalar.GetFishData(), CB.uNumInstance );
+			Check( Diff <= kTolerance, std::string( GetBoidsISAName( (BoidsISA)ISA ) ) + " kernel off scalar by " + std::to_string( Diff ) );
+		}
+		printf( " against Scalar\n" );
+
+		BoidsEngine Fallback;
+		for (int ISA = kBoidsScalar + 1; ISA < kNumBoidsISA; ++ISA)
+		{
+			if (IsBoidsISASupported( (BoidsISA)ISA ))
+				continue;
+			Fallback.SetISA( (BoidsISA)ISA );
+			Check( Fallback.GetISA() == kBoidsScalar, std::string( "unsupported " ) + GetBoidsISAName( (BoidsISA)ISA ) + " falls back to scalar" );
+		}
+	}
+
+	void CheckScheduler( uint32_t MaxThreads, uint32_t NumSteps, const Checker& Check )
+	{
+		// More fish than one task takes, so every thread gets work
+		const SimulationCB CB = GetMovedCB( 10000 );
+		std::vector<FishData> Fish = GenerateFish( CB, 11, 0.2f );
+		BoidsEngine Serial;
+		Serial.Init( CB, Fish.data() );
+		Serial.Step( NumSteps );
+		for (uint32_t NumThreads = 2; NumThreads <= MaxThreads; NumThreads *= 2)
+		{
+			TaskScheduler Scheduler;
+			Scheduler.Initialize( NumThreads );
+			BoidsEngine Parallel;
+			Parallel.SetTaskScheduler( &Scheduler );
+			Parallel.Init( CB, Fish.data() );
+			Parallel.Step( NumSteps );
+			const std::string Threads = " with " + std::to_string( NumThreads ) + " threads";
+			Check( memcmp( Parallel.GetFishData(), Serial.GetFishData(), sizeof( FishData ) * CB.uNumInstance ) == 0,
+				"scheduled steps bit-exact with inline ones" + Threads );
+			Check( Parallel.GetAvgNeighborCount() == Serial.GetAvgNeighborCount(), "neighbor count of all threads summed" + Threads );
+		}
+	}
+
+	void CheckReplay( const Checker& Check )
+	{
+		const char* kScratchPath = "BoidsReplayScratch.brpl";
+		SimulationCB CB = GetDefaultCB( 2000 );
+		std::vector<FishData> Fish( CB.uNumInstance );
+		BoidsEngine::GenerateFishData( CB, 5, BoidsReplay::kInitialClusterScale, Fish.data() );
+		BoidsEngine Engine;
+		Engine.SetISA( kBoidsScalar );
+		Engine.Init( CB, Fish.data() );
+		BoidsReplay Replay;
+		Replay.Begin( CB, 5, Engine.GetISA(), Engine.m_EmulateTilePadding );
+		for (uint32_t Step = 0; Step < 20; ++Step)
+		{
+			CB.fSeekingFactor = Step < 10 ? 0.2f : 2.f;
+			Engine.SetSimulationCB( CB );
+			Replay.RecordStep( CB );
+			Engine.Step();
+		}
+		const uint64_t Checksum = BoidsReplay::Checksum( Engine.GetFishData(), Engine.GetNumFish() );
+
+		const std::vector<std::string> FileNames( 1, kScratchPath );
+		Replay.SetChecksum( Checksum );
+		Check( Replay.Save( kScratchPath ), "replay saved" );
+		BoidsReplay::BatchResult Result = BoidsReplay::RunBatch( FileNames, nullptr )[0];
+		Check( Result.Loaded && Result.Verified && Result.Matched && Result.Checksum == Checksum, "replay plays back to its checksum" );
+
+		Replay.SetChecksum( Checksum ^ 1 );
+		Check( Replay.Save( kScratchPath ), "replay saved" );
+		Result = BoidsReplay::RunBatch( FileNames, nullptr )[0];
+		Check( Result.Verified && !Result.Matched, "wrong checksum is a mismatch" );
+
+		// What GPU runs save
+		Replay.SetChecksum( 0 );
+		Check( Replay.Save( kScratchPath ), "replay saved" );
+		Result = BoidsReplay::RunBatch( FileNames, nullptr )[0];
+		Check( Result.Loaded && !Result.Verified && !Result.Matched, "replay without checksum is not verified" );
+		remove( kScratchPath );
+	}
+}
+
+uint64_t RunBoidsEngineTests( int argc, char* argv[] )
+{
+	const uint32_t MaxThreads = GetCountArg( argc, argv, 1, (std::max)( 4u, std::thread::hardware_concurrency() ) );
+	const uint32_t NumSteps = GetCountArg( argc, argv, 2, 10 );
+	if (MaxThreads == 0 || NumSteps == 0)
+	{
+		fprintf( stderr, "Bad thread or step count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	const Checker Check( Failures, "boids-engine" );
+	CheckBruteForce( Check );
+	CheckISAs( Check );
+	CheckScheduler( MaxThreads, NumSteps, Check );
+	CheckReplay( Check );
+	return ReportFailures( Failures );
+}
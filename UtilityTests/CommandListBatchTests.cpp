@@ -0,0 +1,219 @@
+// CommandListBatch on a GpuQueue over a recording NullQueueBackend. A single-threaded batch checks
+// that empty slots are left out, owners are kept and only the last Set() reports the batch full.
+// Then command lists are recorded on up to MaxThreads threads, each filling interleaved slots so they
+// complete out of order, and every frame must go out as one submission on the next fence with its
+// lists in slot order. Also the benchmark against every thread submitting its own lists, where each
+// submission costs a fixed 10us on the submitting thread, roughly what the driver takes for
+// ExecuteCommandLists and Signal.
+
+#include "UtilityTests.h"
+#include "CommandListBatch.h"
+#include "GpuQueue.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	const uint32_t kListsPerThread = 4;
+	const uint32_t kNumFrames = 2000;
+	// Busy work standing in for recording one list
+	const uint32_t kRecordIterations = 256;
+	// Stand-in for the driver's cost of ExecuteCommandLists() plus Signal(), per call
+	const double kSubmitCostUs = 10.0;
+
+	class SubmitCostBackend : public NullQueueBackend
+	{
+	public:
+		SubmitCostBackend() :NullQueueBackend( 0 ) {}
+		virtual void ExecuteAndSignal( uint32_t NumLists, void* const* ppLists, uint64_t FenceValue ) override
+		{
+			auto Start = std::chrono::high_resolution_clock::now();
+			while (std::chrono::duration<double, std::micro>( std::chrono::high_resolution_clock::now() - Start ).count() < kSubmitCostUs)
+				;
+			NullQueueBackend::ExecuteAndSignal( NumLists, ppLists, FenceValue );
+		}
+	};
+
+	void* ListTag( uint32_t Frame, uint32_t Slot )
+	{
+		return (void*)((uintptr_t)Frame << 16 | (uintptr_t)(Slot + 1));
+	}
+
+	uint32_t Record( uint32_t Seed )
+	{
+		for (uint32_t i = 0; i < kRecordIterations; ++i)
+			Seed = Seed * 1664525u + 1013904223u;
+		return Seed;
+	}
+
+	void CheckBatch( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "command-list-batch" );
+
+		NullQueueBackend Backend( 0 );
+		GpuQueue Queue( 0 );
+		Queue.Create( &Backend );
+		CommandListBatch Batch;
+		int Owners[3];
+		Batch.Begin( 3 );
+		Check( !Batch.IsComplete(), "batch not complete before its slots are set" );
+		Check( !Batch.Set( 2, ListTag( 0, 2 ), &Owners[2] ), "filling a slot before the last doesn't report the batch full" );
+		Check( !Batch.Set( 1, nullptr, &Owners[1] ), "empty slot accepted" );
+		Check( Batch.Set( 0, ListTag( 0, 0 ), &Owners[0] ), "filling the last slot reports the batch full" );
+		Check( Batch.IsComplete(), "batch complete once every slot is set" );
+		Check( Batch.GetOwner( 1 ) == &Owners[1] && Batch.GetOwner( 2 ) == &Owners[2], "owners kept by slot" );
+		const uint64_t Expected = Queue.GetNextFenceValue();
+		Check( Batch.Submit( Queue ) == Expected, "submission signals the next fence" );
+		std::vector<NullQueueBackend::Submission> Submissions = Backend.GetSubmissions();
+		std::vector<void*> Lists = Backend.GetSubmittedLists();
+		Check( Submissions.size() == 1 && Submissions[0].NumLists == 2, "one submission without the empty slot" );
+		Check( Lists.size() == 2 && Lists[0] == ListTag( 0, 0 ) && Lists[1] == ListTag( 0, 2 ), "lists in slot order" );
+
+		Batch.Begin( 2 );
+		Batch.Set( 0, nullptr );
+		Batch.Set( 1, nullptr );
+		Check( Batch.Submit( Queue ) == 0, "batch of empty slots signals nothing" );
+		Check( Backend.GetSubmissions().size() == 1, "batch of empty slots not submitted" );
+		Queue.Destroy();
+	}
+
+	double RunBatched( uint32_t NumThreads, std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "command-list-batch", " with " + std::to_string( NumThreads ) + " threads" );
+
+		SubmitCostBackend Backend;
+		GpuQueue Queue( 0 );
+		Queue.Create( &Backend );
+		CommandListBatch Batch;
+		const uint32_t NumSlots = NumThreads * kListsPerThread;
+		// Frame open for recording plus one, bumped once the batch was begun
+		std::atomic<uint32_t> OpenFrame( 0 );
+		std::atomic<uint32_t> NumFull( 0 );
+		std::atomic<uint32_t> Sink( 0 );
+
+		auto RecordFrame = [&]( uint32_t ThreadIndex, uint32_t Frame )
+		{
+			uint32_t Seed = ThreadIndex;
+			for (uint32_t i = 0; i < kListsPerThread; ++i)
+			{
+				// Interleaved, so slots complete out of order
+				uint32_t Slot = i * NumThreads + ThreadIndex;
+				Seed = Record( Seed + Slot );
+				if (Batch.Set( Slot, ListTag( Frame, Slot ) ))
+					NumFull++;
+			}
+			Sink.fetch_add( Seed, std::memory_order_relaxed );
+		};
+		auto Worker = [&]( uint32_t ThreadIndex )
+		{
+			for (uint32_t Frame = 0; Frame < kNumFrames; ++Frame)
+			{
+				while (OpenFrame.load( std::memory_order_acquire ) != Frame + 1)
+					std::this_thread::yield();
+				RecordFrame( ThreadIndex, Frame );
+			}
+		};
+
+		auto Start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> Threads;
+		for (uint32_t i = 1; i < NumThreads; ++i)
+			Threads.emplace_back( Worker, i );
+		for (uint32_t Frame = 0; Frame < kNumFrames; ++Frame)
+		{
+			Batch.Begin( NumSlots );
+			OpenFrame.store( Frame + 1, std::memory_order_release );
+			RecordFrame( 0, Frame );
+			while (!Batch.IsComplete())
+				std::this_thread::yield();
+			Batch.Submit( Queue );
+		}
+		for (auto& Thread : Threads)
+			Thread.join();
+		std::chrono::duration<double> Elapsed = std::chrono::high_resolution_clock::now() - Start;
+
+		uint64_t NumOrderErrors = 0;
+		uint64_t NumFenceErrors = 0;
+		std::vector<NullQueueBackend::Submission> Submissions = Backend.GetSubmissions();
+		std::vector<void*> Lists = Backend.GetSubmittedLists();
+		for (uint32_t Frame = 0; Frame < (std::min)( (size_t)kNumFrames, Submissions.size() ); ++Frame)
+		{
+			const NullQueueBackend::Submission& Entry = Submissions[Frame];
+			if (Entry.FenceValue != Queue.GetInitialFence() + Frame + 1)
+				NumFenceErrors++;
+			if (Entry.NumLists != NumSlots)
+			{
+				NumOrderErrors++;
+				continue;
+			}
+			for (uint32_t Slot = 0; Slot < NumSlots; ++Slot)
+				if (Lists[Entry.FirstList + Slot] != ListTag( Frame, Slot ))
+					NumOrderErrors++;
+		}
+		Check( Submissions.size() == kNumFrames, "one submission per frame" );
+		Check( NumFenceErrors == 0, "every frame on the next fence" );
+		Check( NumOrderErrors == 0, "every list of a frame submitted in slot order" );
+		Check( NumFull == kNumFrames, "one Set() per frame reports the batch full" );
+		Queue.Destroy();
+		return (double)kNumFrames * NumSlots / (std::max)( Elapsed.count(), 1e-9 );
+	}
+
+	double RunSingle( uint32_t NumThreads )
+	{
+		SubmitCostBackend Backend;
+		Backend.SetRecording( false );
+		GpuQueue Queue( 0 );
+		Queue.Create( &Backend );
+		std::atomic<uint32_t> Sink( 0 );
+
+		auto Worker = [&]( uint32_t ThreadIndex )
+		{
+			uint32_t Seed = ThreadIndex;
+			for (uint32_t Frame = 0; Frame < kNumFrames; ++Frame)
+				for (uint32_t i = 0; i < kListsPerThread; ++i)
+				{
+					uint32_t Slot = i * NumThreads + ThreadIndex;
+					Seed = Record( Seed + Slot );
+					void* pList = ListTag( Frame, Slot );
+					Queue.Execute( 1, &pList );
+				}
+			Sink.fetch_add( Seed, std::memory_order_relaxed );
+		};
+
+		auto Start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> Threads;
+		for (uint32_t i = 1; i < NumThreads; ++i)
+			Threads.emplace_back( Worker, i );
+		Worker( 0 );
+		for (auto& Thread : Threads)
+			Thread.join();
+		std::chrono::duration<double> Elapsed = std::chrono::high_resolution_clock::now() - Start;
+		Queue.Destroy();
+		return (double)kNumFrames * NumThreads * kListsPerThread / (std::max)( Elapsed.count(), 1e-9 );
+	}
+}
+
+// [MaxThreads]
+uint64_t RunCommandListBatchTests( int argc, char* argv[] )
+{
+	const uint32_t MaxThreads = GetCountArg( argc, argv, 1, 8 );
+	if (MaxThreads == 0)
+	{
+		fprintf( stderr, "Bad thread count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckBatch( Failures );
+	printf( "%8s %18s %12s %18s\n", "Threads", "Batched Mlists/s", "Submits/s", "Single Mlists/s" );
+	// Thread counts double from 1 up to MaxThreads
+	for (uint32_t NumThreads = 1; NumThreads <= MaxThreads; NumThreads *= 2)
+	{
+		const double BatchedListsPerSec = RunBatched( NumThreads, Failures );
+		const double SingleListsPerSec = RunSingle( NumThreads );
+		printf( "%8u %18.3f %12.0f %18.3f\n", NumThreads, BatchedListsPerSec / 1e6,
+			BatchedListsPerSec / (NumThreads * kListsPerThread), SingleListsPerSec / 1e6 );
+	}
+	return ReportFailures( Failures );
+}
@@ -0,0 +1,181 @@
+// DescriptorBlockRing from many threads without a GPU. Every thread plays a recording context:
+// reserve a few blocks of random size, stamp each descriptor of them as its own, retire them on a new
+// fence. A stand-in GPU completes fences a few behind and only then frees the stamps, so a block
+// handed out over descriptors still in flight shows up as an overlap. Every block reserved must be
+// retired, and once the last fence completes the ring must be empty again. A small single-threaded
+// run checks that a block which doesn't fit in front of the heap end skips to the start.
+
+#include "UtilityTests.h"
+#include "DescriptorBlockRing.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <thread>
+
+namespace
+{
+	const uint32_t kCapacity = 1 << 14;
+	const uint32_t kMaxBlockSize = 512;
+	const uint32_t kMaxBlocksPerCmdList = 4;
+	const uint64_t kFencesInFlight = 4;
+
+	struct PendingBlock
+	{
+		DescriptorBlock		Block;
+		uint64_t			FenceValue;
+	};
+
+	void CheckStress( uint32_t NumThreads, uint32_t CmdListsPerThread, std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "descriptor-block-ring", " with " + std::to_string( NumThreads ) + " threads" );
+
+		FakeFences Fences;
+		DescriptorBlockRing Ring;
+		Ring.Create( kCapacity, &Fences );
+		// Thread stamp of every descriptor, 0 while free
+		std::unique_ptr<std::atomic<uint32_t>[]> Owners( new std::atomic<uint32_t>[kCapacity] );
+		for (uint32_t i = 0; i < kCapacity; ++i)
+			Owners[i] = 0;
+		std::atomic<uint64_t> NumOverlaps( 0 );
+		std::atomic<uint64_t> NumReserved( 0 );
+		std::atomic<uint64_t> NumRetired( 0 );
+
+		// The GPU: fences are handed out and completed under one lock, in order
+		std::mutex GpuMutex;
+		std::deque<PendingBlock> Pending;
+		uint64_t NextFence = 1;
+
+		auto Worker = [&]( uint32_t ThreadIndex )
+		{
+			const uint32_t Tag = ThreadIndex + 1;
+			uint32_t Random = 0x9e3779b9u * Tag;
+			for (uint32_t i = 0; i < CmdListsPerThread; ++i)
+			{
+				DescriptorBlock Blocks[kMaxBlocksPerCmdList];
+				uint32_t NumBlocks = 0;
+				uint32_t NumWanted = 1 + NextRandom( Random ) % kMaxBlocksPerCmdList;
+				for (uint32_t b = 0; b < NumWanted; ++b)
+				{
+					DescriptorBlock& Block = Blocks[NumBlocks];
+					if (!Ring.Reserve( 1 + NextRandom( Random ) % kMaxBlockSize, Block ))
+						continue;
+					NumBlocks++;
+					if (Block.Offset + Block.Count > kCapacity)
+					{
+						NumOverlaps++;
+						continue;
+					}
+					for (uint32_t d = Block.Offset; d < Block.Offset + Block.Count; ++d)
+					{
+						uint32_t Expected = 0;
+						if (!Owners[d].compare_exchange_strong( Expected, Tag, std::memory_order_relaxed ))
+							NumOverlaps++;
+					}
+				}
+				NumReserved += NumBlocks;
+
+				uint64_t FenceValue;
+				{
+					std::lock_guard<std::mutex> Lock( GpuMutex );
+					FenceValue = NextFence++;
+					for (uint32_t b = 0; b < NumBlocks; ++b)
+					{
+						PendingBlock Entry = { Blocks[b], FenceValue };
+						Pending.push_back( Entry );
+					}
+				}
+				Ring.Retire( Blocks, NumBlocks, FenceValue );
+				NumRetired += NumBlocks;
+
+				// Stand-in for the GPU, keeps a few fences in flight and frees stamps before completing
+				std::lock_guard<std::mutex> Lock( GpuMutex );
+				if (NextFence <= kFencesInFlight + 1)
+					continue;
+				const uint64_t Completed = NextFence - 1 - kFencesInFlight;
+				while (!Pending.empty() && Pending.front().FenceValue <= Completed)
+				{
+					const DescriptorBlock& Block = Pending.front().Block;
+					for (uint32_t d = Block.Offset; d < (std::min)( Block.Offset + Block.Count, kCapacity ); ++d)
+						Owners[d].store( 0, std::memory_order_relaxed );
+					Pending.pop_front();
+				}
+				Fences.Complete( Completed );
+			}
+		};
+
+		auto Start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> Threads;
+		for (uint32_t i = 1; i < NumThreads; ++i)
+			Threads.emplace_back( Worker, i );
+		Worker( 0 );
+		for (auto& Thread : Threads)
+			Thread.join();
+		std::chrono::duration<double> Elapsed = std::chrono::high_resolution_clock::now() - Start;
+
+		DescriptorBlockRingStats Stats = Ring.GetStats();
+		printf( "%7u %10.2f %8llu %8llu %9u\n", NumThreads, Stats.NumBlocks / (std::max)( Elapsed.count(), 1e-9 ) / 1e6,
+			(unsigned long long)Stats.NumFailed, (unsigned long long)NumOverlaps.load(), Stats.PeakUsed );
+
+		Check( NumOverlaps == 0, "no descriptor handed out twice" );
+		Check( Stats.NumBlocks == NumReserved, "blocks counted by the ring as reserved" );
+		Check( NumRetired == NumReserved, "every block reserved retired" );
+		Check( Stats.PeakUsed <= kCapacity, "peak within the capacity" );
+
+		// The last fences complete, everything reserved comes back
+		Fences.Complete( NextFence - 1 );
+		Ring.Reclaim();
+		Stats = Ring.GetStats();
+		Check( Stats.NumPendingBlocks == 0, "no retired block left once every fence completed" );
+		Check( Stats.NumUsed == 0, "ring empty once every fence completed" );
+		Ring.Destroy();
+	}
+
+	void CheckSkipToStart( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "descriptor-block-ring" );
+
+		FakeFences Fences;
+		DescriptorBlockRing Ring;
+		Ring.Create( 16, &Fences );
+		DescriptorBlock First, Second, Third;
+		Check( Ring.Reserve( 10, First ) && First.Offset == 0, "first block at the start" );
+		Check( !Ring.Reserve( 10, Second ), "reserve fails while the ring is full" );
+		Ring.Retire( &First, 1, 1 );
+		Check( !Ring.Reserve( 10, Second ), "reserve fails before the fence completes" );
+		Fences.Complete( 1 );
+		Check( Ring.Reserve( 10, Second ) && Second.Offset == 0 && Second.Count == 10, "block skips to the start" );
+		Check( Ring.GetStats().NumSkipped == 6, "skipped descriptors counted" );
+		Check( Ring.GetStats().NumUsed == 16, "skipped descriptors stay used until retired" );
+		Ring.Retire( &Second, 1, 2 );
+		Fences.Complete( 2 );
+		Check( Ring.Reserve( 6, Third ) && Third.Offset == 10, "next block right after the wrapped one" );
+		Ring.Retire( &Third, 1, 3 );
+		Fences.Complete( 3 );
+		Ring.Reclaim();
+		Check( Ring.GetStats().NumUsed == 0, "ring empty after the wrap" );
+		Check( Ring.GetStats().NumFailed == 2, "failed reserves counted" );
+		Ring.Destroy();
+	}
+}
+
+uint64_t RunDescriptorBlockRingTests( int argc, char* argv[] )
+{
+	const uint32_t MaxThreads = GetCountArg( argc, argv, 1, (std::max)( 4u, std::thread::hardware_concurrency() ) );
+	const uint32_t CmdListsPerThread = GetCountArg( argc, argv, 2, 20000 );
+	std::vector<std::string> Failures;
+	if (!MaxThreads || !CmdListsPerThread)
+		Failures.push_back( "descriptor-block-ring: MaxThreads and CmdListsPerThread must be counts" );
+
+	CheckSkipToStart( Failures );
+	if (MaxThreads && CmdListsPerThread)
+	{
+		printf( "Threads  Mblocks/s     Full Overlaps Peak Used\n" );
+		// Thread counts double from 1 up to MaxThreads
+		for (uint32_t NumThreads = 1; NumThreads <= MaxThreads; NumThreads *= 2)
+			CheckStress( NumThreads, CmdListsPerThread, Failures );
+	}
+	return ReportFailures( Failures );
+}
@@ -0,0 +1,238 @@
+// DescriptorHeapTierPolicy on its own. A command list which overflowed its heap must start the next
+// one a tier up, or higher to fit everything it allocated, and with GrowWithinFrame the heap taken
+// after the overflow already is. ShrinkFrames quiet command lists below half of the smaller tier
+// step down one, an overflow or a busier one in between starts the count over. Tiers stay within
+// the 1K/16K/64K sizes and MinTier/MaxTier, and the heap switches of a command list are counted until
+// it ends. Then random loads are driven through a fake heap like DynamicDescriptorHeap drives the
+// policy, with every step down checked against the command lists before it.
+
+#include "UtilityTests.h"
+#include "DescriptorHeapTierPolicy.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+namespace
+{
+	const uint32_t kLoadLevels[] = { 200, 900, 5000, 30000, 100000 };
+	const uint32_t kNumLoadLevels = sizeof( kLoadLevels ) / sizeof( kLoadLevels[0] );
+
+	// One command list of NumDescriptors, switching heaps like DynamicDescriptorHeap when full
+	void RunFrame( DescriptorHeapTierPolicy& Policy, uint32_t NumDescriptors, uint32_t ChunkSize = 64 )
+	{
+		uint32_t HeapSize = Policy.GetHeapSize();
+		uint32_t Offset = 0;
+		while (NumDescriptors > 0)
+		{
+			const uint32_t Count = (std::min)( ChunkSize, NumDescriptors );
+			if (Offset + Count > HeapSize)
+			{
+				Policy.OnHeapSwitch();
+				HeapSize = Policy.GetHeapSize();
+				Offset = 0;
+			}
+			Policy.OnAllocate( Count );
+			Offset += Count;
+			NumDescriptors -= Count;
+		}
+		Policy.EndFrame();
+	}
+
+	void CheckPromotion( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "descriptor-heap-tier-policy" );
+
+		DescriptorHeapTierPolicy Policy;
+		Check( Policy.GetHeapTier() == 0 && Policy.GetHeapSize() == 1024, "starts with the smallest tier" );
+		RunFrame( Policy, 1000 );
+		Check( Policy.GetHeapTier() == 0, "no promotion without an overflow" );
+
+		Policy.OnAllocate( 1024 );
+		Policy.OnHeapSwitch();
+		Check( Policy.GetNumHeapSwitches() == 1, "heap switch counted" );
+		Check( Policy.GetHeapTier() == 1, "heap taken after an overflow is a tier up" );
+		Policy.OnAllocate( 100 );
+		Policy.EndFrame();
+		Check( Policy.GetHeapTier() == 1 && Policy.GetHeapSize() == 16384, "promoted after an overflow" );
+		Check( Policy.GetNumHeapSwitches() == 0, "heap switches counted per command list" );
+
+		// 16K can't hold it, a single overflow goes straight to 64K
+		Policy.OnAllocate( 16384 );
+		Policy.OnHeapSwitch();
+		Policy.OnAllocate( 4000 );
+		Policy.EndFrame();
+		Check( Policy.GetHeapTier() == 2 && Policy.GetHeapSize() == 65536, "promoted to fit everything allocated" );
+
+		RunFrame( Policy, 200000 );
+		Check( Policy.GetHeapTier() == 2, "no tier above 64K" );
+
+		DescriptorHeapTierConfig Config;
+		Config.GrowWithinFrame = false;
+		DescriptorHeapTierPolicy Fixed( Config );
+		Fixed.OnAllocate( 1024 );
+		Fixed.OnHeapSwitch();
+		Fixed.OnHeapSwitch();
+		Check( Fixed.GetHeapTier() == 0 && Fixed.GetNumHeapSwitches() == 2, "without GrowWithinFrame the tier holds until the command list ends" );
+		Fixed.EndFrame();
+		Check( Fixed.GetHeapTier() == 1, "promoted a tier even when everything fit the old one" );
+	}
+
+	void CheckDecay( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "descriptor-heap-tier-policy" );
+
+		DescriptorHeapTierPolicy Policy;
+		const uint32_t ShrinkFrames = Policy.GetConfig().ShrinkFrames;
+		RunFrame( Policy, 100000 );
+		Check( Policy.GetHeapTier() == 2, "promoted to 64K" );
+
+		for (uint32_t i = 0; i < ShrinkFrames - 1; ++i)
+			RunFrame( Policy, 8192 );
+		Check( Policy.GetHeapTier() == 2, "no step down before ShrinkFrames quiet command lists" );
+		RunFrame( Policy, 8192 );
+		Check( Policy.GetHeapTier() == 1, "step down after ShrinkFrames command lists below half of 16K" );
+
+		for (uint32_t i = 0; i < ShrinkFrames; ++i)
+			RunFrame( Policy, 600 );
+		Check( Policy.GetHeapTier() == 1, "no step down while above half of 1K" );
+
+		for (uint32_t i = 0; i < ShrinkFrames / 2; ++i)
+			RunFrame( Policy, 100 );
+		RunFrame( Policy, 20000 );
+		Check( Policy.GetHeapTier() == 2, "overflow while quiet promotes again" );
+		for (uint32_t i = 0; i < ShrinkFrames - 1; ++i)
+			RunFrame( Policy, 100 );
+		Check( Policy.GetHeapTier() == 2, "overflow starts the quiet count over" );
+		RunFrame( Policy, 100 );
+		Check( Policy.GetHeapTier() == 1, "one tier down at a time" );
+		for (uint32_t i = 0; i < ShrinkFrames; ++i)
+			RunFrame( Policy, 100 );
+		Check( Policy.GetHeapTier() == 0, "back to 1K" );
+		for (uint32_t i = 0; i < ShrinkFrames; ++i)
+			RunFrame( Policy, 0 );
+		Check( Policy.GetHeapTier() == 0, "no tier below 1K" );
+
+		DescriptorHeapTierConfig Config;
+		Config.MinTier = 1;
+		Config.MaxTier = 1;
+		DescriptorHeapTierPolicy Fixed( Config );
+		Check( Fixed.GetHeapSize() == 16384, "starts at MinTier" );
+		RunFrame( Fixed, 100000 );
+		Check( Fixed.GetHeapTier() == 1, "no promotion above MaxTier" );
+		for (uint32_t i = 0; i < ShrinkFrames; ++i)
+			RunFrame( Fixed, 0 );
+		Check( Fixed.GetHeapTier() == 1, "no step down below MinTier" );
+	}
+
+	// Phases of random load, every command list checked against the policy's promises
+	void CheckRandom( uint32_t NumFrames, const DescriptorHeapTierConfig& Config, std::vector<std::string>& Failures )
+	{
+		uint64_t NumSizeErrors = 0;
+		uint64_t NumSwitchErrors = 0;
+		uint64_t NumPromotionErrors = 0;
+		uint64_t NumDecayErrors = 0;
+
+		struct FrameRecord
+		{
+			uint32_t	Tier;
+			uint32_t	NumDescriptors;
+			bool		Overflowed;
+		};
+		std::vector<FrameRecord> History;
+		DescriptorHeapTierPolicy Policy( Config );
+		uint32_t Seed = 1;
+		uint32_t Level = 0;
+		uint32_t PhaseFrames = 0;
+		for (uint32_t Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			if (PhaseFrames-- == 0)
+			{
+				Level = kLoadLevels[NextRandom( Seed ) % kNumLoadLevels];
+				PhaseFrames = 50 + NextRandom( Seed ) % 250;
+			}
+			const uint32_t Tier = Policy.GetHeapTier();
+			uint32_t NumDescriptors = Level / 2 + NextRandom( Seed ) % Level;
+			const FrameRecord Record = { Tier, NumDescriptors, false };
+			History.push_back( Record );
+
+			uint32_t HeapSize = Policy.GetHeapSize();
+			uint32_t Offset = 0;
+			uint32_t NumSwitches = 0;
+			while (NumDescriptors > 0)
+			{
+				const uint32_t Count = (std::min)( 1 + NextRandom( Seed ) % 64, NumDescriptors );
+				if (Offset + Count > HeapSize)
+				{
+					Policy.OnHeapSwitch();
+					NumSwitches++;
+					const uint32_t Expected = Config.GrowWithinFrame ? (std::min)( Tier + NumSwitches, Config.MaxTier ) : Tier;
+					if (Policy.GetHeapTier() != Expected)
+						NumPromotionErrors++;
+					HeapSize = Policy.GetHeapSize();
+					Offset = 0;
+				}
+				Policy.OnAllocate( Count );
+				Offset += Count;
+				NumDescriptors -= Count;
+			}
+			if (Policy.GetNumHeapSwitches() != NumSwitches)
+				NumSwitchErrors++;
+			Policy.EndFrame();
+			History.back().Overflowed = NumSwitches > 0;
+
+			const uint32_t NewTier = Policy.GetHeapTier();
+			if (NewTier < Config.MinTier || NewTier > Config.MaxTier || Policy.GetHeapSize() != Config.TierSizes[NewTier] ||
+				Policy.GetNumHeapSwitches() != 0)
+				NumSizeErrors++;
+			if (NumSwitches > 0)
+			{
+				if (NewTier != Config.MaxTier && (NewTier <= Tier || Config.TierSizes[NewTier] < Record.NumDescriptors))
+					NumPromotionErrors++;
+			}
+			else if (NewTier > Tier)
+				NumPromotionErrors++;
+			else if (NewTier < Tier)
+			{
+				// The last ShrinkFrames command lists were all quiet at this tier and fit half the new one
+				if (NewTier + 1 != Tier || History.size() < Config.ShrinkFrames)
+					NumDecayErrors++;
+				else
+					for (size_t i = History.size() - Config.ShrinkFrames; i < History.size(); ++i)
+						if (History[i].Overflowed || History[i].Tier != Tier || History[i].NumDescriptors > Config.TierSizes[NewTier] / 2)
+							NumDecayErrors++;
+			}
+		}
+
+		const std::string Suffix = std::string( " with GrowWithinFrame " ) + (Config.GrowWithinFrame ? "on" : "off") +
+			" and ShrinkFrames " + std::to_string( Config.ShrinkFrames );
+		if (NumSizeErrors)
+			Failures.push_back( "descriptor-heap-tier-policy: tier outside MinTier/MaxTier or its size" + Suffix );
+		if (NumSwitchErrors)
+			Failures.push_back( "descriptor-heap-tier-policy: heap switches of a command list" + Suffix );
+		if (NumPromotionErrors)
+			Failures.push_back( "descriptor-heap-tier-policy: promotion after an overflow" + Suffix );
+		if (NumDecayErrors)
+			Failures.push_back( "descriptor-heap-tier-policy: step down" + Suffix );
+	}
+}
+
+// [NumFrames]
+uint64_t RunDescriptorHeapTierPolicyTests( int argc, char* argv[] )
+{
+	const uint32_t NumFrames = GetCountArg( argc, argv, 1, 20000 );
+	if (NumFrames == 0)
+	{
+		fprintf( stderr, "Bad frame count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckPromotion( Failures );
+	CheckDecay( Failures );
+	DescriptorHeapTierConfig Config;
+	CheckRandom( NumFrames, Config, Failures );
+	Config.GrowWithinFrame = false;
+	Config.ShrinkFrames = 8;
+	CheckRandom( NumFrames, Config, Failures );
+	printf( "%u random command lists, twice\n", NumFrames );
+	return ReportFailures( Failures );
+}
@@ -0,0 +1,322 @@
+// DescriptorRangeAllocator and DescriptorRangeChain against a reference bitmap of which descriptors
+// are in use: random allocations and frees, each range checked to be free, inside its heap and given
+// whenever a long enough free run exists, the stats checked against the runs of the bitmap. Frees of
+// ranges which are already free, or partly so, are run in a child process and must assert.
+
+#include "UtilityTests.h"
+#include "DescriptorRangeAllocator.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <functional>
+
+namespace
+{
+	// Mostly small ranges, now and then up to Capacity
+	uint32_t RandomCount( uint32_t& Seed, uint32_t Capacity )
+	{
+		const uint32_t Kind = NextRandom( Seed ) % 16;
+		const uint32_t Max = Kind == 0 ? Capacity : Kind < 4 ? 64 : 8;
+		return 1 + NextRandom( Seed ) % (Max < Capacity ? Max : Capacity);
+	}
+
+	struct BitmapRuns
+	{
+		uint32_t	NumUsed;
+		uint32_t	NumFreeRuns;
+		uint32_t	LongestFreeRun;
+	};
+
+	BitmapRuns GetRuns( const std::vector<bool>& Used )
+	{
+		BitmapRuns Runs = {};
+		uint32_t Run = 0;
+		for (size_t i = 0; i <= Used.size(); ++i)
+		{
+			if (i < Used.size() && !Used[i])
+			{
+				Run++;
+				continue;
+			}
+			if (Run)
+			{
+				Runs.NumFreeRuns++;
+				if (Run > Runs.LongestFreeRun)
+					Runs.LongestFreeRun = Run;
+			}
+			Run = 0;
+			if (i < Used.size())
+				Runs.NumUsed++;
+		}
+		return Runs;
+	}
+
+	bool IsFree( const std::vector<bool>& Used, uint32_t Offset, uint32_t Count )
+	{
+		for (uint32_t i = Offset; i < Offset + Count; ++i)
+		{
+			if (Used[i])
+				return false;
+		}
+		return true;
+	}
+
+	void Mark( std::vector<bool>& Used, uint32_t Offset, uint32_t Count, bool Value )
+	{
+		for (uint32_t i = Offset; i < Offset + Count; ++i)
+			Used[i] = Value;
+	}
+
+	struct Range
+	{
+		uint64_t	Begin;			// Offset for the allocator, handle for the chain
+		uint32_t	Count;
+	};
+
+	void CheckAllocator( uint32_t NumOps, std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "allocator" );
+
+		const uint32_t Capacity = 1000;
+		DescriptorRangeAllocator Allocator;
+		Allocator.Create( Capacity );
+		std::vector<bool> Used( Capacity, false );
+		std::vector<Range> Live;
+		uint32_t Seed = 7;
+		uint32_t NumFailedAllocs = 0;
+
+		for (uint32_t Op = 0; Op < NumOps && Failures.empty(); ++Op)
+		{
+			if (Live.empty() || NextRandom( Seed ) % 100 < 55)
+			{
+				const uint32_t Count = RandomCount( Seed, Capacity );
+				const uint32_t Offset = Allocator.Allocate( Count );
+				if (Offset == DescriptorRangeAllocator::kInvalidOffset)
+				{
+					Check( GetRuns( Used ).LongestFreeRun < Count, "failed with a long enough free run left" );
+					NumFailedAllocs++;
+					continue;
+				}
+				if (!Check( Offset + Count <= Capacity, "range past the capacity" ) ||
+					!Check( IsFree( Used, Offset, Count ), "range overlaps one in use" ))
+					break;
+				Mark( Used, Offset, Count, true );
+				Live.push_back( { Offset, Count } );
+			}
+			else
+			{
+				const size_t Index = NextRandom( Seed ) % Live.size();
+				Allocator.Free( (uint32_t)Live[Index].Begin, Live[Index].Count );
+				Mark( Used, (uint32_t)Live[Index].Begin, Live[Index].Count, false );
+				Live[Index] = Live.back();
+				Live.pop_back();
+			}
+
+			if (Op % 64 == 0)
+			{
+				// Frees merge right away, so free ranges are exactly the free runs of the bitmap
+				const BitmapRuns Runs = GetRuns( Used );
+				const DescriptorRangeStats Stats = Allocator.GetStats();
+				Check( Stats.NumUsed == Runs.NumUsed && Allocator.GetNumUsed() == Runs.NumUsed, "used count" );
+				Check( Stats.NumFreeRanges == Runs.NumFreeRuns, "free ranges not merged" );
+				Check( Stats.LargestFreeRange == Runs.LongestFreeRun, "largest free range" );
+			}
+		}
+		Check( NumFailedAllocs > 0, "never full, the run didn't test failing allocations" );
+
+		for (auto& R : Live)
+			Allocator.Free( (uint32_t)R.Begin, R.Count );
+		const DescriptorRangeStats Stats = Allocator.GetStats();
+		Check( Stats.NumUsed == 0 && Stats.NumFreeRanges == 1 && Stats.LargestFreeRange == Capacity, "all freed" );
+		Check( Allocator.Allocate( Capacity ) == 0, "whole capacity once empty" );
+		Allocator.Reset();
+		Check( Allocator.IsEmpty() && Allocator.GetStats().LargestFreeRange == Capacity, "reset" );
+	}
+
+	void CheckChain( uint32_t NumOps, std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "chain" );
+
+		// Bases of made up heaps, far apart and not in order
+		const uint32_t Capacity = 256;
+		const uint32_t Increment = 32;
+		auto GetBase = []( uint32_t Heap ) { return ((uint64_t)(Heap * 7919 % 65521) + 1) << 24; };
+
+		std::vector<std::vector<bool>> Used;
+		DescriptorRangeChain Chain;
+		uint32_t NumCreated = 0;
+		Chain.Create( Capacity, Increment, [&]( uint32_t Heap )
+		{
+			Check( Heap == NumCreated, "heaps not created in order" );
+			NumCreated++;
+			Used.push_back( std::vector<bool>( Capacity, false ) );
+			return GetBase( Heap );
+		} );
+		Check( Chain.GetNumHeaps() == 1 && NumCreated == 1, "first heap" );
+
+		std::vector<Range> Live;
+		uint32_t Seed = 11;
+		uint32_t NumUsed = 0;
+		uint32_t NumWholeHeaps = 0;
+
+		for (uint32_t Op = 0; Op < NumOps && Failures.empty(); ++Op)
+		{
+			// Hovers around 6 heaps worth in use, so freed holes get reused rather than heaps chained forever
+			if (Live.empty() || NextRandom( Seed ) % 100 < (NumUsed < 6 * Capacity ? 60u : 40u))
+			{
+				const uint32_t Count = RandomCount( Seed, Capacity );
+				const uint32_t NumHeaps = Chain.GetNumHeaps();
+				// First fit over the heaps, chaining one only when none has a long enough run
+				uint32_t Expected = NumHeaps;
+				for (uint32_t i = 0; i < NumHeaps && Expected == NumHeaps; ++i)
+				{
+					if (GetRuns( Used[i] ).LongestFreeRun >= Count)
+						Expected = i;
+				}
+
+				uint32_t Heap = ~0u;
+				const uint64_t Handle = Chain.Allocate( Count, &Heap );
+				if (!Check( Heap == Expected, "not the first heap with room" ) ||
+					!Check( Chain.GetNumHeaps() == (Expected == NumHeaps ? NumHeaps + 1 : NumHeaps), "heap chained when not needed" ) ||
+					!Check( Chain.FindHeap( Handle ) == (int)Heap, "handle not in the heap it was given from" ) ||
+					!Check( Handle >= GetBase( Heap ) && (Handle - GetBase( Heap )) % Increment == 0, "handle not on a descriptor" ))
+					break;
+				const uint32_t Offset = (uint32_t)((Handle - GetBase( Heap )) / Increment);
+				if (!Check( Offset + Count <= Capacity, "range straddles two heaps" ) ||
+					!Check( IsFree( Used[Heap], Offset, Count ), "range overlaps one in use" ))
+					break;
+				Mark( Used[Heap], Offset, Count, true );
+				Live.push_back( { Handle, Count } );
+				NumUsed += Count;
+				NumWholeHeaps += Count == Capacity;
+			}
+			else
+			{
+				const size_t Index = NextRandom( Seed ) % Live.size();
+				const Range R = Live[Index];
+				const uint32_t Heap = (uint32_t)Chain.FindHeap( R.Begin );
+				Chain.Free( R.Begin, R.Count );
+				Mark( Used[Heap], (uint32_t)((R.Begin - GetBase( Heap )) / Increment), R.Count, false );
+				Live[Index] = Live.back();
+				Live.pop_back();
+				NumUsed -= R.Count;
+			}
+
+			if (Op % 64 == 0)
+			{
+				Check( Chain.GetNumUsed() == NumUsed, "used count" );
+				for (uint32_t i = 0; i < Chain.GetNumHeaps(); ++i)
+				{
+					const BitmapRuns Runs = GetRuns( Used[i] );
+					const DescriptorRangeStats Stats = Chain.GetHeapStats( i );
+					Check( Stats.NumUsed == Runs.NumUsed && Stats.NumFreeRanges == Runs.NumFreeRuns &&
+						Stats.LargestFreeRange == Runs.LongestFreeRun, "heap stats" );
+				}
+			}
+		}
+		Check( Chain.GetNumHeaps() > 2, "never chained more than one heap" );
+		Check( NumWholeHeaps > 0, "never allocated a whole heap" );
+		Check( Chain.FindHeap( GetBase( 0 ) - Increment ) == -1 &&
+			Chain.FindHeap( GetBase( 0 ) + (uint64_t)Capacity * Increment ) == -1, "handle outside every heap found" );
+
+		const uint32_t NumHeaps = Chain.GetNumHeaps();
+		Chain.Reset();
+		Check( Chain.GetNumUsed() == 0 && Chain.GetNumHeaps() == NumHeaps, "reset" );
+		uint32_t Heap = ~0u;
+		Check( Chain.Allocate( Capacity, &Heap ) == GetBase( 0 ) && Heap == 0, "whole first heap once reset" );
+	}
+
+	// Runs Body in a child process, true if it died of an assert
+	bool Asserts( const std::function<void()>& Body )
+	{
+		fflush( stdout );
+		const pid_t Child = fork();
+		if (Child == 0)
+		{
+			freopen( "/dev/null", "w", stderr );
+			Body();
+			_exit( 0 );
+		}
+		int Status = 0;
+		if (Child < 0 || waitpid( Child, &Status, 0 ) != Child)
+			return false;
+		return WIFSIGNALED( Status ) && WTERMSIG( Status ) == SIGABRT;
+	}
+
+	void CheckDoubleFrees( std::vector<std::string>& Failures )
+	{
+#ifdef NDEBUG
+		printf( "Double free checks skipped, asserts are compiled out\n" );
+		(void)Failures;
+#else
+		const Checker Check( Failures, "double free" );
+
+		Check( Asserts( []
+		{
+			DescriptorRangeAllocator Allocator;
+			Allocator.Create( 16 );
+			Allocator.Allocate( 4 );
+			const uint32_t Offset = Allocator.Allocate( 4 );
+			Allocator.Allocate( 4 );
+			Allocator.Free( Offset, 4 );
+			Allocator.Free( Offset, 4 );
+		} ), "same range twice" );
+		Check( Asserts( []
+		{
+			DescriptorRangeAllocator Allocator;
+			Allocator.Create( 16 );
+			Allocator.Allocate( 8 );
+			Allocator.Free( 0, 4 );
+			Allocator.Free( 2, 4 );
+		} ), "range overlapping the end of a free range" );
+		Check( Asserts( []
+		{
+			DescriptorRangeAllocator Allocator;
+			Allocator.Create( 16 );
+			Allocator.Allocate( 8 );
+			Allocator.Free( 4, 4 );
+			Allocator.Free( 2, 4 );
+		} ), "range overlapping the start of a free range" );
+		Check( Asserts( []
+		{
+			DescriptorRangeAllocator Allocator;
+			Allocator.Create( 16 );
+			Allocator.Free( 0, 1 );
+		} ), "range of an empty allocator" );
+		Check( Asserts( []
+		{
+			DescriptorRangeChain Chain;
+			Chain.Create( 16, 8, []( uint32_t Heap ) { return (uint64_t)(Heap + 1) << 20; } );
+			Chain.Allocate( 4 );
+			Chain.Free( 1ull << 30, 4 );
+		} ), "handle outside every heap" );
+		Check( !Asserts( []
+		{
+			DescriptorRangeAllocator Allocator;
+			Allocator.Create( 16 );
+			const uint32_t Offset = Allocator.Allocate( 4 );
+			Allocator.Free( Offset, 4 );
+		} ), "asserted on a single free" );
+#endif
+	}
+}
+
+// [NumOps]
+uint64_t RunDescriptorRangeAllocatorTests( int argc, char* argv[] )
+{
+	const uint32_t NumOps = GetCountArg( argc, argv, 1, 200000 );
+	if (NumOps == 0)
+	{
+		fprintf( stderr, "Bad op count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckAllocator( NumOps, Failures );
+	CheckChain( NumOps, Failures );
+	CheckDoubleFrees( Failures );
+	printf( "%u random allocations and frees each on one heap and on a chain of heaps\n", NumOps );
+	return ReportFailures( Failures );
+}
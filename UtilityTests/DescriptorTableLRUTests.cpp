@@ -0,0 +1,222 @@
+// DescriptorTableLRU driven like DynamicDescriptorHeap drives it, with a fake shader-visible heap and
+// copier: a staged table is looked up first, and on a miss its assigned handles are copied to the
+// next free slots of the heap and inserted. Taking another heap bumps the generation and starts over
+// on the same slots, as a recycled heap would. Every hit must point at slots holding exactly the
+// staged handles, copied in the current generation. Eviction order, hash collisions and generations
+// taking precedence when evicting are checked on their own.
+
+#include "UtilityTests.h"
+#include "DescriptorTableLRU.h"
+
+#include <stdio.h>
+
+namespace
+{
+	const uint64_t kHeapGpuBase = 1ull << 32;
+	const uint32_t kDescriptorSize = 32;
+
+	// The shader-visible heap: which CPU handle was copied to each slot, and in which generation
+	class FakeHeap
+	{
+	public:
+		FakeHeap( uint32_t NumSlots ) :m_Slots( NumSlots, 0 ), m_SlotGenerations( NumSlots, 0 ), m_Offset( 0 ), m_Generation( 1 ) {}
+
+		bool HasSpace( uint32_t Count ) const { return m_Offset + Count <= m_Slots.size(); }
+		void SwitchHeap()
+		{
+			m_Offset = 0;
+			m_Generation++;
+		}
+		// Unassigned slots, handle 0, are skipped like CopyAndBindStaleTables() skips them
+		uint64_t Copy( const uint64_t* Handles, uint32_t Count )
+		{
+			const uint64_t GpuHandle = kHeapGpuBase + (uint64_t)m_Offset * kDescriptorSize;
+			for (uint32_t i = 0; i < Count; ++i)
+			{
+				if (Handles[i] == 0)
+					continue;
+				m_Slots[m_Offset + i] = Handles[i];
+				m_SlotGenerations[m_Offset + i] = m_Generation;
+			}
+			m_Offset += Count;
+			return GpuHandle;
+		}
+		// The slots at GpuHandle hold every assigned handle of the table, copied in this generation
+		bool Holds( uint64_t GpuHandle, const uint64_t* Handles, uint32_t Count ) const
+		{
+			if (GpuHandle < kHeapGpuBase || (GpuHandle - kHeapGpuBase) % kDescriptorSize != 0)
+				return false;
+			const uint64_t Offset = (GpuHandle - kHeapGpuBase) / kDescriptorSize;
+			if (Offset + Count > m_Slots.size())
+				return false;
+			for (uint32_t i = 0; i < Count; ++i)
+			{
+				if (Handles[i] != 0 && (m_Slots[Offset + i] != Handles[i] || m_SlotGenerations[Offset + i] != m_Generation))
+					return false;
+			}
+			return true;
+		}
+		uint64_t GetGeneration() const { return m_Generation; }
+
+	private:
+		std::vector<uint64_t>	m_Slots;
+		std::vector<uint64_t>	m_SlotGenerations;
+		uint32_t				m_Offset;
+		uint64_t				m_Generation;
+	};
+
+	// Binds a staged table, returns true on a hit
+	bool Bind( DescriptorTableLRU& LRU, FakeHeap& Heap, const uint64_t* Handles, uint32_t Count, uint64_t& GpuHandle )
+	{
+		const uint64_t Hash = DescriptorTableLRU::HashTable( Handles, Count );
+		if (LRU.Find( Hash, Heap.GetGeneration(), Handles, Count, GpuHandle ))
+			return true;
+		if (!Heap.HasSpace( Count ))
+			Heap.SwitchHeap();
+		GpuHandle = Heap.Copy( Handles, Count );
+		LRU.Insert( Hash, Heap.GetGeneration(), Handles, Count, GpuHandle );
+		return false;
+	}
+
+	void CheckRandom( uint32_t NumBinds, std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "random" );
+
+		// A working set a little larger than the LRU, so there are hits, evictions and misses
+		const uint32_t kNumTables = DescriptorTableLRU::kNumEntries + 8;
+		const uint32_t kMaxTableSize = 32;
+		std::vector<std::vector<uint64_t>> Tables( kNumTables );
+		uint32_t Seed = 3;
+		auto NewTable = [&]( std::vector<uint64_t>& Table )
+		{
+			Table.resize( 1 + NextRandom( Seed ) % kMaxTableSize );
+			for (auto& Handle : Table)
+				Handle = NextRandom( Seed ) % 8 == 0 ? 0 : 0x1000 + (uint64_t)(NextRandom( Seed ) % 256) * kDescriptorSize;
+			Table.back() = 0x1000;		// The last slot of a table is always assigned
+		};
+		for (auto& Table : Tables)
+			NewTable( Table );
+
+		DescriptorTableLRU LRU;
+		FakeHeap Heap( 1024 );
+		uint64_t NumHits = 0;
+		for (uint32_t i = 0; i < NumBinds && Failures.empty(); ++i)
+		{
+			std::vector<uint64_t>& Table = Tables[NextRandom( Seed ) % (NextRandom( Seed ) % 4 == 0 ? kNumTables : 8)];
+			// Now and then a table is staged with one handle changed, or replaced
+			const uint32_t Change = NextRandom( Seed ) % 64;
+			if (Change == 0)
+				NewTable( Table );
+			else if (Change == 1)
+				Table[NextRandom( Seed ) % Table.size()] += kDescriptorSize;
+
+			const uint64_t Generation = Heap.GetGeneration();
+			uint64_t GpuHandle = 0;
+			if (Bind( LRU, Heap, Table.data(), (uint32_t)Table.size(), GpuHandle ))
+			{
+				NumHits++;
+				Check( Heap.Holds( GpuHandle, Table.data(), (uint32_t)Table.size() ), "hit on slots not holding the staged handles" );
+				Check( Heap.GetGeneration() == Generation, "hit took another heap" );
+			}
+			else
+				Check( Heap.Holds( GpuHandle, Table.data(), (uint32_t)Table.size() ), "copy" );
+		}
+		Check( NumHits > NumBinds / 4 && NumHits < NumBinds, "hit rate not in between" );
+		Check( LRU.GetNumHits() == NumHits && LRU.GetNumHits() + LRU.GetNumMisses() == NumBinds, "counters" );
+		Check( Heap.GetGeneration() > 10, "too few heap switches" );
+	}
+
+	void CheckGenerations( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "generations" );
+
+		DescriptorTableLRU LRU;
+		const uint64_t Table[3] = { 0x1000, 0, 0x1040 };
+		const uint64_t Hash = DescriptorTableLRU::HashTable( Table, 3 );
+		uint64_t GpuHandle = 0;
+		LRU.Insert( Hash, 1, Table, 3, kHeapGpuBase );
+		Check( LRU.Find( Hash, 1, Table, 3, GpuHandle ) && GpuHandle == kHeapGpuBase, "hit in the same generation" );
+		Check( !LRU.Find( Hash, 2, Table, 3, GpuHandle ), "hit in another generation" );
+
+		// Fill up with generation 1, then move all but the last entry to generation 2. The entry left of
+		// generation 1 is the most recently used and still the one evicted.
+		auto Handle = []( uint32_t i ) { return 0x2000 + (uint64_t)i * kDescriptorSize; };
+		auto Insert = [&]( uint32_t i, uint64_t Generation )
+		{
+			const uint64_t Other[1] = { Handle( i ) };
+			LRU.Insert( DescriptorTableLRU::HashTable( Other, 1 ), Generation, Other, 1, kHeapGpuBase + Handle( i ) );
+		};
+		auto Find = [&]( uint32_t i, uint64_t Generation )
+		{
+			const uint64_t Other[1] = { Handle( i ) };
+			return LRU.Find( DescriptorTableLRU::HashTable( Other, 1 ), Generation, Other, 1, GpuHandle );
+		};
+		LRU.Clear();
+		const uint32_t kLast = DescriptorTableLRU::kNumEntries - 1;
+		for (uint32_t i = 0; i <= kLast; ++i)
+			Insert( i, 1 );
+		for (uint32_t i = 0; i < kLast; ++i)
+			Insert( 100 + i, 2 );
+		Check( Find( kLast, 1 ) && !Find( 0, 1 ), "entries of an older heap not replaced first" );
+		Insert( 200, 2 );
+		Check( !Find( kLast, 1 ), "entry of an older heap kept" );
+		Check( Find( 100, 2 ) && Find( 200, 2 ), "entry of the current heap evicted" );
+		const uint64_t Newest[1] = { Handle( 200 ) };
+
+		LRU.Clear();
+		Check( !LRU.Find( DescriptorTableLRU::HashTable( Newest, 1 ), 2, Newest, 1, GpuHandle ), "hit once cleared" );
+	}
+
+	void CheckEviction( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "eviction" );
+
+		DescriptorTableLRU LRU;
+		uint64_t GpuHandle = 0;
+		auto Handle = []( uint32_t i ) { return 0x1000 + (uint64_t)i * kDescriptorSize; };
+		auto Find = [&]( uint32_t i )
+		{
+			const uint64_t Table[1] = { Handle( i ) };
+			return LRU.Find( DescriptorTableLRU::HashTable( Table, 1 ), 1, Table, 1, GpuHandle ) && GpuHandle == kHeapGpuBase + Handle( i );
+		};
+		auto Insert = [&]( uint32_t i )
+		{
+			const uint64_t Table[1] = { Handle( i ) };
+			LRU.Insert( DescriptorTableLRU::HashTable( Table, 1 ), 1, Table, 1, kHeapGpuBase + Handle( i ) );
+		};
+
+		for (uint32_t i = 0; i < DescriptorTableLRU::kNumEntries; ++i)
+			Insert( i );
+		// Table 0 used again, so table 1 is the least recently used
+		Check( Find( 0 ), "hit" );
+		Insert( DescriptorTableLRU::kNumEntries );
+		Check( !Find( 1 ), "least recently used entry kept" );
+		Check( Find( 0 ) && Find( 2 ) && Find( DescriptorTableLRU::kNumEntries ), "recently used entry evicted" );
+
+		// Same hash and count, other handles: a collision is a miss
+		const uint64_t Table[2] = { 0x5000, 0x5020 };
+		const uint64_t Colliding[2] = { 0x5000, 0x5040 };
+		const uint64_t Hash = DescriptorTableLRU::HashTable( Table, 2 );
+		LRU.Insert( Hash, 1, Table, 2, kHeapGpuBase );
+		Check( !LRU.Find( Hash, 1, Colliding, 2, GpuHandle ), "hash collision hit" );
+		Check( !LRU.Find( Hash, 1, Table, 1, GpuHandle ), "shorter table hit" );
+		Check( LRU.Find( Hash, 1, Table, 2, GpuHandle ), "table itself missed" );
+	}
+}
+
+// [NumBinds]
+uint64_t RunDescriptorTableLRUTests( int argc, char* argv[] )
+{
+	const uint32_t NumBinds = GetCountArg( argc, argv, 1, 200000 );
+	if (NumBinds == 0)
+	{
+		fprintf( stderr, "Bad bind count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckGenerations( Failures );
+	CheckEviction( Failures );
+	CheckRandom( NumBinds, Failures );
+	printf( "%u random table binds through a fake heap\n", NumBinds );
+	return ReportFailures( Failures );
+}
@@ -0,0 +1,310 @@
+// FenceNotifier over queues whose fences the test completes by hand: callbacks on a completed fence
+// run inline, the others on the notifier thread once their fence completed, in fence order and after
+// the listeners; a fence completed before Stop() still has its callback run, the rest are dropped.
+// Then how late callbacks run after their fence completed on the wall clock, next to a thread
+// blocking in WaitForFence(), which is what every caller did before. A callback which never ran
+// fails the area.
+
+#include "UtilityTests.h"
+#include "FenceNotifier.h"
+#include "GpuQueue.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const uint64_t kFenceCountMask = (1ull << 56) - 1;
+
+	// Fences complete when the test says so
+	class ManualBackend : public IGpuQueueBackend
+	{
+	public:
+		explicit ManualBackend( uint64_t InitialFence ) :m_Completed( InitialFence ) {}
+		virtual void ExecuteAndSignal( uint32_t, void* const*, uint64_t ) override {}
+		virtual void Signal( uint64_t ) override {}
+		virtual void GpuWait( uint64_t ) override {}
+		virtual uint64_t GetCompletedFence() override { return m_Completed.load( std::memory_order_acquire ); }
+		virtual void WaitForFence( uint64_t FenceValue ) override
+		{
+			while (GetCompletedFence() < FenceValue)
+				std::this_thread::yield();
+		}
+		void Complete( uint64_t FenceValue ) { m_Completed.store( FenceValue, std::memory_order_release ); }
+
+	private:
+		std::atomic<uint64_t>	m_Completed;
+	};
+
+	// Submissions run back to back on the wall clock, WorkUs per command list
+	class WallClockBackend : public IGpuQueueBackend
+	{
+	public:
+		explicit WallClockBackend( double WorkUs )
+			:m_WorkUs( WorkUs ), m_Start( Clock::now() ), m_BusyUntil( 0 ), m_CompletedCount( 0 ) {}
+
+		double GetNowUs() const
+		{
+			return std::chrono::duration<double, std::micro>( Clock::now() - m_Start ).count();
+		}
+
+		double GetFinishUs( uint64_t FenceValue )
+		{
+			std::lock_guard<std::mutex> Lock( m_Mutex );
+			uint64_t Count = FenceValue & kFenceCountMask;
+			return Count == 0 ? 0 : m_FinishUs[Count - 1];
+		}
+
+		virtual void ExecuteAndSignal( uint32_t NumLists, void* const* ppLists, uint64_t FenceValue ) override
+		{
+			(void)ppLists;
+			(void)FenceValue;
+			double Now = GetNowUs();
+			std::lock_guard<std::mutex> Lock( m_Mutex );
+			m_BusyUntil = (std::max)( Now, m_BusyUntil ) + NumLists * m_WorkUs;
+			m_FinishUs.push_back( m_BusyUntil );
+		}
+
+		virtual void Signal( uint64_t FenceValue ) override { ExecuteAndSignal( 0, nullptr, FenceValue ); }
+		virtual void GpuWait( uint64_t FenceValue ) override { (void)FenceValue; }
+
+		virtual uint64_t GetCompletedFence() override
+		{
+			double Now = GetNowUs();
+			std::lock_guard<std::mutex> Lock( m_Mutex );
+			while (m_CompletedCount < m_FinishUs.size() && m_FinishUs[m_CompletedCount] <= Now)
+				m_CompletedCount++;
+			return m_CompletedCount;
+		}
+
+		// Yields rather than sleeps, an event wakes its waiter faster than the OS timer would
+		virtual void WaitForFence( uint64_t FenceValue ) override
+		{
+			while (GetCompletedFence() < FenceValue)
+				std::this_thread::yield();
+		}
+
+	private:
+		const double			m_WorkUs;
+		const Clock::time_point	m_Start;
+		std::mutex				m_Mutex;
+		double					m_BusyUntil;
+		std::vector<double>		m_FinishUs;
+		uint64_t				m_CompletedCount;
+	};
+
+	void SleepUntilUs( const Clock::time_point& Start, double Us )
+	{
+		std::this_thread::sleep_until( Start + std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double, std::micro>( Us ) ) );
+	}
+
+	bool IsReady( std::future<void>& Future, uint32_t TimeoutMs )
+	{
+		return Future.wait_for( std::chrono::milliseconds( TimeoutMs ) ) == std::future_status::ready;
+	}
+
+	void CheckNotifier( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "fence-notifier" );
+
+		enum { kDirect = 0, kCopy = 3 };
+		GpuQueue DirectQueue( kDirect ), CopyQueue( kCopy );
+		ManualBackend DirectBackend( DirectQueue.GetInitialFence() ), CopyBackend( CopyQueue.GetInitialFence() );
+		DirectQueue.Create( &DirectBackend );
+		CopyQueue.Create( &CopyBackend );
+		void* pList = &DirectQueue;
+		const uint64_t Done = DirectQueue.Execute( 1, &pList );
+		DirectBackend.Complete( Done );
+
+		// Every listener call and callback in the order they ran
+		std::mutex LogMutex;
+		std::vector<std::pair<uint32_t, uint64_t>> Log;
+		auto Append = [&]( uint32_t What, uint64_t Value )
+		{
+			std::lock_guard<std::mutex> Lock( LogMutex );
+			Log.push_back( std::make_pair( What, Value ) );
+		};
+		enum { kListener = 8 };
+
+		FenceNotifier Notifier;
+		Notifier.AddListener( [&]( uint32_t Type, uint64_t CompletedFence ) { Append( kListener + Type, CompletedFence ); } );
+		GpuQueue* Queues[2] = { &DirectQueue, &CopyQueue };
+		Notifier.Start( Queues, 2 );
+
+		std::thread::id InlineThread;
+		Notifier.OnFenceComplete( Done, [&]() { InlineThread = std::this_thread::get_id(); } );
+		Check( InlineThread == std::this_thread::get_id(), "callback on a completed fence runs on the caller" );
+		Check( Notifier.GetStats().NumInline == 1, "inline callback counted" );
+
+		const uint64_t First = DirectQueue.Execute( 1, &pList );
+		const uint64_t Second = DirectQueue.Execute( 1, &pList );
+		const uint64_t Upload = CopyQueue.Execute( 1, &pList );
+		std::thread::id CallbackThread;
+		Notifier.OnFenceComplete( Second, [&]() { Append( kDirect, Second ); } );
+		Notifier.OnFenceComplete( First, [&]() { CallbackThread = std::this_thread::get_id(); Append( kDirect, First ); } );
+		std::future<void> SecondDone = Notifier.WhenComplete( Second );
+		std::future<void> UploadDone = Notifier.WhenComplete( Upload );
+		Check( Notifier.GetStats().NumPending == 4, "callbacks on pending fences wait" );
+		Check( !IsReady( SecondDone, 5 ), "callback not run before its fence completed" );
+
+		DirectBackend.Complete( Second );
+		Check( IsReady( SecondDone, 1000 ), "callback run once its fence completed" );
+		Check( CallbackThread != std::thread::id() && CallbackThread != std::this_thread::get_id(), "callback run on the notifier thread" );
+		{
+			std::lock_guard<std::mutex> Lock( LogMutex );
+			Check( Log.size() == 3 && Log[0] == std::make_pair( (uint32_t)kListener + kDirect, Second ),
+				"listener told the completed fence before the callbacks run" );
+			Check( Log.size() == 3 && Log[1].second == First && Log[2].second == Second, "callbacks run in fence order" );
+		}
+		Check( !IsReady( UploadDone, 5 ), "callback of another queue waits for its own fence" );
+
+		// Completed before Stop() still runs, the one still pending is dropped
+		const uint64_t Never = DirectQueue.Execute( 1, &pList );
+		std::future<void> NeverDone = Notifier.WhenComplete( Never );
+		CopyBackend.Complete( Upload );
+		Notifier.Stop();
+		Check( IsReady( UploadDone, 0 ), "callback whose fence completed before Stop() run" );
+		bool Broken = false;
+		try
+		{
+			NeverDone.get();
+		}
+		catch (const std::future_error&)
+		{
+			Broken = true;
+		}
+		Check( Broken, "callback still pending at Stop() dropped" );
+		FenceNotifierStats Stats = Notifier.GetStats();
+		Check( Stats.NumCallbacks == 4 && Stats.NumPending == 0, "callbacks run on the thread counted" );
+		DirectQueue.Destroy();
+		CopyQueue.Destroy();
+	}
+
+	struct LatencyResult
+	{
+		double		MeanLatencyUs;			// From the fence completing to its callback running
+		double		P50LatencyUs;
+		double		P99LatencyUs;
+		double		MaxLatencyUs;
+		double		PollsPerSec;			// What the thread costs meanwhile
+		uint64_t	NumMissed;				// Callbacks which never ran
+	};
+
+	LatencyResult RunNotifier( double WorkUs, uint32_t NumFences )
+	{
+		WallClockBackend Backend( WorkUs );
+		GpuQueue Queue( 0 );
+		Queue.Create( &Backend );
+		FenceNotifier Notifier;
+		GpuQueue* pQueue = &Queue;
+		Notifier.Start( &pQueue, 1 );
+
+		// Written by the notifier thread, read after Stop() joined it
+		std::vector<double> LatencyUs( NumFences, -1.0 );
+		void* pList = &Queue;
+		uint64_t LastFence = 0;
+		auto Start = Clock::now();
+		for (uint32_t i = 0; i < NumFences; ++i)
+		{
+			uint64_t FenceValue = Queue.Execute( 1, &pList );
+			Notifier.OnFenceComplete( FenceValue, [&Backend, &LatencyUs, i, FenceValue]()
+			{
+				LatencyUs[i] = Backend.GetNowUs() - Backend.GetFinishUs( FenceValue );
+			} );
+			LastFence = FenceValue;
+			SleepUntilUs( Start, (i + 1) * WorkUs );
+		}
+		Notifier.WhenComplete( LastFence ).wait();
+		std::chrono::duration<double> Elapsed = Clock::now() - Start;
+		FenceNotifierStats Stats = Notifier.GetStats();
+		Notifier.Stop();
+		Queue.Destroy();
+
+		LatencyResult Result;
+		std::vector<double> Sorted;
+		Result.NumMissed = 0;
+		for (double Us : LatencyUs)
+		{
+			if (Us < 0)
+				Result.NumMissed++;
+			else
+				Sorted.push_back( Us );
+		}
+		std::sort( Sorted.begin(), Sorted.end() );
+		double Sum = 0;
+		for (double Us : Sorted)
+			Sum += Us;
+		const size_t Count = Sorted.size();
+		Result.MeanLatencyUs = Count ? Sum / Count : 0;
+		Result.P50LatencyUs = Count ? Sorted[Count / 2] : 0;
+		Result.P99LatencyUs = Count ? Sorted[(std::min)( Count - 1, Count * 99 / 100 )] : 0;
+		Result.MaxLatencyUs = Count ? Sorted.back() : 0;
+		Result.PollsPerSec = Stats.NumPolls / (std::max)( Elapsed.count(), 1e-9 );
+		return Result;
+	}
+
+	// Mean latency of a thread blocking in WaitForFence()
+	double RunBlockingWait( double WorkUs, uint32_t NumFences )
+	{
+		WallClockBackend Backend( WorkUs );
+		GpuQueue Queue( 0 );
+		Queue.Create( &Backend );
+		std::atomic<uint32_t> NumSubmitted( 0 );
+		double SumUs = 0;
+
+		std::thread Waiter( [&]()
+		{
+			for (uint32_t i = 0; i < NumFences; ++i)
+			{
+				while (NumSubmitted.load( std::memory_order_acquire ) <= i)
+					std::this_thread::yield();
+				uint64_t FenceValue = Queue.GetInitialFence() + i + 1;
+				double StallMs;
+				Queue.WaitForFence( FenceValue, StallMs );
+				SumUs += Backend.GetNowUs() - Backend.GetFinishUs( FenceValue );
+			}
+		} );
+		void* pList = &Queue;
+		auto Start = Clock::now();
+		for (uint32_t i = 0; i < NumFences; ++i)
+		{
+			Queue.Execute( 1, &pList );
+			NumSubmitted.store( i + 1, std::memory_order_release );
+			SleepUntilUs( Start, (i + 1) * WorkUs );
+		}
+		Waiter.join();
+		Queue.Destroy();
+		return NumFences ? SumUs / NumFences : 0;
+	}
+}
+
+// [NumFences]
+uint64_t RunFenceNotifierTests( int argc, char* argv[] )
+{
+	const uint32_t NumFences = GetCountArg( argc, argv, 1, 500 );
+	if (NumFences == 0)
+	{
+		fprintf( stderr, "Bad fence count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckNotifier( Failures );
+	printf( "%8s %10s %10s %10s %10s %10s %12s\n", "Work us", "Mean us", "P50 us", "P99 us", "Max us", "Polls/s", "Wait us" );
+	// Fences 0.1ms, 0.5ms and 2ms apart
+	for (double WorkUs : { 100.0, 500.0, 2000.0 })
+	{
+		LatencyResult R = RunNotifier( WorkUs, NumFences );
+		printf( "%8.0f %10.1f %10.1f %10.1f %10.1f %10.0f %12.1f\n", WorkUs, R.MeanLatencyUs, R.P50LatencyUs,
+			R.P99LatencyUs, R.MaxLatencyUs, R.PollsPerSec, RunBlockingWait( WorkUs, NumFences ) );
+		if (R.NumMissed != 0)
+			Failures.push_back( "fence-notifier: " + std::to_string( R.NumMissed ) + " callbacks never ran with fences " +
+				std::to_string( WorkUs ) + "us apart" );
+	}
+	return ReportFailures( Failures );
+}
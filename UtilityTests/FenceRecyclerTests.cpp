@@ -0,0 +1,300 @@
+// FenceRing and FenceRecycler from many threads. Producers and consumers of a small ring must see
+// every item exactly once. Recording threads acquire and retire objects while a stand-in GPU
+// completes fences a few behind; an object handed out twice, or before its fence completed, is a
+// failure, and a recycler small enough to spill into its overflow list must still give every object
+// back. Also the contention benchmark against the mutex + std::queue scheme FenceRecycler replaced.
+
+#include "UtilityTests.h"
+#include "FenceRecycler.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+namespace
+{
+	const uint64_t kFencesInFlight = 3;
+
+	struct PooledObject
+	{
+		PooledObject() :Payload( 0 ), RetireFence( 0 ), InUse( true ), NumVisits( 0 ) {}
+		uint64_t				Payload;
+		std::atomic<uint64_t>	RetireFence;
+		std::atomic<bool>		InUse;
+		uint32_t				NumVisits;
+	};
+
+	// What the pools did before: one lock around both the retired queue and creation
+	class LockedRecycler
+	{
+	public:
+		template <typename FenceCompleteFn>
+		PooledObject* Acquire( FenceCompleteFn&& IsFenceComplete )
+		{
+			std::lock_guard<std::mutex> Lock( m_Mutex );
+			if (m_Retired.empty() || !IsFenceComplete( m_Retired.front().first )) return nullptr;
+			PooledObject* pObject = m_Retired.front().second;
+			m_Retired.pop();
+			return pObject;
+		}
+		void Retire( uint64_t FenceValue, PooledObject* pObject )
+		{
+			std::lock_guard<std::mutex> Lock( m_Mutex );
+			m_Retired.push( std::make_pair( FenceValue, pObject ) );
+		}
+
+	private:
+		std::mutex										m_Mutex;
+		std::queue<std::pair<uint64_t, PooledObject*>>	m_Retired;
+	};
+
+	// Producers push distinct items into a ring much smaller than their number, consumers pop them
+	void CheckRing( uint32_t NumProducers, uint32_t NumConsumers, uint32_t ItemsPerProducer, std::vector<std::string>& Failures )
+	{
+		const uint32_t NumItems = NumProducers * ItemsPerProducer;
+		std::unique_ptr<std::atomic<uint32_t>[]> NumPopped( new std::atomic<uint32_t>[NumItems] );
+		for (uint32_t i = 0; i < NumItems; ++i)
+			NumPopped[i] = 0;
+		std::vector<uint32_t> Items( NumItems );
+		FenceRing<uint32_t> Ring( 64 );
+		std::atomic<uint32_t> NumConsumed( 0 );
+		std::atomic<uint32_t> NumBadFences( 0 );
+
+		auto Producer = [&]( uint32_t ProducerIndex )
+		{
+			for (uint32_t i = ProducerIndex * ItemsPerProducer; i < (ProducerIndex + 1) * ItemsPerProducer; ++i)
+			{
+				while (!Ring.Push( i + 1, &Items[i] ))
+					std::this_thread::yield();
+			}
+		};
+		auto Consumer = [&]()
+		{
+			uint64_t FenceValue;
+			uint32_t* pItem;
+			while (NumConsumed.load( std::memory_order_relaxed ) < NumItems)
+			{
+				if (!Ring.Pop( FenceValue, pItem ))
+				{
+					std::this_thread::yield();
+					continue;
+				}
+				const uint32_t Index = (uint32_t)(pItem - Items.data());
+				if (FenceValue != Index + 1)
+					NumBadFences++;
+				NumPopped[Index]++;
+				NumConsumed++;
+			}
+		};
+
+		std::vector<std::thread> Threads;
+		for (uint32_t i = 0; i < NumProducers; ++i)
+			Threads.emplace_back( Producer, i );
+		for (uint32_t i = 0; i < NumConsumers; ++i)
+			Threads.emplace_back( Consumer );
+		for (auto& Thread : Threads)
+			Thread.join();
+
+		uint32_t NumLost = 0;
+		uint32_t NumDuplicated = 0;
+		for (uint32_t i = 0; i < NumItems; ++i)
+		{
+			NumLost += NumPopped[i] == 0;
+			NumDuplicated += NumPopped[i] > 1;
+		}
+		const std::string With = " with " + std::to_string( NumProducers ) + " producers and " + std::to_string( NumConsumers ) + " consumers";
+		if (NumLost)
+			Failures.push_back( "fence-recycler: ring lost " + std::to_string( NumLost ) + " items" + With );
+		if (NumDuplicated)
+			Failures.push_back( "fence-recycler: ring popped " + std::to_string( NumDuplicated ) + " items twice" + With );
+		if (NumBadFences)
+			Failures.push_back( "fence-recycler: ring popped " + std::to_string( NumBadFences.load() ) + " items with another fence" + With );
+		if (Ring.ApproxSize() != 0)
+			Failures.push_back( "fence-recycler: ring not empty after every item was popped" + With );
+	}
+
+	struct RunCounts
+	{
+		uint64_t	NumDuplicated;		// Acquired while somebody else still used it
+		uint64_t	NumEarly;			// Acquired before its fence completed
+		uint64_t	NumCreated;
+		uint64_t	NumDrained;
+		uint64_t	NumDrainedTwice;
+	};
+
+	// Every thread plays a recording thread: acquire an object, retire it on a new fence, while the
+	// "GPU" completes fences a few behind. Created owns the objects made when none was ready.
+	// Returns acquire + retire pairs per second, all threads.
+	template <typename RecyclerT>
+	double Run( RecyclerT& Recycler, uint32_t NumThreads, uint32_t OpsPerThread, std::vector<std::unique_ptr<PooledObject>>& Created, RunCounts& Counts )
+	{
+		std::atomic<uint64_t> NextFence( 1 );
+		std::atomic<uint64_t> CompletedFence( 0 );
+		std::atomic<uint64_t> NumDuplicated( 0 );
+		std::atomic<uint64_t> NumEarly( 0 );
+		std::mutex CreateMutex;
+
+		auto Worker = [&]()
+		{
+			auto IsFenceComplete = [&]( uint64_t FenceValue ) { return FenceValue <= CompletedFence.load( std::memory_order_acquire ); };
+			for (uint32_t i = 0; i < OpsPerThread; ++i)
+			{
+				PooledObject* pObject = Recycler.Acquire( IsFenceComplete );
+				if (pObject == nullptr)
+				{
+					std::lock_guard<std::mutex> Lock( CreateMutex );
+					Created.emplace_back( new PooledObject() );
+					pObject = Created.back().get();
+				}
+				else
+				{
+					if (pObject->InUse.exchange( true, std::memory_order_relaxed ))
+						NumDuplicated++;
+					// Completion only moves forward, a fence complete by now may not have been at acquire
+					if (!IsFenceComplete( pObject->RetireFence.load( std::memory_order_relaxed ) ))
+						NumEarly++;
+				}
+				pObject->Payload++;
+				uint64_t Fence = NextFence.fetch_add( 1, std::memory_order_relaxed );
+				pObject->RetireFence.store( Fence, std::memory_order_relaxed );
+				pObject->InUse.store( false, std::memory_order_relaxed );
+				Recycler.Retire( Fence, pObject );
+				// Stand-in for the GPU, keeps a few fences in flight
+				if (Fence > kFencesInFlight)
+				{
+					uint64_t Completed = CompletedFence.load( std::memory_order_relaxed );
+					while (Completed < Fence - kFencesInFlight &&
+						!CompletedFence.compare_exchange_weak( Completed, Fence - kFencesInFlight, std::memory_order_release ));
+				}
+			}
+		};
+
+		auto Start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> Threads;
+		for (uint32_t i = 1; i < NumThreads; ++i)
+			Threads.emplace_back( Worker );
+		Worker();
+		for (auto& Thread : Threads)
+			Thread.join();
+		std::chrono::duration<double> Elapsed = std::chrono::high_resolution_clock::now() - Start;
+
+		Counts.NumDuplicated = NumDuplicated;
+		Counts.NumEarly = NumEarly;
+		Counts.NumCreated = Created.size();
+		return (double)NumThreads * OpsPerThread / (std::max)( Elapsed.count(), 1e-9 );
+	}
+
+	void CheckRecycler( uint32_t NumThreads, uint32_t OpsPerThread, uint32_t Capacity, double& OpsPerSec, std::vector<std::string>& Failures )
+	{
+		FenceRecycler<PooledObject> Recycler( Capacity );
+		std::vector<std::unique_ptr<PooledObject>> Created;
+		RunCounts Counts = {};
+		OpsPerSec = Run( Recycler, NumThreads, OpsPerThread, Created, Counts );
+		Recycler.Drain( [&Counts]( PooledObject* pObject )
+		{
+			Counts.NumDrainedTwice += pObject->NumVisits++ != 0;
+			Counts.NumDrained++;
+		} );
+
+		const std::string With = " with " + std::to_string( NumThreads ) + " threads and capacity " + std::to_string( Capacity );
+		if (Counts.NumDuplicated)
+			Failures.push_back( "fence-recycler: " + std::to_string( Counts.NumDuplicated ) + " objects acquired twice" + With );
+		if (Counts.NumEarly)
+			Failures.push_back( "fence-recycler: " + std::to_string( Counts.NumEarly ) + " objects acquired before their fence" + With );
+		if (Counts.NumDrained != Counts.NumCreated || Counts.NumDrainedTwice)
+			Failures.push_back( "fence-recycler: " + std::to_string( Counts.NumCreated ) + " objects created, " +
+				std::to_string( Counts.NumDrained ) + " drained" + With );
+	}
+
+	// One thread, a ring of 4: the overflow list takes the rest and is put back as the ring drains
+	void CheckOverflow( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "fence-recycler" );
+
+		const uint32_t kNumObjects = 20;
+		PooledObject Objects[kNumObjects];
+		uint64_t Completed = 0;
+		auto IsFenceComplete = [&Completed]( uint64_t FenceValue ) { return FenceValue <= Completed; };
+
+		FenceRecycler<PooledObject> Recycler( 4 );
+		for (uint32_t i = 0; i < kNumObjects; ++i)
+			Recycler.Retire( i + 1, &Objects[i] );
+		Check( Recycler.GetNumRetired() == 4, "ring holds only its capacity" );
+		Check( Recycler.Acquire( IsFenceComplete ) == nullptr, "nothing acquired before a fence completed" );
+
+		Completed = 10;
+		uint32_t NumAcquired = 0;
+		bool InOrder = true;
+		while (PooledObject* pObject = Recycler.Acquire( IsFenceComplete ))
+		{
+			InOrder &= pObject == &Objects[NumAcquired];
+			pObject->NumVisits++;
+			NumAcquired++;
+		}
+		Check( NumAcquired == 10, "overflow refilled up to the completed fence" );
+		Check( InOrder, "retired objects acquired in fence order" );
+
+		Completed = kNumObjects;
+		while (Recycler.Reclaim( IsFenceComplete ) == FenceRecycler<PooledObject>::kReclaimBatch);
+		while (PooledObject* pObject = Recycler.Acquire( IsFenceComplete ))
+		{
+			pObject->NumVisits++;
+			NumAcquired++;
+		}
+		Check( NumAcquired == kNumObjects, "every overflowed object acquired once completed" );
+
+		// Released objects spill too, they come back without a fence
+		for (uint32_t i = 0; i < kNumObjects; ++i)
+			Recycler.Release( &Objects[i] );
+		while (PooledObject* pObject = Recycler.Acquire())
+		{
+			pObject->NumVisits++;
+			NumAcquired++;
+		}
+		Check( NumAcquired == 2 * kNumObjects, "every released object acquired" );
+		bool TwiceEach = true;
+		for (auto& Object : Objects)
+			TwiceEach &= Object.NumVisits == 2;
+		Check( TwiceEach, "no object lost or acquired twice through the overflow list" );
+	}
+}
+
+uint64_t RunFenceRecyclerTests( int argc, char* argv[] )
+{
+	const uint32_t MaxThreads = GetCountArg( argc, argv, 1, (std::max)( 4u, std::thread::hardware_concurrency() ) );
+	const uint32_t OpsPerThread = GetCountArg( argc, argv, 2, 100000 );
+	std::vector<std::string> Failures;
+	if (!MaxThreads || !OpsPerThread)
+	{
+		Failures.push_back( "fence-recycler: MaxThreads and OpsPerThread must be counts" );
+		return ReportFailures( Failures );
+	}
+
+	CheckOverflow( Failures );
+	for (uint32_t NumProducers = 1; NumProducers <= MaxThreads; NumProducers *= 2)
+	{
+		CheckRing( NumProducers, 1, OpsPerThread / 4, Failures );
+		CheckRing( NumProducers, MaxThreads, OpsPerThread / 4, Failures );
+	}
+
+	printf( "Threads  Lock-free Mops/s  Locked Mops/s\n" );
+	for (uint32_t NumThreads = 1; NumThreads <= MaxThreads; NumThreads *= 2)
+	{
+		double LockFreeOpsPerSec;
+		CheckRecycler( NumThreads, OpsPerThread, FenceRecycler<PooledObject>::kDefaultCapacity, LockFreeOpsPerSec, Failures );
+		LockedRecycler Locked;
+		std::vector<std::unique_ptr<PooledObject>> Created;
+		RunCounts Counts = {};
+		const double LockedOpsPerSec = Run( Locked, NumThreads, OpsPerThread, Created, Counts );
+		printf( "%7u %17.2f %14.2f\n", NumThreads, LockFreeOpsPerSec / 1e6, LockedOpsPerSec / 1e6 );
+
+		// A recycler of 2 spills into its overflow list all the time, which is slow, fewer ops
+		double SpillingOpsPerSec;
+		CheckRecycler( NumThreads, (std::max)( OpsPerThread / 100, 1u ), 2, SpillingOpsPerSec, Failures );
+	}
+	return ReportFailures( Failures );
+}
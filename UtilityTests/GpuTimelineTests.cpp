@@ -0,0 +1,278 @@
+// SimulatedGpuTimeline and FramePacer without a GPU. A few submissions on two queues check the
+// timeline itself: submit latency, list cost, a GPU wait across queues and a CPU stall. Then a frame
+// loop of a few recording contexts runs against GPU frame times from half to twice the CPU frame and
+// 1 to 4 frames in flight, low-latency mode marked "L". Each frame uploads on the copy queue, the
+// direct queue waits for it, every context submits its own list with an allocator recycled by fence
+// like CommandQueue does. The pacer must never let too many frames run or hand out a slot still in
+// use, a CPU bound loop must not stall once two frames are in flight, a GPU bound one must run at
+// the GPU's pace with latency growing with every frame in flight, and low-latency mode must cut it.
+
+#include "UtilityTests.h"
+#include "SimulatedGpuTimeline.h"
+#include "GpuQueue.h"
+#include "FenceRecycler.h"
+#include "FramePacer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <memory>
+
+namespace
+{
+	enum { kDirect = 0, kCopy = 3 };
+	const uint32_t kNumContexts = 3;
+	const uint32_t kMaxFramesInFlight = 4;
+	const uint32_t kNumFrames = 1000;
+	// Share of the CPU and the GPU frame the upload on the copy queue takes
+	const double kUploadShare = 0.1;
+
+	struct SweepResult
+	{
+		double		GpuFrameUs;			// Direct queue time of one frame
+		uint32_t	FramesInFlight;
+		bool		LowLatency;
+		double		StallsPerFrame;		// CPU blocked on a fence, as in g_stats.cpuStallCountPerFrame
+		double		StallMsPerFrame;	// As in g_stats.cpuStallTimePerFrame
+		double		FrameMs;			// CPU frame to frame
+		double		LatencyMs;			// From starting to record a frame until the GPU finished it
+		double		SleepMsPerFrame;	// Low-latency mode holding the frame start back
+		double		GpuIdlePercent;		// Of the direct queue between its first and last frame
+		uint32_t	PeakAllocators;		// Command allocators created, direct and copy
+		uint32_t	NumViolations;		// Too many frames in flight or a frame slot reused early
+	};
+
+	struct SimAllocator
+	{
+		uint32_t	Index;
+	};
+
+	class SimAllocatorPool
+	{
+	public:
+		explicit SimAllocatorPool( GpuQueue& Queue ) :m_Queue( Queue ) {}
+
+		SimAllocator* Request()
+		{
+			SimAllocator* pAllocator = m_Ready.Acquire( [this]( uint64_t FenceValue ) { return m_Queue.IsFenceComplete( FenceValue ); } );
+			if (pAllocator)
+				return pAllocator;
+			SimAllocator* pNew = new SimAllocator;
+			pNew->Index = (uint32_t)m_Allocators.size();
+			m_Allocators.emplace_back( pNew );
+			return pNew;
+		}
+		void Discard( uint64_t FenceValue, SimAllocator* pAllocator ) { m_Ready.Retire( FenceValue, pAllocator ); }
+		uint32_t Size() const { return (uint32_t)m_Allocators.size(); }
+
+	private:
+		GpuQueue&								m_Queue;
+		std::vector<std::unique_ptr<SimAllocator>>	m_Allocators;
+		FenceRecycler<SimAllocator>				m_Ready;
+	};
+
+	// Sleeping moves the virtual clock like any other CPU work
+	class TimelineClock : public IFrameClock
+	{
+	public:
+		explicit TimelineClock( SimulatedGpuTimeline& Timeline ) :m_Timeline( Timeline ) {}
+		virtual double GetNowMs() override { return m_Timeline.GetNow() / 1000.0; }
+		virtual void SleepUntilMs( double TimeMs ) override
+		{
+			double Us = TimeMs * 1000.0 - m_Timeline.GetNow();
+			if (Us > 0)
+				m_Timeline.AdvanceCpu( Us );
+		}
+
+	private:
+		SimulatedGpuTimeline&	m_Timeline;
+	};
+
+	void CheckTimeline( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "gpu-timeline" );
+
+		SimulatedGpuTimeline Timeline;
+		SimulatedQueueConfig DirectConfig = { 10.0, 100.0 };
+		SimulatedQueueConfig CopyConfig = { 0.0, 50.0 };
+		Timeline.Configure( kDirect, DirectConfig );
+		Timeline.Configure( kCopy, CopyConfig );
+		GpuQueue DirectQueue( kDirect ), CopyQueue( kCopy );
+		DirectQueue.Create( Timeline.GetBackend( kDirect ) );
+		CopyQueue.Create( Timeline.GetBackend( kCopy ) );
+		Check( DirectQueue.IsFenceComplete( DirectQueue.GetInitialFence() ), "initial fence complete from the start" );
+
+		void* Lists[2] = { &Timeline, &Timeline };
+		uint64_t First = DirectQueue.Execute( 2, Lists );
+		Check( Timeline.GetStartTime( First ) == 10.0, "work starts after the submit latency" );
+		Check( Timeline.GetCompletionTime( First ) == 210.0, "every list costs its time" );
+		Check( !DirectQueue.IsFenceComplete( First ), "fence pending before the clock reaches its finish" );
+		Timeline.AdvanceCpu( 210.0 );
+		Check( DirectQueue.IsFenceComplete( First ), "fence complete once the clock reaches its finish" );
+
+		uint64_t Upload = CopyQueue.Execute( 1, Lists );
+		Check( Timeline.GetCompletionTime( Upload ) == 260.0, "copy queue runs on its own" );
+		DirectQueue.GpuWait( Upload );
+		uint64_t Second = DirectQueue.Execute( 1, Lists );
+		Check( Timeline.GetStartTime( Second ) == 260.0, "GPU wait holds the direct queue back until the upload finished" );
+		uint64_t Signaled = DirectQueue.Signal();
+		Check( Timeline.GetStartTime( Signaled ) == 360.0 && Timeline.GetCompletionTime( Signaled ) == 360.0,
+			"plain signal after the work before it, costing nothing" );
+
+		double StallMs;
+		Check( DirectQueue.WaitForFence( Signaled, StallMs ), "waiting on a pending fence blocks" );
+		Check( Timeline.GetNow() == 360.0, "blocking moves the clock to the finish" );
+		Check( Timeline.GetNumStalls() == 1 && Timeline.GetStallUs() == 150.0, "blocking counted as a stall" );
+		Check( !DirectQueue.WaitForFence( Second, StallMs ), "waiting on a completed fence doesn't block" );
+		Check( Timeline.GetNumStalls() == 1, "no stall counted for a completed fence" );
+		Timeline.ResetStats();
+		Check( Timeline.GetNumStalls() == 0 && Timeline.GetStallUs() == 0, "stats reset" );
+		DirectQueue.Destroy();
+		CopyQueue.Destroy();
+	}
+
+	SweepResult RunFrames( double CpuFrameUs, double SubmitLatencyUs, double GpuFrameUs, uint32_t FramesInFlight, bool LowLatency )
+	{
+		SimulatedGpuTimeline Timeline;
+		SimulatedQueueConfig DirectConfig = { SubmitLatencyUs, GpuFrameUs / kNumContexts };
+		SimulatedQueueConfig CopyConfig = { SubmitLatencyUs, GpuFrameUs * kUploadShare };
+		Timeline.Configure( kDirect, DirectConfig );
+		Timeline.Configure( kCopy, CopyConfig );
+		GpuQueue DirectQueue( kDirect ), CopyQueue( kCopy );
+		DirectQueue.Create( Timeline.GetBackend( kDirect ) );
+		CopyQueue.Create( Timeline.GetBackend( kCopy ) );
+		SimAllocatorPool DirectAllocators( DirectQueue ), CopyAllocators( CopyQueue );
+
+		TimelineClock Clock( Timeline );
+		FramePacer Pacer;
+		Pacer.Create( &DirectQueue, &Clock );
+		Pacer.SetFramesInFlight( FramesInFlight );
+		Pacer.SetLowLatency( LowLatency );
+
+		const double UploadCpuUs = CpuFrameUs * kUploadShare;
+		const double ContextCpuUs = (CpuFrameUs - UploadCpuUs) / kNumContexts;
+		std::vector<uint64_t> FrameFences;
+		uint64_t SlotFences[FramePacer::kMaxFramesInFlight] = {};
+		double TotalLatencyUs = 0;
+		double IdleUs = 0;
+		double FirstStartUs = 0;
+		uint32_t NumViolations = 0;
+		for (uint32_t Frame = 0; Frame < kNumFrames; ++Frame)
+		{
+			const uint32_t Slot = Pacer.BeginFrame();
+			const double FrameStart = Timeline.GetNow();
+			if (SlotFences[Slot] != 0 && Timeline.GetCompletionTime( SlotFences[Slot] ) > FrameStart)
+				NumViolations++;
+			uint32_t NumRunning = 0;
+			for (size_t i = FrameFences.size() > FramesInFlight ? FrameFences.size() - FramesInFlight : 0; i < FrameFences.size(); ++i)
+				NumRunning += Timeline.GetCompletionTime( FrameFences[i] ) > FrameStart;
+			if (NumRunning >= FramesInFlight)
+				NumViolations++;
+
+			SimAllocator* pAllocator = CopyAllocators.Request();
+			Timeline.AdvanceCpu( UploadCpuUs );
+			void* pList = pAllocator;
+			uint64_t UploadFence = CopyQueue.Execute( 1, &pList );
+			CopyAllocators.Discard( UploadFence, pAllocator );
+			DirectQueue.GpuWait( UploadFence );
+
+			uint64_t FrameFence = 0;
+			for (uint32_t Context = 0; Context < kNumContexts; ++Context)
+			{
+				pAllocator = DirectAllocators.Request();
+				Timeline.AdvanceCpu( ContextCpuUs );
+				pList = pAllocator;
+				FrameFence = DirectQueue.Execute( 1, &pList );
+				DirectAllocators.Discard( FrameFence, pAllocator );
+			}
+			Pacer.EndFrame( FrameFence );
+			const double StartUs = Timeline.GetStartTime( FrameFence - (kNumContexts - 1) );
+			if (FrameFences.empty())
+				FirstStartUs = StartUs;
+			else
+				IdleUs += (std::max)( 0.0, StartUs - Timeline.GetCompletionTime( FrameFences.back() ) );
+			FrameFences.push_back( FrameFence );
+			SlotFences[Slot] = FrameFence;
+			TotalLatencyUs += Timeline.GetCompletionTime( FrameFence ) - FrameStart;
+		}
+		FramePacerStats PacerStats = Pacer.GetStats();
+		Pacer.Destroy();
+
+		SweepResult Result;
+		Result.GpuFrameUs = GpuFrameUs;
+		Result.FramesInFlight = FramesInFlight;
+		Result.LowLatency = LowLatency;
+		Result.StallsPerFrame = (double)Timeline.GetNumStalls() / kNumFrames;
+		Result.StallMsPerFrame = Timeline.GetStallUs() / 1000.0 / kNumFrames;
+		Result.FrameMs = Timeline.GetNow() / 1000.0 / kNumFrames;
+		Result.LatencyMs = TotalLatencyUs / 1000.0 / kNumFrames;
+		Result.SleepMsPerFrame = PacerStats.SleepMsPerFrame;
+		const double GpuSpanUs = Timeline.GetCompletionTime( FrameFences.back() ) - FirstStartUs;
+		Result.GpuIdlePercent = GpuSpanUs > 0 ? IdleUs * 100.0 / GpuSpanUs : 0;
+		Result.PeakAllocators = DirectAllocators.Size() + CopyAllocators.Size();
+		Result.NumViolations = NumViolations;
+		DirectQueue.Destroy();
+		CopyQueue.Destroy();
+		return Result;
+	}
+
+	void CheckSweep( double CpuFrameUs, double SubmitLatencyUs, std::vector<std::string>& Failures )
+	{
+		printf( "%8s %8s %12s %14s %10s %12s %10s %10s %10s %10s\n", "GPU ms", "InFlight", "Stalls/frm", "Stall ms/frm", "Frame ms",
+			"Latency ms", "Sleep ms", "GPU idle", "Allocators", "Violations" );
+		for (double Scale = 0.5; Scale < 2.01; Scale += 0.25)
+		{
+			const double GpuFrameUs = CpuFrameUs * Scale;
+			// The CPU frame or the GPU frame, whichever is longer, paces the loop once frames overlap
+			const double PaceMs = (std::max)( CpuFrameUs, GpuFrameUs ) / 1000.0;
+			auto CheckFor = [&]( const SweepResult& R )
+			{
+				return Checker( Failures, "gpu-timeline", " at " + std::to_string( GpuFrameUs / 1000.0 ) + " GPU ms, " +
+					std::to_string( R.FramesInFlight ) + (R.LowLatency ? " low latency" : "") + " frames in flight" );
+			};
+
+			std::vector<SweepResult> Results;
+			for (uint32_t FramesInFlight = 1; FramesInFlight <= kMaxFramesInFlight; ++FramesInFlight)
+				Results.push_back( RunFrames( CpuFrameUs, SubmitLatencyUs, GpuFrameUs, FramesInFlight, false ) );
+			Results.push_back( RunFrames( CpuFrameUs, SubmitLatencyUs, GpuFrameUs, 2, true ) );
+			for (auto& R : Results)
+			{
+				const Checker Check = CheckFor( R );
+				printf( "%8.2f %7u%s %12.2f %14.3f %10.3f %12.3f %10.3f %9.1f%% %10u %10u\n", R.GpuFrameUs / 1000.0, R.FramesInFlight,
+					R.LowLatency ? "L" : " ", R.StallsPerFrame, R.StallMsPerFrame, R.FrameMs, R.LatencyMs, R.SleepMsPerFrame,
+					R.GpuIdlePercent, R.PeakAllocators, R.NumViolations );
+				Check( R.NumViolations == 0, "no frame over the limit and no frame slot reused early" );
+				// A frame in flight holds one allocator per context and one for its upload, the recording one another set
+				Check( R.PeakAllocators <= (R.FramesInFlight + 1) * (kNumContexts + 1), "allocators bounded by the frames in flight" );
+				if (R.FramesInFlight > 1 && !R.LowLatency)
+					Check( fabs( R.FrameMs - PaceMs ) <= PaceMs * 0.01, "frame time of the slower side" );
+				if (R.FramesInFlight > 1 && GpuFrameUs <= CpuFrameUs)
+					Check( R.StallsPerFrame == 0, "no stall while the GPU keeps up" );
+			}
+			if (GpuFrameUs > CpuFrameUs)
+			{
+				for (uint32_t i = 1; i < kMaxFramesInFlight; ++i)
+					CheckFor( Results[i] )( Results[i].LatencyMs > Results[i - 1].LatencyMs, "latency grows with the frames in flight" );
+				CheckFor( Results.back() )( Results.back().LatencyMs < Results[1].LatencyMs, "low-latency mode cuts latency" );
+				CheckFor( Results.back() )( fabs( Results.back().FrameMs - PaceMs ) <= PaceMs * 0.01, "low-latency mode keeps the GPU's pace" );
+			}
+		}
+	}
+}
+
+// [CpuFrameMs] [SubmitLatencyMs]
+uint64_t RunGpuTimelineTests( int argc, char* argv[] )
+{
+	const double CpuFrameUs = (argc > 1 ? atof( argv[1] ) : 8.0) * 1000.0;
+	const double SubmitLatencyUs = (argc > 2 ? atof( argv[2] ) : 0.2) * 1000.0;
+	if (CpuFrameUs <= 0 || SubmitLatencyUs < 0)
+	{
+		fprintf( stderr, "Bad frame time or latency\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckTimeline( Failures );
+	CheckSweep( CpuFrameUs, SubmitLatencyUs, Failures );
+	return ReportFailures( Failures );
+}
@@ -0,0 +1,360 @@
+// LinearPagePool over a fake backing store which tracks every page alive: the size class picked for
+// a request, pages of a class and large pages handed out again only once the fence they were
+// discarded with completed, the large page cache and its limit, and the used and wasted bytes of
+// each class. The checks run with the shared recyclers only and again with thread magazines, the
+// latter on a thread of their own since magazines are kept per thread.
+// Recording threads then run frames of small allocations against a stand-in GPU: no page may be
+// handed out twice or before its fence, and once the threads exited and handed their magazines
+// back the pool must hold every page it created. The same run, timed, is the scaling benchmark of
+// magazines against the shared recyclers alone.
+
+#include "UtilityTests.h"
+#include "LinearPagePool.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace
+{
+	const size_t kClassSizes[] = { 0x10000, 0x40000, 0x100000, 0x200000 };
+	const uint32_t kNumClasses = sizeof( kClassSizes ) / sizeof( kClassSizes[0] );
+	const uint64_t kFramesInFlight = 3;
+	const uint32_t kAllocsPerFrame = 256;
+
+	// Who holds the page and the fence it was last discarded with
+	class TrackedPage : public LinearPage
+	{
+	public:
+		TrackedPage() :m_Owner( 0 ), m_DiscardFence( 0 ) {}
+		std::atomic<uint32_t>	m_Owner;
+		std::atomic<uint64_t>	m_DiscardFence;
+	};
+
+	// Pages without memory behind, only counted
+	class FakeBackingStore : public ILinearPageBackingStore
+	{
+	public:
+		FakeBackingStore() :m_NumCreated( 0 ), m_NumBadDestroys( 0 ) {}
+		// Pages still handed out when the pool went away
+		~FakeBackingStore()
+		{
+			for (auto pPage : m_Pages)
+				delete pPage;
+		}
+		virtual LinearPage* CreatePage( size_t ) override
+		{
+			LinearPage* pPage = new TrackedPage();
+			std::lock_guard<std::mutex> Lock( m_Mutex );
+			m_Pages.insert( pPage );
+			m_NumCreated++;
+			return pPage;
+		}
+		virtual void DestroyPage( LinearPage* pPage ) override
+		{
+			std::lock_guard<std::mutex> Lock( m_Mutex );
+			if (m_Pages.erase( pPage ) == 0)
+			{
+				m_NumBadDestroys++;
+				return;
+			}
+			delete pPage;
+		}
+		uint32_t GetNumAlive()
+		{
+			std::lock_guard<std::mutex> Lock( m_Mutex );
+			return (uint32_t)m_Pages.size();
+		}
+
+		uint32_t				m_NumCreated;
+		uint32_t				m_NumBadDestroys;		// Pages destroyed twice or never created here
+
+	private:
+		std::mutex				m_Mutex;
+		std::set<LinearPage*>	m_Pages;
+	};
+
+	void CheckSizeClasses( const Checker& Check )
+	{
+		LinearPagePool Pool( kClassSizes, kNumClasses );
+		Check( Pool.GetNumClasses() == kNumClasses && Pool.GetMaxClassSize() == kClassSizes[kNumClasses - 1], "class count and biggest class" );
+		Check( Pool.GetSizeClass( 1 ) == 0, "smallest request in the first class" );
+		bool Exact = true;
+		for (uint32_t i = 0; i < kNumClasses; ++i)
+		{
+			Exact &= Pool.GetSizeClass( kClassSizes[i] ) == i;
+			if (i + 1 < kNumClasses)
+				Exact &= Pool.GetSizeClass( kClassSizes[i] + 1 ) == i + 1;
+		}
+		Check( Exact, "smallest class holding the request" );
+		Check( Pool.GetSizeClass( kClassSizes[kNumClasses - 1] + 1 ) == LinearPagePool::kLargePageClass, "bigger than every class is a large page" );
+	}
+
+	void CheckReuse( bool UseMagazines, const Checker& Check )
+	{
+		FakeBackingStore Store;
+		FakeFences Fences;
+		{
+			LinearPagePool Pool( kClassSizes, kNumClasses );
+			Pool.SetBackend( &Store, &Fences );
+			Pool.SetUseMagazines( UseMagazines );
+
+			LinearPage* pFirst = Pool.RequestPage( 1 );
+			Check( pFirst->m_SizeInByte == kClassSizes[1] && pFirst->m_SizeClass == 1, "page of the size of its class" );
+			pFirst->m_UsedBytes = 0x1000;
+			Pool.DiscardPages( 1, std::vector<LinearPage*>( 1, pFirst ) );
+			LinearPage* pSecond = Pool.RequestPage( 1 );
+			Check( pSecond != pFirst && Store.m_NumCreated == 2, "page not handed out before its fence completed" );
+			Check( Pool.RequestPage( 0 ) != pFirst, "page not handed out to another class" );
+
+			Fences.Complete( 1 );
+			Pool.DiscardPages( 2, std::vector<LinearPage*>( 1, pSecond ) );
+			LinearPage* pThird = Pool.RequestPage( 1 );
+			Check( pThird == pFirst && Store.m_NumCreated == 3, "page handed out again once its fence completed" );
+			Check( pThird->m_UsedBytes == 0, "page handed out again is empty" );
+			Check( Pool.RequestPage( 1 ) != pSecond, "later fence still in flight" );
+			Check( Pool.GetStats( 1 ).NumPages == 3 && Pool.GetStats( 0 ).NumPages == 1, "pages counted per class" );
+		}
+		// Three are still handed out, the pool doesn't know about them
+		Check( Store.GetNumAlive() == 3, "destroy releases the pages the pool holds" );
+		Check( Store.m_NumBadDestroys == 0, "no page destroyed twice" );
+	}
+
+	void CheckLargePages( bool UseMagazines, const Checker& Check )
+	{
+		FakeBackingStore Store;
+		FakeFences Fences;
+		LinearPagePool Pool( kClassSizes, kNumClasses );
+		Pool.SetBackend( &Store, &Fences );
+		Pool.SetUseMagazines( UseMagazines );
+		const uint32_t Large = LinearPagePool::kLargePageClass;
+		const size_t MaxClassSize = kClassSizes[kNumClasses - 1];
+
+		LinearPage* pLarge = Pool.RequestLargePage( MaxClassSize + 1 );
+		Check( pLarge->m_SizeInByte == MaxClassSize + LinearPagePool::kLargePageAlign && pLarge->m_SizeClass == Large,
+			"large page rounded up to its placement alignment" );
+		LinearPage* pPage = Pool.RequestPage( 0 );
+		// Retired on the same fence as the class page of the same command list
+		std::vector<LinearPage*> Pages;
+		Pages.push_back( pLarge );
+		Pages.push_back( pPage );
+		Pool.DiscardPages( 1, Pages );
+		Check( Pool.RequestLargePage( MaxClassSize + 1 ) != pLarge, "large page not handed out before its fence completed" );
+		Check( Pool.GetStats( Large ).NumAvailable == 0, "large page not cached before its fence completed" );
+		Fences.Complete( 1 );
+		Check( Pool.ReclaimCompleted() >= 1 && Pool.GetStats( Large ).NumAvailable == 1, "large page cached once its fence completed" );
+		Check( Pool.RequestLargePage( MaxClassSize * 2 ) != pLarge, "cached large page too small not handed out" );
+		Check( Pool.RequestLargePage( MaxClassSize / 4 ) != pLarge, "cached large page wasting more than it holds not handed out" );
+		Check( Pool.RequestLargePage( MaxClassSize ) == pLarge, "cached large page handed out again" );
+		Check( Pool.RequestPage( 0 ) == pPage, "class page of the same fence handed out again" );
+
+		// Only the most recent few are kept
+		Pages.clear();
+		for (uint32_t i = 0; i < LinearPagePool::kMaxCachedLargePages + 2; ++i)
+			Pages.push_back( Pool.RequestLargePage( MaxClassSize * 3 ) );
+		const uint32_t NumAlive = Store.GetNumAlive();
+		Pool.DiscardPages( 2, Pages );
+		Fences.Complete( 2 );
+		Pool.ReclaimCompleted();
+		Check( Pool.GetStats( Large ).NumAvailable == LinearPagePool::kMaxCachedLargePages, "large page cache limited" );
+		Check( Store.GetNumAlive() == NumAlive - 2, "large pages beyond the cache released" );
+		Pool.Destroy();
+		Check( Store.GetNumAlive() == NumAlive - 2 - LinearPagePool::kMaxCachedLargePages && Store.m_NumBadDestroys == 0,
+			"destroy releases the cached large pages" );
+	}
+
+	void CheckWasteStats( bool UseMagazines, const Checker& Check )
+	{
+		FakeBackingStore Store;
+		FakeFences Fences;
+		LinearPagePool Pool( kClassSizes, kNumClasses );
+		Pool.SetBackend( &Store, &Fences );
+		Pool.SetUseMagazines( UseMagazines );
+
+		uint64_t UsedBytes[kNumClasses + 1] = {};
+		uint64_t WastedBytes[kNumClasses + 1] = {};
+		uint32_t NumRetired[kNumClasses + 1] = {};
+		uint32_t Seed = 1;
+		for (uint64_t Fence = 1; Fence <= 100; ++Fence)
+		{
+			std::vector<LinearPage*> Pages;
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				const uint32_t Random = NextRandom( Seed );
+				const uint32_t SizeClass = Random % (kNumClasses + 1);
+				LinearPage* pPage = SizeClass < kNumClasses ? Pool.RequestPage( SizeClass ) : Pool.RequestLargePage( kClassSizes[kNumClasses - 1] * 2 );
+				pPage->m_UsedBytes = (Random >> 4) % (pPage->m_SizeInByte + 1);
+				const uint32_t Index = SizeClass < kNumClasses ? SizeClass : kNumClasses;
+				UsedBytes[Index] += pPage->m_UsedBytes;
+				WastedBytes[Index] += pPage->m_SizeInByte - pPage->m_UsedBytes;
+				NumRetired[Index]++;
+				Pages.push_back( pPage );
+			}
+			Pool.DiscardPages( Fence, Pages );
+			Fences.Complete( Fence > 2 ? Fence - 2 : 0 );
+		}
+		// Magazines publish their counters every few pages, destroying the pool publishes the rest
+		if (UseMagazines)
+			Pool.Destroy();
+
+		bool Counted = true;
+		for (uint32_t i = 0; i <= kNumClasses; ++i)
+		{
+			LinearPageClassStats Stats = Pool.GetStats( i < kNumClasses ? i : (uint32_t)LinearPagePool::kLargePageClass );
+			Counted &= Stats.NumRetired == NumRetired[i] && Stats.UsedBytes == UsedBytes[i] && Stats.WastedBytes == WastedBytes[i];
+		}
+		Check( Counted, "retired, used and wasted bytes counted per class" );
+	}
+
+	struct ThreadedRun
+	{
+		double		AllocsPerSec;		// All threads
+		uint64_t	NumRequests;
+		uint64_t	NumDuplicated;		// Requested while another thread still held it
+		uint64_t	NumEarly;			// Requested before the fence it was discarded with
+	};
+
+	// Every thread records frames of small linear allocations, requesting pages as they run full and
+	// discarding them at the end of the frame, while the "GPU" completes fences a few frames behind
+	ThreadedRun RunThreads( LinearPagePool& Pool, FakeFences& Fences, uint32_t NumThreads, uint32_t FramesPerThread )
+	{
+		std::atomic<uint64_t> NextFence( 1 );
+		std::atomic<uint64_t> NumRequests( 0 );
+		std::atomic<uint64_t> NumDuplicated( 0 );
+		std::atomic<uint64_t> NumEarly( 0 );
+
+		auto Worker = [&]( uint32_t ThreadIndex )
+		{
+			const uint32_t Tag = ThreadIndex + 1;
+			std::vector<LinearPage*> UsedPages;
+			uint32_t Seed = ThreadIndex * 7919u + 1;
+			uint64_t ThreadRequests = 0;
+			auto Request = [&]()
+			{
+				TrackedPage* pPage = static_cast<TrackedPage*>( Pool.RequestPage( 0 ) );
+				uint32_t Expected = 0;
+				if (!pPage->m_Owner.compare_exchange_strong( Expected, Tag, std::memory_order_relaxed ))
+					NumDuplicated++;
+				if (!Fences.IsFenceComplete( pPage->m_DiscardFence.load( std::memory_order_relaxed ) ))
+					NumEarly++;
+				ThreadRequests++;
+				return pPage;
+			};
+			for (uint32_t Frame = 0; Frame < FramesPerThread; ++Frame)
+			{
+				LinearPage* pPage = nullptr;
+				size_t Offset = 0;
+				for (uint32_t i = 0; i < kAllocsPerFrame; ++i)
+				{
+					// 256B to 4K, 256B aligned, same mix as constant buffers and small uploads
+					size_t Size = ((NextRandom( Seed ) >> 12) % 16 + 1) * 256;
+					if (pPage == nullptr || Offset + Size > pPage->m_SizeInByte)
+					{
+						if (pPage != nullptr)
+						{
+							pPage->m_UsedBytes = Offset;
+							UsedPages.push_back( pPage );
+						}
+						pPage = Request();
+						Offset = 0;
+					}
+					Offset += Size;
+				}
+				pPage->m_UsedBytes = Offset;
+				UsedPages.push_back( pPage );
+				uint64_t Fence = NextFence.fetch_add( 1, std::memory_order_relaxed );
+				for (auto pUsed : UsedPages)
+				{
+					TrackedPage* pTracked = static_cast<TrackedPage*>( pUsed );
+					pTracked->m_DiscardFence.store( Fence, std::memory_order_relaxed );
+					pTracked->m_Owner.store( 0, std::memory_order_relaxed );
+				}
+				Pool.DiscardPages( Fence, UsedPages );
+				UsedPages.clear();
+				// Stand-in for the GPU, keeps a few frames in flight
+				if (Fence > kFramesInFlight * NumThreads)
+					Fences.Complete( Fence - kFramesInFlight * NumThreads );
+			}
+			NumRequests += ThreadRequests;
+		};
+
+		// Every worker on a thread of its own, so all of them exit and hand their magazines back
+		auto Start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> Threads;
+		for (uint32_t i = 0; i < NumThreads; ++i)
+			Threads.emplace_back( Worker, i );
+		for (auto& Thread : Threads)
+			Thread.join();
+		std::chrono::duration<double> Elapsed = std::chrono::high_resolution_clock::now() - Start;
+		Fences.Complete( NextFence - 1 );
+
+		ThreadedRun Run;
+		Run.AllocsPerSec = (double)NumThreads * FramesPerThread * kAllocsPerFrame / (std::max)( Elapsed.count(), 1e-9 );
+		Run.NumRequests = NumRequests;
+		Run.NumDuplicated = NumDuplicated;
+		Run.NumEarly = NumEarly;
+		return Run;
+	}
+
+	double CheckThreads( bool UseMagazines, uint32_t NumThreads, uint32_t FramesPerThread, std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "linear-page-pool", " with " + std::to_string( NumThreads ) + (UseMagazines ? " threads and magazines" : " threads without magazines") );
+
+		FakeBackingStore Store;
+		FakeFences Fences;
+		LinearPagePool Pool( kClassSizes, kNumClasses );
+		Pool.SetBackend( &Store, &Fences );
+		Pool.SetUseMagazines( UseMagazines );
+		ThreadedRun Run = RunThreads( Pool, Fences, NumThreads, FramesPerThread );
+		Check( Run.NumDuplicated == 0, "no page held by two threads" );
+		Check( Run.NumEarly == 0, "no page handed out before its fence" );
+		Check( Store.m_NumCreated < Run.NumRequests / 2 || Run.NumRequests < 64, "pages reused" );
+
+		// The threads are gone, their magazines went back to the shared recyclers in a batch
+		LinearPageClassStats Stats = Pool.GetStats( 0 );
+		Check( Stats.NumPages == Store.GetNumAlive() && Stats.NumPages == Store.m_NumCreated, "pages counted once the threads exited" );
+		Check( Stats.NumRetired == Run.NumRequests, "retired pages of exited threads published" );
+		Pool.ReclaimCompleted();
+		Check( Pool.GetStats( 0 ).NumAvailable == (std::min)( Stats.NumPages, (uint32_t)FenceRecycler<LinearPage>::kDefaultCapacity ),
+			"every page ready again once the threads exited" );
+		Pool.Destroy();
+		Check( Store.GetNumAlive() == 0 && Store.m_NumBadDestroys == 0, "every page released once" );
+		return Run.AllocsPerSec;
+	}
+
+	void CheckPool( bool UseMagazines, std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "linear-page-pool", (UseMagazines ? " with magazines" : " without magazines") );
+		CheckReuse( UseMagazines, Check );
+		CheckLargePages( UseMagazines, Check );
+		CheckWasteStats( UseMagazines, Check );
+	}
+}
+
+uint64_t RunLinearPagePoolTests( int argc, char* argv[] )
+{
+	const uint32_t MaxThreads = GetCountArg( argc, argv, 1, (std::max)( 4u, std::thread::hardware_concurrency() ) );
+	const uint32_t FramesPerThread = GetCountArg( argc, argv, 2, 2000 );
+	if (!MaxThreads || !FramesPerThread)
+	{
+		fprintf( stderr, "Bad thread or frame count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckSizeClasses( Checker( Failures, "linear-page-pool" ) );
+	CheckPool( false, Failures );
+	// A thread of its own, so its magazines start empty
+	std::thread( [&Failures]() { CheckPool( true, Failures ); } ).join();
+
+	printf( "Threads  Magazines Mallocs/s  Shared Mallocs/s\n" );
+	for (uint32_t NumThreads = 1; NumThreads <= MaxThreads; NumThreads *= 2)
+	{
+		const double MagazineAllocsPerSec = CheckThreads( true, NumThreads, FramesPerThread, Failures );
+		const double SharedAllocsPerSec = CheckThreads( false, NumThreads, FramesPerThread, Failures );
+		printf( "%7u %20.2f %17.2f\n", NumThreads, MagazineAllocsPerSec / 1e6, SharedAllocsPerSec / 1e6 );
+	}
+	return ReportFailures( Failures );
+}
@@ -0,0 +1,91 @@
+// Checks and benchmarks of the parts of UtilityLibrary which build without D3D12, one file per area.
+// Without arguments every area runs with its defaults; with an area name only that one runs, given
+// the arguments after the name. The exit code is 1 when any check failed or any error was seen.
+//
+// Standalone, builds on Linux with
+//   U=../UtilityLibrary
+//   g++ -std=c++17 -O2 -I$U -I../BoidsSimulation *.cpp $U/AllocationTrace.cpp $U/GpuQueue.cpp $U/GpuQueueBackend.cpp
+//       $U/SimulatedGpuTimeline.cpp $U/FramePacer.cpp $U/CommandListBatch.cpp
+//       $U/FenceNotifier.cpp
+//       $U/BarrierOptimizer.cpp $U/RenderGraph.cpp
+//       $U/TransientPacker.cpp
+//       $U/PipelineCache.cpp $U/ShaderCacheKey.cpp
+//       $U/DescriptorRangeAllocator.cpp $U/BindlessIndexAllocator.cpp
+//       $U/DescriptorTableLRU.cpp $U/DescriptorHeapTierPolicy.cpp $U/LinearPagePool.cpp $U/UploadRing.cpp $U/DescriptorBlockRing.cpp
+//       $U/TaskScheduler.cpp ../BoidsSimulation/BoidsAsyncCompute.cpp ../BoidsSimulation/BoidsEngine.cpp
+//       ../BoidsSimulation/BoidsKernel.cpp ../BoidsSimulation/BoidsReplay.cpp
+//       -o UtilityTests -pthread
+//
+// Usage: UtilityTests [area [args]]
+//        UtilityTests -list
+
+#include "UtilityTests.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+	struct TestArea
+	{
+		const char*	Name;
+		const char*	Args;
+		uint64_t	(*Run)( int argc, char* argv[] );
+	};
+
+	const TestArea kAreas[] =
+	{
+		{ "gpu-timeline",		"[CpuFrameMs] [SubmitLatencyMs]",	RunGpuTimelineTests },
+		{ "command-list-batch",	"[MaxThreads]",						RunCommandListBatchTests },
+		{ "fence-notifier",		"[NumFences]",						RunFenceNotifierTests },
+		{ "barrier-optimizer",	"[NumFrames]",						RunBarrierOptimizerTests },
+		{ "render-graph",		"[NumSeeds]",						RunRenderGraphTests },
+		{ "transient-packer",	"[NumSeeds]",						RunTransientPackerTests },
+		{ "pipeline-cache",		"",									RunPipelineCacheTests },
+		{ "shader-cache",		"",									RunShaderCacheTests },
+		{ "descriptor-range-allocator",	"[NumOps]",				RunDescriptorRangeAllocatorTests },
+		{ "bindless-index-allocator",	"[NumOps]",				RunBindlessIndexAllocatorTests },
+		{ "descriptor-table-lru",	"[NumBinds]",				RunDescriptorTableLRUTests },
+		{ "descriptor-heap-tier-policy",	"[NumFrames]",		RunDescriptorHeapTierPolicyTests },
+		{ "boids-async-compute",	"[NumFrames] [NumSeeds]",	RunBoidsAsyncComputeTests },
+		{ "null-device",			"[NumFrames]",				RunNullDeviceTests },
+		{ "descriptor-block-ring",	"[MaxThreads] [CmdListsPerThread]",	RunDescriptorBlockRingTests },
+		{ "fence-recycler",			"[MaxThreads] [OpsPerThread]",		RunFenceRecyclerTests },
+		{ "linear-page-pool",		"[MaxThreads] [FramesPerThread]",	RunLinearPagePoolTests },
+		{ "upload-allocator",		"[NumFrames]",						RunUploadAllocatorTests },
+		{ "task-scheduler",			"[MaxThreads]",						RunTaskSchedulerTests },
+		{ "boids-engine",			"[MaxThreads] [NumSteps]",			RunBoidsEngineTests },
+	};
+}
+
+int main( int argc, char* argv[] )
+{
+	if (argc > 1 && strcmp( argv[1], "-list" ) == 0)
+	{
+		for (auto& Area : kAreas)
+			printf( "%-28s %s\n", Area.Name, Area.Args );
+		return 0;
+	}
+	if (argc > 1)
+	{
+		for (auto& Area : kAreas)
+		{
+			if (strcmp( argv[1], Area.Name ) == 0)
+				return Area.Run( argc - 1, argv + 1 ) == 0 ? 0 : 1;
+		}
+		fprintf( stderr, "Unknown area %s, -list shows them\n", argv[1] );
+		return 1;
+	}
+
+	uint32_t NumFailed = 0;
+	for (auto& Area : kAreas)
+	{
+		printf( "== %s\n", Area.Name );
+		char* AreaArgv[] = { (char*)Area.Name, nullptr };
+		const uint64_t NumErrors = Area.Run( 1, AreaArgv );
+		printf( "== %s %s\n\n", Area.Name, NumErrors == 0 ? "passed" : "FAILED" );
+		NumFailed += NumErrors != 0;
+	}
+	printf( "Areas failed: %u of %u\n", NumFailed, (uint32_t)(sizeof( kAreas ) / sizeof( kAreas[0] )) );
+	return NumFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,351 @@
+// A headless frame loop over NullDeviceBackend and NullQueueBackend, set up the way CommandContext
+// and the allocators are on D3D12: LinearPagePool pages come from the device backend and are retired
+// with the queue's fences, descriptor ranges are taken from heaps the backend created, and command
+// lists are created, recorded, closed, submitted and reset through IGpuCommandList. Every list must
+// hold what was recorded into it, every submission must name the lists submitted, pages must come
+// back once their fence passed and not before, and destroying everything must leave nothing alive.
+// Then the same loop runs with frames in flight on a SimulatedGpuTimeline queue slower than the CPU:
+// command lists are reset only once their frame's fence completed, and no page or block of the
+// shared shader-visible DescriptorBlockRing comes back while the GPU may still read it.
+// CommandContext and DynamicDescriptorHeap themselves need D3D12, these are the parts they sit on.
+// The frames are a stand-in loop of three lists, not BoidsSimulation's or VolumetricAnimation's:
+// their barriers, PSOs, root signatures and resources don't go through the backend yet.
+
+#include "UtilityTests.h"
+#include "GpuQueue.h"
+#include "GpuQueueBackend.h"
+#include "LinearPagePool.h"
+#include "DescriptorRangeAllocator.h"
+#include "DescriptorBlockRing.h"
+#include "SimulatedGpuTimeline.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+namespace
+{
+	// D3D12_COMMAND_LIST_TYPE_DIRECT and D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV
+	const uint32_t kDirect = 0;
+	const uint32_t kCbvSrvUav = 0;
+	const uint32_t kNumLists = 3;
+	const uint32_t kStagingCapacity = 64;
+	const uint32_t kTableSize = 4;
+	const uint32_t kFramesInFlight = 3;
+	const uint32_t kRingCapacity = 1024;
+	const uint32_t kBlockSize = 64;
+
+	// What LinearAllocatorPageMngr does on D3D12
+	class PageStore : public ILinearPageBackingStore
+	{
+	public:
+		explicit PageStore( IGpuDeviceBackend& Device ) :m_Device( Device ) {}
+		virtual LinearPage* CreatePage( size_t SizeInByte ) override { return m_Device.CreateLinearPage( SizeInByte, true ); }
+		virtual void DestroyPage( LinearPage* pPage ) override { m_Device.DestroyLinearPage( pPage ); }
+
+	private:
+		IGpuDeviceBackend&	m_Device;
+	};
+
+	// Stands in for ID3D12RootSignature and ID3D12PipelineState
+	int g_RootSignature;
+	int g_PipelineState;
+
+	// Records a draw like GraphicsContext does, on a list created or reset into its allocator
+	void RecordDraw( IGpuCommandList& List, uint32_t Frame, uint32_t Index, const GpuDescriptorHeap& Visible,
+		uint64_t TableHandle, uint64_t ConstantAddress )
+	{
+		void* pHeap = Visible.pNative;
+		List.SetDescriptorHeaps( 1, &pHeap );
+		List.SetRootSignature( false, &g_RootSignature );
+		List.SetPipelineState( &g_PipelineState );
+		const uint32_t Constants[3] = { Frame, Index, 7 };
+		List.SetRootConstants( false, 0, 3, Constants, 0 );
+		List.SetRootView( false, 1, IGpuCommandList::kConstantBufferView, ConstantAddress );
+		List.SetRootDescriptorTable( false, 2, TableHandle );
+		List.DrawIndexed( 36, 1 + Index, 0, -4, 0 );
+	}
+
+	bool HoldsDraw( const NullCommandList& List, uint32_t Frame, uint32_t Index, const GpuDescriptorHeap& Visible,
+		uint64_t TableHandle, uint64_t ConstantAddress )
+	{
+		const std::vector<NullCommandList::Command>& Commands = List.GetCommands();
+		const std::vector<uint32_t>& Constants = List.GetConstants();
+		if (Commands.size() != 7 || Constants.size() != 3)
+			return false;
+		const NullCommandList::Command& Table = Commands[5];
+		const NullCommandList::Command& Draw = Commands[6];
+		return Commands[0].Op == NullCommandList::kSetDescriptorHeaps && Commands[0].Args[0] == 1 &&
+			Commands[0].Values[0] == (uint64_t)(uintptr_t)Visible.pNative &&
+			Commands[1].Op == NullCommandList::kSetRootSignature && Commands[1].Args[0] == 0 &&
+			Commands[1].Values[0] == (uint64_t)(uintptr_t)&g_RootSignature &&
+			Commands[2].Op == NullCommandList::kSetPipelineState && Commands[2].Values[0] == (uint64_t)(uintptr_t)&g_PipelineState &&
+			Commands[3].Op == NullCommandList::kSetRootConstants && Commands[3].Args[2] == 3 && Commands[3].Args[4] == 0 &&
+			Constants[0] == Frame && Constants[1] == Index && Constants[2] == 7 &&
+			Commands[4].Op == NullCommandList::kSetRootView && Commands[4].Args[1] == 1 &&
+			Commands[4].Args[2] == IGpuCommandList::kConstantBufferView && Commands[4].Values[0] == ConstantAddress &&
+			Table.Op == NullCommandList::kSetRootDescriptorTable && Table.Args[1] == 2 && Table.Values[0] == TableHandle &&
+			Draw.Op == NullCommandList::kDrawIndexed && Draw.Args[0] == 36 && Draw.Args[1] == 1 + Index &&
+			(int32_t)Draw.Args[3] == -4;
+	}
+
+	void CheckFrames( uint32_t NumFrames, std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "frames" );
+
+		NullDeviceBackend Device;
+		GpuQueue Queue( kDirect );
+		NullQueueBackend QueueBackend( Queue.GetInitialFence() );
+		Queue.Create( &QueueBackend );
+		PageStore Store( Device );
+		const size_t ClassSizes[2] = { 0x10000, 0x200000 };
+		LinearPagePool Pool( ClassSizes, 2 );
+		Pool.SetBackend( &Store, &Queue );
+
+		// Staging heaps are chained as needed, the tables are copied to one shader-visible heap
+		std::vector<GpuDescriptorHeap> StagingHeaps;
+		DescriptorRangeChain Chain;
+		Chain.Create( kStagingCapacity, NullDeviceBackend::kDescriptorSize, [&]( uint32_t )
+		{
+			StagingHeaps.push_back( Device.CreateDescriptorHeap( kCbvSrvUav, kStagingCapacity, false ) );
+			return StagingHeaps.back().CpuBase;
+		} );
+		const GpuDescriptorHeap Visible = Device.CreateDescriptorHeap( kCbvSrvUav, kNumLists * kTableSize, true );
+		Check( StagingHeaps.size() == 1 && StagingHeaps[0].GpuBase == 0 && Visible.GpuBase != 0, "heap addresses" );
+
+		// One allocator per list, the allocators themselves stay D3D12 only
+		int Allocators[kNumLists];
+		IGpuCommandList* Lists[kNumLists];
+		for (uint32_t i = 0; i < kNumLists; ++i)
+			Lists[i] = Device.CreateCommandList( kDirect, &Allocators[i] );
+		Check( Device.GetStats().NumLists == kNumLists, "lists alive" );
+
+		uint64_t LastFence = Queue.GetInitialFence();
+		for (uint32_t Frame = 0; Frame < NumFrames && Failures.empty(); ++Frame)
+		{
+			std::vector<LinearPage*> Pages;
+			uint64_t Ranges[kNumLists];
+			void* NativeLists[kNumLists];
+			for (uint32_t i = 0; i < kNumLists; ++i)
+			{
+				NullCommandList& Recorded = *(NullCommandList*)Lists[i];
+				if (Frame > 0)
+					Lists[i]->Reset( &Allocators[i] );
+				Check( !Recorded.IsClosed() && Recorded.GetCommands().empty() && Recorded.GetNumResets() == Frame &&
+					Recorded.GetAllocator() == &Allocators[i], "list not reset into its allocator" );
+
+				LinearPage* pPage = Pool.RequestPage( 0 );
+				Pages.push_back( pPage );
+				if (!Check( pPage->m_CpuVirtualAddr != nullptr && pPage->m_SizeInByte == ClassSizes[0] &&
+					pPage->m_GpuVirtualAddr % LinearPagePool::kLargePageAlign == 0, "page" ))
+					break;
+				memset( pPage->m_CpuVirtualAddr, (int)(Frame + i), 256 );
+				pPage->m_UsedBytes = 256;
+
+				Ranges[i] = Chain.Allocate( kTableSize + Frame % 3 );
+				const uint64_t TableHandle = Visible.GpuBase + (uint64_t)i * kTableSize * NullDeviceBackend::kDescriptorSize;
+				RecordDraw( *Lists[i], Frame, i, Visible, TableHandle, pPage->m_GpuVirtualAddr );
+				Lists[i]->Close();
+				Check( Recorded.IsClosed(), "list not closed" );
+				Check( HoldsDraw( Recorded, Frame, i, Visible, TableHandle, pPage->m_GpuVirtualAddr ), "recorded commands" );
+				NativeLists[i] = Lists[i]->GetNativeList();
+			}
+			if (!Failures.empty())
+				break;
+
+			const uint64_t Fence = Queue.Execute( kNumLists, NativeLists );
+			Check( Fence == LastFence + 1 && Queue.IsFenceComplete( Fence ), "fence" );
+			LastFence = Fence;
+			const std::vector<NullQueueBackend::Submission> Submissions = QueueBackend.GetSubmissions();
+			const std::vector<void*> Submitted = QueueBackend.GetSubmittedLists();
+			if (Check( Submissions.size() == Frame + 1, "submission count" ))
+			{
+				const NullQueueBackend::Submission& Last = Submissions.back();
+				Check( Last.FenceValue == Fence && Last.NumLists == kNumLists, "submission" );
+				for (uint32_t i = 0; i < kNumLists && Last.FirstList + i < Submitted.size(); ++i)
+					Check( (NullCommandList*)Submitted[Last.FirstList + i] == (NullCommandList*)Lists[i], "submitted list not the recorder" );
+			}
+			Pool.DiscardPages( Fence, Pages );
+			for (uint32_t i = 0; i < kNumLists; ++i)
+				Chain.Free( Ranges[i], kTableSize + Frame % 3 );
+		}
+		// Every frame's pages had completed by the next, so the first frame's are all it took
+		Check( Device.GetStats().NumPagesCreated <= kNumLists, "pages not reused once their fence passed" );
+		Check( Chain.GetNumHeaps() == 1 && StagingHeaps.size() == 1, "staging heaps not reused" );
+
+		// A page retired with a fence not yet signaled stays retired until it is
+		LinearPagePool Pending( ClassSizes, 2 );
+		Pending.SetBackend( &Store, &Queue );
+		const uint64_t NumCreated = Device.GetStats().NumPagesCreated;
+		LinearPage* pFirst = Pending.RequestPage( 1 );
+		Pending.DiscardPages( Queue.GetNextFenceValue(), std::vector<LinearPage*>( 1, pFirst ) );
+		LinearPage* pSecond = Pending.RequestPage( 1 );
+		Check( pSecond != pFirst && Device.GetStats().NumPagesCreated == NumCreated + 2, "page reused before its fence" );
+		Queue.Signal();
+		Pending.DiscardPages( Queue.GetNextFenceValue(), std::vector<LinearPage*>( 1, pSecond ) );
+		LinearPage* pThird = Pending.RequestPage( 1 );
+		Check( pThird == pFirst, "page not reused once its fence passed" );
+		Pending.DiscardPages( Queue.Signal(), std::vector<LinearPage*>( 1, pThird ) );
+
+		Pending.Destroy();
+		Pool.Destroy();
+		for (auto& Heap : StagingHeaps)
+			Device.DestroyDescriptorHeap( Heap );
+		Device.DestroyDescriptorHeap( Visible );
+		for (uint32_t i = 0; i < kNumLists; ++i)
+			Device.DestroyCommandList( Lists[i] );
+		const NullDeviceStats Stats = Device.GetStats();
+		Check( Stats.NumPages == 0 && Stats.PageBytes == 0 && Stats.NumHeaps == 0 && Stats.NumDescriptors == 0 &&
+			Stats.NumLists == 0, "device objects left once destroyed" );
+		Check( Stats.NumHeapsCreated == 2 && Stats.NumListsCreated == kNumLists, "created counts" );
+		Queue.Destroy();
+	}
+
+	// Three lists a frame take 1.2ms of GPU time against 0.3ms of CPU time, so the CPU runs
+	// kFramesInFlight frames ahead and waits on the oldest one's fence before reusing its lists
+	void CheckFramesInFlight( uint32_t NumFrames, std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "frames in flight" );
+
+		NullDeviceBackend Device;
+		SimulatedGpuTimeline Timeline;
+		const SimulatedQueueConfig Config = { 50.0, 400.0 };
+		Timeline.Configure( kDirect, Config );
+		GpuQueue Queue( kDirect );
+		Queue.Create( Timeline.GetBackend( kDirect ) );
+		PageStore Store( Device );
+		const size_t ClassSizes[2] = { 0x10000, 0x200000 };
+		LinearPagePool Pool( ClassSizes, 2 );
+		Pool.SetBackend( &Store, &Queue );
+		const GpuDescriptorHeap Visible = Device.CreateDescriptorHeap( kCbvSrvUav, kRingCapacity, true );
+		DescriptorBlockRing Ring;
+		Ring.Create( kRingCapacity, &Queue );
+
+		// One allocator per list of a frame slot, like CommandQueue's allocator pool
+		int Allocators[kFramesInFlight][kNumLists];
+		IGpuCommandList* Lists[kFramesInFlight][kNumLists];
+		uint64_t SlotFences[kFramesInFlight];
+		for (uint32_t Slot = 0; Slot < kFramesInFlight; ++Slot)
+		{
+			for (uint32_t i = 0; i < kNumLists; ++i)
+				Lists[Slot][i] = Device.CreateCommandList( kDirect, &Allocators[Slot][i] );
+			SlotFences[Slot] = Queue.GetInitialFence();
+		}
+
+		std::map<LinearPage*, uint64_t> PageFences;		// Of the last frame which used the page
+		std::vector<std::pair<DescriptorBlock, uint64_t>> Blocks;	// Still in flight, with their fence
+		uint32_t NumQueued = 0;
+		for (uint32_t Frame = 0; Frame < NumFrames && Failures.empty(); ++Frame)
+		{
+			const uint32_t Slot = Frame % kFramesInFlight;
+			double StallMs;
+			Queue.WaitForFence( SlotFences[Slot], StallMs );
+			Check( Queue.IsFenceComplete( SlotFences[Slot] ), "frame slot reused before its fence" );
+
+			std::vector<LinearPage*> Pages;
+			DescriptorBlock FrameBlocks[kNumLists];
+			void* NativeLists[kNumLists];
+			for (uint32_t i = 0; i < kNumLists; ++i)
+			{
+				NullCommandList& Recorded = *(NullCommandList*)Lists[Slot][i];
+				if (Frame >= kFramesInFlight)
+					Lists[Slot][i]->Reset( &Allocators[Slot][i] );
+
+				LinearPage* pPage = Pool.RequestPage( 0 );
+				auto Used = PageFences.find( pPage );
+				Check( Used == PageFences.end() || Queue.IsFenceComplete( Used->second ), "page reused before its fence" );
+				Pages.push_back( pPage );
+
+				DescriptorBlock& Block = FrameBlocks[i];
+				if (!Check( Ring.Reserve( kBlockSize, Block ), "descriptor block reserved" ))
+					break;
+				for (auto& InFlight : Blocks)
+					if (!Queue.IsFenceComplete( InFlight.second ))
+						Check( Block.Offset + Block.Count <= InFlight.first.Offset ||
+							InFlight.first.Offset + InFlight.first.Count <= Block.Offset, "descriptor block reused before its fence" );
+
+				const uint64_t TableHandle = Visible.GpuBase + (uint64_t)Block.Offset * NullDeviceBackend::kDescriptorSize;
+				RecordDraw( *Lists[Slot][i], Frame, i, Visible, TableHandle, pPage->m_GpuVirtualAddr );
+				Lists[Slot][i]->Close();
+				Check( HoldsDraw( Recorded, Frame, i, Visible, TableHandle, pPage->m_GpuVirtualAddr ), "recorded commands" );
+				NativeLists[i] = Lists[Slot][i]->GetNativeList();
+			}
+			if (!Failures.empty())
+				break;
+
+			Timeline.AdvanceCpu( 300.0 );
+			const uint64_t Fence = Queue.Execute( kNumLists, NativeLists );
+			SlotFences[Slot] = Fence;
+			NumQueued += Frame > 0 && !Queue.IsFenceComplete( Fence - 1 );
+			for (LinearPage* pPage : Pages)
+				PageFences[pPage] = Fence;
+			Pool.DiscardPages( Fence, Pages );
+			Ring.Retire( FrameBlocks, kNumLists, Fence );
+			Blocks.erase( std::remove_if( Blocks.begin(), Blocks.end(), [&]( const std::pair<DescriptorBlock, uint64_t>& InFlight )
+			{
+				return Queue.IsFenceComplete( InFlight.second );
+			} ), Blocks.end() );
+			for (uint32_t i = 0; i < kNumLists; ++i)
+				Blocks.push_back( std::make_pair( FrameBlocks[i], Fence ) );
+		}
+		printf( "%u frames in flight: %u of %u frames queued behind the last, %llu stalls\n", kFramesInFlight, NumQueued,
+			NumFrames, (unsigned long long)Timeline.GetNumStalls() );
+		Check( NumQueued + 1 >= NumFrames && Timeline.GetNumStalls() > 0, "CPU ahead of the GPU and waiting on it" );
+		Check( Device.GetStats().NumPagesCreated < NumFrames * kNumLists, "pages not reused" );
+		Check( Ring.GetStats().NumFailed == 0, "descriptor ring full" );
+
+		double StallMs;
+		Queue.WaitForFence( Queue.Signal(), StallMs );
+		Ring.Reclaim();
+		Check( Ring.GetStats().NumUsed == 0, "descriptor blocks left once the GPU finished" );
+		Ring.Destroy();
+		Pool.Destroy();
+		Device.DestroyDescriptorHeap( Visible );
+		for (uint32_t Slot = 0; Slot < kFramesInFlight; ++Slot)
+			for (uint32_t i = 0; i < kNumLists; ++i)
+				Device.DestroyCommandList( Lists[Slot][i] );
+		const NullDeviceStats Stats = Device.GetStats();
+		Check( Stats.NumPages == 0 && Stats.NumHeaps == 0 && Stats.NumLists == 0, "device objects left once destroyed" );
+		Queue.Destroy();
+	}
+
+	void CheckAddresses( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "addresses" );
+
+		// Pages, CPU and GPU descriptors of different objects never overlap
+		NullDeviceBackend Device;
+		LinearPage* pA = Device.CreateLinearPage( 0x10001, true );
+		LinearPage* pB = Device.CreateLinearPage( 0x100, false );
+		Check( pB->m_GpuVirtualAddr >= pA->m_GpuVirtualAddr + pA->m_SizeInByte && pB->m_CpuVirtualAddr == nullptr, "pages" );
+		const GpuDescriptorHeap A = Device.CreateDescriptorHeap( kCbvSrvUav, 10, true );
+		const GpuDescriptorHeap B = Device.CreateDescriptorHeap( kCbvSrvUav, 10, true );
+		Check( B.CpuBase >= A.CpuBase + 10 * NullDeviceBackend::kDescriptorSize &&
+			B.GpuBase >= A.GpuBase + 10 * NullDeviceBackend::kDescriptorSize, "heaps" );
+		Check( A.CpuBase != A.GpuBase && A.CpuBase != pA->m_GpuVirtualAddr && A.GpuBase != pA->m_GpuVirtualAddr, "kinds of address" );
+		Check( Device.GetDescriptorSize( kCbvSrvUav ) == NullDeviceBackend::kDescriptorSize, "descriptor size" );
+		Device.DestroyLinearPage( pA );
+		Device.DestroyLinearPage( pB );
+		Device.DestroyDescriptorHeap( A );
+		Device.DestroyDescriptorHeap( B );
+		Check( Device.GetStats().NumPages == 0 && Device.GetStats().NumHeaps == 0, "destroy" );
+	}
+}
+
+// [NumFrames]
+uint64_t RunNullDeviceTests( int argc, char* argv[] )
+{
+	const uint32_t NumFrames = GetCountArg( argc, argv, 1, 1000 );
+	if (NumFrames == 0)
+	{
+		fprintf( stderr, "Bad frame count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckAddresses( Failures );
+	CheckFrames( NumFrames, Failures );
+	CheckFramesInFlight( NumFrames, Failures );
+	printf( "%u headless frames of %u command lists\n", NumFrames, kNumLists );
+	return ReportFailures( Failures );
+}
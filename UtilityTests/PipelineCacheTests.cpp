@@ -0,0 +1,336 @@
+// PipelineCache over what a cache file can run into: missing, of another version or device,
+// truncated, corrupt, invalidated and merged, every blob compared with the one saved, and FindCopy()
+// racing Add() of the same key. Then what it costs at startup and shutdown, with fake blobs of 4 to
+// 64 KB standing in for pipeline states: saving 16, 256 and 4096 of them, loading the file, the
+// first lookup of each blob (which checks its CRC) and lookups after, against reading the whole file
+// with fread() as a cache without mapping would. Scratch files go to the working directory and are
+// removed.
+
+#include "UtilityTests.h"
+#include "PipelineCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	const char* kScratchPath = "PipelineCacheScratch.bin";
+	const uint64_t kDeviceKey = 0x1002687f00000001ull;
+
+	struct FakeBlob
+	{
+		uint64_t				Key;
+		std::vector<uint8_t>	Bytes;
+	};
+
+	// Keys hashed from the index like content keys would be, bytes from the seed
+	void MakeFakeBlobs( std::vector<FakeBlob>& Blobs, uint32_t NumBlobs, uint32_t MinSize, uint32_t MaxSize, uint32_t Seed )
+	{
+		Blobs.resize( NumBlobs );
+		for (uint32_t i = 0; i < NumBlobs; ++i)
+		{
+			Blobs[i].Key = PipelineCacheHash( &i, sizeof( i ), PipelineCacheHash( &Seed, sizeof( Seed ) ) );
+			Blobs[i].Bytes.resize( MinSize + NextRandom( Seed ) % (MaxSize - MinSize + 1) );
+			for (auto& Byte : Blobs[i].Bytes)
+				Byte = (uint8_t)NextRandom( Seed );
+		}
+	}
+
+	bool SaveFakeBlobs( const std::vector<FakeBlob>& Blobs, uint64_t DeviceKey )
+	{
+		PipelineCache Cache;
+		Cache.Load( kScratchPath, DeviceKey );
+		for (auto& Blob : Blobs)
+			Cache.Add( Blob.Key, Blob.Bytes.data(), Blob.Bytes.size() );
+		return Cache.Save( kScratchPath );
+	}
+
+	bool HasBlob( PipelineCache& Cache, const FakeBlob& Blob )
+	{
+		const void* Data;
+		size_t Size;
+		return Cache.Find( Blob.Key, Data, Size ) && Size == Blob.Bytes.size() && memcmp( Data, Blob.Bytes.data(), Size ) == 0;
+	}
+
+	uint32_t NumBlobsFound( PipelineCache& Cache, const std::vector<FakeBlob>& Blobs )
+	{
+		uint32_t NumFound = 0;
+		for (auto& Blob : Blobs)
+			NumFound += HasBlob( Cache, Blob );
+		return NumFound;
+	}
+
+	bool ReadScratch( std::vector<uint8_t>& Bytes )
+	{
+		Bytes.clear();
+		FILE* pFile = fopen( kScratchPath, "rb" );
+		if (pFile == nullptr)
+			return false;
+		fseek( pFile, 0, SEEK_END );
+		const long Size = ftell( pFile );
+		fseek( pFile, 0, SEEK_SET );
+		Bytes.resize( Size > 0 ? (size_t)Size : 0 );
+		const bool Read = fread( Bytes.data(), 1, Bytes.size(), pFile ) == Bytes.size();
+		fclose( pFile );
+		return Read;
+	}
+
+	bool WriteScratch( const std::vector<uint8_t>& Bytes )
+	{
+		FILE* pFile = fopen( kScratchPath, "wb" );
+		if (pFile == nullptr)
+			return false;
+		const bool Written = fwrite( Bytes.data(), 1, Bytes.size(), pFile ) == Bytes.size();
+		return fclose( pFile ) == 0 && Written;
+	}
+
+	double Elapsed( std::chrono::high_resolution_clock::time_point Start )
+	{
+		return std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - Start ).count();
+	}
+
+	void CheckCacheFiles( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "pipeline-cache" );
+
+		// Known values
+		Check( PipelineCacheCrc( "123456789", 9 ) == 0xcbf43926, "hash: crc-32" );
+		Check( PipelineCacheHash( "a", 1 ) == 0xaf63dc4c8601ec8cull, "hash: fnv-1a" );
+
+		std::vector<FakeBlob> Blobs;
+		MakeFakeBlobs( Blobs, 40, 1, 3000, 7 );
+		std::vector<uint8_t> Bytes;
+		PipelineCache Cache;
+
+		// No file yet, then every blob comes back as saved
+		{
+			remove( kScratchPath );
+			Check( Cache.Load( kScratchPath, kDeviceKey ) == kCacheMissing && Cache.GetNumEntries() == 0, "round trip: missing" );
+			Check( SaveFakeBlobs( Blobs, kDeviceKey ), "round trip: saved" );
+			Check( Cache.Load( kScratchPath, kDeviceKey ) == kCacheLoaded && Cache.GetNumEntries() == 40, "round trip: loaded" );
+			Check( NumBlobsFound( Cache, Blobs ) == 40, "round trip: found" );
+			const void* Data;
+			size_t Size;
+			const uint64_t Unknown = 12345;
+			Check( !Cache.Find( Unknown, Data, Size ), "round trip: unknown key" );
+			PipelineCacheStats Stats = Cache.GetStats();
+			Check( Stats.NumLoaded == 40 && Stats.NumHits == 40 && Stats.NumMisses == 1 && Stats.NumCorrupt == 0, "round trip: stats" );
+			Cache.Close();
+
+			// Blobs added are found before they are saved, and an empty cache saves too
+			PipelineCache Empty;
+			Check( Empty.Load( "PipelineCacheNotThere.bin", kDeviceKey ) == kCacheMissing, "empty: missing" );
+			Empty.Add( Blobs[0].Key, Blobs[0].Bytes.data(), Blobs[0].Bytes.size() );
+			Check( HasBlob( Empty, Blobs[0] ), "empty: added found" );
+			Empty.Invalidate( Blobs[0].Key );
+			Check( !HasBlob( Empty, Blobs[0] ) && Empty.Save( kScratchPath ), "empty: saved" );
+			Check( Empty.Load( kScratchPath, kDeviceKey ) == kCacheLoaded && Empty.GetNumEntries() == 0, "empty: loaded" );
+			Empty.Close();
+		}
+
+		// Another device, version or no cache at all leaves every blob out
+		{
+			Check( SaveFakeBlobs( Blobs, kDeviceKey ), "mismatch: saved" );
+			Check( Cache.Load( kScratchPath, kDeviceKey + 1 ) == kCacheOtherDevice && NumBlobsFound( Cache, Blobs ) == 0, "mismatch: device" );
+			Cache.Close();
+			ReadScratch( Bytes );
+			std::vector<uint8_t> Patched = Bytes;
+			((PipelineCacheHeader*)Patched.data())->Version = kPipelineCacheVersion + 1;
+			WriteScratch( Patched );
+			Check( Cache.Load( kScratchPath, kDeviceKey ) == kCacheOldVersion && NumBlobsFound( Cache, Blobs ) == 0, "mismatch: version" );
+			Cache.Close();
+			Patched = Bytes;
+			Patched[0] ^= 0xff;
+			WriteScratch( Patched );
+			Check( Cache.Load( kScratchPath, kDeviceKey ) == kCacheNotACache, "mismatch: magic" );
+			Cache.Close();
+			Patched.assign( 7, 0 );
+			WriteScratch( Patched );
+			Check( Cache.Load( kScratchPath, kDeviceKey ) == kCacheNotACache, "mismatch: too small" );
+			Cache.Close();
+
+			// A file from another device is replaced by the next Save()
+			WriteScratch( Bytes );
+			Cache.Load( kScratchPath, kDeviceKey + 1 );
+			Cache.Add( Blobs[0].Key, Blobs[0].Bytes.data(), Blobs[0].Bytes.size() );
+			Check( Cache.Save( kScratchPath ) && Cache.Load( kScratchPath, kDeviceKey + 1 ) == kCacheLoaded && Cache.GetNumEntries() == 1,
+				"mismatch: replaced" );
+			Cache.Close();
+		}
+
+		// Truncated and corrupt files
+		{
+			WriteScratch( Bytes );
+			std::vector<uint8_t> Patched( Bytes.begin(), Bytes.end() - 1 );
+			WriteScratch( Patched );
+			Check( Cache.Load( kScratchPath, kDeviceKey ) == kCacheTruncated && NumBlobsFound( Cache, Blobs ) == 0, "truncated: end" );
+			Cache.Close();
+			Patched.assign( Bytes.begin(), Bytes.begin() + sizeof( PipelineCacheHeader ) + 10 );
+			((PipelineCacheHeader*)Patched.data())->FileSize = Patched.size();
+			WriteScratch( Patched );
+			Check( Cache.Load( kScratchPath, kDeviceKey ) == kCacheTruncated, "truncated: table" );
+			Cache.Close();
+
+			Patched = Bytes;
+			Patched[sizeof( PipelineCacheHeader ) + 3] ^= 1;
+			WriteScratch( Patched );
+			Check( Cache.Load( kScratchPath, kDeviceKey ) == kCacheCorrupt && NumBlobsFound( Cache, Blobs ) == 0, "corrupt: table" );
+			Cache.Close();
+
+			// A blob failing its CRC is a miss and dropped by the next Save(), the others stay
+			Patched = Bytes;
+			const PipelineCacheEntry* pEntries = (const PipelineCacheEntry*)(Bytes.data() + sizeof( PipelineCacheHeader ));
+			uint32_t Damaged = 0;
+			for (uint32_t i = 0; i < Blobs.size(); ++i)
+				Damaged = Blobs[i].Key == pEntries[5].Key ? i : Damaged;
+			Patched[pEntries[5].Offset + pEntries[5].Size / 2] ^= 0x10;
+			WriteScratch( Patched );
+			Check( Cache.Load( kScratchPath, kDeviceKey ) == kCacheLoaded && !HasBlob( Cache, Blobs[Damaged] ) &&
+				NumBlobsFound( Cache, Blobs ) == 39 && Cache.GetStats().NumCorrupt == 1, "corrupt: blob" );
+			Check( Cache.Save( kScratchPath ) && Cache.Load( kScratchPath, kDeviceKey ) == kCacheLoaded && Cache.GetNumEntries() == 39 &&
+				NumBlobsFound( Cache, Blobs ) == 39, "corrupt: dropped" );
+			Cache.Close();
+		}
+
+		// Invalidated blobs are misses and not saved again, blobs added merge with the file
+		{
+			Check( SaveFakeBlobs( Blobs, kDeviceKey ), "merge: saved" );
+			Cache.Load( kScratchPath, kDeviceKey );
+			Cache.Invalidate( Blobs[3].Key );
+			Check( !HasBlob( Cache, Blobs[3] ) && Cache.GetStats().NumInvalidated == 1, "invalidate: miss" );
+
+			std::vector<FakeBlob> More;
+			MakeFakeBlobs( More, 10, 1, 3000, 8 );
+			for (auto& Blob : More)
+				Cache.Add( Blob.Key, Blob.Bytes.data(), Blob.Bytes.size() );
+			// Replaced under the same key
+			FakeBlob Replaced = Blobs[4];
+			Replaced.Bytes.assign( 100, 0x5a );
+			Cache.Add( Replaced.Key, Replaced.Bytes.data(), Replaced.Bytes.size() );
+			Check( HasBlob( Cache, Replaced ) && Cache.GetNumEntries() == 50, "merge: before save" );
+
+			Check( Cache.Save( kScratchPath ) && Cache.Load( kScratchPath, kDeviceKey ) == kCacheLoaded && Cache.GetNumEntries() == 49,
+				"merge: entries" );
+			Check( !HasBlob( Cache, Blobs[3] ), "invalidate: not saved" );
+			Check( HasBlob( Cache, Replaced ) && NumBlobsFound( Cache, More ) == 10 && NumBlobsFound( Cache, Blobs ) == 38, "merge: found" );
+			Cache.Close();
+		}
+
+		// FindCopy() racing Add() of the same key on another thread always copies one whole blob
+		{
+			PipelineCache Racing;
+			Racing.Load( "PipelineCacheNotThere.bin", kDeviceKey );
+			const std::vector<uint8_t> Small( 1 << 16, 0xaa ), Large( 1 << 17, 0xbb );
+			Racing.Add( 1, Small.data(), Small.size() );
+			std::atomic<bool> Done( false );
+			std::thread Adder( [&]()
+			{
+				for (uint32_t i = 0; i < 16384; ++i)
+				{
+					const std::vector<uint8_t>& Blob = i & 1 ? Small : Large;
+					Racing.Add( 1, Blob.data(), Blob.size() );
+				}
+				Done = true;
+			} );
+			std::vector<uint8_t> Copy;
+			uint32_t NumTorn = 0, NumFound = 0;
+			while (!Done)
+			{
+				const bool Found = Racing.FindCopy( 1, [&Copy]( size_t Size ) -> void*
+				{
+					Copy.resize( Size );
+					return Copy.data();
+				} );
+				NumFound += Found;
+				// Add() overwrites in place, a torn copy starts with one blob and ends with the other
+				const uint8_t Fill = Copy.size() == Small.size() ? 0xaa : 0xbb;
+				NumTorn += !Found || (Copy.size() != Small.size() && Copy.size() != Large.size()) ||
+					Copy.front() != Fill || Copy.back() != Fill;
+			}
+			Adder.join();
+			Check( NumFound > 0 && NumTorn == 0, "find copy: racing add" );
+			Check( !Racing.FindCopy( 1, []( size_t ) -> void* { return nullptr; } ), "find copy: no memory" );
+		}
+		remove( kScratchPath );
+	}
+
+	struct BenchmarkResult
+	{
+		uint32_t	NumBlobs;
+		uint64_t	FileBytes;
+		double		SaveMs;
+		double		LoadUs;					// Map and check the header and entry table
+		double		FirstFindUs;			// Per blob, checks its CRC
+		double		FindNs;					// Per lookup once checked
+		double		ReadAllUs;				// fread() of the whole file
+		uint64_t	NumErrors;				// Blobs missing or not what was saved
+	};
+
+	std::vector<BenchmarkResult> RunBenchmark()
+	{
+		typedef std::chrono::high_resolution_clock Clock;
+		const uint32_t NumBlobCounts[] = { 16, 256, 4096 };
+		const uint32_t kFindRounds = 16;
+		std::vector<BenchmarkResult> Results;
+		std::vector<FakeBlob> Blobs;
+		std::vector<uint8_t> FileBytes;
+		for (uint32_t NumBlobs : NumBlobCounts)
+		{
+			BenchmarkResult Result = {};
+			Result.NumBlobs = NumBlobs;
+			MakeFakeBlobs( Blobs, NumBlobs, 4096, 65536, NumBlobs );
+			remove( kScratchPath );
+
+			Clock::time_point Start = Clock::now();
+			Result.NumErrors += !SaveFakeBlobs( Blobs, kDeviceKey );
+			Result.SaveMs = Elapsed( Start ) * 1e3;
+
+			PipelineCache Cache;
+			Start = Clock::now();
+			Result.NumErrors += Cache.Load( kScratchPath, kDeviceKey ) != kCacheLoaded;
+			Result.LoadUs = Elapsed( Start ) * 1e6;
+
+			const void* Data;
+			size_t Size;
+			Start = Clock::now();
+			for (auto& Blob : Blobs)
+				Result.NumErrors += !Cache.Find( Blob.Key, Data, Size );
+			Result.FirstFindUs = Elapsed( Start ) * 1e6 / NumBlobs;
+
+			Start = Clock::now();
+			for (uint32_t Round = 0; Round < kFindRounds; ++Round)
+				for (auto& Blob : Blobs)
+					Result.NumErrors += !Cache.Find( Blob.Key, Data, Size );
+			Result.FindNs = Elapsed( Start ) * 1e9 / (NumBlobs * kFindRounds);
+			Result.NumErrors += NumBlobs - NumBlobsFound( Cache, Blobs );
+			Cache.Close();
+
+			Start = Clock::now();
+			ReadScratch( FileBytes );
+			Result.ReadAllUs = Elapsed( Start ) * 1e6;
+			Result.FileBytes = FileBytes.size();
+			Results.push_back( Result );
+		}
+		remove( kScratchPath );
+		return Results;
+	}
+}
+
+uint64_t RunPipelineCacheTests( int, char*[] )
+{
+	std::vector<std::string> Failures;
+	CheckCacheFiles( Failures );
+	printf( "%6s %9s %8s %9s %14s %8s %12s\n", "Blobs", "File MB", "Save ms", "Load us", "First Find us",
+		"Find ns", "Read All us" );
+	for (auto& R : RunBenchmark())
+	{
+		printf( "%6u %9.1f %8.2f %9.1f %14.2f %8.1f %12.1f\n", R.NumBlobs, R.FileBytes / 1048576.0, R.SaveMs, R.LoadUs,
+			R.FirstFindUs, R.FindNs, R.ReadAllUs );
+		if (R.NumErrors)
+			Failures.push_back( "pipeline-cache: " + std::to_string( R.NumErrors ) + " blobs not found as saved of " + std::to_string( R.NumBlobs ) );
+	}
+	return ReportFailures( Failures );
+}
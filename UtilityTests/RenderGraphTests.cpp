@@ -0,0 +1,655 @@
+// RenderGraph::Compile() against small graphs whose plan is known: culling, errors, the compute
+// queue and when a pass has to stay off it, transient aliasing, UAV and split barriers. Then
+// synthetic frames of 10, 100 and 1000 passes compiled serially, with the default options and with
+// the copy queue; every plan must be valid against its declarations and come out the same when
+// compiled again. Also what the plans culled, split into segments and barriers, and compile times.
+
+#include "UtilityTests.h"
+#include "RenderGraph.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	// D3D12_RESOURCE_STATES the graphs use
+	const BarrierState kRenderTarget = 0x4;
+	const BarrierState kUnorderedAccess = 0x8;
+	const BarrierState kDepthWrite = 0x10;
+	const BarrierState kNonPixelShaderResource = 0x40;
+	const BarrierState kPixelShaderResource = 0x80;
+	const BarrierState kCopyDest = 0x400;
+	const BarrierState kCopySource = 0x800;
+	const BarrierState kPresent = 0x0;
+
+	const uint64_t kMB = 1024 * 1024;
+	// Passes read what the last few passes made
+	const uint32_t kReadWindow = 8;
+	const uint32_t kNone = 0xffffffff;
+
+	// Same as VALID_COMPUTE_QUEUE_RESOURCE_STATES, COMMON is 0 and valid everywhere
+	const BarrierState kComputeQueueStates = 0x8 | 0x40 | 0x400 | 0x800;
+	const BarrierState kCopyQueueStates = 0x400 | 0x800;
+
+	uint32_t PickRecent( const std::vector<uint32_t>& Resources, uint32_t& Seed )
+	{
+		const uint32_t Window = (std::min)( (uint32_t)Resources.size(), kReadWindow );
+		return Resources[Resources.size() - 1 - NextRandom( Seed ) % Window];
+	}
+
+	struct BenchmarkOptions
+	{
+		const char*			Name;
+		RenderGraphOptions	Options;
+	};
+
+	bool IsSamePlan( const CompiledRenderGraph& A, const CompiledRenderGraph& B )
+	{
+		if (A.Passes.size() != B.Passes.size() || A.Segments.size() != B.Segments.size() || A.Transients.size() != B.Transients.size()
+			|| A.Culled != B.Culled || A.HeapSizes != B.HeapSizes)
+			return false;
+		for (size_t i = 0; i < A.Passes.size(); ++i)
+		{
+			const CompiledRenderPass& PassA = A.Passes[i];
+			const CompiledRenderPass& PassB = B.Passes[i];
+			if (PassA.Pass != PassB.Pass || PassA.Queue != PassB.Queue || PassA.Barriers.size() != PassB.Barriers.size()
+				|| PassA.Aliasing.size() != PassB.Aliasing.size())
+				return false;
+			for (size_t j = 0; j < PassA.Barriers.size(); ++j)
+			{
+				const ResolvedBarrier& BarrierA = PassA.Barriers[j];
+				const ResolvedBarrier& BarrierB = PassB.Barriers[j];
+				if (BarrierA.IsUAV != BarrierB.IsUAV || BarrierA.Flags != BarrierB.Flags || BarrierA.Resource != BarrierB.Resource
+					|| BarrierA.StateBefore != BarrierB.StateBefore || BarrierA.StateAfter != BarrierB.StateAfter)
+					return false;
+			}
+		}
+		for (size_t i = 0; i < A.Segments.size(); ++i)
+			if (A.Segments[i].Queue != B.Segments[i].Queue || A.Segments[i].Waits != B.Segments[i].Waits)
+				return false;
+		for (size_t i = 0; i < A.Transients.size(); ++i)
+			if (A.Transients[i].Resource != B.Transients[i].Resource || A.Transients[i].Heap != B.Transients[i].Heap
+				|| A.Transients[i].Offset != B.Transients[i].Offset)
+				return false;
+		return true;
+	}
+
+	bool IsValidOn( RenderGraphQueue Queue, BarrierState State )
+	{
+		if (Queue == kRenderGraphCompute)
+			return (State & kComputeQueueStates) == State;
+		if (Queue == kRenderGraphCopy)
+			return (State & kCopyQueueStates) == State;
+		return true;
+	}
+
+	struct AccessRange
+	{
+		const RenderGraphAccess*	First;
+		uint32_t					Count;
+
+		const RenderGraphAccess* begin() const { return First; }
+		const RenderGraphAccess* end() const { return First + Count; }
+	};
+
+	// Pass GetNumPasses() is the final state pass
+	AccessRange GetPassAccesses( const RenderGraph& Graph, const CompiledRenderGraph& Compiled, uint32_t Pass )
+	{
+		if (Pass == Graph.GetNumPasses())
+			return { Compiled.FinalAccesses.data(), (uint32_t)Compiled.FinalAccesses.size() };
+		const RenderGraphPass& Desc = Graph.GetPass( Pass );
+		return { Graph.GetAccesses().data() + Desc.FirstAccess, Desc.NumAccesses };
+	}
+
+	// The requests Compile() placed its barriers from, rebuilt from the declarations: one work per
+	// compiled pass, a flush ending every segment. Transients start in the state their first pass
+	// needs, a UAV written by the access before gets a UAV barrier request.
+	void BuildBarrierStream( const RenderGraph& Graph, const CompiledRenderGraph& Compiled, BarrierStream& Stream )
+	{
+		const uint32_t NumResources = Graph.GetNumResources();
+		std::vector<BarrierState> InitialStates( NumResources, 0 );
+		std::vector<uint8_t> Seen( NumResources, 0 );
+		for (uint32_t i = 0; i < NumResources; ++i)
+		{
+			Seen[i] = Graph.GetResource( i ).Imported;
+			InitialStates[i] = Graph.GetResource( i ).InitialState;
+		}
+		for (auto& Pass : Compiled.Passes)
+		{
+			for (auto& Access : GetPassAccesses( Graph, Compiled, Pass.Pass ))
+			{
+				if (!Seen[Access.Resource])
+					InitialStates[Access.Resource] = Access.State;
+				Seen[Access.Resource] = 1;
+			}
+		}
+
+		Stream.Resources.clear();
+		Stream.Ops.clear();
+		for (uint32_t i = 0; i < NumResources; ++i)
+			Stream.AddResource( 1, InitialStates[i] );
+		std::vector<uint8_t> Written( NumResources, 0 );
+		for (auto& Segment : Compiled.Segments)
+		{
+			for (uint32_t i = Segment.FirstPass; i < Segment.FirstPass + Segment.NumPasses; ++i)
+			{
+				for (auto& Access : GetPassAccesses( Graph, Compiled, Compiled.Passes[i].Pass ))
+				{
+					Stream.Transition( Access.Resource, Access.State );
+					if (Access.State == kBarrierStateUAV && Written[Access.Resource])
+						Stream.UAV( Access.Resource );
+					Written[Access.Resource] = Access.Write;
+				}
+				if (i + 1 == Segment.FirstPass + Segment.NumPasses)
+					Stream.Flush();
+				else
+					Stream.Work();
+			}
+		}
+	}
+
+	// Number of errors: a pass left depending on a culled one, a dependency between queues no wait
+	// covers, transients sharing memory while alive at once or unordered across queues, and whatever
+	// ValidateBarriers() finds in the barriers
+	uint64_t ValidateRenderGraph( const RenderGraph& Graph, const CompiledRenderGraph& Compiled )
+	{
+		if (!Compiled.Error.empty())
+			return 1;
+		const uint32_t NumPasses = Graph.GetNumPasses();
+		const uint32_t NumResources = Graph.GetNumResources();
+		const uint32_t NumSegments = (uint32_t)Compiled.Segments.size();
+		uint64_t NumErrors = 0;
+
+		// Every pass left once, in segments covering the passes in order
+		std::vector<uint32_t> CompiledIndex( NumPasses + 1, kNone );
+		for (uint32_t i = 0; i < Compiled.Passes.size(); ++i)
+		{
+			const uint32_t p = Compiled.Passes[i].Pass;
+			if (p > NumPasses || CompiledIndex[p] != kNone || (p < NumPasses && Compiled.Culled[p]))
+			{
+				NumErrors++;
+				continue;
+			}
+			CompiledIndex[p] = i;
+		}
+		for (uint32_t p = 0; p <= NumPasses; ++p)
+			NumErrors += (p == NumPasses || !Compiled.Culled[p]) && CompiledIndex[p] == kNone;
+		if (NumErrors)
+			return NumErrors;
+		uint32_t NextPass = 0;
+		for (uint32_t s = 0; s < NumSegments; ++s)
+		{
+			const RenderGraphSegment& Segment = Compiled.Segments[s];
+			NumErrors += Segment.FirstPass != NextPass || Segment.NumPasses == 0;
+			for (uint32_t i = Segment.FirstPass; i < Segment.FirstPass + Segment.NumPasses && i < Compiled.Passes.size(); ++i)
+				NumErrors += Compiled.Passes[i].Segment != s || Compiled.Passes[i].Queue != Segment.Queue;
+			NextPass = Segment.FirstPass + Segment.NumPasses;
+		}
+		NumErrors += NextPass != Compiled.Passes.size();
+		if (NumErrors)
+			return NumErrors;
+
+		// Per segment, the last segment of each queue done before it starts, from its queue and its waits
+		std::vector<int32_t> Known( NumSegments * kRenderGraphNumQueues, -1 );
+		int32_t LastOnQueue[kRenderGraphNumQueues] = { -1, -1, -1 };
+		for (uint32_t s = 0; s < NumSegments; ++s)
+		{
+			const RenderGraphSegment& Segment = Compiled.Segments[s];
+			int32_t* Clock = &Known[s * kRenderGraphNumQueues];
+			if (LastOnQueue[Segment.Queue] >= 0)
+			{
+				const int32_t Before = LastOnQueue[Segment.Queue];
+				for (uint32_t q = 0; q < kRenderGraphNumQueues; ++q)
+					Clock[q] = Known[Before * kRenderGraphNumQueues + q];
+				Clock[Segment.Queue] = Before;
+			}
+			for (uint32_t Wait : Segment.Waits)
+			{
+				if (Wait >= s || Compiled.Segments[Wait].Queue == Segment.Queue)
+				{
+					NumErrors++;
+					continue;
+				}
+				for (uint32_t q = 0; q < kRenderGraphNumQueues; ++q)
+					Clock[q] = (std::max)( Clock[q], Known[Wait * kRenderGraphNumQueues + q] );
+				Clock[Compiled.Segments[Wait].Queue] = (std::max)( Clock[Compiled.Segments[Wait].Queue], (int32_t)Wait );
+			}
+			LastOnQueue[Segment.Queue] = s;
+		}
+		// Compiled pass A done before B starts
+		auto IsOrdered = [&]( uint32_t A, uint32_t B )
+		{
+			const CompiledRenderPass& PassA = Compiled.Passes[A];
+			const CompiledRenderPass& PassB = Compiled.Passes[B];
+			if (PassA.Queue == PassB.Queue)
+				return A < B;
+			return Known[PassB.Segment * kRenderGraphNumQueues + PassA.Queue] >= (int32_t)PassA.Segment;
+		};
+
+		// Accesses of every resource in declared order, the final state pass last
+		struct ResourceUse
+		{
+			uint32_t			Pass;				// Compiled
+			RenderGraphAccess	Access;
+		};
+		std::vector<std::vector<ResourceUse> > Uses( NumResources );
+		std::vector<uint32_t> LastWriter( NumResources, kNone );
+		for (uint32_t p = 0; p <= NumPasses; ++p)
+		{
+			for (auto& Access : GetPassAccesses( Graph, Compiled, p ))
+			{
+				// A pass left must not need what a culled one wrote
+				if (p == NumPasses || !Compiled.Culled[p])
+				{
+					if (Access.Read && LastWriter[Access.Resource] != kNone)
+						NumErrors += Compiled.Culled[LastWriter[Access.Resource]];
+					ResourceUse Use = { CompiledIndex[p], Access };
+					Uses[Access.Resource].push_back( Use );
+				}
+				if (Access.Write)
+					LastWriter[Access.Resource] = p;
+			}
+		}
+		// Every two uses of a resource which write or need different states are ordered
+		for (auto& ResourceUses : Uses)
+		{
+			for (size_t i = 0; i < ResourceUses.size(); ++i)
+			{
+				for (size_t j = i + 1; j < ResourceUses.size(); ++j)
+				{
+					const ResourceUse& A = ResourceUses[i];
+					const ResourceUse& B = ResourceUses[j];
+					if (A.Access.Write || B.Access.Write || A.Access.State != B.Access.State)
+						NumErrors += !IsOrdered( A.Pass, B.Pass );
+				}
+			}
+		}
+
+		// Transients sharing memory are ordered one after the other, the later one aliasing
+		for (size_t i = 0; i < Compiled.Transients.size(); ++i)
+		{
+			const RenderGraphTransient& A = Compiled.Transients[i];
+			NumErrors += A.Heap >= Compiled.HeapSizes.size() || Graph.GetResource( A.Resource ).Imported;
+			if (A.Heap >= Compiled.HeapSizes.size())
+				continue;
+			NumErrors += A.Offset + A.SizeBytes > Compiled.HeapSizes[A.Heap];
+			for (size_t j = i + 1; j < Compiled.Transients.size(); ++j)
+			{
+				const RenderGraphTransient& B = Compiled.Transients[j];
+				if (A.Heap != B.Heap || A.Offset >= B.Offset + B.SizeBytes || B.Offset >= A.Offset + A.SizeBytes)
+					continue;
+				for (auto& UseA : Uses[A.Resource])
+					for (auto& UseB : Uses[B.Resource])
+						NumErrors += !IsOrdered( UseA.Pass, UseB.Pass );
+				bool Aliased = false;
+				for (auto& Aliasing : Compiled.Passes[B.FirstPass].Aliasing)
+					Aliased |= Aliasing.After == B.Resource;
+				NumErrors += !Aliased;
+			}
+		}
+
+		// Barriers give every pass what it asked for, in states its queue can handle
+		BarrierStream Stream;
+		BuildBarrierStream( Graph, Compiled, Stream );
+		std::vector<BarrierBatch> Batches;
+		for (uint32_t i = 0; i < Compiled.Passes.size(); ++i)
+		{
+			const CompiledRenderPass& Pass = Compiled.Passes[i];
+			for (auto& Barrier : Pass.Barriers)
+				NumErrors += !Barrier.IsUAV && (!IsValidOn( Pass.Queue, Barrier.StateBefore ) || !IsValidOn( Pass.Queue, Barrier.StateAfter ));
+			if (Pass.Barriers.empty())
+				continue;
+			BarrierBatch Batch;
+			Batch.WorkIndex = i;
+			Batch.Barriers = Pass.Barriers;
+			Batches.push_back( std::move( Batch ) );
+		}
+		NumErrors += ValidateBarriers( Stream, Batches );
+		return NumErrors;
+	}
+
+	// Raster passes rendering into new targets from earlier ones, async compute passes on buffers and
+	// in place, compute passes reading render targets which have to stay on the graphics queue, copies,
+	// debug views nothing reads and passes carrying a history texture over to the next frame, all
+	// ending in a composite into the back buffer
+	void MakeSyntheticRenderGraph( RenderGraph& Graph, uint32_t NumPasses, uint32_t Seed )
+	{
+		Graph.Reset();
+		const uint32_t BackBuffer = Graph.Import( "BackBuffer", kPresent, kPresent );
+		const uint32_t History = Graph.Import( "History", kPixelShaderResource );
+
+		// Transients by what the next pass can read them as
+		std::vector<uint32_t> Textures;
+		std::vector<uint32_t> Buffers;
+		char Name[32];
+		for (uint32_t p = 0; p + 1 < NumPasses; ++p)
+		{
+			const uint32_t Kind = Textures.empty() ? 0 : NextRandom( Seed ) % 100;
+			if (Kind < 45)
+			{
+				snprintf( Name, sizeof( Name ), "Raster %u", p );
+				Graph.AddPass( Name );
+				const uint32_t NumReads = Textures.empty() ? 0 : 1 + NextRandom( Seed ) % 2;
+				for (uint32_t i = 0; i < NumReads; ++i)
+					Graph.Read( PickRecent( Textures, Seed ), kPixelShaderResource );
+				if (!Buffers.empty() && NextRandom( Seed ) % 4 == 0)
+					Graph.Read( PickRecent( Buffers, Seed ), kNonPixelShaderResource );
+				snprintf( Name, sizeof( Name ), "Target %u", p );
+				const uint32_t Target = Graph.CreateTransient( Name, (1 + NextRandom( Seed ) % 16) * kMB );
+				Graph.Write( Target, kRenderTarget );
+				Textures.push_back( Target );
+				if (NextRandom( Seed ) % 4 == 0)
+				{
+					snprintf( Name, sizeof( Name ), "Depth %u", p );
+					const uint32_t Depth = Graph.CreateTransient( Name, 8 * kMB );
+					Graph.Write( Depth, kDepthWrite );
+				}
+			}
+			else if (Kind < 70)
+			{
+				snprintf( Name, sizeof( Name ), "Async %u", p );
+				Graph.AddPass( Name, kPassAsyncCompute );
+				if (!Buffers.empty() && NextRandom( Seed ) % 3 == 0)
+				{
+					// Updated in place
+					const uint32_t Buffer = PickRecent( Buffers, Seed );
+					Graph.Read( Buffer, kUnorderedAccess );
+					Graph.Write( Buffer, kUnorderedAccess );
+					continue;
+				}
+				if (!Buffers.empty())
+					Graph.Read( PickRecent( Buffers, Seed ), kNonPixelShaderResource );
+				else
+					Graph.Read( PickRecent( Textures, Seed ), kNonPixelShaderResource );
+				snprintf( Name, sizeof( Name ), "Buffer %u", p );
+				const uint32_t Buffer = Graph.CreateTransient( Name, (1 + NextRandom( Seed ) % 64) * 65536 );
+				Graph.Write( Buffer, kUnorderedAccess );
+				Buffers.push_back( Buffer );
+			}
+			else if (Kind < 80)
+			{
+				// Reads what was just rendered, the graphics queue keeps it
+				snprintf( Name, sizeof( Name ), "Compute %u", p );
+				Graph.AddPass( Name, kPassAsyncCompute );
+				Graph.Read( PickRecent( Textures, Seed ), kNonPixelShaderResource );
+				snprintf( Name, sizeof( Name ), "Image %u", p );
+				const uint32_t Image = Graph.CreateTransient( Name, (1 + NextRandom( Seed ) % 8) * kMB );
+				Graph.Write( Image, kUnorderedAccess );
+				Textures.push_back( Image );
+			}
+			else if (Kind < 88 && !Buffers.empty())
+			{
+				snprintf( Name, sizeof( Name ), "Copy %u", p );
+				Graph.AddPass( Name, kPassCopy );
+				Graph.Read( PickRecent( Buffers, Seed ), kCopySource );
+				snprintf( Name, sizeof( Name ), "Copied %u", p );
+				const uint32_t Buffer = Graph.CreateTransient( Name, 4 * kMB );
+				Graph.Write( Buffer, kCopyDest );
+				Buffers.push_back( Buffer );
+			}
+			else if (Kind < 95)
+			{
+				// A debug view nothing shows
+				snprintf( Name, sizeof( Name ), "Debug %u", p );
+				Graph.AddPass( Name );
+				Graph.Read( PickRecent( Textures, Seed ), kPixelShaderResource );
+				snprintf( Name, sizeof( Name ), "Debug View %u", p );
+				Graph.Write( Graph.CreateTransient( Name, 8 * kMB ), kRenderTarget );
+			}
+			else
+			{
+				snprintf( Name, sizeof( Name ), "History %u", p );
+				Graph.AddPass( Name );
+				Graph.Read( PickRecent( Textures, Seed ), kPixelShaderResource );
+				Graph.Write( History, kRenderTarget );
+			}
+		}
+
+		Graph.AddPass( "Composite", kPassSideEffect );
+		const uint32_t NumInputs = (std::min)( (uint32_t)Textures.size(), 3u );
+		for (uint32_t i = 0; i < NumInputs; ++i)
+			Graph.Read( Textures[Textures.size() - 1 - i], kPixelShaderResource );
+		Graph.Read( History, kPixelShaderResource );
+		Graph.Write( BackBuffer, kRenderTarget );
+	}
+
+	// Small graphs whose plan is known
+	void CheckKnownPlans( std::vector<std::string>& Failures )
+	{
+		RenderGraph Graph;
+		CompiledRenderGraph Compiled;
+		const RenderGraphOptions Options = RenderGraphOptions::Default();
+
+		const Checker Check( Failures, "render-graph" );
+		auto CompileAndValidate = [&]( const RenderGraphOptions& With )
+		{
+			return Graph.Compile( With, Compiled ) && ValidateRenderGraph( Graph, Compiled ) == 0;
+		};
+		auto FindPass = [&]( uint32_t Pass ) -> const CompiledRenderPass*
+		{
+			for (auto& Compiled1Pass : Compiled.Passes)
+				if (Compiled1Pass.Pass == Pass)
+					return &Compiled1Pass;
+			return nullptr;
+		};
+
+		// A debug view nothing reads goes, so does a pass whose target is overwritten before anyone reads it
+		{
+			Graph.Reset();
+			const uint32_t BackBuffer = Graph.Import( "BackBuffer", kPresent, kPresent );
+			const uint32_t Scene = Graph.CreateTransient( "Scene", kMB );
+			const uint32_t Debug = Graph.CreateTransient( "Debug", kMB );
+			Graph.AddPass( "Overwritten" );
+			Graph.Write( Scene, kRenderTarget );
+			Graph.AddPass( "Scene" );
+			Graph.Write( Scene, kRenderTarget );
+			Graph.AddPass( "Debug" );
+			Graph.Read( Scene, kPixelShaderResource );
+			Graph.Write( Debug, kRenderTarget );
+			Graph.AddPass( "Composite" );
+			Graph.Read( Scene, kPixelShaderResource );
+			Graph.Write( BackBuffer, kRenderTarget );
+			Check( CompileAndValidate( Options ), "cull: compile" );
+			Check( Compiled.NumCulled == 2 && Compiled.Culled[0] && !Compiled.Culled[1] && Compiled.Culled[2] && !Compiled.Culled[3], "cull: culled passes" );
+			// Composite and the final state pass
+			const CompiledRenderPass* Final = FindPass( Graph.GetNumPasses() );
+			Check( Final && Final->Barriers.size() == 1 && Final->Barriers[0].StateBefore == kRenderTarget && Final->Barriers[0].StateAfter == kPresent,
+				"cull: back buffer back to present" );
+			Check( Graph.Compile( RenderGraphOptions{ false, true, false, true, true }, Compiled ) && Compiled.NumCulled == 0, "cull: off" );
+		}
+
+		// Reading a transient nobody wrote, and needing one resource in two states, don't compile
+		{
+			Graph.Reset();
+			const uint32_t Scene = Graph.CreateTransient( "Scene", kMB );
+			Graph.AddPass( "Reader", kPassSideEffect );
+			Graph.Read( Scene, kPixelShaderResource );
+			Check( !Graph.Compile( Options, Compiled ) && !Compiled.Error.empty(), "errors: read before write" );
+
+			Graph.Reset();
+			const uint32_t Target = Graph.Import( "Target", kRenderTarget );
+			Graph.AddPass( "Feedback", kPassSideEffect );
+			Graph.Read( Target, kPixelShaderResource );
+			Graph.Write( Target, kRenderTarget );
+			Check( !Graph.Compile( Options, Compiled ) && !Compiled.Error.empty(), "errors: two states" );
+		}
+
+		// An async pass goes to the compute queue, the graphics pass after it doesn't wait for it, the
+		// one using its output does
+		{
+			Graph.Reset();
+			const uint32_t BackBuffer = Graph.Import( "BackBuffer", kPresent, kPresent );
+			const uint32_t Particles = Graph.CreateTransient( "Particles", kMB );
+			const uint32_t Simulated = Graph.CreateTransient( "Simulated", kMB );
+			const uint32_t Shadow = Graph.CreateTransient( "Shadow", kMB );
+			Graph.AddPass( "Emit" );
+			Graph.Write( Particles, kUnorderedAccess );
+			const uint32_t Simulate = Graph.AddPass( "Simulate", kPassAsyncCompute );
+			Graph.Read( Particles, kNonPixelShaderResource );
+			Graph.Write( Simulated, kUnorderedAccess );
+			Graph.AddPass( "Shadow" );
+			Graph.Write( Shadow, kDepthWrite );
+			Graph.AddPass( "Draw" );
+			Graph.Read( Simulated, kNonPixelShaderResource );
+			Graph.Read( Shadow, kPixelShaderResource );
+			Graph.Write( BackBuffer, kRenderTarget );
+			Check( CompileAndValidate( Options ), "async: compile" );
+			const CompiledRenderPass* Pass = FindPass( Simulate );
+			Check( Pass && Pass->Queue == kRenderGraphCompute, "async: on the compute queue" );
+			Check( Compiled.Segments.size() == 4 && Compiled.NumWaits == 2, "async: segments and waits" );
+			Check( CompileAndValidate( RenderGraphOptions{ true, false, false, true, true } ) && Compiled.Segments.size() == 1 && Compiled.NumWaits == 0,
+				"async: off" );
+		}
+
+		// Reading a render target keeps an async pass on the graphics queue
+		{
+			Graph.Reset();
+			const uint32_t BackBuffer = Graph.Import( "BackBuffer", kPresent, kPresent );
+			const uint32_t Scene = Graph.CreateTransient( "Scene", kMB );
+			const uint32_t Luma = Graph.CreateTransient( "Luma", kMB );
+			Graph.AddPass( "Scene" );
+			Graph.Write( Scene, kRenderTarget );
+			const uint32_t Reduce = Graph.AddPass( "Reduce", kPassAsyncCompute );
+			Graph.Read( Scene, kNonPixelShaderResource );
+			Graph.Write( Luma, kUnorderedAccess );
+			Graph.AddPass( "Tonemap" );
+			Graph.Read( Scene, kPixelShaderResource );
+			Graph.Read( Luma, kPixelShaderResource );
+			Graph.Write( BackBuffer, kRenderTarget );
+			Check( CompileAndValidate( Options ), "fallback: compile" );
+			const CompiledRenderPass* Pass = FindPass( Reduce );
+			Check( Pass && Pass->Queue == kRenderGraphGraphics && Compiled.Segments.size() == 1, "fallback: stays on graphics" );
+		}
+
+		// Transients alive one after the other share memory, with an aliasing barrier
+		{
+			Graph.Reset();
+			const uint32_t BackBuffer = Graph.Import( "BackBuffer", kPresent, kPresent );
+			const uint32_t First = Graph.CreateTransient( "First", 4 * kMB );
+			const uint32_t Second = Graph.CreateTransient( "Second", 4 * kMB );
+			const uint32_t Third = Graph.CreateTransient( "Third", 2 * kMB );
+			const uint32_t A = Graph.AddPass( "A" );
+			Graph.Write( First, kRenderTarget );
+			Graph.AddPass( "B" );
+			Graph.Read( First, kPixelShaderResource );
+			Graph.Write( Second, kRenderTarget );
+			const uint32_t C = Graph.AddPass( "C" );
+			Graph.Read( Second, kPixelShaderResource );
+			Graph.Write( Third, kRenderTarget );
+			Graph.AddPass( "D" );
+			Graph.Read( Third, kPixelShaderResource );
+			Graph.Write( BackBuffer, kRenderTarget );
+			Check( CompileAndValidate( Options ), "alias: compile" );
+			Check( Compiled.HeapSize == 8 * kMB && Compiled.TransientBytes == 10 * kMB, "alias: heap size" );
+			const CompiledRenderPass* Pass = FindPass( C );
+			Check( Pass && Pass->Aliasing.size() == 1 && Pass->Aliasing[0].Before == First && Pass->Aliasing[0].After == Third, "alias: barrier" );
+			// Third had part of First's memory at the end of the frame before
+			Pass = FindPass( A );
+			Check( Pass && Pass->Aliasing.size() == 1 && Pass->Aliasing[0].Before == kTransientPreviousFrame && Pass->Aliasing[0].After == First, "alias: previous frame" );
+			Check( CompileAndValidate( RenderGraphOptions{ true, true, false, true, false } ) && Compiled.HeapSize == 10 * kMB, "alias: off" );
+		}
+
+		// A UAV written by two passes in a row gets a UAV barrier, a target idle long enough a split one
+		{
+			Graph.Reset();
+			const uint32_t BackBuffer = Graph.Import( "BackBuffer", kPresent, kPresent );
+			const uint32_t Buffer = Graph.Import( "Buffer", kUnorderedAccess );
+			const uint32_t Shadow = Graph.CreateTransient( "Shadow", kMB );
+			Graph.AddPass( "Shadow" );
+			Graph.Write( Shadow, kDepthWrite );
+			const uint32_t Second = 2;
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				Graph.AddPass( "Update" );
+				Graph.Read( Buffer, kUnorderedAccess );
+				Graph.Write( Buffer, kUnorderedAccess );
+			}
+			Graph.AddPass( "Lighting" );
+			Graph.Read( Shadow, kPixelShaderResource );
+			Graph.Write( BackBuffer, kRenderTarget );
+			Check( CompileAndValidate( Options ), "barriers: compile" );
+			const CompiledRenderPass* Pass = FindPass( Second );
+			Check( Pass && !Pass->Barriers.empty() && Pass->Barriers.back().IsUAV, "barriers: UAV" );
+			// The shadow map to shader resource and the back buffer to render target
+			Check( Compiled.BarrierStats.NumSplit == 2, "barriers: split" );
+		}
+	}
+
+	// Each synthetic graph compiled serially, with the default options and with the copy queue too
+	void RunBenchmark( uint32_t NumSeeds, std::vector<std::string>& Failures )
+	{
+		const uint32_t Sizes[] = { 10, 100, 1000 };
+		RenderGraphOptions Serial = { false, false, false, false, false };
+		RenderGraphOptions AllQueues = RenderGraphOptions::Default();
+		AllQueues.CopyQueue = true;
+		const BenchmarkOptions Configs[] =
+		{
+			{ "serial", Serial },
+			{ "default", RenderGraphOptions::Default() },
+			{ "+copy queue", AllQueues },
+		};
+
+		printf( "%6s %-12s %8s %9s %8s %10s %10s %10s %10s %14s %12s\n", "Passes", "Options", "Culled", "Segments",
+			"Waits", "OffGfx", "Barriers", "Split", "Heap MB", "Transients MB", "us/compile" );
+		RenderGraph Graph;
+		CompiledRenderGraph Compiled;
+		CompiledRenderGraph Again;
+		for (uint32_t NumPasses : Sizes)
+		{
+			// Enough compiles per graph for the small ones to time
+			const uint32_t NumCompiles = (std::max)( 1u, 2000 / NumPasses );
+			for (auto& Config : Configs)
+			{
+				uint32_t NumCulled = 0, NumSegments = 0, NumWaits = 0, NumOffGraphics = 0;
+				uint64_t NumBarriers = 0, NumSplit = 0, HeapSize = 0, TransientBytes = 0;
+				double Seconds = 0;
+				for (uint32_t Seed = 1; Seed <= NumSeeds; ++Seed)
+				{
+					const Checker Check( Failures, "render-graph", ", " + std::to_string( NumPasses ) + " passes " + Config.Name +
+						" seed " + std::to_string( Seed ) );
+					MakeSyntheticRenderGraph( Graph, NumPasses, Seed );
+					bool Compiled1 = Graph.Compile( Config.Options, Compiled );
+					auto Start = std::chrono::high_resolution_clock::now();
+					for (uint32_t i = 0; i < NumCompiles; ++i)
+						Compiled1 &= Graph.Compile( Config.Options, Again );
+					Seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - Start ).count();
+					Check( Compiled1, "synthetic graph compiles" );
+					if (!Compiled1)
+						continue;
+
+					Check( IsSamePlan( Compiled, Again ), "same plan the second time" );
+					Check( ValidateRenderGraph( Graph, Compiled ) == 0, "plan valid" );
+					NumCulled += Compiled.NumCulled;
+					NumSegments += (uint32_t)Compiled.Segments.size();
+					NumWaits += Compiled.NumWaits;
+					for (auto& Pass : Compiled.Passes)
+						NumOffGraphics += Pass.Queue != kRenderGraphGraphics;
+					NumBarriers += Compiled.BarrierStats.NumBarriers;
+					NumSplit += Compiled.BarrierStats.NumSplit;
+					HeapSize += Compiled.HeapSize;
+					TransientBytes += Compiled.TransientBytes;
+				}
+				// Totals over the seeds, the time is an average
+				printf( "%6u %-12s %8u %9u %8u %10u %10llu %10llu %10.1f %14.1f %12.2f\n", NumPasses, Config.Name, NumCulled,
+					NumSegments, NumWaits, NumOffGraphics, (unsigned long long)NumBarriers, (unsigned long long)NumSplit,
+					HeapSize / 1048576.0, TransientBytes / 1048576.0, Seconds * 1e6 / (NumSeeds * NumCompiles) );
+			}
+		}
+	}
+}
+
+// [NumSeeds]
+uint64_t RunRenderGraphTests( int argc, char* argv[] )
+{
+	const uint32_t NumSeeds = GetCountArg( argc, argv, 1, 8 );
+	if (NumSeeds == 0)
+	{
+		fprintf( stderr, "Bad seed count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckKnownPlans( Failures );
+	RunBenchmark( NumSeeds, Failures );
+	return ReportFailures( Failures );
+}
@@ -0,0 +1,520 @@
+// ShaderCacheKey: include scanning, which changes do and don't change a key, a ShaderFileCache
+// reading every file once, and an archive through a cold start, a warm start, an include edited and a
+// bake dropping what wasn't used. Then startup compiles of synthetic shaders three ways: without any
+// cache, on a cold start (every key a miss, compiled and added, the archive saved) and on a warm
+// start (the archive loaded, every key a hit), the bytecode of the warm start compared with what
+// compiling gave. The compiler is a stand-in which hashes every file it includes 256 times, in the
+// order of what a small real compile costs, and every startup keys through a ShaderFileCache of its
+// own like a launch does. Scratch files go to the working directory and are removed.
+
+#include "UtilityTests.h"
+#include "ShaderCacheKey.h"
+#include "PipelineCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+
+namespace
+{
+	const char* kScratchPath = "ShaderCacheScratch.bin";
+	const char* kSharedInclude = "ShaderCacheScratch_Shared.inl";
+	const uint64_t kCompilerKey = 0x00000000d3dc002full;
+	const uint32_t kNumSources = 8;
+
+	double Elapsed( std::chrono::high_resolution_clock::time_point Start )
+	{
+		return std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - Start ).count();
+	}
+
+	// Stands in for the compiler. D3DCompileFromFile() takes milliseconds on a shader of a few KB,
+	// this opens the source and every include and runs kFakeCompilePasses hash passes over them to
+	// cost about as much. The bytecode is half the size of the source, made from the source and macros.
+	const uint32_t kFakeCompilePasses = 256;
+
+	bool FakeCompile( const ShaderCompileDesc& Desc, const ShaderFileReader& Read, std::vector<uint8_t>& Bytecode )
+	{
+		uint64_t Key;
+		std::vector<std::string> Files;
+		std::string Source;
+		if (!GetShaderCacheKey( Desc, Read, Key, &Files ) || !Read( Desc.SourcePath, Source ))
+			return false;
+		uint64_t Work = 0;
+		std::string Content;
+		for (auto& File : Files)
+		{
+			if (!Read( File, Content ))
+				continue;
+			for (uint32_t Pass = 0; Pass < kFakeCompilePasses; ++Pass)
+				Work = PipelineCacheHash( Content.data(), Content.size(), Work + Pass );
+		}
+
+		uint64_t Hash = PipelineCacheHash( Source.data(), Source.size() );
+		for (auto& Macro : Desc.Macros)
+		{
+			Hash = PipelineCacheHash( Macro.Name.data(), Macro.Name.size(), Hash );
+			Hash = PipelineCacheHash( Macro.Definition.data(), Macro.Definition.size(), Hash );
+		}
+		Hash = PipelineCacheHash( Desc.EntryPoint.data(), Desc.EntryPoint.size(), Hash );
+		uint32_t Seed = (uint32_t)(Hash ^ (Hash >> 32));
+		Bytecode.resize( 512 + Source.size() / 2 );
+		for (auto& Byte : Bytecode)
+			Byte = (uint8_t)NextRandom( Seed );
+		// Never the case, keeps the passes from being optimized away
+		if (Work == 0)
+			Bytecode[0] ^= 1;
+		return true;
+	}
+
+	// Copies a blob found into Bytecode
+	bool FindBytecode( PipelineCache& Cache, uint64_t Key, std::vector<uint8_t>& Bytecode )
+	{
+		return Cache.FindCopy( Key, [&Bytecode]( size_t Size ) -> void*
+		{
+			Bytecode.resize( Size );
+			return Bytecode.data();
+		} );
+	}
+
+	// Every combination of three macros switched on or off
+	void AddPermutations( const std::string& SourcePath, const char* EntryPoint, std::vector<ShaderCompileDesc>& Shaders )
+	{
+		const char* Names[] = { "USE_TAPS", "USE_GATHER", "USE_LUMA" };
+		for (uint32_t Permutation = 0; Permutation < 8; ++Permutation)
+		{
+			ShaderCompileDesc Desc = { SourcePath, {}, EntryPoint, "cs_5_1", 0, 0 };
+			for (uint32_t m = 0; m < 3; ++m)
+				Desc.Macros.push_back( { Names[m], (Permutation >> m) & 1 ? "1" : "0" } );
+			Shaders.push_back( Desc );
+		}
+	}
+
+	// Lines of made up HLSL until Size bytes
+	std::string MakeFakeSource( const std::string& Head, size_t Size, uint32_t Seed )
+	{
+		std::string Source = Head;
+		char Line[128];
+		for (uint32_t i = 0; Source.size() < Size; ++i)
+		{
+			snprintf( Line, sizeof( Line ), "float4 Tap%u( float2 uv ) { return Tex.SampleLevel( Samp, uv + %u.0 / 4096.0, 0 ); }\n",
+				i, NextRandom( Seed ) % 64 );
+			Source += Line;
+		}
+		return Source;
+	}
+
+	bool WriteScratchFile( const std::string& Path, const std::string& Content )
+	{
+		FILE* pFile = fopen( Path.c_str(), "wb" );
+		if (pFile == nullptr)
+			return false;
+		const bool Written = fwrite( Content.data(), 1, Content.size(), pFile ) == Content.size();
+		return fclose( pFile ) == 0 && Written;
+	}
+
+	// Compiles through the cache like Graphics::CompileShaderFromFile(), Compiled and Hits counted
+	struct CacheRun
+	{
+		uint32_t	NumCompiled;
+		uint32_t	NumHits;
+		uint32_t	NumFailed;
+	};
+
+	CacheRun CompileAll( PipelineCache& Cache, const std::vector<ShaderCompileDesc>& Shaders, const ShaderFileReader& Read,
+		std::vector<std::vector<uint8_t>>& Bytecodes )
+	{
+		CacheRun Run = {};
+		ShaderFileCache Files( Read );
+		Bytecodes.resize( Shaders.size() );
+		for (size_t i = 0; i < Shaders.size(); ++i)
+		{
+			uint64_t Key;
+			if (!GetShaderCacheKey( Shaders[i], Files, Key ))
+				++Run.NumFailed;
+			else if (FindBytecode( Cache, Key, Bytecodes[i] ))
+				++Run.NumHits;
+			else if (FakeCompile( Shaders[i], Read, Bytecodes[i] ))
+			{
+				Cache.Add( Key, Bytecodes[i].data(), Bytecodes[i].size() );
+				++Run.NumCompiled;
+			}
+			else
+				++Run.NumFailed;
+		}
+		return Run;
+	}
+
+	void CheckKeysAndArchive( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "shader-cache" );
+
+		// Includes in comments left out, spacing and line ends as HLSL allows
+		{
+			std::vector<std::string> Includes;
+			FindShaderIncludes(
+				"#include \"a.inl\"\n"
+				"  #  include <b.h>\r\n"
+				"// #include \"c.inl\"\n"
+				"/* #include \"d.inl\"\n"
+				"#include \"e.inl\" */\n"
+				"float x; // \"#include \\\"f.inl\\\"\"\n"
+				"\t#include \"g/h.inl\" // trailing\n"
+				"#includex \"i.inl\"\n"
+				"#include \"\"\n"
+				"#pragma once\n"
+				"#include \"j.inl\"", Includes );
+			const std::vector<std::string> Expected = { "a.inl", "b.h", "g/h.inl", "j.inl" };
+			Check( Includes == Expected, "includes: scanned" );
+		}
+
+		// A source including one file which includes another, read from memory
+		std::map<std::string, std::string> Files;
+		const ShaderFileReader Read = [&Files]( const std::string& Path, std::string& Content )
+		{
+			auto It = Files.find( Path );
+			if (It == Files.end())
+				return false;
+			Content = It->second;
+			return true;
+		};
+		Files["dir/s.hlsl"] = "#include \"common.inl\"\nfloat4 main() : SV_Target { return Shade(); }\n";
+		Files["dir/common.inl"] = "#include \"nested.inl\"\nfloat4 Shade() { return Nested(); }\n";
+		Files["dir/nested.inl"] = "float4 Nested() { return 1; }\n";
+		const ShaderCompileDesc Base = { "dir/s.hlsl", { { "A", "1" }, { "B", "" }, { "C", "2" } }, "main", "ps_5_1", 1, 0 };
+		auto KeyOf = [&]( const ShaderCompileDesc& Desc )
+		{
+			uint64_t Key = 0;
+			GetShaderCacheKey( Desc, Read, Key );
+			return Key;
+		};
+
+		// The same compile gives the same key, whatever order the macros are in
+		{
+			uint64_t Key = 0;
+			std::vector<std::string> Found;
+			Check( GetShaderCacheKey( Base, Read, Key, &Found ) && Key == KeyOf( Base ) && Key != 0, "key: stable" );
+			const std::vector<std::string> Expected = { "dir/s.hlsl", "dir/common.inl", "dir/nested.inl" };
+			Check( Found == Expected, "key: files" );
+			ShaderCompileDesc Desc = Base;
+			std::reverse( Desc.Macros.begin(), Desc.Macros.end() );
+			Check( KeyOf( Desc ) == Key, "key: macro order" );
+		}
+
+		// Anything the compiler looks at changes the key
+		{
+			const uint64_t Key = KeyOf( Base );
+			ShaderCompileDesc Desc = Base;
+			Desc.Macros[0].Definition = "0";
+			Check( KeyOf( Desc ) != Key, "key: macro value" );
+			Desc = Base;
+			Desc.Macros.push_back( { "D", "" } );
+			Check( KeyOf( Desc ) != Key, "key: macro added" );
+			Desc = Base;
+			Desc.EntryPoint = "main2";
+			Check( KeyOf( Desc ) != Key, "key: entry point" );
+			Desc = Base;
+			Desc.Target = "ps_5_0";
+			Check( KeyOf( Desc ) != Key, "key: target" );
+			Desc = Base;
+			Desc.Flags1 = 3;
+			Check( KeyOf( Desc ) != Key, "key: flags1" );
+			Desc = Base;
+			Desc.Flags2 = 1;
+			Check( KeyOf( Desc ) != Key, "key: flags2" );
+
+			const std::string Saved[] = { Files["dir/s.hlsl"], Files["dir/common.inl"], Files["dir/nested.inl"] };
+			Files["dir/s.hlsl"] += " ";
+			Check( KeyOf( Base ) != Key, "key: source edited" );
+			Files["dir/s.hlsl"] = Saved[0];
+			Files["dir/common.inl"] += " ";
+			Check( KeyOf( Base ) != Key, "key: include edited" );
+			Files["dir/common.inl"] = Saved[1];
+			Files["dir/nested.inl"] += " ";
+			Check( KeyOf( Base ) != Key, "key: nested include edited" );
+			Files["dir/nested.inl"] = Saved[2];
+			Check( KeyOf( Base ) == Key, "key: edits undone" );
+		}
+
+		// Text moving from one macro to the next is a different compile
+		{
+			ShaderCompileDesc Split = Base;
+			Split.Macros = { { "AB", "" } };
+			ShaderCompileDesc Joined = Base;
+			Joined.Macros = { { "A", "B" } };
+			Check( KeyOf( Split ) != KeyOf( Joined ), "key: macro boundary" );
+		}
+
+		// The same files somewhere else have the same key
+		{
+			Files["other/t.hlsl"] = Files["dir/s.hlsl"];
+			Files["other/common.inl"] = Files["dir/common.inl"];
+			Files["other/nested.inl"] = Files["dir/nested.inl"];
+			ShaderCompileDesc Desc = Base;
+			Desc.SourcePath = "other/t.hlsl";
+			Check( KeyOf( Desc ) == KeyOf( Base ), "key: moved" );
+		}
+
+		// An include which isn't there yet, found next to the source, or included twice
+		{
+			Files["m.hlsl"] = "#include \"later.inl\"\n";
+			ShaderCompileDesc Desc = Base;
+			Desc.SourcePath = "m.hlsl";
+			const uint64_t Missing = KeyOf( Desc );
+			Check( Missing != 0, "key: include missing" );
+			Files["later.inl"] = "";
+			Check( KeyOf( Desc ) != Missing, "key: include created" );
+
+			Files["dir/u.hlsl"] = "#include \"sub/x.inl\"\n";
+			Files["dir/sub/x.inl"] = "#include \"nested.inl\"\n";
+			Desc.SourcePath = "dir/u.hlsl";
+			std::vector<std::string> Found;
+			uint64_t Key;
+			Check( GetShaderCacheKey( Desc, Read, Key, &Found ) && Found.size() == 3 && Found[2] == "dir/nested.inl", "key: source directory" );
+			Files["dir/sub/nested.inl"] = "";
+			Check( GetShaderCacheKey( Desc, Read, Key, &Found ) && Found.size() == 3 && Found[2] == "dir/sub/nested.inl", "key: includer first" );
+
+			Files["p.hlsl"] = "#include \"q.inl\"\n#include \"q.inl\"\n";
+			Files["q.inl"] = "#pragma once\n#include \"p.hlsl\"\n";
+			Desc.SourcePath = "p.hlsl";
+			Check( GetShaderCacheKey( Desc, Read, Key, &Found ) && Found.size() == 2, "key: included twice" );
+			Desc.SourcePath = "none.hlsl";
+			Check( !GetShaderCacheKey( Desc, Read, Key ), "key: no source" );
+		}
+
+		// A file cache reads every file once for all permutations and gives the keys reading does, edits
+		// show once it is cleared
+		{
+			uint32_t NumReads = 0;
+			ShaderFileCache FileCache( [&]( const std::string& Path, std::string& Content )
+			{
+				++NumReads;
+				return Read( Path, Content );
+			} );
+			std::vector<ShaderCompileDesc> Shaders;
+			AddPermutations( "dir/s.hlsl", "main", Shaders );
+			AddPermutations( "dir/u.hlsl", "main", Shaders );
+			AddPermutations( "none.hlsl", "main", Shaders );
+			uint32_t NumSame = 0;
+			for (auto& Desc : Shaders)
+			{
+				uint64_t Key = 0;
+				const bool HasKey = GetShaderCacheKey( Desc, FileCache, Key );
+				NumSame += HasKey == (Desc.SourcePath != "none.hlsl") && (!HasKey || Key == KeyOf( Desc ));
+			}
+			Check( NumSame == Shaders.size(), "file cache: keys" );
+			// s.hlsl, common.inl and nested.inl, u.hlsl, sub/x.inl and sub/nested.inl, none.hlsl missing
+			Check( NumReads == 7 && FileCache.GetNumReads() == 7, "file cache: read once" );
+
+			const uint64_t Key = KeyOf( Base );
+			uint64_t Cached = 0;
+			Files["dir/nested.inl"] += " ";
+			Check( GetShaderCacheKey( Base, FileCache, Cached ) && Cached == Key, "file cache: edit unseen" );
+			FileCache.Clear();
+			Check( GetShaderCacheKey( Base, FileCache, Cached ) && Cached != Key && Cached == KeyOf( Base ), "file cache: cleared" );
+			Files["dir/nested.inl"].pop_back();
+		}
+
+		// An archive through a cold start, a warm start and edits
+		{
+			std::vector<ShaderCompileDesc> Shaders;
+			Files["dir/v.hlsl"] = "#include \"common.inl\"\nfloat4 main() : SV_Target { return 2 * Shade(); }\n";
+			Files["dir/w.hlsl"] = "float4 main() : SV_Target { return 0; }\n";
+			AddPermutations( "dir/s.hlsl", "main", Shaders );
+			AddPermutations( "dir/v.hlsl", "main", Shaders );
+			AddPermutations( "dir/w.hlsl", "main", Shaders );
+			std::vector<std::vector<uint8_t>> Compiled, Bytecodes;
+			PipelineCache Cache;
+			remove( kScratchPath );
+
+			Cache.Load( kScratchPath, kCompilerKey );
+			CacheRun Run = CompileAll( Cache, Shaders, Read, Compiled );
+			Check( Run.NumCompiled == 24 && Run.NumHits == 0 && Run.NumFailed == 0 && Cache.Save( kScratchPath ), "archive: cold" );
+			Check( Cache.Load( kScratchPath, kCompilerKey ) == kCacheLoaded && Cache.GetNumEntries() == 24, "archive: saved" );
+			Run = CompileAll( Cache, Shaders, Read, Bytecodes );
+			Check( Run.NumCompiled == 0 && Run.NumHits == 24 && Bytecodes == Compiled, "archive: warm" );
+			Check( Cache.Load( kScratchPath, kCompilerKey + 1 ) == kCacheOtherDevice && CompileAll( Cache, Shaders, Read, Bytecodes ).NumHits == 0,
+				"archive: other compiler" );
+
+			// An include edited compiles what includes it, a source edited its own permutations
+			Cache.Load( kScratchPath, kCompilerKey );
+			Files["dir/nested.inl"] += "// edited\n";
+			Run = CompileAll( Cache, Shaders, Read, Bytecodes );
+			Check( Run.NumCompiled == 16 && Run.NumHits == 8, "archive: include edited" );
+			Files["dir/w.hlsl"] += "// edited\n";
+			Run = CompileAll( Cache, Shaders, Read, Bytecodes );
+			Check( Run.NumCompiled == 8 && Run.NumHits == 16, "archive: source edited" );
+			Check( Cache.Save( kScratchPath ) && Cache.Load( kScratchPath, kCompilerKey ) == kCacheLoaded && Cache.GetNumEntries() == 48,
+				"archive: kept unused" );
+
+			// A bake keeps only what was compiled or found
+			Run = CompileAll( Cache, Shaders, Read, Bytecodes );
+			Check( Run.NumHits == 24 && Cache.Save( kScratchPath, false ) && Cache.Load( kScratchPath, kCompilerKey ) == kCacheLoaded &&
+				Cache.GetNumEntries() == 24, "archive: bake dropped unused" );
+			Run = CompileAll( Cache, Shaders, Read, Bytecodes );
+			Check( Run.NumHits == 24 && Run.NumCompiled == 0, "archive: baked" );
+			Cache.Close();
+			remove( kScratchPath );
+		}
+	}
+
+	struct BenchmarkResult
+	{
+		const char*	Startup;				// "no cache", "cold" or "warm"
+		uint32_t	NumShaders;
+		uint32_t	NumCompiled;
+		uint32_t	NumHits;
+		double		TotalMs;
+		double		KeyMs;					// Reading and hashing sources and includes
+		double		ArchiveMs;				// Load, lookups and save
+		uint64_t	NumErrors;				// Bytecode not what compiling gave, or a compile failed
+	};
+
+	// False if the shader didn't compile
+	typedef std::function<bool( const ShaderCompileDesc& Desc, std::vector<uint8_t>& Bytecode )> ShaderCompiler;
+
+	// The archive is written to ArchivePath and removed afterwards
+	std::vector<BenchmarkResult> RunBenchmark( const std::vector<ShaderCompileDesc>& Shaders, const ShaderCompiler& Compile,
+		const ShaderFileReader& Read, const std::string& ArchivePath )
+	{
+		typedef std::chrono::high_resolution_clock Clock;
+		std::vector<BenchmarkResult> Results;
+		const uint32_t NumShaders = (uint32_t)Shaders.size();
+		std::vector<std::vector<uint8_t>> Compiled( NumShaders );
+		std::vector<uint8_t> Bytecode;
+		std::vector<uint64_t> Keys( NumShaders );
+
+		// Every shader compiled, what the others are compared with
+		BenchmarkResult NoCache = {};
+		NoCache.Startup = "no cache";
+		NoCache.NumShaders = NumShaders;
+		Clock::time_point Start = Clock::now();
+		for (uint32_t i = 0; i < NumShaders; ++i)
+		{
+			const bool Succeeded = Compile( Shaders[i], Compiled[i] );
+			NoCache.NumCompiled += Succeeded;
+			NoCache.NumErrors += !Succeeded;
+		}
+		NoCache.TotalMs = Elapsed( Start ) * 1e3;
+		Results.push_back( NoCache );
+
+		// No archive: every key a miss, compiled, added and saved at the end
+		BenchmarkResult Cold = {};
+		Cold.Startup = "cold";
+		Cold.NumShaders = NumShaders;
+		remove( ArchivePath.c_str() );
+		PipelineCache Cache;
+		Start = Clock::now();
+		Clock::time_point PartStart = Start;
+		Cache.Load( ArchivePath, kCompilerKey );
+		Cold.ArchiveMs += Elapsed( PartStart ) * 1e3;
+		ShaderFileCache ColdFiles( Read );
+		for (uint32_t i = 0; i < NumShaders; ++i)
+		{
+			PartStart = Clock::now();
+			const bool HasKey = GetShaderCacheKey( Shaders[i], ColdFiles, Keys[i] );
+			Cold.KeyMs += Elapsed( PartStart ) * 1e3;
+			PartStart = Clock::now();
+			const bool Found = HasKey && FindBytecode( Cache, Keys[i], Bytecode );
+			Cold.ArchiveMs += Elapsed( PartStart ) * 1e3;
+			if (Found)
+				++Cold.NumHits;
+			else if (Compile( Shaders[i], Bytecode ))
+			{
+				++Cold.NumCompiled;
+				PartStart = Clock::now();
+				if (HasKey)
+					Cache.Add( Keys[i], Bytecode.data(), Bytecode.size() );
+				Cold.ArchiveMs += Elapsed( PartStart ) * 1e3;
+			}
+			else
+				++Cold.NumErrors;
+		}
+		PartStart = Clock::now();
+		Cold.NumErrors += !Cache.Save( ArchivePath );
+		Cold.ArchiveMs += Elapsed( PartStart ) * 1e3;
+		Cold.TotalMs = Elapsed( Start ) * 1e3;
+		Results.push_back( Cold );
+
+		// The archive loaded, every key a hit with the bytecode compiling gave
+		BenchmarkResult Warm = {};
+		Warm.Startup = "warm";
+		Warm.NumShaders = NumShaders;
+		Start = Clock::now();
+		PartStart = Start;
+		Warm.NumErrors += Cache.Load( ArchivePath, kCompilerKey ) != kCacheLoaded;
+		Warm.ArchiveMs += Elapsed( PartStart ) * 1e3;
+		ShaderFileCache WarmFiles( Read );
+		for (uint32_t i = 0; i < NumShaders; ++i)
+		{
+			PartStart = Clock::now();
+			uint64_t Key = 0;
+			const bool HasKey = GetShaderCacheKey( Shaders[i], WarmFiles, Key );
+			Warm.KeyMs += Elapsed( PartStart ) * 1e3;
+			PartStart = Clock::now();
+			const bool Found = HasKey && FindBytecode( Cache, Key, Bytecode );
+			Warm.ArchiveMs += Elapsed( PartStart ) * 1e3;
+			if (Found)
+				++Warm.NumHits;
+			else if (Compile( Shaders[i], Bytecode ))
+				++Warm.NumCompiled;
+			Warm.NumErrors += Key != Keys[i] || Bytecode != Compiled[i];
+		}
+		Warm.TotalMs = Elapsed( Start ) * 1e3;
+		Results.push_back( Warm );
+
+		Cache.Close();
+		remove( ArchivePath.c_str() );
+		return Results;
+	}
+
+	// 8 sources of 9 KB sharing an include, like FXAA.hlsl, with 8 permutations each, written to the
+	// working directory and removed afterwards
+	std::vector<BenchmarkResult> RunSyntheticBenchmark()
+	{
+		std::vector<ShaderCompileDesc> Shaders;
+		std::vector<std::string> Paths( 1, kSharedInclude );
+		bool Written = WriteScratchFile( kSharedInclude, MakeFakeSource( "#define TAP_COUNT 12\n", 1024, 1 ) );
+		char Path[64];
+		for (uint32_t i = 0; i < kNumSources; ++i)
+		{
+			snprintf( Path, sizeof( Path ), "ShaderCacheScratch_%u.hlsl", i );
+			Paths.push_back( Path );
+			const std::string Head = std::string( "#include \"" ) + kSharedInclude + "\"\n";
+			Written &= WriteScratchFile( Path, MakeFakeSource( Head, 9 * 1024, i + 2 ) );
+			AddPermutations( Path, "main", Shaders );
+		}
+
+		const ShaderFileReader Read = ReadShaderFile;
+		const ShaderCompiler Compile = [&Read]( const ShaderCompileDesc& Desc, std::vector<uint8_t>& Bytecode )
+		{
+			return FakeCompile( Desc, Read, Bytecode );
+		};
+		std::vector<BenchmarkResult> Results = RunBenchmark( Shaders, Compile, Read, kScratchPath );
+		Results[0].NumErrors += !Written;
+		for (auto& FilePath : Paths)
+			remove( FilePath.c_str() );
+		return Results;
+	}
+}
+
+uint64_t RunShaderCacheTests( int, char*[] )
+{
+	std::vector<std::string> Failures;
+	CheckKeysAndArchive( Failures );
+	printf( "%-9s %8s %9s %6s %9s %8s %11s\n", "Startup", "Shaders", "Compiled", "Hits", "Total ms", "Key ms", "Archive ms" );
+	std::vector<BenchmarkResult> Results = RunSyntheticBenchmark();
+	for (auto& R : Results)
+	{
+		printf( "%-9s %8u %9u %6u %9.2f %8.2f %11.2f\n", R.Startup, R.NumShaders, R.NumCompiled, R.NumHits, R.TotalMs,
+			R.KeyMs, R.ArchiveMs );
+		if (R.NumErrors)
+			Failures.push_back( std::string( "shader-cache: " ) + std::to_string( R.NumErrors ) + " compiles failed or bytecode differing on the " +
+				R.Startup + " startup" );
+	}
+	if (Results[2].NumHits != Results[2].NumShaders || Results[2].NumCompiled != 0)
+		Failures.push_back( "shader-cache: warm startup compiled" );
+	return ReportFailures( Failures );
+}
@@ -0,0 +1,108 @@
+// TaskScheduler at 2, 4 ... MaxThreads threads: ParallelFor running every index once with thread
+// indices in range and 0 only on the thread which called Initialize(), nested ParallelFor from inside
+// tasks, and Wait() sleeping instead of spinning while the rest of its group runs on the workers,
+// measured as the CPU time the waiting thread used.
+
+#include "UtilityTests.h"
+#include "TaskScheduler.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	double GetThreadCpuMs()
+	{
+		timespec Time;
+		clock_gettime( CLOCK_THREAD_CPUTIME_ID, &Time );
+		return Time.tv_sec * 1000.0 + Time.tv_nsec / 1e6;
+	}
+
+	void CheckParallelFor( TaskScheduler& Scheduler, const Checker& Check )
+	{
+		const uint32_t kCount = 100000;
+		std::vector<std::atomic<uint32_t>> Runs( kCount );
+		std::atomic<uint32_t> BadThreadIdx( 0 );
+		Scheduler.ParallelFor( kCount, 256, [&]( uint32_t Begin, uint32_t End, uint32_t ThreadIdx )
+		{
+			if (ThreadIdx >= Scheduler.GetNumThreads() || ThreadIdx != Scheduler.GetCurrentThreadIdx())
+			{
+				BadThreadIdx++;
+				return;
+			}
+			for (uint32_t i = Begin; i < End; ++i)
+				Runs[i]++;
+		} );
+		Check( std::all_of( Runs.begin(), Runs.end(), []( const std::atomic<uint32_t>& n ) { return n == 1; } ),
+			"every index run once" );
+		Check( BadThreadIdx == 0, "thread index in range and the one of the running thread" );
+		Check( Scheduler.GetCurrentThreadIdx() == 0, "thread 0 is the one which called Initialize()" );
+	}
+
+	void CheckNested( TaskScheduler& Scheduler, const Checker& Check )
+	{
+		const uint32_t kOuter = 64;
+		const uint32_t kInner = 1000;
+		std::atomic<uint64_t> Sum( 0 );
+		Scheduler.ParallelFor( kOuter, 1, [&]( uint32_t Begin, uint32_t End, uint32_t )
+		{
+			for (uint32_t o = Begin; o < End; ++o)
+			{
+				Scheduler.ParallelFor( kInner, 50, [&]( uint32_t InnerBegin, uint32_t InnerEnd, uint32_t )
+				{
+					uint64_t Part = 0;
+					for (uint32_t i = InnerBegin; i < InnerEnd; ++i)
+						Part += i;
+					Sum += Part;
+				} );
+			}
+		} );
+		Check( Sum == (uint64_t)kOuter * kInner * (kInner - 1) / 2, "nested ParallelFor runs every inner index" );
+	}
+
+	// Tasks on workers sleep, so the thread in Wait() has nothing to help with for kSleepMs
+	void CheckWaitSleeps( TaskScheduler& Scheduler, const Checker& Check )
+	{
+		static const uint32_t kSleepMs = 50;
+		TaskGroup Group;
+		for (uint32_t i = 1; i < Scheduler.GetNumThreads(); ++i)
+		{
+			Scheduler.Submit( Group, []( uint32_t ThreadIdx )
+			{
+				if (ThreadIdx != 0)
+					std::this_thread::sleep_for( std::chrono::milliseconds( kSleepMs ) );
+			} );
+		}
+		const double StartMs = GetThreadCpuMs();
+		Scheduler.Wait( Group );
+		const double WaitCpuMs = GetThreadCpuMs() - StartMs;
+		printf( "%-10u %12.2f\n", Scheduler.GetNumThreads(), WaitCpuMs );
+		Check( Group.IsDone(), "group done after Wait()" );
+		Check( WaitCpuMs < kSleepMs / 5.0, "waiting thread sleeps while workers run the group" );
+	}
+}
+
+uint64_t RunTaskSchedulerTests( int argc, char* argv[] )
+{
+	const uint32_t MaxThreads = GetCountArg( argc, argv, 1, (std::max)( 4u, std::thread::hardware_concurrency() ) );
+	if (MaxThreads < 2)
+	{
+		fprintf( stderr, "Bad thread count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	printf( "%-10s %12s\n", "Threads", "WaitCpuMs" );
+	for (uint32_t NumThreads = 2; NumThreads <= MaxThreads; NumThreads *= 2)
+	{
+		const Checker Check( Failures, "task-scheduler", " with " + std::to_string( NumThreads ) + " threads" );
+		TaskScheduler Scheduler;
+		Scheduler.Initialize( NumThreads );
+		CheckParallelFor( Scheduler, Check );
+		CheckNested( Scheduler, Check );
+		CheckWaitSleeps( Scheduler, Check );
+	}
+	return ReportFailures( Failures );
+}
@@ -0,0 +1,372 @@
+// PackTransients() and FindTransientAliasing() on small sets whose layout is known: lifetimes apart
+// sharing memory, overlapping ones, other alias domains and resources sharing nothing kept apart,
+// heaps packed apart, alignment, first-fit into a gap and largest first beating first use.
+// ValidateTransientPacking() must find a misaligned, out of heap and wrongly shared resource. Then how
+// much memory packing saves on synthetic frames of 10, 100 and 1000 passes: render targets, depth
+// buffers and compute images of 1080p sizes living a few passes, a scene color and depth living most
+// of the frame, buffers, some used on the compute queue and some on both queues, which can't share
+// memory. Each frame is packed into one heap, and into a heap per kind of resource as resource heap
+// tier 1 needs, placing the largest first and in order of first use; the first row is the framework's
+// own frame (scene color and depth, FXAA's luma, queues and indirect arguments). Every packing is
+// validated.
+
+#include "UtilityTests.h"
+#include "TransientPacker.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	const uint64_t kMB = 1024 * 1024;
+	const uint64_t kPlacementAlignment = 65536;
+
+	enum HeapKind : uint32_t
+	{
+		kHeapBuffers,
+		kHeapTargets,
+		kHeapTextures,
+	};
+
+	uint64_t SizeOf( const TransientInterval& Interval )
+	{
+		return (std::max)( Interval.SizeBytes, (uint64_t)1 );
+	}
+
+	// What GetResourceAllocationInfo() comes back with, placed resources take 64K pages
+	uint64_t Allocation( uint64_t Bytes )
+	{
+		return (Bytes + kPlacementAlignment - 1) / kPlacementAlignment * kPlacementAlignment;
+	}
+
+	void AddInterval( std::vector<TransientInterval>& Intervals, uint64_t Bytes, uint32_t Heap, uint32_t FirstUse,
+		uint32_t LastUse, uint32_t AliasDomain )
+	{
+		TransientInterval Interval = { Allocation( Bytes ), kPlacementAlignment, FirstUse, LastUse, Heap, AliasDomain };
+		Intervals.push_back( Interval );
+	}
+
+	// Passes: the application, FXAA's luma, resolve work and apply, present
+	void MakeFrameworkFrame( std::vector<TransientInterval>& Intervals )
+	{
+		const uint64_t Pixels = 1920 * 1080;
+		Intervals.clear();
+		AddInterval( Intervals, Pixels * 4, kHeapTargets, 0, 4, 0 );				// Scene color, R11G11B10
+		AddInterval( Intervals, Pixels * 4, kHeapTargets, 0, 0, 0 );				// Scene depth, D32
+		AddInterval( Intervals, Pixels, kHeapTargets, 1, 3, 0 );					// Luma, R8 render target
+		for (uint32_t i = 0; i < 4; ++i)
+			AddInterval( Intervals, 512 * 1024 * 4, kHeapBuffers, 1, 3, 0 );		// Work and color queues
+		AddInterval( Intervals, 24, kHeapBuffers, 2, 3, 0 );						// Indirect arguments
+	}
+
+	void ToOneHeap( std::vector<TransientInterval>& Intervals )
+	{
+		for (auto& Interval : Intervals)
+			Interval.Heap = 0;
+	}
+
+	uint64_t NumAliasingBarriers( const std::vector<TransientInterval>& Intervals, const TransientPacking& Packing )
+	{
+		std::vector<TransientAliasing> Aliasing;
+		FindTransientAliasing( Intervals, Packing, Aliasing );
+		return Aliasing.size();
+	}
+
+	// Intervals misaligned, outside their heap, or sharing memory they may not; 0 for a good packing
+	uint64_t ValidateTransientPacking( const std::vector<TransientInterval>& Intervals, const TransientPacking& Packing )
+	{
+		const uint32_t NumIntervals = (uint32_t)Intervals.size();
+		if (Packing.Offsets.size() != NumIntervals)
+			return 1;
+		uint64_t NumErrors = 0;
+		uint64_t TotalSize = 0;
+		for (uint64_t HeapSize : Packing.HeapSizes)
+			TotalSize += HeapSize;
+		NumErrors += TotalSize != Packing.TotalSize || Packing.TotalSize < Packing.LowerBound;
+		for (uint32_t i = 0; i < NumIntervals; ++i)
+		{
+			const TransientInterval& A = Intervals[i];
+			const uint64_t Offset = Packing.Offsets[i];
+			NumErrors += Offset % A.Alignment != 0 || A.Heap >= Packing.HeapSizes.size() ||
+				Offset + SizeOf( A ) > Packing.HeapSizes[A.Heap];
+			for (uint32_t j = i + 1; j < NumIntervals; ++j)
+			{
+				const TransientInterval& B = Intervals[j];
+				const bool Apart = A.LastUse < B.FirstUse || B.LastUse < A.FirstUse;
+				const bool CanShare = A.AliasDomain != kTransientNoAlias && A.AliasDomain == B.AliasDomain && Apart;
+				if (A.Heap == B.Heap && Offset < Packing.Offsets[j] + SizeOf( B ) && Packing.Offsets[j] < Offset + SizeOf( A ))
+					NumErrors += !CanShare;
+			}
+		}
+		return NumErrors;
+	}
+
+	// Heap is the kind of resource, 0 buffers, 1 render targets and depth, 2 other textures
+	void MakeSyntheticTransientFrame( std::vector<TransientInterval>& Intervals, uint32_t NumPasses, uint32_t Seed )
+	{
+		const uint64_t Pixels = 1920 * 1080;
+		Intervals.clear();
+		AddInterval( Intervals, Pixels * 8, kHeapTargets, 0, NumPasses - 1, 0 );
+		AddInterval( Intervals, Pixels * 4, kHeapTargets, 0, NumPasses * 2 / 3, 0 );
+
+		for (uint32_t p = 0; p < NumPasses; ++p)
+		{
+			const uint32_t NumNew = 1 + NextRandom( Seed ) % 2;
+			for (uint32_t i = 0; i < NumNew; ++i)
+			{
+				uint32_t Length = 1 + NextRandom( Seed ) % 4;
+				if (NextRandom( Seed ) % 10 == 0)
+					Length = 1 + NextRandom( Seed ) % (NumPasses / 4 + 1);
+				const uint32_t LastUse = (std::min)( p + Length - 1, NumPasses - 1 );
+				const uint32_t Domain = NextRandom( Seed ) % 100;
+				const uint32_t AliasDomain = Domain < 75 ? 0 : Domain < 93 ? 1 : kTransientNoAlias;
+
+				const uint32_t Kind = NextRandom( Seed ) % 100;
+				if (Kind < 40)
+				{
+					// RGBA8, RGBA16F and RGBA32F at full resolution, or the first two at quarter
+					const uint64_t Sizes[] = { Pixels * 4, Pixels * 8, Pixels * 16, Pixels, Pixels * 2 };
+					AddInterval( Intervals, Sizes[NextRandom( Seed ) % 5], kHeapTargets, p, LastUse, AliasDomain );
+				}
+				else if (Kind < 55)
+					AddInterval( Intervals, Pixels * 4, kHeapTargets, p, LastUse, AliasDomain );
+				else if (Kind < 75)
+					AddInterval( Intervals, Pixels * (1 + NextRandom( Seed ) % 4), kHeapTextures, p, LastUse, AliasDomain );
+				else
+					AddInterval( Intervals, (1 + NextRandom( Seed ) % 64) * 65536, kHeapBuffers, p, LastUse, AliasDomain );
+			}
+		}
+	}
+
+	void CheckKnownLayouts( std::vector<std::string>& Failures )
+	{
+		std::vector<TransientInterval> Intervals;
+		std::vector<TransientAliasing> Aliasing;
+		TransientPacking Packing;
+
+		const Checker Check( Failures, "transient-packer" );
+		auto Add = [&]( uint64_t Bytes, uint64_t Alignment, uint32_t FirstUse, uint32_t LastUse, uint32_t Heap, uint32_t AliasDomain )
+		{
+			TransientInterval Interval = { Bytes, Alignment, FirstUse, LastUse, Heap, AliasDomain };
+			Intervals.push_back( Interval );
+		};
+		auto Pack = [&]( TransientPackOrder Order )
+		{
+			PackTransients( Intervals, Order, Packing );
+			FindTransientAliasing( Intervals, Packing, Aliasing );
+			return ValidateTransientPacking( Intervals, Packing ) == 0;
+		};
+
+		// Lifetimes apart share memory, the later one aliasing
+		{
+			Intervals.clear();
+			Add( kMB, 65536, 2, 3, 0, 0 );
+			Add( kMB, 65536, 0, 1, 0, 0 );
+			Check( Pack( kPackBySize ), "share: valid" );
+			Check( Packing.Offsets[0] == 0 && Packing.Offsets[1] == 0 && Packing.TotalSize == kMB && Packing.UnaliasedSize == 2 * kMB,
+				"share: same memory" );
+			Check( Aliasing.size() == 2 && Aliasing[0].Before == 1 && Aliasing[0].After == 0, "share: aliasing" );
+			// Next frame
+			Check( Aliasing.size() == 2 && Aliasing[1].Before == kTransientPreviousFrame && Aliasing[1].After == 1, "share: next frame" );
+		}
+
+		// Overlapping lifetimes, other alias domains and resources sharing nothing keep apart
+		{
+			Intervals.clear();
+			Add( kMB, 65536, 0, 1, 0, 0 );
+			Add( kMB, 65536, 1, 2, 0, 0 );
+			Check( Pack( kPackBySize ) && Packing.TotalSize == 2 * kMB && Aliasing.empty(), "apart: overlapping" );
+			Intervals[1].FirstUse = 2;
+			Intervals[1].AliasDomain = 1;
+			Check( Pack( kPackBySize ) && Packing.TotalSize == 2 * kMB && Aliasing.empty(), "apart: alias domains" );
+			Intervals[1].AliasDomain = kTransientNoAlias;
+			Check( Pack( kPackBySize ) && Packing.TotalSize == 2 * kMB && Aliasing.empty(), "apart: no alias" );
+			Intervals[0].AliasDomain = kTransientNoAlias;
+			Check( Pack( kPackBySize ) && Packing.TotalSize == 2 * kMB && Packing.LowerBound == 2 * kMB, "apart: lower bound" );
+		}
+
+		// Heaps are packed apart, and alignment holds
+		{
+			Intervals.clear();
+			Add( kMB, 65536, 0, 1, 0, 0 );
+			Add( 2 * kMB, 65536, 0, 1, 1, 0 );
+			Check( Pack( kPackBySize ) && Packing.HeapSizes.size() == 2 && Packing.HeapSizes[0] == kMB && Packing.HeapSizes[1] == 2 * kMB
+				&& Packing.Offsets[1] == 0 && Packing.TotalSize == 3 * kMB, "heaps: apart" );
+
+			Intervals.clear();
+			Add( 100, 256, 0, 1, 0, 0 );
+			Add( 10, 4096, 0, 1, 0, 0 );
+			Check( Pack( kPackBySize ) && Packing.Offsets[0] == 0 && Packing.Offsets[1] == 4096 && Packing.TotalSize == 4106, "heaps: alignment" );
+		}
+
+		// A resource fits into a gap left between two it overlaps
+		{
+			Intervals.clear();
+			Add( 4 * kMB, 65536, 0, 0, 0, 0 );
+			Add( kMB, 65536, 1, 1, 0, 0 );
+			Add( kMB, 65536, 1, 1, 0, 0 );
+			Add( 2 * kMB, 65536, 1, 1, 0, 0 );
+			Check( Pack( kPackBySize ) && Packing.TotalSize == 4 * kMB && Packing.Offsets[3] == 0 && Packing.Offsets[1] == 2 * kMB
+				&& Packing.Offsets[2] == 3 * kMB, "gap: first-fit" );
+			Check( Aliasing.size() == 4 && Aliasing[0].Before == kTransientPreviousFrame && Aliasing[0].After == 0
+				&& Aliasing[1].Before == 0 && Aliasing[1].After == 1, "gap: aliasing" );
+		}
+
+		// Largest first beats first use when a big resource comes late
+		{
+			Intervals.clear();
+			Add( kMB, 65536, 0, 0, 0, 0 );
+			Add( 4 * kMB, 65536, 1, 1, 0, 0 );
+			Add( kMB, 65536, 0, 1, 0, 0 );
+			Check( Pack( kPackByFirstUse ) && Packing.TotalSize == 6 * kMB, "order: first use" );
+			Check( Pack( kPackBySize ) && Packing.TotalSize == 5 * kMB && Packing.LowerBound == 5 * kMB, "order: by size" );
+		}
+
+		// Synthetic frames pack validly, the same way every time, between the lower bound and no aliasing
+		{
+			uint64_t NumErrors = 0;
+			uint64_t NumOutOfBounds = 0;
+			uint64_t NumBadAliasing = 0;
+			bool Deterministic = true;
+			TransientPacking Again;
+			for (uint32_t Seed = 1; Seed <= 20; ++Seed)
+			{
+				for (uint32_t Order = 0; Order < 2; ++Order)
+				{
+					MakeSyntheticTransientFrame( Intervals, 10 + Seed * 7, Seed );
+					if (Seed % 2)
+						ToOneHeap( Intervals );
+					NumErrors += !Pack( (TransientPackOrder)Order );
+					PackTransients( Intervals, (TransientPackOrder)Order, Again );
+					Deterministic &= Again.Offsets == Packing.Offsets;
+					NumOutOfBounds += Packing.TotalSize < Packing.LowerBound || Packing.TotalSize > Packing.UnaliasedSize;
+					for (auto& Pair : Aliasing)
+						NumBadAliasing += Pair.Before != kTransientPreviousFrame && Intervals[Pair.Before].LastUse >= Intervals[Pair.After].FirstUse;
+				}
+			}
+			Check( NumErrors == 0, "synthetic: valid" );
+			Check( NumOutOfBounds == 0, "synthetic: within bounds" );
+			Check( NumBadAliasing == 0, "synthetic: aliasing in order" );
+			Check( Deterministic, "synthetic: deterministic" );
+		}
+
+		// The validator itself has to catch what a broken packer would do
+		{
+			MakeSyntheticTransientFrame( Intervals, 20, 1 );
+			ToOneHeap( Intervals );
+			Pack( kPackBySize );
+			TransientPacking Broken = Packing;
+			Broken.Offsets[0] += 4096;
+			Check( ValidateTransientPacking( Intervals, Broken ) != 0, "validate: misaligned" );
+			Broken = Packing;
+			Broken.Offsets[1] = Broken.HeapSizes[0];
+			Check( ValidateTransientPacking( Intervals, Broken ) != 0, "validate: outside the heap" );
+			Broken = Packing;
+			Broken.Offsets[1] = Broken.Offsets[0];
+			Check( ValidateTransientPacking( Intervals, Broken ) != 0, "validate: sharing with a live resource" );
+		}
+	}
+
+	struct BenchmarkResult
+	{
+		const char*	Frame;
+		uint32_t	NumPasses;
+		uint32_t	NumResources;
+		bool		SeparateHeaps;				// A heap per kind of resource
+		uint64_t	UnaliasedBytes;
+		uint64_t	LowerBound;					// Most bytes alive at once
+		uint64_t	FirstUseBytes;				// Packed in order of first use
+		uint64_t	BySizeBytes;				// Packed largest first
+		uint64_t	NumAliasing;				// Aliasing barriers of the largest first packing
+		double		UsPerPack;					// Largest first
+	};
+
+	// Bytes add up over the seeds, but the times which are averages
+	std::vector<BenchmarkResult> RunBenchmark( uint32_t NumSeeds, std::vector<std::string>& Failures )
+	{
+		std::vector<BenchmarkResult> Results;
+		std::vector<TransientInterval> Intervals;
+		TransientPacking Packing;
+		TransientPacking FirstUse;
+
+		auto Measure = [&]( BenchmarkResult& Result, uint32_t NumPacks )
+		{
+			PackTransients( Intervals, kPackByFirstUse, FirstUse );
+			auto Start = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < NumPacks; ++i)
+				PackTransients( Intervals, kPackBySize, Packing );
+			Result.UsPerPack += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - Start ).count() * 1e6 / NumPacks;
+			Result.NumResources += (uint32_t)Intervals.size();
+			Result.UnaliasedBytes += Packing.UnaliasedSize;
+			Result.LowerBound += Packing.LowerBound;
+			Result.FirstUseBytes += FirstUse.TotalSize;
+			Result.BySizeBytes += Packing.TotalSize;
+			Result.NumAliasing += NumAliasingBarriers( Intervals, Packing );
+			const uint64_t NumErrors = ValidateTransientPacking( Intervals, Packing ) + ValidateTransientPacking( Intervals, FirstUse );
+			if (NumErrors)
+				Failures.push_back( std::string( "transient-packer: " ) + std::to_string( NumErrors ) + " errors packing a " + Result.Frame +
+					" frame of " + std::to_string( Result.NumPasses ) + " passes" );
+		};
+
+		for (uint32_t Separate = 0; Separate < 2; ++Separate)
+		{
+			BenchmarkResult Result = {};
+			Result.Frame = "framework";
+			Result.NumPasses = 5;
+			Result.SeparateHeaps = Separate != 0;
+			MakeFrameworkFrame( Intervals );
+			if (!Separate)
+				ToOneHeap( Intervals );
+			Measure( Result, 1000 );
+			Results.push_back( Result );
+		}
+
+		const uint32_t Sizes[] = { 10, 100, 1000 };
+		for (uint32_t NumPasses : Sizes)
+		{
+			const uint32_t NumPacks = (std::max)( 1u, 1000 / NumPasses );
+			for (uint32_t Separate = 0; Separate < 2; ++Separate)
+			{
+				BenchmarkResult Result = {};
+				Result.Frame = "synthetic";
+				Result.NumPasses = NumPasses;
+				Result.SeparateHeaps = Separate != 0;
+				for (uint32_t Seed = 1; Seed <= NumSeeds; ++Seed)
+				{
+					MakeSyntheticTransientFrame( Intervals, NumPasses, Seed );
+					if (!Separate)
+						ToOneHeap( Intervals );
+					Measure( Result, NumPacks );
+				}
+				Result.UsPerPack /= NumSeeds;
+				Results.push_back( Result );
+			}
+		}
+		return Results;
+	}
+}
+
+// [NumSeeds]
+uint64_t RunTransientPackerTests( int argc, char* argv[] )
+{
+	const uint32_t NumSeeds = GetCountArg( argc, argv, 1, 8 );
+	if (NumSeeds == 0)
+	{
+		fprintf( stderr, "Bad seed count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	CheckKnownLayouts( Failures );
+	printf( "%-10s %6s %9s %-8s %13s %14s %12s %11s %10s %10s\n", "Frame", "Passes", "Resources", "Heaps",
+		"Unaliased MB", "LowerBound MB", "FirstUse MB", "BySize MB", "Aliasing", "us/pack" );
+	for (auto& R : RunBenchmark( NumSeeds, Failures ))
+	{
+		printf( "%-10s %6u %9u %-8s %13.1f %14.1f %12.1f %11.1f %10llu %10.1f\n", R.Frame, R.NumPasses, R.NumResources,
+			R.SeparateHeaps ? "per kind" : "one", R.UnaliasedBytes / 1048576.0, R.LowerBound / 1048576.0, R.FirstUseBytes / 1048576.0,
+			R.BySizeBytes / 1048576.0, (unsigned long long)R.NumAliasing, R.UsPerPack );
+		if (R.BySizeBytes < R.LowerBound || R.BySizeBytes > R.UnaliasedBytes || R.FirstUseBytes > R.UnaliasedBytes)
+			Failures.push_back( std::string( "transient-packer: packing outside its bounds on the " ) + R.Frame + " frame" );
+	}
+	return ReportFailures( Failures );
+}
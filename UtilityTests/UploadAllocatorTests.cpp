@@ -0,0 +1,450 @@
+// UploadRing on a stand-in GPU: blocks in order, a block which doesn't fit in front of the buffer
+// end skipping to the start, the tail freeing only retired blocks whose fence completed so a new
+// block reuses their bytes, waits on the oldest retired fence counted as one stall per allocation,
+// and failing without waiting when a block still being recorded is in the way, the request is
+// bigger than the ring or only fits with the bytes skipped at the buffer end.
+// Then a replay of per frame upload allocations against the two upload schemes of LinearAllocator:
+// kCpuWritable pages recycled through LinearPagePool, and kCpuRingBuffer blocks of an UploadRing
+// with pages as fallback. Both follow the policies of LinearAllocator on mock memory, the GPU
+// completes a frame's fences FramesInFlight frames later, or right away when the ring waits on one.
+// A ring the size of RingUploadAllocator must never stall and only leave big uploads to pages, a
+// small one must stall.
+
+#include "UtilityTests.h"
+#include "LinearPagePool.h"
+#include "UploadRing.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	// Same as LinearAllocator
+	const size_t kClassSizes[] = { 0x10000, 0x40000, 0x100000, 0x200000 };
+	const uint32_t kNumClasses = sizeof( kClassSizes ) / sizeof( kClassSizes[0] );
+	const size_t kRingBlockSize = 0x10000;
+
+	// Same as RingUploadAllocator
+	const size_t kRingCapacity = 0x1000000;
+	const uint32_t kFramesInFlight = 3;
+	const uint32_t kNumContexts = 4;
+
+	struct UploadTraceAlloc
+	{
+		uint32_t	SizeInByte;
+		uint16_t	Alignment;
+		uint16_t	Context;		// Every context finishes once at the end of the frame
+	};
+
+	struct UploadTraceFrame
+	{
+		uint32_t						NumContexts;
+		std::vector<UploadTraceAlloc>	Allocs;		// In recording order
+	};
+
+	typedef std::vector<UploadTraceFrame> UploadTrace;
+
+	struct UploadSimResult
+	{
+		double		AllocsPerSec;
+		uint64_t	PeakBytes;			// Pages alive, plus the ring itself
+		uint64_t	StallCount;			// Allocations waiting for the GPU, the ring only
+		uint64_t	BytesStalled;
+		uint64_t	NumFallbacks;		// Ring allocations served by a page
+	};
+
+	// Constant buffers and GUI geometry every frame, now and then a buffer upload of a few MB
+	UploadTrace MakeSyntheticUploadTrace( uint32_t NumFrames, uint32_t NumContexts, uint32_t Seed )
+	{
+		UploadTrace Trace( NumFrames );
+		for (auto& Frame : Trace)
+		{
+			Frame.NumContexts = NumContexts;
+			for (uint32_t Context = 0; Context < NumContexts; ++Context)
+			{
+				uint32_t NumConstants = 32 + (NextRandom( Seed ) >> 16) % 64;
+				for (uint32_t i = 0; i < NumConstants; ++i)
+				{
+					UploadTraceAlloc Alloc = { ((NextRandom( Seed ) >> 12) % 4 + 1) * 64, 256, (uint16_t)Context };
+					Frame.Allocs.push_back( Alloc );
+				}
+				// GUI vertex and index buffers
+				const uint32_t Random = NextRandom( Seed );
+				UploadTraceAlloc Vertices = { 0x8000 + (Random >> 8) % 0x8000, 256, (uint16_t)Context };
+				UploadTraceAlloc Indices = { 0x2000 + (Random >> 12) % 0x2000, 256, (uint16_t)Context };
+				Frame.Allocs.push_back( Vertices );
+				Frame.Allocs.push_back( Indices );
+			}
+			const uint32_t Random = NextRandom( Seed );
+			if ((Random >> 16) % 64 == 0)
+			{
+				UploadTraceAlloc Upload = { 0x100000 + Random % 0x300000, 512, 0 };
+				Frame.Allocs.push_back( Upload );
+			}
+		}
+		return Trace;
+	}
+
+	size_t AlignUp( size_t Value, size_t Alignment ) { return (Value + Alignment - 1) & ~(Alignment - 1); }
+
+	// Only counts bytes, the pages have no memory behind
+	class MockBackingStore : public ILinearPageBackingStore
+	{
+	public:
+		MockBackingStore() :m_LiveBytes( 0 ), m_PeakBytes( 0 ) {}
+		virtual LinearPage* CreatePage( size_t SizeInByte ) override
+		{
+			m_LiveBytes += SizeInByte;
+			m_PeakBytes = (std::max)( m_PeakBytes, m_LiveBytes );
+			return new LinearPage();
+		}
+		virtual void DestroyPage( LinearPage* pPage ) override
+		{
+			m_LiveBytes -= pPage->m_SizeInByte;
+			delete pPage;
+		}
+		uint64_t GetPeakBytes() const { return m_PeakBytes; }
+
+	private:
+		uint64_t	m_LiveBytes;
+		uint64_t	m_PeakBytes;
+	};
+
+	// LinearAllocator on mock memory: pages of an adaptive size class per fence interval and large
+	// pages above, or blocks of the ring with large pages as fallback
+	class SimAllocator
+	{
+	public:
+		SimAllocator( LinearPagePool& Pool, UploadRing* pRing, FakeFences& Gpu )
+			:m_Pool( Pool ), m_pRing( pRing ), m_Gpu( Gpu ), m_CurPage( nullptr ), m_CurOffset( 0 ), m_NextClass( 0 ),
+			m_IntervalBytes( 0 ), m_NumFallbacks( 0 )
+		{
+			m_CurBlock.Size = 0;
+		}
+
+		void Allocate( size_t SizeInByte, size_t Alignment )
+		{
+			const size_t AlignedSize = AlignUp( SizeInByte, Alignment );
+			if (m_pRing != nullptr)
+				AllocateFromRing( AlignedSize, Alignment );
+			else if (AlignedSize > m_Pool.GetMaxClassSize())
+				AllocateLargePage( AlignedSize );
+			else
+				AllocateFromPage( AlignedSize, Alignment );
+		}
+
+		void Cleanup( uint64_t FenceValue )
+		{
+			if (m_CurBlock.Size != 0)
+				RetireCurBlock();
+			for (auto BlockId : m_RetiredBlocks)
+				m_pRing->Retire( BlockId, FenceValue );
+			m_RetiredBlocks.clear();
+			if (m_CurPage != nullptr)
+				RetireCurPage();
+			if (m_RetiredPages.empty())
+				return;
+			m_NextClass = (std::min)( m_Pool.GetSizeClass( m_IntervalBytes ), m_Pool.GetNumClasses() - 1 );
+			m_IntervalBytes = 0;
+			m_Pool.DiscardPages( FenceValue, m_RetiredPages );
+			m_RetiredPages.clear();
+		}
+
+		uint64_t GetNumFallbacks() const { return m_NumFallbacks; }
+
+	private:
+		void AllocateFromPage( size_t AlignedSize, size_t Alignment )
+		{
+			if (m_CurPage != nullptr)
+			{
+				m_CurOffset = AlignUp( m_CurOffset, Alignment );
+				if (m_CurOffset + AlignedSize > m_CurPage->m_SizeInByte)
+				{
+					m_NextClass = (std::min)( m_CurPage->m_SizeClass + 1, m_Pool.GetNumClasses() - 1 );
+					RetireCurPage();
+				}
+			}
+			if (m_CurPage == nullptr)
+			{
+				m_CurPage = m_Pool.RequestPage( (std::max)( m_NextClass, m_Pool.GetSizeClass( AlignedSize ) ) );
+				m_CurOffset = 0;
+			}
+			m_CurOffset += AlignedSize;
+			m_IntervalBytes += AlignedSize;
+		}
+
+		void AllocateFromRing( size_t AlignedSize, size_t Alignment )
+		{
+			if (m_CurBlock.Size != 0)
+			{
+				m_CurOffset = AlignUp( m_CurOffset, Alignment );
+				if (m_CurOffset + AlignedSize > m_CurBlock.Size)
+					RetireCurBlock();
+			}
+			if (m_CurBlock.Size == 0)
+			{
+				FakeFences& Gpu = m_Gpu;
+				if (AlignedSize > m_pRing->GetCapacity() / 8 ||
+					!m_pRing->Allocate( (std::max)( AlignedSize, kRingBlockSize ), m_CurBlock,
+						[&Gpu]( uint64_t FenceValue ) { Gpu.Complete( FenceValue ); } ))
+				{
+					m_NumFallbacks++;
+					AllocateLargePage( AlignedSize );
+					return;
+				}
+				m_CurOffset = 0;
+			}
+			m_CurOffset += AlignedSize;
+		}
+
+		void AllocateLargePage( size_t AlignedSize )
+		{
+			LinearPage* pPage = m_Pool.RequestLargePage( AlignedSize );
+			pPage->m_UsedBytes = AlignedSize;
+			m_RetiredPages.push_back( pPage );
+		}
+
+		void RetireCurPage()
+		{
+			m_CurPage->m_UsedBytes = (std::min)( m_CurOffset, m_CurPage->m_SizeInByte );
+			m_RetiredPages.push_back( m_CurPage );
+			m_CurPage = nullptr;
+			m_CurOffset = 0;
+		}
+
+		void RetireCurBlock()
+		{
+			m_RetiredBlocks.push_back( m_CurBlock.Id );
+			m_CurBlock.Size = 0;
+			m_CurOffset = 0;
+		}
+
+		LinearPagePool&				m_Pool;
+		UploadRing*					m_pRing;
+		FakeFences&					m_Gpu;
+		LinearPage*					m_CurPage;
+		size_t						m_CurOffset;
+		uint32_t					m_NextClass;
+		size_t						m_IntervalBytes;
+		std::vector<LinearPage*>	m_RetiredPages;
+		UploadRingBlock				m_CurBlock;
+		std::vector<uint64_t>		m_RetiredBlocks;
+		uint64_t					m_NumFallbacks;
+	};
+
+	UploadSimResult Replay( const UploadTrace& Trace, size_t RingCapacity, uint32_t FramesInFlight )
+	{
+		MockBackingStore BackingStore;
+		FakeFences Gpu;
+		LinearPagePool Pool( kClassSizes, kNumClasses );
+		Pool.SetBackend( &BackingStore, &Gpu );
+		// One thread replays everything, magazines would only add noise
+		Pool.SetUseMagazines( false );
+		UploadRing Ring;
+		if (RingCapacity != 0)
+			Ring.Create( RingCapacity, &Gpu );
+
+		std::vector<SimAllocator> Allocators;
+		std::vector<uint64_t> FrameFences;
+		uint64_t NumAllocs = 0;
+		auto Start = std::chrono::high_resolution_clock::now();
+		for (auto& Frame : Trace)
+		{
+			while (Allocators.size() < Frame.NumContexts)
+				Allocators.emplace_back( Pool, RingCapacity != 0 ? &Ring : nullptr, Gpu );
+			for (auto& Alloc : Frame.Allocs)
+				Allocators[Alloc.Context].Allocate( Alloc.SizeInByte, Alloc.Alignment );
+			NumAllocs += Frame.Allocs.size();
+
+			uint64_t FenceValue = 0;
+			for (uint32_t i = 0; i < Frame.NumContexts; ++i)
+			{
+				FenceValue = Gpu.Signal();
+				Allocators[i].Cleanup( FenceValue );
+			}
+			FrameFences.push_back( FenceValue );
+			if (FrameFences.size() > FramesInFlight)
+				Gpu.Complete( FrameFences[FrameFences.size() - 1 - FramesInFlight] );
+		}
+		std::chrono::duration<double> Elapsed = std::chrono::high_resolution_clock::now() - Start;
+
+		UploadSimResult Result;
+		Result.AllocsPerSec = NumAllocs / (std::max)( Elapsed.count(), 1e-9 );
+		Result.PeakBytes = BackingStore.GetPeakBytes() + RingCapacity;
+		Result.NumFallbacks = 0;
+		for (auto& Allocator : Allocators)
+			Result.NumFallbacks += Allocator.GetNumFallbacks();
+		UploadRingStats RingStats = Ring.GetStats();
+		Result.StallCount = RingStats.StallCount;
+		Result.BytesStalled = RingStats.BytesStalled;
+		Pool.Destroy();
+		return Result;
+	}
+
+	// 64KB ring, every step of it follows from the ones before
+	void CheckRing( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "upload-allocator" );
+
+		FakeFences Gpu;
+		UploadRing Ring;
+		Ring.Create( 0x10000, &Gpu );
+		std::vector<uint64_t> Waits;
+		auto Wait = [&]( uint64_t FenceValue )
+		{
+			Waits.push_back( FenceValue );
+			Gpu.Complete( FenceValue );
+		};
+
+		UploadRingBlock A, B, C, D, E, F, G, H;
+		Check( Ring.Allocate( 0x4000, A, Wait ) && Ring.Allocate( 0x4000, B, Wait ) && Ring.Allocate( 0x6000, C, Wait ),
+			"blocks handed out while the ring has room" );
+		Check( A.Offset == 0 && B.Offset == 0x4000 && C.Offset == 0x8000, "blocks in order" );
+
+		// 0x2000 left in front of the end, D skips them and needs the bytes of A
+		Check( !Ring.Allocate( 0x3000, D, Wait ), "block still recorded in the way fails" );
+		Check( Waits.empty(), "no wait on a block still recorded" );
+		Check( Ring.GetStats().NumFailed == 1 && Ring.GetStats().StallCount == 0, "failure counted, not as a stall" );
+
+		const uint64_t FenceA = Gpu.Signal();
+		Ring.Retire( A.Id, FenceA );
+		const uint64_t FenceB = Gpu.Signal();
+		Ring.Retire( B.Id, FenceB );
+		Check( Ring.Allocate( 0x3000, D, Wait ), "block handed out after waiting on a retired one" );
+		Check( Waits.size() == 1 && Waits[0] == FenceA, "wait on the oldest retired fence only" );
+		Check( D.Offset == 0 && D.Size == 0x3000, "block skips to the start" );
+		UploadRingStats Stats = Ring.GetStats();
+		Check( Stats.SkippedBytes == 0x2000, "skipped bytes counted" );
+		Check( Stats.StallCount == 1 && Stats.BytesStalled == 0x3000, "stall counted" );
+		Check( Stats.UsedBytes == 0xF000 && Stats.PeakUsedBytes == 0xF000, "used bytes include the skipped ones" );
+
+		// Wrap-around: E fills the ring, F reuses the bytes of B once its fence completed
+		Check( Ring.Allocate( 0x1000, E, Wait ) && E.Offset == 0x3000, "block after the skipped one follows it" );
+		Check( Ring.Allocate( 0x2000, F, Wait ) && F.Offset == 0x4000, "block reuses the bytes freed by the tail" );
+		Check( Waits.size() == 2 && Waits[1] == FenceB, "wait on the fence of the freed block" );
+
+		// G needs the bytes of C and D, waiting on both is still one stall
+		Ring.Retire( C.Id, Gpu.Signal() );
+		Ring.Retire( D.Id, Gpu.Signal() );
+		Ring.Retire( E.Id, Gpu.Signal() );
+		Ring.Retire( F.Id, Gpu.Signal() );
+		Check( Ring.Allocate( 0xA000, G, Wait ) && G.Offset == 0x6000, "block handed out after waiting on two" );
+		Check( Waits.size() == 4, "wait on fences until enough is freed" );
+		Stats = Ring.GetStats();
+		Check( Stats.StallCount == 3 && Stats.BytesStalled == 0xF000, "one stall per allocation" );
+
+		Check( !Ring.Allocate( 0x11000, H, Wait ), "block bigger than the ring fails" );
+		Check( Waits.size() == 4 && Ring.GetStats().NumFailed == 2, "failure without waiting" );
+		Check( Ring.Allocate( 1, H, Wait ) && H.Offset == 0 && H.Size == UploadRing::kBlockAlign, "size rounded to blocks" );
+		Stats = Ring.GetStats();
+		Check( Stats.NumBlocks == 8 && Stats.StallCount == 3, "every block counted" );
+		Check( Stats.PeakUsedBytes == 0x10000, "peak of a full ring" );
+		Ring.Destroy();
+	}
+
+	// Past the first block a request of the whole ring only fits with the bytes skipped in front of
+	// the buffer end, so it never fits and must fail right away, with or without blocks in the ring
+	void CheckTooBigPastStart( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "upload-allocator" );
+
+		FakeFences Gpu;
+		UploadRing Ring;
+		Ring.Create( 0x10000, &Gpu );
+		std::vector<uint64_t> Waits;
+		auto Wait = [&]( uint64_t FenceValue ) { Waits.push_back( FenceValue ); Gpu.Complete( FenceValue ); };
+		UploadRingBlock A, B, C;
+		Ring.Allocate( 0x1000, A, Wait );
+		const uint64_t FenceA = Gpu.Signal();
+		Ring.Retire( A.Id, FenceA );
+		Gpu.Complete( FenceA );
+		Check( !Ring.Allocate( 0x10000, B, Wait ), "whole ring past the start of an empty ring fails" );
+		Ring.Allocate( 0x1000, C, Wait );
+		Ring.Retire( C.Id, Gpu.Signal() );
+		Check( !Ring.Allocate( 0xF800, B, Wait ), "request fitting only with the skipped bytes fails" );
+		Check( Waits.empty() && Ring.GetStats().NumFailed == 2, "failure without waiting" );
+		Ring.Destroy();
+	}
+
+	// RingUploadAllocator waits without its lock, so another uploader may take the freed bytes
+	// before the waiting one tries again
+	void CheckWaitUnlocked( std::vector<std::string>& Failures )
+	{
+		const Checker Check( Failures, "upload-allocator" );
+
+		FakeFences Gpu;
+		UploadRing Ring;
+		Ring.Create( 0x10000, &Gpu );
+		UploadRingBlock A, B, C, X;
+		Ring.Allocate( 0x8000, A, []( uint64_t ) {} );
+		Ring.Allocate( 0x8000, B, []( uint64_t ) {} );
+		const uint64_t FenceA = Gpu.Signal();
+		Ring.Retire( A.Id, FenceA );
+		const uint64_t FenceB = Gpu.Signal();
+		Ring.Retire( B.Id, FenceB );
+
+		std::vector<uint64_t> Waits;
+		bool OtherAllocated = false;
+		auto Wait = [&]( uint64_t FenceValue )
+		{
+			Waits.push_back( FenceValue );
+			Gpu.Complete( FenceValue );
+			// The other uploader got the lock first and finds A's bytes free
+			if (!OtherAllocated)
+				OtherAllocated = Ring.Allocate( 0x8000, X, []( uint64_t ) {} );
+		};
+		Check( Ring.Allocate( 0x8000, C, Wait ), "block handed out after another took the first bytes freed" );
+		Check( OtherAllocated && X.Offset == 0 && C.Offset == 0x8000, "blocks taken while waiting not handed out twice" );
+		Check( Waits.size() == 2 && Waits[0] == FenceA && Waits[1] == FenceB, "waits again on the next fence" );
+		Check( Ring.GetStats().StallCount == 1, "one stall for the waiting allocation" );
+		Ring.Destroy();
+	}
+
+	uint64_t CountBigUploads( const UploadTrace& Trace, size_t RingCapacity )
+	{
+		uint64_t Count = 0;
+		for (auto& Frame : Trace)
+			for (auto& Alloc : Frame.Allocs)
+				if (AlignUp( Alloc.SizeInByte, Alloc.Alignment ) > RingCapacity / 8)
+					Count++;
+		return Count;
+	}
+}
+
+// [NumFrames]
+uint64_t RunUploadAllocatorTests( int argc, char* argv[] )
+{
+	const uint32_t NumFrames = GetCountArg( argc, argv, 1, 2000 );
+	if (NumFrames == 0)
+	{
+		fprintf( stderr, "Bad frame count\n" );
+		return 1;
+	}
+	std::vector<std::string> Failures;
+	const Checker Check( Failures, "upload-allocator" );
+	CheckRing( Failures );
+	CheckTooBigPastStart( Failures );
+	CheckWaitUnlocked( Failures );
+
+	const UploadTrace Trace = MakeSyntheticUploadTrace( NumFrames, kNumContexts, 1 );
+	const size_t kSmallRingCapacity = kRingCapacity / 16;
+	const UploadSimResult Pages = Replay( Trace, 0, kFramesInFlight );
+	const UploadSimResult Ring = Replay( Trace, kRingCapacity, kFramesInFlight );
+	const UploadSimResult SmallRing = Replay( Trace, kSmallRingCapacity, kFramesInFlight );
+	Check( Pages.StallCount == 0 && Pages.NumFallbacks == 0, "pages neither stall nor fall back" );
+	Check( Ring.StallCount == 0, "ring of RingUploadAllocator's size doesn't stall" );
+	Check( Ring.NumFallbacks == CountBigUploads( Trace, kRingCapacity ), "ring of RingUploadAllocator's size leaves only big uploads to pages" );
+	Check( SmallRing.StallCount > 0, "small ring stalls" );
+	Check( SmallRing.BytesStalled >= SmallRing.StallCount * kRingBlockSize, "stalled bytes of at least a block each" );
+	Check( SmallRing.NumFallbacks >= CountBigUploads( Trace, kSmallRingCapacity ), "small ring leaves big uploads to pages" );
+
+	printf( "%-10s %10s %8s %8s %11s %10s\n", "Allocator", "Mallocs/s", "Peak MB", "Stalls", "Stalled MB", "Fallbacks" );
+	const char* Names[] = { "Pages", "Ring", "Ring/16" };
+	const UploadSimResult* Results[] = { &Pages, &Ring, &SmallRing };
+	for (int i = 0; i < 3; ++i)
+		printf( "%-10s %10.2f %8.2f %8llu %11.2f %10llu\n", Names[i], Results[i]->AllocsPerSec / 1e6,
+			Results[i]->PeakBytes / 1048576.0, (unsigned long long)Results[i]->StallCount,
+			Results[i]->BytesStalled / 1048576.0, (unsigned long long)Results[i]->NumFallbacks );
+	return ReportFailures( Failures );
+}
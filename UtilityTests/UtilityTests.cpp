@@ -0,0 +1,79 @@
+// What the areas share: failure reporting, arguments and FakeFences.
+
+#include "UtilityTests.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+uint64_t ReportFailures( const std::vector<std::string>& Failures )
+{
+	for (auto& Failure : Failures)
+		printf( "FAILED: %s\n", Failure.c_str() );
+	printf( "Checks failed: %u\n", (uint32_t)Failures.size() );
+	return Failures.size();
+}
+
+uint32_t GetCountArg( int argc, char* argv[], int Index, uint32_t Default )
+{
+	if (argc <= Index)
+		return Default;
+	const int Count = atoi( argv[Index] );
+	return Count > 0 ? (uint32_t)Count : 0;
+}
+
+//--------------------------------------------------------------------------------------
+// FakeFences
+//--------------------------------------------------------------------------------------
+FakeFences::FakeFences( std::initializer_list<uint32_t> Types )
+	:m_Types( Types ), m_Next( new std::atomic<uint64_t>[Types.size()] ), m_Completed( new std::atomic<uint64_t>[Types.size()] )
+{
+	for (size_t q = 0; q < m_Types.size(); ++q)
+	{
+		m_Completed[q] = (uint64_t)m_Types[q] << 56;
+		m_Next[q] = m_Completed[q] + 1;
+	}
+}
+
+int FakeFences::FindQueue( uint64_t FenceValue ) const
+{
+	const uint32_t Type = (uint32_t)(FenceValue >> 56);
+	for (size_t q = 0; q < m_Types.size(); ++q)
+	{
+		if (m_Types[q] == Type)
+			return (int)q;
+	}
+	return -1;
+}
+
+bool FakeFences::IsFenceComplete( uint64_t FenceValue )
+{
+	const int Queue = FindQueue( FenceValue );
+	return Queue >= 0 && FenceValue <= m_Completed[Queue].load( std::memory_order_acquire );
+}
+
+uint64_t FakeFences::Signal( uint32_t Queue )
+{
+	return m_Next[Queue].fetch_add( 1, std::memory_order_relaxed );
+}
+
+void FakeFences::Complete( uint64_t FenceValue )
+{
+	const int Queue = FindQueue( FenceValue );
+	if (Queue < 0)
+		return;
+	uint64_t Completed = m_Completed[Queue].load( std::memory_order_relaxed );
+	while (Completed < FenceValue && !m_Completed[Queue].compare_exchange_weak( Completed, FenceValue, std::memory_order_release ));
+}
+
+void FakeFences::Advance( uint32_t Queue, uint64_t Count )
+{
+	const uint64_t Last = m_Next[Queue].load( std::memory_order_relaxed ) - 1;
+	const uint64_t Completed = m_Completed[Queue].load( std::memory_order_relaxed );
+	m_Completed[Queue].store( Completed + Count < Last ? Completed + Count : Last, std::memory_order_release );
+}
+
+void FakeFences::Drain()
+{
+	for (uint32_t q = 0; q < GetNumQueues(); ++q)
+		m_Completed[q].store( m_Next[q].load( std::memory_order_relaxed ) - 1, std::memory_order_release );
+}
@@ -0,0 +1,107 @@
+#pragma once
+// Areas of the Linux test driver, one file each. An area runs its checks and benchmarks with the
+// arguments given after its name, prints what it measured and returns the number of checks failed
+// and errors seen, 0 when everything passed. Checker, NextRandom() and FakeFences are shared by all
+// areas, in UtilityTests.cpp.
+
+#include <stdint.h>
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "LinearPagePool.h"
+
+struct BarrierStream;
+struct BarrierBatch;
+
+uint64_t RunGpuTimelineTests( int argc, char* argv[] );
+uint64_t RunCommandListBatchTests( int argc, char* argv[] );
+uint64_t RunFenceNotifierTests( int argc, char* argv[] );
+uint64_t RunBarrierOptimizerTests( int argc, char* argv[] );
+uint64_t RunRenderGraphTests( int argc, char* argv[] );
+uint64_t RunTransientPackerTests( int argc, char* argv[] );
+uint64_t RunPipelineCacheTests( int argc, char* argv[] );
+uint64_t RunShaderCacheTests( int argc, char* argv[] );
+uint64_t RunDescriptorRangeAllocatorTests( int argc, char* argv[] );
+uint64_t RunBindlessIndexAllocatorTests( int argc, char* argv[] );
+uint64_t RunDescriptorTableLRUTests( int argc, char* argv[] );
+uint64_t RunDescriptorHeapTierPolicyTests( int argc, char* argv[] );
+uint64_t RunBoidsAsyncComputeTests( int argc, char* argv[] );
+uint64_t RunNullDeviceTests( int argc, char* argv[] );
+uint64_t RunDescriptorBlockRingTests( int argc, char* argv[] );
+uint64_t RunFenceRecyclerTests( int argc, char* argv[] );
+uint64_t RunLinearPagePoolTests( int argc, char* argv[] );
+uint64_t RunUploadAllocatorTests( int argc, char* argv[] );
+uint64_t RunTaskSchedulerTests( int argc, char* argv[] );
+uint64_t RunBoidsEngineTests( int argc, char* argv[] );
+
+// Prints a line for each failure and how many there were, returns that
+uint64_t ReportFailures( const std::vector<std::string>& Failures );
+
+// Adds "Prefix: What Suffix" to Failures when a check fails, returns the condition so a caller can
+// stop early
+class Checker
+{
+public:
+	Checker( std::vector<std::string>& Failures, const std::string& Prefix, const std::string& Suffix = std::string() )
+		:m_Failures( Failures ), m_Prefix( Prefix + ": " ), m_Suffix( Suffix ) {}
+	bool operator()( bool Condition, const std::string& What ) const
+	{
+		if (!Condition)
+			m_Failures.push_back( m_Prefix + What + m_Suffix );
+		return Condition;
+	}
+
+private:
+	std::vector<std::string>&	m_Failures;
+	std::string					m_Prefix;
+	std::string					m_Suffix;
+};
+
+// The LCG every area draws its random cases from, so a seed means the same case everywhere
+inline uint32_t NextRandom( uint32_t& Seed )
+{
+	Seed = Seed * 1664525u + 1013904223u;
+	return Seed >> 8;
+}
+
+// Fences of a few queues which only complete when told to. Fence values carry the queue type in the
+// top 8 bits like GpuQueue's, so the default single queue of type 0 counts 1, 2, 3 from 0 completed.
+// Signal() and Complete() are thread safe, Advance() and Drain() are for one thread.
+class FakeFences : public IFenceOracle
+{
+public:
+	// D3D12_COMMAND_LIST_TYPE of each queue
+	explicit FakeFences( std::initializer_list<uint32_t> Types = { 0 } );
+
+	virtual bool IsFenceComplete( uint64_t FenceValue ) override;
+	uint32_t GetNumQueues() const { return (uint32_t)m_Types.size(); }
+	// The next fence of Queue
+	uint64_t Signal( uint32_t Queue = 0 );
+	// The last fence signaled on Queue, the one before its first fence when nothing was
+	uint64_t GetLastSignaled( uint32_t Queue = 0 ) const { return m_Next[Queue].load( std::memory_order_relaxed ) - 1; }
+	// FenceValue and every fence of its queue before it
+	void Complete( uint64_t FenceValue );
+	// Up to Count more of the fences signaled on Queue
+	void Advance( uint32_t Queue, uint64_t Count );
+	// Every fence signaled so far
+	void Drain();
+
+private:
+	int FindQueue( uint64_t FenceValue ) const;
+
+	std::vector<uint32_t>						m_Types;
+	std::unique_ptr<std::atomic<uint64_t>[]>	m_Next;
+	std::unique_ptr<std::atomic<uint64_t>[]>	m_Completed;
+};
+
+// Number of errors: a barrier whose StateBefore doesn't match, a work seeing a subresource in another
+// state than it asked for or mid split, a UAV request without a barrier since the resource was last
+// used, or a split barrier left open or spanning a flush. In BarrierOptimizerTests.cpp, render-graph
+// checks its plans with it too
+uint64_t ValidateBarriers( const BarrierStream& Stream, const std::vector<BarrierBatch>& Batches );
+
+// argv[Index] as a count of at least 1, Default when not given, 0 when it isn't a count
+uint32_t GetCountArg( int argc, char* argv[], int Index, uint32_t Default );